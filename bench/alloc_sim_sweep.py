@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""
+Sweep allocator policies and parameters over a recorded trace with the offline
+simulator (see `cfs/sched/AllocSim.h`). Record the trace from a live run with
+`fsMetricsDump -i 100 -r trace.txt`, then run, e.g.,
+
+    ./alloc_sim_sweep.py trace.txt --cache-delta 16 64 256 --window 250 500
+
+Every combination of the policy flags, the cache trading granularity and the
+stat window is replayed in parallel; the configurations are printed ordered by
+the minimum improvement over the initial resources, which is what the
+allocator maximizes.
+"""
+import argparse
+import itertools
+import multiprocessing
+import re
+import subprocess
+
+from ufs_build import get_ufs_build_dir
+
+policy_flags = [
+    "NO_HARVEST",
+    "NO_SYMM_PARTITION",
+    "NO_AVOID_TINY_WEIGHT",
+    "NO_CACHE_PARTITION",
+]
+min_improve_re = re.compile(r"^# min_improve=(-?[\d.]+)%$", re.M)
+
+
+def run_sim(args):
+    sim_bin, trace, flags, cache_delta_mb, window_ms, freq_ms = args
+    cmd = [
+        str(sim_bin), "-s", "-t", trace, "-d", str(cache_delta_mb), "-w",
+        str(window_ms), "-f", str(max(freq_ms, window_ms))
+    ]
+    if flags:
+        cmd += ["-p", ",".join(flags)]
+    out = subprocess.run(cmd, capture_output=True, text=True, check=True).stdout
+    m = min_improve_re.search(out)
+    min_improve = float(m.group(1)) if m else float("nan")
+    return flags, cache_delta_mb, window_ms, min_improve
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("trace", help="trace recorded by `fsMetricsDump -r`")
+    parser.add_argument("--cache-delta", type=float, nargs="+", default=[64],
+                        help="cache trading granularity (MB)")
+    parser.add_argument("--window", type=int, nargs="+", default=[500],
+                        help="stat collection window (ms)")
+    parser.add_argument("--freq", type=int, default=1000,
+                        help="allocation period (ms)")
+    parser.add_argument("-j", "--jobs", type=int, default=None)
+    parser.add_argument("--sim-bin", default=get_ufs_build_dir() / "fsAllocSim")
+    args = parser.parse_args()
+
+    flag_sets = [
+        list(c) for n in range(len(policy_flags) + 1)
+        for c in itertools.combinations(policy_flags, n)
+    ]
+    configs = [(args.sim_bin, args.trace, flags, d, w, args.freq)
+               for flags, d, w in itertools.product(
+                   flag_sets, args.cache_delta, args.window)]
+    with multiprocessing.Pool(args.jobs) as pool:
+        results = pool.map(run_sim, configs)
+
+    results.sort(key=lambda r: r[3], reverse=True)
+    print(f"{'min_improve':>11} {'delta_mb':>8} {'window_ms':>9} flags")
+    for flags, d, w, min_improve in results:
+        print(f"{min_improve:>10.2f}% {d:>8g} {w:>9} "
+              f"{','.join(flags) if flags else '-'}")
+
+
+if __name__ == "__main__":
+    main()
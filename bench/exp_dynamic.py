@@ -1,6 +1,7 @@
 #!/usr/bin/env python3
 import argparse
 from pathlib import Path
+import pandas as pd
 from typing import Optional, Union, List
 
 from ufs_build import ufs_configure_then_build
@@ -66,14 +67,14 @@ def get_workload_config_pairs(
     return result
 
 
-def export_dynamic_spec():
+def export_dynamic_spec(is_symm: bool = True):
     exp_config = ExpConfig(
         num_workers=4,
         num_apps=4,
         num_threads_per_app=4,
         num_files_per_app=32,
         use_affinity=True,
-        is_symm=True,
+        is_symm=is_symm,
     )
 
     app1_wl = get_workload_config_pairs(
@@ -118,7 +119,7 @@ def export_dynamic_spec():
         prep=Prep(files=exp_config.files),
     )
 
-    return exp.export_with_name("exp_dynamic")
+    return exp.export_with_name("exp_dynamic" if is_symm else "exp_dynamic_asymm")
 
 
 def run_exp_dynamic(spec_path: Path):
@@ -180,13 +181,66 @@ def plot_exp_dynamic():
     make_dynamic_legend_policy(output_dir_hare / "dynamic_legend_policy")
 
 
+def run_exp_dynamic_migration(spec_path: Path):
+    # with asymmetric partition, each app starts on its own worker and HARE
+    # moves files across workers, so every allocation may migrate inodes
+    ufs_configure_then_build(sched=True, leveldb=False,
+                             fine_grained=False, high_freq=True)
+    output_dir = prepare_output_dir("exp_dynamic_migration")
+    run_bench(spec_path, output_dir,
+              ufs_cmd=get_ufs_cmd_dynamic(is_symm=False))
+
+
+def report_migration_dips(df: pd.DataFrame, results_dir: Path,
+                          window: int = 5, threshold: float = 0.9):
+    """
+    Throughput lost around migrations: for each app, compare the throughput of
+    each epoch (summed over threads) with the rolling median of the epochs
+    around it; an epoch below `threshold` of the median counts as a dip.
+    """
+    rows = []
+    for app, df_app in df.groupby("app"):
+        tp = df_app.groupby("epoch")["throughput"].sum()
+        baseline = tp.rolling(window, center=True, min_periods=1).median()
+        loss = (baseline - tp).clip(lower=0)
+        dips = tp < threshold * baseline
+        rows.append({
+            "app": app,
+            "num_epochs": len(tp),
+            "num_dips": int(dips.sum()),
+            "worst_ratio": (tp / baseline).min(),
+            "loss_pct": 100 * loss.sum() / baseline.sum(),
+        })
+    df_dips = pd.DataFrame(rows)
+    df_dips.to_csv(results_dir / "migration_dips.csv", index=False)
+    print(df_dips.to_string(index=False))
+    return df_dips
+
+
+def plot_exp_dynamic_migration():
+    output_dir = get_output_dir("exp_dynamic_migration")
+    df = parse_and_plot_single(output_dir)
+    report_migration_dips(df, output_dir)
+
+
 def main():
     parser = argparse.ArgumentParser()
     parser.add_argument("--plot",
                         help="Only plot the data",
                         action="store_true")
+    parser.add_argument("--migration",
+                        help="Run with asymmetric partition (inodes migrate "
+                        "across workers) and report the throughput dips",
+                        action="store_true")
     args = parser.parse_args()
 
+    if args.migration:
+        spec_path = export_dynamic_spec(is_symm=False)
+        if not args.plot:
+            run_exp_dynamic_migration(spec_path)
+        plot_exp_dynamic_migration()
+        return
+
     spec_path = export_dynamic_spec()
 
     if not args.plot:
@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""
+One tenant mixing a Zipfian workload with a sequential scan, run once per
+cache replacement policy (see `cfs/sched/CachePolicy.h`). With LRU, the scan
+keeps evicting the Zipfian hot set; 2Q and ARC confine the scan to the
+probation partition.
+"""
+import argparse
+import os
+import shutil
+import time
+
+import pandas as pd
+
+from exp_utils import prepare_output_dir, get_output_dir
+from parse_single import parse_single
+from spec import App, OffsetType
+from spec_app import ExpConfig, WorkloadConfigPerApp
+from ufs_build import ufs_configure_then_build
+from ufs_run import get_ufs_cmd
+from utils import run_bench
+
+exp_name = "exp_scan_zipf"
+policies = ["lru", "2q", "arc"]
+num_workers = 4
+duration_sec = 60
+
+
+def export_scan_zipf_spec(zipf_ws_gb: float, scan_ws_gb: float):
+    # even threads run Zipf, odd threads scan; each worker gets one of each
+    exp_config = ExpConfig(
+        num_workers=num_workers,
+        num_apps=1,
+        num_threads_per_app=2 * num_workers,
+        num_files_per_app=8 * num_workers,
+        use_affinity=True,
+        is_symm=True,
+    )
+    # only the half of the files owned by each kind of threads is accessed
+    zipf = exp_config.get_app(0, "zipf", WorkloadConfigPerApp(
+        offset_type=OffsetType.ZIPF,
+        zipf_theta=0.99,
+        working_set_gb=2 * zipf_ws_gb,
+        read_ratio=1.0,
+        qdepth=1,
+        duration_sec=duration_sec,
+        count=4096,
+    ))
+    scan = exp_config.get_app(0, "scan", WorkloadConfigPerApp(
+        offset_type=OffsetType.SEQ,
+        working_set_gb=2 * scan_ws_gb,
+        read_ratio=1.0,
+        qdepth=1,
+        duration_sec=duration_sec,
+        count=4096,
+    ))
+    app = App(
+        desc=f"{zipf.desc}; {scan.desc}",
+        aid=0,
+        name="scan+zipf",
+        threads=[(zipf if tid % 2 == 0 else scan).threads[tid]
+                 for tid in range(2 * num_workers)],
+    )
+    return exp_config.get_exp([app]).export_with_name(exp_name)
+
+
+def run_exp_scan_zipf(output_dir, zipf_ws_gb, scan_ws_gb, overwrite=False):
+    ufs_configure_then_build(sched=True, leveldb=False,
+                             fine_grained=False, high_freq=False)
+    spec_path = export_scan_zipf_spec(zipf_ws_gb, scan_ws_gb)
+    for policy in policies:
+        time.sleep(1)
+        exp_dir = output_dir / policy
+        if os.path.exists(exp_dir):
+            if overwrite:
+                shutil.rmtree(exp_dir)
+            else:
+                raise ValueError("Experiment directory already exists!")
+        ufs_cmd = get_ufs_cmd(
+            num_workers=num_workers,
+            num_apps=1,
+            total_cache_mb=1024,
+            total_bandwidth_mbps=1024,
+            core_ids=[33, 34, 35, 36],
+            cache_policies={0: policy},
+        )
+        run_bench(spec_path, exp_dir, ufs_cmd, timeout=duration_sec + 30)
+
+
+def report_exp_scan_zipf(results_dir):
+    # steady-state throughput of each kind of thread under each policy
+    rows = []
+    for policy in policies:
+        df = parse_single(results_dir / policy)
+        df = df[df["ts_sec"] >= df["ts_sec"].max() / 2]
+        tput = df.groupby(["app", "ts_sec"])["throughput"].sum()
+        for app, t in tput.groupby(level=0):
+            rows.append({"policy": policy, "app": app, "throughput": t.mean()})
+    summary = pd.DataFrame(rows).pivot(index="policy", columns="app",
+                                       values="throughput")
+    summary.to_csv(results_dir / "policy_throughput.csv")
+    print(summary.to_string())
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--zipf_ws", help="Zipf working set in GB",
+                        type=float, default=1)
+    parser.add_argument("--scan_ws", help="scanned size in GB",
+                        type=float, default=4)
+    parser.add_argument("--overwrite",
+                        help="Write data to the existing directory",
+                        action="store_true")
+    parser.add_argument("--plot", help="Only report the data",
+                        action="store_true")
+    args = parser.parse_args()
+
+    if not args.plot:
+        run_exp_scan_zipf(prepare_output_dir(exp_name, args.overwrite),
+                          args.zipf_ws, args.scan_ws, args.overwrite)
+    report_exp_scan_zipf(get_output_dir(exp_name))
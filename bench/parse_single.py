@@ -5,15 +5,31 @@ import numpy as np
 from pathlib import Path
 
 
+# tail latency appended by Stat::Info::get_latency_tail_str(); optional so that
+# logs from older runs can still be parsed
+tail_re = (
+    r"(?: p50/p99/p99\.9/max: (?P<p50>\d+\.\d+)/(?P<p99>\d+\.\d+)/"
+    r"(?P<p999>\d+\.\d+)/(?P<lat_max>\d+\.\d+) us)?"
+)
+tail_cols = ["p50", "p99", "p999", "lat_max"]
+
+
+def parse_tail(result):
+    for col in tail_cols:
+        result[col] = np.nan if result[col] is None else float(result[col])
+
+
 def parse_line(line):
-    # Example: [2022-11-18 04:02:34.849] [App1-T1] [info] [stat.h:57] App1-T1-W1: Epoch 0: 10362 ops in 0.1 s (404.71 MB/s, 9.652 us/op)
+    # Example: [2022-11-18 04:02:34.849] [App1-T1] [info] [stat.h:57] App1-T1-W1: Epoch 0: 10362 ops in 0.1 s (404.71 MB/s, 9.652 us/op) p50/p99/p99.9/max: 8.960/20.480/45.056/120.832 us
     m = re.match(
         r"\[(?P<ts>.*)\] "
         r"\[(?P<thread>.*)\] "
         r"\[.*\] \[.*\] "  # ignore log level and file
         r"(?P<workload>.*): "
         r"Epoch\s*(?P<epoch>\d+): \d+ ops in \d+\.\d+ s "
-        r"\(\s*(?P<throughput>\d+.\d+) (?P<tp_unit>.*),\s*(?P<latency>\d+.\d+) us/op\)",
+        r"\(\s*(?P<throughput>\d+.\d+) (?P<tp_unit>[^,]*),\s*(?P<latency>\d+.\d+) us/op\)"
+        + tail_re
+        + r"(?:, offered (?P<offered>\d+) ops/s)?",  # only for open-loop
         line,
     )
     if m is None:
@@ -22,9 +38,34 @@ def parse_line(line):
     result = m.groupdict()
     result["app"] = result["thread"].rsplit("-", 1)[0]
     result["ts"] = datetime.strptime(result["ts"], "%Y-%m-%d %H:%M:%S.%f")
+    result["offered"] = np.nan if result["offered"] is None else float(result["offered"])
     result["throughput"] = float(result["throughput"])
     result["latency"] = float(result["latency"])
     result["epoch"] = int(result["epoch"])
+    parse_tail(result)
+    return result
+
+
+def parse_fd_line(line):
+    # Example: [2022-11-18 04:03:04.849] [App1-T1] [info] [workload.h:76] App1-T1-W1 fd-5:  404.71 MB/s,   9.652 us/op p50/p99/p99.9/max: 8.960/20.480/45.056/120.832 us
+    m = re.match(
+        r"\[.*\] "
+        r"\[(?P<thread>.*)\] "
+        r"\[.*\] \[.*\] "  # ignore log level and file
+        r"(?P<workload>\S*) fd-(?P<fd>\d+): "
+        r"\s*(?P<throughput>\d+.\d+) MB/s,\s*(?P<latency>\d+.\d+) us/op"
+        + tail_re,
+        line,
+    )
+    if m is None:
+        return None
+
+    result = m.groupdict()
+    result["app"] = result["thread"].rsplit("-", 1)[0]
+    result["fd"] = int(result["fd"])
+    result["throughput"] = float(result["throughput"])
+    result["latency"] = float(result["latency"])
+    parse_tail(result)
     return result
 
 
@@ -50,16 +91,38 @@ def parse_results(path):
     return df
 
 
+def parse_fd_results(path):
+    """parse per-fd summary lines in *.log into data frame; None if no such
+    lines (e.g., DB workloads)"""
+    results = []
+    for file in path.iterdir():
+        if file.suffix != ".log":
+            continue
+
+        with open(file, "r") as f:
+            for line in f:
+                result = parse_fd_line(line)
+                if result is not None:
+                    results.append(result)
+
+    if len(results) == 0:
+        return None
+    return pd.DataFrame(results)
+
+
 def app_summary(df):
     """Only for human to read"""
+    # percentiles of different threads cannot be merged; report the worst thread
     return (
         df.groupby(["app", "ts_sec"])
-        .agg({"throughput": [np.mean, np.sum], "latency": np.mean})
-        .pivot_table(index="ts_sec", columns="app", values=["throughput", "latency"])
+        .agg({"throughput": [np.mean, np.sum], "latency": np.mean,
+              "p99": np.max, "p999": np.max})
+        .pivot_table(index="ts_sec", columns="app",
+                     values=["throughput", "latency", "p99", "p999"])
     )
 
 
-def save_results(df, path):
+def save_results(df, path, df_fd=None):
     csv_path = path / "results.csv"
     df.to_csv(csv_path, index=False)
     print(f"Saving csv to {csv_path}")
@@ -68,10 +131,16 @@ def save_results(df, path):
     app_summary(df).to_string(summary_path)
     print(f"Saving summary to {summary_path}")
 
+    if df_fd is not None:
+        fd_csv_path = path / "fd_results.csv"
+        df_fd.to_csv(fd_csv_path, index=False)
+        print(f"Saving per-fd csv to {fd_csv_path}")
+
 
 def parse_single(path: Path) -> pd.DataFrame:
     print(f"Reading result from {path}")
     df = parse_results(path)
+    df_fd = parse_fd_results(path)
 
-    save_results(df, path)
+    save_results(df, path, df_fd)
     return df
@@ -27,6 +27,34 @@ def compute_throughput(df: pd.DataFrame):
     return tp_base, tp_sched
 
 
+def compute_tail_latency(df: pd.DataFrame):
+    # percentiles of different threads cannot be merged, so take the worst
+    # thread in each epoch, then average over the same windows as throughput
+    df = df[["app", "epoch", "p99"]].dropna()
+    df_agg = df.groupby(["app", "epoch"], as_index=False).max()
+    p99_base = df_agg[
+        (df_agg["epoch"] >= 9) & (df_agg["epoch"] <= 13)
+    ].groupby("app", as_index=False).mean()
+    p99_sched = df_agg[
+        (df_agg["epoch"] >= 25) & (df_agg["epoch"] <= 29)
+    ].groupby("app", as_index=False).mean()
+    return p99_base, p99_sched
+
+
+def load_tail_latency(data_path) -> Dict:
+    """return app -> {p99_base, p99_sched} in us; empty if the results do not
+    have tail latency (from older runs)"""
+    df = pd.read_csv(data_path)
+    if "p99" not in df:
+        return {}
+    p99_base, p99_sched = compute_tail_latency(df)
+    lat_map = {app: {"p99_base": p99} for app, p99 in
+               p99_base[["app", "p99"]].to_numpy()}
+    for app, p99 in p99_sched[["app", "p99"]].to_numpy():
+        lat_map.setdefault(app, {})["p99_sched"] = p99
+    return lat_map
+
+
 def load_throughput(data_path) -> Tuple[List, List]:
     df = pd.read_csv(data_path)
     tp_base_list, tp_sched_list = compute_throughput(df)
@@ -69,6 +97,8 @@ def load_static_data(result_dir: str, apps_names=None) -> pd.DataFrame:
     }
     for app, tp in tp_sched_list:
         app_map[app]["tp_sched"] = tp
+    for app, lat in load_tail_latency(f"{result_dir}/results.csv").items():
+        app_map[app].update(lat)
     merge_alloc(apps_names, app_map, app_alloc_map)
     df = pd.DataFrame(app_map.values())
     df = convert_df(df)
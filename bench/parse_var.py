@@ -1,7 +1,7 @@
 from typing import Tuple
 
 import pandas as pd
-from parse_static import load_throughput, load_alloc, load_expect, merge_alloc, convert_df
+from parse_static import load_throughput, load_tail_latency, load_alloc, load_expect, merge_alloc, convert_df
 
 
 def save_df(df, results_dir, name):
@@ -34,6 +34,8 @@ def parse_var(results_dir, var_name, var_list, apps_names) -> Tuple[pd.DataFrame
         }
         for app, tp in tp_sched_list:
             app_map[app]["tp_sched"] = tp
+        for app, lat in load_tail_latency(f"{subdir}/results.csv").items():
+            app_map[app].update(lat)
         merge_alloc(apps_names, app_map, app_alloc_map)
         results.extend(app_map.values())
 
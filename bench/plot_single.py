@@ -10,13 +10,20 @@ from parse_single import parse_single
 def plot_single(df_detailed: pd.DataFrame, path: Optional[Path] = None) \
         -> Union[plt.Figure, Path]:
     # df_detailed includes time-scale info (from results.csv)
-    fig, axs = plt.subplots(2, 1, sharex=True)
+    ax_names = ["throughput", "latency"]
+    # logs from older runs do not have tail latency
+    if "p99" in df_detailed and df_detailed["p99"].notna().any():
+        ax_names.append("p99")
+    fig, axs = plt.subplots(len(ax_names), 1, sharex=True)
+    fig.set_size_inches(6.4, 2.4 * len(ax_names))
     fig.subplots_adjust(hspace=0.3)
-    for ax, ax_name in zip(axs, ("throughput", "latency")):
+    for ax, ax_name in zip(axs, ax_names):
         # do not plot the first 5 epoch for latency as it is too large due to the warmup
         if ax_name == "latency":
             df_detailed = df_detailed[df_detailed["epoch"] > 5]
             ax.set_ylabel("Latency (us)")
+        elif ax_name == "p99":
+            ax.set_ylabel("P99 Latency (us)")
         else:
             tp_unit = df_detailed["tp_unit"].unique()
             assert len(tp_unit) == 1
@@ -28,8 +35,10 @@ def plot_single(df_detailed: pd.DataFrame, path: Optional[Path] = None) \
                 ax.plot(df_thread["epoch"],
                         df_thread[ax_name], label=app, color=color)
 
-            # plot an average line across all threads
-            df_avg = df_app.groupby("epoch").agg({ax_name: "mean"})
+            # plot an average line across all threads; for percentiles, the
+            # worst thread instead as they cannot be averaged
+            agg = "max" if ax_name == "p99" else "mean"
+            df_avg = df_app.groupby("epoch").agg({ax_name: agg})
             ax.plot(df_avg.index, df_avg[ax_name],
                     label=app, color="black", ls="--")
 
@@ -26,6 +26,9 @@ def plot_static(df_detailed: pd.DataFrame, df_summary: pd.DataFrame, path: Path)
         "bw_gbps": "BW",
         "cpu_cnt": "CPU",
     }
+    # tail latency (in us) is only available in newer results
+    if "p99_sched" in df_summary:
+        columns.update({"p99_base": "P99B", "p99_sched": "P99S"})
     title = df_summary[columns.keys()].rename(
         columns=columns).round(3).to_string(index=False)
 
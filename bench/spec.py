@@ -46,6 +46,7 @@ class OffsetType(str, Enum):
     SEQ = "seq"
     MIXGRAPH = "mixgraph"
     SHUFFLE = "shuffle"
+    REPLAY = "replay"
 
     def short_name(self):
         if self == OffsetType.SHUFFLE:
@@ -60,8 +61,11 @@ class Offset:
     max: int
     align: int
     theta: float
+    trace_path: str = ""  # only for replay
 
     def __post_init__(self):
+        if self.type == OffsetType.REPLAY:
+            assert self.trace_path != "", "trace_path is empty"
         if self.type != OffsetType.ZIPF:
             assert self.theta == 0.0, f"{self.theta} != 0.0"
         assert self.min <= self.max, f"{self.min} > {self.max}"
@@ -71,6 +75,19 @@ class Offset:
         assert self.max >= 0, f"{self.max} < 0"
 
 
+@unique
+class ArrivalType(str, Enum):
+    CLOSED = "closed"  # issue the next op once a slot (qdepth) frees up
+    POISSON = "poisson"
+    CONST = "const"
+
+
+@dataclass(frozen=True)
+class RatePoint:
+    sec: float  # since the start of the workload
+    rate: float  # ops per second (per thread)
+
+
 @dataclass(frozen=True)
 class Workload:
     name: str
@@ -81,9 +98,23 @@ class Workload:
     duration_sec: int = 1 << 30
     read_ratio: float = 1.0
     dirty_threshold: int = 256 << 10
+    replay_speed: float = 1.0  # only for replay threads; 0 means no pacing
+    # only for open-loop; rate_ramp (if not empty) is linearly interpolated and
+    # overrides rate
+    arrival: ArrivalType = ArrivalType.CLOSED
+    rate: float = 0.0
+    rate_ramp: List[RatePoint] = dataclasses.field(default_factory=list)
 
     def __post_init__(self):
+        if self.arrival != ArrivalType.CLOSED:
+            assert self.rate > 0 or len(self.rate_ramp) > 0, \
+                "open-loop workload requires rate or rate_ramp"
+        for prev, curr in zip(self.rate_ramp, self.rate_ramp[1:]):
+            assert prev.sec < curr.sec, "rate_ramp must be sorted by sec"
+        for p in self.rate_ramp:
+            assert p.rate >= 0, f"{p.rate} < 0"
         assert self.ops > 0, f"{self.ops} <= 0"
+        assert self.replay_speed >= 0, f"{self.replay_speed} < 0"
         assert self.duration_sec > 0, f"{self.duration_sec} <= 0"
         assert self.count > 0, f"{self.count} <= 0"
 
@@ -92,6 +123,7 @@ class Workload:
 class ThreadType(str, Enum):
     RW = "rw"
     DB = "db"
+    REPLAY = "replay"
 
 
 @dataclass(frozen=True)
@@ -118,6 +150,12 @@ class Thread:
             num_files = len(self.file_paths)
             assert num_files != 0, "file_paths is empty"
 
+        elif self.type == ThreadType.REPLAY:
+            # files are opened by the trace itself
+            for w in self.workloads:
+                assert w.offset.type == OffsetType.REPLAY, \
+                    "replay thread only supports replay offset"
+
         for w in self.workloads:
             if self.type == ThreadType.DB:
                 assert w.qdepth == 1, "DB workload only supports sync APIs"
@@ -164,5 +202,5 @@ class Exp:
         return Path(__file__).parent / "specs" / f"{name}.json"
 
 
-__all__ = ["App", "Exp", "Thread", "ThreadType", "Workload",
-           "Offset", "OffsetType", "Prep", "PrepFile", "Database"]
+__all__ = ["App", "Exp", "Thread", "ThreadType", "Workload", "ArrivalType",
+           "RatePoint", "Offset", "OffsetType", "Prep", "PrepFile", "Database"]
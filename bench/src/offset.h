@@ -2,10 +2,12 @@
 
 #include <fcntl.h>
 
+#include <algorithm>
 #include <random>
 #include <stdexcept>
 #include <vector>
 
+#include "FsLibTrace.h"
 #include "spec.h"
 #include "utils/mixgraph.h"
 
@@ -129,6 +131,25 @@ struct MixgraphGenerator : public BaseGenerator {
   }
 };
 
+// Replay the offsets of positional reads/writes recorded in a FsLib trace, in
+// the recorded order (wrapping around at the end of the trace)
+struct ReplayGenerator : public BaseGenerator {
+  std::vector<off_t> offsets;
+  explicit ReplayGenerator(const std::string& trace_path) {
+    FsTraceFileHeader header;
+    std::vector<FsTraceEntry> entries;
+    if (!fsTraceLoad(trace_path, header, entries))
+      throw std::runtime_error("Fail to load trace: " + trace_path);
+    for (const auto& entry : entries) {
+      if (entry.rcd.op == FsTraceOp::PREAD || entry.rcd.op == FsTraceOp::PWRITE)
+        offsets.push_back(entry.rcd.offset);
+    }
+    if (offsets.empty())
+      throw std::runtime_error("No pread/pwrite in trace: " + trace_path);
+  }
+  off_t get() override { return offsets[index % offsets.size()]; }
+};
+
 struct Offsets {
   size_t num;
   BaseGenerator* gen;
@@ -174,6 +195,8 @@ struct Offsets {
         return new ZipfGenerator(spec.min, spec.max, spec.theta, spec.align);
       case spec::OffsetType::MIXGRAPH:
         return new MixgraphGenerator(spec.min, spec.max, spec.align);
+      case spec::OffsetType::REPLAY:
+        return new ReplayGenerator(spec.trace_path);
       default:
         throw std::runtime_error("Unimplemented offset type");
     }
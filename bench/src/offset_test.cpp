@@ -2,6 +2,9 @@
 
 #include <gtest/gtest.h>
 #include <spdlog/spdlog.h>
+#include <unistd.h>
+
+#include <filesystem>
 
 static void print(const spec::Offset& spec, const Offsets& offsets) {
   // Build comma-separated list of offsets
@@ -84,6 +87,47 @@ TEST(OffsetTest, Zipf) {
   }
 }
 
+TEST(OffsetTest, Replay) {
+  char dir_template[] = "/tmp/offset_test_XXXXXX";
+  std::string dir = mkdtemp(dir_template);
+  std::string trace_path;
+  {
+    FsTraceWriter writer(dir, /*fsTid*/ 1, /*baseTsNs*/ 0);
+    ASSERT_TRUE(writer.isOk());
+    trace_path = writer.getPath();
+    writer.add(FsTraceOp::OPEN, 1, 3, -1, O_RDWR, "/data/file");
+    writer.add(FsTraceOp::PREAD, 2, 3, 4096, 4096);
+    writer.add(FsTraceOp::READ, 3, 3, -1, 4096);
+    writer.add(FsTraceOp::PWRITE, 4, 3, 0, 4096);
+    writer.add(FsTraceOp::PREAD, 5, 3, 8192, 4096);
+    writer.add(FsTraceOp::CLOSE, 6, 3, -1, 0);
+  }
+
+  FsTraceFileHeader header;
+  std::vector<FsTraceEntry> entries;
+  ASSERT_TRUE(fsTraceLoad(trace_path, header, entries));
+  EXPECT_EQ(header.fsTid, 1);
+  ASSERT_EQ(entries.size(), 6);
+  EXPECT_EQ(entries[0].rcd.op, FsTraceOp::OPEN);
+  EXPECT_EQ(entries[0].path, "/data/file");
+  EXPECT_EQ(entries[5].rcd.op, FsTraceOp::CLOSE);
+
+  spec::Offset spec{
+      .type = spec::OffsetType::REPLAY,
+      .trace_path = trace_path,
+  };
+  print(spec, Offsets(5, spec));
+
+  Offsets offsets(5, spec);
+  std::vector<off_t> expected{4096, 0, 8192, 4096, 0};
+  std::vector<off_t> actual;
+  actual.reserve(offsets.size());
+  for (auto off : offsets) actual.emplace_back(off);
+  EXPECT_EQ(actual, expected);
+
+  std::filesystem::remove_all(dir);
+}
+
 void print_histogram(const spec::Offset& spec, const Offsets& offsets,
                      uint64_t num_buckets = 100) {
   std::vector<int> buckets(num_buckets);
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "FsLibTrace.h"
+#include "fsapi.h"
+#include "spec.h"
+#include "utils/logging.h"
+#include "utils/stat.h"
+
+// Replay a per-thread FsLib trace (see FsLibTrace.h) op by op.
+//
+// Each replay thread replays one trace file, so running one replay thread per
+// traced app thread reproduces the original concurrency. Records are issued at
+// their recorded time (relative to the start of the replay) divided by
+// `replay_speed`; if an op falls behind its schedule, the next ops are issued
+// back-to-back until catching up. `replay_speed == 0` disables pacing.
+class Replay {
+  const spec::Workload& spec;
+  FsTraceFileHeader header{};
+  std::vector<FsTraceEntry> entries;
+  void* buf = nullptr;
+  // map fds recorded in the trace to fds opened by the replay
+  std::unordered_map<int, int> fd_map;
+
+  // ops whose fd is not opened in the trace (e.g., opened before tracing)
+  uint64_t num_skipped = 0;
+  uint64_t num_failed = 0;
+  uint64_t num_bytes = 0;
+
+ public:
+  explicit Replay(const spec::Workload& spec) : spec(spec) {
+    if (!fsTraceLoad(spec.offset.trace_path, header, entries)) {
+      THREAD_ERROR("{}: fail to load trace {}", spec.name,
+                   spec.offset.trace_path);
+      throw std::runtime_error("Fail to load trace");
+    }
+    uint64_t buf_size = 4096;
+    for (const auto& entry : entries) {
+      if (is_data_op(entry.rcd.op))
+        buf_size = std::max<uint64_t>(buf_size, entry.rcd.size);
+    }
+    buf = fs_zalloc(buf_size);
+  }
+
+  ~Replay() {
+    // files left open by the trace
+    for (const auto& [_, fd] : fd_map) fs_close(fd);
+    fs_free(buf);
+  }
+
+  void run() {
+    THREAD_DEBUG("Replaying workload {}: {}", spec.name, spec.dump());
+    auto epoch_callback = [&](const Stat& stat) {
+      const auto& info = stat.get_epoch_info();
+      THREAD_INFO(
+          "{}: Epoch {:2.0f}: {} ops in {:.2f} s ({:7.2f} kops, {:7.3f} "
+          "us/op) {}",
+          spec.name, stat.get_accum_info().get_elapsed_sec(), info.ops,
+          info.get_elapsed_sec(), info.get_iops() / 1000,
+          info.get_latency_us_per_op(), info.get_latency_tail_str());
+    };
+    Stat stat({.epoch_callback = epoch_callback}, 1);
+
+    // spin instead of sleeping if the next op is due within this
+    static constexpr auto spin_threshold = std::chrono::microseconds(50);
+    std::chrono::nanoseconds max_lag{0};
+    uint64_t op_cnt = 0;
+    auto start_ts = Timer::now();
+    stat.reset();
+    for (const auto& entry : entries) {
+      if (spec.replay_speed > 0) {
+        auto due_ts = start_ts + std::chrono::nanoseconds(uint64_t(
+                                     entry.rcd.tsNs / spec.replay_speed));
+        auto now = Timer::now();
+        if (due_ts - now > spin_threshold)
+          std::this_thread::sleep_until(due_ts - spin_threshold);
+        while (Timer::now() < due_ts)
+          ;
+        max_lag = std::max(max_lag, now - due_ts);
+      }
+
+      stat.op_start();
+      replay_one(entry);
+      stat.op_stop();
+
+      if (++op_cnt >= spec.ops) break;
+      if (stat.get_accum_info().get_elapsed_sec() >= spec.duration_sec) break;
+    }
+
+    THREAD_INFO(
+        "{}: replayed {}/{} ops ({} skipped, {} failed, {:.2f} MB) from {}; "
+        "max lag {:.3f} ms",
+        spec.name, op_cnt, entries.size(), num_skipped, num_failed,
+        double(num_bytes) / 1024 / 1024, spec.offset.trace_path,
+        std::chrono::duration<double, std::milli>(max_lag).count());
+  }
+
+ private:
+  static bool is_data_op(FsTraceOp op) {
+    return op == FsTraceOp::READ || op == FsTraceOp::PREAD ||
+           op == FsTraceOp::WRITE || op == FsTraceOp::PWRITE;
+  }
+
+  void replay_one(const FsTraceEntry& entry) {
+    const auto& rcd = entry.rcd;
+    if (rcd.op == FsTraceOp::OPEN) {
+      if (rcd.fd < 0) return;  // failed when recorded
+      int fd = fs_open(entry.path.c_str(), int(rcd.size), 0644);
+      if (fd < 0) {
+        THREAD_WARN("{}: fail to open {}", spec.name, entry.path);
+        ++num_failed;
+        return;
+      }
+      auto [it, is_new] = fd_map.emplace(rcd.fd, fd);
+      if (!is_new) {  // the close of the old one is not in the trace
+        fs_close(it->second);
+        it->second = fd;
+      }
+      return;
+    }
+
+    int rc = 0;
+    struct stat stat_buf;
+    switch (rcd.op) {
+      case FsTraceOp::STAT:
+        // a missing file is also a legit result of stat
+        fs_stat(entry.path.c_str(), &stat_buf);
+        return;
+      case FsTraceOp::UNLINK:
+        rc = fs_unlink(entry.path.c_str());
+        break;
+      case FsTraceOp::MKDIR:
+        rc = fs_mkdir(entry.path.c_str(), mode_t(rcd.size));
+        break;
+      default: {
+        auto it = fd_map.find(rcd.fd);
+        if (it == fd_map.end()) {
+          ++num_skipped;
+          return;
+        }
+        int fd = it->second;
+        switch (rcd.op) {
+          case FsTraceOp::CLOSE:
+            rc = fs_close(fd);
+            fd_map.erase(it);
+            break;
+          case FsTraceOp::FSYNC:
+            rc = fs_fsync(fd);
+            break;
+          case FsTraceOp::FDATASYNC:
+            rc = fs_fdatasync(fd);
+            break;
+          case FsTraceOp::READ:
+            rc = check_io(fs_allocated_read(fd, buf, rcd.size), rcd);
+            break;
+          case FsTraceOp::PREAD:
+            rc = check_io(fs_allocated_pread(fd, buf, rcd.size, rcd.offset),
+                          rcd);
+            break;
+          case FsTraceOp::WRITE:
+            rc = check_io(fs_allocated_write(fd, buf, rcd.size), rcd);
+            break;
+          case FsTraceOp::PWRITE:
+            rc = check_io(fs_allocated_pwrite(fd, buf, rcd.size, rcd.offset),
+                          rcd);
+            break;
+          default:
+            throw std::runtime_error("Unknown trace op");
+        }
+      }
+    }
+    if (rc < 0) ++num_failed;
+  }
+
+  // a short read/write (e.g., at the end of a file) is not a failure
+  int check_io(ssize_t rc, const FsTraceRecord& rcd) {
+    if (rc < 0) {
+      THREAD_DEBUG("{}: op {} on fd={}, count={}, off={} returned {}",
+                   spec.name, int(rcd.op), rcd.fd, rcd.size, rcd.offset, rc);
+      return -1;
+    }
+    num_bytes += rc;
+    return 0;
+  }
+};
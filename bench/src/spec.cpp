@@ -18,20 +18,50 @@ NLOHMANN_JSON_SERIALIZE_ENUM(OffsetType, {{OffsetType::UNIF, "unif"},
                                           {OffsetType::SHUFFLE, "shuffle"},
                                           {OffsetType::ZIPF, "zipf"},
                                           {OffsetType::SEQ, "seq"},
-                                          {OffsetType::MIXGRAPH, "mixgraph"}})
+                                          {OffsetType::MIXGRAPH, "mixgraph"},
+                                          {OffsetType::REPLAY, "replay"}})
 
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(Offset, type, min, max, align, theta)
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(Offset, type, min, max, align,
+                                                theta, trace_path)
 std::string Offset::dump() const { return nlohmann::json(*this).dump(); }
 
+NLOHMANN_JSON_SERIALIZE_ENUM(ArrivalType, {{ArrivalType::CLOSED, "closed"},
+                                           {ArrivalType::POISSON, "poisson"},
+                                           {ArrivalType::CONST, "const"}})
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(RatePoint, sec, rate)
+
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(Workload, name, ops,
                                                 duration_sec, count, qdepth,
                                                 offset, read_ratio,
-                                                dirty_threshold)
+                                                dirty_threshold, replay_speed,
+                                                arrival, rate, rate_ramp)
 
 std::string Workload::dump() const { return nlohmann::json(*this).dump(); }
 
-NLOHMANN_JSON_SERIALIZE_ENUM(ThreadType,
-                             {{ThreadType::RW, "rw"}, {ThreadType::DB, "db"}})
+double Workload::get_rate(double sec) const {
+  if (rate_ramp.empty()) return rate;
+  if (sec <= rate_ramp.front().sec) return rate_ramp.front().rate;
+  for (size_t i = 1; i < rate_ramp.size(); ++i) {
+    const auto& prev = rate_ramp[i - 1];
+    const auto& next = rate_ramp[i];
+    if (sec < next.sec) {
+      return prev.rate +
+             (next.rate - prev.rate) * (sec - prev.sec) / (next.sec - prev.sec);
+    }
+  }
+  return rate_ramp.back().rate;
+}
+
+bool Workload::is_rate_over(double sec) const {
+  if (!is_open_loop()) return false;
+  if (rate_ramp.empty()) return rate <= 0;
+  return rate_ramp.back().rate <= 0 && sec >= rate_ramp.back().sec;
+}
+
+NLOHMANN_JSON_SERIALIZE_ENUM(ThreadType, {{ThreadType::RW, "rw"},
+                                          {ThreadType::DB, "db"},
+                                          {ThreadType::REPLAY, "replay"}})
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(Thread, type, name, core,
                                                 worker_id, file_paths,
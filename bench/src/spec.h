@@ -28,7 +28,7 @@ struct Prep {
   std::vector<Database> databases;
 };
 
-enum class OffsetType { UNIF, ZIPF, SEQ, SHUFFLE, MIXGRAPH };
+enum class OffsetType { UNIF, ZIPF, SEQ, SHUFFLE, MIXGRAPH, REPLAY };
 
 struct Offset {
   OffsetType type;
@@ -36,10 +36,21 @@ struct Offset {
   off_t max;       // exclusive
   uint32_t align;  // in bytes
   double theta;    // only for zipf
+  std::string trace_path;  // only for replay; a FsLib trace (FsLibTrace.h)
 
   [[nodiscard]] std::string dump() const;
 };
 
+// closed-loop issues the next op once a slot (qdepth) frees up; open-loop
+// issues ops at a target rate regardless of completions
+enum class ArrivalType { CLOSED, POISSON, CONST };
+
+// a point of a rate ramp; the rate is linearly interpolated between points
+struct RatePoint {
+  double sec;   // since the start of the workload
+  double rate;  // ops per second (per thread)
+};
+
 struct Workload {
   std::string name;
   uint64_t ops = std::numeric_limits<uint64_t>::max();
@@ -49,11 +60,29 @@ struct Workload {
   Offset offset = {};
   double read_ratio = 1.0;
   uint64_t dirty_threshold;  // max size of dirty data in bytes (per-file)
+  // only for replay threads: >1 replays faster than recorded; 0 means replaying
+  // as fast as possible
+  double replay_speed = 1.0;
+
+  // only for open-loop: target ops per second (per thread); if rate_ramp is
+  // not empty, it overrides rate
+  ArrivalType arrival = ArrivalType::CLOSED;
+  double rate = 0;
+  std::vector<RatePoint> rate_ramp;
+
+  [[nodiscard]] bool is_open_loop() const {
+    return arrival != ArrivalType::CLOSED;
+  }
+  // target rate at `sec` since the start of the workload
+  [[nodiscard]] double get_rate(double sec) const;
+  // whether no more op arrives from `sec` on: open-loop with a rate <= 0 that
+  // stays so, i.e., `sec` is past the last point of a ramp ending at <= 0
+  [[nodiscard]] bool is_rate_over(double sec) const;
 
   [[nodiscard]] std::string dump() const;
 };
 
-enum class ThreadType { RW, DB };
+enum class ThreadType { RW, DB, REPLAY };
 
 struct Thread {
   ThreadType type = ThreadType::RW;
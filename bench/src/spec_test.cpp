@@ -0,0 +1,59 @@
+#include "spec.h"
+
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <nlohmann/json.hpp>
+
+namespace spec {
+// defined in spec.cpp
+void from_json(const nlohmann::json& j, Workload& w);
+}  // namespace spec
+
+TEST(SpecTest, OpenLoop) {
+  auto json = nlohmann::json::parse(R"({
+    "name": "W",
+    "arrival": "poisson",
+    "rate_ramp": [{"sec": 0, "rate": 100}, {"sec": 10, "rate": 1100},
+                  {"sec": 20, "rate": 0}]
+  })");
+  auto w = json.get<spec::Workload>();
+  EXPECT_TRUE(w.is_open_loop());
+  EXPECT_EQ(w.arrival, spec::ArrivalType::POISSON);
+  EXPECT_DOUBLE_EQ(w.get_rate(-1), 100);
+  EXPECT_DOUBLE_EQ(w.get_rate(5), 600);
+  EXPECT_DOUBLE_EQ(w.get_rate(15), 550);
+  EXPECT_DOUBLE_EQ(w.get_rate(30), 0);
+}
+
+TEST(SpecTest, RampEndingAtZero) {
+  auto w = nlohmann::json::parse(R"({
+    "name": "W",
+    "arrival": "const",
+    "rate_ramp": [{"sec": 0, "rate": 0}, {"sec": 5, "rate": 100},
+                  {"sec": 10, "rate": 0}]
+  })")
+               .get<spec::Workload>();
+  // paused at the start, not over
+  EXPECT_DOUBLE_EQ(w.get_rate(0), 0);
+  EXPECT_FALSE(w.is_rate_over(0));
+  EXPECT_FALSE(w.is_rate_over(9.9));
+  // no duration_sec: the run ends with the ramp
+  EXPECT_EQ(w.duration_sec, std::numeric_limits<uint64_t>::max());
+  EXPECT_DOUBLE_EQ(w.get_rate(10), 0);
+  EXPECT_TRUE(w.is_rate_over(10));
+  EXPECT_TRUE(w.is_rate_over(1e9));
+
+  w.rate_ramp.back().rate = 10;
+  EXPECT_FALSE(w.is_rate_over(1e9));
+  w.rate_ramp.clear();
+  EXPECT_TRUE(w.is_rate_over(0));  // rate 0
+}
+
+TEST(SpecTest, ClosedLoopByDefault) {
+  auto w = nlohmann::json::parse(R"({"name": "W", "rate": 5})")
+               .get<spec::Workload>();
+  EXPECT_FALSE(w.is_open_loop());
+  EXPECT_DOUBLE_EQ(w.get_rate(3), 5);
+  EXPECT_FALSE(w.is_rate_over(3));
+}
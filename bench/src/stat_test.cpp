@@ -0,0 +1,40 @@
+#include "utils/stat.h"
+
+#include <gtest/gtest.h>
+
+TEST(HistogramTest, Exact) {
+  Histogram hist;
+  for (uint64_t v = 1; v <= 20; ++v) hist.add(v);
+  EXPECT_EQ(hist.get_count(), 20);
+  EXPECT_EQ(hist.get_percentile(0.5), 10);
+  EXPECT_EQ(hist.get_percentile(0.99), 20);
+  EXPECT_EQ(hist.get_percentile(1), 20);
+  EXPECT_EQ(hist.get_max(), 20);
+}
+
+TEST(HistogramTest, RelativeError) {
+  Histogram hist;
+  for (uint64_t v = 1; v <= 1'000'000; ++v) hist.add(v * 1000);
+  for (double q : {0.5, 0.9, 0.99, 0.999}) {
+    double expected = q * 1e9;
+    double actual = hist.get_percentile(q);
+    EXPECT_GE(actual, expected * 0.99) << "q=" << q;
+    EXPECT_LE(actual, expected * 1.04) << "q=" << q;
+  }
+  EXPECT_EQ(hist.get_percentile(1), 1'000'000'000);
+}
+
+TEST(HistogramTest, Merge) {
+  Histogram a, b;
+  for (int i = 0; i < 99; ++i) a.add(16);
+  b.add(1'000'000);
+  a += b;
+  EXPECT_EQ(a.get_count(), 100);
+  EXPECT_EQ(a.get_percentile(0.5), 16);
+  EXPECT_EQ(a.get_percentile(0.99), 16);
+  EXPECT_EQ(a.get_max(), 1'000'000);
+  EXPECT_EQ(a.get_percentile(0.999), 1'000'000);
+  a.reset();
+  EXPECT_EQ(a.get_count(), 0);
+  EXPECT_EQ(a.get_percentile(0.99), 0);
+}
@@ -11,6 +11,7 @@
 #include "args.h"
 #include "config.h"
 #include "fsapi.h"
+#include "replay.h"
 #include "spec.h"
 #include "utils/barrier.h"
 #include "utils/leveldb.h"
@@ -70,6 +71,17 @@ struct Thread {
       // LevelDB modifies the manifest file on open so we need to
       // call fsync to ensure all data is flushed to disk
       fs_syncall();
+    } else if (thread.type == spec::ThreadType::REPLAY) {
+      // files are opened by the trace itself; keep the same barrier steps as
+      // RW threads so both types can run in the same app
+      barrier.arrive_and_wait();
+      barrier.arrive_and_wait();
+
+      for (const auto& workload : thread.workloads) {
+        Replay(workload).run();
+      }
+
+      barrier.arrive_and_wait();
     } else {
       throw std::runtime_error("Unknown thread type");
     }
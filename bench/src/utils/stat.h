@@ -2,18 +2,27 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <chrono>
 #include <cstdint>
 #include <functional>
+#include <string>
 #include <utility>
 #include <vector>
 
 class Timer {
+ public:
+  using time_point = std::chrono::high_resolution_clock::time_point;
+
+ private:
   std::chrono::high_resolution_clock::time_point start =
       std::chrono::high_resolution_clock::now();
 
  public:
   void reset() { start = std::chrono::high_resolution_clock::now(); }
+  void reset(std::chrono::high_resolution_clock::time_point ts) { start = ts; }
   [[nodiscard]] std::chrono::nanoseconds elapsed() const {
     return std::chrono::high_resolution_clock::now() - start;
   }
@@ -28,12 +37,83 @@ class Timer {
   }
 };
 
+// Log-linear latency histogram (in the spirit of HdrHistogram): values below
+// 2^sub_bits are counted exactly; above that, each power of two is split into
+// 2^sub_bits linear buckets, so a bucket is at most ~3% wider than its lower
+// bound. Recording is a clz, a shift and an increment, cheap enough to sit on
+// every op even with deep async queues.
+class Histogram {
+  static constexpr uint32_t sub_bits = 5;
+  static constexpr uint64_t sub_cnt = 1 << sub_bits;
+  // values are clamped to 2^max_bits - 1 ns (~18 minutes)
+  static constexpr uint32_t max_bits = 40;
+  static constexpr uint64_t max_value = (uint64_t(1) << max_bits) - 1;
+  static constexpr size_t num_buckets = (max_bits - sub_bits + 1) * sub_cnt;
+
+  std::array<uint64_t, num_buckets> buckets{};
+  uint64_t count = 0;
+  uint64_t max = 0;
+
+  static size_t get_bucket(uint64_t v) {
+    if (v < sub_cnt) return v;
+    uint32_t msb = std::bit_width(v) - 1;  // >= sub_bits
+    uint32_t shift = msb - sub_bits;
+    return (shift + 1) * sub_cnt + ((v >> shift) & (sub_cnt - 1));
+  }
+
+  // the largest value that falls into the bucket
+  static uint64_t get_bucket_upper(size_t idx) {
+    if (idx < sub_cnt) return idx;
+    uint32_t shift = idx / sub_cnt - 1;
+    uint64_t sub = idx % sub_cnt;
+    return ((sub_cnt + sub + 1) << shift) - 1;
+  }
+
+ public:
+  void add(uint64_t v) {
+    v = std::min(v, max_value);
+    buckets[get_bucket(v)]++;
+    count++;
+    max = std::max(max, v);
+  }
+
+  // q in [0, 1]; return the upper bound of the bucket holding the q-quantile
+  // (never larger than the max recorded)
+  [[nodiscard]] uint64_t get_percentile(double q) const {
+    if (count == 0) return 0;
+    auto target = std::max<uint64_t>(1, uint64_t(q * count + 0.5));
+    uint64_t cumu = 0;
+    for (size_t i = 0; i < num_buckets; ++i) {
+      cumu += buckets[i];
+      if (cumu >= target) return std::min(get_bucket_upper(i), max);
+    }
+    return max;
+  }
+
+  [[nodiscard]] uint64_t get_count() const { return count; }
+  [[nodiscard]] uint64_t get_max() const { return max; }
+
+  void reset() {
+    buckets.fill(0);
+    count = 0;
+    max = 0;
+  }
+
+  Histogram& operator+=(const Histogram& rhs) {
+    for (size_t i = 0; i < num_buckets; ++i) buckets[i] += rhs.buckets[i];
+    count += rhs.count;
+    max = std::max(max, rhs.max);
+    return *this;
+  }
+};
+
 class Stat {
  public:
   struct Info {
     uint64_t ops;
     std::chrono::nanoseconds elapsed;
     std::chrono::nanoseconds latency_sum;
+    Histogram latency_hist;  // in ns
 
     [[nodiscard]] double get_elapsed_sec() const {
       return std::chrono::duration<double>(elapsed).count();
@@ -47,17 +127,33 @@ class Stat {
       return std::chrono::duration<double, std::micro>(latency_sum).count() /
              ops;
     }
+    [[nodiscard]] double get_latency_us_percentile(double q) const {
+      return latency_hist.get_percentile(q) / 1e3;
+    }
+    [[nodiscard]] double get_latency_us_max() const {
+      return latency_hist.get_max() / 1e3;
+    }
+    // appended to the end of the report lines; parsed by parse_single.py
+    [[nodiscard]] std::string get_latency_tail_str() const {
+      return fmt::format("p50/p99/p99.9/max: {:.3f}/{:.3f}/{:.3f}/{:.3f} us",
+                         get_latency_us_percentile(0.5),
+                         get_latency_us_percentile(0.99),
+                         get_latency_us_percentile(0.999),
+                         get_latency_us_max());
+    }
 
     void reset() {
       ops = 0;
       elapsed = std::chrono::nanoseconds(0);
       latency_sum = std::chrono::nanoseconds(0);
+      latency_hist.reset();
     }
 
     Info& operator+=(const Info& rhs) {
       ops += rhs.ops;
       elapsed += rhs.elapsed;
       latency_sum += rhs.latency_sum;
+      latency_hist += rhs.latency_hist;
       return *this;
     }
   };
@@ -84,11 +180,22 @@ class Stat {
     timers[timer_idx].reset();
   }
 
+  // start the op at a given time, e.g., when it is scheduled in an open-loop
+  // workload (instead of when it is actually issued), so the queueing delay
+  // before issuing is counted into its latency
+  void op_start(uint32_t timer_idx,
+                std::chrono::high_resolution_clock::time_point ts) {
+    assert(timer_idx < timers.size());
+    timers[timer_idx].reset(ts);
+  }
+
   void op_stop(uint32_t timer_idx = 0) {
     assert(timer_idx < timers.size());
     auto ts = Timer::now();
+    auto latency = timers[timer_idx].elapsed(ts);
     epoch.ops++;
-    epoch.latency_sum += timers[timer_idx].elapsed(ts);
+    epoch.latency_sum += latency;
+    epoch.latency_hist.add(latency.count());
     auto epoch_elapsed = epoch_elapsed_timer.elapsed(ts);
     if (epoch_elapsed >= args.report_interval) {
       epoch.elapsed = epoch_elapsed;
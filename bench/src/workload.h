@@ -5,7 +5,9 @@
 #include <cassert>
 #include <chrono>
 #include <cstdint>
+#include <random>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
 #include "config.h"
@@ -45,6 +47,24 @@ class Workload {
   std::vector<void*> bufs;
   Offsets offsets;
 
+  void init_per_fd_stats(const std::vector<int>& fds,
+                         std::unordered_map<int, Stat>& per_fd_stat_map,
+                         std::unordered_map<int, uint64_t>& per_fd_dirty_sizes) {
+    for (const auto& fd : fds) {
+      auto final_callback = [&, fd](const Stat& stat) {
+        const auto& info = stat.get_accum_info();
+        THREAD_INFO("{} fd-{}: {:7.2f} MB/s, {:7.3f} us/op {}", spec.name, fd,
+                    info.get_mbps(spec.count), info.get_latency_us_per_op(),
+                    info.get_latency_tail_str());
+      };
+      per_fd_stat_map.emplace(
+          std::piecewise_construct, std::forward_as_tuple(fd),
+          std::forward_as_tuple(Stat::Args{.final_callback = final_callback},
+                                1));
+      per_fd_dirty_sizes.emplace(fd, 0);
+    }
+  }
+
  public:
   explicit Workload(const spec::Workload& spec)
       : spec(spec), offsets(spec.ops, spec.offset) {
@@ -57,31 +77,30 @@ class Workload {
   }
 
   void run(const std::vector<int>& fds) {
+    if (spec.is_open_loop()) return run_open_loop(fds);
     THREAD_DEBUG("Running workload {}: {}", spec.name, spec.dump());
     auto epoch_callback = [&](const Stat& stat) {
       const auto& info = stat.get_epoch_info();
       THREAD_INFO(
-          "{}: Epoch {:2.0f}: {} ops in {:.2f} s ({:7.2f} MB/s, {:7.3f} us/op)",
+          "{}: Epoch {:2.0f}: {} ops in {:.2f} s ({:7.2f} MB/s, {:7.3f} "
+          "us/op) {}",
           spec.name, stat.get_accum_info().get_elapsed_sec(), info.ops,
           info.get_elapsed_sec(), info.get_mbps(spec.count),
-          info.get_latency_us_per_op());
+          info.get_latency_us_per_op(), info.get_latency_tail_str());
+    };
+    auto final_callback = [&](const Stat& stat) {
+      const auto& info = stat.get_accum_info();
+      THREAD_INFO("{}: Total: {} ops ({:7.2f} MB/s, {:7.3f} us/op) {}",
+                  spec.name, info.ops, info.get_mbps(spec.count),
+                  info.get_latency_us_per_op(), info.get_latency_tail_str());
     };
-    Stat stat({.epoch_callback = epoch_callback}, spec.qdepth);
+    Stat stat(
+        {.final_callback = final_callback, .epoch_callback = epoch_callback},
+        spec.qdepth);
 
     std::unordered_map<int, Stat> per_fd_stat_map;
     std::unordered_map<int, uint64_t> per_fd_dirty_sizes;
-    for (const auto& fd : fds) {
-      auto final_callback = [&, fd](const Stat& stat) {
-        const auto& info = stat.get_accum_info();
-        THREAD_INFO("{} fd-{}: {:7.2f} MB/s, {:7.3f} us/op", spec.name, fd,
-                    info.get_mbps(spec.count), info.get_latency_us_per_op());
-      };
-      per_fd_stat_map.emplace(
-          std::piecewise_construct, std::forward_as_tuple(fd),
-          std::forward_as_tuple(Stat::Args{.final_callback = final_callback},
-                                1));
-      per_fd_dirty_sizes.emplace(fd, 0);
-    }
+    init_per_fd_stats(fds, per_fd_stat_map, per_fd_dirty_sizes);
 
     size_t fd_idx = 0;
     size_t op_cnt = 0;
@@ -243,6 +262,181 @@ class Workload {
     }
   }
 
+  // Open-loop: ops arrive at `spec.get_rate()` with Poisson or constant
+  // inter-arrival times, regardless of whether previous ops have completed.
+  // An op's latency is measured from its scheduled arrival instead of when it
+  // is issued, so the time it waits for a free slot (all `qdepth` inflight) or
+  // for a late sync op is charged to it, i.e., no coordinated omission.
+  void run_open_loop(const std::vector<int>& fds) {
+    THREAD_DEBUG("Running open-loop workload {}: {}", spec.name, spec.dump());
+    // an op issued this late after its arrival is counted as late
+    static constexpr auto late_threshold = std::chrono::microseconds(10);
+    // sleep (instead of spinning) only if the next arrival is further away
+    static constexpr auto spin_threshold = std::chrono::microseconds(50);
+    // recheck period while the target rate is zero
+    static constexpr auto pause_interval = std::chrono::milliseconds(1);
+
+    double offered_rate = 0;
+    uint64_t num_late = 0;
+    auto epoch_callback = [&](const Stat& stat) {
+      const auto& info = stat.get_epoch_info();
+      THREAD_INFO(
+          "{}: Epoch {:2.0f}: {} ops in {:.2f} s ({:7.2f} MB/s, {:7.3f} "
+          "us/op) {}, offered {:.0f} ops/s",
+          spec.name, stat.get_accum_info().get_elapsed_sec(), info.ops,
+          info.get_elapsed_sec(), info.get_mbps(spec.count),
+          info.get_latency_us_per_op(), info.get_latency_tail_str(),
+          offered_rate);
+    };
+    auto final_callback = [&](const Stat& stat) {
+      const auto& info = stat.get_accum_info();
+      THREAD_INFO("{}: Total: {} ops ({:7.2f} MB/s, {:7.3f} us/op) {}, {} late",
+                  spec.name, info.ops, info.get_mbps(spec.count),
+                  info.get_latency_us_per_op(), info.get_latency_tail_str(),
+                  num_late);
+    };
+    Stat stat(
+        {.final_callback = final_callback, .epoch_callback = epoch_callback},
+        spec.qdepth);
+
+    std::unordered_map<int, Stat> per_fd_stat_map;
+    std::unordered_map<int, uint64_t> per_fd_dirty_sizes;
+    init_per_fd_stats(fds, per_fd_stat_map, per_fd_dirty_sizes);
+
+    auto on_write_done = [&](int fd) {
+      uint64_t& fd_dirty = per_fd_dirty_sizes.find(fd)->second;
+      fd_dirty += spec.count;
+      if (fd_dirty >= spec.dirty_threshold) {
+        int ret = fs_fdatasync(fd);
+        if (ret != 0) THREAD_ERROR("fdatasync returns {}", ret);
+        fd_dirty = 0;
+      }
+    };
+    auto check_rc = [&](ssize_t rc, bool is_read, int fd, off_t off) {
+      if (rc == spec.count) return;
+      THREAD_ERROR("{}: {} returned {} on fd={}, count={}, off={}", spec.name,
+                   is_read ? "pread" : "pwrite", rc, fd, spec.count, off);
+      throw std::runtime_error("I/O does not return expected data");
+    };
+
+    // async slots; only used if qdepth > 1
+    std::vector<async_ctx_rw> ctxs(spec.qdepth);
+    std::vector<bool> slots_busy(spec.qdepth, false);
+    std::vector<bool> slots_is_read(spec.qdepth);
+    std::vector<Timer::time_point> slots_due_ts(spec.qdepth);
+    uint32_t num_busy = 0;
+    // reap the op in the slot if it has completed
+    auto try_complete = [&](uint32_t idx) {
+      auto ctx = &ctxs[idx];
+      ssize_t rc;
+      int poll_rc = slots_is_read[idx] ? fs_allocated_pread_poll(ctx, &rc)
+                                       : fs_allocated_pwrite_poll(ctx, &rc);
+      if (poll_rc != 0) return;  // still inflight
+      check_rc(rc, slots_is_read[idx], ctx->fd, ctx->offset);
+      if (!slots_is_read[idx]) on_write_done(ctx->fd);
+      stat.op_stop(idx);
+      // per-fd stat has only one timer, so start it only now
+      auto& fd_stat = per_fd_stat_map.find(ctx->fd)->second;
+      fd_stat.op_start(0, slots_due_ts[idx]);
+      fd_stat.op_stop();
+      slots_busy[idx] = false;
+      --num_busy;
+    };
+    auto poll_all = [&]() {
+      for (uint32_t i = 0; i < spec.qdepth; ++i)
+        if (slots_busy[i]) try_complete(i);
+    };
+
+    std::mt19937_64 rng{std::random_device{}()};
+    std::exponential_distribution<double> exp_dist(1.0);
+    auto get_interval = [&](double rate) {
+      double sec = spec.arrival == spec::ArrivalType::POISSON
+                       ? exp_dist(rng) / rate
+                       : 1.0 / rate;
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::duration<double>(sec));
+    };
+
+    size_t fd_idx = 0;
+    uint64_t op_cnt = 0;
+    auto off_it = offsets.begin();
+    auto start_ts = Timer::now();
+    auto due_ts = start_ts;
+    auto is_expired = [&]() {
+      return std::chrono::duration<double>(due_ts - start_ts).count() >=
+             spec.duration_sec;
+    };
+    // wait for `ts`; keep reaping completions in the meantime
+    auto wait_until = [&](Timer::time_point ts) {
+      while (Timer::now() < ts) {
+        if (num_busy > 0)
+          poll_all();
+        else if (ts - Timer::now() > spin_threshold)
+          std::this_thread::sleep_until(ts - spin_threshold);
+      }
+    };
+    stat.reset();
+    while (op_cnt < spec.ops && off_it != offsets.end()) {
+      // schedule the next arrival
+      double sec = std::chrono::duration<double>(due_ts - start_ts).count();
+      // e.g., a ramp down to 0 with no duration_sec would never expire
+      if (spec.is_rate_over(sec)) break;
+      offered_rate = spec.get_rate(sec);
+      if (offered_rate <= 0) {
+        due_ts += pause_interval;
+        if (is_expired()) break;
+        wait_until(due_ts);
+        continue;
+      }
+      due_ts += get_interval(offered_rate);
+      if (is_expired()) break;
+
+      wait_until(due_ts);
+      // wait for a free slot; the op is queueing now
+      while (num_busy == spec.qdepth) poll_all();
+
+      off_t off = *off_it;
+      int fd = fds[fd_idx];
+      bool is_read = rand() % 100 < spec.read_ratio * 100;
+      if (Timer::now() - due_ts > late_threshold) ++num_late;
+
+      if (spec.qdepth == 1) {  // use sync APIs
+        per_fd_stat_map.find(fd)->second.op_start(0, due_ts);
+        stat.op_start(0, due_ts);
+        ssize_t rc = is_read ? fs_allocated_pread(fd, bufs[0], spec.count, off)
+                             : fs_allocated_pwrite(fd, bufs[0], spec.count, off);
+        check_rc(rc, is_read, fd, off);
+        if (!is_read) on_write_done(fd);
+        stat.op_stop();
+        per_fd_stat_map.find(fd)->second.op_stop();
+      } else {
+        uint32_t idx = 0;
+        while (slots_busy[idx]) ++idx;
+        stat.op_start(idx, due_ts);
+        int submit_rc =
+            is_read
+                ? fs_allocated_pread_submit(&ctxs[idx], fd, bufs[idx],
+                                            spec.count, off)
+                : fs_allocated_pwrite_submit(&ctxs[idx], fd, bufs[idx],
+                                             spec.count, off);
+        if (submit_rc) throw std::runtime_error("Fail to submit I/O");
+        slots_busy[idx] = true;
+        slots_is_read[idx] = is_read;
+        slots_due_ts[idx] = due_ts;
+        ++num_busy;
+      }
+
+      ++op_cnt;
+      fd_idx = (fd_idx + 1) % fds.size();
+      // same as closed-loop: for sequential workloads, reuse the same offset
+      // until all the files are used
+      if (spec.offset.type != spec::OffsetType::SEQ || fd_idx == 0) ++off_it;
+    }
+
+    // clean up inflight requests
+    while (num_busy > 0) poll_all();
+  }
+
   enum class DBWorkloadType { RW, SCAN };
 
   void run(leveldb::DB* db) {
@@ -259,10 +453,10 @@ class Workload {
       const auto& info = stat.get_epoch_info();
       THREAD_INFO(
           "{}: Epoch {:2.0f}: {} ops in {:.2f} s ({:7.2f} kops, {:7.3f} "
-          "us/op)",
+          "us/op) {}",
           spec.name, stat.get_accum_info().get_elapsed_sec(), info.ops,
           info.get_elapsed_sec(), info.get_iops() / 1000,
-          info.get_latency_us_per_op());
+          info.get_latency_us_per_op(), info.get_latency_tail_str());
     };
     Stat stat({.epoch_callback = epoch_callback}, 1);
 
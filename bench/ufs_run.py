@@ -7,7 +7,7 @@ from pathlib import Path
 from ufs_build import get_ufs_build_dir
 from ufs_cleanup import EXIT_FNAME, READY_FNAME
 from utils import run_cmd, check_rc
-from typing import List
+from typing import Dict, List
 
 
 def prep_configs(ufs_config_fname: str = "/tmp/ufs.config",
@@ -47,6 +47,8 @@ def get_ufs_cmd(
     disable_avoid_tiny_weight=False,
     disable_cache_partition=False,
     is_symm=True,
+    cache_policies: Dict[int, str] = None,  # aid -> "lru"/"2q"/"arc"/"bypass"
+    sim_config: str = None,  # emulated device's config; needs NO_JOURNAL
 ):
     assert len(core_ids) == num_workers
     assert is_symm or num_workers % num_apps == 0
@@ -95,6 +97,11 @@ def get_ufs_cmd(
         policy_flags.append("NO_CACHE_PARTITION")
     if policy_flags:
         cmd += f" -p {','.join(policy_flags)}"
+    if cache_policies:
+        cmd += " -m " + ','.join(f"a{aid}:{p}"
+                                 for aid, p in cache_policies.items())
+    if sim_config:
+        cmd += f" -s {sim_config}"
     return cmd
 
 
@@ -4,6 +4,7 @@
 #include <atomic>
 #include <string>
 
+#include "BlkDevStripe.h"
 #include "typedefs.h"
 
 // TODO: support bulk read/write request convering multiple blocks
@@ -27,8 +28,13 @@ struct BdevIoContext {
   BlkDevReqType reqType;
   cfs_tid_t tid;
   bdev_reqid_t rid;
+  // device the request went to (see BlkDevStripe)
+  int dev;
   // Used when busy checking the status of this request, e.g. blockingRead()
   bool isDone;  // no atomic needed...
+  // rdtsc at submission of an async request; 0 for blocking requests, whose
+  // latency is not fed to the QueueDepthController
+  uint64_t submitTs;
   BdevIoContext()
       : buf(nullptr),
         blockNo(0),
@@ -36,7 +42,9 @@ struct BdevIoContext {
         reqType(BlkDevReqType::BLK_DEV_REQ_DEFAULT),
         tid(0),
         rid(0),
-        isDone(false) {}
+        dev(0),
+        isDone(false),
+        submitTs(0) {}
 };
 
 class BlkDev {
@@ -49,12 +57,42 @@ class BlkDev {
   virtual int write(uint64_t blockNo, uint64_t blockNoSeqNo, char *data) = 0;
   virtual void *zmallocBuf(uint64_t size, uint64_t align) = 0;
   virtual int freeBuf(void *ptr) = 0;
+  // Same as zmallocBuf(), with the memory on NUMA node `node` (see
+  // FsProc_Numa.h) if the device can place it; node < 0 means anywhere
+  virtual void *zmallocBufOnNode(uint64_t size, uint64_t align, int node) {
+    return zmallocBuf(size, align);
+  }
   virtual int devExit(void) = 0;
+  // Make memory not allocated by zmallocBuf() (e.g., an app's shm) the target
+  // of DMA. A device may only be able to use part of it, which is returned as
+  // [start, end). Registrations of the same memory are reference counted.
+  // @return false if none of it can be used (the default)
+  virtual bool registerDmaMem(char *addr, uint64_t len, char *&start,
+                              char *&end) {
+    return false;
+  }
+  virtual void unregisterDmaMem(char *start) {}
+
+  // Devices the FS blocks are striped over (1 unless configured)
+  int getNumDevs() const { return stripe.numDevs; }
+  int getDevOfBlock(uint64_t blockNo) const { return stripe.devOf(blockNo); }
+  int getDevOfSector(uint64_t sectorNo) const {
+    return stripe.devOf(sectorNo * 512 / devBlockSize);
+  }
 
  protected:
+  // @return the device of the byte `offset` of the FS in `dev` and the
+  // offset on that device
+  uint64_t mapDevOffset(uint64_t offset, int &dev) const {
+    uint64_t blockNo = offset / devBlockSize;
+    dev = stripe.devOf(blockNo);
+    return stripe.devBlockNo(blockNo) * devBlockSize + offset % devBlockSize;
+  }
+
   std::string devPath;
   uint32_t devBlockNum;
   uint32_t devBlockSize;
+  BlkDevStripe stripe;
 };
 
 #endif  // CFS_BLKDEV_H
@@ -0,0 +1,70 @@
+#ifndef CFS_BLKDEVQDCONTROLLER_H
+#define CFS_BLKDEVQDCONTROLLER_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Adaptive limit of a worker's in-flight device requests. A deep queue keeps
+ * the device busy but every request waits behind it; so, like CoDel, it looks
+ * at the minimum completion latency of each interval: if even the fastest
+ * request took longer than the target, there is a standing queue and the
+ * limit is cut multiplicatively. Otherwise the limit is only raised if it was
+ * reached in the interval (i.e., it may be what holds the throughput back).
+ *
+ * Like BBR, the delivery rate of the intervals in which the device was the
+ * bottleneck (the limit was reached or the latency was above the target) is
+ * max-filtered into a capacity estimate; intervals with an idle device say
+ * nothing about the capacity.
+ *
+ * All the calls are from the worker that owns it, except get_capacity().
+ * Time is in any unit given by `ticks_per_second`.
+ */
+class QueueDepthController {
+ public:
+  struct Params {
+    uint64_t target_latency;
+    uint64_t interval;
+    int min_limit;
+    int max_limit;
+    uint64_t ticks_per_second;
+    // length of the capacity max-filter, in #intervals
+    int num_filter_intervals = 10;
+  };
+
+  explicit QueueDepthController(const Params &params);
+
+  // called at submission with the number of requests in flight including it
+  void on_submit(int num_inflight) {
+    if (num_inflight >= limit) limit_reached = true;
+  }
+  void on_complete(uint64_t now, uint64_t latency, uint32_t bytes);
+
+  int get_limit() const { return limit; }
+  // device throughput when it is the bottleneck in bytes/second; 0 if the
+  // device has never been saturated by this worker
+  uint64_t get_capacity() const {
+    return capacity.load(std::memory_order_relaxed);
+  }
+
+ private:
+  void end_interval(uint64_t now);
+
+  const Params params;
+  int limit;
+
+  // the current interval
+  bool started = false;
+  uint64_t interval_start = 0;
+  uint64_t min_latency = UINT64_MAX;
+  uint64_t bytes_done = 0;
+  bool limit_reached = false;
+
+  // delivery rates of the recent saturated intervals (ring buffer)
+  std::vector<uint64_t> rate_samples;
+  size_t next_sample = 0;
+  std::atomic_uint64_t capacity{0};
+};
+
+#endif  // CFS_BLKDEVQDCONTROLLER_H
@@ -0,0 +1,135 @@
+#ifndef CFS_BLKDEVSIM_H
+#define CFS_BLKDEVSIM_H
+
+#include <atomic>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "BlkDevSimModel.h"
+#include "BlkDevSpdk.h"
+
+/**
+ * Emulated NVMe device. It keeps the asynchronous contract of BlkDevSpdk: a
+ * request is submitted by read()/write() and its completion is delivered to
+ * the submitting worker by checkCompletion(), but the device is a RAM (or
+ * file) store and the completion time of each command is given by
+ * BlkDevSimModel. It lets the scheduler be tested without an NVMe SSD.
+ *
+ * The data is copied at submission; a command just becomes visible to the
+ * worker no earlier than its modeled completion time.
+ *
+ * With `num_devs` > 1, the data is striped over as many emulated devices
+ * (BlkDevStripe), each with its own model of the same parameters, so every
+ * device has its own bandwidth. The store is still one range of the size of
+ * the FS.
+ *
+ * NOTE: the journal issues NVMe commands on the qpair directly, so it only
+ * works with CFS_JOURNAL_TYPE=NO_JOURNAL.
+ */
+class BlkDevSim : public BlkDevSpdk {
+ public:
+  // @param configName: config4cpp file of BlkDevSimParams (same names);
+  //   `store` is the backing file; if not set, the data is kept in memory;
+  //   `num_devs` and `stripe_mb` as BlkDevSpdk
+  BlkDevSim(uint32_t blockNum, uint32_t blockSize, std::string configName);
+  ~BlkDevSim();
+  // inherited functions
+  int devInit();
+  int read(uint64_t blockNo, char *data, void *ctx_payload = nullptr);
+  int write(uint64_t blockNo, uint64_t blockNoSeqNo, char *data);
+  void *zmallocBuf(uint64_t size, uint64_t align);
+  void *zmallocBufOnNode(uint64_t size, uint64_t align, int node);
+  int freeBuf(void *ptr);
+  int devExit(void);
+  // the store is accessed by memcpy; any memory can be the target
+  bool registerDmaMem(char *addr, uint64_t len, char *&start, char *&end) {
+    start = addr;
+    end = addr + len;
+    return true;
+  }
+  void unregisterDmaMem(char *start) {}
+  // overwrite BlkDevSpdk's functions
+  int blockingRead(uint64_t blockNo, char *data);
+  int blockingWrite(uint64_t blockNo, char *data);
+  int blockingWriteMultiBlocks(uint64_t blockStartNo, int numBlocks,
+                               char *data);
+  int initWorker(int wid);
+  void updateWorkerNum(int workerNum) { numWorkers = workerNum; }
+  bool ifAllworkerReady() { return numReadyWorkers >= numWorkers; }
+  int checkCompletion(int maxCmplNum);
+  void releaseBdevIoContext(struct BdevIoContext *ctx);
+  int reduceInflightWriteNum(int num) { return 0; }
+  int getInflightReqNum();
+  int flushWrittenDevs(FlushCallback cb, void *cbArg);
+  int cleanup(void);
+  // number of flushes submitted to device `dev`
+  uint64_t getDevNumFlushes(int dev) const { return devNumFlushes[dev]; }
+
+  int readSector(uint64_t sectorNo, char *data, void *ctx_payload = nullptr);
+  int blockingReadSector(uint64_t sectorNo, char *data);
+  int writeSector(uint64_t sectorNo, uint64_t sectorNoSeqNo, char *data);
+  int blockingWriteSector(uint64_t sectorNo, uint64_t sectorNoSeqNo,
+                          char *data);
+
+  // DO_NOT_SUPPORT
+  void addController(struct ctrlr_entry *entry) { throw; }
+  void registerNamespace(struct spdk_nvme_ctrlr *ctrlr,
+                         struct spdk_nvme_ns *ns) {
+    throw;
+  }
+  struct spdk_nvme_ns *getCurrentThreadNS(void) { return nullptr; }
+  struct spdk_nvme_qpair *getCurrentThreadQPair(void) { return nullptr; }
+
+ private:
+  static constexpr int kNumMaxThreads = 20;
+
+  // a submitted command waiting for its modeled completion time; a flush
+  // has no context
+  struct PendingCmd {
+    uint64_t done_ts;
+    struct BdevIoContext *ctx;
+    FlushGroup *flush;
+    bool operator>(const PendingCmd &other) const {
+      return done_ts > other.done_ts;
+    }
+  };
+  using PendingQueue =
+      std::priority_queue<PendingCmd, std::vector<PendingCmd>,
+                          std::greater<PendingCmd>>;
+
+  // per-thread state, like the qpair and request contexts of BlkDevSpdk
+  struct ThreadQueue {
+    std::vector<struct BdevIoContext *> ctxs;
+    std::vector<bdev_reqid_t> unusedReqids;
+    PendingQueue pending;
+  };
+
+  // copy between the store and `data`; the IO must not cross a stripe unit
+  // @param dev: set to the device of `offset`
+  // @return the modeled completion time
+  uint64_t doIo(uint64_t offset, uint32_t bytes, char *data, bool isWrite,
+                int &dev);
+  // @param blockNo: in the unit of `bytes`, as BlkDevSpdk::submitDevReq
+  int submitReq(uint64_t blockNo, uint64_t blockNoSeqNo, char *data,
+                BlkDevReqType reqType, uint32_t bytes, void *ctx_payload);
+  int blockingIo(uint64_t offset, uint32_t bytes, char *data, bool isWrite);
+  static uint64_t nowNs();
+
+  BlkDevSimParams params;
+  // one per device; the submissions of all the workers go through them
+  std::vector<BlkDevSimModel *> models;
+  std::vector<std::atomic_uint64_t> devNumFlushes;
+  std::mutex modelLock;
+
+  int storeFd = -1;
+  char *storeMem = nullptr;
+  uint64_t storeSize;
+
+  std::vector<ThreadQueue> threadQueues;
+  int numWorkers = 1;
+  std::atomic_int numReadyWorkers{0};
+};
+
+#endif  // CFS_BLKDEVSIM_H
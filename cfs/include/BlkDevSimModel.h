@@ -0,0 +1,74 @@
+#ifndef CFS_BLKDEVSIMMODEL_H
+#define CFS_BLKDEVSIMMODEL_H
+
+#include <cstdint>
+#include <random>
+#include <string_view>
+#include <vector>
+
+// Parameters of the emulated NVMe device (see BlkDevSim).
+struct BlkDevSimParams {
+  // distribution of the per-command service latency
+  // - FIXED: always the mean
+  // - EXP: exponential with the mean
+  // - LOGNORMAL: lognormal with the mean and a stddev of lat_cv * mean
+  enum class LatDist : uint8_t { FIXED, EXP, LOGNORMAL };
+
+  LatDist lat_dist = LatDist::LOGNORMAL;
+  double read_lat_us = 80;
+  double write_lat_us = 20;
+  double lat_cv = 0.3;
+  // bandwidth ceiling of each direction in MiB/s; 0 means unlimited
+  double read_bw_mbps = 0;
+  double write_bw_mbps = 0;
+  // number of commands the device serves concurrently (e.g., flash channels);
+  // the others wait in the device's queue
+  int parallelism = 32;
+  // a read that starts while writes are in service is slowed by
+  // (1 + rw_interference * #writes_in_service / parallelism), modeling reads
+  // stuck behind flash programs
+  double rw_interference = 0;
+  uint64_t seed = 0;
+
+  // accept "fixed", "exp" and "lognormal"
+  // @return false if the name is unknown
+  static bool parse_lat_dist(std::string_view name, LatDist &dist);
+};
+
+/**
+ * Timing model of the emulated device. A command takes the channel that frees
+ * up first, holds it for a sampled service latency and, if its direction has a
+ * bandwidth ceiling, completes no earlier than its bytes can be transferred
+ * after all the bytes submitted before it. Time is in nanoseconds of any epoch.
+ *
+ * Not thread-safe; the device serializes the submissions.
+ */
+class BlkDevSimModel {
+ public:
+  explicit BlkDevSimModel(const BlkDevSimParams &params);
+
+  // @return the completion time of a command submitted at `now`
+  uint64_t submit(uint64_t now, bool is_write, uint32_t bytes);
+
+  const BlkDevSimParams &get_params() const { return params; }
+
+ private:
+  struct Channel {
+    uint64_t free_ts = 0;
+    bool is_write = false;
+  };
+
+  uint64_t sample_latency(bool is_write);
+
+  BlkDevSimParams params;
+  std::vector<Channel> channels;
+  // when the bytes submitted so far in each direction are transferred
+  uint64_t bw_free_ts[2] = {0, 0};
+  // ns per byte of each direction; 0 if unlimited
+  double ns_per_byte[2] = {0, 0};
+  std::mt19937_64 gen;
+  std::lognormal_distribution<double> lognormal_dist;
+  std::exponential_distribution<double> exp_dist{1.0};
+};
+
+#endif  // CFS_BLKDEVSIMMODEL_H
@@ -5,10 +5,13 @@
 
 #include <deque>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
 #include "BlkDev.h"
+#include "BlkDevQdController.h"
 #include "param.h"
 #include "spdk/env.h"
 #include "spdk/nvme.h"
@@ -43,6 +46,14 @@ class BlkDevSpdk : public BlkDev {
   // if enabled, each name_read/write will go through checking of the memory
   // address to make sure the address is within the valid pinned memory
   static constexpr bool kCheckRWMem = false;
+  // granularity of spdk_mem_register()
+  static constexpr uintptr_t kDmaMemAlign = 2 * 1024 * 1024;
+  // devices the data can be striped over (`num_devs` in the config)
+  static constexpr int kMaxDevs = 8;
+  // default stripe unit (`stripe_mb`); large enough that a file usually sits
+  // on one device, so the load of a tenant on each device is skewed by which
+  // of its files are hot (see Tenant::add_blk_queue())
+  static constexpr uint64_t kDefaultStripeMB = 1024;
   BlkDevSpdk(const std::string &path, uint32_t blockNum, uint32_t blockSize);
   BlkDevSpdk(const std::string &path, uint32_t blockNum, uint32_t blockSize,
              std::string configName);
@@ -52,8 +63,12 @@ class BlkDevSpdk : public BlkDev {
   virtual int read(uint64_t blockNo, char *data, void *ctx_payload);
   virtual int write(uint64_t blockNo, uint64_t blockNoSeqNo, char *data);
   virtual void *zmallocBuf(uint64_t size, uint64_t align);
+  virtual void *zmallocBufOnNode(uint64_t size, uint64_t align, int node);
   virtual int freeBuf(void *ptr);
   virtual int devExit(void);
+  virtual bool registerDmaMem(char *addr, uint64_t len, char *&start,
+                              char *&end);
+  virtual void unregisterDmaMem(char *start);
   // BlkDevSpdk specific functions (not inherited)
   virtual int blockingRead(uint64_t blockNo, char *data);
   virtual int blockingWrite(uint64_t blockNo, char *data);
@@ -74,6 +89,29 @@ class BlkDevSpdk : public BlkDev {
   virtual void releaseBdevIoContext(struct BdevIoContext *ctx);
   // called once an write block IO is done to reduce the current inflight #
   virtual int reduceInflightWriteNum(int num);
+  // number of requests submitted by the current thread but not completed yet
+  virtual int getInflightReqNum();
+  // how many requests the current thread should keep in flight at most; it is
+  // adapted to hold the completion latency (see QueueDepthController)
+  int getInflightReqLimit();
+  // sum of the workers' estimates of the device throughput in bytes/second;
+  // 0 if the device has never been saturated
+  uint64_t getCapacityEstimate();
+  // Same as the three above, for device `dev` only: each device has its own
+  // qpair and controller in every thread, so a slow device does not hold the
+  // requests to the others back
+  int getDevInflightReqNum(int dev);
+  int getDevInflightReqLimit(int dev);
+  uint64_t getDevCapacityEstimate(int dev);
+  // called once all the flushes of a flushWrittenDevs() complete; `ok` is
+  // false if any of them fails
+  using FlushCallback = void (*)(void *arg, bool ok);
+  // Flush the volatile write cache of device 0 (the metadata and the
+  // journals) and of every device the current thread has written to since
+  // its last flush, so that a journal commit never gets durable before the
+  // data it covers. The callback is called by checkCompletion().
+  // @return number of flushes submitted, -1 if none could be
+  virtual int flushWrittenDevs(FlushCallback cb, void *cbArg);
   // clean up the access to this device (not only the worker's access)
   virtual int cleanup();
 
@@ -119,6 +157,38 @@ class BlkDevSpdk : public BlkDev {
   std::string configFileName;
   bool isSpdkDev = true;
 
+  // lay the data blocks out over `numDevs` devices (see BlkDevStripe)
+  // @return false if the layout is not valid
+  bool initStripe(int numDevs, uint64_t stripeMB);
+
+  // adaptive in-flight limit of each thread and device; created by
+  // initWorker(). <tid, <dev, controller>>
+  std::vector<std::vector<std::unique_ptr<QueueDepthController>>>
+      tidQdCtrlList;
+  // asynchronous requests in flight <tid, <dev, number>>
+  std::vector<std::vector<int>> tidDevInflightList;
+  void initQdController(cfs_tid_t tid);
+  // also counts the requests in flight to ctx->dev
+  void qdControllerOnSubmit(struct BdevIoContext *ctx);
+  void qdControllerOnComplete(struct BdevIoContext *ctx);
+
+  // the flushes of one flushWrittenDevs(), waiting for all of them
+  struct FlushGroup {
+    FlushCallback cb;
+    void *cbArg;
+    int numLeft;
+    bool ok;
+  };
+  static void onFlushDone(FlushGroup *group, bool ok);
+  static void flushComplete(void *arg, const struct spdk_nvme_cpl *completion);
+  // devices written since the last flush <tid, <dev, written>>
+  std::vector<std::vector<bool>> tidDevWrittenList;
+  void markDevWritten(cfs_tid_t tid, int dev) {
+    if (!tidDevWrittenList[tid].empty()) tidDevWrittenList[tid][dev] = true;
+  }
+  // @return device 0 and the devices written by `tid`, whose marks are cleared
+  std::vector<int> takeDevsToFlush(cfs_tid_t tid);
+
  private:
   // A flag to control the debug output
   // Even using SPDLOG_DEBUG(), it is going to be to heavyweight if we log
@@ -140,13 +210,15 @@ class BlkDevSpdk : public BlkDev {
 
   struct ctrlr_entry *gControllers;
   struct ns_entry *gNamespaces;
-  // Note: assume only has one controller and one namespace now, always use this
-  // one
+  // namespaces the FS is striped over, the first stripe.numDevs ones of
+  // gNamespaces; the metadata (and the journal) is on devNsList[0]
+  std::vector<struct ns_entry *> devNsList;
   struct spdk_env_opts opts;
   static constexpr int kNumMaxThreads = 20;
   std::vector<std::vector<bdev_reqid_t>> tidUnusedReqidList;
   std::vector<threadReqVec> tidReqvecList;
-  std::vector<struct spdk_nvme_qpair *> tidQpairList;
+  // <tid, <dev, qpair>>
+  std::vector<std::vector<struct spdk_nvme_qpair *>> tidQpairList;
   std::vector<int> tidWidList;
 
   int _workerNum = 1;
@@ -159,6 +231,11 @@ class BlkDevSpdk : public BlkDev {
   char *pinMemBase = nullptr;
   char *pinMemEnd = nullptr;
 
+  // memory registered by registerDmaMem(); shared by all the workers
+  // <start, <end, refs>>
+  std::mutex dmaMemLock;
+  std::unordered_map<char *, std::pair<char *, int>> dmaMemRegions;
+
   // Stats reporting
   bool isReportStats = false;
   static constexpr uint32_t kReportAllocCalledNumThreshold = 10000;
@@ -172,7 +249,7 @@ class BlkDevSpdk : public BlkDev {
   // uint32_t inflightNumStatsVecIdx = 0;
   int64_t lastStatReportTime = 0;
 
-  struct BdevIoContext *allocReqContext(cfs_tid_t tid);
+  struct BdevIoContext *allocReqContext(cfs_tid_t tid, int dev = 0);
   void releaseReqContext(struct BdevIoContext *ctx);
   // submit a device IO request
   // @param blockNo : logical block number (in the unit of *curBlockSize*)
@@ -211,8 +288,14 @@ class BlkDevPosix : public BlkDevSpdk {
   int read(uint64_t blockNo, char *data, void *ctx_payload = nullptr);
   int write(uint64_t blockNo, uint64_t blockNoSeqNo, char *data);
   void *zmallocBuf(uint64_t size, uint64_t align);
+  void *zmallocBufOnNode(uint64_t size, uint64_t align, int node);
   int freeBuf(void *ptr);
   int devExit(void);
+  // reads are blocking copies; there is no DMA
+  bool registerDmaMem(char *addr, uint64_t len, char *&start, char *&end) {
+    return false;
+  }
+  void unregisterDmaMem(char *start) {}
   // overwrite BlkDevSpdk's functions
   int blockingRead(uint64_t blockNo, char *data);
   int blockingWrite(uint64_t blockNo, char *data);
@@ -230,6 +313,7 @@ class BlkDevPosix : public BlkDevSpdk {
   int checkCompletion(int maxCmplNum);
   void releaseBdevIoContext(struct BdevIoContext *ctx);
   int reduceInflightWriteNum(int num);
+  int getInflightReqNum() { return 0; }  // blocking device
   int cleanup(void);
 
  private:
@@ -0,0 +1,60 @@
+#ifndef CFS_BLKDEVSTRIPE_H
+#define CFS_BLKDEVSTRIPE_H
+
+#include <cstdint>
+#include <limits>
+
+// Layout of the FS blocks over several devices (e.g., the NVMe SSDs of a
+// host). The metadata below `firstBlock` (superblock, bitmaps, journals and
+// inodes) stays on device 0 at the same block numbers, so the journal keeps
+// writing it with its own LBAs. The data blocks from `firstBlock` on are
+// striped round-robin in units of `unitBlocks`: the k-th unit goes to device
+// k % numDevs, after the units before it on that device (and after the
+// metadata on device 0).
+//
+// Every request is one block or one sector, so it never crosses a unit; the
+// blocking multi-block writes are split with blocksLeftInUnit().
+struct BlkDevStripe {
+  int numDevs = 1;
+  uint64_t unitBlocks = 0;  // ignored with one device
+  uint64_t firstBlock = 0;
+
+  bool isStriped(uint64_t blockNo) const {
+    return numDevs > 1 && blockNo >= firstBlock;
+  }
+
+  int devOf(uint64_t blockNo) const {
+    if (!isStriped(blockNo)) return 0;
+    return ((blockNo - firstBlock) / unitBlocks) % numDevs;
+  }
+
+  // block number on the device devOf(blockNo)
+  uint64_t devBlockNo(uint64_t blockNo) const {
+    if (!isStriped(blockNo)) return blockNo;
+    uint64_t off = blockNo - firstBlock;
+    uint64_t unit = off / unitBlocks;
+    uint64_t base = unit % numDevs == 0 ? firstBlock : 0;
+    return base + (unit / numDevs) * unitBlocks + off % unitBlocks;
+  }
+
+  // number of blocks from `blockNo` on that are contiguous on its device
+  uint64_t blocksLeftInUnit(uint64_t blockNo) const {
+    if (numDevs <= 1) return std::numeric_limits<uint64_t>::max();
+    if (blockNo < firstBlock) return firstBlock - blockNo;
+    return unitBlocks - (blockNo - firstBlock) % unitBlocks;
+  }
+
+  // number of blocks device `dev` holds for a FS of `numBlocks` blocks
+  uint64_t devNumBlocks(int dev, uint64_t numBlocks) const {
+    if (numDevs <= 1) return numBlocks;
+    if (numBlocks <= firstBlock) return dev == 0 ? numBlocks : 0;
+    uint64_t units = (numBlocks - firstBlock) / unitBlocks;
+    uint64_t rest = (numBlocks - firstBlock) % unitBlocks;
+    uint64_t blocks = units / numDevs * unitBlocks;
+    if (uint64_t(dev) < units % numDevs) blocks += unitBlocks;
+    if (uint64_t(dev) == units % numDevs) blocks += rest;
+    return dev == 0 ? firstBlock + blocks : blocks;
+  }
+};
+
+#endif  // CFS_BLKDEVSTRIPE_H
@@ -1,6 +1,7 @@
 #ifndef CFS_BLOCKBUFFER_H
 #define CFS_BLOCKBUFFER_H
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <cstddef>
@@ -46,7 +47,11 @@ class BlockBuffer {
     lruCache.init(config, setBufPtr);
     for (auto [t, c] : config) {
       sched::Tenant *tenant = t.get_tenant();
-      if (tenant) tenant->set_cache(lruCache.get_cache(t));
+      if (!tenant) continue;
+      if (t.is_probation())
+        tenant->set_probation_cache(lruCache.get_cache(t));
+      else
+        tenant->set_cache(lruCache.get_cache(t));
     }
   }
 #endif
@@ -88,18 +93,24 @@ class BlockBuffer {
       if (tenant) {
         tenant->access_ghost_page(blockNo, isWrite);  // maintain ghost cache
         tenant->record_blocks_done(1);
+        if (item.get_tag() == sched::Tag::probation_of(tenant) &&
+            tenant->promotes_cache_hit())
+          item = promoteBlock(item, tenant);
       }
 #endif
     } else {
       // tenant can be nullptr if !isMultiTenantSupported
       sched::Tag tag = tenant ? (sched::params::policy::cache_partition
-                                     ? sched::Tag{.tenant = tenant}
+                                     ? tenant->get_insert_tag(blockNo)
                                      : sched::tag::global)
                               : (sched::tag::unalloc);
       if (isWrite && tenant) tenant->record_blocks_done(1);
       item = lruCache.insert(tag, blockNo, /*pin*/ true,
                              /*hint_nonexist*/ true);
       if (item == nullptr) return nullptr;
+#ifdef DO_SCHED
+      if (tag.get_tenant()) followCacheSplit(tenant);
+#endif
       item->reset();
       auto orig_index = item->getIndex();
       // NOTE: we never put 0 into the blockIndexMap
@@ -118,6 +129,12 @@ class BlockBuffer {
     return item;
   }
 
+  // whether blockNo is in the buffer (in memory or being read); unlike
+  // getBlock(), it neither inserts nor pins it
+  bool containsBlock(block_no_t blockNo) {
+    return lruCache.lookup(blockNo, false) != nullptr;
+  }
+
   template <typename Fn>
   void forEachBlock(Fn fn) {
     lruCache.for_each(fn);
@@ -197,9 +214,32 @@ class BlockBuffer {
     assert(sched::params::policy::cache_partition);
     sched::Tenant *tenant = t.get_tenant();
     assert(tenant);
-    auto old_size = lruCache.capacity_of(t);
     auto new_size = tenant->get_max_cache_size();
-    SCHED_LOG_NOTICE("Adjust cache size: %ld -> %d", old_size, new_size);
+    if (!tenant->is_cache_split()) {
+      resizeCachePartition(t, new_size);
+      return;
+    }
+    // shrink first so that the other one can grow from the unallocated space
+    sched::Tag main_tag = t.get_main();
+    sched::Tag probation_tag = sched::Tag::probation_of(tenant);
+    uint32_t probation_size = tenant->split_cache(new_size);
+    uint32_t main_size = new_size - probation_size;
+    if (lruCache.capacity_of(main_tag) > main_size) {
+      resizeCachePartition(main_tag, main_size);
+      resizeCachePartition(probation_tag, probation_size);
+    } else {
+      resizeCachePartition(probation_tag, probation_size);
+      resizeCachePartition(main_tag, main_size);
+    }
+#endif
+  }
+
+ private:
+#ifdef DO_SCHED
+  // move cache slots between the tag and `unalloc` so that the tag has new_size
+  void resizeCachePartition(sched::Tag t, size_t new_size) {
+    auto old_size = lruCache.capacity_of(t);
+    SCHED_LOG_NOTICE("Adjust cache size: %ld -> %ld", old_size, new_size);
     if (old_size < new_size) {
       auto move_cnt = new_size - old_size;
       auto done_cnt = lruCache.relocate(/*src*/ sched::tag::unalloc,
@@ -225,10 +265,36 @@ class BlockBuffer {
             old_size, new_size, move_cnt, done_cnt);
       }
     }
-#endif
   }
 
- private:
+  // ARC adapts the probation target on every ghost hit; relocate slots between
+  // the tenant's two partitions once the target has moved far enough from the
+  // current split, so that relocation (which evicts) is not done per miss
+  void followCacheSplit(sched::Tenant *tenant) {
+    if (tenant->get_cache_policy() != sched::CachePolicy::ARC) return;
+    sched::Tag main_tag = {.tenant = tenant};
+    sched::Tag probation_tag = sched::Tag::probation_of(tenant);
+    size_t curr = lruCache.capacity_of(probation_tag);
+    size_t target = tenant->get_probation_target();
+    size_t total = curr + lruCache.capacity_of(main_tag);
+    size_t step = std::max<size_t>(kMinCacheSplitStep, total / 64);
+    if (target >= curr + step)
+      lruCache.relocate(/*src*/ main_tag, /*dst*/ probation_tag, target - curr);
+    else if (curr >= target + step)
+      lruCache.relocate(/*src*/ probation_tag, /*dst*/ main_tag, curr - target);
+  }
+  constexpr static size_t kMinCacheSplitStep = 16;
+
+  // ARC: move a block hit in the tenant's probation to its main partition
+  // (T1 -> T2). SharedCache cannot retag a block, so it is taken out and
+  // installed again like an inode export and import, keeping its memory; both
+  // partitions keep their capacity, and main evicts to make room. Blocks that
+  // are not idle (being read, dirty or pinned by another request) stay.
+  // @return the pinned handle of the block
+  BlockBufferHandle promoteBlock(BlockBufferHandle item,
+                                 sched::Tenant *tenant);
+#endif
+
   /**
    * SharedCache use tag to distinguish tenant. Each tenant will have a unique
    * tag (in our implementation, it is Tenant pointer). nullptr is a special
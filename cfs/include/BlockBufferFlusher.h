@@ -1,12 +1,15 @@
 #ifndef CFS_BLOCKBUFFERFLUSHER_H
 #define CFS_BLOCKBUFFERFLUSHER_H
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <list>
 #include <map>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "BlockBufferItem.h"
 #include "Tag.h"
@@ -20,6 +23,15 @@ struct TenantInfo {
   size_t capacity = 0;
   size_t numDirty = 0;
 
+  // dirty blocks ordered by (index, block number), so that a write-back batch
+  // walks each inode's blocks in order and they coalesce on the device
+  std::map<std::pair<uint32_t, block_no_t>, BlockBufferHandle> dirtyBlocks;
+  // the write-back scans dirtyBlocks circularly; resume from here
+  std::pair<uint32_t, block_no_t> writeBackCursor{0, 0};
+  // indices covered by the in-flight write-back (at most one per tenant)
+  std::vector<uint32_t> writeBackIndices;
+  bool writeBackSent = false;
+
   [[nodiscard]] double getDirtyRatio() const {
     return static_cast<double>(numDirty) / capacity;
   }
@@ -43,7 +55,12 @@ struct TenantInfo {
 class Flusher {
  public:
   Flusher(const std::vector<std::pair<sched::Tag, size_t>> &config) {
-    for (auto [t, c] : config) tenantInfoMap.emplace(t, TenantInfo{t, c});
+    // a tenant's probation partition is accounted to its main one
+    for (auto [t, c] : config) {
+      auto [it, is_new] =
+          tenantInfoMap.emplace(t.get_main(), TenantInfo{t.get_main(), c});
+      if (!is_new) it->second.capacity += c;
+    }
   }
   Flusher(const Flusher &) = delete;
   Flusher &operator=(const Flusher &) = delete;
@@ -142,6 +159,80 @@ class Flusher {
     doFlushByIndex(0, canFlush, toFlushBlockNos);
   }
 
+  // Background write-back of one tenant (DO_SCHED): unlike doFlush, which
+  // picks any dirty blocks once the whole buffer is above the threshold, it is
+  // driven by the tenant's own dirty ratio and its blocks are submitted within
+  // the tenant's bandwidth (see sched::Tenant::add_wb_queue).
+  // @return: number of blocks the tenant should write back now; 0 if it is
+  // not above the threshold or has a write-back in flight
+  uint32_t checkIfTenantNeedWriteBack(sched::Tag tag) const {
+    auto it = tenantInfoMap.find(tag);
+    if (it == tenantInfoMap.end()) return 0;
+    auto &ti = it->second;
+    if (ti.writeBackSent || !ti.isAboveThreshold(dirtyRatioThreshold)) return 0;
+    // write back to the low watermark, so that it is not triggered again by
+    // the next few writes with a tiny batch
+    auto lowWater = static_cast<size_t>(dirtyRatioThreshold * ti.capacity *
+                                        kWriteBackLowWaterRatio);
+    return std::clamp<size_t>(ti.numDirty - lowWater,
+                              std::max(dirtyFlushOneTimeSubmitNum, 1U),
+                              kMaxWriteBackBatchSize);
+  }
+
+  // dirty blocks are about to use up the tenant's cache; its write-back should
+  // not wait for the bandwidth left by foreground block requests
+  bool checkIfTenantWriteBackUrgent(sched::Tag tag) const {
+    auto it = tenantInfoMap.find(tag);
+    if (it == tenantInfoMap.end()) return false;
+    return it->second.isAboveThreshold((1 + dirtyRatioThreshold) / 2);
+  }
+
+  // fill up to maxNum dirty blocks of the tenant, in (index, block number)
+  // order starting from where the last write-back stopped. The blocks of the
+  // indices with a foreground flush (fsync) pending are left to it.
+  void doWriteBack(sched::Tag tag, uint32_t maxNum,
+                   std::list<BlockBufferHandle> &toFlushBlockNos) {
+    auto &ti = tenantInfoMap[tag];
+    assert(!ti.writeBackSent);
+    auto &blocks = ti.dirtyBlocks;
+    auto it = blocks.lower_bound(ti.writeBackCursor);
+    for (size_t n = blocks.size(); n > 0 && toFlushBlockNos.size() < maxNum;
+         --n, ++it) {
+      if (it == blocks.end()) it = blocks.begin();
+      auto [idx, bno] = it->first;
+      if (fgIndices.find(idx) != fgIndices.end()) continue;
+      assert(it->second->isDirty());
+      toFlushBlockNos.push_back(it->second);
+      if (ti.writeBackIndices.empty() || ti.writeBackIndices.back() != idx) {
+        ti.writeBackIndices.push_back(idx);
+        writeBackIndexMap[idx]++;
+      }
+      ti.writeBackCursor = {idx, bno + 1};
+    }
+    if (!toFlushBlockNos.empty()) ti.writeBackSent = true;
+    SPDLOG_DEBUG("doWriteBack tenant:{} bnum:{}", fmt::ptr(tag.get_tenant()),
+                 toFlushBlockNos.size());
+  }
+
+  int doWriteBackDone(sched::Tag tag) {
+    auto &ti = tenantInfoMap[tag];
+    if (!ti.writeBackSent) {
+      SPDLOG_ERROR("doWriteBackDone called but writeBackSent is false");
+      return -1;
+    }
+    for (auto idx : ti.writeBackIndices)
+      if (--writeBackIndexMap[idx] == 0) writeBackIndexMap.erase(idx);
+    ti.writeBackIndices.clear();
+    ti.writeBackSent = false;
+    return 0;
+  }
+
+  // a foreground flush of this index must wait until the write-back is done;
+  // otherwise, a block could be submitted twice
+  bool checkIfIdxWriteBackInflight(uint32_t index) const {
+    return writeBackIndexMap.find(index) != writeBackIndexMap.end();
+  }
+
   int doFlushDone() {
     if (!(bgFlushSent || checkIfFgFlushInflight())) {
       SPDLOG_ERROR(
@@ -156,9 +247,11 @@ class Flusher {
 
   void addDirtyItem(BlockBufferHandle item, uint32_t itemIndex) {
     dirtyIndexMap[itemIndex].emplace(item);
-    tenantInfoMap[item.get_tag()].numDirty++;
+    auto &ti = tenantInfoMap[item.get_tag().get_main()];
+    ti.numDirty++;
+    ti.dirtyBlocks.emplace(std::make_pair(itemIndex, item.get_key()), item);
     SPDLOG_DEBUG("addDirtyItem item:{}, idx={}, curr={}", item.get_key(),
-                 itemIndex, tenantInfoMap[item.get_tag()].numDirty);
+                 itemIndex, tenantInfoMap[item.get_tag().get_main()].numDirty);
   }
 
   void removeDirtyItem(BlockBufferHandle item) {
@@ -167,9 +260,11 @@ class Flusher {
     // this should be 1; removing a non-existing index does not make sense
     assert(num_removed == 1);
     if (dirtyIndexMap[itemIndex].empty()) dirtyIndexMap.erase(itemIndex);
-    tenantInfoMap[item.get_tag()].numDirty -= num_removed;
+    auto &ti = tenantInfoMap[item.get_tag().get_main()];
+    ti.numDirty -= num_removed;
+    ti.dirtyBlocks.erase(std::make_pair(itemIndex, item.get_key()));
     SPDLOG_DEBUG("removeDirtyItem item:{}, idx={}, curr={}", item.get_key(),
-                 itemIndex, tenantInfoMap[item.get_tag()].numDirty);
+                 itemIndex, tenantInfoMap[item.get_tag().get_main()].numDirty);
   }
 
   int removeDirtyItemByIndex(uint32_t itemIndex) {
@@ -177,11 +272,13 @@ class Flusher {
     if (it == dirtyIndexMap.end()) return 0;
     int num = it->second.size();
     assert(num > 0);  // should not be empty, otherwise, why it is in the map?
-    sched::Tag t = it->second.begin()->get_tag();
-    tenantInfoMap[t].numDirty -= num;
+    for (auto item : it->second) {
+      auto &ti = tenantInfoMap[item.get_tag().get_main()];
+      ti.numDirty--;
+      ti.dirtyBlocks.erase(std::make_pair(itemIndex, item.get_key()));
+    }
     dirtyIndexMap.erase(itemIndex);
-    SPDLOG_DEBUG("removeDirtyItemByIndex itemIndex:{}, curr={}", itemIndex,
-                 tenantInfoMap[t].numDirty);
+    SPDLOG_DEBUG("removeDirtyItemByIndex itemIndex:{}, num={}", itemIndex, num);
     return num;
   }
 
@@ -214,6 +311,10 @@ class Flusher {
 
   // By default, we only allow 10 inflight fore-ground syncing
   constexpr static int kNumFgFlushLimit = 10;
+  // a tenant's write-back brings its dirty ratio down to this fraction of the
+  // threshold
+  constexpr static double kWriteBackLowWaterRatio = 0.75;
+  constexpr static size_t kMaxWriteBackBatchSize = 256;
 
  private:
   // map tenant tag to its' info. If !DO_SCHED, all info is under key
@@ -248,6 +349,9 @@ class Flusher {
   std::unordered_map<uint32_t, std::unordered_set<BlockBufferHandle>>
       dirtyIndexMap;
 
+  // index -> number of in-flight tenant write-backs that cover it
+  std::unordered_map<uint32_t, int> writeBackIndexMap;
+
   friend std::ostream &operator<<(std::ostream &os, const Flusher &f) {
     os << "Flusher: dirtyRatio:" << f.dirtyRatioThreshold
        << " maxSubmitNum:" << f.dirtyFlushOneTimeSubmitNum
@@ -0,0 +1,71 @@
+#ifndef CFS_FS_HUGEPAGE_H
+#define CFS_FS_HUGEPAGE_H
+
+#include <cstddef>
+#include <string>
+
+// Huge pages for the large buffers outside of SPDK (whose DMA memory is
+// already on hugepages): the BlockBuffer slabs and the journal memory of
+// BlkDevPosix/BlkDevSim, and the shared memory of FsLibMemMng. A cache hit
+// touches a random 4 KB block of a multi-GB buffer, so with 4 KB pages almost
+// every hit is a TLB miss.
+//
+// The hugetlb pages (MAP_HUGETLB, or a file of a hugetlbfs mount for the
+// shared memory, if one is given) are tried first; they must be reserved by
+// the admin (vm.nr_hugepages). Then, anonymous memory falls back to
+// transparent huge pages (madvise), and shared memory to shm_open, with THP if
+// the kernel has shmem_enabled=advise.
+//
+// Used by both FSP and FsLib, so it only prints to stderr.
+namespace fs_hugepage {
+
+enum class Backend {
+  kNone,     // regular pages
+  kThp,      // transparent huge pages (best effort)
+  kHugetlb,  // reserved huge pages
+};
+
+const char *backendName(Backend backend);
+
+struct Config {
+  // size of the hugetlb pages; 0 to only use THP
+  size_t hugetlbPageSize = 2UL << 20;
+  bool thp = true;
+  // hugetlbfs mount of the shared memory; empty to use shm_open. Its page
+  // size is the one of the mount (pagesize= option), not hugetlbPageSize
+  std::string hugetlbfsDir;
+};
+
+// Initialized from the env: CFS_HUGEPAGE is "off", "thp", "2m" (default) or
+// "1g", CFS_HUGETLBFS_DIR the hugetlbfs mount (unset by default, so the shared
+// memory is on hugetlbfs only if asked for). FSP and the apps must agree on
+// the mount. Changes only affect the later mappings.
+Config &config();
+
+// Anonymous zeroed memory on huge pages. The pages are faulted in on first
+// touch, so the range can still be bound to a NUMA node.
+// @return nullptr if the huge pages are off or size is below 2 MB (the caller
+//   then uses its regular allocator)
+void *mapAnon(size_t size, Backend *backend = nullptr);
+
+// Shared memory `name` on the hugetlbfs mount. The file only lives until the
+// peer attaches, or until the creator unmaps it if the peer never does, so
+// that its huge pages are not left reserved after both sides exit.
+// @param create: create it (replacing a stale one) if true, else attach to
+//   the one the peer created
+// @return nullptr if not available: no mount given, not enough free huge
+//   pages, or the peer fell back to shm_open. When create fails, no file
+//   `name` is left on the mount, so the peer does not attach to a stale one.
+void *mapShm(const std::string &name, size_t size, bool create);
+
+// Ask for THP on a shm_open mapping; a no-op if THP is off.
+void adviseThp(void *addr, size_t size);
+
+// Unmap memory of mapAnon() or mapShm(); a mapShm() file that the peer has
+// not attached to yet is removed.
+// @return false if addr was not mapped here
+bool unmap(void *addr);
+
+}  // namespace fs_hugepage
+
+#endif
@@ -79,10 +79,17 @@ struct FileHandle {
   tbb::reader_writer_lock lock_;
 };
 
+// env to disable the per-thread request rings (see fs_init_thread_local_mem)
+#define CFS_LIB_THREAD_RING_ENV "CFS_LIB_THREAD_RING"
+
 class FsService {
  public:
   FsService();
   FsService(int wid, key_t key);
+  // Service backed by a request ring owned by one app thread, which is created
+  // here and needs to be registered to the worker (CFS_OP_THREAD_RING) via
+  // the shared service of the same key.
+  FsService(int wid, key_t key, int threadRingId);
   ~FsService();
   void initService();
   int allocRingSlot();
@@ -94,6 +101,8 @@ class FsService {
   int submitReq(int slotId);
 
   key_t GetShmkey() { return shmKey; }
+  // 0 for the shared ring of the app
+  int GetThreadRingId() { return threadRingId; }
 
   struct shmipc_mgr *shmipc_mgr = NULL;
   bool inUse = false;
@@ -103,6 +112,7 @@ class FsService {
   std::atomic_flag unusedSlotsLock;
   key_t shmKey;
   int wid;
+  int threadRingId;
   CommuChannelAppSide *channelPtr;
 };
 
@@ -167,6 +167,8 @@ class SingleSizeMemBlockArr {
   fslib_malloc_block_sz_t getBlockSize() { return blockSize; }
   fslib_malloc_block_cnt_t getBlockCount() { return numBlocks; }
   fslib_malloc_block_cnt_t getTotalDataBytes() { return blockSize * numBlocks; }
+  // start of the whole array (header included), i.e., the address it is mapped
+  void *getMemAddr() { return firstBlockMetaPtr; }
   fslib_malloc_mem_sz_t getTotalBytes() { return totalMemBytes; }
   void getMemArrName(char *dst, size_t len) {
     strncpy(dst, memArrName.c_str(),
@@ -11,15 +11,26 @@ typedef cfs_ino_t file_handle_idx_t;
 
 // This is not thread-safe
 // Supposed to be guarded by fileHandle's read-write lock
+// A cached page is only used if its version in the shared PageDescriptor is
+// still the one FSP handed out, so pages invalidated by FSP (e.g., on write)
+// are never served.
 class FileHandleCacheReader {
  public:
   FileHandleCacheReader() {}
+  // @return false if any page of the range is not cached or no longer valid
   bool lookupRange(off_t alignedOff, size_t sizeByte, void *buf);
   void installCachePage(off_t off,
-                        std::pair<PageDescriptor *, void *> &pdAddrPair);
+                        std::pair<PageDescriptor *, void *> &pdAddrPair,
+                        uint32_t version);
+  void clear() { pageMap.clear(); }
 
  private:
-  std::unordered_map<off_t, std::pair<PageDescriptor *, void *>> pageMap;
+  struct CachedPage {
+    PageDescriptor *pd;
+    void *addr;
+    uint32_t version;
+  };
+  std::unordered_map<off_t, CachedPage> pageMap;
 };
 
 class PageCacheHelper {
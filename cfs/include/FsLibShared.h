@@ -82,6 +82,7 @@ enum CfsOpCode {
   CFS_OP_RENAME = 22,
   CFS_OP_OPENDIR = 23,
   CFS_OP_RMDIR = 24,
+  CFS_OP_READDIR = 25,
   // NOTE: both fsync and fdatasync will use this op code.
   CFS_OP_FSYNC = 31,
   CFS_OP_SYNCALL = 33,  // we reserve one for fsync
@@ -108,6 +109,8 @@ enum CfsOpCode {
   // remove it once this is stable.
   CFS_OP_INODE_REASSIGNMENT = 123,
   CFS_OP_THREAD_REASSIGNMENT = 124,
+  // NOTE: register/unregister an app thread's own request ring with a worker
+  CFS_OP_THREAD_RING = 125,
 };
 
 // if set, FSP is going to use the R/W the data in client's memory
@@ -350,6 +353,41 @@ struct rmdirOp {
   char pathname[MULTI_DIRSIZE];
 };
 
+// One entry of a readdir chunk, written by FSP into the data buffer.
+struct readdirEnt {
+  uint32_t ino;
+  // DT_DIR or DT_REG with readdirplus, DT_UNKNOWN otherwise (the dentry does
+  // not record the type)
+  uint8_t type;
+  char name[DIRSIZE];
+};
+
+// With readdirplus, the attributes follow each entry (what stat() returns).
+// FSP only fills them for the inodes the primary owns; the client stats the
+// others, which their owners answer.
+struct readdirPlusEnt {
+  struct readdirEnt ent;
+  int hasAttrs;
+  struct stat statbuf;
+};
+static_assert(FS_READDIR_CHUNK * sizeof(struct readdirPlusEnt) <= 48 * 1024,
+              "a readdirplus chunk does not fit in a 48K shm block");
+
+// Read the next chunk of a directory, at most maxEntries (capped to
+// FS_READDIR_CHUNK) entries into the data buffer.
+// @ret: the number of entries; fewer than maxEntries at the end of the dir
+struct readdirOp {
+  int ret;
+  int tid;
+  int plus;
+  // dentry slot of the dir to start from (0 for the first chunk); FSP sets it
+  // to the slot after the last entry returned
+  uint64_t cursor;
+  uint32_t maxEntries;
+  char name[MULTI_DIRSIZE];
+  struct allocatedOpCommon alOp;
+};
+
 struct syncallOp {
   int ret;
 };
@@ -400,6 +438,16 @@ struct pingOp {
   int ret;
 };
 
+// Sent on the shared ring of a worker; the thread ring to (un)register is
+// created by the client and named by THREAD_RING_SHM_NAME_FMT with the shmKey
+// of the shared ring and ringId (unique within the app).
+#define THREAD_RING_SHM_NAME_FMT "/shmipc_mgr_%08d_t%d"
+struct threadRingOp {
+  int ret;
+  int ringId;
+  int8_t isRegister;
+};
+
 struct startDumpLoadOp {
   int ret;
 };
@@ -439,6 +487,7 @@ union CfsOp {
   struct renameOp rename;
   struct opendirOp opendir;
   struct rmdirOp rmdir;
+  struct readdirOp readdir;
   struct syncallOp syncall;
   struct syncunlinkedOp syncunlinked;
   struct newShmAllocatedOp newshmop;
@@ -451,6 +500,7 @@ union CfsOp {
   struct dumpinodesOp dumpinodes;
   struct inodeReassignmentOp inodeReassignment;
   struct threadReassignOp threadReassign;
+  struct threadRingOp threadRing;
 #ifdef _CFS_TEST_
   struct testOp test;
 #endif
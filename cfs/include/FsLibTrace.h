@@ -0,0 +1,176 @@
+#ifndef CFS_FSLIBTRACE_H
+#define CFS_FSLIBTRACE_H
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+//
+// Per-thread op trace captured at the FsLib layer; the format is shared by the
+// capturer (FsLib) and the replayer (bench).
+//
+// Capture is enabled at runtime by setting CFS_LIB_TRACE_DIR to a directory;
+// each app thread then writes "<dir>/fslib-trace-<pid>-<fsTid>.bin" when it
+// exits (or on fs_exit). If the env var is not set, each traced api only pays
+// a check of a thread_local pointer.
+//
+// File layout: FsTraceFileHeader, then a sequence of FsTraceRecord, each
+// immediately followed by `pathLen` bytes of path (not NUL-terminated).
+//
+
+#define CFS_LIB_TRACE_DIR_ENV "CFS_LIB_TRACE_DIR"
+
+enum class FsTraceOp : uint16_t {
+  OPEN,  // fd: returned fd; size: flags
+  CLOSE,
+  READ,  // offset: -1 (use the file offset)
+  PREAD,
+  WRITE,  // offset: -1 (use the file offset)
+  PWRITE,
+  FSYNC,
+  FDATASYNC,
+  STAT,
+  UNLINK,
+  MKDIR,
+  _DUMMY_LAST,
+};
+
+constexpr static uint64_t kFsTraceMagic = 0x4543'4152'5453'4655UL;  // UFSTRACE
+constexpr static uint32_t kFsTraceVersion = 1;
+
+struct FsTraceFileHeader {
+  uint64_t magic;
+  uint32_t version;
+  int32_t fsTid;
+  int32_t pid;
+  int32_t pad;
+  // all threads of a process share the same base, so the relative time between
+  // records of different threads is preserved
+  uint64_t baseTsNs;
+};
+
+struct __attribute__((packed)) FsTraceRecord {
+  uint64_t tsNs;  // when the api is called; relative to baseTsNs
+  int64_t offset;
+  uint64_t size;
+  int32_t fd;
+  FsTraceOp op;
+  uint16_t pathLen;
+};
+static_assert(sizeof(FsTraceRecord) == 32, "FsTraceRecord must be compact");
+
+static inline uint64_t fsTraceClockNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000UL + ts.tv_nsec;
+}
+
+// Buffered writer owned by one app thread; no lock is required
+class FsTraceWriter {
+ public:
+  FsTraceWriter(const std::string &dir, int fsTid, uint64_t baseTsNs)
+      : baseTsNs_(baseTsNs) {
+    path_ = dir + "/fslib-trace-" + std::to_string(getpid()) + "-" +
+            std::to_string(fsTid) + ".bin";
+    file_ = fopen(path_.c_str(), "wb");
+    if (file_ == nullptr) {
+      fprintf(stderr, "FsTraceWriter: cannot open %s: %s\n", path_.c_str(),
+              strerror(errno));
+      return;
+    }
+    buf_.reserve(kFsTraceBufSize);
+    FsTraceFileHeader header{};
+    header.magic = kFsTraceMagic;
+    header.version = kFsTraceVersion;
+    header.fsTid = fsTid;
+    header.pid = getpid();
+    header.baseTsNs = baseTsNs;
+    append(&header, sizeof(header));
+  }
+  FsTraceWriter(const FsTraceWriter &) = delete;
+  FsTraceWriter &operator=(const FsTraceWriter &) = delete;
+  ~FsTraceWriter() {
+    flush();
+    if (file_ != nullptr) fclose(file_);
+  }
+
+  bool isOk() const { return file_ != nullptr; }
+  const std::string &getPath() const { return path_; }
+
+  // timestamp to pass into add(); relative to the process-wide base
+  uint64_t now() const { return fsTraceClockNs() - baseTsNs_; }
+
+  void add(FsTraceOp op, uint64_t tsNs, int fd, int64_t offset, uint64_t size,
+           const char *path = nullptr) {
+    FsTraceRecord rcd;
+    rcd.tsNs = tsNs;
+    rcd.offset = offset;
+    rcd.size = size;
+    rcd.fd = fd;
+    rcd.op = op;
+    rcd.pathLen = path == nullptr ? 0 : strnlen(path, UINT16_MAX);
+    append(&rcd, sizeof(rcd));
+    if (rcd.pathLen > 0) append(path, rcd.pathLen);
+  }
+
+  void flush() {
+    if (file_ == nullptr || buf_.empty()) return;
+    fwrite(buf_.data(), 1, buf_.size(), file_);
+    fflush(file_);
+    buf_.clear();
+  }
+
+ private:
+  constexpr static size_t kFsTraceBufSize = 1024 * 1024;
+
+  void append(const void *data, size_t len) {
+    if (buf_.size() + len > kFsTraceBufSize) flush();
+    auto p = static_cast<const char *>(data);
+    buf_.insert(buf_.end(), p, p + len);
+  }
+
+  std::string path_;
+  FILE *file_{nullptr};
+  uint64_t baseTsNs_;
+  std::vector<char> buf_;
+};
+
+// one decoded record, with the path (if any) attached
+struct FsTraceEntry {
+  FsTraceRecord rcd;
+  std::string path;
+};
+
+// Load a whole per-thread trace file into memory
+// @return false if the file cannot be read or is not a valid trace
+static inline bool fsTraceLoad(const std::string &path,
+                               FsTraceFileHeader &header,
+                               std::vector<FsTraceEntry> &entries) {
+  std::unique_ptr<FILE, decltype(&fclose)> file(fopen(path.c_str(), "rb"),
+                                                &fclose);
+  if (file == nullptr) return false;
+  if (fread(&header, sizeof(header), 1, file.get()) != 1) return false;
+  if (header.magic != kFsTraceMagic || header.version != kFsTraceVersion)
+    return false;
+  entries.clear();
+  FsTraceEntry entry;
+  while (fread(&entry.rcd, sizeof(entry.rcd), 1, file.get()) == 1) {
+    if (entry.rcd.op >= FsTraceOp::_DUMMY_LAST) return false;
+    entry.path.resize(entry.rcd.pathLen);
+    if (entry.rcd.pathLen > 0 &&
+        fread(entry.path.data(), entry.rcd.pathLen, 1, file.get()) != 1)
+      return false;  // truncated
+    entries.push_back(entry);
+  }
+  return true;
+}
+
+#endif  // CFS_FSLIBTRACE_H
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <stdint.h>
 #include <array>
+#include <atomic>
 #include <cstdio>
 #include "param.h"
 #include "typedefs.h"
@@ -11,7 +12,15 @@
 typedef uint32_t page_idx_t;
 
 #define PAGE_CACHE_PAGE_SIZE (4096)
+// size of the shared read cache (fs_uc_pread); can be overridden at build time
+// and must be the same for FSP and FsLib
+#ifndef N_PAGE_CACHE_BYTE
+#ifdef USE_UC_PAGE_CACHE
+#define N_PAGE_CACHE_BYTE (((uint64_t)64) * 1024 * 1024)
+#else
 #define N_PAGE_CACHE_BYTE (((uint64_t)8) * 1024)
+#endif
+#endif
 #define N_PAGE_CACHE_PAGE ((N_PAGE_CACHE_BYTE) / PAGE_CACHE_PAGE_SIZE)
 
 #define PAGE_CACHE_PAGE_STATUS_IDLE 0
@@ -23,7 +32,8 @@ typedef uint32_t page_idx_t;
 struct PageDescriptorMsg {
   page_idx_t gPageIdx;
   page_idx_t pageIdxWithinIno;
-  int validSize;
+  // PageDescriptor::version when the server handed out this page
+  uint32_t version;
   uint32_t MAGIC;
 };
 
@@ -41,9 +51,22 @@ struct PageDescriptor {
   page_idx_t pageIdxWithinIno;
   int validSize;  // number of bytes that contains valid data
   int pageStatus;
-  char __padding[44];
+  // Bumped by the server whenever the page is (re)assigned or freed, e.g. when
+  // a write invalidates the inode's cached pages. A client only trusts its
+  // copy of a page if the version still matches the one it was handed, checked
+  // both before and after copying the data out.
+  std::atomic<uint32_t> version;
+  char __padding[40];
 };
 
+inline uint32_t readPdVersion(const PageDescriptor *pd) {
+  return pd->version.load(std::memory_order_acquire);
+}
+
+inline void bumpPdVersion(PageDescriptor *pd) {
+  pd->version.fetch_add(1, std::memory_order_release);
+}
+
 static_assert(sizeof(struct PageDescriptor) == CACHE_LINE_BYTE,
               "PageDescriptor not cache aligned");
 
@@ -9,6 +9,7 @@
 #include <set>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "FsLibMalloc.h"
 #include "FsLibProc.h"
@@ -187,6 +188,10 @@ class AppProc {
       std::string &shmName, fslib_malloc_block_sz_t shmBlockSize,
       fslib_malloc_block_cnt_t shmNumBlocks);
 
+  // whether the device can read into [addr, addr + len) of the shm directly;
+  // the shm is registered to the device at the first query
+  bool isShmDmaCapable(uint8_t shmId, char *addr, size_t len);
+
   // Invalidate the <shmName, shmPtr> once the application exits
   // TODO (jingliu) :clean all the client related context once a client exits
   int invalidateAppShm();
@@ -263,6 +268,32 @@ class AppProc {
     cred = new_cred;
   }
 
+  //
+  // request rings
+  //
+  // Besides the shared ring (ring 0, shmipc_mgr), each app thread may register
+  // its own single-producer ring (CFS_OP_THREAD_RING), so that one slow slot
+  // does not block the other threads of the app in shmipc_mgr_alloc_slot().
+  // The slot id given to FsReq encodes <ring, idx within the ring>.
+  // @return ring number (> 0) or -1 if the ring cannot be attached
+  int addThreadRing(int clientRingId);
+  // REQUIRED: the client thread has no in-flight request on this ring
+  // @return 0 on success, -1 if not found
+  int removeThreadRing(int clientRingId);
+  // Get the next request ready for server from all the rings, round-robin
+  // @return nullptr if none of the rings has a request
+  struct shmipc_msg *pollMsg(off_t &slotId);
+  struct shmipc_msg *slotToMsg(off_t slotId) {
+    return IDX_TO_MSG(slotToRing(slotId), slotId & kSlotIdxMask);
+  }
+  char *slotToXreq(off_t slotId) {
+    return IDX_TO_XREQ(slotToRing(slotId), slotId & kSlotIdxMask);
+  }
+  char *slotToData(off_t slotId) {
+    return IDX_TO_DATA(slotToRing(slotId), slotId & kSlotIdxMask);
+  }
+  size_t getNumThreadRings() const { return numThreadRings; }
+
   struct shmipc_mgr *shmipc_mgr = NULL;
   static constexpr int kFdBase = 100000;
 
@@ -284,9 +315,32 @@ class AppProc {
   std::unordered_map<uint32_t, std::unordered_map<off_t, InAppCachedBlock *>>
       pendingInAppBlocks;
 
+  static constexpr int kSlotRingShift = 16;
+  static constexpr off_t kSlotIdxMask = (1 << kSlotRingShift) - 1;
+  static_assert(RING_SIZE <= (1 << kSlotRingShift) &&
+                THREAD_RING_SIZE <= (1 << kSlotRingShift));
+  struct shmipc_mgr *slotToRing(off_t slotId) {
+    int ringNo = slotId >> kSlotRingShift;
+    if (ringNo == 0) return shmipc_mgr;
+    assert(threadRings[ringNo - 1].second != nullptr);
+    return threadRings[ringNo - 1].second;
+  }
+  void clearThreadRings();
+
+  int shmKey = 0;
+  // <clientRingId, ring>; ring number is index + 1, entries of removed rings
+  // are left as <-1, nullptr> to keep the numbers of the others stable
+  std::vector<std::pair<int, struct shmipc_mgr *>> threadRings;
+  size_t numThreadRings = 0;
+  // ring number to poll first in the next pollMsg()
+  size_t pollCursor = 0;
+
   int shmFd = -1;
   std::unordered_map<std::string, SingleSizeMemBlockArr *> shmNameMemArrMap;
   std::unordered_map<uint8_t, SingleSizeMemBlockArr *> shmIdArrMap;
+  // <shmId, [start, end) registered to the device>; {nullptr, nullptr} if the
+  // device cannot use any of it
+  std::unordered_map<uint8_t, std::pair<char *, char *>> shmDmaRangeMap;
 
   struct InoWithTid {
     int tid;
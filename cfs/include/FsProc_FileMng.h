@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "FsProc_FsImpl.h"
 #include "FsProc_FsInternal.h"
@@ -134,6 +135,13 @@ class FileMng {
   void ProcessSyncUnlinkedBeforeSyncall(FsReq *req);
 
   int _renewLeaseForRead(FsReq *req);
+  void invalidateClientCache(InMemInode *inode);
+#ifdef DO_SCHED
+  // After the tenant's cache share shrinks, drop (and revoke the leases of)
+  // the client cache of its inodes until its pages fit in the share again,
+  // like adjustCacheSize() evicts the server buffer
+  void reclaimClientCache(sched::Tenant &tenant);
+#endif
 
   /* No longer use pending map; submit to blk_queue/device directly */
   /*****************************************************************************
@@ -285,6 +293,13 @@ class FileMng {
     // Owner deallocates all inode resources once fd's closed
     static void OwnerDeallocResources(FileMng *mng, cfs_ino_t ino,
                                       InMemInode *inode);
+    // Collect the extents and the index node blocks of the inode. If index
+    // nodes need to be read, OwnerDeallocResources is called again once they
+    // are in memory.
+    // @return false if it needs to wait for the reads
+    static bool OwnerCollectExtents(FileMng *mng, InMemInode *inode,
+                                    std::vector<cfs_extent> &extents,
+                                    std::vector<uint64_t> &nodeBlocks);
 #if CFS_JOURNAL(ON)
     // NOTE: we do not require these two functions in the no-journal case as
     // fsync is not required for the unlink and we deallocate bitmaps using the
@@ -296,8 +311,10 @@ class FileMng {
     // OwnerDeallocResources can only start deallocating blocks once the bitmap
     // is loaded into memory. It ensures this condition by calling
     // OwnerEnsureLocalBitmapsInMem.
-    static bool OwnerEnsureLocalBitmapsInMem(FileMng *mng, cfs_ino_t ino,
-                                             InMemInode *inode);
+    static bool OwnerEnsureLocalBitmapsInMem(
+        FileMng *mng, cfs_ino_t ino, InMemInode *inode,
+        const std::vector<cfs_extent> &extents,
+        const std::vector<uint64_t> &nodeBlocks);
 #endif
   };
 
@@ -0,0 +1,118 @@
+#ifndef CFS_FSPROC_FREEEXTENTINDEX_H
+#define CFS_FSPROC_FREEEXTENTINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+//
+// In-memory index of the free allocation units of one extent size class (i.e.,
+// one slot of ext_array) within one worker's data bitmap region. Each worker
+// (FsImpl) owns the indexes of its own region, so no locking is needed.
+//
+// Free units are kept as runs of consecutive units in two red-black trees: one
+// keyed by the start unit (to coalesce on free), the other by (length, start)
+// so that an allocation takes the smallest run that fits (best fit), which
+// leaves long runs intact for contiguous placement.
+//
+// Bitmap blocks that must not be modified for now (e.g., freed into by another
+// worker until the checkpoint, see FsImpl::immutableBlockBitmaps_) are frozen:
+// their free units are split into runs of their own that stay out of the size
+// tree, so an allocation is still the first run of the tree. Freezing and
+// thawing only touch the runs of that bitmap block.
+//
+// The index is built incrementally from the in-memory bitmap blocks: a bitmap
+// block is added by indexNextBmapBlock() once it is loaded, after which every
+// allocation in it is O(log n) instead of a scan of the bitmap.
+//
+// Unit layout (same as the bitmap allocation in FsImpl::allocateDataBlocks):
+//   - allocUnit < BPB: one bitmap block holds BPB/allocUnit units; unit `u` is
+//     represented by the first bit of its range in the block
+//   - allocUnit >= BPB: one unit spans allocUnit/BPB bitmap blocks and is
+//     represented by the first int of its first bitmap block
+//
+class FreeExtentIndex {
+ public:
+  // @param numBmapBlocks: number of bitmap blocks of this size class's region
+  // @param allocUnit: number of data blocks per allocation
+  FreeExtentIndex(uint32_t numBmapBlocks, uint32_t allocUnit);
+  FreeExtentIndex(const FreeExtentIndex &) = delete;
+  FreeExtentIndex &operator=(const FreeExtentIndex &) = delete;
+
+  // mapping between units and (bitmap block, bit); block index is relative to
+  // the start of the region
+  uint32_t unitToBmapBlock(uint64_t unit) const;
+  uint32_t unitToBitNo(uint64_t unit) const;
+  // @return false if the bit does not represent a unit
+  bool bmapBitToUnit(uint32_t bmapBlockIdx, uint32_t bitNo,
+                     uint64_t &unit) const;
+  bool isUnitFree(const char *bmap, uint64_t unit) const;
+
+  // The next bitmap block to index, in the order of the region; every index
+  // step advances it by getBmapBlockStride().
+  uint32_t getNextBmapBlockToIndex() const { return nextToIndex_; }
+  uint32_t getBmapBlockStride() const { return bmapBlocksPerUnit_; }
+  bool isFullyIndexed() const { return nextToIndex_ >= numBmapBlocks_; }
+  bool isBmapBlockIndexed(uint32_t bmapBlockIdx) const;
+  // Add all the free units of the next bitmap block to the index.
+  // @param bmap: content of the bitmap block (must be in memory)
+  void indexNextBmapBlock(const char *bmap);
+
+  // Take one free unit out of the bitmap blocks not frozen, best fit.
+  // @return false if no usable free unit is indexed
+  bool allocUnit(uint64_t &unit);
+  // Take a specific unit, e.g., the one right after a file's last unit so that
+  // the file stays contiguous.
+  // @return false if it is not free in the index (or not indexed yet)
+  bool takeUnit(uint64_t unit);
+  // Return a unit to the index; no-op if its bitmap block is not indexed yet
+  // (it will be picked up when indexed) or it is already free in the index.
+  void freeUnit(uint64_t unit);
+
+  // Exclude (or include again) the units of a bitmap block from allocUnit().
+  // Calls nest: a block frozen twice is usable after it is thawed twice. Works
+  // on blocks not indexed yet as well.
+  void freezeBmapBlock(uint32_t bmapBlockIdx);
+  void thawBmapBlock(uint32_t bmapBlockIdx);
+  bool isBmapBlockFrozen(uint32_t bmapBlockIdx) const;
+
+  uint64_t getNumFreeUnits() const { return numFreeUnits_; }
+  uint64_t getNumUnits() const { return numUnits_; }
+  size_t getNumRuns() const { return runs_.size(); }
+  // runs allocUnit() picks from, i.e., not frozen
+  size_t getNumUsableRuns() const { return runsBySize_.size(); }
+
+ private:
+  // add free units [start, start + len) that are not in the index yet
+  void addFreeRun(uint64_t start, uint64_t len);
+  void insertRun(uint64_t start, uint64_t len);
+  void eraseRun(std::map<uint64_t, uint64_t>::iterator it);
+  // the first bitmap block of the unit; the key of frozen_
+  uint32_t groupOf(uint64_t unit) const { return unitToBmapBlock(unit); }
+  bool isUnitFrozen(uint64_t unit) const;
+  // units [first, last) of the bitmap block
+  void groupUnits(uint32_t bmapBlockIdx, uint64_t &first,
+                  uint64_t &last) const;
+  // whether two adjacent runs may be one: a frozen run never leaves its block
+  bool canMerge(uint64_t leftStart, uint64_t rightStart) const;
+
+  const uint32_t numBmapBlocks_;
+  const uint32_t allocUnit_;
+  uint32_t unitsPerBmapBlock_;  // 1 if allocUnit_ >= BPB
+  uint32_t bmapBlocksPerUnit_;  // 1 if allocUnit_ < BPB
+  uint64_t numUnits_;
+
+  uint32_t nextToIndex_{0};
+  uint64_t numFreeUnits_{0};
+  // <start unit, length>
+  std::map<uint64_t, uint64_t> runs_;
+  // <length, start unit> of the runs out of the frozen blocks
+  std::set<std::pair<uint64_t, uint64_t>> runsBySize_;
+  // first bitmap block of the unit -> times frozen
+  std::unordered_map<uint32_t, uint32_t> frozen_;
+};
+
+#endif  // CFS_FSPROC_FREEEXTENTINDEX_H
@@ -4,7 +4,10 @@
 #include <folly/concurrency/ConcurrentHashMap.h>
 
 #include <array>
+#include <chrono>
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <set>
 #include <tuple>
 #include <unordered_map>
@@ -19,14 +22,17 @@
 #include "FsProc_FileMng.h"
 #include "FsProc_FsInternal.h"
 #include "FsProc_FsReq.h"
+#include "FsProc_InodeQuiescer.h"
 #include "FsProc_Journal.h"
 #include "FsProc_KnowParaLoadMng.h"
 #include "FsProc_LoadMng.h"
 #include "FsProc_Messenger.h"
+#include "FsProc_Numa.h"
 #include "FsProc_SplitPolicy.h"
 #include "FsProc_UnixSock.h"
 #include "FsProc_WorkerComm.h"
 #include "FsProc_WorkerStats.h"
+#include "Snapshot.h"
 #include "Tenant.h"
 #include "concurrentqueue.h"
 #include "config4cpp/Configuration.h"
@@ -206,6 +212,21 @@ class FsProc {
 
   int getNumApps() { return numAppProc; }
 
+  // devices the data is striped over (see BlkDevStripe)
+  int getNumDevs();
+  // throughput of device `dev` measured by the workers in #blocks/second; 0 if
+  // it has not been saturated yet
+  int64_t getDevCapacityEstimate(int dev);
+
+  // NUMA nodes of the workers' cores and of the apps' memory, so that the
+  // allocator keeps an app's tenants near it (policy::numa_affinity); -1 if
+  // unknown (see FsProc_Numa.h)
+  int getWorkerNumaNode(int wid) { return workerNumaNodes[wid]; }
+  int getAppNumaNode(int aid) { return appNumaNodes[aid]; }
+  // called by a worker that finds where an app's memory is; the first one
+  // found is kept
+  void noteAppNumaNode(int aid, int node);
+
   // wrap the generation of log's names
   // @param ssLogger : store the name of logger object
   // @param ssFile : store the name of log's file
@@ -253,8 +274,23 @@ class FsProc {
     assert(wid < numThreads);
     assert(state != workerActive[wid]);
     workerActive[wid] = state;
+    if (state) notifyWorkerActive();
   }
 
+  // block the calling worker until `wid` is activated, FsProc stops, a message
+  // is sent to it or `timeout` passes; unlike polling checkWorkerActive(), it
+  // gives the core away
+  // @return whether the worker is active
+  bool waitWorkerActive(int wid, std::chrono::microseconds timeout);
+
+  // elastic workers (policy::elastic_workers): a worker asked to park
+  // deactivates itself by parkWorker() once it is drained; withdrawing the
+  // request activates it again if it has parked
+  void requestWorkerPark(int wid, bool park);
+  bool checkWorkerParkRequested(int wid) { return workerParkRequested[wid]; }
+  // @return whether the worker is parked; false if the request is withdrawn
+  bool parkWorker(int wid);
+
   uint64_t QueryWorkerJournalMngNumWrite(int wid, bool do_reset);
 
   void redirectZombieAppReqs(int wid);
@@ -354,6 +390,15 @@ class FsProc {
 
   // state of a worker whether it is asleep or not
   std::atomic_bool *workerActive;
+  // whether the allocator asks each worker to park
+  std::atomic_bool *workerParkRequested;
+  // fixed once the workers start
+  std::vector<int> workerNumaNodes;
+  std::atomic_int *appNumaNodes;
+  // wake up the workers in waitWorkerActive(); also the messenger's wakeup
+  void notifyWorkerActive();
+  std::mutex workerActiveMtx;
+  std::condition_variable workerActiveCv;
 
 #ifdef UFS_SOCK_LISTEN
   // a thread that listens UNIX domain socket to establish
@@ -382,11 +427,38 @@ class FsProc {
   sched::Allocator *allocator;
   std::thread *allocator_thread;
 
+  // warm restart (see Snapshot.h): the snapshot restored at start (nullptr if
+  // none or it does not match the cmdline or the journals), and the one
+  // filled by the workers on exit (nullptr if no snapshot file is given)
+  std::string snapshotFname;
+  std::unique_ptr<sched::snapshot::Snapshot> warmSnapshot;
+  std::unique_ptr<sched::snapshot::Snapshot> exitSnapshot;
+
   // this function should only be called after all workers have initialized
   // their tenants
  public:
   void startAllocator();
   // for now we don't stop allocator but just directly exit the process
+
+  // load the snapshot to restore from `fname` (if it exists) and save one to
+  // it on exit; must be called before starting the workers
+  void initSnapshot(
+      const char *fname,
+      const std::vector<std::vector<std::tuple<int, int, double, double>>>
+          &workerAppConfigs);
+  const sched::snapshot::Snapshot *getWarmSnapshot() const {
+    return warmSnapshot.get();
+  }
+  sched::snapshot::Snapshot *getExitSnapshot() { return exitSnapshot.get(); }
+  // drop the warm snapshot if a journal was checkpointed since it was saved;
+  // called by the master once the device is ready, before it restores any
+  // allocation or block of the snapshot
+  void checkWarmSnapshotJournals(CurBlkDev *dev);
+
+ private:
+  // the journals whose last checkpoints a snapshot records, indexed as their
+  // jsuper blocks (get_worker_journal_sb)
+  int numJournals() const;
 #endif
 };
 
@@ -506,6 +578,17 @@ class FsProcWorker {
   // Pinning cores
   int getPinnedCPUCore() { return pinnedCPUCore; }
   void setPinnedCPUCore(int x) { pinnedCPUCore = x; }
+  // -1 if unknown or the machine has a single node
+  int getNumaNode() { return fsp_numa::nodeOfCpu(pinnedCPUCore); }
+
+  // Allocate the data block partition of this worker on its own node instead
+  // of using its slice of the master's buffer; called by the master before
+  // this worker's FileMng is created.
+  void allocLocalDataBlockMem(uint64_t sizeBytes);
+  // nullptr if the partition is in the master's buffer
+  char *getLocalDataBlockMem() { return localDataBlockMemPtr; }
+
+  CurBlkDev *getDev() { return dev; }
 
   AppProc *GetApp(pid_t pid) const {
     auto it = appMap.find(pid);
@@ -560,8 +643,16 @@ class FsProcWorker {
   void ProcessLmJoinAllCreation(LmMsgJoinAllCreationCtx *ctx);
 
   void ProcessSchedNewResrcAlloc(sched::AllocDecision *decision);
+  // Move <dst_wid, num_inodes> of the app's inodes. Idle inodes are exported
+  // right away; busy ones are quiesced (see quiescing_inodes_), so the app's
+  // requests on other inodes are not stalled.
   void schedMigrateInode(AppProc *app,
                          const std::vector<std::tuple<int, int>> &inode_move);
+  // Export the quiescing inodes that have no request in progress anymore.
+  // @return number of inodes exported
+  int schedExportQuiescedInodes();
+  // @return true if the request is held because its inode is quiescing
+  bool holdReqIfInodeQuiescing(FsReq *req, InMemInode *inode);
 
   int CheckFutureRoutingOnReqCompletion(AppProc *app, int tid,
                                         InMemInode *inode);
@@ -809,6 +900,8 @@ class FsProcWorker {
   FileMng *fileManager;
   // the buffer that is essentially HugePages allocated by SPDK interface.
   char *devBufMemPtr;
+  // see allocLocalDataBlockMem()
+  char *localDataBlockMemPtr{nullptr};
 
   // A variable which is read only to check if keep running or stop
   std::atomic_bool *workerRunning;
@@ -831,6 +924,14 @@ class FsProcWorker {
   std::map<pid_t, std::map<int, int>> crt_routing_tb_;
   std::vector<std::pair<cfs_ino_t, int>> pending_crt_redirect_inos_;
 
+  // Inodes the scheduler is moving to another worker, waiting for their
+  // in-progress requests to finish. New requests on them are held and then
+  // redirected to the new owner once the reassignment is done.
+  InodeQuiescer<AppProc, FsReq> quiescing_inodes_;
+  // export the inode to dst_wid; `held_reqs` are redirected after that
+  void schedExportInode(AppProc *app, cfs_ino_t ino, int dst_wid,
+                        std::vector<FsReq *> &&held_reqs);
+
   FsWorkerOpStats *opStatsPtr_{nullptr};
   cfs_tid_t workerTid_;
 
@@ -839,6 +940,8 @@ class FsProcWorker {
 #ifdef DO_SCHED
   // when start inner loop for the first time, reset cpu progress
   uint64_t cpu_prog_epoch_ts = 0;
+  // last time this worker published to the metrics page
+  uint64_t metrics_publish_ts = 0;
 #else
   std::queue<FsReq *> internalReadyReqQueue;
   std::queue<FsReq *> recvReadyReqQueue;
@@ -956,6 +1059,17 @@ class FsProcWorker {
   bool processRecvReadyQueue(sched::Tenant &t);
   bool processInternalReadyQueue(sched::Tenant &t);
   uint64_t processBlockReadyQueue(sched::Tenant &t);
+  // publish this worker's and its tenants' states to the metrics page; cheap
+  // to call in every loop since it is rate-limited internally
+  void publishMetrics(sched::stat::IdleStat &idle_stat);
+  // park this worker if the allocator asks to and it is drained: no tenant
+  // owns a file or has a request here, and the device queue is empty
+  bool tryPark(sched::stat::IdleStat &idle_stat);
+  // warm restart (see Snapshot.h): record this worker's tenants on exit;
+  // prefetch the restored blocks of every app into this worker's tenants
+  // before admitting requests (only the master, which owns all inodes then)
+  void snapshotTenants(sched::snapshot::Snapshot &snapshot);
+  void warmUpTenants(const sched::snapshot::Snapshot &snapshot);
 #endif
   virtual void primaryHandleUnknownFdReq(FsReq *req) final;
   virtual void ownerProcessFdReq(FsReq *req) final;
@@ -997,6 +1111,9 @@ class FsProcWorker {
 
   // pin worker to cpu (according to wid currently)
   virtual int pinToCpu();
+  // rebuild the request pools on this worker's thread once pinned, so that
+  // they are first touched on the node of its core
+  void relocateReqPools();
 
   // this will be invoked inside onTargetInodeFiguredOut()
   // basically if one FsReq's inode is successfully set to a valid *inodePtr*
@@ -1151,6 +1268,7 @@ class FsProcWorkerMaster : public FsProcWorker {
       // case FsReqType::UNLINK:
       // case FsReqType::RENAME:
       case FsReqType::OPENDIR:
+      case FsReqType::READDIR:
       case FsReqType::APP_EXIT:
       case FsReqType::NEW_SHM_ALLOCATED:
       case FsReqType::SYNCALL:
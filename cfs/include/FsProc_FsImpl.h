@@ -1,18 +1,23 @@
 #ifndef CFS_INCLUDE_FSPROC_FSIMPL_H_
 #define CFS_INCLUDE_FSPROC_FSIMPL_H_
 
+#include <array>
 #include <cstdint>
+#include <memory>
 #include <set>
 #include <stdexcept>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
+#include "FsProc_FreeExtentIndex.h"
 #include "FsProc_FsInternal.h"
 #include "FsProc_FsReq.h"
 #include "FsProc_Journal.h"
 #include "FsProc_PageCache.h"
 #include "FsProc_TLS.h"
 #include "FsProc_WorkerStats.h"
+#include "Snapshot.h"
 #include "Tenant.h"
 
 //
@@ -384,6 +389,14 @@ class FsImpl {
   // return the corresponding dentry's pointer
   cfs_dirent *lookupDirDentry(FsReq *fsReq, InMemInode *dirInode,
                               const std::string &fileName, bool &error);
+  // Collect the dentries of a directory from the dentry slot `cursor` on,
+  // skipping the unlinked ones, until `maxEntries` are found or the end of
+  // the directory is reached.
+  // @param cursor: set to the slot after the last collected dentry
+  // @return false if need RIO (dentry or index node block), then fsReq has
+  //   pending IO and cursor is left as is
+  bool readDirDentries(FsReq *fsReq, InMemInode *dirInode, uint64_t &cursor,
+                       uint32_t maxEntries, std::vector<cfs_dirent> &dentries);
 
   // see if the dirinode's data block which contains the dentry that
   // encode the <fileName:targetInode->i_no> info is in memory
@@ -435,13 +448,28 @@ class FsImpl {
 #endif
   }
 
+  // Find the extent that maps the block blockIdx of an inode; the index nodes
+  // of its extent tree are read through the data block buffer.
+  // @return 1 if found, 0 if need RIO (index node), -1 if the block is not
+  //   mapped
+  int lookupExtent(FsReq *req, InMemInode *inode, uint32_t blockIdx,
+                   cfs_extent &extent);
+  // Collect all the extents of an inode, and the data blocks (relative to the
+  // first data block) that hold the index nodes of its extent tree.
+  // @return false if need RIO (index node), then req has pending IO
+  bool collectExtents(FsReq *req, InMemInode *inode,
+                      std::vector<cfs_extent> &extents,
+                      std::vector<uint64_t> &nodeBlocks);
+
   int64_t readInodeToUCache(
       FsReq *req, InMemInode *inode,
       std::vector<std::pair<cfs_bno_t, size_t>> &pagesToRead,
       std::vector<std::pair<PageDescriptor *, void *>> &dstVec);
 
+  // @param direct: read whole blocks not in the buffer directly into dst if
+  //   the device can DMA to it (dst must be the app's shm of req)
   int64_t readInode(FsReq *req, InMemInode *inode, char *dst, uint64_t off,
-                    uint64_t nBytes, bool nocpy = false);
+                    uint64_t nBytes, bool nocpy = false, bool direct = false);
   // doAllocate data blocks for processing a WRITE request
   uint64_t writeInodeAllocDataBlock(FsReq *req, InMemInode *inode, uint64_t off,
                                     uint64_t nBytes);
@@ -472,6 +500,11 @@ class FsImpl {
   int64_t releaseInodeDataBlocks(FsReq *req, InMemInode *inode);
   int64_t allocateDataBlocks(FsReq *fsReq, InMemInode *inode,
                              uint32_t numBlocks);
+  // Tell the allocator that a data block's bit is cleared in the (dirty)
+  // bitmap, so that its allocation unit can be reused without a bitmap scan.
+  // @param bmap: the bitmap block that has been modified
+  void noteDataBlockFreed(cfs_bno_t bmapBlockNo, uint32_t bitNo,
+                          const char *bmap);
   // if a inode is deleted, then the data blocks should be able to be
   // reused (e.g., LRU replacement)
   void releaseInodeDataBuffers(InMemInode *inode);
@@ -491,6 +524,17 @@ class FsImpl {
   // @param: needFlush, will be set to false if all the blocks are clean
   int64_t flushInodeData(FsProcWorker *worker, FsReq *req, bool &needFlush);
 
+#ifdef DO_SCHED
+  // Background write-back of a tenant's dirty data blocks once its dirty
+  // ratio is above the threshold; the blocks go to the tenant's write-back
+  // queue and are submitted within its bandwidth.
+  // @return: number of blocks queued. set to -1 if no write-back is needed.
+  int64_t writeBackTenantDirty(FsProcWorker *worker, sched::Tenant &tenant);
+#endif
+  bool checkIfInodeWriteBackInflight(cfs_ino_t ino) {
+    return dataBlockBuf_->flusher.checkIfIdxWriteBackInflight(ino);
+  }
+
   // help with FS exit (flushing)
   // Will flush all the in-memory metadata buffers to disk.
   void flushMetadataOnExit(FsProcWorker *procHandler);
@@ -528,6 +572,17 @@ class FsImpl {
 
   void adjustCacheSize(sched::Tag t) { dataBlockBuf_->adjustCacheSize(t); }
 
+  // warm restart (see Snapshot.h): list the blocks in each tenant's partition,
+  // indexed by aid, main partition first; and read `blocks` (hottest first)
+  // into `tenant`'s partition at a bounded rate with blocking I/O
+  // @return number of blocks read, or -1 on I/O error
+  void snapshotDataBlockBuf(
+      std::vector<sched::snapshot::TenantSnapshot> &tenants);
+  int BlockingWarmUpDataBlockBuf(
+      sched::Tenant &tenant,
+      const std::vector<std::pair<uint32_t, uint32_t>> &blocks,
+      FsProcWorker *worker_handler);
+
  private:
   int idx_{-1};
   FsProcWorker *fsWorker_{nullptr};
@@ -558,18 +613,27 @@ class FsImpl {
   // false and should be optimized away. That way calling code need not be
   // changed.
   bool isBlockBitmapImmutable(cfs_bno_t blockNo);
-  // <alloctionUnit, nextAllocWithinUnitBlockNo>
-  // This is ued for small optimization for block allocation
-  // NOTE: currently only used for the first extent in the extent-array
-  std::unordered_map<uint32_t, uint32_t> nextDataBlockAllocWithinUnitBlockIdx{
-      NEXTENT_ARR};
-  // record which bit is free inside the block indicates by above
-  // nextDataBlockAllocWithinUnitBlockIdx map
-  std::unordered_map<uint32_t, int> nextDataBlockAllocCurBlkBitNo{NEXTENT_ARR};
+  // Add the bitmap blocks to immutableBlockBitmaps_ (resp. make them the
+  // whole set, swapping the old set into `bmaps`), and freeze (thaw) them in
+  // the free extent indexes accordingly.
+  void lockBlockBitmaps(const std::unordered_set<cfs_bno_t> &bmaps);
+  void resetLockedBlockBitmaps(std::unordered_set<cfs_bno_t> &bmaps);
+  // Free allocation units of this worker's data bitmap region, one index per
+  // extent slot (aka. allocation unit); created on the first allocation.
+  // Only touched by the owner worker, thus the allocation is lock-free.
+  std::array<std::unique_ptr<FreeExtentIndex>, NEXTENT_ARR> freeExtentIdxes_;
 
   // BlockBuffer *inodeBlockBuf_;
   // inodeBuffer will use 512Byte is block Size
   BlockBuffer *inodeSectorBuf_{nullptr};
+#ifdef DO_SCHED
+  // the tenant charged for each inode sector it brought into inodeSectorBuf_
+  // (see sched::Tenant::meta_cache_sectors), until the inode leaves it
+  std::unordered_map<uint32_t, sched::Tenant *> inodeSectorTenants_;
+#endif
+  // the inode is unlinked or moves to another worker: the sector stays in the
+  // buffer, but it is no longer charged to the tenant that brought it in
+  void releaseInodeSectorCharge(cfs_ino_t ino);
   BlockBuffer *dataBlockBuf_{nullptr};
   float dataBlockBufDirtyFlushRato_{0.9};
   static constexpr int kBufferSlowLowWatermark = 5000;
@@ -578,7 +642,6 @@ class FsImpl {
 #ifndef NONE_MT_LOCK
   std::atomic_flag iMapBlockLock;
   std::atomic_flag inodeMapLock;
-  std::atomic_flag bmapLock;
 #endif
 
   // NOTE: these memory address are global visible
@@ -628,7 +691,25 @@ class FsImpl {
   void initMemAddrInodeSectorBuf();
   void initMemAddrDataBlockBuf();
 
-  void initDataBlockAllocNextFreeBlockIdx();
+  FreeExtentIndex *getFreeExtentIndex(int extentArrIdx);
+  // The index (if created) of the region that holds a bitmap block of this
+  // worker.
+  // @param bmapBlockIdx: set to the block's index relative to the region
+  FreeExtentIndex *findFreeExtentIndex(cfs_bno_t bmapBlockNo,
+                                       uint32_t &bmapBlockIdx);
+  // Allocate the first allocation unit of a new extent
+  // @param blockNo: set to the extent's block_no if succeed
+  // @return 1 if succeed, 0 if need RIO (bitmap block), -1 if no space
+  int allocateDataUnit(FsReq *fsReq, int extentArrIdx, uint64_t &blockNo);
+  // Allocate the unit that starts at blockNo, i.e., the one right after an
+  // extent's last unit, so that the extent can keep growing
+  // @return 1 if succeed, 0 if need RIO (bitmap block), -1 if it is not free
+  //   (or not in this worker's region)
+  int allocateDataUnitAt(FsReq *fsReq, int extentArrIdx, uint64_t blockNo);
+  // One step of allocateDataBlocks(): grow the file at the right edge of its
+  // extent tree by at most numBlocks blocks
+  // @return number of blocks added, 0 if need RIO, -1 if no space
+  int64_t appendDataBlocks(FsReq *fsReq, InMemInode *inode, uint32_t numBlocks);
 
   // Fetch Inode by blocking wait for disk io done
   // REQUIRED: ino not in inodeMap
@@ -653,6 +734,10 @@ class FsImpl {
   BlockBufferHandle getBlock(BlockBuffer *blockBuf, uint32_t blockNo,
                              FsReq *fsReq, bool doSubmit, bool doBlockSubmit,
                              bool &canOverwritten, uint32_t new_index = 0);
+  // read a data block into the app's buffer dst without the block buffer;
+  // it is charged to the tenant like a block read through the buffer
+  // @return false if it cannot (in the buffer, or dst is not DMA-capable)
+  bool submitDirectRead(FsReq *fsReq, uint32_t blockNo, char *dst);
   BlockBufferHandle getLockedDirtyBitmap(cfs_bno_t bitmap_blockno);
   void releaseLockedDirtyBitmap(BlockBufferHandle buf);
   cfs_mem_block_t *getDirtyInodeBitmap(cfs_bno_t bitmap_blockno);
@@ -722,6 +807,7 @@ inline cfs_mem_block_t *FsImpl::getDirtyInodeBitmap(cfs_bno_t bitmap_blockno) {
 
 inline void FsImpl::releaseInodeDataBuffers(InMemInode *inode) {
   dataBlockBuf_->releaseUnlinkedInodeDirtyBlocks(inode->i_no);
+  releaseInodeSectorCharge(inode->i_no);
 }
 
 inline bool FsImpl::isBlockBitmapImmutable(cfs_bno_t blockNo) {
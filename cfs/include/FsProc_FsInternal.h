@@ -73,6 +73,8 @@ struct cfs_dirent {
 };
 
 // an extent descriptor takes 16 bytes
+// It is also the index entry of an extent tree (see cfs_extent_header), where
+// block_no is the child node and num_blocks is unused.
 struct cfs_extent {
   uint32_t i_block_offset;  // block no offset in this file
   // Note, this block_no's block zero is the first data-block
@@ -82,11 +84,41 @@ struct cfs_extent {
   uint64_t block_no;    // on disk block no
 };
 
+// Extent tree
+// The extents of an inode form a B+tree rooted at the inode: ext_header
+// describes ext_array, which holds the extents themselves (depth 0) or the
+// index entries of the nodes one level down. A node (cfs_extent_node) takes a
+// data block and has the same layout. Entries are sorted by i_block_offset,
+// thus a lookup is one binary search per level.
+// A file only grows at its end, so the tree only grows at its right edge: a
+// full node is never split but gets a new right sibling, and every node except
+// the rightmost ones is full.
+// An inode without the magic is in the legacy format: ext_array slot i has the
+// size class i (see extentArrIdx2BlockAllocUnit()); cfs_extent_tree_upgrade()
+// converts it in place.
+#define CFS_EXTENT_MAGIC 0xE57E
+
+struct cfs_extent_header {
+  uint16_t magic;
+  uint16_t entries;  // # of valid entries
+  uint16_t max;      // capacity of entries
+  uint16_t depth;    // 0: entries are extents; otherwise index entries
+  uint64_t __reserved;
+};
+
+#define NEXTENT_PER_NODE \
+  ((BSIZE - sizeof(struct cfs_extent_header)) / sizeof(struct cfs_extent))
+
+struct cfs_extent_node {
+  struct cfs_extent_header hdr;
+  struct cfs_extent ents[NEXTENT_PER_NODE];
+};
+
 // on disk inode (512 B)
 // NOTE: choose to use 512B to make sure one on-disk IO-unit (512 B) can
 // just have one inode
-// In future, if we need larger file, we can release more *cfs_extent* from
-// __padding_for_sector
+// The size of a file is bounded by neither ext_array nor the padding, as
+// ext_array is the root of the extent tree.
 struct cfs_dinode {
   //
   // 1-Byte fields
@@ -125,21 +157,26 @@ struct cfs_dinode {
   struct timeval ctime;
   struct timeval mtime;
 
-  // Ext-0, Ext-1, Ext-2 ... Ext6 will allocate certain size of data
+  // Root of the extent tree
+  // Legacy: Ext-0, Ext-1, Ext-2 ... Ext6 will allocate certain size of data
   // 4K, 1M, 128M (one whole bitmap), 2*128M, 4*128M, 8*128M, 16*128M
   struct cfs_extent ext_array[NEXTENT_ARR];
+  struct cfs_extent_header ext_header;
 
-  uint8_t __padding_for_sector[256];
+  uint8_t __padding_for_sector[240];
   // Pad unused space to 512B
   uint8_t __padding[56];
 };
+static_assert(sizeof(struct cfs_dinode) == 512, "cfs_dinode must be 512B");
 
 // printing formats
 std::string inline format_inode_output(struct cfs_dinode *inodePtr) {
   std::ostringstream ss;
   ss << "Inode:" << inodePtr->i_no << " type:" << inodePtr->type
      << "SyncID: " << inodePtr->syncID << " size:" << inodePtr->size
-     << " extents:\n";
+     << " ext_magic:" << inodePtr->ext_header.magic
+     << " ext_depth:" << inodePtr->ext_header.depth
+     << " ext_entries:" << inodePtr->ext_header.entries << " extents:\n";
   for (int i = 0; i < NEXTENT_ARR; i++) {
     ss << "\t ext_array[" << i << "]:"
        << " i_block_offset:" << inodePtr->ext_array[i].i_block_offset
@@ -164,6 +201,11 @@ std::string inline from_cfsdinode_to_str(const cfs_dinode *dinode) {
   DUMP_PACK_DINODE_ATTR_TO_JSON(jsub, dinode, i_block_count);
   DUMP_PACK_DINODE_ATTR_TO_JSON(jsub, dinode, size);
   DUMP_PACK_DINODE_ATTR_TO_JSON(jsub, dinode, syncID);
+  jsub["ext_header"] = {
+      {"magic", dinode->ext_header.magic},
+      {"entries", dinode->ext_header.entries},
+      {"depth", dinode->ext_header.depth},
+  };
   for (int i = 0; i < NEXTENT_ARR; i++) {
     std::string attrName = "extent-" + std::to_string(i);
     jsub[attrName] = {
@@ -233,8 +275,55 @@ const int kFsPerExtShareArr[] = {1, 80, 160, 10, 16, 10};  // micro-bench@bumble
 const int kFsExtArrShareSum = kFsPerExtShareArr[0] + kFsPerExtShareArr[1] +
                               kFsPerExtShareArr[2] + kFsPerExtShareArr[3] +
                               kFsPerExtShareArr[4] + kFsPerExtShareArr[5];
+// Layout of getDataBMapStartBlockNoForExtentArrIdx() for a device too small
+// for it (e.g., 240 bitmap blocks per worker with the default 300 GB, fewer
+// than LAST_EXTENT_MAX_BMAP_BLOCK_NUM alone): the last extent gets at most
+// half of the bitmap blocks, in whole units, and the rest is split by the
+// shares, with at least one bitmap block per class that has a share.
+uint32_t inline getDataBMapStartBlockNoForSmallDev(int extentArrIdx,
+                                                   uint32_t totalBmapBlockNum,
+                                                   uint32_t &maxBmapBlockNum) {
+  const uint32_t lastUnitBmapBlocks =
+      (LAST_EXTENT_ALLOC_UNIT_BYTE) / ((BPB) * (BSIZE)) > 0
+          ? (LAST_EXTENT_ALLOC_UNIT_BYTE) / ((BPB) * (BSIZE))
+          : 1;
+  uint32_t lastNum =
+      totalBmapBlockNum / 2 / lastUnitBmapBlocks * lastUnitBmapBlocks;
+  if (lastNum > (LAST_EXTENT_MAX_BMAP_BLOCK_NUM))
+    lastNum = (LAST_EXTENT_MAX_BMAP_BLOCK_NUM);
+  uint32_t restNum = totalBmapBlockNum - lastNum;
+  if (extentArrIdx + 1 == (NEXTENT_ARR)) {
+    maxBmapBlockNum = lastNum;
+    return restNum;
+  }
+  int numWithShare = 0;
+  for (int i = 0; i + 1 < (NEXTENT_ARR); i++)
+    numWithShare += kFsPerExtShareArr[i] > 0;
+  uint64_t spareNum = restNum > uint32_t(numWithShare)
+                          ? restNum - numWithShare
+                          : 0;
+  auto startOf = [&](int idx) {
+    int preShare = 0, preWithShare = 0;
+    for (int i = 0; i < idx; i++) {
+      preShare += kFsPerExtShareArr[i];
+      preWithShare += kFsPerExtShareArr[i] > 0;
+    }
+    uint64_t start = preWithShare + spareNum * preShare / kFsExtArrShareSum;
+    return uint32_t(start < restNum ? start : restNum);
+  };
+  uint32_t start = startOf(extentArrIdx);
+  maxBmapBlockNum = startOf(extentArrIdx + 1) - start;
+  return start;
+}
+
 uint32_t inline getDataBMapStartBlockNoForExtentArrIdx(
     int extentArrIdx, uint32_t totalBmapBlockNum, uint32_t &maxBmapBlockNum) {
+  // (totalBmapBlockNum - LAST_EXTENT_MAX_BMAP_BLOCK_NUM) would wrap, or give
+  // no block to every share
+  if (totalBmapBlockNum <
+      (LAST_EXTENT_MAX_BMAP_BLOCK_NUM) + uint32_t(kFsExtArrShareSum))
+    return getDataBMapStartBlockNoForSmallDev(extentArrIdx, totalBmapBlockNum,
+                                              maxBmapBlockNum);
   uint32_t bmap_start_block_no;
   if (extentArrIdx + 1 == (NEXTENT_ARR)) {
     maxBmapBlockNum = (LAST_EXTENT_MAX_BMAP_BLOCK_NUM);
@@ -400,4 +489,144 @@ static inline uint32_t get_bmap_block_for_pba(uint32_t pba) {
 static inline uint32_t get_imap_for_inode(uint64_t inode) {
   return (inode / (BPB)) + get_imap_start_block();
 }
+
+//
+// Helper functions of the extent tree
+//
+
+static inline bool cfs_extent_tree_enabled(const struct cfs_dinode *dinode) {
+  return dinode->ext_header.magic == CFS_EXTENT_MAGIC;
+}
+
+// an empty tree for a new inode
+void inline cfs_extent_tree_init(struct cfs_dinode *dinode) {
+  memset(dinode->ext_array, 0, sizeof(dinode->ext_array));
+  memset(&dinode->ext_header, 0, sizeof(dinode->ext_header));
+  dinode->ext_header.magic = CFS_EXTENT_MAGIC;
+  dinode->ext_header.max = NEXTENT_ARR;
+}
+
+void inline cfs_extent_node_init(struct cfs_extent_node *node,
+                                 uint16_t depth) {
+  memset(node, 0, sizeof(*node));
+  node->hdr.magic = CFS_EXTENT_MAGIC;
+  node->hdr.max = NEXTENT_PER_NODE;
+  node->hdr.depth = depth;
+}
+
+// Convert a legacy inode into a tree of depth 0 in place; no data is moved.
+// Legacy slots are used in order, so the extents are the slots before the
+// first empty one (a deleted extent may leave its block_no behind).
+void inline cfs_extent_tree_upgrade(struct cfs_dinode *dinode) {
+  if (cfs_extent_tree_enabled(dinode)) return;
+  int n = 0;
+  while (n < NEXTENT_ARR && dinode->ext_array[n].num_blocks > 0) n++;
+  memset(&dinode->ext_array[n], 0,
+         sizeof(struct cfs_extent) * (NEXTENT_ARR - n));
+  memset(&dinode->ext_header, 0, sizeof(dinode->ext_header));
+  dinode->ext_header.magic = CFS_EXTENT_MAGIC;
+  dinode->ext_header.entries = n;
+  dinode->ext_header.max = NEXTENT_ARR;
+}
+
+// @return index of the last entry whose i_block_offset <= i_block_idx, -1 if
+// there is none
+int inline cfs_extent_search(const struct cfs_extent *ents, int n,
+                             uint32_t i_block_idx) {
+  int lo = 0, hi = n;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (ents[mid].i_block_offset <= i_block_idx)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo - 1;
+}
+
+// Find the extent that maps a block of an inode in the extent tree format.
+// @param getNode: (uint64_t block_no) -> const cfs_extent_node *, gives the
+//   node in the data block block_no, or nullptr if it is not available (e.g.,
+//   being read)
+// @param extent: set to the extent if found
+// @return 1 if found, 0 if a node is not available, -1 if the block is not
+//   mapped
+template <typename GetNode>
+int cfs_extent_tree_lookup(const struct cfs_dinode *dinode,
+                           uint32_t i_block_idx, GetNode &&getNode,
+                           struct cfs_extent &extent) {
+  const struct cfs_extent_header *hdr = &dinode->ext_header;
+  const struct cfs_extent *ents = dinode->ext_array;
+  while (true) {
+    int i = cfs_extent_search(ents, hdr->entries, i_block_idx);
+    if (i < 0) return -1;
+    if (hdr->depth == 0) {
+      if (i_block_idx - ents[i].i_block_offset >= ents[i].num_blocks)
+        return -1;
+      extent = ents[i];
+      return 1;
+    }
+    const struct cfs_extent_node *node = getNode(ents[i].block_no);
+    if (node == nullptr) return 0;
+    assert(node->hdr.magic == CFS_EXTENT_MAGIC);
+    assert(node->hdr.depth + 1 == hdr->depth);
+    hdr = &node->hdr;
+    ents = node->ents;
+  }
+}
+
+// Size class (i.e., legacy ext_array index) of the bitmap region a data block
+// is in; every worker's bitmap blocks are partitioned the same way by
+// getDataBMapStartBlockNoForExtentArrIdx().
+// @param block_no: relative to the first data block
+// @param unit_start: set to the first block of the allocation unit of block_no
+// @return -1 if the block is in no region
+int inline getAllocClassForDataBlock(uint64_t block_no, uint64_t &unit_start) {
+  uint64_t worker_bmap_blocks = get_dev_bmap_num_blocks_for_worker(0);
+  uint64_t bmap_idx = block_no / (BPB);
+  uint64_t worker_start = bmap_idx / worker_bmap_blocks * worker_bmap_blocks;
+  uint64_t in_worker = bmap_idx - worker_start;
+  for (int i = 0; i < NEXTENT_ARR; i++) {
+    uint32_t max_bmap_blocks;
+    uint32_t start = getDataBMapStartBlockNoForExtentArrIdx(
+        i, worker_bmap_blocks, max_bmap_blocks);
+    if (in_worker < start || in_worker >= start + max_bmap_blocks) continue;
+    uint64_t region_start = (worker_start + start) * (BPB);
+    uint64_t unit = extentArrIdx2BlockAllocUnit(i);
+    unit_start = region_start + (block_no - region_start) / unit * unit;
+    return i;
+  }
+  return -1;
+}
+
+// Call fn(unit_start, size_class) for each allocation unit an extent covers.
+// An extent starts at a unit and only grows into the adjacent unit of the
+// same class, so it covers whole units except maybe the last one.
+template <typename Fn>
+void forEachAllocUnitOfExtent(const struct cfs_extent &extent, Fn &&fn) {
+  uint64_t cur = extent.block_no;
+  uint64_t end = extent.block_no + extent.num_blocks;
+  while (cur < end) {
+    uint64_t unit_start;
+    int cls = getAllocClassForDataBlock(cur, unit_start);
+    assert(cls >= 0);
+    fn(unit_start, cls);
+    cur = unit_start + extentArrIdx2BlockAllocUnit(cls);
+  }
+}
+
+// Files smaller than this (in blocks) grow one block at a time
+#define EXTENT_TREE_SMALL_FILE_BLOCKS 16
+
+// Size class of the next allocation unit of a file that has i_block_count
+// blocks: single blocks while it is small, then the class of the legacy slot
+// at that offset, so that the unit keeps growing with the file, and the
+// largest class from then on.
+int inline getExtentTreeAllocClass(uint32_t i_block_count) {
+  if (i_block_count < EXTENT_TREE_SMALL_FILE_BLOCKS) return 0;
+  uint32_t inside_extent_idx, extent_max_block_num;
+  int idx = getCurrentExtentArrIdx(i_block_count, inside_extent_idx,
+                                   extent_max_block_num);
+  return idx < 0 ? NEXTENT_ARR - 1 : idx;
+}
 #endif  // CFS_FSINTERNAL_H
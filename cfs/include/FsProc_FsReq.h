@@ -76,6 +76,7 @@ enum class FsReqType {
   APP_MIGRATE,
   INODE_REASSIGNMENT,  // TODO enable only with flag at compile time
   THREAD_REASSIGN,
+  THREAD_RING,
   REMOTE_BITMAP_CHANGES,
   PING,
   _LANDMARK_COMMON_ADMIN_OP,
@@ -87,6 +88,7 @@ enum class FsReqType {
   MKDIR,
   RENAME,
   OPENDIR,
+  READDIR,
   RMDIR,
   _LANDMARK_ADMIN_OP_,  // operations that without inclusion of *inode* (aka.
                         // file)
@@ -147,6 +149,7 @@ static constexpr int inline getFlags(const FsReqType t) {
     case FsReqType::MKDIR:
     case FsReqType::RENAME:
     case FsReqType::OPENDIR:
+    case FsReqType::READDIR:
     case FsReqType::RMDIR:
       return uses_paths | handled_by_primary;
 
@@ -165,6 +168,7 @@ static constexpr int inline getFlags(const FsReqType t) {
     case FsReqType::SYNCUNLINKED:
     case FsReqType::INODE_REASSIGNMENT:
     case FsReqType::THREAD_REASSIGN:
+    case FsReqType::THREAD_RING:
     case FsReqType::APP_MIGRATE:
     case FsReqType::PING:
     case FsReqType::DUMPINODES:
@@ -283,6 +287,7 @@ const static std::unordered_map<uint32_t, const char *> gFsReqTypeStrMap{
     FS_REQ_TYPE_AD_HOC_TO_STR(FDATA_SYNC),
     FS_REQ_TYPE_AD_HOC_TO_STR(WSYNC),
     FS_REQ_TYPE_AD_HOC_TO_STR(OPENDIR),
+    FS_REQ_TYPE_AD_HOC_TO_STR(READDIR),
     FS_REQ_TYPE_AD_HOC_TO_STR(RMDIR),
     FS_REQ_TYPE_AD_HOC_TO_STR(APP_EXIT),
     FS_REQ_TYPE_AD_HOC_TO_STR(NEW_SHM_ALLOCATED),
@@ -295,6 +300,7 @@ const static std::unordered_map<uint32_t, const char *> gFsReqTypeStrMap{
     FS_REQ_TYPE_AD_HOC_TO_STR(STOP_DUMP_LOADSTAT),
     FS_REQ_TYPE_AD_HOC_TO_STR(INODE_REASSIGNMENT),
     FS_REQ_TYPE_AD_HOC_TO_STR(THREAD_REASSIGN),
+    FS_REQ_TYPE_AD_HOC_TO_STR(THREAD_RING),
 };
 
 std::string inline getFsReqTypeOutputString(FsReqType tp) {
@@ -472,6 +478,9 @@ enum class FsReqState {
   OPENDIR_GET_FILE_INODE,
   OPENDIR_READ_WHOLE_INODE,
   OPENDIR_ERR,
+  // readdir (resolves the path with the opendir states)
+  READDIR_READ_DENTRIES,
+  READDIR_FILL_ATTRS,
   // rmdir
   RMDIR_START_FAKE,
   // newshmalloc
@@ -941,6 +950,7 @@ class FsReq {
     assert(rwopPtr != nullptr);
     return rwopPtr->flag & _RWOP_FLAG_FSLIB_ENABLE_APP_BUF_;
   }
+  uint8_t getShmId() { return shmId; }
   fslib_malloc_block_cnt_t getDataPtrId() { return dataPtrId; }
   char *getMallocedDataPtr() {
     auto ptr = app->getDataPtrByShmIdAndDataId(shmId, dataPtrId);
@@ -998,7 +1008,8 @@ class FsReq {
     bool rt = reqType == FsReqType::CREATE || reqType == FsReqType::UNLINK ||
               reqType == FsReqType::MKDIR || reqType == FsReqType::RMDIR ||
               reqType == FsReqType::RENAME || reqType == FsReqType::OPEN ||
-              reqType == FsReqType::OPENDIR || reqType == FsReqType::STAT;
+              reqType == FsReqType::OPENDIR || reqType == FsReqType::READDIR ||
+              reqType == FsReqType::STAT;
     return rt;
   }
 
@@ -1236,6 +1247,12 @@ class BlockReqPool {
 
   BlockReq *alloc();
   void free(BlockReq *);
+  bool allFree() {
+    return int(block_req_queue_.size()) == kPerWorkerBlockReqPoolCapacity;
+  }
+  // reallocate the pool from the calling thread (see
+  // FsProcWorker::relocateReqPools); all the requests must be free
+  void relocate();
 
  private:
   BlockReq *pool_;
@@ -1256,6 +1273,12 @@ class BufferFlushReq {
   //      otherwise, the blockBuffer will choose the blocks by itself
   // @return: return number of blocks that are flags
   int initFlushReqs(int index);
+#ifdef DO_SCHED
+  // initialize the block level requests for the background write-back of a
+  // tenant; they are submitted through the tenant's write-back queue
+  // @return: number of blocks to be written back
+  int initWriteBackReqs(sched::Tenant *t, uint32_t maxNum);
+#endif
   // Submit the flushing request to FSP
   // return the number of blocks to be flushed.
   int submitFlushReqs();
@@ -1284,6 +1307,13 @@ class BufferFlushReq {
   void setEnableTrace(bool b) { enableTrace_ = b; }
 
  private:
+  // create the BlockReq of each block in toSubmitFlushBlocks
+  int initBlockReqs();
+#ifdef DO_SCHED
+  // queue a block request to the tenant that is charged for it
+  void addToTenantQueue(BlockReq *block_req);
+#endif
+
   BlockBuffer *srcBuf;
   // if this flushRequest directly comes from app request, store it here
  public:
@@ -1295,6 +1325,10 @@ class BufferFlushReq {
   // blocks that has been submitted to the device, but not done yet
   std::unordered_set<block_no_t> submittedFlushBlocks;
   FsProcWorker *submitWorker;
+#ifdef DO_SCHED
+  // the tenant whose write-back this is; nullptr if it comes from fsReq
+  sched::Tenant *wbTenant = nullptr;
+#endif
 
   bool enableTrace_{kEnableTrace};
 };
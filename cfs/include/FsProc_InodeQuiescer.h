@@ -0,0 +1,82 @@
+#ifndef CFS_INCLUDE_FSPROC_INODEQUIESCER_H_
+#define CFS_INCLUDE_FSPROC_INODEQUIESCER_H_
+
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "typedefs.h"
+
+// Inodes the scheduler is moving to another worker, waiting for their
+// in-progress requests to finish (see FsProcWorker::schedMigrateInode). New
+// requests on them are held, and handed over exactly once: to the export of
+// the inode, which redirects them to the new owner, or back to the worker if
+// the inode is gone meanwhile.
+// Only touched by the worker owning the inodes.
+template <typename App, typename Req>
+class InodeQuiescer {
+ public:
+  // what the worker says about a quiescing inode on each export round
+  enum class InodeState { kGone, kBusy, kIdle };
+
+  bool empty() const { return inodes_.empty(); }
+  size_t size() const { return inodes_.size(); }
+  bool contains(cfs_ino_t ino) const { return inodes_.count(ino) > 0; }
+  size_t numHeld(cfs_ino_t ino) const {
+    auto it = inodes_.find(ino);
+    return it == inodes_.end() ? 0 : it->second.held_reqs.size();
+  }
+
+  // @return false if the inode is already quiescing
+  bool quiesce(cfs_ino_t ino, App *app, int dst_wid) {
+    return inodes_.emplace(ino, Entry{.app = app, .dst_wid = dst_wid}).second;
+  }
+
+  // @return true if the request is held because its inode is quiescing
+  bool hold(cfs_ino_t ino, Req *req) {
+    auto it = inodes_.find(ino);
+    if (it == inodes_.end()) return false;
+    it->second.held_reqs.push_back(req);
+    return true;
+  }
+
+  // Hand over the inodes that are gone or idle, and stop quiescing them:
+  //   - stateOf(ino) -> InodeState
+  //   - exportInode(ino, app, dst_wid, std::vector<Req *> &&held_reqs)
+  //   - release(req) for each held request of a gone inode
+  // The callbacks may quiesce or hold again.
+  // @return number of inodes exported
+  template <typename StateFn, typename ExportFn, typename ReleaseFn>
+  int exportIdle(StateFn &&stateOf, ExportFn &&exportInode,
+                 ReleaseFn &&release) {
+    std::vector<std::pair<cfs_ino_t, InodeState>> done;
+    for (auto &[ino, entry] : inodes_) {
+      InodeState state = stateOf(ino);
+      if (state != InodeState::kBusy) done.emplace_back(ino, state);
+    }
+    int numExported = 0;
+    for (auto [ino, state] : done) {
+      auto it = inodes_.find(ino);
+      Entry entry = std::move(it->second);
+      inodes_.erase(it);
+      if (state == InodeState::kGone) {
+        for (Req *req : entry.held_reqs) release(req);
+        continue;
+      }
+      exportInode(ino, entry.app, entry.dst_wid, std::move(entry.held_reqs));
+      ++numExported;
+    }
+    return numExported;
+  }
+
+ private:
+  struct Entry {
+    App *app;
+    int dst_wid;
+    std::vector<Req *> held_reqs{};
+  };
+  std::unordered_map<cfs_ino_t, Entry> inodes_;
+};
+
+#endif  // CFS_INCLUDE_FSPROC_INODEQUIESCER_H_
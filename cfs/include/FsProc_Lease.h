@@ -48,6 +48,10 @@ class FsProcWorkerLeaseMng {
 
   int tryInvalidateLease(FsProcWorkerInodeLeaseCtx *ctxPtr);
 
+  // Drop all the READ leases on *ino*, e.g. because it is being modified
+  // @return number of leases revoked
+  int revokeReadLeases(cfs_ino_t ino);
+
  private:
   std::unordered_map<cfs_ino_t,
                      std::unordered_map<pid_t, FsProcWorkerInodeLeaseCtx *>>
@@ -1,8 +1,14 @@
 #ifndef __fsproc_messenger_h
 #define __fsproc_messenger_h
 
+#include <atomic>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "FsProc_PtrRing.h"
+#include "FsProc_TLS.h"
 #include "param.h"
-#include "shmipc/shmipc.h"
 
 struct FsProcMessage {
  public:
@@ -65,100 +71,187 @@ CHECK_MSG_ACK_INVARIANT(kLM_Rebalance);
 CHECK_MSG_ACK_INVARIANT(kLM_JoinAll);
 CHECK_MSG_ACK_INVARIANT(kLM_JoinAllCreation);
 
+// A ring of FsProcMessage from one sender thread (or, for the shared ring of
+// threads that are not workers, many sender threads) to one receiver.
+// Each message takes two ring entries: <type, ctx>. They are always enqueued
+// in the same bulk, so a message is never split.
 class FsProcMsgRing {
  public:
-  FsProcMsgRing(size_t capacity);
-  ~FsProcMsgRing();
-  // Thread safe - puts a message into the ring. Returns success bool.
-  bool put_message(FsProcMessage &fsp_msg);
-  // Thread safe - gets a message from the ring. Returns success bool.
-  bool get_message(FsProcMessage &fsp_msg);
+  FsProcMsgRing(const char *name, size_t capacity, bool single_producer);
+  // Puts all of the n messages into the ring, or none if there is no room.
+  bool put_messages(const FsProcMessage *msgs, size_t n);
+  // Gets up to max messages from the ring. Returns the number of messages.
+  size_t get_messages(FsProcMessage *msgs, size_t max);
+  // max number of messages in one put_messages()
+  constexpr static size_t kMaxBulk = 32;
 
  private:
-  size_t capacity;
-  // NOTE: implementing using shmipc_mgr since that also has a single consumer
-  // multi producer model. However, the assumption there is that the client and
-  // server have their own separate shmipc_mgr instances but share the
-  // underlying buffer. So the head/tail pointers are independent. Due to lack
-  // of time, we just use two shmipc_mgr instances here.
-  // TODO consider using the dpdk ring library
-  struct shmipc_mgr *consumer;
-  struct shmipc_mgr *producer;
-
-  void initShmipcMgr(struct shmipc_mgr *mgr);
+  FsProcPtrRing<void> ring;
 };
 
 // TODO: consider just sending messages with function and ctx.
 // receiver will automatically call those functions with the ctx argument.
+//
+// Every receiver (a worker or the load monitor) has one single-producer ring
+// per worker, plus one multi-producer ring shared by the threads that are not
+// workers (load manager, allocator, main). The sending worker is found by its
+// thread-local wid (FsProcTLS), so workers never contend with each other on a
+// ring. After a put, the sender rings the receiver's doorbell (a counter); the
+// receiver only scans its rings when the doorbell has changed, so an idle poll
+// reads one cache line.
 class FsProcMessenger {
  public:
   constexpr static int kLmWid = (NMAX_FSP_WORKER);
   constexpr static int kNumNonWorkerThreads = 1;
   constexpr static int kActualRingLen = NMAX_FSP_WORKER + kNumNonWorkerThreads;
+  // max number of messages received in one scan of the rings
+  constexpr static size_t kMaxRecvBatch = 32;
+  // @param ring_size: capacity (in messages) of each sender-receiver ring
   FsProcMessenger(size_t n_workers, size_t ring_size);
   ~FsProcMessenger();
   // sends a message to wid
   bool send_message(int wid, FsProcMessage &fsp_msg);
+  // sends n messages to wid, in order
+  bool send_messages(int wid, const FsProcMessage *msgs, size_t n);
   // recieves a message that was sent to wid
   // NOTE: This allows anyone to recieve a message meant for anyone else.
   // Callers should only call this function using their own wid. Since this
   // is internally used by workers (that trust each other), it is fine for now.
   // TODO: allow send_to_any, but recv only on my own wid.
   bool recv_message(int wid, FsProcMessage &fsp_msg);
+  // recieves up to max messages that were sent to wid
+  // @return number of messages received
+  size_t recv_messages(int wid, FsProcMessage *msgs, size_t max);
 
   bool send_message_to_loadmonitor(int fromWid, FsProcMessage &fsp_msg);
 
+  // A receiver with nothing else to do (e.g., a parked worker) may sleep
+  // instead of polling: it marks itself sleeping, checks has_pending() under
+  // its own lock and waits on its condition variable; the senders call
+  // `wakeup(wid)` after a put to a sleeping receiver, which must notify it.
+  // The wakeup is set once, before any message is sent.
+  void set_wakeup(std::function<void(int wid)> wakeup) {
+    wakeup_ = std::move(wakeup);
+  }
+  void set_sleeping(int wid, bool sleeping) {
+    inboxes[wid]->sleeping.store(sleeping);
+  }
+  // receiver only: whether any message sent to wid is not received yet
+  bool has_pending(int wid) const;
+
+  // Same as send_messages(), but from an explicit sender; src is a worker
+  // index, or -1 for a thread that is not a worker.
+  // Only the thread of worker src may send as src.
+  bool send_messages_from(int src, int wid, const FsProcMessage *msgs,
+                          size_t n);
+
+  // While a SendBatch is alive, the messages sent by this thread are staged
+  // and then delivered with one put per receiver when it goes out of scope
+  // (or on Flush()). Used for bursts of messages, e.g., migrating many inodes.
+  class SendBatch {
+   public:
+    explicit SendBatch(FsProcMessenger *messenger);
+    ~SendBatch();
+    SendBatch(const SendBatch &) = delete;
+    SendBatch &operator=(const SendBatch &) = delete;
+    void Flush();
+
+   private:
+    friend class FsProcMessenger;
+    FsProcMessenger *messenger_;
+    SendBatch *outer_;
+    std::vector<FsProcMessage> staged_[kActualRingLen];
+  };
+
  private:
+  struct Inbox {
+    // bumped by the senders after each put
+    alignas(UTIL_CACHE_LINE_SIZE) std::atomic_uint64_t doorbell{0};
+    // set by a receiver about to sleep; the senders check it after the
+    // doorbell, so that either the receiver sees the doorbell or they wake it
+    std::atomic_bool sleeping{false};
+    // below are only accessed by the receiver
+    alignas(UTIL_CACHE_LINE_SIZE) uint64_t seen{0};
+    size_t cursor{0};
+    // messages received by recv_message() but not returned yet
+    FsProcMessage pending[kMaxRecvBatch];
+    size_t pendingHead{0};
+    size_t pendingTail{0};
+    // indexed by sender: [0, n_workers) for the workers, n_workers for others
+    std::vector<FsProcMsgRing *> rings;
+  };
+
   size_t n_workers;
   size_t ring_size;
-  FsProcMsgRing *rings[kActualRingLen];
-};
+  Inbox *inboxes[kActualRingLen];
+  std::function<void(int wid)> wakeup_;
+  thread_local static SendBatch *tBatch;
 
-// inline functions for FsProcMsgRing
-
-inline bool FsProcMsgRing::put_message(FsProcMessage &fsp_msg) {
-  // NOTE: a limitation with the shmipc mgr is that alloc_slot is blocking.
-  // However, that is only if the entire ring is completley full.
-  // Currently, messages between workers are not that frequent (during fsync and
-  // checkpointing) and they are checked on every iteration, so it should not be
-  // a problem.
-  struct shmipc_msg msg;
-  msg.status = shmipc_STATUS_RESERVED;
-  msg.type = fsp_msg.type;
-  void **ptr = (void **)(msg.inline_data);
-  *ptr = (void *)fsp_msg.ctx;
-  off_t ring_idx = shmipc_mgr_alloc_slot(producer);
-  shmipc_mgr_put_msg_nowait(producer, ring_idx, &msg);
-  return true;
-}
-
-inline bool FsProcMsgRing::get_message(FsProcMessage &fsp_msg) {
-  off_t idx;
-  struct shmipc_msg *msg = shmipc_mgr_get_msg_nowait(consumer, &idx);
-  if (msg == nullptr) return false;
-
-  fsp_msg.type = msg->type;
-  void **ptr = (void **)(msg->inline_data);
-  fsp_msg.ctx = *ptr;
-  // NOTE: in the actual client/server model, the client allocates and
-  // deallocates slots. But here, we let the other fsproc workers send
-  // messages, so they alloc slots. And when we process it, we immediately
-  // deallocate it can be used again.
-  // FsProc workers will only send the message through the ring. They can
-  // check their ctx variables to figure out if a message succeeded.
-  shmipc_mgr_dealloc_slot(consumer, idx);
-  return true;
-}
+  size_t senderIdx(int src) const {
+    return (src >= 0 && size_t(src) < n_workers) ? size_t(src) : n_workers;
+  }
+  size_t scanRings(Inbox *inbox, FsProcMessage *msgs, size_t max);
+};
 
 // inline functions for FsProcMessenger
 inline bool FsProcMessenger::send_message(int wid, FsProcMessage &fsp_msg) {
+  return send_messages(wid, &fsp_msg, 1);
+}
+
+inline bool FsProcMessenger::send_messages(int wid, const FsProcMessage *msgs,
+                                           size_t n) {
   // TODO eventually we might dynamically create/destroy workers. We will need
   // to register workers with the messenger and check for existence.
-  return rings[wid]->put_message(fsp_msg);
+  if (tBatch != nullptr && tBatch->messenger_ == this) {
+    tBatch->staged_[wid].insert(tBatch->staged_[wid].end(), msgs, msgs + n);
+    return true;
+  }
+  return send_messages_from(FsProcTLS::GetWid(), wid, msgs, n);
 }
 
 inline bool FsProcMessenger::recv_message(int wid, FsProcMessage &fsp_msg) {
-  return rings[wid]->get_message(fsp_msg);
+  Inbox *inbox = inboxes[wid];
+  if (inbox->pendingHead == inbox->pendingTail) {
+    inbox->pendingHead = 0;
+    inbox->pendingTail = scanRings(inbox, inbox->pending, kMaxRecvBatch);
+    if (inbox->pendingTail == 0) return false;
+  }
+  fsp_msg = inbox->pending[inbox->pendingHead++];
+  return true;
+}
+
+inline size_t FsProcMessenger::recv_messages(int wid, FsProcMessage *msgs,
+                                             size_t max) {
+  Inbox *inbox = inboxes[wid];
+  size_t n = 0;
+  // the ones buffered by recv_message() go first
+  while (n < max && inbox->pendingHead < inbox->pendingTail)
+    msgs[n++] = inbox->pending[inbox->pendingHead++];
+  if (n < max) n += scanRings(inbox, msgs + n, max - n);
+  return n;
+}
+
+inline bool FsProcMessenger::has_pending(int wid) const {
+  const Inbox *inbox = inboxes[wid];
+  return inbox->pendingHead < inbox->pendingTail ||
+         inbox->doorbell.load() != inbox->seen;
+}
+
+inline size_t FsProcMessenger::scanRings(Inbox *inbox, FsProcMessage *msgs,
+                                         size_t max) {
+  uint64_t doorbell = inbox->doorbell.load(std::memory_order_acquire);
+  if (doorbell == inbox->seen) return 0;
+  size_t num_rings = inbox->rings.size();
+  size_t n = 0;
+  for (size_t i = 0; i < num_rings && n < max; i++) {
+    size_t idx = inbox->cursor + i;
+    if (idx >= num_rings) idx -= num_rings;
+    n += inbox->rings[idx]->get_messages(msgs + n, max - n);
+  }
+  if (++inbox->cursor == num_rings) inbox->cursor = 0;
+  // all the puts before this doorbell are drained unless we stopped at max
+  if (n < max) inbox->seen = doorbell;
+  return n;
 }
 
 inline bool FsProcMessenger::send_message_to_loadmonitor(
@@ -167,6 +260,4 @@ inline bool FsProcMessenger::send_message_to_loadmonitor(
   return send_message(kLmWid, fsp_msg);
 }
 
-// TODO batch_message and send_batch. Let recv_message stay the same. It would
-// receive a batch and iterate over that.
 #endif  // __fsproc_messenger_h
@@ -0,0 +1,52 @@
+#ifndef CFS_FS_PROC_NUMA_H
+#define CFS_FS_PROC_NUMA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// NUMA topology and memory placement. On a multi-socket server, a worker that
+// serves a cache hit out of memory on the other socket pays the interconnect
+// on every memcpy, so each worker's data partition, request pools and app
+// rings are placed on the node of the core it is pinned to.
+//
+// Only the kernel interface is used (sysfs and the mbind/get_mempolicy
+// syscalls), so there is no dependency on libnuma. On a single-node machine
+// every node is reported as unknown (-1), which turns all the placement off.
+namespace fsp_numa {
+
+// number of memory nodes; 1 if the topology is unknown
+int numNodes();
+
+// @return the node of `cpu`; -1 if unknown or there is only one node
+int nodeOfCpu(int cpu);
+
+// cpus of `node` in ascending order, one hyperthread per physical core
+std::vector<int> coresOfNode(int node);
+
+// @return the node of the page holding `addr`; -1 if unknown, there is only
+// one node, or the page has not been touched yet (it is not faulted in here)
+int nodeOfAddr(const void *addr);
+
+// Make [addr, addr + len) prefer the memory of `node` and migrate the pages
+// already touched. The range is shrunk to whole pages. Memory pinned for DMA
+// (e.g., SPDK hugepages) must not be passed: it cannot be migrated.
+// @return false if the kernel refuses it; nothing is done if node < 0
+bool bindToNode(void *addr, size_t len, int node);
+
+// Cores for `num` workers: one hyperthread per physical core, the ones of
+// `node` first and then the other nodes in order, so that the workers span as
+// few sockets as possible. The master (the first core) is on `node`.
+// @return empty if there are not enough physical cores
+std::vector<int> assignWorkerCores(int num, int node);
+
+// allocation counters of the kernel (/sys/devices/system/node/nodeN/numastat)
+struct NodeStat {
+  uint64_t localNode;  // pages allocated on `node` by a task running on it
+  uint64_t otherNode;  // pages allocated on `node` by a task on another node
+};
+bool readNodeStat(int node, NodeStat &stat);
+
+}  // namespace fsp_numa
+
+#endif
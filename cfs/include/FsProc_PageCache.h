@@ -9,6 +9,10 @@
 #include "tbb/concurrent_hash_map.h"
 #include "tbb/concurrent_queue.h"
 
+namespace sched {
+class Tenant;
+}
+
 class InodePageCache {
  public:
   InodePageCache() {}
@@ -22,20 +26,40 @@ class InodePageCache {
     }
     return -1;
   }
+  bool empty() const { return pageMap.empty(); }
+  // move all the global page idx out of this cache
+  void drain(std::vector<page_idx_t> &pages) {
+    pages.reserve(pages.size() + pageMap.size());
+    for (auto &kv : pageMap) pages.push_back(kv.second);
+    pageMap.clear();
+  }
 
  private:
   // <page within inode, global page idx>
   std::unordered_map<page_idx_t, page_idx_t> pageMap;
 };
 
+// Shared read cache: pages live in shm mapped read-only by every client (see
+// FsLibPageCache.h), so a client can serve repeated reads of a leased file
+// without IPC.
+// Pages are owned by the worker owning the inode; a page handed out to an app
+// is charged to that app's tenant on the worker, and therefore counts toward
+// its cache share (ResrcAlloc::cache_size) instead of coming for free.
 class PageCacheManager {
  public:
   PageCacheManager();
   ~PageCacheManager();
+  // @param owner: tenant charged for the pages; nullptr if not scheduled
+  // @return -1 if the cache is full or the owner is out of its cache share,
+  // in which case nothing is allocated
   int allocPageToIno(int numPg,
                      std::vector<std::pair<PageDescriptor *, void *>> &pages,
-                     cfs_ino_t ino);
+                     cfs_ino_t ino, sched::Tenant *owner = nullptr);
+  // Free pages and invalidate them for all the clients that have them cached
   void freePage(std::vector<page_idx_t> &pages);
+  // Inodes that hold pages charged to the tenant, each once
+  void getInodesChargedTo(const sched::Tenant *owner,
+                          std::vector<cfs_ino_t> &inos) const;
 
   PageDescriptor *findStablePage(page_idx_t pgid) {
     PageDescriptor *pdPtr = fromPageIdxToPd(layout, pgid);
@@ -52,6 +76,9 @@ class PageCacheManager {
   void *shmPtr = nullptr;
 
   tbb::concurrent_queue<page_idx_t> freePages;
+  // tenant charged for each page in use; indexed by global page idx and only
+  // touched by the worker owning the page
+  std::vector<sched::Tenant *> pageOwners;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef CFS_INCLUDE_FSPROC_PTRRING_H_
+#define CFS_INCLUDE_FSPROC_PTRRING_H_
+
+#include <cstdlib>
+#include <stdexcept>
+
+#include "util/util_buf_ring.h"
+
+// A bounded FIFO of pointers shared between FSP threads, built on util_ring
+// (the port of the DPDK ring library): producer and consumer indexes live in
+// their own cache lines, and a bulk enqueue/burst dequeue moves many entries
+// with one index update.
+// The consumer is always single; the producer is single unless created with
+// single_producer = false, in which case producers reserve space with a CAS.
+template <typename T>
+class FsProcPtrRing {
+ public:
+  // @param min_capacity: rounded up so that the ring holds >= min_capacity
+  FsProcPtrRing(const char *name, size_t min_capacity, bool single_producer)
+      : single_producer_(single_producer) {
+    // util_ring keeps one slot empty to tell full from empty
+    uint32_t count = 2;
+    while (count < min_capacity + 1) count <<= 1;
+    ssize_t mem_size = util_ring_get_memsize(count);
+    if (mem_size < 0) throw std::runtime_error("invalid ring size");
+    ring_ = static_cast<struct util_ring *>(
+        std::aligned_alloc(UTIL_CACHE_LINE_SIZE, mem_size));
+    if (ring_ == nullptr) throw std::runtime_error("failed to malloc ring");
+    unsigned flags = RING_F_SC_DEQ | (single_producer ? RING_F_SP_ENQ : 0);
+    if (util_ring_init(ring_, name, count, flags) != 0) {
+      std::free(ring_);
+      throw std::runtime_error("failed to init ring");
+    }
+  }
+  ~FsProcPtrRing() { std::free(ring_); }
+  FsProcPtrRing(const FsProcPtrRing &) = delete;
+  FsProcPtrRing &operator=(const FsProcPtrRing &) = delete;
+
+  // Enqueue all of the n entries or none of them.
+  bool put_bulk(T *const *objs, unsigned n) {
+    auto table = reinterpret_cast<void *const *>(objs);
+    if (single_producer_)
+      return util_ring_sp_enqueue_bulk(ring_, table, n, nullptr) == n;
+    return util_ring_mp_enqueue_bulk(ring_, table, n, nullptr) == n;
+  }
+
+  // Dequeue up to max entries.
+  // @return number of entries dequeued
+  unsigned get_burst(T **objs, unsigned max) {
+    return util_ring_sc_dequeue_burst(ring_, reinterpret_cast<void **>(objs),
+                                      max, nullptr);
+  }
+
+  bool try_enqueue(T *obj) { return put_bulk(&obj, 1); }
+  bool try_dequeue(T *&obj) { return get_burst(&obj, 1) == 1; }
+
+  size_t size_approx() const { return util_ring_count(ring_); }
+  size_t capacity() const { return util_ring_get_capacity(ring_); }
+
+ private:
+  bool single_producer_;
+  struct util_ring *ring_{nullptr};
+};
+
+#endif  // CFS_INCLUDE_FSPROC_PTRRING_H_
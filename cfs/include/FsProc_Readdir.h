@@ -0,0 +1,103 @@
+#ifndef CFS_INCLUDE_FSPROC_READDIR_H_
+#define CFS_INCLUDE_FSPROC_READDIR_H_
+
+#include <dirent.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "FsLibShared.h"
+#include "FsProc_FsInternal.h"
+
+// The steps of a CFS_OP_READDIR chunk (see FileMng::processOpendir) that do
+// not touch the buffers, so that they can be tested on their own.
+//
+// The cursor is the dentry slot of the directory to resume from. It is held
+// by the client, and FSP keeps no state for it, so a cursor never expires: it
+// can be reused at any time, and one past the end just returns no entry. A
+// dentry keeps its slot for its lifetime, so the entries of a listing are
+// never returned twice; the ones unlinked before the cursor reaches them are
+// skipped, and the ones created meanwhile are returned if their slot is after
+// the cursor.
+namespace fsp_readdir {
+
+constexpr uint64_t kDentriesPerBlock = BSIZE / sizeof(cfs_dirent);
+
+// Collect the dentries from slot `cursor` on, skipping the unlinked ones,
+// until `maxEntries` are found or `numSlots` are walked.
+//   - visitBlock(blockIdx, visit) -> 1 if the block is in memory, after
+//     calling visit(const cfs_dirent *block); 0 if it needs IO; -1 if the
+//     block is a hole
+// @param cursor: set to the slot after the last collected dentry
+// @return false if need IO, then cursor is left as is
+template <typename VisitBlockFn>
+bool collectDentries(uint64_t numSlots, uint64_t &cursor, uint32_t maxEntries,
+                     VisitBlockFn &&visitBlock,
+                     std::vector<cfs_dirent> &dentries) {
+  uint64_t slot = cursor;
+  dentries.clear();
+  while (slot < numSlots && dentries.size() < maxEntries) {
+    uint64_t i = slot / kDentriesPerBlock;
+    uint64_t blockEnd = std::min((i + 1) * kDentriesPerBlock, numSlots);
+    int rc = visitBlock(i, [&](const cfs_dirent *block) {
+      for (; slot < blockEnd && dentries.size() < maxEntries; slot++) {
+        const cfs_dirent *dentry = block + slot % kDentriesPerBlock;
+        if (dentry->inum > 0) dentries.emplace_back(*dentry);
+      }
+    });
+    if (rc == 0) return false;
+    // a hole holds no dentry
+    if (rc < 0) slot = blockEnd;
+  }
+  cursor = slot;
+  return true;
+}
+
+// Write the entries of a chunk into the data buffer of the request, as
+// readdirPlusEnt if `plus`, with no attributes yet.
+inline void packEntries(char *dst, const std::vector<cfs_dirent> &dentries,
+                        bool plus) {
+  for (size_t k = 0; k < dentries.size(); k++) {
+    struct readdirEnt *ent =
+        plus ? &(reinterpret_cast<readdirPlusEnt *>(dst) + k)->ent
+             : reinterpret_cast<readdirEnt *>(dst) + k;
+    ent->ino = dentries[k].inum;
+    ent->type = DT_UNKNOWN;
+    memcpy(ent->name, dentries[k].name, DIRSIZE);
+    ent->name[DIRSIZE - 1] = '\0';
+    if (plus) (reinterpret_cast<readdirPlusEnt *>(dst) + k)->hasAttrs = 0;
+  }
+}
+
+// Fill the attributes and types of the readdirplus entries whose inodes are
+// owned by this worker. The others are left without attributes: their owners
+// may hold a newer size, so the client asks them with a stat. All the inodes
+// are got before waiting, so that the missing ones are read together.
+//   - isOwned(ino) -> bool
+//   - getInode(ino) -> Inode *; nullptr if it is not in memory
+//   - hasPendingIo() -> bool, true if a getInode() started a read
+//   - fill(Inode *, readdirPlusEnt *): sets statbuf and ent.type
+// @return 1 if done, 0 if need IO, -1 if an owned inode does not exist
+template <typename Inode, typename OwnedFn, typename GetInodeFn,
+          typename PendingFn, typename FillFn>
+int fillAttrs(readdirPlusEnt *ents, int num, OwnedFn &&isOwned,
+              GetInodeFn &&getInode, PendingFn &&hasPendingIo, FillFn &&fill) {
+  std::vector<Inode *> inodes(num, nullptr);
+  for (int k = 0; k < num; k++)
+    if (isOwned(ents[k].ent.ino)) inodes[k] = getInode(ents[k].ent.ino);
+  if (hasPendingIo()) return 0;
+  for (int k = 0; k < num; k++) {
+    if (!isOwned(ents[k].ent.ino)) continue;
+    if (inodes[k] == nullptr) return -1;
+    memset(&ents[k].statbuf, 0, sizeof(struct stat));
+    fill(inodes[k], &ents[k]);
+    ents[k].hasAttrs = 1;
+  }
+  return 1;
+}
+
+}  // namespace fsp_readdir
+
+#endif  // CFS_INCLUDE_FSPROC_READDIR_H_
@@ -1,6 +1,8 @@
 #ifndef CFS_INCLUDE_FSPROC_TLS_H_
 #define CFS_INCLUDE_FSPROC_TLS_H_
 
+#include <pthread.h>
+
 #include <string>
 
 class FsProcWorkerMaster;
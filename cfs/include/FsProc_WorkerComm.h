@@ -2,12 +2,16 @@
 #ifndef CFS_INCLUDE_FSPROC_WORKERCOMM_H_
 #define CFS_INCLUDE_FSPROC_WORKERCOMM_H_
 
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
+#include "BlockBufferItem.h"
+#include "FsProc_PtrRing.h"
 #include "cfs_feature_macros.h"
-#include "readerwriterqueue.h"
 #include "spdlog/sinks/basic_file_sink.h"
-#include "BlockBufferItem.h"
 
 class FsProcWorker;
 class InMemInode;
@@ -184,13 +188,13 @@ class WorkerCommBridge {
  private:
   FsProcWorker *workers_[2]{nullptr, nullptr};
   int workerWids_[2]{0, 0};
-  typedef moodycamel::ReaderWriterQueue<WorkerCommMessage *>
-      unidirectional_msg_queue;
+  // single producer, single consumer
+  typedef FsProcPtrRing<WorkerCommMessage> unidirectional_msg_queue;
   unidirectional_msg_queue msgQueues_[2]{
       // workers_[0] uses this to send out - workers_[1] uses this to recv
-      unidirectional_msg_queue{kMaxInflightMsgNum},
+      {"wk_comm_l2r", kMaxInflightMsgNum, true},
       // workers_[1] uses this to send out - workers_[0] uses this to recv
-      unidirectional_msg_queue{kMaxInflightMsgNum}};
+      {"wk_comm_r2l", kMaxInflightMsgNum, true}};
   std::unordered_set<WorkerCommMessage *> waitForReplyMsg_[2];
 
   int getWorkerIdx(FsProcWorker *worker) {
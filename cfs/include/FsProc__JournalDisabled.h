@@ -34,6 +34,7 @@ class InodeLogEntry {
   void set_nlink(uint8_t nlink) {}
   void update_extent(struct cfs_extent *extent, bool add_or_del,
                      bool bmap_modified) {}
+  void set_ext_root(const struct cfs_dinode *dinode) {}
   void add_dependency(uint64_t inode, uint64_t syncID) {}
   bool empty() { return true; }
 };
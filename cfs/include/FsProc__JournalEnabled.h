@@ -116,6 +116,11 @@ class InodeLogEntry {
   void set_nlink(uint8_t nlink);
   void update_extent(struct cfs_extent *extent, bool add_or_del,
                      bool bmap_modified);
+  // Log the root of an inode's extent tree (see cfs_extent_header) as a whole.
+  // Then the extents in ext_add/ext_del only tell which allocation units have
+  // their bitmap bits set/cleared; the index nodes are written back like data
+  // blocks before the journal entry.
+  void set_ext_root(const struct cfs_dinode *dinode);
   void add_dependency(uint64_t inode, uint64_t syncID);
   std::string as_json_str();
   bool empty();
@@ -142,6 +147,8 @@ class InodeLogEntry {
   struct timeval atime;
   struct timeval mtime;
   struct timeval ctime;
+  struct cfs_extent_header ext_header;
+  struct cfs_extent ext_root[NEXTENT_ARR];
 
   // extent_seq_no is used to keep track of ordering between additions and
   // deletion of extents. It is incremented anytime we add to ext_add or
@@ -257,6 +264,7 @@ class JournalManager {
   void submitJournalEntry(JournalEntry *je, JournalCallbackFn cb, void *cb_arg);
   void processJournalEntry(JournalEntry *je);
   static void writeComplete(void *arg, const struct spdk_nvme_cpl *completion);
+  static void ioComplete(void *arg, bool ok);
   static void checkpointWriteComplete(void *arg,
                                       const struct spdk_nvme_cpl *completion);
   // Starts a new transaction if queue not empty and nothing in progress.
@@ -288,6 +296,13 @@ class JournalManager {
   uint64_t QueryNumNvmeWriteDone() { return n_num_nvme_write_done_; }
   void ResetNumNvmeWriteDone() { n_num_nvme_write_done_ = 0; }
 
+  // last_chkpt_ts of the jsuper in use
+  uint64_t GetLastCheckpoint() const;
+  // last_chkpt_ts of the jsuper at `jsuper_blockno` on the device, before any
+  // JournalManager reads it; 0 if it is not a jsuper
+  static uint64_t BlockingReadLastCheckpoint(CurBlkDev *dev,
+                                             uint64_t jsuper_blockno);
+
  private:
   JSuper *jsuper;
   char *pinnedMemJournalSuper;
@@ -387,6 +402,7 @@ class JournalManager {
 #define bitmap_op_IDX 0x100
 #define dentry_count_IDX 0x200
 #define nlink_IDX 0x400
+#define ext_root_IDX 0x800
 
 #define DEFINE_SIMPLE_SETTER(field, dtype)          \
   inline void InodeLogEntry::set_##field(dtype v) { \
@@ -436,6 +452,12 @@ inline void InodeLogEntry::update_extent(struct cfs_extent *extent,
   val.bmap_modified |= bmap_modified;
 }
 
+inline void InodeLogEntry::set_ext_root(const struct cfs_dinode *dinode) {
+  ext_header = dinode->ext_header;
+  memcpy(ext_root, dinode->ext_array, sizeof(ext_root));
+  optfield_bitarr |= ext_root_IDX;
+}
+
 inline void InodeLogEntry::add_dependency(uint64_t inode, uint64_t syncID) {
   // TODO how to wait on same inode but different syncID?
   // Try to prove that we won't ever have a deadlock while waiting.
@@ -454,6 +476,9 @@ inline size_t InodeLogEntry::calcSize(void) {
   // (size, n_ext_add, n_ext_del, n_depends_on) = 8 * 4
   size_t dsize =
       (8 * 3) + (4 * 6) + (sizeof(struct timeval) * 3) + 2 + 1 + (8 * 4);
+  // (ext_header, ext_root) only if present
+  if (optfield_bitarr & ext_root_IDX)
+    dsize += sizeof(ext_header) + sizeof(ext_root);
 
   // each element in ext_{add,del} takes 8 bytes for key, ExtMapVal for val
   // key: uint64_t, value: struct ExtMapVal
@@ -36,6 +36,9 @@ int fs_init(key_t key);
 int fs_init_multi(int num_key, const key_t *keys);
 // Init one thread's local variables
 // including tid, and data-shm
+// Also makes this thread use its own request ring to each worker (created on
+// the first request to that worker) instead of the app's shared ring; set env
+// CFS_LIB_THREAD_RING=0 to disable.
 void fs_init_thread_local_mem();
 
 // reset this FsLib from server shm
@@ -62,11 +65,24 @@ int fs_dumpinodes(int wid);
 ////////////////////////////////////////////////////////////////////////////////
 // POSIX API
 
+// A directory stream. The entries are fetched from FSP in chunks of up to
+// FS_READDIR_CHUNK, each resuming at the dentry slot where the last one
+// stopped, so a directory of n entries takes n / FS_READDIR_CHUNK requests.
+// FSP keeps no state for the stream: the cursor never expires, and the stream
+// can be left open for any time (see FsProc_Readdir.h for what it returns if
+// the directory changes meanwhile).
 struct CFS_DIR {
-  // number of dentry that has valid value (ino != 0)
+  // number of entries of the current chunk
   int dentryNum;
   int dentryIdx;
   struct dirent *firstDentry;
+  // attributes of the entries of the current chunk (fs_opendirplus), or NULL
+  struct stat *firstStat;
+  // dentry slot of the dir the next chunk starts from
+  uint64_t cursor;
+  // the current chunk is the last one
+  int eof;
+  char *name;
 };
 
 // ~= stat()
@@ -89,8 +105,22 @@ int fs_mkdir(const char *pathname, mode_t mode);
 // ~= opendir()
 struct CFS_DIR *fs_opendir(const char *name);
 // ~= readdir()
+// d_type is DT_UNKNOWN: the dentries do not record the type
 struct dirent *fs_readdir(struct CFS_DIR *dirp);
 int fs_closedir(struct CFS_DIR *dirp);
+// readdirplus: opendir() whose chunks carry the attributes of the entries,
+// which FSP gets in one pass per chunk; the entries whose inodes another
+// worker owns are stat()-ed by the client
+struct CFS_DIR *fs_opendirplus(const char *name);
+// ~= readdir() + stat() of the entry; dirp must come from fs_opendirplus()
+struct dirent *fs_readdirplus(struct CFS_DIR *dirp, struct stat *statbuf);
+// Read up to count (capped to FS_READDIR_CHUNK) entries of directory name in
+// one request, from *cursor on (0 for the first call). With stats != NULL,
+// stats[i] gets the attributes of dents[i] (readdirplus).
+// @return the number of entries, fewer than count at the end of the dir, or
+//   < 0 on error; *cursor is advanced past the returned entries
+int fs_readdir_chunk(const char *name, uint64_t *cursor, struct dirent *dents,
+                     struct stat *stats, int count);
 // ~= rmdir() , according to man page, must be empty directory
 int fs_rmdir(const char *pathname);
 // ~= rename()
@@ -157,7 +187,11 @@ ssize_t fs_cached_pread(int fd, void **bufAddr, size_t count, off_t offset);
 // Basically fs_cached_pread() + one copy
 ssize_t fs_cached_posix_pread(int fd, void *buf, size_t count, off_t offset);
 
-// Support a unified page cache (for read-only w/ lease)
+// Read through the shared client cache (requires CFS_CLIENT_PAGE_CACHE)
+// Pages fetched by FSP are leased to the app and mapped into it, so repeated
+// reads of them are served without IPC; a write to the file invalidates them
+// at once. The pages count toward the app's cache share; when it is used up,
+// or the request is too large, this falls back to fs_pread().
 ssize_t fs_uc_read(int fd, void *buf, size_t count);
 ssize_t fs_uc_pread(int fd, void *buf, size_t count, off_t offset);
 
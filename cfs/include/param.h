@@ -58,6 +58,8 @@ static_assert((NINODES) <= (IMAPBLOCK_NUM) * (BSIZE * 8));
 // FsLibShared.h
 //
 #define RING_SIZE 512
+// per app thread request ring (one producer), see CFS_OP_THREAD_RING
+#define THREAD_RING_SIZE 64
 // This is adjusted for opendir(), make it larger enough to read all the
 // dentreis at one time
 //#define RING_DATA_ITEM_SIZE (524288UL)  // each OP can R/W 512K data
@@ -91,9 +93,9 @@ static_assert((NINODES) <= (IMAPBLOCK_NUM) * (BSIZE * 8));
 // max number of client processes supported
 #define NMAX_APP_PROC (40)
 
-// maximum number of messages (from other workers) each worker can have in its
-// queue
-#define DEFAULT_MESSENGER_BUFSIZE (4096)
+// maximum number of messages from one worker (or from all the non-worker
+// threads) each worker can have in its queue
+#define DEFAULT_MESSENGER_BUFSIZE (1024)
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -112,9 +114,16 @@ static_assert((NINODES) <= (IMAPBLOCK_NUM) * (BSIZE * 8));
 
 // max number of width in single directory
 #define FS_DIR_MAX_WIDTH 50000
+// max number of dentries returned by one readdir request; a chunk of
+// readdirplus entries fits in a 48K shm block
+#define FS_READDIR_CHUNK 256
 
 // block device (by default, do not use SPDK)
 #define SPDK_THREAD_MAX_INFLIGHT 600
+// adaptive in-flight limit of each worker (see QueueDepthController)
+#define DEV_QD_TARGET_LATENCY_US 500
+#define DEV_QD_INTERVAL_US 10000
+#define DEV_QD_MIN_INFLIGHT 8
 
 // FsProc.[cc/h]
 #define ESTIMATE_BLOCK_WAIT_NUM 4
@@ -85,6 +85,9 @@ struct shmipc_mgr {
   size_t capacity;
   size_t mask;
   off_t next;
+  // set by the client if only one thread ever allocates slots from this
+  // ring, so that alloc_slot can bump next without an atomic op
+  int single_producer;
 };
 
 struct shmipc_mgr *shmipc_mgr_init(const char *name, size_t rsize, int create);
@@ -109,6 +112,8 @@ struct shmipc_msg *shmipc_mgr_get_msg_nowait(struct shmipc_mgr *mgr,
                                              off_t *idx);
 
 // All *put* functions first need to alloc a slot and later dealloc.
+// Slots are handed out in ring order; if the slot is still in use, this waits
+// until it is deallocated.
 off_t shmipc_mgr_alloc_slot(struct shmipc_mgr *mgr);
 // TODO in debug mode, measure how much time slots are held...
 void shmipc_mgr_dealloc_slot(struct shmipc_mgr *mgr, off_t ring_idx);
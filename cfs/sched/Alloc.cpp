@@ -2,17 +2,157 @@
 
 #include <cmath>
 #include <cstddef>
+#include <numeric>
 #include <stdexcept>
 
-#include "FsProc_Fs.h"
-#include "FsProc_Messenger.h"
+#include "AllocEnv.h"
 #include "Log.h"
+#include "Metrics.h"
 #include "Param.h"
 #include "Resrc.h"
 #include "View.h"
+#include "perfutil/Cycles.h"
+#include "spdlog/fmt/bundled/ranges.h"
 
 namespace sched {
 
+void Allocator::update_total_bandwidth() {
+  // the bandwidth given at cmdline is for all the devices together
+  const int num_devs = env->get_num_devs();
+  dev_bandwidth.assign(num_devs, cfg_bandwidth / num_devs);
+  int64_t bandwidth = 0;
+  for (int dev = 0; dev < num_devs; ++dev) {
+    if (params::policy::dev_capacity_cap) {
+      int64_t capacity = env->get_dev_capacity(dev);
+      if (capacity > 0)
+        dev_bandwidth[dev] = std::min(dev_bandwidth[dev], capacity);
+    }
+    bandwidth += dev_bandwidth[dev];
+  }
+  if (bandwidth == total_resrc.bandwidth) return;
+  SCHED_LOG_NOTICE("Allocator: Total bandwidth %ld MB/s -> %ld MB/s",
+                   params::blocks_to_mb_int(total_resrc.bandwidth),
+                   params::blocks_to_mb_int(bandwidth));
+  total_resrc.bandwidth = bandwidth;
+  base_resrc = total_resrc / views.size();
+}
+
+int64_t Allocator::get_fair_bandwidth(
+    const AppResrcView& v, const std::vector<int64_t>& dev_bw) const {
+  const auto& shares = v.get_dev_shares();
+  int64_t bandwidth = std::numeric_limits<int64_t>::max();
+  for (size_t dev = 0; dev < shares.size(); ++dev) {
+    if (shares[dev] <= 0) continue;
+    int64_t dev_fair = dev_bw[dev] / int64_t(views.size());
+    bandwidth = std::min(bandwidth, int64_t(dev_fair / shares[dev]));
+  }
+  return bandwidth;
+}
+
+void Allocator::add_dev_load(const AppResrcView& v, int64_t bandwidth,
+                             std::vector<int64_t>& dev_avail) {
+  // round the load up and the release down, so a device is never overdrawn
+  const auto& shares = v.get_dev_shares();
+  for (size_t dev = 0; dev < shares.size(); ++dev)
+    dev_avail[dev] -= int64_t(std::ceil(bandwidth * shares[dev]));
+}
+
+std::vector<double> Allocator::get_dev_prices(
+    const std::vector<int64_t>& dev_avail) const {
+  std::vector<double> prices(dev_avail.size(), 1);
+  double max_util = 0;
+  for (size_t dev = 0; dev < dev_avail.size(); ++dev) {
+    prices[dev] = dev_bandwidth[dev] > 0
+                      ? 1 - double(dev_avail[dev]) / dev_bandwidth[dev]
+                      : 1;
+    max_util = std::max(max_util, prices[dev]);
+  }
+  // no device is used at all: they are all the same
+  if (max_util <= 0) return std::vector<double>(dev_avail.size(), 1);
+  for (auto& p : prices) p /= max_util;
+  return prices;
+}
+
+std::vector<double> Allocator::get_improve_ratios(
+    const std::vector<int64_t>& dev_avail) const {
+  const size_t num_devs = dev_avail.size();
+  std::vector<double> ratios(views.size(), 0);
+  std::vector<double> dev_left(dev_avail.begin(), dev_avail.end());
+  std::vector<bool> growing(views.size());
+  for (size_t i = 0; i < views.size(); ++i)
+    growing[i] = views[i].get_resrc().bandwidth > 0;
+
+  // each round stops the apps on one more device, so it takes at most
+  // min(#apps, #devices) rounds
+  while (true) {
+    std::vector<double> load(num_devs, 0);  // of the growing apps
+    for (size_t i = 0; i < views.size(); ++i) {
+      if (!growing[i]) continue;
+      const auto& shares = views[i].get_dev_shares();
+      for (size_t dev = 0; dev < num_devs; ++dev)
+        load[dev] += views[i].get_resrc().bandwidth * shares[dev];
+    }
+    int bottleneck = -1;
+    double ratio = 0;
+    for (size_t dev = 0; dev < num_devs; ++dev) {
+      if (load[dev] <= 0) continue;
+      double r = std::max(dev_left[dev], 0.0) / load[dev];
+      if (bottleneck < 0 || r < ratio) {
+        bottleneck = dev;
+        ratio = r;
+      }
+    }
+    if (bottleneck < 0) break;
+    for (size_t dev = 0; dev < num_devs; ++dev)
+      dev_left[dev] -= ratio * load[dev];
+    for (size_t i = 0; i < views.size(); ++i) {
+      if (!growing[i]) continue;
+      ratios[i] += ratio;
+      if (views[i].get_dev_shares()[bottleneck] > 0) growing[i] = false;
+    }
+  }
+  return ratios;
+}
+
+void Allocator::update_active_workers(int64_t& cpu_avail) {
+  if (!params::policy::elastic_workers) return;
+  if (params::policy::symm_partition) {
+    SCHED_LOG_WARNING(
+        "Elastic workers need asymmetric partition; all workers stay active");
+    return;
+  }
+  const int num_workers = env->get_num_workers();
+  auto total_cpu_of = [&](int n) { return cfg_cpu_cycles * n / num_workers; };
+
+  // the fewest workers serving the demand with some headroom
+  const int64_t cpu_demand = total_resrc.cpu_cycles - cpu_avail;
+  int target = 1;
+  while (target < num_workers &&
+         cpu_demand * (1 + params::elastic::headroom) > total_cpu_of(target))
+    ++target;
+
+  if (target < num_active_workers) {
+    if (++num_surplus_rounds < params::elastic::park_patience) return;
+  } else if (target == num_active_workers) {
+    num_surplus_rounds = 0;
+    return;
+  }
+  num_surplus_rounds = 0;
+
+  SCHED_LOG_NOTICE("Allocator: CPU demand=%ld; active workers %d -> %d",
+                   cpu_demand, num_active_workers, target);
+  for (int wid = std::min(target, num_active_workers);
+       wid < std::max(target, num_active_workers); ++wid)
+    env->set_worker_parked(wid, /*parked*/ wid >= target);
+  num_active_workers = target;
+
+  int64_t total_cpu = total_cpu_of(target);
+  cpu_avail += total_cpu - total_resrc.cpu_cycles;
+  assert(cpu_avail >= 0);
+  total_resrc.cpu_cycles = total_cpu;
+  base_resrc = total_resrc / views.size();
+}
+
 void Allocator::do_apply() {
   for (auto& view : views) view.reset_pending_weights();
 
@@ -36,8 +176,8 @@ void Allocator::do_apply() {
 }
 
 void Allocator::do_symm_partition() {
-  int num_workers = fs_proc->getNumThreads();
-  assert(int(views.size()) == fs_proc->getNumApps());
+  int num_workers = env->get_num_workers();
+  assert(int(views.size()) == env->get_num_apps());
 
   uint32_t per_worker_avail_weight = params::worker_avail_weight;
 
@@ -69,8 +209,9 @@ void Allocator::do_symm_partition() {
 }
 
 void Allocator::do_asymm_partition_naive() {
-  int num_workers = fs_proc->getNumThreads();
-  assert(int(views.size()) == fs_proc->getNumApps());
+  // parked workers get no weight, so do_apply_to_app moves their files away
+  int num_workers = num_active_workers;
+  assert(int(views.size()) == env->get_num_apps());
 
   std::vector<uint32_t> workers_avail_weight;
   workers_avail_weight.reserve(num_workers);
@@ -107,8 +248,11 @@ void Allocator::do_asymm_partition_naive() {
         weights_distr_list.emplace_back(wid, old_weights[wid]);
     }
     std::sort(weights_distr_list.begin(), weights_distr_list.end(),
-              [](const std::pair<int, uint32_t>& lhs,
-                 const std::pair<int, uint32_t>& rhs) {
+              [&](const std::pair<int, uint32_t>& lhs,
+                  const std::pair<int, uint32_t>& rhs) {
+                bool lhs_near = is_near(view.aid, lhs.first);
+                bool rhs_near = is_near(view.aid, rhs.first);
+                if (lhs_near != rhs_near) return lhs_near;
                 if (lhs.second != rhs.second) return lhs.second > rhs.second;
                 return lhs.first < rhs.first;
               });
@@ -127,8 +271,8 @@ void Allocator::do_asymm_partition_naive() {
 }
 
 void Allocator::do_asymm_partition_avoid_tiny() {
-  int num_workers = fs_proc->getNumThreads();
-  assert(int(views.size()) == fs_proc->getNumApps());
+  int num_workers = num_active_workers;
+  assert(int(views.size()) == env->get_num_apps());
 
   // <wid, weight>
   std::vector<int> avail_dedi_workers;  // wid list
@@ -145,6 +289,9 @@ void Allocator::do_asymm_partition_avoid_tiny() {
     // will pop from back, so put preferred one at the end
     std::sort(avail_dedi_workers.begin(), avail_dedi_workers.end(),
               [&](const int& lhs, const int& rhs) -> bool {
+                bool lhs_near = is_near(view.aid, lhs);
+                bool rhs_near = is_near(view.aid, rhs);
+                if (lhs_near != rhs_near) return rhs_near;
                 return old_weights[lhs] != old_weights[rhs]
                            ? old_weights[lhs] < old_weights[rhs]
                            : lhs > rhs;
@@ -196,7 +343,10 @@ void Allocator::do_asymm_partition_avoid_tiny() {
     std::sort(curr_avail_list.begin(), curr_avail_list.end(),
               [&](const std::pair<int, uint32_t>& lhs,
                   const std::pair<int, uint32_t>& rhs) -> bool {
-                if (lhs.second > rhs.second) return true;
+                if (lhs.second != rhs.second) return lhs.second > rhs.second;
+                bool lhs_near = is_near(view.aid, lhs.first);
+                bool rhs_near = is_near(view.aid, rhs.first);
+                if (lhs_near != rhs_near) return lhs_near;
                 return lhs.first < rhs.first;
               });
 
@@ -211,19 +361,21 @@ void Allocator::do_asymm_partition_avoid_tiny() {
   }
 }
 
+bool Allocator::is_near(int aid, int wid) const {
+  if (!params::policy::numa_affinity) return false;
+  int node = env->get_app_node(aid);
+  return node >= 0 && node == env->get_worker_node(wid);
+}
+
 void Allocator::do_apply_to_app(AppResrcView& view) {
   assert(view.get_pending_weight_unalloc() == 0);
-  int num_workers = fs_proc->getNumThreads();
+  int num_workers = env->get_num_workers();
   SCHED_LOG_NOTICE("=== Resource Distribution of App-%d ===", view.aid);
 
-  std::vector<Tenant*> tenants = view.get_tenants();
+  const auto& tenants = view.get_tenants();
   std::vector<int> nfiles_curr(num_workers);  // wid -> num_files
-  for (auto& tenant : tenants) {
-    auto app = tenant->get_app();
-    auto wid = app->getWorker()->getWid();
-    int n = app->GetInos().size();
-    nfiles_curr[wid] = n;
-  }
+  for (auto tenant : tenants)
+    nfiles_curr[tenant->get_wid()] = tenant->get_num_files();
 
   auto& weights = view.get_pending_weights();
 
@@ -272,7 +424,8 @@ void Allocator::do_apply_to_app(AppResrcView& view) {
     // First compute the source and destination workers
     std::vector<std::tuple<int, int>> src_apps;  // (wid, num_files)
     std::vector<std::tuple<int, int>> dst_apps;  // (wid, num_files)
-    int num_files_left = total_num_files;
+    // every worker must be visited: when files are consolidated onto the
+    // first workers, the sources are the ones after them
     for (int wid = 0; wid < num_workers; ++wid) {
       int curr_n = nfiles_curr[wid];
       int next_n = nfiles_next[wid];
@@ -281,10 +434,6 @@ void Allocator::do_apply_to_app(AppResrcView& view) {
       } else if (curr_n < next_n) {
         dst_apps.emplace_back(wid, next_n - curr_n);
       }
-      num_files_left -= next_n;
-      if (num_files_left <= 0) {
-        break;
-      }
     }
 
     // Then compute the inode movement
@@ -316,8 +465,6 @@ void Allocator::do_apply_to_app(AppResrcView& view) {
 
   auto app_total_resrc = view.get_resrc();
   for (int wid = 0; wid < num_workers; ++wid) {
-    FsProcMessage msg;
-    msg.type = FsProcMessageType::kSCHED_NewResrcAlloc;
     auto decision = new AllocDecision{
         .aid = view.aid,
         .inode_move = std::move(inode_move[wid]),
@@ -330,15 +477,34 @@ void Allocator::do_apply_to_app(AppResrcView& view) {
                           total_num_files)),
             .cpu_cycles =
                 static_cast<int64_t>(params::weight_to_cycles(weights[wid])),
-        }};
+        },
+        .dev_shares = view.get_dev_shares()};
 
     SCHED_LOG_NOTICE("App-%d on Worker-%d: cache=%d, bw=%ld, cpu=%ld", view.aid,
                      wid, decision->resrc.cache_size, decision->resrc.bandwidth,
                      decision->resrc.cpu_cycles);
-    msg.ctx = decision;
-    fs_proc->messenger->send_message(wid, msg);
+    env->apply(wid, decision);
   }
   view.set_weights(weights);
 }
 
+void Allocator::do_export_metrics(const std::vector<bool>& views_active) {
+  auto page = metrics::get_page();
+  if (page == nullptr) return;
+  assert(views_active.size() == views.size());
+  uint64_t now = PlatformLab::PerfUtils::Cycles::rdtsc();
+  for (size_t i = 0; i < views.size(); ++i) {
+    auto& view = views[i];
+    if (view.aid >= metrics::max_apps) continue;
+    metrics::AppStat s{};
+    s.update_ts = now;
+    s.aid = view.aid;
+    s.is_active = views_active[i];
+    s.alloc_round = alloc_round;
+    s.resrc = view.get_resrc();
+    s.numa_node = env->get_app_node(view.aid);
+    page->apps[view.aid].store(s);
+  }
+}
+
 }  // namespace sched
@@ -4,40 +4,91 @@
 #include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <thread>
 
+#include "AllocEnv.h"
+#include "IndexedHeap.h"
 #include "Log.h"
 #include "Param.h"
 #include "Resrc.h"
-#include "Tenant.h"
 #include "View.h"
 
-class FsProc;
-
 namespace sched {
 
 class Allocator {
-  FsProc* fs_proc;
+  std::unique_ptr<AllocEnv> env;
   ResrcAlloc total_resrc;
   ResrcAlloc base_resrc;
+  // total bandwidth given at cmdline; total_resrc.bandwidth may be lower if
+  // the device cannot deliver it
+  int64_t cfg_bandwidth{0};
+  // bandwidth of each device (striped, see BlkDevStripe.h); sums up to
+  // total_resrc.bandwidth
+  std::vector<int64_t> dev_bandwidth;
+  // total CPU given at cmdline; with policy::elastic_workers,
+  // total_resrc.cpu_cycles only counts the active workers
+  int64_t cfg_cpu_cycles{0};
+  // workers [0, num_active_workers) are active; the rest are parked
+  int num_active_workers;
+  // consecutive allocations where fewer workers would do
+  uint32_t num_surplus_rounds{0};
   std::vector<AppResrcView> views;
+  uint64_t alloc_round{0};
+  // the caches have been restored from a warm-restart snapshot (see
+  // Snapshot.h), so the first allocation needs no preheat
+  bool warm_started{false};
 
  public:
-  explicit Allocator(FsProc* fs_proc) : fs_proc(fs_proc) {}
+  explicit Allocator(std::unique_ptr<AllocEnv> env)
+      : env(std::move(env)),
+        num_active_workers(this->env->get_num_workers()) {}
 
   AppResrcView& append_view(int aid) {
     // currently require ordered by aid
     assert(size_t(aid) == views.size());
-    views.emplace_back(aid);
+    views.emplace_back(aid, env->get_num_devs());
     return views.back();
   }
   void add_total_resrc(ResrcAlloc r) {
     total_resrc += r;
+    cfg_bandwidth = total_resrc.bandwidth;
+    cfg_cpu_cycles = total_resrc.cpu_cycles;
     base_resrc = total_resrc / views.size();
   }
 
+  void set_warm_started() { warm_started = true; }
+
   [[noreturn]] static void run(Allocator* allocator);
 
+  // take a snapshot of every app's stat as the baseline of the next window
+  void reset_stat() {
+    for (auto& v : views) v.reset_stat();
+  }
+
+  /**
+   * @brief Poll the stat of the window since `reset_stat` and allocate if every
+   * app made progress in it. `run` calls it every `alloc::freq_us`; the offline
+   * simulator (AllocSim.h) calls it directly.
+   *
+   * @param views_active Filled with whether each app made progress.
+   * @return bool Whether all apps are active.
+   */
+  bool poll_and_alloc(std::vector<bool>& views_active);
+
+  const std::vector<AppResrcView>& get_views() const { return views; }
+  ResrcAlloc get_total_resrc() const { return total_resrc; }
+  int get_num_active_workers() const { return num_active_workers; }
+
+  /**
+   * @brief Publish each app's allocation to the metrics page (if any).
+   *
+   * @param views_active Whether each app made progress in the last window.
+   */
+  void do_export_metrics(const std::vector<bool>& views_active);
+
  private:
   /**
    * @brief Do allocation. Note that our primary goal is to maximize the minimum
@@ -48,21 +99,74 @@ class Allocator {
   void do_alloc();
 
   /**
-   * @brief Harvest bandwidth by relocating cache.
+   * @brief Cap the total bandwidth by the measured device capacity
+   * (policy::dev_capacity_cap).
+   */
+  void update_total_bandwidth();
+
+  /**
+   * @brief The bandwidth an app gets from an equal share of each device in
+   * `dev_bw`: its device shares split it over the devices, so the device it
+   * loads the most relative to its share limits it.
+   */
+  int64_t get_fair_bandwidth(const AppResrcView& v,
+                             const std::vector<int64_t>& dev_bw) const;
+
+  /**
+   * @brief Take `bandwidth` of app `v` (may be negative to give it back) from
+   * each device in `dev_avail` by its device shares.
+   */
+  static void add_dev_load(const AppResrcView& v, int64_t bandwidth,
+                           std::vector<int64_t>& dev_avail);
+
+  /**
+   * @brief Price of the bandwidth of each device: its utilization relative to
+   * the most utilized one. Bandwidth on a device with slack is worth less than
+   * on the bottleneck. With one device, the price is 1.
+   */
+  std::vector<double> get_dev_prices(
+      const std::vector<int64_t>& dev_avail) const;
+
+  /**
+   * @brief Improvement of each app when all the apps grow their bandwidth by
+   * the same ratio until some device runs out; the apps on that device stop
+   * and the others keep growing into the rest (progressive filling). With one
+   * device, every app improves by bw_avail / bw_sum.
+   */
+  std::vector<double> get_improve_ratios(
+      const std::vector<int64_t>& dev_avail) const;
+
+  /**
+   * @brief Resize the set of active workers to the CPU demand left after
+   * `collect_idle` (policy::elastic_workers): park workers once the demand has
+   * stayed low for params::elastic::park_patience allocations; unpark them as
+   * soon as it grows. The CPU of the parked workers is taken out of the total.
    *
+   * @param cpu_avail CPU collected as idle; updated by the change of total.
+   */
+  void update_active_workers(int64_t& cpu_avail);
+
+  /**
+   * @brief Harvest bandwidth by relocating cache: repeatedly trade cache from
+   * the app asking the least bandwidth for it to the app releasing the most.
+   * Each trade costs O(log #apps). With several devices, the offers are
+   * weighed by the price of the devices they go to (see get_dev_prices), and a
+   * trade that would take more of a device than it has left stops the harvest.
+   *
+   * @param dev_avail Bandwidth left on each device; updated by the trades.
    * @return int64_t How much bandwidth is harvested.
    */
-  int64_t do_harvest();
+  int64_t do_harvest(std::vector<int64_t>& dev_avail);
 
   /**
    * @brief Distribute the available CPU and bandwidth.
    *
    * @param cpu_avail CPU to distribute.
-   * @param bw_avail Bandwidth to distribute; must be zero after return.
-   * consumed.
+   * @param dev_avail Bandwidth to distribute on each device; with one device,
+   * all of it is consumed.
    * @return int64_t How many CPU cycles is left undistributed.
    */
-  int64_t do_distribute(int64_t cpu_avail, int64_t bw_avail);
+  int64_t do_distribute(int64_t cpu_avail, std::vector<int64_t>& dev_avail);
 
   /**
    * @brief Apply the allocation result to the system.
@@ -75,13 +179,11 @@ class Allocator {
 
   void do_asymm_partition_avoid_tiny();  // policy::avoid_tiny_weight = true
 
-  void do_apply_to_app(AppResrcView& view);
-};
+  // whether worker `wid` is on the NUMA node of app `aid`; the asymmetric
+  // partitions place an app's weight on such workers first
+  bool is_near(int aid, int wid) const;
 
-struct AllocDecision {
-  int aid;
-  std::vector<std::tuple<int, int>> inode_move;  // dst_wid, num_files
-  ResrcAlloc resrc;
+  void do_apply_to_app(AppResrcView& view);
 };
 
 [[noreturn]] inline void Allocator::run(Allocator* allocator) {
@@ -99,8 +201,9 @@ struct AllocDecision {
     if (are_all_active) {
       // we wait for a relatively long time before start because the app needs
       // time to populate its cache.
-      std::this_thread::sleep_for(
-          std::chrono::microseconds(params::alloc::preheat_window_us));
+      if (!allocator->warm_started)
+        std::this_thread::sleep_for(
+            std::chrono::microseconds(params::alloc::preheat_window_us));
       break;  // some apps start to make progress
     } else {
       std::this_thread::sleep_for(std::chrono::microseconds(1000));  // spin
@@ -108,30 +211,12 @@ struct AllocDecision {
   }
 
   while (true) {
-    for (auto& v : allocator->views) v.reset_stat();
+    allocator->reset_stat();
     std::this_thread::sleep_for(
         std::chrono::microseconds(params::alloc::stat_coll_window_us));
 
-    // we assume all apps must be active and trying to fully utilize the
-    // resources; we don't have a very well support for a client that is not
-    // active. if we detect a client does not make any progress, we assume the
-    // system is not ready or in a unstable state, so we don't do allocation in
-    // this case.
-    are_all_active = true;
-    for (auto& v : allocator->views) {
-      bool is_active = v.poll_stat();
-      if (!is_active) {
-        SPDLOG_INFO("App {} is inactive", v.aid);
-        SCHED_LOG_NOTICE("App %d is inactive", v.aid);
-      }
-      are_all_active &= is_active;
-    }
-    if (are_all_active) {
-      // // dump ghost cache hit rates
-      // for (auto& v : allocator->views) v.print();
-
-      if (sched::params::policy::alloc_enabled) allocator->do_alloc();
-
+    std::vector<bool> views_active;
+    if (allocator->poll_and_alloc(views_active)) {
       if constexpr (params::alloc::unlimited_bandwidth_window_us > 0) {
         // to speedup convergence, we allow tenants to use more bandwidth then
         // allocated to update their cache to a steady state
@@ -151,17 +236,53 @@ struct AllocDecision {
       std::this_thread::sleep_for(std::chrono::microseconds(
           params::alloc::unlimited_bandwidth_window_us));  // sleep too...
     }
+    allocator->do_export_metrics(views_active);
 
     std::this_thread::sleep_for(
         std::chrono::microseconds(params::alloc::stabilize_window_us));
   }
 }
 
+inline bool Allocator::poll_and_alloc(std::vector<bool>& views_active) {
+  // we assume all apps must be active and trying to fully utilize the
+  // resources; we don't have a very well support for a client that is not
+  // active. if we detect a client does not make any progress, we assume the
+  // system is not ready or in a unstable state, so we don't do allocation in
+  // this case.
+  bool are_all_active = true;
+  views_active.clear();
+  for (auto& v : views) {
+    bool is_active = v.poll_stat();
+    if (!is_active) {
+      SPDLOG_INFO("App {} is inactive", v.aid);
+      SCHED_LOG_NOTICE("App %d is inactive", v.aid);
+    }
+    are_all_active &= is_active;
+    views_active.emplace_back(is_active);
+  }
+  if (!are_all_active) return false;
+
+  // // dump ghost cache hit rates
+  // for (auto& v : views) v.print();
+
+  if (sched::params::policy::alloc_enabled) {
+    do_alloc();
+    ++alloc_round;
+  }
+  return true;
+}
+
 inline void Allocator::do_alloc() {
   if (views.size() <= 1) return;  // nothing to schedule if only one client
 
+  update_total_bandwidth();
+
   // first, let all tenants' resources set to the equal case
-  for (auto& v : views) v.set_resrc(base_resrc);
+  for (auto& v : views) {
+    ResrcAlloc r = base_resrc;
+    r.bandwidth = get_fair_bandwidth(v, dev_bandwidth);
+    v.set_resrc(r);
+  }
 
   SCHED_LOG_NOTICE("Baseline Resource: cache=%d, bw=%ld, cpu=%ld",
                    base_resrc.cache_size, base_resrc.bandwidth,
@@ -170,6 +291,9 @@ inline void Allocator::do_alloc() {
   // available resources (either from collect_idle or harvest)
   int64_t cpu_avail = 0;  // unit: cycles
   int64_t bw_avail = 0;
+  // with several devices, the baseline may leave some of a device unused
+  std::vector<int64_t> dev_avail = dev_bandwidth;
+  for (auto& v : views) add_dev_load(v, v.get_resrc().bandwidth, dev_avail);
 
   // collect idle resources
   for (auto& v : views) {
@@ -177,18 +301,21 @@ inline void Allocator::do_alloc() {
     assert(cpu_idle >= 0);
     assert(bw_idle >= 0);
     cpu_avail += cpu_idle;
-    bw_avail += bw_idle;
+    add_dev_load(v, -bw_idle, dev_avail);
   }
+  for (auto bw : dev_avail) bw_avail += bw;
   // now every resource must be fully utilized
   SCHED_LOG_NOTICE(
       "Allocator: Available resource after clearing idleness: cpu=%ld, bw=%ld",
       cpu_avail, bw_avail);
 
+  update_active_workers(cpu_avail);
+
   // then start harvest
   if (params::policy::harvest_enabled && params::policy::cache_partition) {
     // if cache_partition is not enabled, we are using global LRU, so there is
     // no per-tenant cache allocation, thus, no harvest
-    bw_avail += do_harvest();
+    bw_avail += do_harvest(dev_avail);
     SCHED_LOG_NOTICE(
         "Allocator: Available resource after harvest: cpu=%ld, bw=%ld",
         cpu_avail, bw_avail);
@@ -199,7 +326,7 @@ inline void Allocator::do_alloc() {
   if (bw_avail == 0 && cpu_avail == 0) goto done;
 
   // distribute those harvested resources
-  cpu_avail = do_distribute(cpu_avail, bw_avail);
+  cpu_avail = do_distribute(cpu_avail, dev_avail);
   if (cpu_avail == 0) goto done;
 
   // if there are clients are full hit, they are not bottleneck on bandwidth, so
@@ -248,121 +375,180 @@ done:
   do_apply();
 }
 
-inline int64_t Allocator::do_harvest() {
+inline int64_t Allocator::do_harvest(std::vector<int64_t>& dev_avail) {
   int64_t bw_harvested = 0;
 
-  // pair<bw_release/compensate, index>
-  std::vector<std::pair<int64_t, int>> bw_rel_list;
-  std::vector<std::pair<int64_t, int>> bw_comp_list;
-  for (int i = 0; i < int(views.size()); ++i) {
-    auto& v = views[i];
-    bw_rel_list.emplace_back(v.pred_what_if_more_cache(), i);
-    bw_comp_list.emplace_back(v.pred_what_if_less_cache(), i);
+  // what the bandwidth of each app is worth: the price of the devices it goes
+  // to, weighted by its shares of them
+  std::vector<double> prices;
+  prices.reserve(views.size());
+  {
+    std::vector<double> dev_prices = get_dev_prices(dev_avail);
+    for (auto& v : views) {
+      double price = 0;
+      const auto& shares = v.get_dev_shares();
+      for (size_t dev = 0; dev < shares.size(); ++dev)
+        price += dev_prices[dev] * shares[dev];
+      prices.emplace_back(price);
+    }
+  }
+  // an offer of int64_max aborts the deal whatever the price
+  auto priced = [](int64_t offer, double price) -> int64_t {
+    if (offer == std::numeric_limits<int64_t>::max()) return offer;
+    return offer * price;
+  };
+
+  // offers indexed by view: how much bandwidth each app would release for
+  // more cache (the most first) and ask for less cache (the least first); a
+  // trade only changes the offers of the two apps involved. the heaps are keyed
+  // by the priced offers
+  std::vector<int64_t> bw_rel_offers, bw_comp_offers;
+  std::vector<int64_t> bw_rel_keys, bw_comp_keys;
+  for (size_t i = 0; i < views.size(); ++i) {
+    bw_rel_offers.emplace_back(views[i].pred_what_if_more_cache());
+    bw_comp_offers.emplace_back(views[i].pred_what_if_less_cache());
+    bw_rel_keys.emplace_back(priced(bw_rel_offers[i], prices[i]));
+    bw_comp_keys.emplace_back(priced(bw_comp_offers[i], prices[i]));
   }
+  IndexedHeap<int64_t, std::greater<int64_t>> bw_rel_heap(
+      std::move(bw_rel_keys));
+  IndexedHeap<int64_t, std::less<int64_t>> bw_comp_heap(
+      std::move(bw_comp_keys));
 
   uint32_t trade_round = 0;
+  uint32_t num_deltas_traded = 0;
   [[maybe_unused]] auto t0 = std::chrono::high_resolution_clock::now();
 
   while (true) {
     if (trade_round >= params::max_trade_round) break;
 
-    std::nth_element(bw_rel_list.begin(), bw_rel_list.begin(),
-                     bw_rel_list.end(),
-                     [](const std::pair<int64_t, int>& lhs,
-                        const std::pair<int64_t, int>& rhs) {
-                       return lhs.first > rhs.first;
-                     });
-    std::nth_element(bw_comp_list.begin(), bw_comp_list.begin(),
-                     bw_comp_list.end(),
-                     [](const std::pair<int64_t, int>& lhs,
-                        const std::pair<int64_t, int>& rhs) {
-                       return lhs.first < rhs.first;
-                     });
-    auto [bw_rel, rel_idx] = bw_rel_list[0];
-    auto [bw_comp, comp_idx] = bw_comp_list[0];
-    if (rel_idx == comp_idx) {
-      // in a rare case, both release and compensate are from the same client,
-      // in which case we just skip the compensate one (use the second instead)
-      std::nth_element(bw_comp_list.begin(), bw_comp_list.begin() + 1,
-                       bw_comp_list.end(),
-                       [](const std::pair<int64_t, int>& lhs,
-                          const std::pair<int64_t, int>& rhs) {
-                         return lhs.first < rhs.first;
-                       });
-      bw_comp = bw_comp_list[1].first;
-      comp_idx = bw_comp_list[1].second;
-    }
+    int rel_idx = bw_rel_heap.top();
+    int comp_idx = bw_comp_heap.top();
+    // in a rare case, both release and compensate are from the same client,
+    // in which case we just skip the compensate one (use the second instead)
+    if (rel_idx == comp_idx) comp_idx = bw_comp_heap.second();
     // likely no further deal can be made
-    if (bw_rel - bw_comp <= params::min_bandwidth_harvest) break;
+    const int64_t first_gain =
+        bw_rel_heap.get_key(rel_idx) - bw_comp_heap.get_key(comp_idx);
+    if (first_gain <= params::min_bandwidth_harvest) break;
 
     auto& v_rel = views[rel_idx];
     auto& v_comp = views[comp_idx];
+    const double p_rel = prices[rel_idx];
+    const double p_comp = prices[comp_idx];
+    int64_t bw_rel = bw_rel_offers[rel_idx];
+    int64_t bw_comp = bw_comp_offers[comp_idx];
+
+    // if the marginal gains are flat, trade several deltas at once: double the
+    // batch as long as the extra deltas harvest about as much as the first,
+    // and within the cache the releasing app's ghost caches can predict
+    const uint32_t max_num_deltas =
+        std::min(params::max_trade_batch, v_rel.get_max_more_cache_deltas());
+    uint32_t num_deltas = 1;
+    int64_t gain = first_gain;
+    while (num_deltas * 2 <= max_num_deltas) {
+      uint32_t next_num_deltas = num_deltas * 2;
+      int64_t next_bw_rel = v_rel.pred_what_if_more_cache(next_num_deltas);
+      int64_t next_bw_comp = v_comp.pred_what_if_less_cache(next_num_deltas);
+      if (next_bw_comp == std::numeric_limits<int64_t>::max()) break;
+      int64_t next_gain =
+          priced(next_bw_rel, p_rel) - priced(next_bw_comp, p_comp);
+      if (next_gain - gain < (next_num_deltas - num_deltas) * first_gain *
+                                 (1 - params::trade_batch_flatness))
+        break;
+      num_deltas = next_num_deltas;
+      bw_rel = next_bw_rel;
+      bw_comp = next_bw_comp;
+      gain = next_gain;
+    }
+
+    // the released bandwidth may be on other devices than the compensation
+    std::vector<int64_t> next_dev_avail = dev_avail;
+    add_dev_load(v_rel, -bw_rel, next_dev_avail);
+    add_dev_load(v_comp, bw_comp, next_dev_avail);
+    if (std::any_of(next_dev_avail.begin(), next_dev_avail.end(),
+                    [](int64_t bw) { return bw < 0; }))
+      break;
+    dev_avail = std::move(next_dev_avail);
 
     SCHED_LOG_DEBUG("App-%d: bw -= %ld MB/s", v_rel.aid, params::blocks_to_mb_int(bw_rel));
     SCHED_LOG_DEBUG("App-%d: bw += %ld MB/s", v_comp.aid, params::blocks_to_mb_int(bw_comp));
 
-    v_rel.add_cache_delta();
-    v_comp.minus_cache_delta();
+    v_rel.add_cache_delta(num_deltas);
+    v_comp.minus_cache_delta(num_deltas);
     v_rel.add_bandwidth(-bw_rel);
     v_comp.add_bandwidth(bw_comp);
     bw_harvested += bw_rel - bw_comp;
 
     // trigger the next round: recompute those prediction that has resources
     // updated
-    int done_cnt = 0;  // there are four elements to update
-    for (int i = 0; i < int(views.size()) && done_cnt < 4; ++i) {
-      if (bw_rel_list[i].second == rel_idx ||
-          bw_rel_list[i].second == comp_idx) {
-        auto& v = views[bw_rel_list[i].second];
-        bw_rel_list[i].first = v.pred_what_if_more_cache();
-        ++done_cnt;
-      }
-      if (bw_comp_list[i].second == rel_idx ||
-          bw_comp_list[i].second == comp_idx) {
-        auto& v = views[bw_comp_list[i].second];
-        bw_comp_list[i].first = v.pred_what_if_less_cache();
-        ++done_cnt;
-      }
-    }
+    bw_rel_offers[rel_idx] = v_rel.pred_what_if_more_cache();
+    bw_rel_offers[comp_idx] = v_comp.pred_what_if_more_cache();
+    bw_comp_offers[rel_idx] = v_rel.pred_what_if_less_cache();
+    bw_comp_offers[comp_idx] = v_comp.pred_what_if_less_cache();
+    bw_rel_heap.update(rel_idx, priced(bw_rel_offers[rel_idx], p_rel));
+    bw_rel_heap.update(comp_idx, priced(bw_rel_offers[comp_idx], p_comp));
+    bw_comp_heap.update(rel_idx, priced(bw_comp_offers[rel_idx], p_rel));
+    bw_comp_heap.update(comp_idx, priced(bw_comp_offers[comp_idx], p_comp));
     ++trade_round;
+    num_deltas_traded += num_deltas;
   }
   [[maybe_unused]] auto t1 = std::chrono::high_resolution_clock::now();
-  SCHED_LOG_NOTICE("Trading takes %.2lf us (%d rounds)",
+  SCHED_LOG_NOTICE("Trading takes %.2lf us (%d rounds, %d deltas)",
                    std::chrono::duration<double, std::micro>(t1 - t0).count(),
-                   trade_round);
+                   trade_round, num_deltas_traded);
   return bw_harvested;
 }
 
-inline int64_t Allocator::do_distribute(int64_t cpu_avail, int64_t bw_avail) {
+inline int64_t Allocator::do_distribute(int64_t cpu_avail,
+                                        std::vector<int64_t>& dev_avail) {
+  int64_t bw_avail = 0;
+  for (auto bw : dev_avail) bw_avail += bw;
   int64_t bw_sum = total_resrc.bandwidth - bw_avail;
   assert(bw_sum >= 0);
-  double improve_ratio = 0;
+  std::vector<double> improve_ratios(views.size(), 0);
+  double improve_ratio = 0;  // the most any app improves
   if (bw_sum > 0) {  // common case
-    int64_t bw_avail_total = bw_avail;
-    improve_ratio = double(bw_avail) / bw_sum;
+    improve_ratios = get_improve_ratios(dev_avail);
+    improve_ratio =
+        *std::max_element(improve_ratios.begin(), improve_ratios.end());
     SCHED_LOG_NOTICE("Expect improvement after BE-distribution: %.2lf%%",
                      improve_ratio * 100);
-    for (auto& v : views) {
-      auto r = v.get_resrc();
-      if (r.bandwidth == 0) continue;
-      int64_t bw_distr = bw_avail_total * r.bandwidth / bw_sum;
-      v.add_bandwidth(bw_distr);
+    for (size_t i = 0; i < views.size(); ++i) {
+      auto r = views[i].get_resrc();
+      // an app needing no bandwidth is held back by no device
+      if (r.bandwidth == 0) {
+        improve_ratios[i] = improve_ratio;
+        continue;
+      }
+      int64_t bw_distr = r.bandwidth * improve_ratios[i];
+      views[i].add_bandwidth(bw_distr);
       bw_avail -= bw_distr;
       assert(bw_avail >= 0);
     }
   } else {  // everyone is a hit... just share
-    for (auto& v : views) v.add_bandwidth(bw_avail / views.size());
-    bw_avail -= bw_avail / views.size() * views.size();
+    const auto dev_share = dev_avail;
+    for (auto& v : views) {
+      int64_t bw_distr = get_fair_bandwidth(v, dev_share);
+      v.add_bandwidth(bw_distr);
+      add_dev_load(v, bw_distr, dev_avail);
+      bw_avail -= bw_distr;
+    }
   }
-  // this could happen due to rounding issue... just give it to a random clients
-  if (bw_avail > 0) views[0].add_bandwidth(bw_avail);
+  // this could happen due to rounding issue... just give it to a random
+  // clients; with several devices, the rest is on devices the apps are not
+  // short of, and giving it to one app would also take the others
+  if (bw_avail > 0 && dev_avail.size() == 1) views[0].add_bandwidth(bw_avail);
 
   //  if (improve_ratio == 0) return cpu_avail;
   int64_t cpu_sum = total_resrc.cpu_cycles - cpu_avail;
   // I don't think it could be the case that all CPU are available...
   assert(cpu_sum > 0);
-  if (params::policy::strict_weight_distr ||
-      improve_ratio * cpu_sum > cpu_avail) {
+  // CPU to keep up with the improved bandwidth
+  double cpu_demand = 0;
+  for (size_t i = 0; i < views.size(); ++i)
+    cpu_demand += improve_ratios[i] * views[i].get_resrc().cpu_cycles;
+  if (params::policy::strict_weight_distr || cpu_demand > cpu_avail) {
     SCHED_LOG_NOTICE(
         "Expect improvement after CPU-distribution: %.2lf%%",
         std::min<double>(double(cpu_avail) / cpu_sum, improve_ratio) * 100);
@@ -379,12 +565,12 @@ inline int64_t Allocator::do_distribute(int64_t cpu_avail, int64_t bw_avail) {
     if (cpu_avail > 0) views[0].add_cpu(cpu_avail);
     return 0;
   } else {  // only give CPU when necessary
-    for (auto& v : views) {
+    for (size_t i = 0; i < views.size(); ++i) {
       SCHED_LOG_NOTICE("Expect improvement after CPU-distribution: %.2lf%%",
-                       improve_ratio * 100);
-      auto r = v.get_resrc();
-      int64_t cpu_distr = improve_ratio * r.cpu_cycles;
-      v.add_cpu(cpu_distr);
+                       improve_ratios[i] * 100);
+      auto r = views[i].get_resrc();
+      int64_t cpu_distr = improve_ratios[i] * r.cpu_cycles;
+      views[i].add_cpu(cpu_distr);
       cpu_avail -= cpu_distr;
     }
     return cpu_avail;
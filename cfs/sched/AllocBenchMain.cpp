@@ -0,0 +1,158 @@
+/**
+ * fsAllocBench: measure how long an allocation takes as the number of apps
+ * grows. For each app count, it synthesizes a trace (see AllocSim.h) where
+ * every app has one tenant on each worker with a random workload, replays it
+ * through the allocator and prints the mean and max wall time of
+ * `Allocator::poll_and_alloc` per round.
+ *
+ * Usage: fsAllocBench [-w num_workers] [-r num_rounds] [-b max_batch]
+ *                     [-s seed] [num_apps ...]
+ *   -w: default 4
+ *   -r: allocations to time for each app count; default 5
+ *   -b: max cache_delta per trade; default params::max_trade_batch
+ *   num_apps: default 10 20 50 100 200 500 1000
+ *
+ * The workloads are a mix of scans, uniform working sets and skewed working
+ * sets of 64 MB to 2 GB per tenant, so that the harvest phase makes trades
+ * among all apps.
+ */
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "AllocSim.h"
+#include "Param.h"
+#include "spdlog/spdlog.h"
+
+using namespace sched;
+
+// one sample per stat window; the allocator runs every window
+constexpr uint64_t kWindowUs = 5'000'000;
+
+static sim::Trace make_trace(int num_workers, int num_apps, int num_rounds,
+                             std::mt19937& rng) {
+  sim::Trace trace;
+  trace.num_workers = num_workers;
+  trace.num_apps = num_apps;
+  trace.cycles_per_second = params::cycles_per_second;
+  trace.samples.assign(num_workers,
+                       std::vector<std::vector<sim::TenantSample>>(num_apps));
+
+  const uint64_t window_cycles =
+      kWindowUs * params::cycles_per_second / 1'000'000;
+  // every tenant gets the same cache and bandwidth regardless of the app
+  // count, so that trades stay above min_bandwidth_harvest, and an even share
+  // of the workers; a block costs the CPU of half of the bandwidth, so a
+  // tenant missing more than half of the time is bottlenecked on bandwidth
+  const int64_t cpu_cycles = params::weight_to_cycles(std::max<uint32_t>(
+      params::worker_avail_weight / num_apps, params::min_weight));
+  const ResrcAlloc resrc{
+      .cache_size = params::mb_to_blocks(256),
+      .bandwidth = params::mb_to_blocks(100),
+      .cpu_cycles = cpu_cycles,
+  };
+  const int64_t cycles_per_block =
+      std::max<int64_t>(cpu_cycles / (2 * resrc.bandwidth), 1);
+  constexpr int64_t kBlocksPerWindow = 100'000;
+
+  std::uniform_int_distribution<int> kind_distr(0, 3);
+  std::uniform_real_distribution<double> ws_mb_distr(64, 2048);
+  for (int aid = 0; aid < num_apps; ++aid) {
+    int kind = kind_distr(rng);  // 0: scan; 1, 2: uniform; 3: skewed
+    double ws = params::mb_to_blocks(ws_mb_distr(rng));
+    auto hit_rate = [&](uint32_t size) {
+      if (kind == 0) return 0.0;
+      if (kind == 3) return 1 - std::exp(-size / ws);
+      return std::min(1.0, size / ws);
+    };
+    for (int wid = 0; wid < num_workers; ++wid) {
+      auto& list = trace.samples[wid][aid];
+      // preheat, then one window for each round
+      for (int i = 1; i <= num_rounds + 2; ++i) {
+        sim::TenantSample s;
+        s.ts = window_cycles * i;
+        s.num_files = 8;
+        s.resrc = resrc;
+        int64_t done = kBlocksPerWindow * i;
+        s.acct = ResrcAcct(done,
+                           int64_t(done * (1 - hit_rate(resrc.cache_size))),
+                           done * cycles_per_block);
+        for (uint32_t size = params::ghost::min_size;
+             size <= params::ghost::max_size; size += params::ghost::tick) {
+          auto hit = uint64_t(done * hit_rate(size));
+          s.ghost.emplace_back(hit, done - hit);
+        }
+        list.emplace_back(std::move(s));
+      }
+    }
+  }
+  return trace;
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [-w num_workers] [-r num_rounds] [-b max_batch] [-s seed] "
+          "[num_apps ...]\n",
+          prog);
+}
+
+int main(int argc, char** argv) {
+  int num_workers = 4;
+  int num_rounds = 5;
+  unsigned seed = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "w:r:b:s:")) != -1) {
+    switch (opt) {
+      case 'w':
+        num_workers = atoi(optarg);
+        break;
+      case 'r':
+        num_rounds = atoi(optarg);
+        break;
+      case 'b':
+        params::max_trade_batch = atoi(optarg);
+        break;
+      case 's':
+        seed = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (num_workers <= 0 || num_rounds <= 0 || params::max_trade_batch == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  std::vector<int> num_apps_list;
+  for (int i = optind; i < argc; ++i) num_apps_list.emplace_back(atoi(argv[i]));
+  if (num_apps_list.empty()) num_apps_list = {10, 20, 50, 100, 200, 500, 1000};
+  spdlog::set_level(spdlog::level::warn);
+
+  printf("num_apps mean_alloc_us max_alloc_us\n");
+  for (int num_apps : num_apps_list) {
+    if (num_apps < 2) continue;  // nothing to allocate
+    std::mt19937 rng(seed);
+    auto trace = make_trace(num_workers, num_apps, num_rounds, rng);
+    sim::AllocSim alloc_sim(trace, {.preheat_us = kWindowUs,
+                                    .freq_us = kWindowUs,
+                                    .window_us = kWindowUs});
+    sim::AllocSim::Round round;
+    double sum_us = 0, max_us = 0;
+    int n = 0;
+    while (n < num_rounds && alloc_sim.step(round)) {
+      sum_us += round.alloc_us;
+      max_us = std::max(max_us, round.alloc_us);
+      ++n;
+    }
+    printf("%d %.1lf %.1lf\n", num_apps, n > 0 ? sum_us / n : 0, max_us);
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,37 @@
+#include "AllocEnv.h"
+
+#include "FsProc_Fs.h"
+#include "FsProc_Messenger.h"
+
+namespace sched {
+
+int FsAllocEnv::get_num_workers() const { return fs_proc->getNumThreads(); }
+
+int FsAllocEnv::get_num_apps() const { return fs_proc->getNumApps(); }
+
+int FsAllocEnv::get_num_devs() const { return fs_proc->getNumDevs(); }
+
+int64_t FsAllocEnv::get_dev_capacity(int dev) {
+  return fs_proc->getDevCapacityEstimate(dev);
+}
+
+void FsAllocEnv::apply(int wid, AllocDecision* decision) {
+  FsProcMessage msg;
+  msg.type = FsProcMessageType::kSCHED_NewResrcAlloc;
+  msg.ctx = decision;
+  fs_proc->messenger->send_message(wid, msg);
+}
+
+void FsAllocEnv::set_worker_parked(int wid, bool parked) {
+  fs_proc->requestWorkerPark(wid, parked);
+}
+
+int FsAllocEnv::get_worker_node(int wid) const {
+  return fs_proc->getWorkerNumaNode(wid);
+}
+
+int FsAllocEnv::get_app_node(int aid) const {
+  return fs_proc->getAppNumaNode(aid);
+}
+
+}  // namespace sched
@@ -0,0 +1,93 @@
+/**
+ * This file defines what the allocator (Alloc.h) needs from the system it
+ * allocates for. The allocation core only talks to these two interfaces, so it
+ * runs the same in FsProc (Tenant and FsAllocEnv) and in the offline simulator
+ * (AllocSim.h), which replays a recorded trace instead.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include "Resrc.h"
+
+class FsProc;
+
+namespace sched {
+
+struct AllocDecision {
+  int aid;
+  std::vector<std::tuple<int, int>> inode_move;  // dst_wid, num_files
+  ResrcAlloc resrc;
+  // part of resrc.bandwidth for each device; empty means an even split
+  std::vector<double> dev_shares;
+};
+
+// an app's share on one worker, as seen by AppResrcView
+class TenantProbe {
+ public:
+  virtual ~TenantProbe() = default;
+
+  virtual int get_wid() const = 0;
+  virtual size_t get_num_files() const = 0;
+
+  // accumulated resource consumption
+  virtual ResrcAcct get_acct() const = 0;
+  // accumulated block requests to device `dev` (see AllocEnv::get_num_devs)
+  virtual uint64_t get_dev_io_cnt(int dev) const = 0;
+  // accumulated ghost cache stat of the given cache size; `size` is always one
+  // of the ticks in params::ghost
+  virtual HitRateCnt get_ghost_stat(uint32_t size) const = 0;
+
+  virtual ResrcAlloc get_resrc() const = 0;
+  virtual uint32_t get_allocated_weight() const = 0;
+
+  virtual void turn_blk_rate_limiter(bool to_on) = 0;
+};
+
+class AllocEnv {
+ public:
+  virtual ~AllocEnv() = default;
+
+  virtual int get_num_workers() const = 0;
+  virtual int get_num_apps() const = 0;
+
+  // devices the data is striped over; each has its own bandwidth
+  virtual int get_num_devs() const = 0;
+  // what device `dev` delivers when saturated; unit: #blocks/second; 0 if the
+  // device has not been saturated yet
+  virtual int64_t get_dev_capacity(int dev) = 0;
+
+  // apply an app's new resources on a worker; take the ownership of `decision`
+  virtual void apply(int wid, AllocDecision* decision) = 0;
+
+  // park a worker once it has handed off all its files, or wake it up
+  // (policy::elastic_workers); the master (wid 0) is never parked
+  virtual void set_worker_parked(int wid, bool parked) = 0;
+
+  // NUMA node of a worker's core and of an app's memory; -1 if unknown
+  // (policy::numa_affinity)
+  virtual int get_worker_node(int wid) const = 0;
+  virtual int get_app_node(int aid) const = 0;
+};
+
+// the live system: decisions are sent to the workers as messages
+class FsAllocEnv : public AllocEnv {
+  FsProc* fs_proc;
+
+ public:
+  explicit FsAllocEnv(FsProc* fs_proc) : fs_proc(fs_proc) {}
+
+  int get_num_workers() const override;
+  int get_num_apps() const override;
+  int get_num_devs() const override;
+  int64_t get_dev_capacity(int dev) override;
+  void apply(int wid, AllocDecision* decision) override;
+  void set_worker_parked(int wid, bool parked) override;
+  int get_worker_node(int wid) const override;
+  int get_app_node(int aid) const override;
+};
+
+}  // namespace sched
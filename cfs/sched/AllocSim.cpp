@@ -0,0 +1,275 @@
+#include "AllocSim.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <sstream>
+
+#include "View.h"
+
+namespace sched::sim {
+
+std::string Trace::load(std::istream& in) {
+  std::string line;
+  int line_no = 0;
+  while (std::getline(in, line)) {
+    ++line_no;
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream ss(line);
+    char type;
+    ss >> type;
+    if (type == 'H') {
+      uint32_t min_size, max_size, tick;
+      ss >> num_workers >> num_apps >> min_size >> max_size >> tick >>
+          cycles_per_second;
+      if (!ss) return "Invalid header at line " + std::to_string(line_no);
+      if (min_size != params::ghost::min_size ||
+          max_size != params::ghost::max_size ||
+          tick != params::ghost::tick)
+        return "Ghost cache ticks of the trace do not match params::ghost";
+      samples.assign(num_workers,
+                     std::vector<std::vector<TenantSample>>(num_apps));
+      worker_nodes.assign(num_workers, -1);
+      app_nodes.assign(num_apps, -1);
+    } else if (type == 'T') {
+      if (samples.empty())
+        return "Missing header before line " + std::to_string(line_no);
+      TenantSample s;
+      int wid, aid;
+      uint32_t num_ticks;
+      ss >> s.ts >> wid >> aid >> s.num_files >> s.resrc.cache_size >>
+          s.resrc.bandwidth >> s.resrc.cpu_cycles >> s.acct.num_blks_done >>
+          s.acct.bw_consump >> s.acct.cpu_consump >> num_ticks;
+      if (!ss || wid < 0 || wid >= num_workers || aid < 0 ||
+          aid >= num_apps || num_ticks != params::ghost::num_ticks)
+        return "Invalid sample at line " + std::to_string(line_no);
+      s.ghost.resize(num_ticks);
+      for (auto& h : s.ghost) ss >> h.hit_cnt >> h.miss_cnt;
+      if (!ss) return "Invalid sample at line " + std::to_string(line_no);
+      auto& list = samples[wid][aid];
+      if (!list.empty() && list.back().ts >= s.ts) continue;  // duplicated
+      list.emplace_back(std::move(s));
+    } else if (type == 'D') {
+      if (samples.empty())
+        return "Missing header before line " + std::to_string(line_no);
+      int wid, aid, n;
+      ss >> wid >> aid >> n;
+      if (!ss || wid < 0 || wid >= num_workers || aid < 0 ||
+          aid >= num_apps || n < 1 || samples[wid][aid].empty())
+        return "Invalid device counts at line " + std::to_string(line_no);
+      if (num_devs > 1 && n != num_devs)
+        return "Inconsistent number of devices at line " +
+               std::to_string(line_no);
+      num_devs = n;
+      std::vector<uint64_t> cnt(n);
+      for (auto& c : cnt) ss >> c;
+      if (!ss)
+        return "Invalid device counts at line " + std::to_string(line_no);
+      samples[wid][aid].back().dev_io_cnt = std::move(cnt);
+    } else if (type == 'W' || type == 'A') {
+      if (samples.empty())
+        return "Missing header before line " + std::to_string(line_no);
+      int id, node;
+      ss >> id >> node;
+      auto& nodes = type == 'W' ? worker_nodes : app_nodes;
+      if (!ss || id < 0 || id >= int(nodes.size()))
+        return "Invalid NUMA node at line " + std::to_string(line_no);
+      nodes[id] = node;
+    } else {
+      return "Unknown record at line " + std::to_string(line_no);
+    }
+  }
+  if (samples.empty()) return "Empty trace";
+  for (auto& row : samples)
+    for (auto& list : row)
+      if (list.empty()) return "Some tenant has no sample";
+  return "";
+}
+
+uint64_t Trace::begin_ts() const {
+  uint64_t ts = 0;
+  for (auto& row : samples)
+    for (auto& list : row) ts = std::max(ts, list.front().ts);
+  return ts;
+}
+
+uint64_t Trace::end_ts() const {
+  uint64_t ts = std::numeric_limits<uint64_t>::max();
+  for (auto& row : samples)
+    for (auto& list : row) ts = std::min(ts, list.back().ts);
+  return ts;
+}
+
+SimTenant::SimTenant(int wid, const std::vector<TenantSample>& samples,
+                     uint64_t cycles_per_second, int num_devs)
+    : wid(wid),
+      samples(samples),
+      cycles_per_second(cycles_per_second),
+      num_files(samples.front().num_files),
+      resrc(samples.front().resrc),
+      dev_io_cnt(num_devs, 0) {}
+
+HitRateCnt SimTenant::get_ghost_stat(uint32_t size) const {
+  return samples[cursor].ghost[(size - params::ghost::min_size) /
+                               params::ghost::tick];
+}
+
+std::pair<double, double> SimTenant::advance(uint64_t ts, ResrcAlloc base) {
+  size_t next = cursor;
+  while (next + 1 < samples.size() && samples[next + 1].ts <= ts) ++next;
+  if (next == cursor) return {0, 0};
+  const auto& prev = samples[cursor];
+  const auto& curr = samples[next];
+  cursor = next;
+
+  // the workload between the two samples; a counter counts from zero again if
+  // it was reset in between (Tenant::reset_stat)
+  auto diff = [](int64_t c, int64_t p) { return c >= p ? c - p : c; };
+  ResrcAcct d(diff(curr.acct.num_blks_done, prev.acct.num_blks_done),
+              diff(curr.acct.bw_consump, prev.acct.bw_consump),
+              diff(curr.acct.cpu_consump, prev.acct.cpu_consump));
+  if (d.num_blks_done <= 0) return {0, 0};  // idle in the trace
+  double cycles_per_block = double(d.cpu_consump) / d.num_blks_done;
+  double measured_miss_rate =
+      std::min(1.0, double(d.bw_consump) / d.num_blks_done);
+  std::vector<HitRateCnt> curve(curr.ghost.size());
+  for (size_t i = 0; i < curve.size(); ++i)
+    curve[i] = HitRateCnt(
+        curr.ghost[i].hit_cnt - std::min(curr.ghost[i].hit_cnt,
+                                         prev.ghost[i].hit_cnt),
+        curr.ghost[i].miss_cnt - std::min(curr.ghost[i].miss_cnt,
+                                          prev.ghost[i].miss_cnt));
+
+  // where the misses go; evenly if the trace does not tell
+  const size_t num_devs = dev_io_cnt.size();
+  std::vector<double> dev_shares(num_devs, 1.0 / num_devs);
+  if (curr.dev_io_cnt.size() == num_devs &&
+      prev.dev_io_cnt.size() == num_devs) {
+    uint64_t sum = 0;
+    std::vector<uint64_t> dev_io(num_devs);
+    for (size_t dev = 0; dev < num_devs; ++dev) {
+      dev_io[dev] = diff(curr.dev_io_cnt[dev], prev.dev_io_cnt[dev]);
+      sum += dev_io[dev];
+    }
+    if (sum > 0)
+      for (size_t dev = 0; dev < num_devs; ++dev)
+        dev_shares[dev] = double(dev_io[dev]) / sum;
+  }
+
+  auto miss_rate_of = [&](uint32_t cache_size) {
+    auto hrc = interpolate_hit_rate_cnt(
+        curve, std::min(cache_size, params::ghost::max_size));
+    double hit_rate = hrc.get_hit_rate();
+    if (hit_rate == std::numeric_limits<double>::infinity())
+      return measured_miss_rate;
+    return hit_rate >= params::full_hit_threshold ? 0.0 : 1 - hit_rate;
+  };
+  // #blocks/second when backlogged; each device limits it by the bandwidth
+  // allocated on it
+  auto tp_of = [&](ResrcAlloc r, const std::vector<double>& r_dev_shares,
+                   double miss_rate) {
+    double tp = std::numeric_limits<double>::infinity();
+    if (cycles_per_block > 0) tp = r.cpu_cycles / cycles_per_block;
+    for (size_t dev = 0; dev < num_devs; ++dev) {
+      double demand = miss_rate * dev_shares[dev];
+      if (demand <= 0) continue;
+      double share = r_dev_shares.size() == num_devs ? r_dev_shares[dev]
+                                                     : 1.0 / num_devs;
+      tp = std::min(tp, r.bandwidth * share / demand);
+    }
+    return tp;
+  };
+
+  double seconds = double(curr.ts - prev.ts) / cycles_per_second;
+  double miss_rate = miss_rate_of(resrc.cache_size);
+  double blocks = tp_of(resrc, resrc_dev_shares, miss_rate) * seconds;
+  double base_blocks =
+      tp_of(base, {}, miss_rate_of(base.cache_size)) * seconds;
+  acct += ResrcAcct(int64_t(blocks), int64_t(blocks * miss_rate),
+                    int64_t(blocks * cycles_per_block));
+  for (size_t dev = 0; dev < num_devs; ++dev)
+    dev_io_cnt[dev] += blocks * miss_rate * dev_shares[dev];
+  return {blocks, base_blocks};
+}
+
+void SimAllocEnv::apply(int wid, AllocDecision* decision) {
+  auto& app_tenants = tenants[decision->aid];
+  app_tenants[wid]->set_resrc(decision->resrc, decision->dev_shares);
+  for (auto [dst_wid, nfiles] : decision->inode_move) {
+    app_tenants[wid]->add_files(-nfiles);
+    app_tenants[dst_wid]->add_files(nfiles);
+  }
+  delete decision;
+}
+
+AllocSim::AllocSim(const Trace& trace, AllocSimOptions opts)
+    : trace(trace),
+      tenants(trace.num_apps),
+      base_resrc(trace.num_apps),
+      env(new SimAllocEnv(tenants, trace)),
+      allocator(std::unique_ptr<AllocEnv>(env)),
+      freq_cycles(opts.freq_us * trace.cycles_per_second / 1'000'000),
+      window_cycles(opts.window_us * trace.cycles_per_second / 1'000'000),
+      now(trace.begin_ts() + opts.preheat_us * trace.cycles_per_second /
+                                 1'000'000) {
+  // the same as FsProc::startAllocator
+  for (int aid = 0; aid < trace.num_apps; ++aid) {
+    auto& v = allocator.append_view(aid);
+    for (int wid = 0; wid < trace.num_workers; ++wid) {
+      auto& t = tenants[aid].emplace_back(std::make_unique<SimTenant>(
+          wid, trace.samples[wid][aid], trace.cycles_per_second,
+          trace.num_devs));
+      v.append_tenant(t.get());
+      allocator.add_total_resrc(t->get_resrc());
+      base_resrc[aid].emplace_back(t->get_resrc());
+    }
+  }
+}
+
+bool AllocSim::step(Round& round) {
+  if (now + window_cycles > trace.end_ts()) return false;
+  round.time = double(now - trace.begin_ts()) / trace.cycles_per_second;
+  round.apps.assign(trace.num_apps, {});
+
+  for (int aid = 0; aid < trace.num_apps; ++aid)
+    for (int wid = 0; wid < trace.num_workers; ++wid)
+      tenants[aid][wid]->advance(now, base_resrc[aid][wid]);
+  allocator.reset_stat();
+
+  double seconds = double(window_cycles) / trace.cycles_per_second;
+  for (int aid = 0; aid < trace.num_apps; ++aid) {
+    auto& r = round.apps[aid];
+    for (int wid = 0; wid < trace.num_workers; ++wid) {
+      auto& t = tenants[aid][wid];
+      r.resrc += t->get_resrc();
+      auto [blocks, base_blocks] =
+          t->advance(now + window_cycles, base_resrc[aid][wid]);
+      r.tp += blocks / seconds;
+      r.base_tp += base_blocks / seconds;
+    }
+  }
+
+  std::vector<bool> views_active;
+  auto t0 = std::chrono::steady_clock::now();
+  allocator.poll_and_alloc(views_active);
+  auto t1 = std::chrono::steady_clock::now();
+  round.alloc_us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+  for (int aid = 0; aid < trace.num_apps; ++aid) {
+    auto& r = round.apps[aid];
+    r.is_active = views_active[aid];
+    r.num_files.assign(trace.num_workers, 0);
+    for (int wid = 0; wid < trace.num_workers; ++wid)
+      r.num_files[wid] = tenants[aid][wid]->get_num_files();
+  }
+  round.workers_parked.assign(trace.num_workers, false);
+  round.workers_num_files.assign(trace.num_workers, 0);
+  for (int wid = 0; wid < trace.num_workers; ++wid) {
+    round.workers_parked[wid] = env->is_worker_parked(wid);
+    for (int aid = 0; aid < trace.num_apps; ++aid)
+      round.workers_num_files[wid] += tenants[aid][wid]->get_num_files();
+  }
+  now += freq_cycles;
+  return true;
+}
+
+}  // namespace sched::sim
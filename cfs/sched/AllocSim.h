@@ -0,0 +1,188 @@
+/**
+ * Offline simulator of the allocator. It replays a trace recorded from a live
+ * run (`fsMetricsDump -r`) through the same `Allocator` FsProc uses, with
+ * `SimTenant` and `SimAllocEnv` in place of the workers, and predicts the
+ * throughput each app would get under the allocations it makes. A run takes
+ * milliseconds instead of minutes, so policies and parameters can be swept
+ * over many configurations (see `bench/alloc_sim_sweep.py`).
+ *
+ * The trace gives each tenant's workload: its ghost cache curve, which does
+ * not depend on the allocation, and its CPU cost per block. Like the
+ * allocator, the simulator assumes every app is backlogged: a tenant with
+ * cache `c`, bandwidth `b` and CPU `p` does
+ *   min(p / cycles_per_block, b / miss_rate(c))
+ * blocks per second, and is charged the consumption of that throughput, which
+ * is what the allocator polls in the next window.
+ *
+ * Trace format (text, one record per line):
+ *   H num_workers num_apps ghost_min_size ghost_max_size ghost_tick cycles/s
+ *   T ts wid aid num_files cache_size bandwidth cpu_cycles num_blks_done
+ *     bw_consump cpu_consump num_ticks hit_0 miss_0 ... hit_n miss_n
+ *   D wid aid num_devs io_cnt_0 ... io_cnt_n
+ *   W wid numa_node
+ *   A aid numa_node
+ * `H` comes first; each `T` is a snapshot of `metrics::TenantStat`. The
+ * ghost cache ticks must be the ones this binary is built with. `D` follows
+ * the `T` of the same tenant when the data is striped over several devices: it
+ * gives the block requests to each device, which split a tenant's bandwidth
+ * demand over the devices (each device then limits the throughput on its
+ * own). `W` and `A` give the NUMA nodes of the workers and the apps
+ * (policy::numa_affinity); they are optional, and the last one of each worker
+ * or app is used.
+ */
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Alloc.h"
+#include "AllocEnv.h"
+#include "Param.h"
+#include "Resrc.h"
+
+namespace sched::sim {
+
+struct TenantSample {
+  uint64_t ts;  // rdtsc of the live run
+  uint32_t num_files;
+  ResrcAlloc resrc;
+  ResrcAcct acct;
+  std::vector<HitRateCnt> ghost;  // one entry for each params::ghost tick
+  std::vector<uint64_t> dev_io_cnt;  // empty if there is one device
+};
+
+struct Trace {
+  int num_workers = 0;
+  int num_apps = 0;
+  int num_devs = 1;
+  uint64_t cycles_per_second = 0;
+  // samples[wid][aid], ordered by ts
+  std::vector<std::vector<std::vector<TenantSample>>> samples;
+  // -1 if unknown
+  std::vector<int> worker_nodes;
+  std::vector<int> app_nodes;
+
+  // @return an error message; empty on success
+  std::string load(std::istream& in);
+
+  // every tenant has samples in [begin_ts(), end_ts()]
+  uint64_t begin_ts() const;
+  uint64_t end_ts() const;
+};
+
+class SimTenant final : public TenantProbe {
+  const int wid;
+  const std::vector<TenantSample>& samples;
+  const uint64_t cycles_per_second;
+  size_t cursor = 0;  // the latest sample replayed
+
+  size_t num_files;
+  ResrcAlloc resrc;
+  // part of resrc.bandwidth on each device; empty means an even split
+  std::vector<double> resrc_dev_shares;
+  ResrcAcct acct;  // charged by `advance`, not from the trace
+  std::vector<uint64_t> dev_io_cnt;  // charged by `advance` as well
+
+ public:
+  SimTenant(int wid, const std::vector<TenantSample>& samples,
+            uint64_t cycles_per_second, int num_devs);
+
+  int get_wid() const override { return wid; }
+  size_t get_num_files() const override { return num_files; }
+  ResrcAcct get_acct() const override { return acct; }
+  uint64_t get_dev_io_cnt(int dev) const override { return dev_io_cnt[dev]; }
+  HitRateCnt get_ghost_stat(uint32_t size) const override;
+  ResrcAlloc get_resrc() const override { return resrc; }
+  uint32_t get_allocated_weight() const override {
+    return params::cycles_to_weight(resrc.cpu_cycles);
+  }
+  void turn_blk_rate_limiter(bool to_on) override {}
+
+  void set_resrc(ResrcAlloc r, const std::vector<double>& dev_shares = {}) {
+    resrc = r;
+    resrc_dev_shares = dev_shares;
+  }
+  void add_files(int n) { num_files += n; }
+
+  /**
+   * @brief Replay the trace up to `ts`: predict the number of blocks done
+   * since the last call under the current resources (charged to the tenant)
+   * and under `base`.
+   *
+   * @return std::pair<double, double> #blocks done with `resrc` and `base`.
+   */
+  std::pair<double, double> advance(uint64_t ts, ResrcAlloc base);
+};
+
+class SimAllocEnv : public AllocEnv {
+  // tenants[aid][wid]
+  std::vector<std::vector<std::unique_ptr<SimTenant>>>& tenants;
+  const Trace& trace;
+  std::vector<bool> parked;  // a worker parks at once: it has no queues
+
+ public:
+  SimAllocEnv(std::vector<std::vector<std::unique_ptr<SimTenant>>>& tenants,
+              const Trace& trace)
+      : tenants(tenants), trace(trace), parked(trace.num_workers) {}
+
+  int get_num_workers() const override { return trace.num_workers; }
+  int get_num_apps() const override { return tenants.size(); }
+  int get_num_devs() const override { return trace.num_devs; }
+  // the device bandwidth is whatever the trace was recorded with
+  int64_t get_dev_capacity(int dev) override { return 0; }
+  void apply(int wid, AllocDecision* decision) override;
+  void set_worker_parked(int wid, bool p) override { parked[wid] = p; }
+  bool is_worker_parked(int wid) const { return parked[wid]; }
+  int get_worker_node(int wid) const override {
+    return trace.worker_nodes[wid];
+  }
+  int get_app_node(int aid) const override { return trace.app_nodes[aid]; }
+};
+
+struct AllocSimOptions {
+  uint64_t preheat_us = params::alloc::preheat_window_us;
+  uint64_t freq_us = params::alloc::freq_us;
+  uint64_t window_us = params::alloc::stat_coll_window_us;
+};
+
+class AllocSim {
+ public:
+  struct AppRound {
+    bool is_active;
+    ResrcAlloc resrc;  // in effect during the window
+    double tp;         // predicted throughput; unit: #blocks/second
+    double base_tp;    // predicted throughput with the initial resources
+    std::vector<int> num_files;  // after the allocation; for each worker
+  };
+  struct Round {
+    double time;  // seconds since the trace begins
+    std::vector<AppRound> apps;
+    double alloc_us;  // wall time of Allocator::poll_and_alloc
+    // after the allocation; for each worker
+    std::vector<bool> workers_parked;
+    std::vector<int> workers_num_files;
+  };
+
+  AllocSim(const Trace& trace, AllocSimOptions opts = {});
+
+  // simulate one stat window and the allocation after it
+  // @return false if the trace is over
+  bool step(Round& round);
+
+ private:
+  const Trace& trace;
+  // tenants[aid][wid]; declared before the allocator, which refers to them
+  std::vector<std::vector<std::unique_ptr<SimTenant>>> tenants;
+  std::vector<std::vector<ResrcAlloc>> base_resrc;  // [aid][wid]
+  SimAllocEnv* env;  // owned by the allocator
+  Allocator allocator;
+
+  uint64_t freq_cycles;
+  uint64_t window_cycles;
+  uint64_t now;
+};
+
+}  // namespace sched::sim
@@ -0,0 +1,164 @@
+/**
+ * fsAllocSim: replay a trace recorded by `fsMetricsDump -r` through the
+ * allocator and print the allocations and the predicted throughput (see
+ * AllocSim.h).
+ *
+ * Usage: fsAllocSim -t trace [-p flags] [-d cache_delta_mb] [-b max_batch]
+ *                   [-h preheat_ms] [-f freq_ms] [-w window_ms] [-s]
+ *   -p: policy flags as `fsMain -p` (e.g., NO_HARVEST,NO_SYMM_PARTITION)
+ *   -d: granularity of cache trading; default params::cache_delta
+ *   -b: max cache_delta per trade; default params::max_trade_batch
+ *   -h/-f/-w: preheat, allocation period and stat window; default
+ *       params::alloc
+ *   -s: only print the summary
+ *
+ * Each round prints one line per app:
+ *   round time_s aid active cache_mb bw_mbps cpu_cnt tp_mbps base_tp_mbps
+ * and the summary prints each app's mean throughput over the rounds after the
+ * first allocation, its improvement over the initial resources, and the
+ * minimum improvement, which is what the allocator maximizes, as well as the
+ * mean time an allocation takes.
+ */
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "AllocSim.h"
+#include "Param.h"
+#include "spdlog/spdlog.h"
+
+using namespace sched;
+
+static void usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s -t trace [-p flags] [-d cache_delta_mb] [-b max_batch] "
+          "[-h preheat_ms] [-f freq_ms] [-w window_ms] [-s]\n",
+          prog);
+}
+
+int main(int argc, char** argv) {
+  const char* trace_path = nullptr;
+  sim::AllocSimOptions opts;
+  bool summary_only = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:p:d:b:h:f:w:s")) != -1) {
+    switch (opt) {
+      case 't':
+        trace_path = optarg;
+        break;
+      case 'p': {
+        std::string_view flags(optarg);
+        while (!flags.empty()) {
+          auto pos = flags.find(',');
+          auto flag = flags.substr(0, pos);
+          if (!params::parse_policy_flag(flag)) {
+            fprintf(stderr, "Unknown policy flag: %.*s\n", int(flag.size()),
+                    flag.data());
+            return 1;
+          }
+          flags.remove_prefix(pos == flags.npos ? flags.size() : pos + 1);
+        }
+        break;
+      }
+      case 'd':
+        params::cache_delta = params::mb_to_blocks(atof(optarg));
+        params::min_cache_total = params::cache_delta;
+        break;
+      case 'b':
+        params::max_trade_batch = atoi(optarg);
+        break;
+      case 'h':
+        opts.preheat_us = atol(optarg) * 1000;
+        break;
+      case 'f':
+        opts.freq_us = atol(optarg) * 1000;
+        break;
+      case 'w':
+        opts.window_us = atol(optarg) * 1000;
+        break;
+      case 's':
+        summary_only = true;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (trace_path == nullptr || params::cache_delta == 0 ||
+      params::max_trade_batch == 0 ||
+      opts.window_us == 0 || opts.freq_us < opts.window_us) {
+    usage(argv[0]);
+    return 1;
+  }
+  // the allocator logs inactive apps at info level
+  spdlog::set_level(spdlog::level::warn);
+
+  std::ifstream in(trace_path);
+  if (!in) {
+    fprintf(stderr, "Cannot open trace %s\n", trace_path);
+    return 1;
+  }
+  sim::Trace trace;
+  if (auto err = trace.load(in); !err.empty()) {
+    fprintf(stderr, "%s: %s\n", trace_path, err.c_str());
+    return 1;
+  }
+
+  sim::AllocSim alloc_sim(trace, opts);
+  sim::AllocSim::Round round;
+  // rounds after the first allocation
+  std::vector<double> tp_sum(trace.num_apps), base_tp_sum(trace.num_apps);
+  int num_rounds = 0, num_alloc_rounds = 0;
+  double alloc_us_sum = 0;
+  bool allocated = false;
+  if (!summary_only)
+    printf("round time_s aid active cache_mb bw_mbps cpu_cnt tp_mbps "
+           "base_tp_mbps\n");
+  while (alloc_sim.step(round)) {
+    bool are_all_active = true;
+    for (int aid = 0; aid < trace.num_apps; ++aid) {
+      const auto& a = round.apps[aid];
+      are_all_active &= a.is_active;
+      if (allocated) {
+        tp_sum[aid] += a.tp;
+        base_tp_sum[aid] += a.base_tp;
+      }
+      if (summary_only) continue;
+      printf("%d %.1lf %d %d %.0lf %.1lf %.2lf %.1lf %.1lf\n", num_rounds,
+             round.time, aid, a.is_active,
+             params::blocks_to_mb(a.resrc.cache_size),
+             params::blocks_to_mb(a.resrc.bandwidth),
+             double(a.resrc.cpu_cycles) /
+                 params::worker_avail_cycles_per_second,
+             a.tp / 256, a.base_tp / 256);
+    }
+    if (allocated) ++num_alloc_rounds;
+    alloc_us_sum += round.alloc_us;
+    allocated |= are_all_active;  // with NO_ALLOC, the improvement is 0
+    ++num_rounds;
+  }
+
+  printf("# %d rounds, %d after the first allocation, %.1lf us/alloc\n",
+         num_rounds, num_alloc_rounds,
+         num_rounds > 0 ? alloc_us_sum / num_rounds : 0);
+  if (num_alloc_rounds == 0) return 0;
+  double min_improve = std::numeric_limits<double>::infinity();
+  for (int aid = 0; aid < trace.num_apps; ++aid) {
+    double tp = tp_sum[aid] / num_alloc_rounds;
+    double base_tp = base_tp_sum[aid] / num_alloc_rounds;
+    double improve = base_tp > 0 ? tp / base_tp - 1 : 0;
+    min_improve = std::min(min_improve, improve);
+    printf("# app %d: tp_mbps=%.1lf base_tp_mbps=%.1lf improve=%.2lf%%\n", aid,
+           tp / 256, base_tp / 256, improve * 100);
+  }
+  printf("# min_improve=%.2lf%%\n", min_improve * 100);
+  return 0;
+}
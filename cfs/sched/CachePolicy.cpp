@@ -0,0 +1,243 @@
+#include "CachePolicy.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <unordered_set>
+
+namespace sched {
+
+namespace {
+// cache policy of each app; only written at cmdline parsing
+std::unordered_map<int, CachePolicy> app_cache_policies;
+std::unordered_set<int> app_cache_bypass;
+std::unordered_map<int, uint32_t> app_meta_cache_quotas;
+}  // namespace
+
+const char *to_string(CachePolicy policy) {
+  switch (policy) {
+    case CachePolicy::LRU:
+      return "lru";
+    case CachePolicy::TWO_Q:
+      return "2q";
+    case CachePolicy::ARC:
+      return "arc";
+  }
+  return "unknown";
+}
+
+bool parse_cache_policy(std::string_view name, CachePolicy &policy) {
+  for (auto p : {CachePolicy::LRU, CachePolicy::TWO_Q, CachePolicy::ARC}) {
+    if (name == to_string(p)) {
+      policy = p;
+      return true;
+    }
+  }
+  return false;
+}
+
+void set_cache_policy(int aid, CachePolicy policy) {
+  app_cache_policies[aid] = policy;
+}
+
+CachePolicy get_cache_policy(int aid) {
+  auto it = app_cache_policies.find(aid);
+  return it == app_cache_policies.end() ? CachePolicy::LRU : it->second;
+}
+
+void set_cache_bypass(int aid, bool bypass) {
+  if (bypass)
+    app_cache_bypass.insert(aid);
+  else
+    app_cache_bypass.erase(aid);
+}
+
+bool get_cache_bypass(int aid) { return app_cache_bypass.contains(aid); }
+
+void set_meta_cache_quota(int aid, uint32_t blocks) {
+  app_meta_cache_quotas[aid] = blocks;
+}
+
+uint32_t get_meta_cache_quota(int aid) {
+  auto it = app_meta_cache_quotas.find(aid);
+  return it == app_meta_cache_quotas.end()
+             ? std::numeric_limits<uint32_t>::max()
+             : it->second;
+}
+
+/* CacheAdmission */
+
+void CacheAdmission::set_capacity(uint32_t c) {
+  uint32_t old_capacity = std::exchange(capacity, c);
+  switch (policy) {
+    case CachePolicy::LRU:
+      probation_target = 0;
+      return;
+    case CachePolicy::TWO_Q:
+      // Kin = 25%, Kout = 50% as suggested by the 2Q paper
+      probation_target = clamp_probation(capacity / 4);
+      break;
+    case CachePolicy::ARC:
+      // ARC starts with p = 0; keep the adapted share if resized
+      probation_target = old_capacity == 0
+                             ? clamp_probation(0)
+                             : clamp_probation(uint64_t(probation_target) *
+                                               capacity / old_capacity);
+      break;
+  }
+  trim(PROBATION);
+  trim(MAIN);
+}
+
+bool CacheAdmission::admit_to_probation(uint32_t key) {
+  if (policy == CachePolicy::LRU) return false;
+  auto it = history.find(key);
+  if (it == history.end()) {  // never seen recently: on probation
+    remember(key, PROBATION);
+    return true;
+  }
+  if (policy == CachePolicy::ARC) {
+    // the side the block was evicted from should have been larger; the delta
+    // is scaled by the ratio of the ghost sizes
+    uint32_t ghost_probation = get_ghost_size(PROBATION);
+    uint32_t ghost_main = get_ghost_size(MAIN);
+    int64_t target = probation_target;
+    if (it->second.side == PROBATION)
+      target += std::max(1U, ghost_main / ghost_probation);
+    else
+      target -= std::max(1U, ghost_probation / ghost_main);
+    probation_target = clamp_probation(target);
+  }
+  remember(key, MAIN);
+  return false;
+}
+
+void CacheAdmission::remember(uint32_t key, Side side) {
+  uint64_t seq = next_seq++;
+  auto [it, is_new] = history.try_emplace(key, HistoryEntry{side, seq});
+  if (!is_new) {
+    --history_size[it->second.side];
+    it->second = {side, seq};
+  }
+  ++history_size[side];
+  history_fifo[side].emplace_back(key, seq);
+  trim(side);
+}
+
+void CacheAdmission::trim(Side side) {
+  auto &fifo = history_fifo[side];
+  auto is_live = [&](const std::pair<uint32_t, uint64_t> &e) {
+    auto it = history.find(e.first);
+    return it != history.end() && it->second.seq == e.second;
+  };
+  uint32_t limit = get_history_limit(side);
+  while (!fifo.empty() && (history_size[side] > limit || !is_live(fifo.front()))) {
+    if (is_live(fifo.front())) {
+      history.erase(fifo.front().first);
+      --history_size[side];
+    }
+    fifo.pop_front();
+  }
+  // keys moved to the other side leave stale elements in the middle
+  if (fifo.size() > 2 * size_t(history_size[side]) + 64)
+    std::erase_if(fifo, [&](const auto &e) { return !is_live(e); });
+}
+
+uint32_t CacheAdmission::get_history_limit(Side side) const {
+  switch (policy) {
+    case CachePolicy::TWO_Q:
+      // A1in + A1out; main is plain LRU and needs no history
+      return side == PROBATION ? capacity / 4 + capacity / 2 : 0;
+    case CachePolicy::ARC:
+      // L1 = T1 + B1 and L2 = T2 + B2 are each bounded by the capacity
+      return capacity;
+    default:
+      return 0;
+  }
+}
+
+uint32_t CacheAdmission::get_ghost_size(Side side) const {
+  uint32_t in_cache =
+      side == PROBATION ? probation_target : capacity - probation_target;
+  return std::max(history_size[side], in_cache + 1) - in_cache;
+}
+
+uint32_t CacheAdmission::clamp_probation(int64_t target) const {
+  // neither side may be empty: an insertion into a tag without capacity fails
+  if (capacity < 2) return 0;
+  int64_t min_size = std::max(1U, capacity / 16);
+  return std::clamp(target, min_size, int64_t(capacity) - min_size);
+}
+
+/* PolicySim */
+
+PolicySim::PolicySim(CachePolicy policy, uint32_t capacity)
+    : admission(policy), capacity(capacity) {
+  admission.set_capacity(capacity);
+}
+
+bool PolicySim::access(uint32_t key) {
+  auto it = index.find(key);
+  if (it != index.end()) {
+    auto &[side, pos] = it->second;
+    if (side == 0 && admission.promotes_on_hit()) {
+      // same as BlockBuffer::promoteBlock: main evicts to make room
+      lru[0].erase(pos);
+      uint32_t main_cap = capacity - admission.get_probation_target();
+      if (!lru[1].empty() && lru[1].size() >= main_cap) evict(1);
+      lru[1].push_front(key);
+      it->second = {1, lru[1].begin()};
+      admission.on_promoted(key);
+      return true;
+    }
+    lru[side].splice(lru[side].begin(), lru[side], pos);
+    return true;
+  }
+  int side = admission.admit_to_probation(key) ? 0 : 1;
+  uint32_t probation_cap = admission.get_probation_target();
+  uint32_t caps[2] = {probation_cap, capacity - probation_cap};
+  // follow the adapted split, as BlockBuffer relocates between the two tags
+  for (int s = 0; s < 2; ++s)
+    while (lru[s].size() > caps[s]) evict(s);
+  if (caps[side] == 0) return false;
+  if (lru[side].size() >= caps[side]) evict(side);
+  lru[side].push_front(key);
+  index[key] = {side, lru[side].begin()};
+  return false;
+}
+
+void PolicySim::evict(int side) {
+  assert(!lru[side].empty());
+  index.erase(lru[side].back());
+  lru[side].pop_back();
+}
+
+/* SimGhostCache */
+
+SimGhostCache::SimGhostCache(CachePolicy policy, uint32_t tick,
+                             uint32_t min_size, uint32_t max_size)
+    : tick(tick), min_size(min_size), max_size(max_size) {
+  assert(tick > 0 && min_size <= max_size);
+  for (uint32_t size = min_size; size <= max_size; size += tick)
+    sims.emplace_back(policy, std::max(1U, size >> kSampleShift));
+  stats.resize(sims.size());
+}
+
+void SimGhostCache::access(uint32_t key, bool as_miss) {
+  if (!is_sampled(key)) return;
+  for (size_t i = 0; i < sims.size(); ++i) {
+    bool hit = sims[i].access(key);
+    if (hit && !as_miss)
+      ++stats[i].hit_cnt;
+    else
+      ++stats[i].miss_cnt;
+  }
+}
+
+const SimGhostCache::Stat &SimGhostCache::get_stat(uint32_t size) const {
+  assert(size >= min_size && size <= max_size);
+  assert((size - min_size) % tick == 0);
+  return stats[(size - min_size) / tick];
+}
+
+}  // namespace sched
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sched {
+
+/**
+ * Replacement policy of a tenant's cache partition.
+ *
+ * SharedCache only keeps one LRU list per tag, so a scan-resistant policy is
+ * built from two tags per tenant: a small probation partition that every new
+ * block enters, and a main partition that only admits a block that is missed
+ * again shortly after it left probation. A one-time scan thus only churns
+ * probation and never evicts the blocks that are re-referenced.
+ * - LRU: no probation; every block goes to the main partition (default)
+ * - TWO_Q: the "full" 2Q of Johnson & Shasha (VLDB'94): probation (A1in) is a
+ *     quarter of the partition and the ghost of it (A1out) remembers half the
+ *     partition worth of keys; like 2Q, a hit in probation does not promote
+ * - ARC: same two partitions as ARC's T1 and T2 (Megiddo & Modha, FAST'03):
+ *     a hit in probation promotes the block to main, and the probation share
+ *     is adapted with ARC's rule: a ghost hit of probation grows it and a
+ *     ghost hit of main shrinks it
+ */
+enum class CachePolicy : uint8_t { LRU, TWO_Q, ARC };
+
+const char *to_string(CachePolicy policy);
+// accept "lru", "2q" and "arc"
+// @return false if the name is unknown
+bool parse_cache_policy(std::string_view name, CachePolicy &policy);
+
+// Policy of each app (same on every worker); apps not set are LRU. Must be set
+// before the tenants are created (i.e., at cmdline parsing).
+void set_cache_policy(int aid, CachePolicy policy);
+CachePolicy get_cache_policy(int aid);
+
+// Apps whose whole-block reads skip the cache as if every file is opened with
+// O_DIRECT (e.g., a scan that would only churn its partition). It is set in the
+// same way as the policy and is independent of it: the blocks that still go
+// through the cache (partial blocks, writes, metadata) follow the policy.
+void set_cache_bypass(int aid, bool bypass);
+bool get_cache_bypass(int aid);
+
+// Blocks of the metadata buffers (inode sectors and bitmaps) an app may bring
+// in before the excess is charged to its cache share (see Tenant.h); apps not
+// set are unlimited. Set in the same way as the policy.
+void set_meta_cache_quota(int aid, uint32_t blocks);
+uint32_t get_meta_cache_quota(int aid);
+
+/**
+ * Decide which partition a missed block goes to and how large probation is.
+ * It only remembers the keys recently admitted to each partition: a miss on a
+ * remembered key means the block has been evicted from that partition, i.e.,
+ * a ghost hit, without having to observe the evictions of SharedCache.
+ */
+class CacheAdmission {
+ public:
+  explicit CacheAdmission(CachePolicy policy) : policy(policy) {}
+
+  CachePolicy get_policy() const { return policy; }
+  // whether the partition is split into probation and main
+  bool is_split() const { return policy != CachePolicy::LRU; }
+
+  // capacity of the whole partition (probation + main), in #blocks
+  void set_capacity(uint32_t c);
+  uint32_t get_capacity() const { return capacity; }
+  // the capacity probation should have; always 0 for LRU
+  uint32_t get_probation_target() const { return probation_target; }
+
+  // called on a miss
+  // @return whether to insert the block into probation (otherwise main)
+  bool admit_to_probation(uint32_t key);
+  // whether a hit in probation moves the block to main (ARC's T1 -> T2)
+  bool promotes_on_hit() const { return policy == CachePolicy::ARC; }
+  // called once a block hit in probation has been moved to main
+  void on_promoted(uint32_t key) { remember(key, MAIN); }
+
+ private:
+  enum Side : uint8_t { PROBATION = 0, MAIN = 1 };
+
+  void remember(uint32_t key, Side side);
+  void trim(Side side);
+  uint32_t get_history_limit(Side side) const;
+  // number of remembered keys that are no longer in the partition
+  uint32_t get_ghost_size(Side side) const;
+  uint32_t clamp_probation(int64_t target) const;
+
+  CachePolicy policy;
+  uint32_t capacity = 0;
+  uint32_t probation_target = 0;
+
+  struct HistoryEntry {
+    Side side;
+    uint64_t seq;
+  };
+  std::unordered_map<uint32_t, HistoryEntry> history;
+  // admission order of each side; an element is stale if the key has been
+  // admitted again since (sequence number mismatch)
+  std::deque<std::pair<uint32_t, uint64_t>> history_fifo[2];
+  uint32_t history_size[2] = {0, 0};
+  uint64_t next_seq = 0;
+};
+
+/**
+ * Key-only simulation of a tenant's cache partition under a policy: the same
+ * admission as the real partition and one LRU list per side.
+ */
+class PolicySim {
+ public:
+  PolicySim(CachePolicy policy, uint32_t capacity);
+
+  // @return whether it is a hit
+  bool access(uint32_t key);
+
+ private:
+  void evict(int side);
+
+  CacheAdmission admission;
+  uint32_t capacity;
+  // one list per CacheAdmission side; front is the most recently used
+  std::list<uint32_t> lru[2];
+  std::unordered_map<uint32_t, std::pair<int, std::list<uint32_t>::iterator>>
+      index;
+};
+
+/**
+ * Ghost cache for policies other than LRU. The split partitions are not a
+ * stack algorithm (the content at one size is not a subset of that at a larger
+ * size), so a single reuse-distance pass cannot give the whole curve. Instead,
+ * it runs one miniature simulation (Waldspurger et al., ATC'17) per size: a
+ * cache of size/2^kSampleShift fed with the accesses to the 1/2^kSampleShift
+ * of the blocks whose hash is sampled approximates the hit rate at full size.
+ * Like gcache::SampledGhostCache, the counters only count sampled accesses.
+ */
+class SimGhostCache {
+ public:
+  // same default sample rate as gcache::SampledGhostCache<>
+  constexpr static uint32_t kSampleShift = 5;
+
+  struct Stat {
+    uint64_t hit_cnt = 0;
+    uint64_t miss_cnt = 0;
+  };
+
+  SimGhostCache(CachePolicy policy, uint32_t tick, uint32_t min_size,
+                uint32_t max_size);
+
+  // whether the accesses to `key` are fed to the simulations; the ghost
+  // caches count 1/2^kSampleShift of the keys, so should anything added to
+  // their counters
+  static bool is_sampled(uint32_t key) {
+    // Fibonacci hashing; sample the keys whose top kSampleShift bits are 0
+    return ((key * 2654435769U) >> (32 - kSampleShift)) == 0;
+  }
+
+  // @param as_miss: update the simulations but count as a miss (e.g., writes)
+  void access(uint32_t key, bool as_miss);
+
+  // @param size: must be one of min_size + k * tick
+  const Stat &get_stat(uint32_t size) const;
+
+  uint32_t get_tick() const { return tick; }
+  uint32_t get_min_size() const { return min_size; }
+  uint32_t get_max_size() const { return max_size; }
+
+ private:
+  const uint32_t tick;
+  const uint32_t min_size;
+  const uint32_t max_size;
+  std::vector<PolicySim> sims;
+  std::vector<Stat> stats;
+};
+
+}  // namespace sched
@@ -0,0 +1,195 @@
+/**
+ * fsDispatchBench: measure the per-request overhead of the DO_SCHED dispatch
+ * in `FsProcWorker::workerRunLoopInner`, with the tenants' queues as
+ * std::queue (as before) and as RingQueue with the queue-length histograms
+ * (as now). Each loop does what the worker's does:
+ *   - poll: every tenant tops up its recv queue to `depth` outstanding
+ *     requests, and is charged the cycles of queuing them
+ *   - dispatch: `params::num_reqs_per_loop` times, sort the tenants by CPU
+ *     progress and serve the first one with work: pop a request from its recv
+ *     queue, which queues a block request and goes to the intl queue to wait
+ *     for it, and pop a request from its intl queue, which completes
+ *   - submit: drain every tenant's block queue
+ * The requests do no work, so the cycles are the dispatch overhead alone.
+ * The sort and the timestamps take most of them; so the cost of the queues
+ * alone is measured as well: a push and a pop of a block request on a queue
+ * holding `depth` of them.
+ *
+ * Usage: fsDispatchBench [-d depth] [-n num_reqs] [num_tenants ...]
+ *   -d: outstanding requests per tenant; default 32
+ *   -n: requests to complete for each tenant count; default 4000000
+ *   num_tenants: default 1 4 16 64
+ */
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "Param.h"
+#include "RingQueue.h"
+#include "perfutil/Cycles.h"
+
+using namespace sched;
+using PlatformLab::PerfUtils::Cycles;
+
+// stand-ins for the worker's requests; only their pointers are queued
+struct FsReq {};
+struct BlockReq {};
+
+template <typename T>
+using StdQueue = std::queue<T>;
+
+template <template <typename> class Queue, bool kHist>
+struct BenchTenant {
+  Queue<FsReq*> recv_queue;
+  Queue<FsReq*> intl_queue;
+  Queue<std::pair<BlockReq*, FsReq*>> blk_queue;
+  QlenHist recv_qlen_hist;
+  QlenHist intl_qlen_hist;
+  QlenHist blk_qlen_hist;
+  uint64_t cpu_prog{0};
+  uint32_t weight{params::min_weight};
+  int outstanding{0};
+  uint64_t next_req{1};
+
+  void add_recv_queue(FsReq* req) {
+    if (kHist) recv_qlen_hist.record(recv_queue.size());
+    recv_queue.push(req);
+  }
+  void add_intl_queue(FsReq* req) {
+    if (kHist) intl_qlen_hist.record(intl_queue.size());
+    intl_queue.push(req);
+  }
+  void add_blk_queue(BlockReq* blk_req, FsReq* req) {
+    if (kHist) blk_qlen_hist.record(blk_queue.size());
+    blk_queue.push({blk_req, req});
+  }
+  FsReq* pop(Queue<FsReq*>& q) {
+    if (q.empty()) return nullptr;
+    FsReq* req = q.front();
+    q.pop();
+    return req;
+  }
+  void record_cpu_consump(uint64_t cycles) {
+    cpu_prog += params::cycles_to_progress(cycles, weight);
+  }
+  bool can_sched() const { return !(recv_queue.empty() && intl_queue.empty()); }
+};
+
+// @return cycles per completed request
+template <template <typename> class Queue, bool kHist>
+static double run_one(int num_tenants, int depth, uint64_t num_reqs) {
+  using Tenant = BenchTenant<Queue, kHist>;
+  std::vector<Tenant> tenants(num_tenants);
+  std::vector<Tenant*> order;
+  for (auto& t : tenants) order.push_back(&t);
+  // spread the weights, so that the order changes as the tenants progress
+  for (int i = 0; i < num_tenants; ++i)
+    tenants[i].weight = params::min_weight + i % 8;
+
+  uint64_t num_done = 0;
+  uint64_t sink = 0;  // keeps the popped block requests alive
+  uint64_t begin_ts = Cycles::rdtsc();
+  while (num_done < num_reqs) {
+    for (auto& t : tenants) {  // poll
+      uint64_t ts = Cycles::rdtsc();
+      for (; t.outstanding < depth; ++t.outstanding)
+        t.add_recv_queue(reinterpret_cast<FsReq*>(t.next_req++ << 4));
+      t.record_cpu_consump(Cycles::rdtsc() - ts);
+    }
+    for (int i = 0; i < params::num_reqs_per_loop; ++i) {  // dispatch
+      std::sort(order.begin(), order.end(), [](Tenant* lhs, Tenant* rhs) {
+        return lhs->cpu_prog < rhs->cpu_prog;
+      });
+      bool has_work_done = false;
+      for (auto t : order) {
+        if (!t->can_sched()) continue;
+        uint64_t ts = Cycles::rdtsc();
+        if (FsReq* req = t->pop(t->recv_queue)) {
+          t->add_blk_queue(reinterpret_cast<BlockReq*>(req), req);
+          t->add_intl_queue(req);
+          has_work_done = true;
+        }
+        if (t->pop(t->intl_queue)) {
+          --t->outstanding;
+          ++num_done;
+          has_work_done = true;
+        }
+        t->record_cpu_consump(Cycles::rdtsc() - ts);
+        break;
+      }
+      if (!has_work_done) break;
+    }
+    for (auto& t : tenants) {  // submit
+      while (!t.blk_queue.empty()) {
+        sink += reinterpret_cast<uintptr_t>(t.blk_queue.front().first);
+        t.blk_queue.pop();
+      }
+    }
+  }
+  uint64_t cycles = Cycles::rdtsc() - begin_ts;
+  if (sink == 0) fprintf(stderr, "no block request submitted\n");
+  return double(cycles) / num_done;
+}
+
+// @return cycles per push and pop of a block request
+template <template <typename> class Queue>
+static double run_queue_ops(int depth, uint64_t num_ops) {
+  Queue<std::pair<BlockReq*, FsReq*>> q;
+  uint64_t sink = 0;
+  for (int i = 0; i < depth; ++i)
+    q.push({reinterpret_cast<BlockReq*>(uintptr_t(i) << 4), nullptr});
+  uint64_t begin_ts = Cycles::rdtsc();
+  for (uint64_t i = 0; i < num_ops; ++i) {
+    auto e = q.front();
+    q.pop();
+    sink += reinterpret_cast<uintptr_t>(e.first);
+    q.push(e);
+  }
+  uint64_t cycles = Cycles::rdtsc() - begin_ts;
+  if (sink == 0) fprintf(stderr, "nothing popped\n");
+  return double(cycles) / num_ops;
+}
+
+int main(int argc, char** argv) {
+  int depth = 32;
+  uint64_t num_reqs = 4'000'000;
+  int opt;
+  while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+    switch (opt) {
+      case 'd':
+        depth = atoi(optarg);
+        break;
+      case 'n':
+        num_reqs = atoll(optarg);
+        break;
+      default:
+        fprintf(stderr,
+                "Usage: %s [-d depth] [-n num_reqs] [num_tenants ...]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  std::vector<int> tenant_counts;
+  for (int i = optind; i < argc; ++i) tenant_counts.push_back(atoi(argv[i]));
+  if (tenant_counts.empty()) tenant_counts = {1, 4, 16, 64};
+
+  printf("depth=%d reqs=%lu (cycles/req)\n", depth, num_reqs);
+  printf("tenants | std::queue |   ring | ring+hist\n");
+  for (int n : tenant_counts) {
+    double std_cycles = run_one<StdQueue, false>(n, depth, num_reqs);
+    double ring_cycles = run_one<RingQueue, false>(n, depth, num_reqs);
+    double hist_cycles = run_one<RingQueue, true>(n, depth, num_reqs);
+    printf("%7d | %10.1lf | %6.1lf | %9.1lf\n", n, std_cycles, ring_cycles,
+           hist_cycles);
+  }
+  printf("queue ops: std::queue %.1lf, ring %.1lf cycles/(push+pop)\n",
+         run_queue_ops<StdQueue>(depth, num_reqs),
+         run_queue_ops<RingQueue>(depth, num_reqs));
+  return 0;
+}
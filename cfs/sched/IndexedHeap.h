@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace sched {
+
+/**
+ * A binary heap over ids [0, n) whose keys can be updated in place; `top` is
+ * the id with the best key under `Better` (ties go to the smaller id). The
+ * allocator keeps one trade offer per app in it, so a trade, which changes the
+ * offers of two apps only, costs O(log n) instead of a scan over all apps.
+ */
+template <typename Key, typename Better = std::greater<Key>>
+class IndexedHeap {
+  std::vector<Key> keys;    // id -> key
+  std::vector<int> heap;    // heap order -> id
+  std::vector<size_t> pos;  // id -> index in `heap`
+  Better better;
+
+ public:
+  explicit IndexedHeap(std::vector<Key> init_keys)
+      : keys(std::move(init_keys)), heap(keys.size()), pos(keys.size()) {
+    for (size_t i = 0; i < keys.size(); ++i) {
+      heap[i] = int(i);
+      pos[i] = i;
+    }
+    for (size_t i = heap.size() / 2; i-- > 0;) sift_down(i);
+  }
+
+  size_t size() const { return heap.size(); }
+  const Key& get_key(int id) const { return keys[id]; }
+
+  int top() const {
+    assert(!heap.empty());
+    return heap[0];
+  }
+
+  // the best id except `top`; requires at least two ids
+  int second() const {
+    assert(heap.size() >= 2);
+    if (heap.size() == 2 || before(heap[1], heap[2])) return heap[1];
+    return heap[2];
+  }
+
+  void update(int id, Key key) {
+    keys[id] = std::move(key);
+    size_t i = pos[id];
+    if (i > 0 && before(id, heap[(i - 1) / 2]))
+      sift_up(i);
+    else
+      sift_down(i);
+  }
+
+ private:
+  bool before(int lhs, int rhs) const {
+    if (better(keys[lhs], keys[rhs])) return true;
+    if (better(keys[rhs], keys[lhs])) return false;
+    return lhs < rhs;
+  }
+
+  void swap_at(size_t i, size_t j) {
+    std::swap(heap[i], heap[j]);
+    pos[heap[i]] = i;
+    pos[heap[j]] = j;
+  }
+
+  void sift_up(size_t i) {
+    while (i > 0) {
+      size_t parent = (i - 1) / 2;
+      if (!before(heap[i], heap[parent])) break;
+      swap_at(i, parent);
+      i = parent;
+    }
+  }
+
+  void sift_down(size_t i) {
+    while (true) {
+      size_t best = i;
+      size_t l = 2 * i + 1, r = 2 * i + 2;
+      if (l < heap.size() && before(heap[l], heap[best])) best = l;
+      if (r < heap.size() && before(heap[r], heap[best])) best = r;
+      if (best == i) break;
+      swap_at(i, best);
+      i = best;
+    }
+  }
+};
+
+}  // namespace sched
@@ -0,0 +1,102 @@
+#include "Metrics.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include "spdlog/spdlog.h"
+
+namespace sched::metrics {
+
+static std::atomic<Page*> g_page{nullptr};
+static std::string g_shm_name;
+
+Page* create_page(int num_workers, int num_apps, int num_devs,
+                  const char* shm_name) {
+  if (num_workers > max_workers || num_apps > max_apps ||
+      num_devs > max_devs) {
+    SPDLOG_WARN(
+        "Metrics page supports up to {} workers, {} apps and {} devices; got "
+        "{} workers, {} apps and {} devices, metrics disabled",
+        max_workers, max_apps, max_devs, num_workers, num_apps, num_devs);
+    return nullptr;
+  }
+
+  int fd = shm_open(shm_name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0) {
+    SPDLOG_WARN("Fail to create metrics page {}: {}", shm_name,
+                strerror(errno));
+    return nullptr;
+  }
+  if (ftruncate(fd, sizeof(Page)) != 0) {
+    SPDLOG_WARN("Fail to resize metrics page {}: {}", shm_name,
+                strerror(errno));
+    close(fd);
+    shm_unlink(shm_name);
+    return nullptr;
+  }
+  void* addr =
+      mmap(nullptr, sizeof(Page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    SPDLOG_WARN("Fail to map metrics page {}: {}", shm_name, strerror(errno));
+    shm_unlink(shm_name);
+    return nullptr;
+  }
+
+  Page* page = new (addr) Page();
+  page->header.version = page_version;
+  page->header.num_workers = num_workers;
+  page->header.num_apps = num_apps;
+  page->header.num_devs = num_devs;
+  page->header.ghost_min_size = params::ghost::min_size;
+  page->header.ghost_max_size = params::ghost::max_size;
+  page->header.ghost_tick = params::ghost::tick;
+  page->header.cycles_per_second = params::cycles_per_second;
+  // a reader only trusts the page after seeing the magic number
+  std::atomic_thread_fence(std::memory_order_release);
+  page->header.magic = page_magic;
+
+  g_shm_name = shm_name;
+  g_page.store(page, std::memory_order_release);
+  SPDLOG_INFO("Metrics page created: {} ({} bytes)", shm_name, sizeof(Page));
+  return page;
+}
+
+void destroy_page() {
+  Page* page = g_page.exchange(nullptr, std::memory_order_acq_rel);
+  if (page == nullptr) return;
+  munmap(page, sizeof(Page));
+  shm_unlink(g_shm_name.c_str());
+}
+
+Page* get_page() { return g_page.load(std::memory_order_acquire); }
+
+const Page* attach_page(const char* shm_name) {
+  int fd = shm_open(shm_name, O_RDONLY, 0);
+  if (fd < 0) return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Page)) {
+    close(fd);  // not created by a compatible FsProc (or not resized yet)
+    return nullptr;
+  }
+  void* addr = mmap(nullptr, sizeof(Page), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return nullptr;
+  auto page = reinterpret_cast<const Page*>(addr);
+  if (page->header.magic != page_magic ||
+      page->header.version != page_version) {
+    munmap(addr, sizeof(Page));
+    return nullptr;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return page;
+}
+
+}  // namespace sched::metrics
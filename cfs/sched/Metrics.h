@@ -0,0 +1,201 @@
+/**
+ * This file defines a shared-memory metrics page, which exports the scheduler,
+ * cache and device state to an external process (e.g., `fsMetricsDump` or a
+ * monitoring daemon) without going through the log.
+ *
+ * The page is created by FsProc when the allocator starts. Each slot has
+ * exactly one writer: a worker owns its worker slot and the tenant slots of its
+ * row; the allocator owns the app slots. Writers publish a snapshot every
+ * `publish_interval_cycles` instead of on every request, so the request path
+ * only pays one timestamp comparison. Every slot is aligned to its own cache
+ * line(s) to avoid false sharing between workers, and is guarded by a seqlock
+ * so a reader never observes a torn snapshot.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "Param.h"
+#include "Resrc.h"
+
+namespace sched::metrics {
+
+constexpr static const char* default_shm_name = "/bunnyfs_metrics";
+constexpr static uint64_t page_magic = 0x4255'4e4e'594d'4554UL;  // BUNNYMET
+constexpr static uint32_t page_version = 9;
+
+// capacity of the page; the actual numbers are recorded in the page header
+constexpr static int max_workers = 32;
+constexpr static int max_apps = 64;
+constexpr static int max_devs = 8;
+constexpr static uint32_t max_ghost_ticks = 64;
+static_assert(params::ghost::num_ticks <= max_ghost_ticks,
+              "Metrics page cannot hold the whole ghost cache curve!");
+
+// publish every 10 ms; frequent enough for a dashboard, rare enough to be
+// negligible in the worker loop
+constexpr static uint64_t publish_interval_cycles =
+    params::cycles_per_second / 100;
+
+constexpr static size_t cache_line_size = 64;
+
+// single-writer sequence lock: an odd sequence number means the writer is in
+// the middle of an update
+class SeqLock {
+  std::atomic_uint64_t seq{0};
+
+ public:
+  void write_begin() {
+    seq.store(seq.load(std::memory_order_relaxed) + 1,
+              std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  void write_end() {
+    seq.store(seq.load(std::memory_order_relaxed) + 1,
+              std::memory_order_release);
+  }
+  uint64_t read_begin() const {
+    uint64_t s;
+    while ((s = seq.load(std::memory_order_acquire)) & 1)
+      ;  // the writer is updating; spin
+    return s;
+  }
+  bool read_retry(uint64_t s) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return seq.load(std::memory_order_relaxed) != s;
+  }
+};
+
+template <typename T>
+struct alignas(cache_line_size) Slot {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Slot data must be trivially copyable!");
+  SeqLock lock;
+  T data;
+
+  // only called by the slot's owner
+  void store(const T& d) {
+    lock.write_begin();
+    std::memcpy(&data, &d, sizeof(T));
+    lock.write_end();
+  }
+
+  T load() const {
+    T d;
+    uint64_t s;
+    do {
+      s = lock.read_begin();
+      std::memcpy(&d, &data, sizeof(T));
+    } while (lock.read_retry(s));
+    return d;
+  }
+};
+
+struct WorkerStat {
+  uint64_t update_ts;    // rdtsc when published; 0 if never published
+  double idle_ratio;     // idleness in the last `IdleStat` window
+  uint32_t num_tenants;  // number of tenants served by this worker
+  int32_t dev_inflight;  // requests submitted to the device but not completed
+  int32_t dev_inflight_limit;  // adaptive limit of dev_inflight
+  bool parked;  // parked by the allocator (policy::elastic_workers)
+  int32_t numa_node;  // of the worker's core; -1 if unknown
+};
+
+struct TenantStat {
+  uint64_t update_ts;  // rdtsc when published; 0 if never published
+  int32_t wid;
+  int32_t aid;
+
+  ResrcAlloc resrc;  // allocated resources on this worker
+  ResrcAcct acct;    // accumulated consumption (since the last reset)
+
+  // rate limiter
+  int64_t rate_limit_bandwidth;  // unit: #blocks/second
+  bool rate_limit_on;
+
+  // queues and migration
+  uint32_t recv_qlen;
+  uint32_t intl_qlen;
+  uint32_t blk_qlen;
+  int32_t num_reqs_inflight;
+  int32_t num_reqs_held;  // held until their inode is migrated
+  // lengths seen by the requests queued since the start (see QlenHist in
+  // RingQueue.h)
+  uint64_t recv_qlen_hist[params::qlen_hist_buckets];
+  uint64_t intl_qlen_hist[params::qlen_hist_buckets];
+  uint64_t blk_qlen_hist[params::qlen_hist_buckets];
+
+  uint32_t cache_used;         // unit: #blocks
+  uint32_t client_cache_used;  // pages held in the client cache; #blocks
+  uint32_t meta_cache_used;    // metadata brought in; #blocks
+  uint32_t num_files;          // files of the app served by this worker
+
+  // block requests queued for each device the data is striped over
+  int32_t num_devs;
+  uint64_t dev_io_cnt[max_devs];
+
+  // ghost cache miss ratio curve; the i-th entry is for cache size
+  // `ghost_min_size + i * ghost_tick` in the page header
+  uint32_t ghost_num_ticks;
+  uint64_t ghost_hit_cnt[max_ghost_ticks];
+  uint64_t ghost_miss_cnt[max_ghost_ticks];
+};
+
+struct AppStat {
+  uint64_t update_ts;  // rdtsc when published; 0 if never published
+  int32_t aid;
+  bool is_active;        // whether made progress in the last stat window
+  uint64_t alloc_round;  // number of allocation done so far
+  ResrcAlloc resrc;      // total allocated resources across workers
+  int32_t numa_node;     // where the app's memory is; -1 if unknown
+};
+
+struct PageHeader {
+  uint64_t magic;
+  uint32_t version;
+  int32_t num_workers;
+  int32_t num_apps;
+  int32_t num_devs;
+  uint32_t ghost_min_size;
+  uint32_t ghost_max_size;
+  uint32_t ghost_tick;
+  uint64_t cycles_per_second;
+};
+
+struct Page {
+  alignas(cache_line_size) PageHeader header;
+  Slot<WorkerStat> workers[max_workers];
+  Slot<AppStat> apps[max_apps];
+  Slot<TenantStat> tenants[max_workers][max_apps];
+};
+
+/**
+ * @brief Create the metrics page in shared memory and make it visible to the
+ * workers and the allocator via `get_page()`. Failure is not fatal: no metrics
+ * will be published.
+ *
+ * @return Page* The page created; nullptr on failure.
+ */
+Page* create_page(int num_workers, int num_apps, int num_devs = 1,
+                  const char* shm_name = default_shm_name);
+
+/**
+ * @brief Unmap and unlink the page created by `create_page`.
+ */
+void destroy_page();
+
+// nullptr if the page is not created (yet)
+Page* get_page();
+
+/**
+ * @brief Attach to an existing metrics page as a reader.
+ *
+ * @return const Page* nullptr if it does not exist or is not compatible.
+ */
+const Page* attach_page(const char* shm_name = default_shm_name);
+
+}  // namespace sched::metrics
@@ -0,0 +1,243 @@
+/**
+ * fsMetricsDump: print the metrics page exported by FsProc (see Metrics.h).
+ *
+ * Usage: fsMetricsDump [-n shm_name] [-i interval_ms] [-g] [-q] [-r trace]
+ *   -n: name of the metrics page; default "/bunnyfs_metrics"
+ *   -i: if > 0, keep dumping every `interval_ms`; otherwise, dump once
+ *   -g: also print each tenant's ghost cache miss ratio curve
+ *   -q: also print each tenant's queue-length histograms
+ *   -r: instead of printing, record the tenants' snapshots to `trace` every
+ *       `interval_ms` until killed; replay it with fsAllocSim (AllocSim.h)
+ *
+ * With the data striped over several devices, the block requests of each
+ * tenant to each device are printed below it (and recorded as D lines).
+ */
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "Metrics.h"
+
+using namespace sched::metrics;
+
+static double blocks_to_mb(uint64_t blocks) { return double(blocks) / 256; }
+
+// one line of the non-empty buckets of a queue-length histogram, e.g.,
+// "recv qlen%: 0=80.0 1=15.0 2-3=5.0"
+static void print_qlen_hist(const char* name, const uint64_t* hist) {
+  uint64_t total = 0;
+  for (uint32_t b = 0; b < sched::params::qlen_hist_buckets; ++b)
+    total += hist[b];
+  printf("        %s qlen%%:", name);
+  for (uint32_t b = 0; b < sched::params::qlen_hist_buckets; ++b) {
+    if (hist[b] == 0) continue;
+    uint64_t lo = b == 0 ? 0 : 1UL << (b - 1);
+    uint64_t hi = b == 0 ? 0 : (1UL << b) - 1;
+    if (b == sched::params::qlen_hist_buckets - 1) {
+      printf(" %lu+", lo);
+    } else if (lo == hi) {
+      printf(" %lu", lo);
+    } else {
+      printf(" %lu-%lu", lo, hi);
+    }
+    printf("=%.1lf", 100.0 * hist[b] / total);
+  }
+  printf("\n");
+}
+
+static void dump(const Page* page, bool print_ghost, bool print_qlen) {
+  const auto& header = page->header;
+  double cycles_per_us = header.cycles_per_second / 1e6;
+
+  printf("=== Workers ===\n");
+  printf(
+      "wid | age_ms | idle%% | tenants | dev_inflight | limit | parked | "
+      "node\n");
+  uint64_t latest_ts = 0;
+  for (int wid = 0; wid < header.num_workers; ++wid) {
+    auto ws = page->workers[wid].load();
+    latest_ts = std::max(latest_ts, ws.update_ts);
+  }
+  auto age_ms = [&](uint64_t ts) {
+    return ts == 0 || ts > latest_ts ? 0.0
+                                     : (latest_ts - ts) / cycles_per_us / 1e3;
+  };
+  for (int wid = 0; wid < header.num_workers; ++wid) {
+    auto ws = page->workers[wid].load();
+    if (ws.update_ts == 0) continue;
+    printf("%3d | %6.1lf | %5.1lf | %7u | %12d | %5d | %6s | %4d\n", wid,
+           age_ms(ws.update_ts), ws.idle_ratio * 100, ws.num_tenants,
+           ws.dev_inflight, ws.dev_inflight_limit, ws.parked ? "yes" : "no",
+           ws.numa_node);
+  }
+
+  printf("=== Apps (allocator) ===\n");
+  printf("aid | round | active | cache_MB |  bw_MB/s | cpu_Mcyc/s | node\n");
+  for (int aid = 0; aid < header.num_apps; ++aid) {
+    auto as = page->apps[aid].load();
+    if (as.update_ts == 0) continue;
+    printf("%3d | %5lu | %6s | %8.1lf | %8.1lf | %10.1lf | %4d\n", aid,
+           as.alloc_round, as.is_active ? "yes" : "no",
+           blocks_to_mb(as.resrc.cache_size), blocks_to_mb(as.resrc.bandwidth),
+           as.resrc.cpu_cycles / 1e6, as.numa_node);
+  }
+
+  printf("=== Tenants ===\n");
+  printf(
+      "wid aid | cache_MB used_MB cli_MB meta_MB | bw_MB/s rl_MB/s rl | "
+      "cpu_Mcyc/s | done_MB io_MB cpu_Gcyc | recv intl blk infl held\n");
+  for (int wid = 0; wid < header.num_workers; ++wid) {
+    for (int aid = 0; aid < header.num_apps; ++aid) {
+      auto ts = page->tenants[wid][aid].load();
+      if (ts.update_ts == 0) continue;
+      printf(
+          "%3d %3d | %8.1lf %7.1lf %6.1lf %7.1lf | %7.1lf %7.1lf %2s | "
+          "%10.1lf | %7.1lf %5.1lf %8.3lf | %4u %4u %3u %4d %4d\n",
+          wid, aid, blocks_to_mb(ts.resrc.cache_size),
+          blocks_to_mb(ts.cache_used), blocks_to_mb(ts.client_cache_used),
+          blocks_to_mb(ts.meta_cache_used),
+          blocks_to_mb(ts.resrc.bandwidth),
+          blocks_to_mb(ts.rate_limit_bandwidth), ts.rate_limit_on ? "on" : "-",
+          ts.resrc.cpu_cycles / 1e6, blocks_to_mb(ts.acct.num_blks_done),
+          blocks_to_mb(ts.acct.bw_consump), ts.acct.cpu_consump / 1e9,
+          ts.recv_qlen, ts.intl_qlen, ts.blk_qlen, ts.num_reqs_inflight,
+          ts.num_reqs_held);
+      if (ts.num_devs > 1) {
+        printf("        dev io:");
+        for (int dev = 0; dev < ts.num_devs; ++dev)
+          printf(" %d=%lu", dev, ts.dev_io_cnt[dev]);
+        printf("\n");
+      }
+      if (print_qlen) {
+        print_qlen_hist("recv", ts.recv_qlen_hist);
+        print_qlen_hist("intl", ts.intl_qlen_hist);
+        print_qlen_hist("blk", ts.blk_qlen_hist);
+      }
+      if (!print_ghost) continue;
+      printf("        ghost miss%%:");
+      for (uint32_t i = 0; i < ts.ghost_num_ticks; ++i) {
+        uint64_t acc = ts.ghost_hit_cnt[i] + ts.ghost_miss_cnt[i];
+        uint32_t c = header.ghost_min_size + i * header.ghost_tick;
+        printf(" %.0lfMB=%.1lf", blocks_to_mb(c),
+               acc == 0 ? 100.0 : 100.0 * ts.ghost_miss_cnt[i] / acc);
+      }
+      printf("\n");
+    }
+  }
+  fflush(stdout);
+}
+
+// append the tenants published since the last call in the trace format of
+// AllocSim.h, and the NUMA nodes that have changed
+static void record(const Page* page, FILE* trace,
+                   std::vector<uint64_t>& last_ts,
+                   std::vector<int>& last_nodes) {
+  const auto& header = page->header;
+  for (int wid = 0; wid < header.num_workers; ++wid) {
+    auto ws = page->workers[wid].load();
+    if (ws.update_ts == 0 || ws.numa_node == last_nodes[wid]) continue;
+    last_nodes[wid] = ws.numa_node;
+    fprintf(trace, "W %d %d\n", wid, ws.numa_node);
+  }
+  for (int aid = 0; aid < header.num_apps; ++aid) {
+    auto as = page->apps[aid].load();
+    auto& last = last_nodes[header.num_workers + aid];
+    if (as.update_ts == 0 || as.numa_node == last) continue;
+    last = as.numa_node;
+    fprintf(trace, "A %d %d\n", aid, as.numa_node);
+  }
+  for (int wid = 0; wid < header.num_workers; ++wid) {
+    for (int aid = 0; aid < header.num_apps; ++aid) {
+      auto ts = page->tenants[wid][aid].load();
+      auto& last = last_ts[wid * header.num_apps + aid];
+      if (ts.update_ts == 0 || ts.update_ts == last) continue;
+      last = ts.update_ts;
+      fprintf(trace, "T %lu %d %d %u %u %ld %ld %ld %ld %ld %u", ts.update_ts,
+              wid, aid, ts.num_files, ts.resrc.cache_size, ts.resrc.bandwidth,
+              ts.resrc.cpu_cycles, ts.acct.num_blks_done, ts.acct.bw_consump,
+              ts.acct.cpu_consump, ts.ghost_num_ticks);
+      for (uint32_t i = 0; i < ts.ghost_num_ticks; ++i)
+        fprintf(trace, " %lu %lu", ts.ghost_hit_cnt[i], ts.ghost_miss_cnt[i]);
+      fprintf(trace, "\n");
+      if (ts.num_devs <= 1) continue;
+      fprintf(trace, "D %d %d %d", wid, aid, ts.num_devs);
+      for (int dev = 0; dev < ts.num_devs; ++dev)
+        fprintf(trace, " %lu", ts.dev_io_cnt[dev]);
+      fprintf(trace, "\n");
+    }
+  }
+  fflush(trace);
+}
+
+int main(int argc, char** argv) {
+  const char* shm_name = default_shm_name;
+  int interval_ms = 0;
+  bool print_ghost = false;
+  bool print_qlen = false;
+  const char* trace_path = nullptr;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:i:gqr:")) != -1) {
+    switch (opt) {
+      case 'n':
+        shm_name = optarg;
+        break;
+      case 'i':
+        interval_ms = atoi(optarg);
+        break;
+      case 'g':
+        print_ghost = true;
+        break;
+      case 'q':
+        print_qlen = true;
+        break;
+      case 'r':
+        trace_path = optarg;
+        break;
+      default:
+        fprintf(stderr,
+                "Usage: %s [-n shm_name] [-i interval_ms] [-g] [-q] "
+                "[-r trace]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+
+  const Page* page = attach_page(shm_name);
+  if (page == nullptr) {
+    fprintf(stderr, "Cannot attach to metrics page %s\n", shm_name);
+    return 1;
+  }
+
+  if (trace_path) {
+    FILE* trace = fopen(trace_path, "w");
+    if (trace == nullptr) {
+      fprintf(stderr, "Cannot open %s\n", trace_path);
+      return 1;
+    }
+    const auto& header = page->header;
+    fprintf(trace, "H %d %d %u %u %u %lu\n", header.num_workers,
+            header.num_apps, header.ghost_min_size, header.ghost_max_size,
+            header.ghost_tick, header.cycles_per_second);
+    std::vector<uint64_t> last_ts(header.num_workers * header.num_apps);
+    std::vector<int> last_nodes(header.num_workers + header.num_apps, -1);
+    while (true) {
+      record(page, trace, last_ts, last_nodes);
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(std::max(interval_ms, 1)));
+    }
+  }
+
+  while (true) {
+    dump(page, print_ghost, print_qlen);
+    if (interval_ms <= 0) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    printf("\n");
+  }
+  return 0;
+}
@@ -26,8 +26,47 @@ bool cache_partition = true;
 
 bool unlimited_bandwidth_if_unpopulated_cache = true;
 
+bool dev_capacity_cap = true;
+
+bool elastic_workers = false;
+
+bool numa_affinity = true;
+
 }  // namespace policy
 
+bool parse_policy_flag(std::string_view name) {
+  if (name == "NO_ALLOC") {
+    policy::alloc_enabled = false;
+  } else if (name == "NO_HARVEST") {
+    policy::harvest_enabled = false;
+  } else if (name == "NO_SYMM_PARTITION") {
+    policy::symm_partition = false;
+  } else if (name == "NO_AVOID_TINY_WEIGHT") {
+    policy::avoid_tiny_weight = false;
+  } else if (name == "NO_CACHE_PARTITION") {
+    policy::cache_partition = false;
+  } else if (name == "NO_DEV_CAPACITY_CAP") {
+    policy::dev_capacity_cap = false;
+  } else if (name == "ELASTIC_WORKERS") {
+    policy::elastic_workers = true;
+  } else if (name == "NO_NUMA_AFFINITY") {
+    policy::numa_affinity = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+#ifdef ALLOC_FINE_GRAINED
+uint32_t cache_delta = mb_to_blocks(4);
+#else
+uint32_t cache_delta = mb_to_blocks(32);
+#endif
+
+uint32_t min_cache_total = cache_delta;
+
+uint32_t max_trade_batch = 16;
+
 void log_params() {
   SPDLOG_INFO(
       "Policy flags: "
@@ -38,7 +77,10 @@ void log_params() {
       "avoid_tiny_weight={}, "
       "strict_cpu_usage={}, "
       "cache_partition={}, "
-      "unlimited_bandwidth_if_unpopulated_cache={}",
+      "unlimited_bandwidth_if_unpopulated_cache={}, "
+      "dev_capacity_cap={}, "
+      "elastic_workers={}, "
+      "numa_affinity={}",
       sched::params::policy::strict_weight_distr,
       sched::params::policy::alloc_enabled,
       sched::params::policy::harvest_enabled,
@@ -46,11 +88,15 @@ void log_params() {
       sched::params::policy::avoid_tiny_weight,
       sched::params::policy::strict_cpu_usage,
       sched::params::policy::cache_partition, 
-      sched::params::policy::unlimited_bandwidth_if_unpopulated_cache);
+      sched::params::policy::unlimited_bandwidth_if_unpopulated_cache,
+      sched::params::policy::dev_capacity_cap,
+      sched::params::policy::elastic_workers,
+      sched::params::policy::numa_affinity);
   SPDLOG_INFO(
       "Other params: "
       "cache_delta={}MB, "
       "min_cache_total={}MB, "
+      "max_trade_batch={}, "
       "ghost::min_size={}MB, "
       "ghost::max_size={}MB, "
       "ghost::tick={}MB, "
@@ -59,6 +105,7 @@ void log_params() {
       "alloc::stat_coll_window_us={}, "
       "alloc::unlimited_bandwidth_window_us={}",
       blocks_to_mb_int(cache_delta), blocks_to_mb_int(min_cache_total),
+      max_trade_batch,
       blocks_to_mb_int(ghost::min_size), blocks_to_mb_int(ghost::max_size),
       blocks_to_mb_int(ghost::tick), alloc::preheat_window_us, alloc::freq_us,
       alloc::stat_coll_window_us, alloc::unlimited_bandwidth_window_us);
@@ -3,6 +3,7 @@
 #include <cassert>
 #include <cstdint>
 #include <limits>
+#include <string_view>
 
 namespace sched::params {
 
@@ -50,8 +51,27 @@ extern bool cache_partition;
 // TODO: use separated rate limiting mechanisms for read and write bandwidth
 extern bool unlimited_bandwidth_if_unpopulated_cache;
 
+// whether cap the total bandwidth to distribute by the device throughput the
+// workers measure (see QueueDepthController); the configured total is used
+// until the device gets saturated, and is never exceeded
+extern bool dev_capacity_cap;
+
+// whether consolidate tenants onto fewer workers when the CPU demand is low,
+// parking the workers left without any tenant's files (see params::elastic);
+// requires asymmetric partition, since it relies on inode migration
+extern bool elastic_workers;
+
+// whether prefer the workers on an app's NUMA node when asymmetric partition
+// places its weight, so that its requests are served by the socket its memory
+// is on; no effect if the nodes are unknown (e.g., a single-socket machine)
+extern bool numa_affinity;
+
 }  // namespace policy
 
+// set a policy flag by its cmdline name (e.g., "NO_HARVEST")
+// @return false if there is no such flag
+bool parse_policy_flag(std::string_view name);
+
 /** Some independent parameters **/
 
 // in each workerRunLoopInner, process how many requests; this controls the
@@ -59,6 +79,12 @@ extern bool unlimited_bandwidth_if_unpopulated_cache;
 // the device, etc)
 constexpr static int num_reqs_per_loop = 3;
 
+// initial capacity of each request queue of a tenant (see RingQueue.h); a
+// queue doubles if a backlog outgrows it
+constexpr static uint32_t queue_init_capacity = 256;
+// buckets of a queue-length histogram: 0, [1, 2), [2, 4), ..., [1024, inf)
+constexpr static uint32_t qlen_hist_buckets = 12;
+
 // if a hit rate is larger than this, we consider this client as all hit; this
 // helps to solve the problem of rounding error of float-point number
 constexpr static double full_hit_threshold = 0.999;
@@ -67,6 +93,14 @@ constexpr static double full_hit_threshold = 0.999;
 constexpr static uint32_t max_trade_round =
     std::numeric_limits<uint32_t>::max();
 
+// when the marginal gains of a trade are flat, trade up to this many
+// cache_delta at once (1 disables batching); the offline simulator may sweep it
+extern uint32_t max_trade_batch;
+
+// the marginal gains are flat if each extra cache_delta of a batch still
+// harvests at least (1 - trade_batch_flatness) of what the first one does
+constexpr static double trade_batch_flatness = 0.05;
+
 /** CPU/weight-related parameters **/
 
 // NOTE: rdtsc has stable frequency, which differs from the actual CPU frequency
@@ -128,16 +162,16 @@ constexpr static inline uint64_t blocks_to_mb_int(uint64_t blocks) {
   return blocks / 256;  // no float-point number
 }
 constexpr static inline uint64_t mb_to_blocks(double mb) { return mb * 256; }
+// the inode buffer caches 512-byte sectors instead of 4 KB blocks
+constexpr static uint32_t sectors_per_block = 8;
 
-#ifdef ALLOC_FINE_GRAINED
-constexpr static uint32_t cache_delta = mb_to_blocks(4);
-#else
-constexpr static uint32_t cache_delta = mb_to_blocks(32);
-#endif
+// the granularity of cache trading; mb_to_blocks(4) if ALLOC_FINE_GRAINED,
+// otherwise mb_to_blocks(32); the offline simulator may sweep it
+extern uint32_t cache_delta;
 
 // limite the least amount of cache that a tenant could have (no more trading
-// beyond this point)
-constexpr static uint32_t min_cache_total = cache_delta;
+// beyond this point); same as cache_delta
+extern uint32_t min_cache_total;
 
 // the minimum bandwidth; this ensures a client could still make progress even
 // the allocator "thinks" it is fully hit and does not need any bandwidth; this
@@ -192,6 +226,27 @@ namespace rate {
 constexpr static uint64_t cycles_per_frame = 1024UL * 1024UL * 256UL;  // ~0.12s
 }  // namespace rate
 
+/* Elastic worker parameters (policy::elastic_workers) */
+namespace elastic {
+// keep enough workers active to serve the CPU demand with this much spare, so
+// that a small growth does not need a worker to be unparked
+constexpr static double headroom = 0.25;
+// park workers only after the demand has stayed low for this many allocations
+// in a row; unparking happens as soon as the demand grows
+constexpr static uint32_t park_patience = 3;
+// a parked worker wakes up this often (us) to serve its app rings; a message
+// from another worker wakes it up at once
+constexpr static uint32_t parked_nap_us = 1000;
+}  // namespace elastic
+
+/* Warm restart parameters (see Snapshot.h) */
+namespace warm {
+// prefetch restored blocks in batches at no more than this rate, so that a
+// restart does not saturate a device shared with others
+constexpr static int64_t prefetch_bandwidth = mb_to_blocks(1024);  // #blocks/s
+constexpr static uint32_t prefetch_batch = 256;                     // 1 MB
+}  // namespace warm
+
 // log down all compile-time/runtime mutable and other major params
 void log_params();
 
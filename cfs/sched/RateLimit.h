@@ -76,6 +76,13 @@ class RateLimiter {
   // by allocator.
   void turn(bool to_on) { is_on = to_on; }
 
+  [[nodiscard]] bool get_is_on() const { return is_on; }
+
+  // unit: #blocks/second
+  [[nodiscard]] int64_t get_bandwidth() const {
+    return rate_inv_to_bw(rate_inv.load(std::memory_order_acquire));
+  }
+
   [[nodiscard]] bool is_min_bandwidth() const {
     return rate_inv.load(std::memory_order_acquire) >=
            params::cycles_per_second / params::min_bandwidth;
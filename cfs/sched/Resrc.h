@@ -2,9 +2,12 @@
 
 #include <cassert>
 #include <cstdint>
+#include <deque>
 #include <iostream>
 #include <limits>
+#include <memory>
 
+#include "CachePolicy.h"
 #include "RateLimit.h"
 #include "gcache/ghost_cache.h"
 
@@ -113,24 +116,69 @@ struct HitRateCnt {
   }
 };
 
+// Predict the hit rate of a tenant's cache at different sizes under the
+// tenant's replacement policy: LRU uses gcache's sampled stack algorithm; the
+// others are not stack algorithms and use miniature simulations instead
+class PolicyGhostCache {
+  CachePolicy policy;
+  gcache::SampledGhostCache<> lru_ghost;
+  std::unique_ptr<SimGhostCache> sim_ghost;  // nullptr for LRU
+
+ public:
+  PolicyGhostCache(CachePolicy policy, uint32_t tick, uint32_t min_size,
+                   uint32_t max_size)
+      : policy(policy),
+        lru_ghost(tick, min_size, max_size),
+        sim_ghost(policy == CachePolicy::LRU
+                      ? nullptr
+                      : std::make_unique<SimGhostCache>(policy, tick, min_size,
+                                                        max_size)) {}
+
+  void access(uint32_t page_id, gcache::AccessMode mode) {
+    if (sim_ghost)
+      sim_ghost->access(page_id, mode == gcache::AccessMode::AS_MISS);
+    else
+      lru_ghost.access(page_id, mode);
+  }
+
+  HitRateCnt get_stat(uint32_t size) const {
+    if (!sim_ghost) return lru_ghost.get_stat(size);
+    auto& s = sim_ghost->get_stat(size);
+    return {s.hit_cnt, s.miss_cnt};
+  }
+
+  CachePolicy get_policy() const { return policy; }
+  uint32_t get_tick() const { return lru_ghost.get_tick(); }
+  uint32_t get_min_size() const { return lru_ghost.get_min_size(); }
+  uint32_t get_max_size() const { return lru_ghost.get_max_size(); }
+};
+
 struct ResrcCtrlBlock {
   // allocated resource
   ResrcAlloc curr_resrc;
-  // limit submission rate for block request
-  RateLimiter blk_rate_limiter;
-  // use default sample rate
-  gcache::SampledGhostCache<> ghost_cache;
-
-  ResrcCtrlBlock(uint32_t cache_size, int64_t bandwidth, int64_t cpu_cycles)
+  // limit submission rate for block request; one per device, each with the
+  // part of the bandwidth of the requests that go there
+  std::deque<RateLimiter> blk_rate_limiters;
+  // where missed blocks go in the tenant's cache partition
+  CacheAdmission cache_admission;
+  // under the same policy as cache_admission
+  PolicyGhostCache ghost_cache;
+
+  ResrcCtrlBlock(uint32_t cache_size, int64_t bandwidth, int64_t cpu_cycles,
+                 CachePolicy cache_policy = CachePolicy::LRU, int num_devs = 1)
       : curr_resrc({cache_size, bandwidth, cpu_cycles}),
-        blk_rate_limiter(bandwidth),
-        ghost_cache(params::ghost::tick, params::ghost::min_size,
-                    params::ghost::max_size) {}
+        cache_admission(cache_policy),
+        ghost_cache(cache_policy, params::ghost::tick, params::ghost::min_size,
+                    params::ghost::max_size) {
+    assert(num_devs >= 1);
+    for (int dev = 0; dev < num_devs; ++dev)
+      blk_rate_limiters.emplace_back(bandwidth / num_devs);
+  }
 
   void report_ghost_cache(std::ostream& report_buf) const {
     for (uint32_t c = ghost_cache.get_min_size();
          c <= ghost_cache.get_max_size(); c += ghost_cache.get_tick()) {
-      auto& s = ghost_cache.get_stat(c);
+      auto s = ghost_cache.get_stat(c);
       report_buf << "" << params::blocks_to_mb_int(c) << ": " << s << '\n';
     }
   }
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "Param.h"
+
+namespace sched {
+
+/**
+ * FIFO queue over a power-of-two ring, for the tenant's request queues on the
+ * worker's hot path. The ring is allocated with the tenant, so pushing and
+ * popping never allocate (unlike std::queue over std::deque, which allocates a
+ * chunk every few entries as the queue moves along); the entries are
+ * contiguous, and the index wraps with a mask.
+ *
+ * The queues have no hard bound (e.g., a write-back queues a whole file), so a
+ * full ring doubles instead of rejecting; it never shrinks, so it only grows
+ * up to the deepest backlog the tenant has had.
+ */
+template <typename T>
+class RingQueue {
+  std::unique_ptr<T[]> slots;
+  uint32_t mask;
+  // free-running; the entries are [head, tail) modulo the capacity
+  uint32_t head{0};
+  uint32_t tail{0};
+
+ public:
+  // @param capacity: rounded up to a power of two
+  explicit RingQueue(uint32_t capacity = params::queue_init_capacity) {
+    uint32_t cap = 1;
+    while (cap < capacity) cap <<= 1;
+    slots.reset(new T[cap]());
+    mask = cap - 1;
+  }
+
+  bool empty() const { return head == tail; }
+  size_t size() const { return tail - head; }
+  size_t capacity() const { return mask + 1; }
+
+  void push(const T& v) {
+    if (tail - head > mask) grow();
+    slots[tail++ & mask] = v;
+  }
+  T& front() {
+    assert(!empty());
+    return slots[head & mask];
+  }
+  void pop() {
+    assert(!empty());
+    ++head;
+  }
+
+ private:
+  // off the fast path, so push() stays small enough to be inlined whole
+  __attribute__((noinline, cold)) void grow() {
+    size_t n = size();
+    std::unique_ptr<T[]> new_slots(new T[n * 2]());
+    for (size_t i = 0; i < n; ++i) new_slots[i] = slots[(head + i) & mask];
+    slots = std::move(new_slots);
+    mask = n * 2 - 1;
+    head = 0;
+    tail = n;
+  }
+};
+
+/**
+ * Histogram of a queue's length as seen by each entry pushed, i.e., how many
+ * entries it waits behind. Bucket 0 counts an empty queue and bucket i > 0 a
+ * length in [2^(i-1), 2^i); the last bucket has no upper bound. The counts
+ * only grow; the allocator compares two snapshots to get a window.
+ */
+class QlenHist {
+  uint64_t cnt[params::qlen_hist_buckets]{};
+
+ public:
+  static uint32_t bucket_of(size_t qlen) {
+    uint32_t b = qlen == 0 ? 0 : 64 - __builtin_clzl(qlen);
+    return b < params::qlen_hist_buckets ? b : params::qlen_hist_buckets - 1;
+  }
+  // smallest length of bucket `b`
+  static size_t bucket_min(uint32_t b) { return b == 0 ? 0 : 1UL << (b - 1); }
+
+  void record(size_t qlen) { ++cnt[bucket_of(qlen)]; }
+
+  uint64_t get(uint32_t b) const { return cnt[b]; }
+  uint64_t total() const {
+    uint64_t sum = 0;
+    for (auto c : cnt) sum += c;
+    return sum;
+  }
+  // the bucket the quantile `q` (e.g., 0.99) of the lengths falls in
+  uint32_t quantile_bucket(double q) const {
+    uint64_t rank = q * total();
+    uint64_t sum = 0;
+    for (uint32_t b = 0; b < params::qlen_hist_buckets; ++b) {
+      sum += cnt[b];
+      if (sum > rank) return b;
+    }
+    return params::qlen_hist_buckets - 1;
+  }
+};
+
+}  // namespace sched
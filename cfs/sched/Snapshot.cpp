@@ -0,0 +1,145 @@
+#include "Snapshot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+namespace sched::snapshot {
+
+namespace {
+
+template <typename T>
+void put(std::ostream& out, T v) {
+  out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+bool get(std::istream& in, T& v) {
+  return bool(in.read(reinterpret_cast<char*>(&v), sizeof(T)));
+}
+
+// a tenant never holds more than the whole buffer (a few GB); anything larger
+// is a corrupted file
+constexpr uint32_t max_blocks_per_tenant = 1U << 28;
+// one per worker at most
+constexpr uint32_t max_journals = 1U << 10;
+
+// bandwidth and CPU of the cmdline are converted from MB/s and ratios, so the
+// totals may differ by rounding
+bool close_enough(int64_t a, int64_t b) {
+  return std::llabs(a - b) <= std::max<int64_t>(std::llabs(b) / 100, 1);
+}
+
+}  // namespace
+
+std::string Snapshot::load(std::istream& in) {
+  uint64_t magic;
+  uint32_t version;
+  if (!get(in, magic) || magic != file_magic) return "Not a snapshot";
+  if (!get(in, version) || version != file_version)
+    return "Unsupported snapshot version";
+  if (!get(in, num_workers) || !get(in, num_apps) || num_workers <= 0 ||
+      num_apps <= 0)
+    return "Invalid snapshot header";
+  uint32_t num_journals;
+  if (!get(in, num_journals) || num_journals > max_journals)
+    return "Invalid snapshot header";
+  journal_chkpts.resize(num_journals);
+  for (auto& ts : journal_chkpts) {
+    if (!get(in, ts)) return "Invalid snapshot header";
+  }
+  tenants.assign(num_workers, std::vector<TenantSnapshot>(num_apps));
+  for (int wid = 0; wid < num_workers; ++wid) {
+    for (int aid = 0; aid < num_apps; ++aid) {
+      auto& t = tenants[wid][aid];
+      uint32_t num_blocks;
+      if (!get(in, t.resrc.cache_size) || !get(in, t.resrc.bandwidth) ||
+          !get(in, t.resrc.cpu_cycles) || !get(in, num_blocks))
+        return "Truncated snapshot at W" + std::to_string(wid) + "-A" +
+               std::to_string(aid);
+      if (num_blocks > max_blocks_per_tenant)
+        return "Invalid snapshot at W" + std::to_string(wid) + "-A" +
+               std::to_string(aid);
+      t.blocks.resize(num_blocks);
+      for (auto& [block_no, index] : t.blocks) {
+        if (!get(in, block_no) || !get(in, index))
+          return "Truncated snapshot at W" + std::to_string(wid) + "-A" +
+                 std::to_string(aid);
+      }
+    }
+  }
+  return "";
+}
+
+std::string Snapshot::save(std::ostream& out) const {
+  put(out, file_magic);
+  put(out, file_version);
+  put(out, num_workers);
+  put(out, num_apps);
+  put(out, uint32_t(journal_chkpts.size()));
+  for (auto ts : journal_chkpts) put(out, ts);
+  for (const auto& row : tenants) {
+    for (const auto& t : row) {
+      put(out, t.resrc.cache_size);
+      put(out, t.resrc.bandwidth);
+      put(out, t.resrc.cpu_cycles);
+      put(out, uint32_t(t.blocks.size()));
+      for (auto [block_no, index] : t.blocks) {
+        put(out, block_no);
+        put(out, index);
+      }
+    }
+  }
+  if (!out) return "Fail to write snapshot";
+  return "";
+}
+
+std::string Snapshot::load_file(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return "Fail to open " + path;
+  return load(in);
+}
+
+std::string Snapshot::take_file(const std::string& path) {
+  auto err = load_file(path);
+  std::string used_path = path + ".used";
+  if (std::rename(path.c_str(), used_path.c_str()) != 0 && err.empty())
+    return "Fail to rename " + path + " to " + used_path;
+  return err;
+}
+
+std::string Snapshot::save_file(const std::string& path) const {
+  std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) return "Fail to open " + tmp_path;
+    auto err = save(out);
+    if (!err.empty()) return err;
+    out.flush();
+    if (!out) return "Fail to write " + tmp_path;
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+    return "Fail to rename " + tmp_path + " to " + path;
+  return "";
+}
+
+bool Snapshot::match(const std::vector<std::vector<ResrcAlloc>>& init) const {
+  if (int(init.size()) != num_workers) return false;
+  for (int wid = 0; wid < num_workers; ++wid) {
+    if (int(init[wid].size()) != num_apps) return false;
+    ResrcAlloc saved_total, init_total;
+    for (int aid = 0; aid < num_apps; ++aid) {
+      saved_total += tenants[wid][aid].resrc;
+      init_total += init[wid][aid];
+    }
+    // the buffer of each worker is sized for exactly its total cache
+    if (saved_total.cache_size != init_total.cache_size ||
+        !close_enough(saved_total.bandwidth, init_total.bandwidth) ||
+        !close_enough(saved_total.cpu_cycles, init_total.cpu_cycles))
+      return false;
+  }
+  return true;
+}
+
+}  // namespace sched::snapshot
@@ -0,0 +1,83 @@
+/**
+ * Warm-restart snapshot of the scheduler state. Without it, a restarted FsProc
+ * starts with empty cache partitions and the initial allocation of the cmdline,
+ * and the allocator waits `preheat_window_us` before its first decision, so an
+ * upgrade or a restart leaves a long performance hole.
+ *
+ * On exit, each worker records, for every tenant, the last allocation applied
+ * and the blocks resident in its cache partition, hottest first: the main
+ * partition before probation (see CachePolicy.h), and the last checkpoint of
+ * every journal. On start, the file is renamed to `<path>.used` once read, so
+ * a run that crashes leaves none behind and the next start is cold. The
+ * allocations are restored when the snapshot matches the cmdline (same
+ * workers, apps and total resources per worker) and the journals have not
+ * been checkpointed since (e.g., by fsOfflineCheckpointer or a new mkfs), so
+ * the blocks and the inodes they belong to are the ones on disk; the blocks
+ * are prefetched into the master's buffer at a bounded rate before the
+ * workers admit any request, and replayed into the ghost caches, so the
+ * allocator can skip the preheat.
+ *
+ * File format (binary, native endianness):
+ *   u64 magic, u32 version, i32 num_workers, i32 num_apps
+ *   u32 num_journals, num_journals * u64 last_chkpt_ts
+ *   for each wid, for each aid:
+ *     u32 cache_size, i64 bandwidth, i64 cpu_cycles, u32 num_blocks
+ *     num_blocks * (u32 block_no, u32 index)
+ * where `index` is the inode a block belongs to (see BlockBufferItem).
+ */
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Resrc.h"
+
+namespace sched::snapshot {
+
+constexpr static uint64_t file_magic = 0x4255'4e4e'5957'524dUL;  // BUNNYWRM
+constexpr static uint32_t file_version = 2;
+
+struct TenantSnapshot {
+  ResrcAlloc resrc;
+  // resident blocks as (block_no, index), hottest first
+  std::vector<std::pair<uint32_t, uint32_t>> blocks;
+};
+
+struct Snapshot {
+  int num_workers = 0;
+  int num_apps = 0;
+  // the last checkpoint (JSuperOnDisk::last_chkpt_ts) of each journal, in the
+  // order of their jsuper blocks
+  std::vector<uint64_t> journal_chkpts;
+  // tenants[wid][aid]
+  std::vector<std::vector<TenantSnapshot>> tenants;
+
+  Snapshot() = default;
+  Snapshot(int num_workers, int num_apps)
+      : num_workers(num_workers),
+        num_apps(num_apps),
+        tenants(num_workers, std::vector<TenantSnapshot>(num_apps)) {}
+
+  // @return an error message; empty on success
+  std::string load(std::istream& in);
+  std::string save(std::ostream& out) const;
+
+  // the files are replaced atomically, so a crash during saving leaves the
+  // previous snapshot intact
+  std::string load_file(const std::string& path);
+  // load_file(), then move the file out of the way, so that only the next
+  // clean exit writes one again
+  std::string take_file(const std::string& path);
+  std::string save_file(const std::string& path) const;
+
+  // whether the allocations can replace the initial ones: the allocator
+  // conserves the total resources of each worker, so the totals must match
+  // the `init` allocations (indexed in the same way as `tenants`)
+  bool match(const std::vector<std::vector<ResrcAlloc>>& init) const;
+};
+
+}  // namespace sched::snapshot
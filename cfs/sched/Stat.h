@@ -43,8 +43,23 @@ class IdleStat {
   uint64_t last_report_ts{0};
   uint64_t idle_time_sum{0};
   uint64_t begin_ts{0};
+  double last_idle_ratio{0};
   int wid;
 
+  // return whether a new window starts
+  bool try_report(uint64_t now) {
+    uint64_t t_since_last = now - last_report_ts;
+    if (t_since_last <= report_idle_freq_cycles) return false;
+    if (last_report_ts != 0) {  // report idleness
+      last_idle_ratio = double(idle_time_sum) / t_since_last;
+      SCHED_LOG_NOTICE("[STAT] Worker-%d idleness: %.1f%%", wid,
+                       100.0 * last_idle_ratio);
+      idle_time_sum = 0;
+    }
+    last_report_ts = now;
+    return true;
+  }
+
  public:
   IdleStat(int wid) : wid(wid) {}
 
@@ -53,18 +68,13 @@ class IdleStat {
   void start() { begin_ts = PlatformLab::PerfUtils::Cycles::rdtsc(); }
   void stop() {
     uint64_t now = PlatformLab::PerfUtils::Cycles::rdtsc();
-    uint64_t t_diff = now - begin_ts;
-    uint64_t t_since_last = now - last_report_ts;
-    if (t_since_last > report_idle_freq_cycles) {
-      if (last_report_ts != 0) {  // report idleness
-        SCHED_LOG_NOTICE("[STAT] Worker-%d idleness: %.1f%%", wid,
-                         100.0 * idle_time_sum / t_since_last);
-        idle_time_sum = 0;
-      }
-      last_report_ts = now;
-    } else {
-      idle_time_sum += t_diff;
-    }
+    if (!try_report(now)) idle_time_sum += now - begin_ts;
   }
+
+  // `stop` is only called on idle loops; a fully busy worker should call this
+  // periodically so its idleness is still updated
+  void poll() { try_report(PlatformLab::PerfUtils::Cycles::rdtsc()); }
+
+  double get_idle_ratio() const { return last_idle_ratio; }
 };
 }  // namespace sched::stat
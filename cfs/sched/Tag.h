@@ -7,6 +7,11 @@
 namespace sched {
 class Tenant;
 
+// a tenant whose cache partition is split (see CachePolicy.h) owns a second
+// tag for its probation partition: the tenant pointer with this bit set, which
+// is never set in a real pointer as Tenant is at least 8-byte aligned
+constexpr static uint64_t probation_tag_bit = 1;
+
 // Tag is used to identify a cache access is from a tenant
 union Tag {
   // Dummy tenants are not real; they are only created to represent a specific
@@ -17,9 +22,31 @@ union Tag {
   Dummy dummpy;
   uint64_t raw;
 
+  static Tag probation_of(Tenant* t) {
+    Tag tag = {.tenant = t};
+    tag.raw |= probation_tag_bit;
+    return tag;
+  }
+
+  bool is_dummy() const {
+    return dummpy == Dummy::UNALLOC || dummpy == Dummy::GLOBAL;
+  }
+
+  bool is_probation() const {
+    return !is_dummy() && (raw & probation_tag_bit);
+  }
+
+  // the tag of the tenant's main partition (itself if not probation)
+  Tag get_main() const {
+    if (!is_probation()) return *this;
+    Tag tag;
+    tag.raw = raw & ~probation_tag_bit;
+    return tag;
+  }
+
   Tenant* get_tenant() const {
-    if (dummpy == Dummy::UNALLOC || dummpy == Dummy::GLOBAL) return nullptr;
-    return tenant;
+    if (is_dummy()) return nullptr;
+    return get_main().tenant;
   }
 
   bool operator==(Tag rhs) const { return raw == rhs.raw; }
@@ -27,6 +54,7 @@ union Tag {
   friend std::ostream& operator<<(std::ostream& os, const Tag& t) {
     if (t.dummpy == Dummy::UNALLOC) return os << "UNALLOC";
     if (t.dummpy == Dummy::GLOBAL) return os << "GLOBAL";
+    if (t.is_probation()) return os << t.get_tenant() << "(probation)";
     return os << t.tenant;
   }
 };
@@ -21,5 +21,56 @@ std::string Tenant::to_string() const {
   //   resrc_ctrl_block.report_ghost_cache(report_buf);
 };
 
+int Tenant::get_wid() const { return app_proc->getWorker()->getWid(); }
+
+size_t Tenant::get_num_files() const { return app_proc->GetInos().size(); }
+
+int Tenant::get_striped_dev(BlockReq *blk_req) const {
+  auto dev = app_proc->getWorker()->getDev();
+  switch (blk_req->getReqType()) {
+    case FsBlockReqType::READ_NOBLOCKING_SECTOR:
+    case FsBlockReqType::WRITE_NOBLOCKING_SECTOR:
+      return dev->getDevOfSector(blk_req->getBlockNo());
+    default:
+      return dev->getDevOfBlock(blk_req->getBlockNo());
+  }
+}
+
+void Tenant::export_metrics(metrics::TenantStat &s) const {
+  s.resrc = resrc_ctrl_block.curr_resrc;
+  s.acct = resrc_acct;
+  s.rate_limit_bandwidth = 0;
+  for (auto &limiter : resrc_ctrl_block.blk_rate_limiters)
+    s.rate_limit_bandwidth += limiter.get_bandwidth();
+  s.rate_limit_on = resrc_ctrl_block.blk_rate_limiters.front().get_is_on();
+  s.recv_qlen = recv_queue.size();
+  s.intl_qlen = intl_queue.size();
+  s.blk_qlen = get_blk_qlen();
+  for (uint32_t b = 0; b < params::qlen_hist_buckets; ++b) {
+    s.recv_qlen_hist[b] = recv_qlen_hist.get(b);
+    s.intl_qlen_hist[b] = intl_qlen_hist.get(b);
+    s.blk_qlen_hist[b] = blk_qlen_hist.get(b);
+  }
+  s.num_reqs_inflight = num_reqs_inflight;
+  s.num_reqs_held = num_reqs_held;
+  s.cache_used = get_cache_used();
+  s.client_cache_used = client_cache_pages;
+  s.meta_cache_used = get_meta_cache_used();
+  s.num_files = get_num_files();
+  s.num_devs = std::min(get_num_devs(), metrics::max_devs);
+  for (int dev = 0; dev < s.num_devs; ++dev)
+    s.dev_io_cnt[dev] = dev_queues[dev].io_cnt;
+
+  const auto &ghost_cache = resrc_ctrl_block.ghost_cache;
+  uint32_t i = 0;
+  for (uint32_t c = ghost_cache.get_min_size();
+       c <= ghost_cache.get_max_size() && i < metrics::max_ghost_ticks;
+       c += ghost_cache.get_tick(), ++i) {
+    auto cs = get_ghost_stat(c);
+    s.ghost_hit_cnt[i] = cs.hit_cnt;
+    s.ghost_miss_cnt[i] = cs.miss_cnt;
+  }
+  s.ghost_num_ticks = i;
+}
 
 }  // namespace sched
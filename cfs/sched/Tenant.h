@@ -6,13 +6,18 @@
 #include <iostream>
 #include <limits>
 #include <ostream>
-#include <queue>
+#include <utility>
+#include <vector>
 
+#include "AllocEnv.h"
 #include "BlockBufferItem.h"
+#include "CachePolicy.h"
 #include "Log.h"
+#include "Metrics.h"
 #include "Param.h"
 #include "RateLimit.h"
 #include "Resrc.h"
+#include "RingQueue.h"
 #include "Stat.h"
 #include "gcache/ghost_cache.h"
 #include "gcache/shared_cache.h"
@@ -32,9 +37,6 @@ class SharedCache;
 
 namespace sched {
 
-class Allocator;
-class AppResrcView;
-
 /**
  * Unlike AppProc, Tenant here is an encapsulation for scheduling.
  * Each tenant is a scheduling entity; it has its allocated share of each
@@ -42,16 +44,39 @@ class AppResrcView;
  * Each tenant belongs to one worker, so read/write data structures inside does
  * not require locks; each app can have multiple tenant, each on different
  * workers. An app's total resources (across workers) is an instance of `class
- * AppResrcView`.
+ * AppResrcView`, which reads it through `TenantProbe`.
  */
-class Tenant {
+class Tenant final : public TenantProbe {
   AppProc *app_proc;
   // receive queue: requests from the client's shared memory
-  std::queue<FsReq *> recv_queue;
+  RingQueue<FsReq *> recv_queue;
   // internal ready queue: requests waiting for further process
-  std::queue<FsReq *> intl_queue;
-  // block queue: block requests waiting to be submitted
-  std::queue<std::pair<BlockReq *, FsReq *>> blk_queue;
+  RingQueue<FsReq *> intl_queue;
+  // block requests to one of the devices the data is striped over (see
+  // BlkDevStripe); each device has its own rate limiter, so the requests to a
+  // device this tenant has used up its share of do not hold back the others
+  struct DevQueue {
+    // block queue: block requests waiting to be submitted
+    RingQueue<std::pair<BlockReq *, FsReq *>> blk_queue;
+    // write-back queue: block requests of the background write-back of this
+    // tenant's dirty blocks (no FsReq); they are charged to the same rate
+    // limiter as blk_queue but only use the budget blk_queue leaves, unless
+    // urgent
+    RingQueue<BlockReq *> wb_queue;
+    // block requests queued so far; the allocator splits this tenant's
+    // bandwidth over the devices by it. It counts the demand rather than the
+    // requests submitted, which the split itself would skew
+    uint64_t io_cnt{0};
+  };
+  std::vector<DevQueue> dev_queues;
+  // lengths seen by the requests queued; the block requests of all devices
+  // (but not the write-back) share one histogram
+  QlenHist recv_qlen_hist;
+  QlenHist intl_qlen_hist;
+  QlenHist blk_qlen_hist;
+  // set when dirty blocks are about to use up the cache; write-back then goes
+  // ahead of the foreground block requests
+  bool wb_urgent{false};
 
   // when sharing CPU, the server essentially do WFQ.
   // we divide the time into epoch, where each tenant's progress is 0 when an
@@ -72,39 +97,62 @@ class Tenant {
   // pointer to this tenant's LRU cache (for easy check whether this tenant has
   // unpopulated cache)
   const SharedCache_t::LRUCache_t *cache{nullptr};
+  // probation partition of the cache; nullptr unless the cache policy splits
+  // the partition (see CachePolicy.h)
+  const SharedCache_t::LRUCache_t *probation_cache{nullptr};
+
+  // number of pages of the shared client cache charged to this tenant; only
+  // touched by the worker owning this tenant
+  uint32_t client_cache_pages{0};
+
+  // whole-block reads skip the cache and go directly into the app's buffer
+  const bool cache_bypass;
+
+  // sectors of the metadata buffers (inode sectors and bitmap blocks) brought
+  // in by this tenant, until the inode is unlinked or moves to another worker.
+  // These buffers are shared and hold all the metadata, so nothing is evicted
+  // from them; instead, the part beyond `meta_cache_quota` (#blocks) is taken
+  // out of the server buffer like client_cache_pages
+  uint32_t meta_cache_sectors{0};
+  const uint32_t meta_cache_quota;
+  // metadata blocks read from the device; metadata never leaves the buffers,
+  // so these are misses no matter how large the cache is. Only the blocks the
+  // ghost cache would sample are counted, so that they add to its counters
+  uint64_t meta_miss_cnt{0};
 
   /**
-   * If we try to do load-balancing for this tenant, we will need to export this
-   * tenant's inodes and move them to other workers. To achieve so, we need to
-   * first drain the inflight requests, so no inode will be pinned by this
-   * tenant.
+   * If we try to do load-balancing for this tenant, we will need to export some
+   * of this tenant's inodes and move them to other workers. Only the requests
+   * on the moving inodes are held back (by the worker, see
+   * FsProcWorker::schedMigrateInode) until the inode is exported; the others
+   * keep flowing.
    */
 
   // a request flows:      shm -> recv_queue -> ??? -> intl_queue -> ??? -> shm
   // we count in-flight as this window:       [***************************]
   int num_reqs_inflight{0};
-  bool is_drain{false};
-  std::vector<std::tuple<int, int>> pending_inode_move{};
+  // in-flight requests held because their inode is moving to another worker
+  int num_reqs_held{0};
 
   // stat info
   sched::stat::LatencyStat block_latency_stat;
 
-  friend Allocator;
-  friend AppResrcView;
-
  public:
   // NOTE: cpu_share is currently unused...
   Tenant(int wid, int aid, AppProc *app_proc, uint32_t cache_size,
-         int64_t bandwidth, int64_t cpu_cycles)
+         int64_t bandwidth, int64_t cpu_cycles, int num_devs = 1)
       : app_proc(app_proc),
         recv_queue(),
         intl_queue(),
-        blk_queue(),
+        dev_queues(num_devs),
         cpu_prog(0),
         resrc_acct(),
-        resrc_ctrl_block(cache_size, bandwidth, cpu_cycles),
+        resrc_ctrl_block(cache_size, bandwidth, cpu_cycles,
+                         sched::get_cache_policy(aid), num_devs),
         weight(std::max(params::cycles_to_weight(cpu_cycles),
-                        params::min_weight)) {
+                        params::min_weight)),
+        cache_bypass(sched::get_cache_bypass(aid)),
+        meta_cache_quota(sched::get_meta_cache_quota(aid)) {
     char buf[20];
     sprintf(buf, "W%d-A%d BIO", wid, aid);
     block_latency_stat.set_name(buf);
@@ -113,6 +161,53 @@ class Tenant {
   AppProc *get_app() const { return app_proc; }
 
   void set_cache(const SharedCache_t::LRUCache_t &c) { cache = &c; }
+  void set_probation_cache(const SharedCache_t::LRUCache_t &c) {
+    probation_cache = &c;
+  }
+
+  CachePolicy get_cache_policy() const {
+    return resrc_ctrl_block.cache_admission.get_policy();
+  }
+  bool is_cache_bypass() const { return cache_bypass; }
+  bool is_cache_split() const {
+    return resrc_ctrl_block.cache_admission.is_split();
+  }
+  // split the cache partition of the given capacity between probation and main
+  // @return the capacity of probation (0 if not split)
+  uint32_t split_cache(uint32_t capacity) {
+    resrc_ctrl_block.cache_admission.set_capacity(capacity);
+    return resrc_ctrl_block.cache_admission.get_probation_target();
+  }
+  uint32_t get_probation_target() const {
+    return resrc_ctrl_block.cache_admission.get_probation_target();
+  }
+  // whether a hit in probation moves the block to main (see CachePolicy.h)
+  bool promotes_cache_hit() const {
+    return resrc_ctrl_block.cache_admission.promotes_on_hit();
+  }
+  void on_cache_hit_promoted(uint32_t block_no) {
+    resrc_ctrl_block.cache_admission.on_promoted(block_no);
+  }
+  // the tag under which a missed block is inserted
+  Tag get_insert_tag(uint32_t block_no) {
+    if (resrc_ctrl_block.cache_admission.admit_to_probation(block_no))
+      return Tag::probation_of(this);
+    return Tag{.tenant = this};
+  }
+  // whether the cache has been filled up; with a split partition, main may
+  // stay partially empty for a long time (e.g., under a scan) while new blocks
+  // only churn probation, so a full probation means it has been populated
+  bool is_cache_populated() const {
+    const auto *c = probation_cache ? probation_cache : cache;
+    assert(c);
+    assert(c->size() <= c->capacity());
+    return !(c->size() < c->capacity());
+  }
+  uint32_t get_cache_used() const {
+    uint32_t used = cache ? cache->size() : 0;
+    if (probation_cache) used += probation_cache->size();
+    return used;
+  }
 
   std::string to_string() const;
 
@@ -140,39 +235,136 @@ class Tenant {
   void reset_cpu_prog() { cpu_prog = 0; }
   // cpu_prog is updated in `record_cpu_consump`
 
-  ResrcAlloc get_resrc() const { return resrc_ctrl_block.curr_resrc; }
-  void set_resrc(ResrcAlloc new_resrc) {
+  ResrcAlloc get_resrc() const override { return resrc_ctrl_block.curr_resrc; }
+  // @param dev_shares: part of the bandwidth for each device; split evenly if
+  // empty
+  void set_resrc(ResrcAlloc new_resrc,
+                 const std::vector<double> &dev_shares = {}) {
     weight = std::max(params::cycles_to_weight(new_resrc.cpu_cycles),
                       params::min_weight);
-    resrc_ctrl_block.blk_rate_limiter.update_bandwidth(new_resrc.bandwidth);
+    auto &limiters = resrc_ctrl_block.blk_rate_limiters;
+    for (size_t dev = 0; dev < limiters.size(); ++dev) {
+      double share = dev_shares.size() == limiters.size()
+                         ? dev_shares[dev]
+                         : 1.0 / limiters.size();
+      limiters[dev].update_bandwidth(int64_t(new_resrc.bandwidth * share));
+    }
     resrc_ctrl_block.curr_resrc = new_resrc;
     SCHED_LOG_NOTICE("Apply: cache=%d, bw=%ld, cpu=%ld", new_resrc.cache_size,
                      new_resrc.bandwidth, new_resrc.cpu_cycles);
   }
 
-  // exposed to BlockBuffer LRU cache
+  // exposed to BlockBuffer LRU cache; pages held in the client cache and
+  // metadata beyond the quota are part of this tenant's cache share, so they
+  // are taken out of the server buffer
   uint32_t get_max_cache_size() const {
-    return std::max(resrc_ctrl_block.curr_resrc.cache_size, params::min_cache);
+    uint32_t cache_size = resrc_ctrl_block.curr_resrc.cache_size;
+    cache_size -= std::min(cache_size, client_cache_pages);
+    cache_size -= std::min(cache_size, get_meta_cache_over_quota());
+    return std::max(cache_size, params::min_cache);
+  }
+
+  // charge/uncharge pages of the shared client cache (see FsProc_PageCache.h);
+  // charging fails if it would leave the server buffer less than min_cache
+  bool charge_client_cache(uint32_t num_pages) {
+    if (client_cache_pages + num_pages + params::min_cache >
+        resrc_ctrl_block.curr_resrc.cache_size)
+      return false;
+    client_cache_pages += num_pages;
+    return true;
+  }
+  void uncharge_client_cache(uint32_t num_pages) {
+    assert(client_cache_pages >= num_pages);
+    client_cache_pages -= num_pages;
+  }
+  uint32_t get_client_cache_pages() const { return client_cache_pages; }
+  // pages charged beyond what charge_client_cache() would allow now, i.e.,
+  // after the cache share shrinks; the worker reclaims them
+  uint32_t get_client_cache_excess() const {
+    uint32_t cache_size = resrc_ctrl_block.curr_resrc.cache_size;
+    uint32_t allowed =
+        cache_size > params::min_cache ? cache_size - params::min_cache : 0;
+    return client_cache_pages > allowed ? client_cache_pages - allowed : 0;
+  }
+
+  // charge a block newly inserted into a metadata buffer; it is a miss if it
+  // has to be read from the device (i.e., not a newly allocated inode)
+  // @return whether the server buffer shrinks, i.e., the caller should call
+  // adjustCacheSize
+  bool access_meta_block(uint32_t block_no, uint32_t num_sectors,
+                         bool is_miss) {
+    if (is_miss) {
+      if (SimGhostCache::is_sampled(block_no)) ++meta_miss_cnt;
+      record_blocks_done(1);
+    }
+    uint32_t old_over_quota = get_meta_cache_over_quota();
+    meta_cache_sectors += num_sectors;
+    return get_meta_cache_over_quota() != old_over_quota;
+  }
+  // take back the charge of a block that leaves this tenant
+  // @return whether the server buffer grows back
+  bool release_meta_block(uint32_t num_sectors) {
+    assert(meta_cache_sectors >= num_sectors);
+    uint32_t old_over_quota = get_meta_cache_over_quota();
+    meta_cache_sectors -= num_sectors;
+    return get_meta_cache_over_quota() != old_over_quota;
+  }
+  // unit: #blocks
+  uint32_t get_meta_cache_used() const {
+    return (meta_cache_sectors + params::sectors_per_block - 1) /
+           params::sectors_per_block;
+  }
+  uint32_t get_meta_cache_over_quota() const {
+    uint32_t used = get_meta_cache_used();
+    return used > meta_cache_quota ? used - meta_cache_quota : 0;
   }
   // weight is for CPU-only
   uint32_t get_weight() const { return weight; }
 
   // for allocator: the real, allocated weight
-  uint32_t get_allocated_weight() const {
+  uint32_t get_allocated_weight() const override {
     return params::cycles_to_weight(resrc_ctrl_block.curr_resrc.cpu_cycles);
   }
 
-  size_t get_recv_qlen() { return recv_queue.size(); }
-  size_t get_intl_qlen() { return intl_queue.size(); }
-  size_t get_blk_qlen() { return blk_queue.size(); }
-
-  void add_recv_queue(FsReq *req) { recv_queue.emplace(req); }
-  void add_intl_queue(FsReq *req) { intl_queue.emplace(req); }
+  size_t get_recv_qlen() const { return recv_queue.size(); }
+  size_t get_intl_qlen() const { return intl_queue.size(); }
+  size_t get_blk_qlen() const {
+    size_t qlen = 0;
+    for (auto &q : dev_queues) qlen += q.blk_queue.size();
+    return qlen;
+  }
+  size_t get_wb_qlen() const {
+    size_t qlen = 0;
+    for (auto &q : dev_queues) qlen += q.wb_queue.size();
+    return qlen;
+  }
+  int get_num_devs() const { return dev_queues.size(); }
+  const QlenHist &get_recv_qlen_hist() const { return recv_qlen_hist; }
+  const QlenHist &get_intl_qlen_hist() const { return intl_qlen_hist; }
+  const QlenHist &get_blk_qlen_hist() const { return blk_qlen_hist; }
+
+  void add_recv_queue(FsReq *req) {
+    recv_qlen_hist.record(recv_queue.size());
+    recv_queue.push(req);
+  }
+  void add_intl_queue(FsReq *req) {
+    intl_qlen_hist.record(intl_queue.size());
+    intl_queue.push(req);
+  }
   void add_blk_queue(BlockReq *blk_req, FsReq *req) {
-    blk_queue.emplace(blk_req, req);
+    auto &q = dev_queues[get_dev(blk_req)];
+    blk_qlen_hist.record(q.blk_queue.size());
+    q.blk_queue.push({blk_req, req});
+    ++q.io_cnt;
+  }
+  void add_wb_queue(BlockReq *blk_req) {
+    auto &q = dev_queues[get_dev(blk_req)];
+    q.wb_queue.push(blk_req);
+    ++q.io_cnt;
   }
+  void set_wb_urgent(bool urgent) { wb_urgent = urgent; }
   FsReq *pop_recv_queue() {
-    if (recv_queue.empty() || is_drain) return nullptr;
+    if (recv_queue.empty()) return nullptr;
     FsReq *req = recv_queue.front();
     recv_queue.pop();
     ++num_reqs_inflight;
@@ -184,30 +376,40 @@ class Tenant {
     intl_queue.pop();
     return req;
   }
-  BlockReq *pop_blk_queue(FsReq *&fs_req) {
-    if (blk_queue.empty()) return nullptr;
+  // @param dev: the device whose queues to pop from
+  // @param fs_req: set to nullptr for a write-back block request
+  BlockReq *pop_blk_queue(int dev, FsReq *&fs_req) {
+    auto &blk_queue = dev_queues[dev].blk_queue;
+    auto &wb_queue = dev_queues[dev].wb_queue;
+    auto &blk_rate_limiter = resrc_ctrl_block.blk_rate_limiters[dev];
+    if (blk_queue.empty() && wb_queue.empty()) return nullptr;
     if (params::policy::cache_partition) {
-      assert(cache);
-      assert(cache->size() <= cache->capacity());
       if (params::policy::unlimited_bandwidth_if_unpopulated_cache) {
         // if the cache is not fully populated, we don't throttle this tenant's
         // bandwidth: it is likely that this tenant just gets extra cache space
         // and need to populate the cache to stabilize; we are sure that the
         // upper bound of bandwidth this tenant could consume without rate limit
         // is the unpopulated cache space
-        if (!(cache->size() < cache->capacity())) {
+        if (is_cache_populated()) {
           // only check rate limiter if cache is fully populated
-          if (!resrc_ctrl_block.blk_rate_limiter.can_send()) return nullptr;
+          if (!blk_rate_limiter.can_send()) return nullptr;
         }
       } else {  // always check rate limiter
-        if (!resrc_ctrl_block.blk_rate_limiter.can_send()) return nullptr;
+        if (!blk_rate_limiter.can_send()) return nullptr;
       }
     } else {  // always check rate limiter
-      if (!resrc_ctrl_block.blk_rate_limiter.can_send()) return nullptr;
+      if (!blk_rate_limiter.can_send()) return nullptr;
+    }
+    BlockReq *blk_req;
+    if (!wb_queue.empty() && (blk_queue.empty() || wb_urgent)) {
+      blk_req = wb_queue.front();
+      fs_req = nullptr;
+      wb_queue.pop();
+    } else {
+      blk_req = blk_queue.front().first;
+      fs_req = blk_queue.front().second;
+      blk_queue.pop();
     }
-    BlockReq *blk_req = blk_queue.front().first;
-    fs_req = blk_queue.front().second;
-    blk_queue.pop();
     // here we assume this block would be submitted to device immediately
     record_bw_consump(1);
     return blk_req;
@@ -230,7 +432,7 @@ class Tenant {
       if (consumed_cycles > limited_cycles) return false;
     }
     // check recv_queue and intl_queue must have something to schedule
-    return !((recv_queue.empty() || is_drain) && (intl_queue.empty()));
+    return !(recv_queue.empty() && intl_queue.empty());
   }
 
   void access_ghost_page(uint32_t page_id, bool is_write) {
@@ -238,6 +440,13 @@ class Tenant {
     resrc_ctrl_block.ghost_cache.access(page_id, mode);
   }
 
+  // a block read without going through the cache; it is a miss no matter how
+  // large the cache is, so the ghost cache sees no benefit of caching it
+  void access_bypass_page(uint32_t page_id) {
+    resrc_ctrl_block.ghost_cache.access(page_id, gcache::AccessMode::AS_MISS);
+    record_blocks_done(1);
+  }
+
   void record_blocks_done(uint32_t blocks) {
     resrc_acct.num_blks_done += blocks;
   }
@@ -257,31 +466,47 @@ class Tenant {
     resrc_acct.cpu_consump = 0;
   }
 
-  void turn_blk_rate_limiter(bool to_on) {
-    resrc_ctrl_block.blk_rate_limiter.turn(to_on);
+  void turn_blk_rate_limiter(bool to_on) override {
+    for (auto &limiter : resrc_ctrl_block.blk_rate_limiters)
+      limiter.turn(to_on);
   }
 
-  bool should_migrate() { return is_drain && num_reqs_inflight == 0; }
-
-  void set_drain_for_migration(std::vector<std::tuple<int, int>> &&inode_move) {
-    // the previous drain should be done
-    assert(!is_drain && pending_inode_move.empty());
-    is_drain = true;
-    assert(pending_inode_move.empty());
-    pending_inode_move = std::move(inode_move);
+  // the rest of TenantProbe
+  int get_wid() const override;
+  size_t get_num_files() const override;
+  ResrcAcct get_acct() const override { return resrc_acct; }
+  uint64_t get_dev_io_cnt(int dev) const override {
+    return dev_queues[dev].io_cnt;
   }
-
-  const std::vector<std::tuple<int, int>> &get_pending_inode_move() {
-    assert(is_drain);
-    return pending_inode_move;
+  HitRateCnt get_ghost_stat(uint32_t size) const override {
+    HitRateCnt s = resrc_ctrl_block.ghost_cache.get_stat(size);
+    s.miss_cnt += meta_miss_cnt;
+    return s;
   }
 
-  void unset_drain_for_migration() {
-    is_drain = false;
-    pending_inode_move.clear();
+  void record_req_held() { ++num_reqs_held; }
+  void record_req_released() { --num_reqs_held; }
+  int get_num_reqs_held() const { return num_reqs_held; }
+
+  // nothing queued, in progress or owned; a worker parks only when all its
+  // tenants are drained (policy::elastic_workers)
+  bool is_drained() const {
+    return recv_queue.empty() && intl_queue.empty() && get_blk_qlen() == 0 &&
+           get_wb_qlen() == 0 && num_reqs_inflight == 0 &&
+           num_reqs_held == 0 && get_num_files() == 0;
   }
 
   void add_latency(uint64_t l) { block_latency_stat.add_latency(l); }
+
+  // the device `blk_req` goes to
+  int get_dev(BlockReq *blk_req) const {
+    return dev_queues.size() == 1 ? 0 : get_striped_dev(blk_req);
+  }
+  int get_striped_dev(BlockReq *blk_req) const;
+
+  // fill in a snapshot for the metrics page; `update_ts`, `wid` and `aid` are
+  // left to the caller
+  void export_metrics(metrics::TenantStat &s) const;
 };
 
 }  // namespace sched
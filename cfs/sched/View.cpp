@@ -1,8 +1,9 @@
 #include "View.h"
 
+#include <algorithm>
 #include <limits>
+#include <string>
 
-#include "FsProc_App.h"
 #include "Log.h"
 #include "Param.h"
 
@@ -59,9 +60,21 @@ bool AppResrcView::poll_stat(bool silent) {
   ResrcAcct total{};
   distr_ghost_cache_view.poll();
   for (int i = 0; i < int(tenants.size()); ++i) {
-    curr_prog[i] = tenants[i]->resrc_acct - prev_prog[i];
+    curr_prog[i] = tenants[i]->get_acct() - prev_prog[i];
     total += curr_prog[i];
   }
+  if (get_num_devs() > 1) {
+    std::vector<uint64_t> dev_io(get_num_devs(), 0);
+    uint64_t dev_io_sum = 0;
+    for (int dev = 0; dev < get_num_devs(); ++dev) {
+      for (auto t : tenants) dev_io[dev] += t->get_dev_io_cnt(dev);
+      dev_io[dev] -= std::min(dev_io[dev], prev_dev_io[dev]);
+      dev_io_sum += dev_io[dev];
+    }
+    if (dev_io_sum > 0)
+      for (int dev = 0; dev < get_num_devs(); ++dev)
+        dev_shares[dev] = double(dev_io[dev]) / dev_io_sum;
+  }
 
   if (total.num_blks_done > 0) {  // some real progress is made
     cycles_per_block = total.cpu_consump / total.num_blks_done;
@@ -84,7 +97,7 @@ bool AppResrcView::poll_stat(bool silent) {
       SCHED_LOG_NOTICE(HEADER1);
       SCHED_LOG_NOTICE(HEADER2);
       for (int i = 0; i < int(tenants.size()); ++i) {
-        auto num_inodes = tenants[i]->app_proc->GetInos().size();
+        auto num_inodes = tenants[i]->get_num_files();
         auto a = tenants[i]->get_resrc();
         auto c = distr_ghost_cache_view.get_hit_rate_cnt(i, a.cache_size);
 
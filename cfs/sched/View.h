@@ -3,23 +3,30 @@
 #include <cstdint>
 #include <limits>
 
+#include <unordered_map>
+#include <vector>
+
+#include "AllocEnv.h"
 #include "Log.h"
 #include "Param.h"
 #include "Resrc.h"
-#include "Tenant.h"
-#include "gcache/ghost_cache.h"
 #include "spdlog/spdlog.h"
 
 namespace sched {
 
+// look up a cache size on a ghost cache curve, which has one entry for each
+// params::ghost::tick; interpolate if the size falls between two ticks
+inline HitRateCnt interpolate_hit_rate_cnt(
+    const std::vector<HitRateCnt>& curve, uint32_t cache_size);
+
 class GhostCacheView {
-  const gcache::SampledGhostCache<>& ghost_cache;
+  const TenantProbe& tenant;
   std::vector<HitRateCnt> prev_stat_image;
   std::vector<HitRateCnt> curr_stat_image;
 
  public:
-  explicit GhostCacheView(const gcache::SampledGhostCache<>& ghost_cache)
-      : ghost_cache(ghost_cache),
+  explicit GhostCacheView(const TenantProbe& tenant)
+      : tenant(tenant),
         prev_stat_image(params::ghost::num_ticks),
         curr_stat_image(params::ghost::num_ticks) {
     reset();
@@ -52,7 +59,7 @@ class DistrGhostCacheView {
 
   // NOTE: such append ensures the ordering! the index will be used in
   // `update_weight`
-  void append(const gcache::SampledGhostCache<>& ghost_cache, uint32_t weight);
+  void append(const TenantProbe& tenant, uint32_t weight);
 
   void update_weight(int idx, uint32_t weight);
 
@@ -61,6 +68,9 @@ class DistrGhostCacheView {
   void poll();
 
   double get_hit_rate(uint32_t cache_size);
+  // the largest cache the hit rate can be predicted for: each worker's share
+  // of it must be within its ghost cache
+  uint32_t get_max_cache_size() const;
 
   HitRateCnt get_hit_rate_cnt(int wid, uint32_t cache_size);
 
@@ -70,7 +80,7 @@ class DistrGhostCacheView {
 // an application's unified resource view
 class AppResrcView {
   // track tenants on different workers (ordered by worker id)
-  std::vector<Tenant*> tenants;
+  std::vector<TenantProbe*> tenants;
   // progress accounting
   std::vector<ResrcAcct> prev_prog;
   std::vector<ResrcAcct> curr_prog;
@@ -87,11 +97,20 @@ class AppResrcView {
   int64_t cycles_per_block;
   double measured_miss_rate;  // from resource accounting, not from ghost cache
 
+  // fraction of the app's block requests that went to each device in the last
+  // window (the bandwidth it needs of each); kept from the window before if it
+  // did no I/O
+  std::vector<double> dev_shares;
+  std::vector<uint64_t> prev_dev_io;
+
  public:
   const int aid;  // for logging and debugging
 
  public:
-  AppResrcView(int aid) : aid(aid) {}
+  AppResrcView(int aid, int num_devs = 1)
+      : dev_shares(num_devs, 1.0 / num_devs),
+        prev_dev_io(num_devs, 0),
+        aid(aid) {}
   // disallow clone
   AppResrcView(const AppResrcView&) = delete;
   AppResrcView& operator=(const AppResrcView&) = delete;
@@ -103,10 +122,13 @@ class AppResrcView {
   ResrcAlloc get_resrc() const { return curr_resrc; }
   void set_resrc(ResrcAlloc r) { curr_resrc = r; }
 
+  int get_num_devs() const { return dev_shares.size(); }
+  const std::vector<double>& get_dev_shares() const { return dev_shares; }
+
   // add a tenant; called durint the initialization
-  void append_tenant(Tenant* t);
+  void append_tenant(TenantProbe* t);
 
-  const std::vector<Tenant*>& get_tenants() const { return tenants; }
+  const std::vector<TenantProbe*>& get_tenants() const { return tenants; }
 
   // return tuples of <wid, weight>
   void get_weights(std::vector<uint32_t>& weights) const;
@@ -123,14 +145,25 @@ class AppResrcView {
   // return <cpu, bw> pair; at least one of them should be zero.
   std::pair<int64_t, int64_t> collect_idle();
 
-  // if given/taken cache, how much bandwidth to release/compensate to keep the
-  // the same throughput (may be higher in the case of full cache hit...)
-  int64_t pred_what_if_more_cache();
-  int64_t pred_what_if_less_cache();
+  // if given/taken `num_deltas` of cache_delta, how much bandwidth to
+  // release/compensate to keep the the same throughput (may be higher in the
+  // case of full cache hit...)
+  int64_t pred_what_if_more_cache(uint32_t num_deltas = 1);
+  int64_t pred_what_if_less_cache(uint32_t num_deltas = 1);
+  // the most `num_deltas` of cache_delta `pred_what_if_more_cache` can predict
+  uint32_t get_max_more_cache_deltas() const {
+    uint32_t max_cache_size = distr_ghost_cache_view.get_max_cache_size();
+    if (curr_resrc.cache_size >= max_cache_size) return 0;
+    return (max_cache_size - curr_resrc.cache_size) / params::cache_delta;
+  }
 
   // update resources
-  void add_cache_delta() { curr_resrc.cache_size += params::cache_delta; }
-  void minus_cache_delta() { curr_resrc.cache_size -= params::cache_delta; }
+  void add_cache_delta(uint32_t num_deltas = 1) {
+    curr_resrc.cache_size += num_deltas * params::cache_delta;
+  }
+  void minus_cache_delta(uint32_t num_deltas = 1) {
+    curr_resrc.cache_size -= num_deltas * params::cache_delta;
+  }
   void add_cpu(int64_t cycles) { curr_resrc.cpu_cycles += cycles; }
   void add_bandwidth(int64_t bandwidth) { curr_resrc.bandwidth += bandwidth; }
 
@@ -206,14 +239,14 @@ inline void GhostCacheView::reset() {
   uint32_t size, i;
   for (size = params::ghost::min_size, i = 0; size <= params::ghost::max_size;
        size += params::ghost::tick, ++i)
-    prev_stat_image[i] = ghost_cache.get_stat(size);
+    prev_stat_image[i] = tenant.get_ghost_stat(size);
 }
 
 inline void GhostCacheView::poll() {
   uint32_t size, i;
   for (size = params::ghost::min_size, i = 0; size <= params::ghost::max_size;
        size += params::ghost::tick, ++i) {
-    HitRateCnt s = ghost_cache.get_stat(size);
+    HitRateCnt s = tenant.get_ghost_stat(size);
     curr_stat_image[i] = s - prev_stat_image[i];
     // we additionally ensure the hit rate must be inclusive
     // since we are polling from GhostCache, which could be updated by the
@@ -234,19 +267,19 @@ inline void GhostCacheView::poll() {
   }
 }
 
-inline HitRateCnt GhostCacheView::get_hit_rate_cnt(uint32_t cache_size) {
+inline HitRateCnt interpolate_hit_rate_cnt(const std::vector<HitRateCnt>& curve,
+                                           uint32_t cache_size) {
   assert(cache_size <= params::ghost::max_size);
   if (cache_size < params::ghost::min_size) {
     double size_ratio = double(cache_size) / params::ghost::min_size;
-    return HitRateCnt(curr_stat_image[0].hit_cnt * size_ratio,
-                      curr_stat_image[0].hit_cnt * (1 - size_ratio) +
-                          curr_stat_image[0].miss_cnt);
+    return HitRateCnt(curve[0].hit_cnt * size_ratio,
+                      curve[0].hit_cnt * (1 - size_ratio) + curve[0].miss_cnt);
   }
   auto idx = (cache_size - params::ghost::min_size) / params::ghost::tick;
   uint32_t left_size = idx * params::ghost::tick + params::ghost::min_size;
-  if (cache_size == left_size) return curr_stat_image[idx];
-  auto& l_stat = curr_stat_image[idx];
-  auto& r_stat = curr_stat_image[idx + 1];
+  if (cache_size == left_size) return curve[idx];
+  auto& l_stat = curve[idx];
+  auto& r_stat = curve[idx + 1];
 
   double l_dist = cache_size - left_size;
   double r_dist = left_size + params::ghost::tick - cache_size;
@@ -258,10 +291,14 @@ inline HitRateCnt GhostCacheView::get_hit_rate_cnt(uint32_t cache_size) {
                     l_stat.miss_cnt * l_ratio + r_stat.miss_cnt * r_ratio);
 }
 
-inline void DistrGhostCacheView::append(
-    const gcache::SampledGhostCache<>& ghost_cache, uint32_t weight) {
+inline HitRateCnt GhostCacheView::get_hit_rate_cnt(uint32_t cache_size) {
+  return interpolate_hit_rate_cnt(curr_stat_image, cache_size);
+}
+
+inline void DistrGhostCacheView::append(const TenantProbe& tenant,
+                                        uint32_t weight) {
   assert(weight <= params::max_weight);
-  weighted_views.emplace_back(weight, ghost_cache);
+  weighted_views.emplace_back(weight, tenant);
   weight_sum += weight;
 }
 
@@ -300,6 +337,19 @@ inline double DistrGhostCacheView::get_hit_rate(uint32_t cache_size) {
   return hit_rate;
 }
 
+inline uint32_t DistrGhostCacheView::get_max_cache_size() const {
+  assert(weight_sum > 0);
+  uint64_t max_cache_size = std::numeric_limits<uint32_t>::max();
+  for (auto& [w, gcv] : weighted_views) {
+    // the largest c with w * c / weight_sum <= ghost::max_size
+    if (w)
+      max_cache_size = std::min(
+          max_cache_size,
+          (uint64_t(params::ghost::max_size + 1) * weight_sum - 1) / w);
+  }
+  return max_cache_size;
+}
+
 inline HitRateCnt DistrGhostCacheView::get_hit_rate_cnt(int wid,
                                                         uint32_t cache_size) {
   return weighted_views[wid].second.get_hit_rate_cnt(cache_size);
@@ -321,13 +371,12 @@ inline void DistrGhostCacheView::print() {
   }
 }
 
-inline void AppResrcView::append_tenant(Tenant* t) {
+inline void AppResrcView::append_tenant(TenantProbe* t) {
   tenants.emplace_back(t);
   prev_prog.emplace_back();
   curr_prog.emplace_back();
-  distr_ghost_cache_view.append(t->resrc_ctrl_block.ghost_cache,
-                                t->get_allocated_weight());
-  curr_resrc += t->resrc_ctrl_block.curr_resrc;
+  distr_ghost_cache_view.append(*t, t->get_allocated_weight());
+  curr_resrc += t->get_resrc();
   pending_weights.emplace_back(0);
 }
 
@@ -344,7 +393,11 @@ inline void AppResrcView::set_weights(const std::vector<uint32_t>& weights) {
 
 inline void AppResrcView::reset_stat() {
   for (int i = 0; i < int(tenants.size()); ++i)
-    prev_prog[i] = tenants[i]->resrc_acct;
+    prev_prog[i] = tenants[i]->get_acct();
+  for (int dev = 0; dev < get_num_devs(); ++dev) {
+    prev_dev_io[dev] = 0;
+    for (auto t : tenants) prev_dev_io[dev] += t->get_dev_io_cnt(dev);
+  }
   distr_ghost_cache_view.reset();
 }
 
@@ -378,19 +431,23 @@ inline std::pair<int64_t, int64_t> AppResrcView::collect_idle() {
   return {0, 0};  // in case of rounding error
 }
 
-inline int64_t AppResrcView::pred_what_if_more_cache() {
+inline int64_t AppResrcView::pred_what_if_more_cache(uint32_t num_deltas) {
   // returning 0 indicates to abort this deal.
   // this means this client is asking for cache but return with no bandwidth,
   // which is impossible to be accepted.
   constexpr static int64_t abort_offer = 0;
+  // no ghost cache tells the hit rate beyond its max size
+  if (num_deltas > get_max_more_cache_deltas()) return abort_offer;
+
   double old_hit_rate =
       distr_ghost_cache_view.get_hit_rate(curr_resrc.cache_size);
   if (old_hit_rate >= params::full_hit_threshold ||
       old_hit_rate == std::numeric_limits<double>::infinity())
     return abort_offer;
 
+  uint32_t cache_diff = num_deltas * params::cache_delta;
   double new_hit_rate = distr_ghost_cache_view.get_hit_rate(
-      curr_resrc.cache_size + params::cache_delta);
+      curr_resrc.cache_size + cache_diff);
   if (new_hit_rate == std::numeric_limits<double>::infinity())
     return abort_offer;
 
@@ -404,7 +461,7 @@ inline int64_t AppResrcView::pred_what_if_more_cache() {
       " ==> hit %.3lf -> %.3lf"
       " ==> bw %4ld - %3ld MB/s",
       aid, params::blocks_to_mb_int(curr_resrc.cache_size),
-      params::blocks_to_mb_int(params::cache_delta),
+      params::blocks_to_mb_int(cache_diff),
       old_hit_rate, new_hit_rate,
       params::blocks_to_mb_int(curr_resrc.bandwidth),
       params::blocks_to_mb_int(bandwidth_release));
@@ -412,12 +469,15 @@ inline int64_t AppResrcView::pred_what_if_more_cache() {
   return bandwidth_release;
 }
 
-inline int64_t AppResrcView::pred_what_if_less_cache() {
+inline int64_t AppResrcView::pred_what_if_less_cache(uint32_t num_deltas) {
   // returning int64_max indicates to abort this deal.
   // in other words, this client asks for the bandwidth compensation that no one
   // could possibly afford.
   constexpr static int64_t abort_offer = std::numeric_limits<int64_t>::max();
-  if (curr_resrc.cache_size <= params::min_cache_total) return abort_offer;
+  uint32_t cache_diff = num_deltas * params::cache_delta;
+  if (curr_resrc.cache_size <=
+      params::min_cache_total + cache_diff - params::cache_delta)
+    return abort_offer;
 
   double old_hit_rate =
       distr_ghost_cache_view.get_hit_rate(curr_resrc.cache_size);
@@ -425,7 +485,7 @@ inline int64_t AppResrcView::pred_what_if_less_cache() {
     return abort_offer;
 
   double new_hit_rate = distr_ghost_cache_view.get_hit_rate(
-      curr_resrc.cache_size - params::cache_delta);
+      curr_resrc.cache_size - cache_diff);
   if (new_hit_rate == std::numeric_limits<double>::infinity())
     return abort_offer;
 
@@ -447,7 +507,7 @@ inline int64_t AppResrcView::pred_what_if_less_cache() {
         " ==> hit %.3lf -> %.3lf"
         " ==> bw %4ld + %3ld MB/s",
         aid, params::blocks_to_mb_int(curr_resrc.cache_size),
-        params::blocks_to_mb_int(params::cache_delta),
+        params::blocks_to_mb_int(cache_diff),
         old_hit_rate, new_hit_rate,
         params::blocks_to_mb_int(curr_resrc.bandwidth),
         params::blocks_to_mb_int(bandwidth_compensate));
@@ -0,0 +1,42 @@
+#include "BlkDevQdController.h"
+
+#include <algorithm>
+#include <cassert>
+
+QueueDepthController::QueueDepthController(const Params &params)
+    : params(params),
+      limit(params.max_limit),
+      rate_samples(std::max(params.num_filter_intervals, 1), 0) {
+  assert(params.min_limit >= 1 && params.min_limit <= params.max_limit);
+}
+
+void QueueDepthController::on_complete(uint64_t now, uint64_t latency,
+                                       uint32_t bytes) {
+  if (!started) {
+    interval_start = now - latency;
+    started = true;
+  }
+  min_latency = std::min(min_latency, latency);
+  bytes_done += bytes;
+  if (now - interval_start >= params.interval) end_interval(now);
+}
+
+void QueueDepthController::end_interval(uint64_t now) {
+  bool congested = min_latency > params.target_latency;
+  if (congested || limit_reached) {
+    rate_samples[next_sample] = double(bytes_done) * params.ticks_per_second /
+                                (now - interval_start);
+    next_sample = (next_sample + 1) % rate_samples.size();
+    capacity.store(*std::max_element(rate_samples.begin(), rate_samples.end()),
+                   std::memory_order_relaxed);
+  }
+  if (congested) {
+    limit = std::max(params.min_limit, limit - std::max(1, limit / 4));
+  } else if (limit_reached) {
+    limit = std::min(params.max_limit, limit + std::max(1, limit / 8));
+  }
+  interval_start = now;
+  min_latency = UINT64_MAX;
+  bytes_done = 0;
+  limit_reached = false;
+}
@@ -0,0 +1,389 @@
+#include "BlkDevSim.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <experimental/filesystem>
+#include <stdexcept>
+
+#include "FsHugePage.h"
+#include "FsProc_Fs.h"
+#include "FsProc_Numa.h"
+#include "config4cpp/Configuration.h"
+#include "perfutil/Cycles.h"
+#include "spdlog/spdlog.h"
+#include "util.h"
+
+// completions are delivered to the worker of the current thread
+extern FsProc *gFsProcPtr;
+
+BlkDevSim::BlkDevSim(uint32_t blockNum, uint32_t blockSize,
+                     std::string configName)
+    : BlkDevSpdk(/*isPosix*/ false, "", blockNum, blockSize),
+      storeSize(uint64_t(blockNum) * blockSize),
+      threadQueues(kNumMaxThreads) {
+  configFileName = std::move(configName);
+}
+
+BlkDevSim::~BlkDevSim() {
+  cleanup();
+  for (auto model : models) delete model;
+  for (auto &q : threadQueues)
+    for (auto ctx : q.ctxs) delete ctx;
+  // there is no SPDK env for ~BlkDevSpdk() to tear down
+  isSpdkDev = false;
+}
+
+int BlkDevSim::devInit() {
+  std::lock_guard<std::mutex> guard(modelLock);
+  if (!models.empty()) {
+    SPDLOG_WARN("devInit called, but the device is initialized");
+    return 0;
+  }
+  std::string store;
+  int numDevs = 1;
+  uint64_t stripeMB = kDefaultStripeMB;
+  if (!configFileName.empty()) {
+    if (!std::experimental::filesystem::exists(configFileName)) {
+      SPDLOG_ERROR("config file:{} not exist", configFileName);
+      return -1;
+    }
+    config4cpp::Configuration *cfg = config4cpp::Configuration::create();
+    try {
+      cfg->parse(configFileName.c_str());
+      store = cfg->lookupString("", "store", "");
+      const char *dist = cfg->lookupString("", "lat_dist", "lognormal");
+      if (!BlkDevSimParams::parse_lat_dist(dist, params.lat_dist)) {
+        SPDLOG_ERROR("Unknown lat_dist:{}", dist);
+        cfg->destroy();
+        return -1;
+      }
+      params.read_lat_us =
+          cfg->lookupFloat("", "read_lat_us", params.read_lat_us);
+      params.write_lat_us =
+          cfg->lookupFloat("", "write_lat_us", params.write_lat_us);
+      params.lat_cv = cfg->lookupFloat("", "lat_cv", params.lat_cv);
+      params.read_bw_mbps =
+          cfg->lookupFloat("", "read_bw_mbps", params.read_bw_mbps);
+      params.write_bw_mbps =
+          cfg->lookupFloat("", "write_bw_mbps", params.write_bw_mbps);
+      params.parallelism =
+          cfg->lookupInt("", "parallelism", params.parallelism);
+      params.rw_interference =
+          cfg->lookupFloat("", "rw_interference", params.rw_interference);
+      params.seed = cfg->lookupInt("", "seed", params.seed);
+      numDevs = cfg->lookupInt("", "num_devs", numDevs);
+      stripeMB = cfg->lookupInt("", "stripe_mb", stripeMB);
+    } catch (const config4cpp::ConfigurationException &ex) {
+      SPDLOG_ERROR("Config Parse Error:{}", ex.c_str());
+      cfg->destroy();
+      return -1;
+    }
+    cfg->destroy();
+  }
+
+  if (!initStripe(numDevs, stripeMB)) return -1;
+
+  if (store.empty()) {
+    // pages are only allocated once touched
+    void *addr = mmap(nullptr, storeSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED) {
+      SPDLOG_ERROR("Cannot map the in-memory store: {}", strerror(errno));
+      return -1;
+    }
+    storeMem = static_cast<char *>(addr);
+  } else {
+    storeFd = open(store.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (storeFd < 0 || fstat(storeFd, &st) < 0) {
+      SPDLOG_ERROR("Cannot open the store:{} err:{}", store, strerror(errno));
+      return -1;
+    }
+    if (uint64_t(st.st_size) < storeSize &&
+        ftruncate(storeFd, storeSize) < 0) {
+      SPDLOG_ERROR("Cannot truncate the store. err:{}", strerror(errno));
+      return -1;
+    }
+    void *addr = mmap(nullptr, storeSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      storeFd, 0);
+    if (addr == MAP_FAILED) {
+      SPDLOG_ERROR("Cannot map the store: {}", strerror(errno));
+      return -1;
+    }
+    storeMem = static_cast<char *>(addr);
+  }
+
+  devNumFlushes = std::vector<std::atomic_uint64_t>(numDevs);
+  for (int dev = 0; dev < numDevs; dev++) {
+    BlkDevSimParams devParams = params;
+    devParams.seed = params.seed + dev;
+    models.push_back(new BlkDevSimModel(devParams));
+  }
+  SPDLOG_INFO(
+      "[BlkDevSim] Device ready! store:{} num_devs:{} lat_us:r{}/w{} "
+      "lat_cv:{} bw_mbps:r{}/w{} parallelism:{} rw_interference:{}",
+      store.empty() ? "<memory>" : store, numDevs, params.read_lat_us,
+      params.write_lat_us, params.lat_cv, params.read_bw_mbps,
+      params.write_bw_mbps, params.parallelism, params.rw_interference);
+  return 0;
+}
+
+int BlkDevSim::devExit() { return cleanup(); }
+
+int BlkDevSim::cleanup() {
+  if (storeMem != nullptr) {
+    munmap(storeMem, storeSize);
+    storeMem = nullptr;
+  }
+  if (storeFd >= 0) {
+    close(storeFd);
+    storeFd = -1;
+  }
+  return 0;
+}
+
+void *BlkDevSim::zmallocBuf(uint64_t size, uint64_t align) {
+  // huge pages are zeroed and aligned to at least 2 MB
+  fs_hugepage::Backend backend;
+  void *addr = fs_hugepage::mapAnon(size, &backend);
+  if (addr != nullptr) {
+    SPDLOG_INFO("zmallocBuf {} bytes on {} pages", size,
+                fs_hugepage::backendName(backend));
+    return addr;
+  }
+  if (posix_memalign(&addr, std::max(align, uint64_t(sizeof(void *))),
+                     size) != 0) {
+    SPDLOG_ERROR("zmallocBuf failed");
+    return nullptr;
+  }
+  memset(addr, 0, size);
+  return addr;
+}
+
+void *BlkDevSim::zmallocBufOnNode(uint64_t size, uint64_t align, int node) {
+  fs_hugepage::Backend backend;
+  void *addr = fs_hugepage::mapAnon(size, &backend);
+  if (addr != nullptr) {
+    SPDLOG_INFO("zmallocBuf {} bytes on {} pages", size,
+                fs_hugepage::backendName(backend));
+    // not touched yet, so the pages are faulted in on the node
+    fsp_numa::bindToNode(addr, size, node);
+    return addr;
+  }
+  if (posix_memalign(&addr, std::max(align, uint64_t(sizeof(void *))),
+                     size) != 0) {
+    SPDLOG_ERROR("zmallocBuf failed");
+    return nullptr;
+  }
+  // bind before zeroing, which faults the pages in
+  fsp_numa::bindToNode(addr, size, node);
+  memset(addr, 0, size);
+  return addr;
+}
+
+int BlkDevSim::freeBuf(void *ptr) {
+  if (ptr == nullptr) return -1;
+  if (!fs_hugepage::unmap(ptr)) free(ptr);
+  return 0;
+}
+
+int BlkDevSim::initWorker(int wid) {
+  cfsSetTid(wid);
+  cfs_tid_t tid = cfsGetTid();
+  if (tid >= kNumMaxThreads) throw std::runtime_error("too many workers");
+  auto &q = threadQueues[tid];
+  if (!q.ctxs.empty()) {
+    SPDLOG_DEBUG("initWorker: this worker has been set to SimDev, but it's ok");
+    return -1;
+  }
+  for (int i = 0; i < SPDK_THREAD_MAX_INFLIGHT; i++) {
+    auto ctx_ptr = new BdevIoContext();
+    ctx_ptr->tid = tid;
+    ctx_ptr->rid = i;
+    q.ctxs.push_back(ctx_ptr);
+    q.unusedReqids.push_back(i);
+  }
+  initQdController(tid);
+  numReadyWorkers++;
+  SPDLOG_DEBUG("initWorker Completed for tid:{} wid:{}", tid, wid);
+  return 0;
+}
+
+uint64_t BlkDevSim::nowNs() {
+  return PlatformLab::PerfUtils::Cycles::toNanoseconds(
+      PlatformLab::PerfUtils::Cycles::rdtsc());
+}
+
+uint64_t BlkDevSim::doIo(uint64_t offset, uint32_t bytes, char *data,
+                         bool isWrite, int &dev) {
+  if (offset + bytes > storeSize)
+    throw std::runtime_error("BlkDevSim: IO beyond the device");
+  if (isWrite)
+    memcpy(storeMem + offset, data, bytes);
+  else
+    memcpy(data, storeMem + offset, bytes);
+  // only the device matters to the model, not the offset on it
+  mapDevOffset(offset, dev);
+  std::lock_guard<std::mutex> guard(modelLock);
+  return models[dev]->submit(nowNs(), isWrite, bytes);
+}
+
+int BlkDevSim::submitReq(uint64_t blockNo, uint64_t blockNoSeqNo, char *data,
+                         BlkDevReqType reqType, uint32_t bytes,
+                         void *ctx_payload) {
+  auto &q = threadQueues[cfsGetTid()];
+  if (q.unusedReqids.empty()) {
+    // same as running out of the qpair's request contexts
+    return -1;
+  }
+  bdev_reqid_t rid = q.unusedReqids.back();
+  q.unusedReqids.pop_back();
+  struct BdevIoContext *ctx_ptr = q.ctxs[rid];
+  ctx_ptr->buf = data;
+  ctx_ptr->ctx_payload = ctx_payload;
+  ctx_ptr->blockNo = blockNo;
+  ctx_ptr->blockNoSeqNo = blockNoSeqNo;
+  ctx_ptr->reqType = reqType;
+  ctx_ptr->isDone = false;
+  bool isWrite = reqType == BlkDevReqType::BLK_DEV_REQ_WRITE ||
+                 reqType == BlkDevReqType::BLK_DEV_REQ_SECTOR_WRITE;
+  uint64_t doneTs = doIo(blockNo * bytes, bytes, data, isWrite, ctx_ptr->dev);
+  if (isWrite) markDevWritten(ctx_ptr->tid, ctx_ptr->dev);
+  qdControllerOnSubmit(ctx_ptr);
+  q.pending.push({doneTs, ctx_ptr, nullptr});
+  return 0;
+}
+
+int BlkDevSim::blockingIo(uint64_t offset, uint32_t bytes, char *data,
+                          bool isWrite) {
+  int dev;
+  uint64_t doneTs = doIo(offset, bytes, data, isWrite, dev);
+  if (isWrite) markDevWritten(cfsGetTid(), dev);
+  // busy wait here
+  while (nowNs() < doneTs) {
+  }
+  return 0;
+}
+
+// @param maxCmplNum: # of completion fo be processed, 0 --> unlimited
+// @return # of completion processed
+int BlkDevSim::checkCompletion(int maxCmplNum) {
+  auto &pending = threadQueues[cfsGetTid()].pending;
+  if (pending.empty()) return 0;
+  uint64_t now = nowNs();
+  int num = 0;
+  while (!pending.empty() && pending.top().done_ts <= now &&
+         (maxCmplNum == 0 || num < maxCmplNum)) {
+    PendingCmd cmd = pending.top();
+    pending.pop();
+    num++;
+    if (cmd.flush != nullptr) {
+      onFlushDone(cmd.flush, true);
+      continue;
+    }
+    struct BdevIoContext *ctx = cmd.ctx;
+    // the worker releases the context once it handles the completion
+    switch (ctx->reqType) {
+      case BlkDevReqType::BLK_DEV_REQ_READ:
+      case BlkDevReqType::BLK_DEV_REQ_SECTOR_READ:
+        gFsProcPtr->submitDevAsyncReadReqCompletion(ctx);
+        break;
+      default:
+        gFsProcPtr->submitBlkWriteReqCompletion(ctx);
+    }
+  }
+  return num;
+}
+
+int BlkDevSim::flushWrittenDevs(FlushCallback cb, void *cbArg) {
+  cfs_tid_t tid = cfsGetTid();
+  std::vector<int> devs = takeDevsToFlush(tid);
+  auto group = new FlushGroup{
+      .cb = cb, .cbArg = cbArg, .numLeft = int(devs.size()), .ok = true};
+  // the store is always durable; a flush just takes the time of a command
+  std::lock_guard<std::mutex> guard(modelLock);
+  for (int dev : devs) {
+    devNumFlushes[dev]++;
+    uint64_t doneTs = models[dev]->submit(nowNs(), /*is_write*/ true, 0);
+    threadQueues[tid].pending.push({doneTs, nullptr, group});
+  }
+  return devs.size();
+}
+
+int BlkDevSim::getInflightReqNum() {
+  auto &q = threadQueues[cfsGetTid()];
+  return q.ctxs.size() - q.unusedReqids.size();
+}
+
+void BlkDevSim::releaseBdevIoContext(struct BdevIoContext *ctx) {
+  qdControllerOnComplete(ctx);
+  ctx->buf = nullptr;
+  threadQueues[ctx->tid].unusedReqids.push_back(ctx->rid);
+}
+
+int BlkDevSim::read(uint64_t blockNo, char *data, void *ctx_payload) {
+  return submitReq(blockNo, /*blockNoSeqNo*/ 0, data,
+                   BlkDevReqType::BLK_DEV_REQ_READ, devBlockSize, ctx_payload);
+}
+
+int BlkDevSim::write(uint64_t blockNo, uint64_t blockNoSeqNo, char *data) {
+  return submitReq(blockNo, blockNoSeqNo, data,
+                   BlkDevReqType::BLK_DEV_REQ_WRITE, devBlockSize,
+                   /*ctx_payload*/ nullptr);
+}
+
+int BlkDevSim::readSector(uint64_t sectorNo, char *data, void *ctx_payload) {
+  return submitReq(sectorNo, /*blockNoSeqNo*/ 0, data,
+                   BlkDevReqType::BLK_DEV_REQ_SECTOR_READ, (SSD_SEC_SIZE),
+                   ctx_payload);
+}
+
+int BlkDevSim::writeSector(uint64_t sectorNo, uint64_t sectorNoSeqNo,
+                           char *data) {
+  return submitReq(sectorNo, sectorNoSeqNo, data,
+                   BlkDevReqType::BLK_DEV_REQ_SECTOR_WRITE, (SSD_SEC_SIZE),
+                   /*ctx_payload*/ nullptr);
+}
+
+int BlkDevSim::blockingRead(uint64_t blockNo, char *data) {
+  return blockingIo(blockNo * devBlockSize, devBlockSize, data,
+                    /*isWrite*/ false);
+}
+
+int BlkDevSim::blockingWrite(uint64_t blockNo, char *data) {
+  return blockingIo(blockNo * devBlockSize, devBlockSize, data,
+                    /*isWrite*/ true);
+}
+
+int BlkDevSim::blockingWriteMultiBlocks(uint64_t blockStartNo, int numBlocks,
+                                        char *data) {
+  assert(numBlocks >= 1);
+  // one command for each run of blocks that is contiguous on a device
+  while (numBlocks > 0) {
+    int curNumBlocks =
+        std::min(uint64_t(numBlocks), stripe.blocksLeftInUnit(blockStartNo));
+    blockingIo(blockStartNo * devBlockSize, curNumBlocks * devBlockSize, data,
+               /*isWrite*/ true);
+    blockStartNo += curNumBlocks;
+    numBlocks -= curNumBlocks;
+    data += uint64_t(curNumBlocks) * devBlockSize;
+  }
+  return 0;
+}
+
+int BlkDevSim::blockingReadSector(uint64_t sectorNo, char *data) {
+  return blockingIo(sectorNo * (SSD_SEC_SIZE), (SSD_SEC_SIZE), data,
+                    /*isWrite*/ false);
+}
+
+int BlkDevSim::blockingWriteSector(uint64_t sectorNo, uint64_t sectorNoSeqNo,
+                                   char *data) {
+  return blockingIo(sectorNo * (SSD_SEC_SIZE), (SSD_SEC_SIZE), data,
+                    /*isWrite*/ true);
+}
@@ -0,0 +1,68 @@
+#include "BlkDevSimModel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+bool BlkDevSimParams::parse_lat_dist(std::string_view name, LatDist &dist) {
+  if (name == "fixed") {
+    dist = LatDist::FIXED;
+  } else if (name == "exp") {
+    dist = LatDist::EXP;
+  } else if (name == "lognormal") {
+    dist = LatDist::LOGNORMAL;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+BlkDevSimModel::BlkDevSimModel(const BlkDevSimParams &params)
+    : params(params),
+      channels(std::max(params.parallelism, 1)),
+      gen(params.seed) {
+  // ln(X) ~ N(mu, sigma^2) with E[X] = 1 and stddev(X) = lat_cv
+  double sigma2 = std::log1p(params.lat_cv * params.lat_cv);
+  lognormal_dist = std::lognormal_distribution<double>(-sigma2 / 2,
+                                                       std::sqrt(sigma2));
+  double bw_mbps[2] = {params.read_bw_mbps, params.write_bw_mbps};
+  for (int i = 0; i < 2; i++)
+    if (bw_mbps[i] > 0) ns_per_byte[i] = 1e9 / (bw_mbps[i] * (1 << 20));
+}
+
+uint64_t BlkDevSimModel::sample_latency(bool is_write) {
+  double mean_ns = (is_write ? params.write_lat_us : params.read_lat_us) * 1e3;
+  switch (params.lat_dist) {
+    case BlkDevSimParams::LatDist::FIXED:
+      return mean_ns;
+    case BlkDevSimParams::LatDist::EXP:
+      return mean_ns * exp_dist(gen);
+    case BlkDevSimParams::LatDist::LOGNORMAL:
+      return mean_ns * lognormal_dist(gen);
+  }
+  assert(false);
+  return mean_ns;
+}
+
+uint64_t BlkDevSimModel::submit(uint64_t now, bool is_write, uint32_t bytes) {
+  auto ch = std::min_element(
+      channels.begin(), channels.end(),
+      [](const Channel &a, const Channel &b) { return a.free_ts < b.free_ts; });
+  uint64_t start = std::max(now, ch->free_ts);
+  double lat = sample_latency(is_write);
+  if (!is_write && params.rw_interference > 0) {
+    int num_writes = std::count_if(
+        channels.begin(), channels.end(),
+        [start](const Channel &c) { return c.is_write && c.free_ts > start; });
+    lat *= 1 + params.rw_interference * num_writes / channels.size();
+  }
+  uint64_t done = start + uint64_t(lat);
+  if (ns_per_byte[is_write] > 0) {
+    uint64_t &bw_ts = bw_free_ts[is_write];
+    bw_ts = std::max(bw_ts, start) + uint64_t(bytes * ns_per_byte[is_write]);
+    done = std::max(done, bw_ts);
+  }
+  ch->free_ts = done;
+  ch->is_write = is_write;
+  return done;
+}
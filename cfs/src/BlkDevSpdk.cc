@@ -12,6 +12,9 @@
 #include <thread>
 
 #include "FsProc_Fs.h"
+#include "FsHugePage.h"
+#include "FsProc_FsInternal.h"
+#include "FsProc_Numa.h"
 #include "config4cpp/Configuration.h"
 #include "spdlog/fmt/ostr.h"
 #include "spdlog/spdlog.h"
@@ -123,12 +126,15 @@ BlkDevSpdk::BlkDevSpdk(const std::string &path, uint32_t blockNum,
                        uint32_t blockSize)
     : BlkDev(path, blockNum, blockSize),
       tidUnusedReqidList(kNumMaxThreads),
-      tidQpairList(kNumMaxThreads, nullptr),
+      tidQpairList(kNumMaxThreads),
       tidWidList(kNumMaxThreads, -1),
       threadInDevQueueReqNumVec(kNumMaxThreads, 0),
       threadAllocCntVec(kNumMaxThreads, 0),
       threadDoneCntVec(kNumMaxThreads, 0),
       lastReportTs(kNumMaxThreads, 0) {
+  tidQdCtrlList.resize(kNumMaxThreads);
+  tidDevInflightList.resize(kNumMaxThreads);
+  tidDevWrittenList.resize(kNumMaxThreads);
   nsSecSize = 0;
   kThreadMaxInflightReqs = SPDK_THREAD_MAX_INFLIGHT;
   gControllers = nullptr;
@@ -147,8 +153,10 @@ BlkDevSpdk::BlkDevSpdk(const std::string &path, uint32_t blockNum,
 BlkDevSpdk::BlkDevSpdk(bool isPosix, const std::string &path, uint32_t blockNum,
                        uint32_t blockSize)
     : BlkDev(path, blockNum, blockSize) {
-  // Do nothing here
   isSpdkDev = (!isPosix);
+  tidQdCtrlList.resize(kNumMaxThreads);
+  tidDevInflightList.resize(kNumMaxThreads);
+  tidDevWrittenList.resize(kNumMaxThreads);
 }
 
 BlkDevSpdk::~BlkDevSpdk() {
@@ -169,6 +177,8 @@ int BlkDevSpdk::devInit() {
   }
   spdk_env_opts_init(&opts);
   probeIoContext.devPtr = this;
+  int numDevs = 1;
+  uint64_t stripeMB = kDefaultStripeMB;
   if (!configFileName.empty()) {
     // Check if the config file exists.
     if (std::experimental::filesystem::exists(configFileName)) {
@@ -179,6 +189,8 @@ int BlkDevSpdk::devInit() {
         opts.name = cfg->lookupString("", "dev_name");
         opts.core_mask = cfg->lookupString("", "core_mask");
         opts.shm_id = cfg->lookupInt("", "shm_id");
+        numDevs = cfg->lookupInt("", "num_devs", numDevs);
+        stripeMB = cfg->lookupInt("", "stripe_mb", stripeMB);
       } catch (const config4cpp::ConfigurationException &ex) {
         SPDLOG_INFO("Config Parse Error:{}", ex.c_str());
         cfg->destroy();
@@ -225,6 +237,33 @@ int BlkDevSpdk::devInit() {
   while (gNamespaces == NULL) {
     // wait until initialization completed
   }
+
+  if (!initStripe(numDevs, stripeMB)) {
+    cleanup();
+    return -1;
+  }
+  for (auto entry = gNamespaces; entry != nullptr; entry = entry->next) {
+    if (int(devNsList.size()) == numDevs) break;
+    devNsList.push_back(entry);
+  }
+  if (int(devNsList.size()) < numDevs) {
+    SPDLOG_ERROR("num_devs:{} but only {} namespaces found", numDevs,
+                 devNsList.size());
+    cleanup();
+    return -1;
+  }
+  for (int dev = 1; dev < numDevs; dev++) {
+    auto ns = devNsList[dev]->ns;
+    uint64_t need = stripe.devNumBlocks(dev, devBlockNum) * devBlockSize;
+    if (spdk_nvme_ns_get_sector_size(ns) != nsSecSize ||
+        spdk_nvme_ns_get_size(ns) < need) {
+      SPDLOG_ERROR("device {} cannot hold its stripes: sector size:{} size:{}",
+                   dev, spdk_nvme_ns_get_sector_size(ns),
+                   spdk_nvme_ns_get_size(ns));
+      cleanup();
+      return -1;
+    }
+  }
   SPDLOG_INFO("{} Initialization complete :)", logInfoStr);
   return 0;
 }
@@ -239,16 +278,19 @@ int BlkDevSpdk::submitDevReq(uint64_t blockNo, uint64_t blockNoSeqNo,
   }
   int rc = -1;
   uint64_t lbaStartNo;
+  int dev;
+  uint64_t devOffset =
+      mapDevOffset(blockNo * curBlockLbaNum * nsSecSize, dev);
   cfs_tid_t tid = cfsGetTid();
-  struct BdevIoContext *ctx_ptr = allocReqContext(tid);
+  struct BdevIoContext *ctx_ptr = allocReqContext(tid, dev);
   if (ctx_ptr == nullptr) {
     // SPDLOG_INFO("submitDevReq cannot allocate request context");
     return -1;
   }
-  auto qp = tidQpairList[tid];
+  auto qp = tidQpairList[tid][dev];
   // auto qpit = tidQpairMap.find(tid);
   // assert(qpit != tidQpairMap.end());
-  lbaStartNo = blockNo * curBlockLbaNum;
+  lbaStartNo = devOffset / nsSecSize;
 
   ctx_ptr->buf = data;
   ctx_ptr->ctx_payload = ctx_payload;
@@ -259,6 +301,7 @@ int BlkDevSpdk::submitDevReq(uint64_t blockNo, uint64_t blockNoSeqNo,
     SPDLOG_DEBUG("submitDevReq libstart:{} blockLbaNum:{}", lbaStartNo,
                  curBlockLbaNum);
   }
+  qdControllerOnSubmit(ctx_ptr);
 
   switch (reqType) {
     case (BlkDevReqType::BLK_DEV_REQ_READ):
@@ -267,8 +310,9 @@ int BlkDevSpdk::submitDevReq(uint64_t blockNo, uint64_t blockNoSeqNo,
         bool ok = checkRWBufWithinBound(ctx_ptr->buf, curBlockLbaNum * 512);
         if (!ok) throw std::runtime_error("read mem out bound\n");
       }
-      rc = spdk_nvme_ns_cmd_read(gNamespaces->ns, qp, ctx_ptr->buf, lbaStartNo,
-                                 curBlockLbaNum, read_complete, ctx_ptr, 0);
+      rc = spdk_nvme_ns_cmd_read(devNsList[dev]->ns, qp, ctx_ptr->buf,
+                                 lbaStartNo, curBlockLbaNum, read_complete,
+                                 ctx_ptr, 0);
       // fprintf(stderr,
       //        "spdk_nvme_ns_cmd_read lhaStart:%lu ctx->ptr:%p "
       //        "ctx_ptr->blockNo:%ld\n",
@@ -276,12 +320,14 @@ int BlkDevSpdk::submitDevReq(uint64_t blockNo, uint64_t blockNoSeqNo,
       break;
     }
     case BlkDevReqType::BLK_DEV_REQ_WRITE: {
+      markDevWritten(tid, dev);
       if (kCheckRWMem) {
         bool ok = checkRWBufWithinBound(ctx_ptr->buf, curBlockLbaNum * 512);
         if (!ok) throw std::runtime_error("write mem out bound\n");
       }
-      rc = spdk_nvme_ns_cmd_write(gNamespaces->ns, qp, ctx_ptr->buf, lbaStartNo,
-                                  curBlockLbaNum, write_complete, ctx_ptr, 0);
+      rc = spdk_nvme_ns_cmd_write(devNsList[dev]->ns, qp, ctx_ptr->buf,
+                                  lbaStartNo, curBlockLbaNum, write_complete,
+                                  ctx_ptr, 0);
       // fprintf(stdout, "write lhaStart:%lu ctx->ptr:%p
       // ctx_ptr->blockNo:%ld\n",
       //        lbaStartNo, data, blockNo);
@@ -306,12 +352,15 @@ int BlkDevSpdk::submitBlockingDevReq(uint64_t blockNo, char *data,
   }
   int rc = -1;
   uint64_t lbaStartNo;
+  int dev;
+  uint64_t devOffset =
+      mapDevOffset(blockNo * curBlockLbaNum * nsSecSize, dev);
   cfs_tid_t tid = cfsGetTid();
-  struct BdevIoContext *ctx_ptr = allocReqContext(tid);
+  struct BdevIoContext *ctx_ptr = allocReqContext(tid, dev);
   // auto qpit = tidQpairList.find(tid);
   // assert(qpit != tidQpairMap.end());
-  auto qpit = tidQpairList[tid];
-  lbaStartNo = blockNo * curBlockLbaNum;
+  auto qpit = tidQpairList[tid][dev];
+  lbaStartNo = devOffset / nsSecSize;
 
   ctx_ptr->buf = data;
   ctx_ptr->blockNo = blockNo;
@@ -324,13 +373,14 @@ int BlkDevSpdk::submitBlockingDevReq(uint64_t blockNo, char *data,
   switch (reqType) {
     case BlkDevReqType::BLK_DEV_REQ_READ:
     case BlkDevReqType::BLK_DEV_REQ_SECTOR_READ:
-      rc = spdk_nvme_ns_cmd_read(gNamespaces->ns, qpit, ctx_ptr->buf,
+      rc = spdk_nvme_ns_cmd_read(devNsList[dev]->ns, qpit, ctx_ptr->buf,
                                  lbaStartNo, curBlockLbaNum,
                                  blocking_read_complete, ctx_ptr, 0);
       break;
     case BlkDevReqType::BLK_DEV_REQ_WRITE:
     case BlkDevReqType::BLK_DEV_REQ_SECTOR_WRITE:
-      rc = spdk_nvme_ns_cmd_write(gNamespaces->ns, qpit, ctx_ptr->buf,
+      markDevWritten(tid, dev);
+      rc = spdk_nvme_ns_cmd_write(devNsList[dev]->ns, qpit, ctx_ptr->buf,
                                   lbaStartNo, curBlockLbaNum,
                                   blocking_write_complete, ctx_ptr, 0);
       break;
@@ -380,11 +430,61 @@ void *BlkDevSpdk::zmallocBuf(uint64_t size, uint64_t align) {
   return addr;
 }
 
+void *BlkDevSpdk::zmallocBufOnNode(uint64_t size, uint64_t align, int node) {
+  // hugepages are reserved per socket; if the node has run out of them, any
+  // memory is better than none
+  void *addr = spdk_dma_malloc_socket(
+      size, align, NULL, node < 0 ? SPDK_ENV_SOCKET_ID_ANY : node);
+  if (addr == NULL && node >= 0) {
+    SPDLOG_WARN("zmallocBuf on socket {} failed; fall back to any socket",
+                node);
+    return zmallocBuf(size, align);
+  }
+  if (addr == NULL) {
+    SPDLOG_ERROR("zmallocBuf failed");
+  }
+  return addr;
+}
+
 int BlkDevSpdk::freeBuf(void *ptr) {
   spdk_dma_free(ptr);
   return 0;
 }
 
+bool BlkDevSpdk::registerDmaMem(char *addr, uint64_t len, char *&start,
+                                char *&end) {
+  // spdk_mem_register() only takes whole 2MB pages
+  start = reinterpret_cast<char *>(
+      (reinterpret_cast<uintptr_t>(addr) + kDmaMemAlign - 1) & ~(kDmaMemAlign - 1));
+  end = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(addr) + len) &
+                                 ~(kDmaMemAlign - 1));
+  if (start >= end) return false;
+  std::lock_guard<std::mutex> guard(dmaMemLock);
+  auto it = dmaMemRegions.find(start);
+  if (it != dmaMemRegions.end()) {
+    assert(it->second.first == end);
+    it->second.second++;
+    return true;
+  }
+  int rc = spdk_mem_register(start, end - start);
+  if (rc != 0) {
+    SPDLOG_WARN("spdk_mem_register({}, {}) failed: {}", fmt::ptr(start),
+                end - start, rc);
+    return false;
+  }
+  dmaMemRegions.emplace(start, std::make_pair(end, 1));
+  return true;
+}
+
+void BlkDevSpdk::unregisterDmaMem(char *start) {
+  std::lock_guard<std::mutex> guard(dmaMemLock);
+  auto it = dmaMemRegions.find(start);
+  assert(it != dmaMemRegions.end());
+  if (--it->second.second > 0) return;
+  spdk_mem_unregister(start, it->second.first - start);
+  dmaMemRegions.erase(it);
+}
+
 int BlkDevSpdk::devExit() {
   cleanup();
   return 0;
@@ -404,29 +504,39 @@ int BlkDevSpdk::blockingWriteMultiBlocks(uint64_t blockStartNo, int numBlocks,
   assert(numBlocks >= 1);
   uint64_t lbaStartNo;
   cfs_tid_t tid = cfsGetTid();
-  struct BdevIoContext *ctx_ptr = allocReqContext(tid);
-  auto qp = tidQpairList[tid];
-  // auto qpit = tidQpairMap.find(tid);
-  // assert(qpit != tidQpairMap.end());
-  lbaStartNo = blockStartNo * defaultBlockLbaNum;
-  if (isDebug) {
-    SPDLOG_DEBUG("BlkDevSpdk::submitBlockingDevReq lbastart:{} blockLbaNum:{}",
-                 lbaStartNo, defaultBlockLbaNum);
-  }
-  ctx_ptr->buf = data;
-  ctx_ptr->blockNo = blockStartNo;
-  ctx_ptr->reqType = BlkDevReqType::BLK_DEV_REQ_WRITE;
-
-  rc = spdk_nvme_ns_cmd_write(gNamespaces->ns, qp, ctx_ptr->buf, lbaStartNo,
-                              (defaultBlockLbaNum * numBlocks),
-                              blocking_write_complete, ctx_ptr, 0);
-
-  // busy wait here
-  while (!ctx_ptr->isDone) {
-    checkCompletion(0);
+  // one command for each run of blocks that is contiguous on a device
+  while (numBlocks > 0) {
+    int curNumBlocks =
+        std::min(uint64_t(numBlocks), stripe.blocksLeftInUnit(blockStartNo));
+    int dev;
+    lbaStartNo = mapDevOffset(blockStartNo * devBlockSize, dev) / nsSecSize;
+    struct BdevIoContext *ctx_ptr = allocReqContext(tid, dev);
+    auto qp = tidQpairList[tid][dev];
+    if (isDebug) {
+      SPDLOG_DEBUG(
+          "BlkDevSpdk::submitBlockingDevReq lbastart:{} blockLbaNum:{}",
+          lbaStartNo, defaultBlockLbaNum);
+    }
+    ctx_ptr->buf = data;
+    ctx_ptr->blockNo = blockStartNo;
+    ctx_ptr->reqType = BlkDevReqType::BLK_DEV_REQ_WRITE;
+    markDevWritten(tid, dev);
+
+    rc = spdk_nvme_ns_cmd_write(devNsList[dev]->ns, qp, ctx_ptr->buf,
+                                lbaStartNo, (defaultBlockLbaNum * curNumBlocks),
+                                blocking_write_complete, ctx_ptr, 0);
+
+    // busy wait here
+    while (rc >= 0 && !ctx_ptr->isDone) {
+      checkCompletion(0);
+    }
+    // release req context
+    releaseReqContext(ctx_ptr);
+    if (rc < 0) return rc;
+    blockStartNo += curNumBlocks;
+    numBlocks -= curNumBlocks;
+    data += uint64_t(curNumBlocks) * devBlockSize;
   }
-  // release req context
-  releaseReqContext(ctx_ptr);
   return rc;
 }
 
@@ -437,7 +547,8 @@ int BlkDevSpdk::blockingZeroSectors(uint64_t lba, uint32_t lba_count) {
   }
   cfs_tid_t tid = cfsGetTid();
   struct BdevIoContext *ctx_ptr = allocReqContext(tid);
-  auto qp = tidQpairList[tid];
+  // only used for the journal, which is on the first device
+  auto qp = tidQpairList[tid][0];
   // auto qpit = tidQpairMap.find(tid);
   // assert(qpit != tidQpairMap.end());
   // doesn't really matter, what we want is just the isDone variable
@@ -446,7 +557,7 @@ int BlkDevSpdk::blockingZeroSectors(uint64_t lba, uint32_t lba_count) {
   ctx_ptr->reqType = BlkDevReqType::BLK_DEV_REQ_WRITE;
   ctx_ptr->isDone = false;
 
-  int rc = spdk_nvme_ns_cmd_write_zeroes(gNamespaces->ns, qp, lba, lba_count,
+  int rc = spdk_nvme_ns_cmd_write_zeroes(devNsList[0]->ns, qp, lba, lba_count,
                                          blocking_write_complete, ctx_ptr, 0);
 
   if (rc < 0) return rc;
@@ -467,7 +578,7 @@ void BlkDevSpdk::addController(struct ctrlr_entry *entry) {
 int BlkDevSpdk::initWorker(int wid) {
   cfsSetTid(wid);
   cfs_tid_t tid = cfsGetTid();
-  if (tidQpairList[tid] != nullptr) {
+  if (!tidQpairList[tid].empty()) {
     SPDLOG_DEBUG("initWorker: this worker has been set to SpdkDev, but it's ok");
     return -1;
   }
@@ -476,13 +587,19 @@ int BlkDevSpdk::initWorker(int wid) {
   // }
   std::lock_guard<std::mutex> lock(lmtx);
   {
-    // init qpair for this thread
-    struct spdk_nvme_qpair *p =
-        spdk_nvme_ctrlr_alloc_io_qpair(gNamespaces->ctrlr, NULL, 0);
-    if (p == nullptr) {
-      SPDLOG_ERROR("ERROR cannot allocate qpair for thread {}", tid);
-      return -1;
+    // init qpairs for this thread, one per device
+    std::vector<struct spdk_nvme_qpair *> qpairs;
+    for (auto entry : devNsList) {
+      struct spdk_nvme_qpair *p =
+          spdk_nvme_ctrlr_alloc_io_qpair(entry->ctrlr, NULL, 0);
+      if (p == nullptr) {
+        SPDLOG_ERROR("ERROR cannot allocate qpair for thread {}", tid);
+        for (auto q : qpairs) spdk_nvme_ctrlr_free_io_qpair(q);
+        return -1;
+      }
+      qpairs.push_back(p);
     }
+    struct spdk_nvme_qpair *p = qpairs[0];
     int curWid = wid;
     threadInflightWriteReqNumMap[curWid] = 0;
     threadInDevQueueReqNumVec[curWid] = 0;
@@ -493,7 +610,7 @@ int BlkDevSpdk::initWorker(int wid) {
       throw std::runtime_error("Sorry tid wid not match");
     }
     tidWidList[tid] = curWid;
-    tidQpairList[tid] = p;
+    tidQpairList[tid] = std::move(qpairs);
     fprintf(stderr, "====== tid:%d wid:%d qpair:%p\n", tid, curWid, p);
     SPDLOG_DEBUG("initWorker-AllocateQpair-tid:{} wid:{} qpir:{}", tid, curWid,
                  reinterpret_cast<uintptr_t>(p));
@@ -506,6 +623,7 @@ int BlkDevSpdk::initWorker(int wid) {
       ctx_ptr->rid = i;
       tidReqvecList[tid][i] = ctx_ptr;
     }
+    initQdController(tid);
     _readyWorkerNum++;
     SPDLOG_INFO("readWorkerNum:{}", _readyWorkerNum);
     if (_readyWorkerNum == _workerNum) {
@@ -521,12 +639,13 @@ int BlkDevSpdk::initWorker(int wid) {
 int BlkDevSpdk::cleanup() {
   struct ns_entry *ns_entry = gNamespaces;
   struct ctrlr_entry *ctrlr_entry = gControllers;
-  for (auto ele : tidQpairList) {
-    if (ele != nullptr) {
+  for (auto &qpairs : tidQpairList) {
+    for (auto ele : qpairs) {
       spdk_nvme_ctrlr_free_io_qpair(ele);
     }
   }
   tidQpairList.clear();
+  devNsList.clear();
 
   // for (auto it = tidQpairMap.begin(); it != tidQpairMap.end(); ++it) {
   //   // free qpair
@@ -597,7 +716,7 @@ void BlkDevSpdk::statsReport() {
   lastReportTs[curWid] = curTs;
 }
 
-struct BdevIoContext *BlkDevSpdk::allocReqContext(cfs_tid_t tid) {
+struct BdevIoContext *BlkDevSpdk::allocReqContext(cfs_tid_t tid, int dev) {
   if (isReportStats) {
     int curWid = tidWidList[cfsGetTid()];
     auto curAllocCntPtr = &(threadAllocCntVec[curWid]);
@@ -617,11 +736,14 @@ struct BdevIoContext *BlkDevSpdk::allocReqContext(cfs_tid_t tid) {
   tidUnusedReqidList[tid].pop_back();
   struct BdevIoContext *ctx_ptr = (tidReqvecList[tid])[rid];
   ctx_ptr->isDone = false;
+  ctx_ptr->submitTs = 0;
+  ctx_ptr->dev = dev;
   return ctx_ptr;
 }
 
 void BlkDevSpdk::releaseReqContext(struct BdevIoContext *ctx) {
   cfs_tid_t tid = ctx->tid;
+  qdControllerOnComplete(ctx);
   ctx->buf = nullptr;
   tidUnusedReqidList[tid].push_back(ctx->rid);
   threadDoneCntVec[tid]++;
@@ -644,18 +766,68 @@ int BlkDevSpdk::reduceInflightWriteNum(int num) {
 }
 
 struct spdk_nvme_ns *BlkDevSpdk::getCurrentThreadNS(void) {
-  // Only one namespace, no need to lookup based on thread
+  // the journal and the metadata it writes are on the first device
   return gNamespaces->ns;
 }
 
 struct spdk_nvme_qpair *BlkDevSpdk::getCurrentThreadQPair(void) {
   cfs_tid_t tid = cfsGetTid();
-  auto qp = tidQpairList[tid];
   // auto qpIt = tidQpairMap.find(tid);
   // if (qpIt == tidQpairMap.end()) throw std::runtime_error("qpair not found");
-  if (qp == nullptr) throw std::runtime_error("qpair not found");
+  if (tidQpairList[tid].empty()) throw std::runtime_error("qpair not found");
 
-  return qp;
+  return tidQpairList[tid][0];
+}
+
+std::vector<int> BlkDevSpdk::takeDevsToFlush(cfs_tid_t tid) {
+  std::vector<int> devs = {0};
+  auto &written = tidDevWrittenList[tid];
+  for (size_t dev = 1; dev < written.size(); dev++)
+    if (written[dev]) devs.push_back(dev);
+  written.assign(written.size(), false);
+  return devs;
+}
+
+void BlkDevSpdk::onFlushDone(FlushGroup *group, bool ok) {
+  group->ok = group->ok && ok;
+  if (--group->numLeft > 0) return;
+  group->cb(group->cbArg, group->ok);
+  delete group;
+}
+
+void BlkDevSpdk::flushComplete(void *arg,
+                               const struct spdk_nvme_cpl *completion) {
+  onFlushDone(static_cast<FlushGroup *>(arg),
+              !spdk_nvme_cpl_is_error(completion));
+}
+
+int BlkDevSpdk::flushWrittenDevs(FlushCallback cb, void *cbArg) {
+  cfs_tid_t tid = cfsGetTid();
+  std::vector<int> devs = takeDevsToFlush(tid);
+  auto group = new FlushGroup{
+      .cb = cb, .cbArg = cbArg, .numLeft = int(devs.size()), .ok = true};
+  // the completions are only reaped by this thread, so the group cannot
+  // complete while the flushes are submitted
+  int numSubmitted = 0;
+  for (int dev : devs) {
+    int rc = spdk_nvme_ns_cmd_flush(devNsList[dev]->ns, tidQpairList[tid][dev],
+                                    flushComplete, group);
+    if (rc != 0) {
+      SPDLOG_ERROR("{} failed to submit flush to device {}, errno={}",
+                   logInfoStr, dev, rc);
+      group->ok = false;
+      group->numLeft--;
+      // a device written with no flush would never be flushed
+      if (dev != 0) tidDevWrittenList[tid][dev] = true;
+      continue;
+    }
+    numSubmitted++;
+  }
+  if (numSubmitted == 0) {
+    delete group;
+    return -1;
+  }
+  return numSubmitted;
 }
 
 // @param maxCmplNum: # of completion fo be processed, 0 --> unlimited
@@ -663,8 +835,8 @@ struct spdk_nvme_qpair *BlkDevSpdk::getCurrentThreadQPair(void) {
 int BlkDevSpdk::checkCompletion(int maxCmplNum) {
   cfs_tid_t tid = cfsGetTid();
   // auto qpIt = tidQpairMap.find(tid);
-  auto qp = tidQpairList[tid];
-  if (qp == nullptr) {
+  auto &qpairs = tidQpairList[tid];
+  if (qpairs.empty()) {
     // if (qpIt == tidQpairMap.end()) {
     fprintf(stderr, " \t=====>cannot find qpair for tid:%d  ", tid);
     // for (auto k : tidQpairMap) {
@@ -688,13 +860,121 @@ int BlkDevSpdk::checkCompletion(int maxCmplNum) {
   //            inflightReqNum, &tid);
   //  }
   // return spdk_nvme_qpair_process_completions(tidQpairMap[tid], checkNum);
-  return spdk_nvme_qpair_process_completions(tidQpairList[tid], checkNum);
+  int num = 0;
+  for (auto qp : qpairs) {
+    int rc = spdk_nvme_qpair_process_completions(qp, checkNum);
+    if (rc < 0) return rc;
+    num += rc;
+  }
+  return num;
+}
+
+int BlkDevSpdk::getInflightReqNum() {
+  cfs_tid_t tid = cfsGetTid();
+  return kThreadMaxInflightReqs - tidUnusedReqidList[tid].size();
 }
 
 void BlkDevSpdk::releaseBdevIoContext(struct BdevIoContext *ctx) {
   releaseReqContext(ctx);
 }
 
+int BlkDevSpdk::getInflightReqLimit() {
+  cfs_tid_t tid = cfsGetTid();
+  if (tid >= tidQdCtrlList.size() || tidQdCtrlList[tid].empty())
+    return SPDK_THREAD_MAX_INFLIGHT;
+  // the request contexts are shared by the devices
+  int limit = 0;
+  for (auto &ctrl : tidQdCtrlList[tid]) limit += ctrl->get_limit();
+  return std::min(limit, SPDK_THREAD_MAX_INFLIGHT);
+}
+
+uint64_t BlkDevSpdk::getCapacityEstimate() {
+  uint64_t capacity = 0;
+  for (int dev = 0; dev < stripe.numDevs; dev++)
+    capacity += getDevCapacityEstimate(dev);
+  return capacity;
+}
+
+int BlkDevSpdk::getDevInflightReqNum(int dev) {
+  cfs_tid_t tid = cfsGetTid();
+  if (tid >= tidDevInflightList.size() || tidDevInflightList[tid].empty())
+    return 0;
+  return tidDevInflightList[tid][dev];
+}
+
+int BlkDevSpdk::getDevInflightReqLimit(int dev) {
+  cfs_tid_t tid = cfsGetTid();
+  if (tid >= tidQdCtrlList.size() || tidQdCtrlList[tid].empty())
+    return SPDK_THREAD_MAX_INFLIGHT;
+  return tidQdCtrlList[tid][dev]->get_limit();
+}
+
+uint64_t BlkDevSpdk::getDevCapacityEstimate(int dev) {
+  uint64_t capacity = 0;
+  for (auto &ctrls : tidQdCtrlList)
+    if (!ctrls.empty()) capacity += ctrls[dev]->get_capacity();
+  return capacity;
+}
+
+bool BlkDevSpdk::initStripe(int numDevs, uint64_t stripeMB) {
+  if (numDevs < 1 || numDevs > kMaxDevs) {
+    SPDLOG_ERROR("num_devs:{} must be in [1, {}]", numDevs, kMaxDevs);
+    return false;
+  }
+  uint64_t unitBlocks = (stripeMB << 20) / devBlockSize;
+  if (numDevs > 1 && unitBlocks == 0) {
+    SPDLOG_ERROR("stripe_mb must be > 0");
+    return false;
+  }
+  stripe.numDevs = numDevs;
+  stripe.unitBlocks = unitBlocks;
+  stripe.firstBlock = get_data_start_block();
+  if (numDevs > 1) {
+    SPDLOG_INFO("{} data striped over {} devices in units of {} MB from block "
+                "{}",
+                logInfoStr, numDevs, stripeMB, stripe.firstBlock);
+  }
+  return true;
+}
+
+void BlkDevSpdk::initQdController(cfs_tid_t tid) {
+  using PlatformLab::PerfUtils::Cycles;
+  QueueDepthController::Params params{
+      .target_latency = Cycles::fromMicroseconds(DEV_QD_TARGET_LATENCY_US),
+      .interval = Cycles::fromMicroseconds(DEV_QD_INTERVAL_US),
+      .min_limit = DEV_QD_MIN_INFLIGHT,
+      .max_limit = SPDK_THREAD_MAX_INFLIGHT,
+      .ticks_per_second = uint64_t(Cycles::perSecond()),
+  };
+  tidQdCtrlList[tid].clear();
+  for (int dev = 0; dev < stripe.numDevs; dev++)
+    tidQdCtrlList[tid].push_back(
+        std::make_unique<QueueDepthController>(params));
+  tidDevInflightList[tid].assign(stripe.numDevs, 0);
+  tidDevWrittenList[tid].assign(stripe.numDevs, false);
+}
+
+void BlkDevSpdk::qdControllerOnSubmit(struct BdevIoContext *ctx) {
+  ctx->submitTs = PlatformLab::PerfUtils::Cycles::rdtsc();
+  auto &ctrls = tidQdCtrlList[ctx->tid];
+  if (ctrls.empty()) return;
+  ctrls[ctx->dev]->on_submit(++tidDevInflightList[ctx->tid][ctx->dev]);
+}
+
+void BlkDevSpdk::qdControllerOnComplete(struct BdevIoContext *ctx) {
+  if (ctx->submitTs == 0) return;
+  auto &ctrls = tidQdCtrlList[ctx->tid];
+  if (ctrls.empty()) return;
+  tidDevInflightList[ctx->tid][ctx->dev]--;
+  auto &ctrl = ctrls[ctx->dev];
+  uint64_t now = PlatformLab::PerfUtils::Cycles::rdtsc();
+  bool isSector = ctx->reqType == BlkDevReqType::BLK_DEV_REQ_SECTOR_READ ||
+                  ctx->reqType == BlkDevReqType::BLK_DEV_REQ_SECTOR_WRITE;
+  ctrl->on_complete(now, now - ctx->submitTs,
+                    isSector ? (SSD_SEC_SIZE) : devBlockSize);
+  ctx->submitTs = 0;
+}
+
 // gFsProcPtr only used by these call back functions
 extern FsProc *gFsProcPtr;
 
@@ -818,14 +1098,29 @@ int BlkDevPosix::write(uint64_t blockNo, uint64_t blockNoSeqNo, char *data) {
 }
 
 void *BlkDevPosix::zmallocBuf(uint64_t size, uint64_t align) {
+  // the large buffers (block buffers, journal) go on huge pages
+  fs_hugepage::Backend backend;
+  void *addr = fs_hugepage::mapAnon(size, &backend);
+  if (addr != NULL) {
+    SPDLOG_INFO("zmallocBuf {} bytes on {} pages", size,
+                fs_hugepage::backendName(backend));
+    return addr;
+  }
   return malloc(size);
 }
 
+void *BlkDevPosix::zmallocBufOnNode(uint64_t size, uint64_t align, int node) {
+  void *addr = zmallocBuf(size, align);
+  // not touched yet, so the pages are faulted in on the node
+  if (addr != NULL) fsp_numa::bindToNode(addr, size, node);
+  return addr;
+}
+
 int BlkDevPosix::freeBuf(void *ptr) {
   if (ptr == NULL) {
     return -1;
   }
-  free(ptr);
+  if (!fs_hugepage::unmap(ptr)) free(ptr);
   return 0;
 }
 
@@ -39,6 +39,41 @@ int BlockBuffer::splitBufferItemsByIndex(
   return 0;
 }
 
+#ifdef DO_SCHED
+BlockBufferHandle BlockBuffer::promoteBlock(BlockBufferHandle item,
+                                            sched::Tenant *tenant) {
+  if (!item->isInMem() || item->isDirty()) return item;
+  block_no_t blockNo = item.get_key();
+  uint32_t index = item->getIndex();
+  char *ptr = item->getBufPtr();
+  sched::Tag probation_tag = item.get_tag();
+  sched::Tag main_tag = probation_tag.get_main();
+  // the handle is gone once erased
+  if (index) blockIndexMap[index].erase(item);
+  lruCache.release(item);
+  if (!lruCache.erase(item)) {
+    // pinned by another request; pin it again and leave it in probation
+    item = lruCache.lookup(blockNo, true);
+    if (index) blockIndexMap[index].emplace(item);
+    return item;
+  }
+  auto handle = lruCache.install(main_tag, blockNo);
+  handle->init(this, ptr);
+  handle->setIndex(index);
+  handle->set_IO_done();
+  lruCache.pin(handle);
+  if (index) blockIndexMap[index].emplace(handle);
+  // the slot goes back to probation through unalloc
+  if (lruCache.relocate(/*src*/ main_tag, /*dst*/ sched::tag::unalloc, 1) !=
+          1 ||
+      lruCache.relocate(/*src*/ sched::tag::unalloc, /*dst*/ probation_tag,
+                        1) != 1)
+    SCHED_LOG_WARNING("Fail to move cache slot after promotion");
+  tenant->on_cache_hit_promoted(blockNo);
+  return handle;
+}
+#endif
+
 // This function will try to keep cache size constant
 void BlockBuffer::installBufferItemsOfIndex(
     uint32_t index, const std::vector<ExportedBlockBufferItem> &itemSet,
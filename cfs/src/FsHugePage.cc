@@ -0,0 +1,243 @@
+#include "FsHugePage.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace fs_hugepage {
+
+namespace {
+
+constexpr size_t kThpSize = 2UL << 20;
+constexpr long kHugetlbfsMagic = 0x958458f6;
+
+size_t roundUp(size_t size, size_t align) {
+  return (size + align - 1) / align * align;
+}
+
+Config loadConfig() {
+  Config cfg;
+  const char *mode = getenv("CFS_HUGEPAGE");
+  if (mode != nullptr) {
+    if (strcmp(mode, "off") == 0 || strcmp(mode, "0") == 0) {
+      cfg.hugetlbPageSize = 0;
+      cfg.thp = false;
+    } else if (strcmp(mode, "thp") == 0) {
+      cfg.hugetlbPageSize = 0;
+    } else if (strcmp(mode, "1g") == 0) {
+      cfg.hugetlbPageSize = 1UL << 30;
+    } else if (strcmp(mode, "2m") != 0) {
+      fprintf(stderr, "CFS_HUGEPAGE=%s unknown, use 2m\n", mode);
+    }
+  }
+  const char *dir = getenv("CFS_HUGETLBFS_DIR");
+  if (dir != nullptr) cfg.hugetlbfsDir = dir;
+  return cfg;
+}
+
+struct Mapping {
+  // rounded up to the page size
+  size_t len = 0;
+  // the hugetlbfs file created for it, until the peer attaches; empty if none
+  std::string path;
+  dev_t dev = 0;
+  ino_t ino = 0;
+};
+
+// mappings of this module
+struct Registry {
+  std::mutex lock;
+  std::unordered_map<void *, Mapping> mappings;
+
+  void add(void *addr, Mapping mapping) {
+    std::lock_guard<std::mutex> guard(lock);
+    mappings.emplace(addr, std::move(mapping));
+  }
+  // @return false if not found
+  bool remove(void *addr, Mapping &mapping) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = mappings.find(addr);
+    if (it == mappings.end()) return false;
+    mapping = std::move(it->second);
+    mappings.erase(it);
+    return true;
+  }
+};
+
+Registry &registry() {
+  static Registry reg;
+  return reg;
+}
+
+int log2Of(size_t size) { return __builtin_ctzl(size); }
+
+void *mapHugetlbAnon(size_t size, size_t pageSize) {
+  size_t len = roundUp(size, pageSize);
+  void *addr = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                        (log2Of(pageSize) << MAP_HUGE_SHIFT),
+                    -1, 0);
+  if (addr == MAP_FAILED) return nullptr;
+  registry().add(addr, {len});
+  return addr;
+}
+
+void *mapThpAnon(size_t size) {
+  // THP needs 2 MB aligned ranges: map one more huge page and trim
+  size_t len = roundUp(size, kThpSize);
+  void *raw = mmap(nullptr, len + kThpSize, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) return nullptr;
+  uintptr_t start = roundUp(reinterpret_cast<uintptr_t>(raw), kThpSize);
+  uintptr_t head = start - reinterpret_cast<uintptr_t>(raw);
+  if (head > 0) munmap(raw, head);
+  munmap(reinterpret_cast<char *>(start) + len, kThpSize - head);
+  void *addr = reinterpret_cast<void *>(start);
+  if (madvise(addr, len, MADV_HUGEPAGE) != 0) {
+    fprintf(stderr, "madvise(MADV_HUGEPAGE) failed: %s\n", strerror(errno));
+  }
+  registry().add(addr, {len});
+  return addr;
+}
+
+// @return the page size of the hugetlbfs mount `dir`; 0 if it is not one
+size_t hugetlbfsPageSize(const std::string &dir) {
+  struct statfs st;
+  if (statfs(dir.c_str(), &st) != 0 || st.f_type != kHugetlbfsMagic) return 0;
+  return st.f_bsize;
+}
+
+}  // namespace
+
+const char *backendName(Backend backend) {
+  switch (backend) {
+    case Backend::kThp:
+      return "thp";
+    case Backend::kHugetlb:
+      return "hugetlb";
+    default:
+      return "4k";
+  }
+}
+
+Config &config() {
+  static Config cfg = loadConfig();
+  return cfg;
+}
+
+void *mapAnon(size_t size, Backend *backend) {
+  const Config &cfg = config();
+  if (backend != nullptr) *backend = Backend::kNone;
+  if (size < kThpSize) return nullptr;
+  // a 1 GB page for a small buffer would waste most of it
+  if (cfg.hugetlbPageSize > 0 && size >= cfg.hugetlbPageSize) {
+    void *addr = mapHugetlbAnon(size, cfg.hugetlbPageSize);
+    if (addr != nullptr) {
+      if (backend != nullptr) *backend = Backend::kHugetlb;
+      return addr;
+    }
+  }
+  if (!cfg.thp) return nullptr;
+  void *addr = mapThpAnon(size);
+  if (addr != nullptr && backend != nullptr) *backend = Backend::kThp;
+  return addr;
+}
+
+void *mapShm(const std::string &name, size_t size, bool create) {
+  const Config &cfg = config();
+  if (cfg.hugetlbfsDir.empty()) return nullptr;
+  size_t pageSize = hugetlbfsPageSize(cfg.hugetlbfsDir);
+  if (pageSize == 0) return nullptr;
+  std::string path = cfg.hugetlbfsDir + "/" + name;
+  // the creator decides: the peer attaches to the file whatever its config
+  if (create && cfg.hugetlbPageSize == 0) {
+    // a file left by a run with huge pages would be attached by the peer
+    unlink(path.c_str());
+    return nullptr;
+  }
+
+  mode_t oldMask = umask(0);
+  int flags = create ? (O_CREAT | O_EXCL | O_RDWR) : O_RDWR;
+  int fd = open(path.c_str(), flags, 0666);
+  if (fd < 0 && create && errno == EEXIST) {
+    // left by a run that died before its peer attached: the peer must not
+    // attach to it, so replace it
+    unlink(path.c_str());
+    fd = open(path.c_str(), flags, 0666);
+  }
+  umask(oldMask);
+  if (fd < 0) {
+    if (create) {
+      fprintf(stderr, "open(%s) error:%s\n", path.c_str(), strerror(errno));
+    }
+    return nullptr;
+  }
+  Mapping mapping{roundUp(size, pageSize)};
+  struct stat st;
+  void *addr = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (!create || ftruncate(fd, mapping.len) == 0)) {
+    // the huge pages are reserved here: it fails if there are not enough
+    addr = mmap(nullptr, mapping.len, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                0);
+  }
+  int err = errno;
+  close(fd);
+  if (addr == MAP_FAILED) {
+    fprintf(stderr, "hugetlbfs mmap(%s, %lu) failed: %s\n", path.c_str(),
+            mapping.len, strerror(err));
+    if (create) unlink(path.c_str());
+    return nullptr;
+  }
+  if (create) {
+    // removed when the peer attaches, or at unmap() if it never does
+    mapping.path = path;
+    mapping.dev = st.st_dev;
+    mapping.ino = st.st_ino;
+  } else {
+    // both sides are mapped: the pages live until both unmap them, and a
+    // crash can no longer leave them reserved
+    unlink(path.c_str());
+  }
+  registry().add(addr, std::move(mapping));
+  return addr;
+}
+
+void adviseThp(void *addr, size_t size) {
+  if (!config().thp || size < kThpSize) return;
+  // shmem THP is off unless shmem_enabled allows it; failing is fine
+  madvise(addr, size, MADV_HUGEPAGE);
+}
+
+bool unmap(void *addr) {
+  Mapping mapping;
+  if (!registry().remove(addr, mapping)) return false;
+  if (munmap(addr, mapping.len) != 0) {
+    fprintf(stderr, "munmap(%p, %lu) failed: %s\n", addr, mapping.len,
+            strerror(errno));
+  }
+  struct stat st;
+  // unless the peer removed it, and maybe a new run created one since
+  if (!mapping.path.empty() && stat(mapping.path.c_str(), &st) == 0 &&
+      st.st_dev == mapping.dev && st.st_ino == mapping.ino) {
+    unlink(mapping.path.c_str());
+  }
+  return true;
+}
+
+}  // namespace fs_hugepage
@@ -6,6 +6,7 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 
+#include <algorithm>
 #include <atomic>
 #include <iostream>
 #include <stdexcept>
@@ -33,6 +34,7 @@
 #include <utility>
 
 #include "FsLibApp.h"
+#include "FsLibTrace.h"
 #include "FsMsg.h"
 #include "FsProc_FsInternal.h"
 #include "fsapi.h"
@@ -136,17 +138,21 @@ static void dumpAllocatedOpCommon(allocatedOpCommonPacked *alOp) {
           alOp->shmid, alOp->dataPtrId, alOp->perAppSeqNo);
 }
 
-FsService::FsService(int wid, key_t key)
+FsService::FsService(int wid, key_t key, int threadRingId)
     : unusedSlotsLock(ATOMIC_FLAG_INIT),
       shmKey(key),
       wid(wid),
+      threadRingId(threadRingId),
       channelPtr(nullptr) {
-  for (auto i = 0; i < RING_SIZE; i++) {
+  int ringSize = threadRingId == 0 ? RING_SIZE : THREAD_RING_SIZE;
+  for (auto i = 0; i < ringSize; i++) {
     unusedRingSlots.push_back(i);
   }
   initService();
 }
 
+FsService::FsService(int wid, key_t key) : FsService(wid, key, 0) {}
+
 // Assume 0 means no shmKey available
 FsService::FsService() : FsService(0, 0) {}
 
@@ -161,6 +167,18 @@ void FsService::initService() {
   }
 
   char shmfile[128];
+  if (threadRingId != 0) {
+    // the thread ring is created by the client and only has this thread as
+    // its producer
+    snprintf(shmfile, 128, THREAD_RING_SHM_NAME_FMT, (int)shmKey,
+             threadRingId);
+    shmipc_mgr = shmipc_mgr_init(shmfile, THREAD_RING_SIZE, 1);
+    if (shmipc_mgr == NULL) {
+      throw std::runtime_error("initservice failed to create thread ring");
+    }
+    shmipc_mgr->single_producer = 1;
+    return;
+  }
   snprintf(shmfile, 128, "/shmipc_mgr_%08d", (int)shmKey);
 
   // We create the memory on server side, so for client this is 0
@@ -599,12 +617,16 @@ static inline void prepare_unlinkOp(struct shmipc_msg *msg, struct unlinkOp *op,
   EmbedThreadIdToAsOpRet(op->ret);
 }
 
-static inline void prepare_opendirOp(struct shmipc_msg *msg,
-                                     struct opendirOp *op,
-                                     const char *pathname) {
-  msg->type = CFS_OP_OPENDIR;
+static inline void prepare_readdirOp(struct shmipc_msg *msg,
+                                     struct readdirOp *op,
+                                     const char *pathname, uint64_t cursor,
+                                     int count, bool plus) {
+  msg->type = CFS_OP_READDIR;
   adjustPath(pathname, &(op->name[0]));
-  EmbedThreadIdToAsOpRet(op->numDentry);
+  op->cursor = cursor;
+  op->maxEntries = count;
+  op->plus = plus ? 1 : 0;
+  EmbedThreadIdToAsOpRet(op->tid);
 }
 
 static inline void prepare_rmdirOp(struct shmipc_msg *msg, struct rmdirOp *op,
@@ -717,6 +739,19 @@ thread_local int threadFsTid = 0;
 thread_local FsApiTs *tFsApiTs;
 #endif
 
+// op trace capture, enabled by env CFS_LIB_TRACE_DIR (see FsLibTrace.h)
+// nullptr if tracing is disabled for this thread
+thread_local std::unique_ptr<FsTraceWriter> tFsTrace;
+static const char *gTraceDir = nullptr;
+static uint64_t gTraceBaseTsNs = 0;
+static std::once_flag gTraceInitFlag;
+
+#define FSLIB_TRACE(op, fd, offset, size, path)                            \
+  do {                                                                     \
+    if (tFsTrace)                                                          \
+      tFsTrace->add((op), tFsTrace->now(), (fd), (offset), (size), (path)); \
+  } while (0)
+
 #ifdef FS_LIB_SPPG
 constexpr uint32_t kLocalPinnedMemSize = ((uint32_t)1024) * 1024 * 16;  // 16M
 
@@ -745,6 +780,96 @@ static inline off_t shmipc_mgr_alloc_slot_dbg(struct shmipc_mgr *mgr) {
 
 /*----------------------------------------------------------------------------*/
 
+// Per app thread request rings (see CFS_OP_THREAD_RING)
+// Enabled for a thread by fs_init_thread_local_mem(). The ring to one worker
+// is created and registered on the first request of the thread to that
+// worker, so workers the thread never talks to are left alone. The rings are
+// unregistered when the thread exits.
+struct FsLibThreadRings {
+  ~FsLibThreadRings();
+  // @return the service of this thread's ring to wid, or sharedServ if the
+  // ring cannot be set up
+  FsService *getService(int wid, FsService *sharedServ);
+  void dropAll(bool unregister);
+
+  // <wid, service>; nullptr if the setup failed, to not retry on every op
+  std::unordered_map<int, FsService *> services;
+  int epoch;
+};
+thread_local std::unique_ptr<FsLibThreadRings> tThreadRings;
+static std::atomic_int gThreadRingIdIncr{0};
+// bumped by fs_exit(), after which the server no longer knows the rings
+static std::atomic_int gThreadRingEpoch{0};
+
+static int send_thread_ring_op(FsService *fsServ, int ringId,
+                               bool isRegister) {
+  struct shmipc_msg msg;
+  struct threadRingOp *op;
+  off_t ring_idx;
+  int ret;
+  ring_idx = shmipc_mgr_alloc_slot_dbg(fsServ->shmipc_mgr);
+  op = (struct threadRingOp *)IDX_TO_XREQ(fsServ->shmipc_mgr, ring_idx);
+  memset(&msg, 0, sizeof(msg));
+  msg.type = CFS_OP_THREAD_RING;
+  op->ringId = ringId;
+  op->isRegister = isRegister;
+  shmipc_mgr_put_msg(fsServ->shmipc_mgr, ring_idx, &msg);
+  ret = op->ret;
+  shmipc_mgr_dealloc_slot(fsServ->shmipc_mgr, ring_idx);
+  return ret;
+}
+
+FsService *FsLibThreadRings::getService(int wid, FsService *sharedServ) {
+  if (epoch != gThreadRingEpoch) {
+    dropAll(false);
+    epoch = gThreadRingEpoch;
+  }
+  auto it = services.find(wid);
+  if (it != services.end()) {
+    return it->second == nullptr ? sharedServ : it->second;
+  }
+
+  int ringId = ++gThreadRingIdIncr;
+  FsService *serv = nullptr;
+  try {
+    serv = new FsService(wid, sharedServ->GetShmkey(), ringId);
+  } catch (std::runtime_error &e) {
+    fprintf(stderr, "ERROR cannot create thread ring to wid:%d - %s\n", wid,
+            e.what());
+  }
+  if (serv != nullptr && send_thread_ring_op(sharedServ, ringId, true) < 0) {
+    delete serv;
+    serv = nullptr;
+  }
+  services.emplace(wid, serv);
+  return serv == nullptr ? sharedServ : serv;
+}
+
+void FsLibThreadRings::dropAll(bool unregister) {
+  for (auto [wid, serv] : services) {
+    if (serv == nullptr) continue;
+    if (unregister) {
+      auto it = gServMngPtr->multiFsServMap.find(wid);
+      if (it != gServMngPtr->multiFsServMap.end())
+        send_thread_ring_op(it->second, serv->GetThreadRingId(), false);
+    }
+    delete serv;
+  }
+  services.clear();
+}
+
+FsLibThreadRings::~FsLibThreadRings() {
+  // the server drops all the rings on fs_exit(), and the shared services are
+  // gone after fs_cleanup()
+  dropAll(gServMngPtr != nullptr && !gCleanedUpDone &&
+          epoch == gThreadRingEpoch);
+}
+
+static inline FsService *getThreadFsService(int wid, FsService *sharedServ) {
+  if (!tThreadRings) return sharedServ;
+  return tThreadRings->getService(wid, sharedServ);
+}
+
 // Global utility function for resolivng FsService given a file descriptor
 inline FsService *getFsServiceForFD(int fd, int &wid) {
   auto &fdMap = gLibSharedContext->fdWidMap;
@@ -753,13 +878,13 @@ inline FsService *getFsServiceForFD(int fd, int &wid) {
     wid = search->second;
     auto service = gServMngPtr->multiFsServMap[wid];
     service->inUse = true;
-    return service;
+    return getThreadFsService(wid, service);
   }
 
   // TODO (ask jing) - do fd's also default to primary if they aren't in the
   // map?
   wid = gPrimaryServWid;
-  return gServMngPtr->primaryServ;
+  return getThreadFsService(wid, gServMngPtr->primaryServ);
 }
 
 inline FsService *getFsServiceForPath(const char *path, int &wid) {
@@ -769,11 +894,11 @@ inline FsService *getFsServiceForPath(const char *path, int &wid) {
     wid = search->second;
     auto service = gServMngPtr->multiFsServMap[wid];
     service->inUse = true;
-    return service;
+    return getThreadFsService(wid, service);
   }
 
   wid = gPrimaryServWid;
-  return gServMngPtr->primaryServ;
+  return getThreadFsService(wid, gServMngPtr->primaryServ);
 }
 
 // getWidFromReturnCode returns a wid >= 0 when rc indicates that an inode has
@@ -888,6 +1013,14 @@ void _setup_app_thread_mem_buf() {
   tFsApiTs = gLibSharedContext->apiTsMng_.initForTid(threadFsTid);
   if (tFsApiTs == nullptr) throw std::runtime_error("error cannot get apiTs");
 #endif
+  std::call_once(gTraceInitFlag, []() {
+    gTraceDir = getenv(CFS_LIB_TRACE_DIR_ENV);
+    gTraceBaseTsNs = fsTraceClockNs();
+  });
+  if (gTraceDir != nullptr) {
+    tFsTrace.reset(new FsTraceWriter(gTraceDir, threadFsTid, gTraceBaseTsNs));
+    if (!tFsTrace->isOk()) tFsTrace.reset();
+  }
   auto curFsLibMemBuf = new FsLibMemMng(gLibSharedContext->key, threadFsTid);
   int rc = curFsLibMemBuf->init(true);
   if (rc < 0) {
@@ -1141,6 +1274,9 @@ static inline bool check_fs_access_ok() {
 int fs_exit() {
   int ret = 0;
 
+  // the per-thread rings are dropped by the server along with the app
+  gThreadRingEpoch++;
+
   for (auto iter : gServMngPtr->multiFsServMap) {
     auto service = iter.second;
     if (!(service->inUse)) continue;
@@ -1167,6 +1303,8 @@ int fs_exit() {
 #ifdef CFS_LIB_SAVE_API_TS
   gLibSharedContext->apiTsMng_.reportAllTs();
 #endif
+  // other threads' traces are flushed when they exit
+  if (tFsTrace) tFsTrace->flush();
   pid_t my_pid = getpid();
   char my_recv_sock_path[128];
   sprintf(my_recv_sock_path, "/ufs-app-%d", my_pid);
@@ -1440,6 +1578,7 @@ int fs_stat(const char *pathname, struct stat *statbuf) {
 #ifdef CFS_LIB_SAVE_API_TS
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_STAT);
 #endif
+  FSLIB_TRACE(FsTraceOp::STAT, -1, -1, 0, pathname);
   int delixArr[32];
   int dummy;
   char *standardPath = filepath2TokensStandardized(pathname, delixArr, dummy);
@@ -1567,6 +1706,8 @@ static int fs_open_internal(FsService *fsServ, const char *path, int flags,
 int fs_open(const char *path, int flags, mode_t mode) {
   int delixArr[32];
   int dummy;
+  // the fd is only known on return, but the record uses the call time
+  uint64_t traceTs = tFsTrace ? tFsTrace->now() : 0;
 #ifdef CFS_LIB_SAVE_API_TS
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_OPEN);
 #endif
@@ -1606,6 +1747,7 @@ free_and_return:
 #ifdef CFS_LIB_SAVE_API_TS
   tFsApiTs->addApiNormalDone(FsApiType::FS_OPEN, tsIdx);
 #endif
+  if (tFsTrace) tFsTrace->add(FsTraceOp::OPEN, traceTs, rc, -1, flags, path);
   return rc;
 }
 
@@ -1657,6 +1799,7 @@ int fs_close(int fd) {
 #ifdef CFS_LIB_SAVE_API_TS
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_CLOSE);
 #endif
+  FSLIB_TRACE(FsTraceOp::CLOSE, fd, -1, 0, nullptr);
 #ifdef LDB_PRINT_CALL
   print_close(fd);
 #endif
@@ -1846,6 +1989,7 @@ int fs_unlink_internal(FsService *fsServ, const char *pathname) {
 int fs_unlink(const char *pathname) {
   int delixArr[32];
   int dummy;
+  FSLIB_TRACE(FsTraceOp::UNLINK, -1, -1, 0, pathname);
 #ifdef CFS_LIB_SAVE_API_TS
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_UNLINK);
 #endif
@@ -1891,6 +2035,7 @@ int fs_mkdir_internal(FsService *fsServ, const char *pathname, mode_t mode) {
 }
 
 int fs_mkdir(const char *pathname, mode_t mode) {
+  FSLIB_TRACE(FsTraceOp::MKDIR, -1, -1, mode, pathname);
 #ifdef CFS_LIB_SAVE_API_TS
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_MKDIR);
 #endif
@@ -1901,68 +2046,113 @@ int fs_mkdir(const char *pathname, mode_t mode) {
   return rt;
 }
 
-CFS_DIR *fs_opendir_internal(FsService *fsServ, const char *name) {
+int fs_readdir_chunk_internal(FsService *fsServ, const char *name,
+                              uint64_t *cursor, struct dirent *dents,
+                              struct stat *stats, int count) {
   struct shmipc_msg msg;
-  struct opendirOp *odop;
-  cfs_dirent *cfsDentryPtr;
-  CFS_DIR *dirp;
+  struct readdirOp *rdop;
   off_t ring_idx;
-  int numTotalDentry;
   uint8_t shmid;
   fslib_malloc_block_cnt_t dataPtrId;
+  int ret;
 
-  auto threadMemBuf = check_app_thread_mem_buf_ready();
+  if (count <= 0) return 0;
+  if (count > FS_READDIR_CHUNK) count = FS_READDIR_CHUNK;
+  bool plus = (stats != nullptr);
+  size_t entSize = plus ? sizeof(readdirPlusEnt) : sizeof(readdirEnt);
 
-  // zalloc is unnecessarily costly, use malloc
-  void *dataPtr = fs_malloc((FS_DIR_MAX_WIDTH) * sizeof(cfs_dirent));
+  auto threadMemBuf = check_app_thread_mem_buf_ready();
+  void *dataPtr = fs_malloc(count * entSize);
 
   int err = 0;
   threadMemBuf->getBufOwnerInfo(dataPtr, false, shmid, dataPtrId, err);
   if (err) {
-    fprintf(stderr, "fs_opendir_internal: Error in getBufOwnerInfo\n");
-    return NULL;
+    fprintf(stderr, "fs_readdir_chunk_internal: Error in getBufOwnerInfo\n");
+    fs_free(dataPtr);
+    return -1;
   }
 
   memset(&msg, 0, sizeof(msg));
   ring_idx = shmipc_mgr_alloc_slot_dbg(fsServ->shmipc_mgr);
-  odop = (struct opendirOp *)IDX_TO_XREQ(fsServ->shmipc_mgr, ring_idx);
-  prepare_opendirOp(&msg, odop, name);
-  odop->alOp.shmid = shmid;
-  odop->alOp.dataPtrId = dataPtrId;
+  rdop = (struct readdirOp *)IDX_TO_XREQ(fsServ->shmipc_mgr, ring_idx);
+  prepare_readdirOp(&msg, rdop, name, *cursor, count, plus);
+  rdop->alOp.shmid = shmid;
+  rdop->alOp.dataPtrId = dataPtrId;
 
   // send request
   shmipc_mgr_put_msg(fsServ->shmipc_mgr, ring_idx, &msg);
 
-  // TODO ensure that the operation was successful
-  numTotalDentry = odop->numDentry;
-  cfsDentryPtr = (cfs_dirent *)(dataPtr);
-  dirp = (CFS_DIR *)malloc(sizeof(*dirp));
-  dirp->dentryNum = 0;
-  dirp->dentryIdx = 0;
-  if (numTotalDentry > 0) {
-    dirp->firstDentry = (dirent *)malloc(sizeof(dirent) * numTotalDentry);
-    for (int i = 0; i < numTotalDentry; i++) {
-      if ((cfsDentryPtr + i)->inum == 0) {
-        // Currently the openDir's FSP side implementation will read the whole
-        // inode content, which contains the empty inode (after unlink)
-        continue;
-      }
-      (dirp->firstDentry + dirp->dentryNum)->d_ino = (cfsDentryPtr + i)->inum;
-      strcpy((dirp->firstDentry + dirp->dentryNum)->d_name,
-             (cfsDentryPtr + i)->name);
-      // Explicitly set d_type to UNKNOWN since we don't plan to carry type
-      // info. See struct cfs_dirent comment.
-      (dirp->firstDentry + dirp->dentryNum)->d_type = DT_UNKNOWN;
-      dirp->dentryNum++;
+  ret = rdop->ret;
+  if (ret >= 0) *cursor = rdop->cursor;
+  shmipc_mgr_dealloc_slot(fsServ->shmipc_mgr, ring_idx);
+
+  for (int i = 0; i < ret; i++) {
+    struct readdirPlusEnt *pent = static_cast<readdirPlusEnt *>(dataPtr) + i;
+    struct readdirEnt *ent =
+        plus ? &pent->ent : static_cast<readdirEnt *>(dataPtr) + i;
+    dents[i].d_ino = ent->ino;
+    dents[i].d_off = 0;
+    dents[i].d_reclen = sizeof(struct dirent);
+    dents[i].d_type = ent->type;
+    memcpy(dents[i].d_name, ent->name, DIRSIZE);
+    if (!plus) continue;
+    if (pent->hasAttrs) {
+      stats[i] = pent->statbuf;
+      continue;
+    }
+    // the inode is owned by another worker, which has its attributes
+    std::string path = std::string(name) + "/" + ent->name;
+    if (fs_stat(path.c_str(), &stats[i]) == 0) {
+      dents[i].d_type = S_ISDIR(stats[i].st_mode) ? DT_DIR : DT_REG;
+    } else {
+      // unlinked since the chunk was read, as readdir() then stat()
+      memset(&stats[i], 0, sizeof(struct stat));
     }
   }
 #ifdef _CFS_LIB_PRINT_REQ_
-  fprintf(stdout, "fs_opendir(%s)\n", name);
+  fprintf(stdout, "fs_readdir_chunk(%s, plus:%d) ret:%d\n", name, plus, ret);
 #endif
-  // TODO measure cost to hold the slot. If it is too much, we might as well
-  // copy the data and release the slot.
-  shmipc_mgr_dealloc_slot(fsServ->shmipc_mgr, ring_idx);
   fs_free(dataPtr);
+  return ret;
+}
+
+int fs_readdir_chunk(const char *name, uint64_t *cursor, struct dirent *dents,
+                     struct stat *stats, int count) {
+  return fs_readdir_chunk_internal(gServMngPtr->primaryServ, name, cursor,
+                                   dents, stats, count);
+}
+
+// Fetch the next chunk of dirp into its buffers.
+// @return false on error
+static bool fs_readdir_fill(FsService *fsServ, CFS_DIR *dirp) {
+  int ret = fs_readdir_chunk_internal(fsServ, dirp->name, &dirp->cursor,
+                                      dirp->firstDentry, dirp->firstStat,
+                                      FS_READDIR_CHUNK);
+  dirp->dentryIdx = 0;
+  dirp->dentryNum = std::max(ret, 0);
+  // a short chunk is the last one
+  dirp->eof = (ret < FS_READDIR_CHUNK);
+  return ret >= 0;
+}
+
+static CFS_DIR *fs_opendir_internal(FsService *fsServ, const char *name,
+                                    bool plus) {
+  CFS_DIR *dirp = (CFS_DIR *)malloc(sizeof(*dirp));
+  dirp->name = strdup(name);
+  dirp->cursor = 0;
+  dirp->firstDentry =
+      (struct dirent *)malloc(sizeof(struct dirent) * FS_READDIR_CHUNK);
+  dirp->firstStat =
+      plus ? (struct stat *)malloc(sizeof(struct stat) * FS_READDIR_CHUNK)
+           : nullptr;
+  // the first chunk tells if the dir exists
+  if (!fs_readdir_fill(fsServ, dirp)) {
+    fs_closedir(dirp);
+    return NULL;
+  }
+#ifdef _CFS_LIB_PRINT_REQ_
+  fprintf(stdout, "fs_opendir(%s)\n", name);
+#endif
   return dirp;
 }
 
@@ -1971,13 +2161,35 @@ CFS_DIR *fs_opendir(const char *name) {
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_OPENDIR);
 #endif
   CFS_DIR *rt;
-  rt = fs_opendir_internal(gServMngPtr->primaryServ, name);
+  rt = fs_opendir_internal(gServMngPtr->primaryServ, name, /*plus*/ false);
 #ifdef CFS_LIB_SAVE_API_TS
   tFsApiTs->addApiNormalDone(FsApiType::FS_OPENDIR, tsIdx);
 #endif
   return rt;
 }
 
+CFS_DIR *fs_opendirplus(const char *name) {
+#ifdef CFS_LIB_SAVE_API_TS
+  int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_OPENDIR);
+#endif
+  CFS_DIR *rt;
+  rt = fs_opendir_internal(gServMngPtr->primaryServ, name, /*plus*/ true);
+#ifdef CFS_LIB_SAVE_API_TS
+  tFsApiTs->addApiNormalDone(FsApiType::FS_OPENDIR, tsIdx);
+#endif
+  return rt;
+}
+
+// @return the index of the next entry in the chunk of dirp; -1 at the end
+static int fs_readdir_next(CFS_DIR *dirp) {
+  if (dirp->dentryIdx == dirp->dentryNum) {
+    if (dirp->eof) return -1;
+    if (!fs_readdir_fill(gServMngPtr->primaryServ, dirp)) return -1;
+    if (dirp->dentryNum == 0) return -1;
+  }
+  return dirp->dentryIdx++;
+}
+
 struct dirent *fs_readdir(CFS_DIR *dirp) {
 #ifdef _CFS_LIB_PRINT_REQ_
   fprintf(stdout, "fs_readdir()\n");
@@ -1986,12 +2198,31 @@ struct dirent *fs_readdir(CFS_DIR *dirp) {
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_READDIR);
 #endif
   struct dirent *dent = NULL;
-  if (dirp->dentryIdx > dirp->dentryNum) goto return_dent;
-  if (dirp->dentryIdx == dirp->dentryNum) {
-    goto return_dent;
+  int idx = fs_readdir_next(dirp);
+  if (idx >= 0) dent = dirp->firstDentry + idx;
+#ifdef CFS_LIB_SAVE_API_TS
+  tFsApiTs->addApiNormalDone(FsApiType::FS_READDIR, tsIdx);
+#endif
+  return dent;
+}
+
+struct dirent *fs_readdirplus(CFS_DIR *dirp, struct stat *statbuf) {
+#ifdef _CFS_LIB_PRINT_REQ_
+  fprintf(stdout, "fs_readdirplus()\n");
+#endif
+  if (dirp->firstStat == nullptr) {
+    fprintf(stderr, "fs_readdirplus: dir not opened by fs_opendirplus\n");
+    return NULL;
+  }
+#ifdef CFS_LIB_SAVE_API_TS
+  int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_READDIR);
+#endif
+  struct dirent *dent = NULL;
+  int idx = fs_readdir_next(dirp);
+  if (idx >= 0) {
+    dent = dirp->firstDentry + idx;
+    *statbuf = dirp->firstStat[idx];
   }
-  dent = (dirp->firstDentry + (dirp->dentryIdx++));
-return_dent:
 #ifdef CFS_LIB_SAVE_API_TS
   tFsApiTs->addApiNormalDone(FsApiType::FS_READDIR, tsIdx);
 #endif
@@ -2011,9 +2242,9 @@ int fs_closedir(CFS_DIR *dirp) {
 #endif
 
   // assume a close must follow an open, then free in close
-  if (dirp->firstDentry != NULL) {
-    free(dirp->firstDentry);
-  }
+  free(dirp->firstDentry);
+  free(dirp->firstStat);
+  free(dirp->name);
 
   free(dirp);
 #ifdef CFS_LIB_SAVE_API_TS
@@ -2116,6 +2347,7 @@ int fs_fsync(int fd) {
 #ifdef LDB_PRINT_CALL
   print_fsync(fd);
 #endif
+  FSLIB_TRACE(FsTraceOp::FSYNC, fd, -1, 0, nullptr);
   int wid = -1;
 #ifdef CFS_LIB_SAVE_API_TS
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_FSYNC);
@@ -2142,6 +2374,7 @@ int fs_fdatasync(int fd) {
 #ifdef LDB_PRINT_CALL
   print_fsync(fd);
 #endif
+  FSLIB_TRACE(FsTraceOp::FDATASYNC, fd, -1, 0, nullptr);
   int wid = -1;
 #ifdef CFS_LIB_SAVE_API_TS
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_FSYNC);
@@ -2276,6 +2509,7 @@ ssize_t fs_read_internal(FsService *fsServ, int fd, void *buf, size_t count) {
 }
 
 ssize_t fs_read(int fd, void *buf, size_t count) {
+  FSLIB_TRACE(FsTraceOp::READ, fd, -1, count, nullptr);
   int wid = -1;
 #ifdef CFS_LIB_SAVE_API_TS
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_READ);
@@ -2333,6 +2567,7 @@ static ssize_t fs_pread_internal(FsService *fsServ, int fd, void *buf,
 }
 
 ssize_t fs_pread(int fd, void *buf, size_t count, off_t offset) {
+  FSLIB_TRACE(FsTraceOp::PREAD, fd, offset, count, nullptr);
   int wid = -1;
 #ifdef CFS_LIB_SAVE_API_TS
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_PREAD);
@@ -2434,6 +2669,7 @@ static ssize_t fs_write_internal(FsService *fsServ, int fd, const void *buf,
 
 ssize_t fs_write(int fd, const void *buf, size_t count) {
   if (count == 0) return 0;
+  FSLIB_TRACE(FsTraceOp::WRITE, fd, -1, count, nullptr);
 #ifdef CFS_LIB_SAVE_API_TS
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_WRITE);
 #endif
@@ -2499,6 +2735,7 @@ static ssize_t fs_pwrite_internal(FsService *fsServ, int fd, const void *buf,
 
 ssize_t fs_pwrite(int fd, const void *buf, size_t count, off_t offset) {
   if (count == 0) return 0;
+  FSLIB_TRACE(FsTraceOp::PWRITE, fd, offset, count, nullptr);
 #ifdef CFS_LIB_SAVE_API_TS
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_PWRITE);
 #endif
@@ -2564,6 +2801,7 @@ ssize_t fs_allocated_read(int fd, void *buf, size_t count) {
 #ifdef LDB_PRINT_CALL
   print_read(fd, buf, count);
 #endif
+  FSLIB_TRACE(FsTraceOp::READ, fd, -1, count, nullptr);
   int wid = -1;
   if (count == 0) return 0;
 #ifdef CFS_LIB_SAVE_API_TS
@@ -2643,6 +2881,7 @@ ssize_t fs_allocated_pread(int fd, void *buf, size_t count, off_t offset) {
     LeaseUnref(entry);
     fd = base_fd;
   }
+  FSLIB_TRACE(FsTraceOp::PREAD, fd, offset, count, nullptr);
   int wid = -1;
 #ifdef CFS_LIB_SAVE_API_TS
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_PREAD);
@@ -2706,6 +2945,7 @@ ssize_t fs_allocated_write(int fd, void *buf, size_t count) {
 #ifdef LDB_PRINT_CALL
   print_write(fd, buf, count);
 #endif
+  // a write to a local fd (lease) is traced as the pwrite to its base fd
   if (OpenLease::IsLocalFd(fd)) {
     int base_fd = OpenLease::FindBaseFd(fd);
     OpenLeaseMapEntry *entry = LeaseRef(base_fd);
@@ -2731,6 +2971,7 @@ ssize_t fs_allocated_write(int fd, void *buf, size_t count) {
     return rc;
   }
 
+  FSLIB_TRACE(FsTraceOp::WRITE, fd, -1, count, nullptr);
 #ifdef CFS_LIB_SAVE_API_TS
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_WRITE);
 #endif
@@ -2800,6 +3041,7 @@ static ssize_t fs_allocated_pwrite_internal(FsService *fsServ, int fd,
 }
 
 ssize_t fs_allocated_pwrite(int fd, void *buf, ssize_t count, off_t offset) {
+  FSLIB_TRACE(FsTraceOp::PWRITE, fd, offset, count, nullptr);
   int wid = -1;
 #ifdef CFS_LIB_SAVE_API_TS
   int tsIdx = tFsApiTs->addApiStart(FsApiType::FS_PWRITE);
@@ -3377,8 +3619,10 @@ ssize_t fs_uc_read(int fd, void *buf, size_t count) {
   return nread;
 }
 
-// static const uint64_t kUcOpByteMax =
-//     ((RING_DATA_ITEM_SIZE) / (CACHE_LINE_BYTE)) * (PAGE_CACHE_PAGE_SIZE);
+// one PageDescriptorMsg per page, plus one to mark the end
+static const uint64_t kUcOpByteMax =
+    ((RING_DATA_ITEM_SIZE) / sizeof(PageDescriptorMsg) - 1) *
+    (PAGE_CACHE_PAGE_SIZE);
 
 void updateRcTsForLease(rwOpCommon *op, FsLeaseCommon::rdtscmp_ts_t &ts,
                         ssize_t &rc) {
@@ -3417,8 +3661,7 @@ ssize_t fs_uc_pread_internal(FsService *fsServ, int fd, void *buf,
                              size_t orig_count, off_t orig_off,
                              size_t count_from_aligned, off_t offset_aligned,
                              FileHandle *fh, FsLeaseCommon::rdtscmp_ts_t &ts) {
-  // fprintf(stdout, "fs_uc_pread_internal\n");
-  // assert(count_from_aligned < kUcOpByteMax);
+  assert(count_from_aligned <= kUcOpByteMax);
   struct shmipc_msg msg;
   struct preadOpPacked *prop_p;
   struct preadOp prop;
@@ -3435,7 +3678,11 @@ ssize_t fs_uc_pread_internal(FsService *fsServ, int fd, void *buf,
 
   unpack_preadOp(prop_p, &prop);
   rc = prop.rwOp.ret;
-  if (rc > 0) {
+  if (rc > 0 && rc <= (orig_off - offset_aligned)) {
+    // orig_off is beyond the end of file
+    rc = 0;
+  } else if (rc > 0) {
+    rc = rc - (orig_off - offset_aligned);
     // record pages to cacheHelper
     void *curDataPtr = (void *)IDX_TO_DATA(fsServ->shmipc_mgr, ring_idx);
     PageDescriptorMsg *pdmsg =
@@ -3443,31 +3690,37 @@ ssize_t fs_uc_pread_internal(FsService *fsServ, int fd, void *buf,
     PageDescriptorMsg *curmsg;
     uint64_t off = orig_off, tot;
     uint32_t m;
+    size_t nbytes = std::min(orig_count, static_cast<size_t>(rc));
+    bool isStale = false;
     fh->lock_.lock();
     char *dstPtr = static_cast<char *>(buf);
     int pdmsgIdx = 0;
-    for (tot = 0; tot < orig_count;
-         tot += m, off += m, dstPtr += m, pdmsgIdx++) {
+    for (tot = 0; tot < nbytes; tot += m, off += m, dstPtr += m, pdmsgIdx++) {
       uint32_t pageIdx = off / (PAGE_CACHE_PAGE_SIZE);
       curmsg = pdmsg + pdmsgIdx;
-      m = std::min(orig_count - tot,
+      m = std::min(nbytes - tot,
                    (PAGE_CACHE_PAGE_SIZE)-off % (PAGE_CACHE_PAGE_SIZE));
       assert(checkPdMsgMAGIC(curmsg));
       assert(curmsg->pageIdxWithinIno == pageIdx);
-      // fprintf(stdout, "off:%lu curmsg->gPageIdx:%u\n", off,
-      // curmsg->gPageIdx);
       auto curpair =
           gLibSharedContext->pageCacheHelper.findStablePage(curmsg->gPageIdx);
       // copy the data to destination
       memcpy(dstPtr,
              static_cast<char *>(curpair.second) + off % (PAGE_CACHE_PAGE_SIZE),
              m);
+      // the page may be invalidated (e.g., by a write) since the server
+      // replied; then the copy cannot be trusted
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (readPdVersion(curpair.first) != curmsg->version) {
+        isStale = true;
+        break;
+      }
       // install the cache pages
       fh->cacheReader.installCachePage(pageIdx * (PAGE_CACHE_PAGE_SIZE),
-                                       curpair);
+                                       curpair, curmsg->version);
     }
     fh->lock_.unlock();
-    rc = rc - (orig_off - offset_aligned);
+    if (isStale) rc = -1;
   }
   // extract ts
   updateRcTsForLease(&prop.rwOp, ts, rc);
@@ -3478,6 +3731,11 @@ ssize_t fs_uc_pread_internal(FsService *fsServ, int fd, void *buf,
   return rc;
 }
 
+// Read through the shared client cache: pages already cached by this app are
+// copied directly from the shared memory without IPC as long as the lease on
+// the file is valid; otherwise the pages are fetched (and leased) from FSP.
+// If FSP cannot cache the pages (e.g., the tenant is out of its cache share)
+// or they are invalidated under us, it falls back to fs_pread().
 ssize_t fs_uc_pread(int fd, void *buf, size_t count, off_t offset) {
   struct FileHandle *fhPtr = nullptr;
   fromFdToFileHandle(fd, &fhPtr);
@@ -3492,6 +3750,8 @@ ssize_t fs_uc_pread(int fd, void *buf, size_t count, off_t offset) {
   size_t count_from_aligned_off = count;
   if (aligned_start_off < offset)
     count_from_aligned_off += (offset - aligned_start_off);
+  if (count_from_aligned_off > kUcOpByteMax)
+    return fs_pread(fd, buf, count, offset);
   fhPtr->lock_.lock_read();
   bool success = fhPtr->cacheReader.lookupRange(offset, count, buf);
   fhPtr->lock_.unlock();
@@ -3502,42 +3762,40 @@ ssize_t fs_uc_pread(int fd, void *buf, size_t count, off_t offset) {
   int wid = -1;
   if (success) {
     if (gLibSharedContext->leaseMng_.ifFileLeaseValid(fhPtr->id)) {
-      // fprintf(stdout, "cacheHit\n");
       return count;
-    } else {
-      // fprintf(stdout, "only need to renew\n");
-      // renew lease
-      FsLeaseCommon::rdtscmp_ts_t ts = 0;
-    UC_PREAD_RW_LEASERENEW_WID_UPDATE_RETRY:
-      auto service = getFsServiceForFD(fd, wid);
-      int lrnrt = fs_uc_pread_renewonly_internal(service, fd, ts);
-      if (handle_inode_in_transfer(lrnrt))
-        goto UC_PREAD_RW_LEASERENEW_WID_UPDATE_RETRY;
-      bool should_retry = checkUpdateFdWid(static_cast<int>(lrnrt), fd);
-      if (should_retry) goto UC_PREAD_RW_LEASERENEW_WID_UPDATE_RETRY;
-      if (lrnrt < 0) {
-        throw std::runtime_error("cannot renew lease");
-      } else {
-        gLibSharedContext->leaseMng_.updateFileTs(fhPtr->id, ts);
-        return count;
-      }
     }
-  } else {
-    // fprintf(stdout, "fetch data from server\n");
-    // fetch data from the server
+    // renew lease
     FsLeaseCommon::rdtscmp_ts_t ts = 0;
-  UC_PREAD_DATA_FETCH_RETRY:
+  UC_PREAD_RW_LEASERENEW_WID_UPDATE_RETRY:
     auto service = getFsServiceForFD(fd, wid);
-    retnr = fs_uc_pread_internal(service, fd, buf, count, offset,
-                                 count_from_aligned_off, aligned_start_off,
-                                 fhPtr, ts);
-    if (handle_inode_in_transfer(retnr)) goto UC_PREAD_DATA_FETCH_RETRY;
-    bool should_retry = checkUpdateFdWid(retnr, fd);
-    if (should_retry) goto UC_PREAD_DATA_FETCH_RETRY;
-    gLibSharedContext->leaseMng_.updateFileTs(fhPtr->id, ts);
-    return retnr;
+    int lrnrt = fs_uc_pread_renewonly_internal(service, fd, ts);
+    if (handle_inode_in_transfer(lrnrt))
+      goto UC_PREAD_RW_LEASERENEW_WID_UPDATE_RETRY;
+    bool should_retry = checkUpdateFdWid(static_cast<int>(lrnrt), fd);
+    if (should_retry) goto UC_PREAD_RW_LEASERENEW_WID_UPDATE_RETRY;
+    if (lrnrt >= 0) {
+      gLibSharedContext->leaseMng_.updateFileTs(fhPtr->id, ts);
+      return count;
+    }
+    // the file is being written; what we have cached cannot be trusted
+    fhPtr->lock_.lock();
+    fhPtr->cacheReader.clear();
+    fhPtr->lock_.unlock();
   }
-  return 0;
+
+  // fetch data from the server
+  FsLeaseCommon::rdtscmp_ts_t ts = 0;
+UC_PREAD_DATA_FETCH_RETRY:
+  auto service = getFsServiceForFD(fd, wid);
+  retnr = fs_uc_pread_internal(service, fd, buf, count, offset,
+                               count_from_aligned_off, aligned_start_off,
+                               fhPtr, ts);
+  if (handle_inode_in_transfer(retnr)) goto UC_PREAD_DATA_FETCH_RETRY;
+  bool should_retry = checkUpdateFdWid(retnr, fd);
+  if (should_retry) goto UC_PREAD_DATA_FETCH_RETRY;
+  if (retnr < 0) return fs_pread(fd, buf, count, offset);
+  gLibSharedContext->leaseMng_.updateFileTs(fhPtr->id, ts);
+  return retnr;
 }
 
 off_t fs_lseek_internal(FsService *fsServ, int fd, long int offset,
@@ -3661,7 +3919,16 @@ void fs_free_pad(void *ptr, int fsTid) {
 
 void fs_free_pad(void *ptr) { fs_free_pad(ptr, threadFsTid); }
 
-void fs_init_thread_local_mem() { check_app_thread_mem_buf_ready(); }
+void fs_init_thread_local_mem() {
+  check_app_thread_mem_buf_ready();
+  if (!tThreadRings) {
+    const char *env = getenv(CFS_LIB_THREAD_RING_ENV);
+    if (env == nullptr || strcmp(env, "0") != 0) {
+      tThreadRings = std::make_unique<FsLibThreadRings>();
+      tThreadRings->epoch = gThreadRingEpoch;
+    }
+  }
+}
 
 void *fs_malloc(size_t size) {
   int err;
@@ -4023,6 +4290,7 @@ int fs_allocated_pread_submit(struct async_ctx_rw *ctx, int fd, void *buf,
     LeaseUnref(entry);
     fd = base_fd;
   }
+  FSLIB_TRACE(FsTraceOp::PREAD, fd, offset, count, nullptr);
 
   // pack args into ctx in case we may need them for resubmission
   ctx->fd = fd;
@@ -4103,6 +4371,7 @@ int fs_allocated_pwrite_submit_internal(struct async_ctx_rw *ctx) {
 
 int fs_allocated_pwrite_submit(struct async_ctx_rw *ctx, int fd, void *buf,
                                size_t count, off_t offset) {
+  FSLIB_TRACE(FsTraceOp::PWRITE, fd, offset, count, nullptr);
   // pack args into ctx in case we may need them for resubmission
   ctx->fd = fd;
   ctx->buf = buf;
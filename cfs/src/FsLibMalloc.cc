@@ -8,6 +8,7 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include "FsHugePage.h"
 #include "stats/stats.h"
 #include "util.h"
 
@@ -765,6 +766,8 @@ struct MemBlockMeta *FsLibMemMng::findDataPtrMeta(void *ptr, int &sizeIdx,
 void *shmOpenInit(int &fd, std::string &shmNameStr, uint64_t sizeBytes,
                   int &err) {
   err = 0;
+  void *hugePtr = fs_hugepage::mapShm(shmNameStr, sizeBytes, /*create*/ true);
+  if (hugePtr != nullptr) return hugePtr;
   auto shmName = shmNameStr.c_str();
   int shmFd = shm_open(shmName, O_CREAT | O_EXCL | O_RDWR, 0666);
   if (shmFd < 0) {
@@ -799,6 +802,7 @@ void *shmOpenInit(int &fd, std::string &shmNameStr, uint64_t sizeBytes,
     err = 1;
     return nullptr;
   }
+  fs_hugepage::adviseThp(shmPtr, sizeBytes);
 
   return shmPtr;
 }
@@ -810,6 +814,9 @@ void *shmOpenAttach(int &fd, std::string &shmNameStr, uint64_t sizeBytes,
   fprintf(stdout, "shmOpenAttach->shm_open + mmap(), sizeBytes:%lu\n",
           sizeBytes);
 #endif
+  // the app created it on hugetlbfs if it could; the file is removed here
+  void *hugePtr = fs_hugepage::mapShm(shmNameStr, sizeBytes, /*create*/ false);
+  if (hugePtr != nullptr) return hugePtr;
   auto shmName = shmNameStr.c_str();
   int shmFd = shm_open(shmName, O_RDWR, 0666);
   if (shmFd < 0) {
@@ -827,6 +834,7 @@ void *shmOpenAttach(int &fd, std::string &shmNameStr, uint64_t sizeBytes,
   }
 
   if (err) exit(1);
+  fs_hugepage::adviseThp(shmPtr, sizeBytes);
 
   return shmPtr;
 }
@@ -837,6 +845,7 @@ int releaseShm(void *ptr, uint64_t sizeBytes) {
 #ifdef FS_LIB_MALLOC_DEBUG
   fprintf(stdout, "releaseShm->munmap sizeBytes:%lu\n", sizeBytes);
 #endif
+  if (fs_hugepage::unmap(ptr)) return 0;
   int rt = munmap(ptr, sizeBytes);
   if (rt == -1) {
     fprintf(stderr, "shm munmap() failed errstr: %s\n", strerror(errno));
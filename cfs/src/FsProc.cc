@@ -13,9 +13,11 @@
 #include "FsProc_FsImpl.h"
 #include "FsProc_LoadMng.h"
 #include "FsProc_Messenger.h"
+#include "FsProc_Numa.h"
 #include "FsProc_PageCache.h"
 #include "FsProc_UnixSock.h"
 #include "FsProc_util.h"
+#include "Metrics.h"
 #include "Param.h"
 #include "param.h"
 #include "perfutil/Cycles.h"
@@ -46,11 +48,16 @@ FsProc::FsProc(int tNum, int appNum, const char *readyFname,
       numThreads(tNum),
       numAppProc(appNum),
       workerRunning(new std::atomic_bool[tNum]),
-      workerActive(new std::atomic_bool[tNum]) {
+      workerActive(new std::atomic_bool[tNum]),
+      workerParkRequested(new std::atomic_bool[tNum]),
+      workerNumaNodes(tNum, -1),
+      appNumaNodes(new std::atomic_int[appNum]) {
   for (int i = 0; i < tNum; i++) {
     workerRunning[i].store(false);
     workerActive[i].store(false);
+    workerParkRequested[i].store(false);
   }
+  for (int i = 0; i < appNum; i++) appNumaNodes[i].store(-1);
   pageCacheMng = new PageCacheManager();
 //  loadMng = new worker_stats::LoadMngType(tNum);
 #ifdef UFS_SOCK_LISTEN
@@ -64,7 +71,12 @@ FsProc::FsProc(bool doInline)
       numThreads(1),
       numAppProc(1),
       workerRunning(new std::atomic_bool[1]),
-      workerActive(new std::atomic_bool[1]) {
+      workerActive(new std::atomic_bool[1]),
+      workerParkRequested(new std::atomic_bool[1]),
+      workerNumaNodes(1, -1),
+      appNumaNodes(new std::atomic_int[1]) {
+  workerParkRequested[0].store(false);
+  appNumaNodes[0].store(-1);
 //  loadMng = new worker_stats::LoadMngType(1);
 #ifdef UFS_SOCK_LISTEN
   sock_listener_ = new fsp_sock::UnixSocketListener(1);
@@ -118,11 +130,35 @@ void FsProc::cleanup() {
   if (loadMng != nullptr) loadMng->shutDown();
 #ifdef UFS_SOCK_LISTEN
   if (sock_listener_ != nullptr) sock_listener_->ShutDown();
+#endif
+#ifdef DO_SCHED
+  // every worker has recorded its tenants when it left the run loop
+  if (exitSnapshot != nullptr) {
+#if CFS_JOURNAL(ON)
+    // a servant that never ran has no journal manager: then the snapshot
+    // does not match the journals on the next start
+    for (int wid = 0; wid < numJournals(); ++wid) {
+      auto jmgr = workerList[wid]->jmgr;
+      exitSnapshot->journal_chkpts.push_back(
+          jmgr != nullptr ? jmgr->GetLastCheckpoint() : 0);
+    }
+#endif
+    auto err = exitSnapshot->save_file(snapshotFname);
+    if (err.empty())
+      SPDLOG_INFO("Warm-restart snapshot saved to {}", snapshotFname);
+    else
+      SPDLOG_WARN("Fail to save warm-restart snapshot: {}", err);
+  }
 #endif
   for (auto wk : workerMap) {
     delete wk.second;
   }
+#ifdef DO_SCHED
+  sched::metrics::destroy_page();
+#endif
   delete[] workerRunning;
+  delete[] workerParkRequested;
+  delete[] appNumaNodes;
   fprintf(stdout, "delete pageCacheMng:%p\n", pageCacheMng);
   if (pageCacheMng != nullptr) delete pageCacheMng;
   fprintf(stdout, "delete loadMng:%p\n", loadMng);
@@ -143,9 +179,21 @@ void FsProc::cleanup() {
   SPDLOG_INFO("Bye :)");
 }
 
+int FsProc::getNumDevs() { return workerList[0]->getDev()->getNumDevs(); }
+
+int64_t FsProc::getDevCapacityEstimate(int dev) {
+  std::unordered_set<CurBlkDev *> devs;
+  uint64_t capacity = 0;
+  for (auto worker : workerList)
+    if (devs.insert(worker->getDev()).second)
+      capacity += worker->getDev()->getDevCapacityEstimate(dev);
+  return capacity / BSIZE;
+}
+
 #ifdef DO_SCHED
 void FsProc::startAllocator() {
-  allocator = new sched::Allocator(this);
+  allocator =
+      new sched::Allocator(std::make_unique<sched::FsAllocEnv>(this));
   for (int aid = 0; aid < numAppProc; ++aid) {
     auto &v = allocator->append_view(aid);
     for (int wid = 0; wid < numThreads; ++wid) {
@@ -154,8 +202,85 @@ void FsProc::startAllocator() {
       allocator->add_total_resrc(t.get_resrc());
     }
   }
+  if (warmSnapshot != nullptr) allocator->set_warm_started();
+  // workers start publishing once the page is visible
+  static_assert(CurBlkDev::kMaxDevs <= sched::metrics::max_devs);
+  sched::metrics::create_page(numThreads, numAppProc, getNumDevs());
   allocator_thread = new std::thread(sched::Allocator::run, allocator);
 }
+
+void FsProc::initSnapshot(
+    const char *fname,
+    const std::vector<std::vector<std::tuple<int, int, double, double>>>
+        &workerAppConfigs) {
+  if (fname == nullptr) return;
+  snapshotFname = fname;
+  exitSnapshot =
+      std::make_unique<sched::snapshot::Snapshot>(numThreads, numAppProc);
+  if (!checkFileExistance(fname)) {
+    SPDLOG_INFO("No warm-restart snapshot {}; start cold", fname);
+    return;
+  }
+
+  auto snapshot = std::make_unique<sched::snapshot::Snapshot>();
+  // the file system changes from now on, so a crash must not leave the
+  // snapshot to the next start
+  auto err = snapshot->take_file(snapshotFname);
+  if (!err.empty()) {
+    SPDLOG_WARN("Fail to load warm-restart snapshot: {}; start cold", err);
+    return;
+  }
+  // the initial allocations as FsProcWorker::InitApps would make
+  std::vector<std::vector<sched::ResrcAlloc>> init(
+      numThreads, std::vector<sched::ResrcAlloc>(numAppProc));
+  for (int wid = 0; wid < numThreads && wid < int(workerAppConfigs.size());
+       ++wid) {
+    for (auto [aid, cache_mb, bw_mb, cpu_ratio] : workerAppConfigs[wid]) {
+      init[wid][aid] = {
+          .cache_size = uint32_t(sched::params::mb_to_blocks(cache_mb)),
+          .bandwidth = int64_t(sched::params::mb_to_blocks(bw_mb)),
+          .cpu_cycles = int64_t(
+              sched::params::worker_avail_cycles_per_second * cpu_ratio),
+      };
+    }
+  }
+  if (!snapshot->match(init)) {
+    SPDLOG_WARN(
+        "Warm-restart snapshot {} does not match the config; start cold",
+        fname);
+    return;
+  }
+  warmSnapshot = std::move(snapshot);
+  SPDLOG_INFO("Restore from warm-restart snapshot {}", fname);
+}
+
+int FsProc::numJournals() const {
+#if CFS_JOURNAL(LOCAL_JOURNAL)
+  return numThreads;
+#elif CFS_JOURNAL(GLOBAL_JOURNAL)
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+void FsProc::checkWarmSnapshotJournals(CurBlkDev *dev) {
+  if (warmSnapshot == nullptr) return;
+  std::vector<uint64_t> chkpts;
+#if CFS_JOURNAL(ON)
+  for (int wid = 0; wid < numJournals(); ++wid) {
+    chkpts.push_back(JournalManager::BlockingReadLastCheckpoint(
+        dev, get_worker_journal_sb(wid)));
+  }
+#endif
+  if (chkpts == warmSnapshot->journal_chkpts) return;
+  SPDLOG_WARN(
+      "File system checkpointed since the warm-restart snapshot {}; start "
+      "cold",
+      snapshotFname);
+  warmSnapshot.reset();
+}
+
 #endif
 
 int AppProc::GetDstWid(int tau_id, cfs_ino_t ino) {
@@ -187,6 +312,7 @@ void FsProc::startWorkers(
   }
 
   messenger = new FsProcMessenger(numThreads, DEFAULT_MESSENGER_BUFSIZE);
+  messenger->set_wakeup([this](int) { notifyWorkerActive(); });
 //  loadMng->setMessenger(messenger);
 #if defined SCALE_USE_BUCKETED_DATA
   auto masterWorker = new FsProcWorkerMaster(
@@ -226,6 +352,7 @@ void FsProc::startWorkers(
 
     assert(!workerCoresVec.empty());
     curWorker->setPinnedCPUCore(workerCoresVec[i]);
+    workerNumaNodes[i] = curWorker->getNumaNode();
 
     curWorker->messenger = messenger;
     recorders_[curWorker->getWid()] = &(curWorker->stats_recorder_);
@@ -328,9 +455,57 @@ void FsProc::stop() {
     while (!workerRunning[i].compare_exchange_weak(expect, false) && expect)
       ;
   }
+  notifyWorkerActive();  // for the ones in waitWorkerActive()
   SPDLOG_INFO("Signal sent to each workers");
 }
 
+bool FsProc::waitWorkerActive(int wid, std::chrono::microseconds timeout) {
+  messenger->set_sleeping(wid, true);
+  {
+    std::unique_lock<std::mutex> lock(workerActiveMtx);
+    workerActiveCv.wait_for(lock, timeout, [&] {
+      return workerActive[wid] || !workerRunning[wid] ||
+             messenger->has_pending(wid);
+    });
+  }
+  messenger->set_sleeping(wid, false);
+  return workerActive[wid];
+}
+
+void FsProc::notifyWorkerActive() {
+  // a waiter checks its condition under the lock, so it cannot miss this
+  { std::lock_guard<std::mutex> lock(workerActiveMtx); }
+  workerActiveCv.notify_all();
+}
+
+void FsProc::requestWorkerPark(int wid, bool park) {
+  assert(wid != FsProcWorker::kMasterWidConst && wid < numThreads);
+  workerParkRequested[wid] = park;
+  if (park) return;
+  // it may have parked already; if it is still about to, parkWorker() sees the
+  // request withdrawn
+  bool expect = false;
+  if (workerActive[wid].compare_exchange_strong(expect, true))
+    notifyWorkerActive();
+}
+
+bool FsProc::parkWorker(int wid) {
+  workerActive[wid] = false;
+  if (workerParkRequested[wid]) return true;
+  // withdrawn after the worker decided to park; requestWorkerPark() may have
+  // reactivated it already
+  bool expect = false;
+  workerActive[wid].compare_exchange_strong(expect, true);
+  return false;
+}
+
+void FsProc::noteAppNumaNode(int aid, int node) {
+  if (node < 0 || aid < 0 || aid >= numAppProc) return;
+  int expect = -1;
+  if (appNumaNodes[aid].compare_exchange_strong(expect, node))
+    SPDLOG_INFO("App aid={} is on NUMA node {}", aid, node);
+}
+
 int FsProc::submitDevAsyncReadReqCompletion(struct BdevIoContext *ctx) {
   SPDLOG_DEBUG("submitDevAsyncReadReqCompletion blockNo:{}", ctx->blockNo);
   auto curWorkerIt = workerMap.find(cfsGetTid());
@@ -418,7 +593,8 @@ AppProc::AppProc(FsProcWorker *worker, int aid, int shmBaseOffset,
       fdIncr(worker->getWid() * 10000000 + kFdBase)
 #ifdef DO_SCHED
       ,
-      tenant(worker->getWid(), aid, this, cache_size, bandwidth, cpu_cycles)
+      tenant(worker->getWid(), aid, this, cache_size, bandwidth, cpu_cycles,
+             worker->getDev()->getNumDevs())
 #endif
 {
   initShm(aid, shmBaseOffset);
@@ -432,7 +608,7 @@ AppProc::AppProc(FsProcWorker *worker, int aid, int shmBaseOffset,
 }
 
 void AppProc::initShm(int aid, int shmBaseOffset) {
-  int shmKey = FS_SHM_KEY_BASE + shmBaseOffset + aid;
+  shmKey = FS_SHM_KEY_BASE + shmBaseOffset + aid;
   char shmfile[128];
   // TODO have a constant for this format?
   snprintf(shmfile, 128, "/shmipc_mgr_%08d", shmKey);
@@ -445,9 +621,82 @@ void AppProc::initShm(int aid, int shmBaseOffset) {
         aid, shmKey);
     throw std::runtime_error("failed to initialize shared memory for appProc");
   }
+  // the rings of every worker are created by the master thread; the worker
+  // polls its ring all the time, so move it to the worker's node
+  fsp_numa::bindToNode(shmipc_mgr->qp->ptr, shmipc_mgr->qp->size,
+                       worker->getNumaNode());
+}
+
+AppProc::~AppProc() {
+  clearThreadRings();
+  shmipc_mgr_destroy(shmipc_mgr);
+}
+
+int AppProc::addThreadRing(int clientRingId) {
+  char shmfile[128];
+  snprintf(shmfile, 128, THREAD_RING_SHM_NAME_FMT, shmKey, clientRingId);
+  // created by the client thread, hence 0
+  auto ring = shmipc_mgr_init(shmfile, THREAD_RING_SIZE, 0);
+  if (ring == NULL) {
+    SPDLOG_WARN("Worker-{}: cannot attach thread ring {} of app aid={}",
+                worker->getWid(), shmfile, aid);
+    return -1;
+  }
+  // zeroed by the client thread that created it, so it is on the app's node
+  gFsProcPtr->noteAppNumaNode(aid, fsp_numa::nodeOfAddr(ring->qp->ptr));
+  numThreadRings++;
+  for (size_t i = 0; i < threadRings.size(); i++) {
+    if (threadRings[i].second == nullptr) {
+      threadRings[i] = {clientRingId, ring};
+      return i + 1;
+    }
+  }
+  threadRings.emplace_back(clientRingId, ring);
+  return threadRings.size();
 }
 
-AppProc::~AppProc() { shmipc_mgr_destroy(shmipc_mgr); }
+int AppProc::removeThreadRing(int clientRingId) {
+  for (auto &[id, ring] : threadRings) {
+    if (ring != nullptr && id == clientRingId) {
+      shmipc_mgr_destroy(ring);
+      id = -1;
+      ring = nullptr;
+      numThreadRings--;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+void AppProc::clearThreadRings() {
+  for (auto &[id, ring] : threadRings) shmipc_mgr_destroy(ring);
+  threadRings.clear();
+  numThreadRings = 0;
+  pollCursor = 0;
+}
+
+struct shmipc_msg *AppProc::pollMsg(off_t &slotId) {
+  off_t idx;
+  struct shmipc_msg *msg;
+  if (numThreadRings == 0) {
+    msg = shmipc_mgr_get_msg_nowait(shmipc_mgr, &idx);
+    slotId = idx;
+    return msg;
+  }
+  size_t numRings = threadRings.size() + 1;
+  for (size_t i = 0; i < numRings; i++) {
+    size_t ringNo = pollCursor;
+    pollCursor = (pollCursor + 1) % numRings;
+    auto ring = ringNo == 0 ? shmipc_mgr : threadRings[ringNo - 1].second;
+    if (ring == nullptr) continue;
+    msg = shmipc_mgr_get_msg_nowait(ring, &idx);
+    if (msg != nullptr) {
+      slotId = (off_t(ringNo) << kSlotRingShift) | idx;
+      return msg;
+    }
+  }
+  return nullptr;
+}
 
 FileObj *AppProc::allocateFd(InMemInode *inodePtr, int openFlags,
                              mode_t openMode) {
@@ -819,6 +1068,19 @@ void FsReq::initReqFromCop(AppProc *curApp, off_t curSlotId,
       pathTokens = absl::StrSplit(standardFullPath, "/");
       break;
     }
+    case CFS_OP_READDIR: {
+      setType(FsReqType::READDIR);
+      reqState = FsReqState::OPENDIR_GET_CACHED_INODE;
+      alopPtr = &cop->op.readdir.alOp;
+      dataPtrId = cop->op.readdir.alOp.dataPtrId;
+      shmId = alopPtr->shmid;
+      tid = cop->op.readdir.tid;
+      standardFullPath = filepath2TokensStandardized(copPtr->op.readdir.name,
+                                                     standardFullPathDelimIdx,
+                                                     standardFullPathDepth);
+      pathTokens = absl::StrSplit(standardFullPath, "/");
+      break;
+    }
     case CFS_OP_RMDIR: {
       setType(FsReqType::RMDIR);
       reqState = FsReqState::RMDIR_START_FAKE;
@@ -873,6 +1135,10 @@ void FsReq::initReqFromCop(AppProc *curApp, off_t curSlotId,
       setType(FsReqType::THREAD_REASSIGN);
       break;
     }
+    case CFS_OP_THREAD_RING: {
+      setType(FsReqType::THREAD_RING);
+      break;
+    }
 #ifdef _CFS_TEST_
     case CFS_OP_TEST: {
       standardFullPath = filepath2TokensStandardized(copPtr->op.test.path,
@@ -969,7 +1235,7 @@ void FsReq::markComplete() {
   // TODO change the member variable type
   off_t ring_idx = (off_t)appRingSlotId;
   struct shmipc_msg *msg = NULL;
-  msg = IDX_TO_MSG(app->shmipc_mgr, ring_idx);
+  msg = app->slotToMsg(ring_idx);
   SHMIPC_SET_MSG_STATUS(msg, shmipc_STATUS_READY_FOR_CLIENT);
 }
 
@@ -1314,6 +1580,16 @@ BlockReqPool::BlockReqPool()
 
 BlockReqPool::~BlockReqPool() { delete[] pool_; }
 
+void BlockReqPool::relocate() {
+  assert(allFree());
+  delete[] pool_;
+  std::vector<BlockReq *>().swap(block_req_queue_);
+  pool_ = new BlockReq[kPerWorkerBlockReqPoolCapacity]();
+  block_req_queue_.reserve(kPerWorkerBlockReqPoolCapacity);
+  for (int i = 0; i < kPerWorkerBlockReqPoolCapacity; ++i)
+    block_req_queue_.emplace_back(&pool_[i]);
+}
+
 // caller must call init()!
 BlockReq *BlockReqPool::alloc() {
   if (block_req_queue_.empty())
@@ -1400,6 +1676,19 @@ int BufferFlushReq::initFlushReqs(int index) {
     srcBuf->flusher.doFlush(canFlush, toSubmitFlushBlocks);
   }
   assert(canFlush);
+  return initBlockReqs();
+}
+
+#ifdef DO_SCHED
+int BufferFlushReq::initWriteBackReqs(sched::Tenant *t, uint32_t maxNum) {
+  wbTenant = t;
+  srcBuf->flusher.doWriteBack(sched::Tag{.tenant = t}, maxNum,
+                              toSubmitFlushBlocks);
+  return initBlockReqs();
+}
+#endif
+
+int BufferFlushReq::initBlockReqs() {
   for (auto handle : toSubmitFlushBlocks) {
     block_no_t bno = handle.get_key();
     SPDLOG_DEBUG("initFlushReqs bno:{} idx:{}", bno, handle->getIndex());
@@ -1420,6 +1709,17 @@ int BufferFlushReq::initFlushReqs(int index) {
   return toSubmitFlushBlocks.size();
 }
 
+#ifdef DO_SCHED
+void BufferFlushReq::addToTenantQueue(BlockReq *block_req) {
+  block_req->set_buf_flush_req(this);
+  if (wbTenant != nullptr) {
+    wbTenant->add_wb_queue(block_req);
+  } else {
+    fsReq->get_tenant()->add_blk_queue(block_req, fsReq);
+  }
+}
+#endif
+
 int BufferFlushReq::submitFlushReqs() {
   int rc;
   if (enableTrace_) {
@@ -1445,8 +1745,7 @@ int BufferFlushReq::submitFlushReqs() {
     }
 #else
     // add to the tenant's block request queue
-    block_req->set_buf_flush_req(this);
-    fsReq->get_tenant()->add_blk_queue(block_req, fsReq);
+    addToTenantQueue(block_req);
     numSubmit++;
     toSubmitFlushBlocks.pop_front();
     submittedFlushBlocks.insert(bno);
@@ -1477,8 +1776,7 @@ void BufferFlushReq::blockReqFinished(block_no_t blockNo) {
     assert(rc >= 0);
 #else
     // add to the tenant's block request queue
-    block_req->set_buf_flush_req(this);
-    fsReq->get_tenant()->add_blk_queue(block_req, fsReq);
+    addToTenantQueue(block_req);
 #endif
     toSubmitFlushBlocks.pop_front();
     submittedFlushBlocks.insert(bno);
@@ -1495,7 +1793,13 @@ void BufferFlushReq::flushDonePropagate() {
     delete req;
   }
   flushBlockReqMap.clear();
+#ifdef DO_SCHED
+  int rc = wbTenant != nullptr
+               ? srcBuf->flusher.doWriteBackDone(sched::Tag{.tenant = wbTenant})
+               : srcBuf->flusher.doFlushDone();
+#else
   int rc = srcBuf->flusher.doFlushDone();
+#endif
   if (rc < 0) {
     if (fsReq != nullptr) {
       SPDLOG_ERROR("flushDonePropagate reqType:{} ino:{}",
@@ -1504,7 +1808,7 @@ void BufferFlushReq::flushDonePropagate() {
     } else {
       SPDLOG_ERROR("flushDonePropagate no req");
     }
-    if (fsReq->getType() != FsReqType::SYNCALL) {
+    if (fsReq == nullptr || fsReq->getType() != FsReqType::SYNCALL) {
       throw std::runtime_error("doFlushDone is wrong");
     }
   }
@@ -1814,6 +2118,8 @@ std::pair<uint8_t, void *> AppProc::initNewAllocatedShm(
   if (addr != nullptr) {
     memArrPtr = new SingleSizeMemBlockArr(shmBlockSize, shmNumBlocks,
                                           totalBytes, addr, shmName, true);
+    // only known if the client has touched it already
+    gFsProcPtr->noteAppNumaNode(aid, fsp_numa::nodeOfAddr(addr));
     shmIdArrMap.emplace(curShmId, memArrPtr);
     shmNameMemArrMap.emplace(shmName, memArrPtr);
     arr_ptr = memArrPtr;
@@ -1823,14 +2129,41 @@ std::pair<uint8_t, void *> AppProc::initNewAllocatedShm(
   return {curShmId, static_cast<void *>(arr_ptr)};
 }
 
+bool AppProc::isShmDmaCapable(uint8_t shmId, char *addr, size_t len) {
+  auto it = shmDmaRangeMap.find(shmId);
+  if (it == shmDmaRangeMap.end()) {
+    char *start = nullptr, *end = nullptr;
+    auto arrIt = shmIdArrMap.find(shmId);
+    if (arrIt == shmIdArrMap.end()) return false;
+    SingleSizeMemBlockArr *arr = arrIt->second;
+    if (!worker->getDev()->registerDmaMem(
+            static_cast<char *>(arr->getMemAddr()), arr->getTotalBytes(),
+            start, end)) {
+      SPDLOG_INFO("shmId:{} of app {} cannot be read into directly", shmId,
+                  aid);
+      start = end = nullptr;
+    }
+    it = shmDmaRangeMap.emplace(shmId, std::make_pair(start, end)).first;
+  }
+  auto [start, end] = it->second;
+  // NVMe needs the buffer to be dword-aligned
+  return addr >= start && addr + len <= end &&
+         reinterpret_cast<uintptr_t>(addr) % 4 == 0;
+}
+
 int AppProc::invalidateAppShm() {
   std::string shmNames;
   for (auto ele : shmNameMemArrMap) {
     shmNames += ele.first + " ";
   }
   SPDLOG_INFO("invalidateAppShm: {}", shmNames);
+  for (auto [shmId, range] : shmDmaRangeMap) {
+    if (range.first != nullptr) worker->getDev()->unregisterDmaMem(range.first);
+  }
+  shmDmaRangeMap.clear();
   shmNameMemArrMap.clear();
   shmIdArrMap.clear();
+  clearThreadRings();
   shmipc_mgr_server_reset(shmipc_mgr);
   return 0;
 }
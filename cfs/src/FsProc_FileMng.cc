@@ -1,3 +1,4 @@
+#include <dirent.h>
 #include <stdio.h>
 
 #include <algorithm>
@@ -9,6 +10,7 @@
 #include "FsProc_Fs.h"
 #include "FsProc_Journal.h"
 #include "FsProc_Messenger.h"
+#include "FsProc_Readdir.h"
 #include "perfutil/Cycles.h"
 #include "spdlog/fmt/bundled/ranges.h"
 #include "spdlog/fmt/ostr.h"
@@ -175,6 +177,7 @@ int FileMng::processReq(FsReq *req) {
       processMkdir(req);
       break;
     case FsReqType::OPENDIR:
+    case FsReqType::READDIR:
       processOpendir(req);
       break;
     case FsReqType::NEW_SHM_ALLOCATED:
@@ -428,6 +431,8 @@ bool FileMng::exportInode(cfs_ino_t inum, ExportedInode &exp) {
 #endif
 
   delExportedInodeFdMappings(exp.inode);
+  // pages and leases are managed by the owner worker
+  invalidateClientCache(exp.inode);
 
   // Exporting block buffers
   splitInodeDataBlockBufferSlot(exp.inode, exp.block_buffers);
@@ -756,6 +761,7 @@ void FileMng::processWrite(FsReq *req) {
         // spin
       }
       fsWorker_->onTargetInodeFiguredOut(req, fileInode);
+      invalidateClientCache(fileInode);
       uint64_t fobjStartOff = fileObj->off;
       char *src = req->getChannelDataPtr();
       int64_t nWrite =
@@ -827,6 +833,7 @@ void FileMng::processPwrite(FsReq *req) {
         // spin
       }
       fsWorker_->onTargetInodeFiguredOut(req, fileInode);
+      invalidateClientCache(fileInode);
       char *src = req->getChannelDataPtr();
       int64_t nWrite =
           fsImpl_->writeInode(req, fileInode, src, fobjStartOff, reqCount);
@@ -1045,6 +1052,7 @@ void FileMng::processPreadUC(FsReq *req) {
               curmsg->gPageIdx = curPd->gPageIdx;
               curmsg->MAGIC = PAGE_DESCRIPTOR_MSG_MAGIC;
               curmsg->pageIdxWithinIno = blockIdx;
+              curmsg->version = readPdVersion(curPd);
               assert(curPd->pageIdxWithinIno == blockIdx);
             } else {
               blockReqs.push_back({blockIdx, curCount});
@@ -1063,13 +1071,26 @@ void FileMng::processPreadUC(FsReq *req) {
           std::vector<std::pair<PageDescriptor *, void *>> cachePages;
           std::vector<void *> addrs;
           addrs.reserve(numPageToFetch);
+          sched::Tenant *owner = nullptr;
+#ifdef DO_SCHED
+          owner = req->get_tenant();
+#endif
           int na = gFsProcPtr->pageCacheMng->allocPageToIno(
-              numPageToFetch, cachePages, fileInode->i_no);
-          assert(na == 0);
-          assert(cachePages.size() == numPageToFetch);
-          req->ucReqDstVec = std::move(cachePages);
-          req->ucReqPagesToRead = std::move(blockReqs);
-          req->setState(FsReqState::UCPREAD_FETCH_DATA);
+              numPageToFetch, cachePages, fileInode->i_no, owner);
+          if (na != 0) {
+            // out of cache (share); the client falls back to a normal read
+            req->setState(FsReqState::UCPREAD_RET_ERR);
+          } else {
+            assert(cachePages.size() == numPageToFetch);
+#ifdef DO_SCHED
+            // the client cache grows, so the tenant's server buffer shrinks
+            if (owner != nullptr && sched::params::policy::cache_partition)
+              fsImpl_->adjustCacheSize(sched::Tag{.tenant = owner});
+#endif
+            req->ucReqDstVec = std::move(cachePages);
+            req->ucReqPagesToRead = std::move(blockReqs);
+            req->setState(FsReqState::UCPREAD_FETCH_DATA);
+          }
         } else {
           req->setState(FsReqState::UCPREAD_RENEW_LEASE);
         }
@@ -1089,6 +1110,10 @@ void FileMng::processPreadUC(FsReq *req) {
     int nread = fsImpl_->readInodeToUCache(
         req, fileInode, req->ucReqPagesToRead, req->ucReqDstVec);
     if (nread < 0) {
+      std::vector<page_idx_t> pages;
+      for (auto &[pd, _] : req->ucReqDstVec) pages.push_back(pd->gPageIdx);
+      gFsProcPtr->pageCacheMng->freePage(pages);
+      req->ucReqDstVec.clear();
       req->setState(FsReqState::UCPREAD_RET_ERR);
     } else {
       if (req->numTotalPendingIoReq() == 0) {
@@ -1111,6 +1136,7 @@ void FileMng::processPreadUC(FsReq *req) {
             curmsg->MAGIC = PAGE_DESCRIPTOR_MSG_MAGIC;
             curmsg->pageIdxWithinIno = curBlockIdx;
             curmsg->gPageIdx = curpd->gPageIdx;
+            curmsg->version = readPdVersion(curpd);
 
             curpd->pageIdxWithinIno = curBlockIdx;
             curpd->validSize = req->ucReqPagesToRead[i].second;
@@ -1137,7 +1163,7 @@ void FileMng::processPreadUC(FsReq *req) {
       SPDLOG_DEBUG("ret set to:{}", req->getClientOp()->op.pread.rwOp.ret);
       fsWorker_->submitFsReqCompletion(req);
     } else {
-      req->setState(FsReqState::ALLOCPREAD_RET_ERR);
+      req->setState(FsReqState::UCPREAD_RET_ERR);
     }
   }
 
@@ -1157,6 +1183,7 @@ void FileMng::processAllocWrite(FsReq *req) {
     if (fileObj != nullptr) {
       InMemInode *fileInode = fileObj->ip;
       fsWorker_->onTargetInodeFiguredOut(req, fileInode);
+      invalidateClientCache(fileInode);
       // first check if this inode is already in some other app
       if (fsWorker_->checkInodeInOtherApp(fileInode->inodeData->i_no,
                                           req->getPid())) {
@@ -1203,6 +1230,7 @@ void FileMng::processAllocWrite(FsReq *req) {
     if (fileObj != nullptr) {
       InMemInode *fileInode = fileObj->ip;
       fsWorker_->onTargetInodeFiguredOut(req, fileInode);
+      invalidateClientCache(fileInode);
       uint64_t fobjStartOff = fileObj->off;
       if (fileObj->flags & O_APPEND) {
         auto cur_append_off =
@@ -1291,6 +1319,7 @@ void FileMng::processAllocPwrite(FsReq *req) {
     if (fileObj != nullptr) {
       InMemInode *fileInode = fileObj->ip;
       fsWorker_->onTargetInodeFiguredOut(req, fileInode);
+      invalidateClientCache(fileInode);
       uint64_t fobjStartOff = req->getClientOp()->op.allocpwrite.offset;
       assert(req->isAppBufferAvailable());
       char *src = req->getMallocedDataPtr();
@@ -1343,6 +1372,16 @@ void FileMng::processAllocPwrite(FsReq *req) {
   }
 }
 
+// whether the read of an allocated (shm) buffer may skip the block buffer
+inline static bool isDirectRead(FsReq *req, FileObj *fileObj) {
+  if (fileObj->flags & O_DIRECT) return true;
+#ifdef DO_SCHED
+  return req->get_tenant()->is_cache_bypass();
+#else
+  return false;
+#endif
+}
+
 void FileMng::processAllocRead(FsReq *req) {
   if (req->getState() == FsReqState::ALLOCREAD_FETCH_DATA) {
     FileObj *fileObj = req->getFileObj();
@@ -1353,7 +1392,8 @@ void FileMng::processAllocRead(FsReq *req) {
       uint64_t fobjStartOff = fileObj->off;
       char *dst = req->getMallocedDataPtr();
       int64_t nRead =
-          fsImpl_->readInode(req, fileInode, dst, fobjStartOff, reqCount);
+          fsImpl_->readInode(req, fileInode, dst, fobjStartOff, reqCount,
+                             /*nocpy*/ false, isDirectRead(req, fileObj));
       if (nRead < 0) {
         req->setState(FsReqState::ALLOCREAD_RET_ERR);
       } else {
@@ -1463,7 +1503,8 @@ void FileMng::processAllocPread(FsReq *req) {
         SPDLOG_DEBUG("mem_start_offset:{} startOff:{} reqcount:{}",
                      req->getMemOffset(), fobjStartOff, reqCount);
         nRead = fsImpl_->readInode(req, fileInode, dst + req->getMemOffset(),
-                                   fobjStartOff, reqCount);
+                                   fobjStartOff, reqCount, /*nocpy*/ false,
+                                   isDirectRead(req, fileObj));
         if (nRead < 0) {
           req->setState(FsReqState::ALLOCPREAD_RET_ERR);
         } else {
@@ -1574,6 +1615,42 @@ void FileMng::processCacheLeaseRenew(FsReq *req) {
   fsWorker_->submitFsReqCompletion(req);
 }
 
+// Invalidate the shared client cache of the inode: drop its cached pages and
+// the READ leases on it. Called before the inode's data changes or the inode
+// leaves this worker; clients see the pages' version bump right away, so they
+// stop serving the old data from their cache even if their lease is still
+// valid.
+void FileMng::invalidateClientCache(InMemInode *inode) {
+#ifdef USE_UC_PAGE_CACHE
+  if (!inode->inodePageCache.empty()) {
+    std::vector<page_idx_t> pages;
+    inode->inodePageCache.drain(pages);
+    // NOTE: the server buffer takes back the freed share on the next
+    // adjustCacheSize(), i.e., the next allocation decision
+    gFsProcPtr->pageCacheMng->freePage(pages);
+  }
+  leaseMng_.revokeReadLeases(inode->i_no);
+#endif
+}
+
+#ifdef DO_SCHED
+void FileMng::reclaimClientCache(sched::Tenant &tenant) {
+#ifdef USE_UC_PAGE_CACHE
+  if (tenant.get_client_cache_excess() == 0) return;
+  std::vector<cfs_ino_t> inos;
+  gFsProcPtr->pageCacheMng->getInodesChargedTo(&tenant, inos);
+  for (cfs_ino_t ino : inos) {
+    auto it = fsImpl_->inodeMap_.find(ino);
+    if (it == fsImpl_->inodeMap_.end()) continue;
+    invalidateClientCache(it->second);
+    if (tenant.get_client_cache_excess() == 0) break;
+  }
+  SPDLOG_DEBUG("reclaimed client cache: {} pages left",
+               tenant.get_client_cache_pages());
+#endif
+}
+#endif
+
 int FileMng::_renewLeaseForRead(FsReq *req) {
   FsProcLeaseType type;
   bool leaseFound = leaseMng_.queryValidExistingLease(req->getFileInum(), type);
@@ -2422,6 +2499,8 @@ void FileMng::updateBlockBitmaps(std::vector<uint64_t> &blocks_to_set,
     block_clear_bit(lba % BPB, stable_bmap);
     auto dirty_bmap = fsImpl_->getLockedDirtyBitmap(bmap_disk_bno);
     block_clear_bit(lba % BPB, dirty_bmap->getBufPtr());
+    fsImpl_->noteDataBlockFreed(bmap_disk_bno, lba % BPB,
+                                dirty_bmap->getBufPtr());
     fsImpl_->releaseLockedDirtyBitmap(dirty_bmap);
   }
 }
@@ -2561,6 +2640,7 @@ void FileMng::processRemoteBitmapChanges(FsReq *req) {
       assert((getWidForBitmapBlock(bmap_bno)) == (fsWorker_->getWid()));
       SPDLOG_DEBUG("clearing bit {} in data block bitmap", lba % BPB);
       block_clear_bit(lba % BPB, bmap_ptr);
+      fsImpl_->noteDataBlockFreed(bmap_bno, lba % BPB, bmap_ptr);
     }
   }
 
@@ -2608,8 +2688,7 @@ void FileMng::processBitmapChanges(BitmapChangeOps *changes,
   // bitmaps so that we do not allocate from them till checkpointing is done.
   SPDLOG_DEBUG("adding {} entries to immutableBlockBitmaps",
                bmaps_cleared.size());
-  fsImpl_->immutableBlockBitmaps_.insert(bmaps_cleared.cbegin(),
-                                         bmaps_cleared.cend());
+  fsImpl_->lockBlockBitmaps(bmaps_cleared);
 
   // We register the bmaps we've performed deallocations on with the journal
   // manager. If we are currently checkpointing, the journal manager will make
@@ -2669,6 +2748,7 @@ void FileMng::processLdbWsync(FsReq *req) {
     InMemInode *fileInode = req->getTargetInode();
     assert(fileInode != nullptr);
     fsWorker_->onTargetInodeFiguredOut(req, fileInode);
+    invalidateClientCache(fileInode);
     // TODO (jingliu): test to see if this function works as expected
     uint64_t n_num_blocks = 0;
     if (op_ptr->file_size > 0) {
@@ -3457,6 +3537,17 @@ void FileMng::processOpendir(FsReq *req) {
     }
   }
 
+  if (req->getState() == FsReqState::OPENDIR_READ_WHOLE_INODE &&
+      req->getType() == FsReqType::READDIR) {
+    // readdir only reads the dentry blocks of its chunk
+    if (req->getTargetInode()->inodeData->type != T_DIR) {
+      req->setError(FS_REQ_ERROR_POSIX_ENOTDIR);
+      req->setState(FsReqState::OPENDIR_ERR);
+    } else {
+      req->setState(FsReqState::READDIR_READ_DENTRIES);
+    }
+  }
+
   if (req->getState() == FsReqState::OPENDIR_READ_WHOLE_INODE) {
     InMemInode *fileInode = req->getTargetInode();
     char *dst = req->getMallocedDataPtr();
@@ -3478,6 +3569,52 @@ void FileMng::processOpendir(FsReq *req) {
     }
   }
 
+  if (req->getState() == FsReqState::READDIR_READ_DENTRIES) {
+    InMemInode *dirInode = req->getTargetInode();
+    auto &rdop = req->getClientOp()->op.readdir;
+    uint32_t maxEntries = std::min(rdop.maxEntries, uint32_t(FS_READDIR_CHUNK));
+    uint64_t cursor = rdop.cursor;
+    std::vector<cfs_dirent> dentries;
+    dentries.reserve(maxEntries);
+    if (fsImpl_->readDirDentries(req, dirInode, cursor, maxEntries, dentries)) {
+      fsp_readdir::packEntries(req->getMallocedDataPtr(), dentries, rdop.plus);
+      rdop.cursor = cursor;
+      rdop.ret = dentries.size();
+      if (rdop.plus) {
+        req->setState(FsReqState::READDIR_FILL_ATTRS);
+      } else {
+        fsWorker_->submitFsReqCompletion(req);
+      }
+    } else {
+      submitFsGeneratedRequests(req);
+    }
+  }
+
+  if (req->getState() == FsReqState::READDIR_FILL_ATTRS) {
+    auto &rdop = req->getClientOp()->op.readdir;
+    auto *ents = reinterpret_cast<readdirPlusEnt *>(req->getMallocedDataPtr());
+    // the inodes other workers own are left to them
+    auto master = static_cast<FsProcWorkerMaster *>(fsWorker_);
+    int rc = fsp_readdir::fillAttrs<InMemInode>(
+        ents, rdop.ret,
+        [master](cfs_ino_t ino) {
+          return master->getInodeOwner(ino) == FsProcWorker::kMasterWidConst;
+        },
+        [this, req](cfs_ino_t ino) { return fsImpl_->getFileInode(req, ino); },
+        [req]() { return req->numTotalPendingIoReq() > 0; },
+        [this](InMemInode *inode, readdirPlusEnt *ent) {
+          fromInMemInode2Statbuf(inode, &ent->statbuf);
+          ent->ent.type = inode->inodeData->type == T_DIR ? DT_DIR : DT_REG;
+        });
+    if (rc > 0) {
+      fsWorker_->submitFsReqCompletion(req);
+    } else if (rc == 0) {
+      submitFsGeneratedRequests(req);
+    } else {
+      req->setState(FsReqState::OPENDIR_ERR);
+    }
+  }
+
   if (req->getState() == FsReqState::OPENDIR_ERR) {
     req->setError();
     fsWorker_->submitFsReqCompletion(req);
@@ -3611,7 +3748,9 @@ void InMemInode::initNewAllocatedDinodeContent(mode_t tp) {
   inodeData->type = tp;
   setNlink(1);
   inodeData->i_no = i_no;
+  cfs_extent_tree_init(inodeData);
   logEntry->set_mode(tp);
+  logEntry->set_ext_root(inodeData);
 }
 
 bool InMemInode::tryLock() {
@@ -476,10 +476,41 @@ void FileMng::UnlinkOp::OwnerUnlinkInode(FileMng *mng, cfs_ino_t ino,
   if (nlink == 0) OwnerDeallocResources(mng, ino, inode);
 }
 
+bool FileMng::UnlinkOp::OwnerCollectExtents(FileMng *mng, InMemInode *inode,
+                                            std::vector<cfs_extent> &extents,
+                                            std::vector<uint64_t> &nodeBlocks) {
+  // without index nodes, nothing needs to be read
+  if (inode->inodeData->ext_header.depth == 0)
+    return mng->fsImpl_->collectExtents(nullptr, inode, extents, nodeBlocks);
+
+  // NOTE: like OwnerEnsureLocalBitmapsInMem, a generic request is used to read
+  // the index nodes
+  auto cb = [](FileMng *mgr, FsReq *req) {
+    InMemInode *minode = static_cast<InMemInode *>(req->generic_callback_ctx);
+    cfs_ino_t ino = minode->i_no;
+    mgr->fsWorker_->releaseFsReq(req);
+
+    // resume function again
+    FileMng::UnlinkOp::OwnerDeallocResources(mgr, ino, minode);
+  };
+
+  void *ctx = static_cast<void *>(inode);
+  auto req = mng->fsWorker_->genGenericRequest(cb, ctx);
+  if (mng->fsImpl_->collectExtents(req, inode, extents, nodeBlocks)) {
+    mng->fsWorker_->releaseFsReq(req);
+    return true;
+  }
+
+  assert(req->numTotalPendingIoReq() > 0);
+  mng->submitFsGeneratedRequests(req);
+  return false;
+}
+
 #if CFS_JOURNAL(ON)
-bool FileMng::UnlinkOp::OwnerEnsureLocalBitmapsInMem(FileMng *mng,
-                                                     cfs_ino_t ino,
-                                                     InMemInode *inode) {
+bool FileMng::UnlinkOp::OwnerEnsureLocalBitmapsInMem(
+    FileMng *mng, cfs_ino_t ino, InMemInode *inode,
+    const std::vector<cfs_extent> &extents,
+    const std::vector<uint64_t> &nodeBlocks) {
   if (inode == nullptr) [[unlikely]] {
     inode = mng->GetInMemInode(ino);
   }
@@ -487,18 +518,18 @@ bool FileMng::UnlinkOp::OwnerEnsureLocalBitmapsInMem(FileMng *mng,
   auto this_wid = mng->fsWorker_->getWid();
   uint64_t bmap_start = get_bmap_start_block_for_worker(this_wid);
   uint64_t bmap_stop = get_bmap_start_block_for_worker(this_wid + 1);
-  int i = 0;
-  ssize_t size = inode->inodeData->size;
   std::unordered_set<cfs_bno_t> local_bmaps;
-  while (size > 0) {
-    auto extentPtr = &(inode->inodeData->ext_array[i++]);
-    size -= (extentPtr->num_blocks * BSIZE);
-
-    auto bmap = get_bmap_block_for_lba(extentPtr->block_no);
+  auto addBmap = [&](uint64_t block_no) {
+    auto bmap = get_bmap_block_for_lba(block_no);
     if ((bmap >= bmap_start) && (bmap < bmap_stop)) {
       local_bmaps.insert(bmap);
     }
+  };
+  for (const auto &extent : extents) {
+    forEachAllocUnitOfExtent(
+        extent, [&](uint64_t unit_start, int) { addBmap(unit_start); });
   }
+  for (uint64_t block_no : nodeBlocks) addBmap(block_no);
 
   std::unordered_set<cfs_bno_t> local_unloaded_bmaps;
   // TODO consider an ordered map so that set differences can be used
@@ -538,20 +569,16 @@ bool FileMng::UnlinkOp::OwnerEnsureLocalBitmapsInMem(FileMng *mng,
 #endif
 
 #if CFS_JOURNAL(ON)
-static int CalculateWorkerWithMaximumDeallocs(ssize_t file_size,
-                                              const struct cfs_extent *arr) {
-  int i = 0;
+static int CalculateWorkerWithMaximumDeallocs(
+    const std::vector<cfs_extent> &extents) {
   int max_idx = 0;
   size_t bmap_counts[NMAX_FSP_WORKER];
   memset(bmap_counts, 0, sizeof(size_t) * NMAX_FSP_WORKER);
 
-  while (file_size > 0) {
-    auto extentPtr = &(arr[i++]);
-    file_size -= (extentPtr->num_blocks * BSIZE);
-
-    auto bmap = get_bmap_block_for_lba(extentPtr->block_no);
+  for (const auto &extent : extents) {
+    auto bmap = get_bmap_block_for_lba(extent.block_no);
     auto wid = getWidForBitmapBlock(bmap);
-    bmap_counts[wid] += extentPtr->num_blocks;
+    bmap_counts[wid] += extent.num_blocks;
 
     if (bmap_counts[max_idx] < bmap_counts[wid]) max_idx = wid;
   }
@@ -580,9 +607,13 @@ void FileMng::UnlinkOp::OwnerDeallocResources(FileMng *mng, cfs_ino_t ino,
     // doesn't hurt to make this assertion atleast in debug mode.
     return;
   }
+  mng->invalidateClientCache(inode);
 
-  auto best_wid = CalculateWorkerWithMaximumDeallocs(
-      inode->inodeData->size, inode->inodeData->ext_array);
+  std::vector<cfs_extent> extents;
+  std::vector<uint64_t> nodeBlocks;
+  if (!OwnerCollectExtents(mng, inode, extents, nodeBlocks)) return;
+
+  auto best_wid = CalculateWorkerWithMaximumDeallocs(extents);
   SPDLOG_DEBUG("Unlink deallocating inode {}, calculated best_wid as {}", ino,
                best_wid);
   if (best_wid != -1 && best_wid != mng->fsWorker_->getWid()) {
@@ -608,19 +639,26 @@ void FileMng::UnlinkOp::OwnerDeallocResources(FileMng *mng, cfs_ino_t ino,
 
   // If the bitmaps aren't loaded, the function will first load it and then call
   // back into OwnerDeallocResources
-  if (!OwnerEnsureLocalBitmapsInMem(mng, ino, inode)) return;
+  if (!OwnerEnsureLocalBitmapsInMem(mng, ino, inode, extents, nodeBlocks))
+    return;
 
   // safe to deallocate. Marking items to be deallocated during fsync.
   // TODO: handle non journal case.
   inode->logEntry->set_bitmap_op(0);
-  // TODO: calculate based on file size instead of going over all extents
-  for (int i = 0; i < NEXTENT_ARR; i++) {
-    auto extentPtr = &(inode->inodeData->ext_array[i]);
-    if ((extentPtr->block_no > 0) && (extentPtr->num_blocks > 0)) {
-      // this deallocation must lead to clearing the bit in bmap for extent
-      inode->logEntry->update_extent(extentPtr, false, /*bmap_modified*/ true);
-    }
+  // this deallocation must lead to clearing the bit in bmap for each unit
+  for (const auto &extent : extents) {
+    forEachAllocUnitOfExtent(extent, [&](uint64_t unit_start, int cls) {
+      struct cfs_extent unit = {extent.i_block_offset,
+                                extentArrIdx2BlockAllocUnit(cls), unit_start};
+      inode->logEntry->update_extent(&unit, false, /*bmap_modified*/ true);
+    });
   }
+  for (uint64_t block_no : nodeBlocks) {
+    struct cfs_extent node = {0, 1, block_no};
+    inode->logEntry->update_extent(&node, false, /*bmap_modified*/ true);
+  }
+  cfs_extent_tree_init(inode->inodeData);
+  inode->logEntry->set_ext_root(inode->inodeData);
 
   // mark this inode dirty so that it is eventually synced to disk
   inode->fetchSetDirty(true);
@@ -643,6 +681,10 @@ void FileMng::UnlinkOp::OwnerDeallocResources(FileMng *mng, cfs_ino_t ino,
     inode->unlinkDeallocResourcesOnClose = true;
     return;
   }
+  std::vector<cfs_extent> extents;
+  std::vector<uint64_t> nodeBlocks;
+  if (!OwnerCollectExtents(mng, inode, extents, nodeBlocks)) return;
+  mng->invalidateClientCache(inode);
 
   std::unordered_map<int, BitmapChangeOps *> wid_changes_map;
   {
@@ -652,13 +694,18 @@ void FileMng::UnlinkOp::OwnerDeallocResources(FileMng *mng, cfs_ino_t ino,
     wid_changes_map[FsProcWorker::kMasterWidConst] = changes;
   }
 
+  // NOTE: in current implementation clearing the first block in an allocation
+  // unit is enough to mark the entire unit "free"
+  std::vector<uint64_t> unit_starts(nodeBlocks);
+  for (const auto &extent : extents) {
+    forEachAllocUnitOfExtent(extent, [&](uint64_t unit_start, int) {
+      unit_starts.push_back(unit_start);
+    });
+  }
+
   // segregate changes based on which blocks belong to which worker
-  for (int i = 0; i < NEXTENT_ARR; i++) {
-    auto extentPtr = &(inode->inodeData->ext_array[i]);
-    if (extentPtr->block_no == 0) continue;
-    // NOTE: in current implementation clearing the first block in extent is
-    // enough to mark the entire extent "free"
-    cfs_bno_t block_pba = conv_lba_to_pba(extentPtr->block_no);
+  for (uint64_t unit_start : unit_starts) {
+    cfs_bno_t block_pba = conv_lba_to_pba(unit_start);
     cfs_bno_t bmap_disk_bno = get_bmap_block_for_pba(block_pba);
     int bmap_wid = getWidForBitmapBlock(bmap_disk_bno);
     auto [it, inserted] = wid_changes_map.try_emplace(bmap_wid, nullptr);
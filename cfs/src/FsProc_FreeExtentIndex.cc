@@ -0,0 +1,220 @@
+#include "FsProc_FreeExtentIndex.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <vector>
+
+#include "FsProc_FsInternal.h"
+#include "util.h"
+
+FreeExtentIndex::FreeExtentIndex(uint32_t numBmapBlocks, uint32_t allocUnit)
+    : numBmapBlocks_(numBmapBlocks), allocUnit_(allocUnit) {
+  assert(allocUnit_ > 0);
+  if (allocUnit_ < BPB) {
+    assert(BPB % allocUnit_ == 0);
+    unitsPerBmapBlock_ = BPB / allocUnit_;
+    bmapBlocksPerUnit_ = 1;
+    numUnits_ = uint64_t(numBmapBlocks_) * unitsPerBmapBlock_;
+  } else {
+    assert(allocUnit_ % BPB == 0);
+    unitsPerBmapBlock_ = 1;
+    bmapBlocksPerUnit_ = allocUnit_ / BPB;
+    // a trailing partial unit is never allocated
+    numUnits_ = numBmapBlocks_ / bmapBlocksPerUnit_;
+  }
+}
+
+uint32_t FreeExtentIndex::unitToBmapBlock(uint64_t unit) const {
+  if (allocUnit_ < BPB) return unit / unitsPerBmapBlock_;
+  return unit * bmapBlocksPerUnit_;
+}
+
+uint32_t FreeExtentIndex::unitToBitNo(uint64_t unit) const {
+  if (allocUnit_ < BPB) return (unit % unitsPerBmapBlock_) * allocUnit_;
+  return 0;
+}
+
+bool FreeExtentIndex::bmapBitToUnit(uint32_t bmapBlockIdx, uint32_t bitNo,
+                                    uint64_t &unit) const {
+  if (bmapBlockIdx >= numBmapBlocks_ || bitNo >= BPB) return false;
+  if (allocUnit_ < BPB) {
+    if (bitNo % allocUnit_ != 0) return false;
+    unit = uint64_t(bmapBlockIdx) * unitsPerBmapBlock_ + bitNo / allocUnit_;
+    return true;
+  }
+  if (bmapBlockIdx % bmapBlocksPerUnit_ != 0 || bitNo != 0) return false;
+  unit = bmapBlockIdx / bmapBlocksPerUnit_;
+  return unit < numUnits_;
+}
+
+bool FreeExtentIndex::isUnitFree(const char *bmap, uint64_t unit) const {
+  if (allocUnit_ < BPB)
+    return !block_test_bit(unitToBitNo(unit),
+                           const_cast<void *>(static_cast<const void *>(bmap)));
+  // the whole unit is marked by memset() on allocation
+  return *reinterpret_cast<const int *>(bmap) == 0;
+}
+
+bool FreeExtentIndex::isBmapBlockIndexed(uint32_t bmapBlockIdx) const {
+  return bmapBlockIdx < nextToIndex_;
+}
+
+void FreeExtentIndex::indexNextBmapBlock(const char *bmap) {
+  assert(!isFullyIndexed());
+  uint32_t bmapBlockIdx = nextToIndex_;
+  nextToIndex_ += bmapBlocksPerUnit_;
+  if (allocUnit_ >= BPB) {
+    uint64_t unit = bmapBlockIdx / bmapBlocksPerUnit_;
+    if (unit < numUnits_ && isUnitFree(bmap, unit)) addFreeRun(unit, 1);
+    return;
+  }
+  uint64_t firstUnit = uint64_t(bmapBlockIdx) * unitsPerBmapBlock_;
+  uint64_t runStart = 0, runLen = 0;
+  for (uint32_t i = 0; i < unitsPerBmapBlock_; i++) {
+    if (isUnitFree(bmap, firstUnit + i)) {
+      if (runLen == 0) runStart = firstUnit + i;
+      runLen++;
+    } else if (runLen > 0) {
+      addFreeRun(runStart, runLen);
+      runLen = 0;
+    }
+  }
+  if (runLen > 0) addFreeRun(runStart, runLen);
+}
+
+bool FreeExtentIndex::allocUnit(uint64_t &unit) {
+  if (runsBySize_.empty()) return false;
+  auto [len, start] = *runsBySize_.begin();
+  auto it = runs_.find(start);
+  assert(it != runs_.end());
+  eraseRun(it);
+  if (len > 1) insertRun(start + 1, len - 1);
+  numFreeUnits_--;
+  unit = start;
+  return true;
+}
+
+bool FreeExtentIndex::takeUnit(uint64_t unit) {
+  auto next = runs_.upper_bound(unit);
+  if (next == runs_.begin()) return false;
+  auto it = std::prev(next);
+  uint64_t start = it->first;
+  uint64_t end = it->first + it->second;
+  if (end <= unit) return false;
+  eraseRun(it);
+  if (unit > start) insertRun(start, unit - start);
+  if (unit + 1 < end) insertRun(unit + 1, end - unit - 1);
+  numFreeUnits_--;
+  return true;
+}
+
+void FreeExtentIndex::freeUnit(uint64_t unit) {
+  if (unit >= numUnits_ || !isBmapBlockIndexed(unitToBmapBlock(unit))) return;
+  // already free in the index?
+  auto next = runs_.upper_bound(unit);
+  if (next != runs_.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second > unit) return;
+  }
+  addFreeRun(unit, 1);
+}
+
+void FreeExtentIndex::freezeBmapBlock(uint32_t bmapBlockIdx) {
+  uint64_t first, last;
+  groupUnits(bmapBlockIdx, first, last);
+  if (++frozen_[groupOf(first)] > 1 || first >= last) return;
+  // cut the runs at the block's edges; insertRun() leaves the middle pieces
+  // out of the size tree
+  auto it = runs_.upper_bound(first);
+  if (it != runs_.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second > first) it = prev;
+  }
+  while (it != runs_.end() && it->first < last) {
+    uint64_t start = it->first;
+    uint64_t end = start + it->second;
+    eraseRun(it++);
+    if (start < first) insertRun(start, first - start);
+    uint64_t midStart = std::max(start, first);
+    insertRun(midStart, std::min(end, last) - midStart);
+    if (end > last) insertRun(last, end - last);
+  }
+}
+
+void FreeExtentIndex::thawBmapBlock(uint32_t bmapBlockIdx) {
+  uint64_t first, last;
+  groupUnits(bmapBlockIdx, first, last);
+  auto frozen = frozen_.find(groupOf(first));
+  assert(frozen != frozen_.end());
+  if (--frozen->second > 0) return;
+  frozen_.erase(frozen);
+  // add the runs again, so that they coalesce with their neighbours
+  std::vector<std::pair<uint64_t, uint64_t>> groupRuns;
+  for (auto it = runs_.lower_bound(first);
+       it != runs_.end() && it->first < last;) {
+    groupRuns.emplace_back(*it);
+    numFreeUnits_ -= it->second;
+    eraseRun(it++);
+  }
+  for (auto [start, len] : groupRuns) addFreeRun(start, len);
+}
+
+bool FreeExtentIndex::isBmapBlockFrozen(uint32_t bmapBlockIdx) const {
+  uint64_t first, last;
+  groupUnits(bmapBlockIdx, first, last);
+  return frozen_.count(groupOf(first)) > 0;
+}
+
+bool FreeExtentIndex::isUnitFrozen(uint64_t unit) const {
+  return !frozen_.empty() && frozen_.count(groupOf(unit)) > 0;
+}
+
+void FreeExtentIndex::groupUnits(uint32_t bmapBlockIdx, uint64_t &first,
+                                 uint64_t &last) const {
+  if (allocUnit_ < BPB) {
+    first = uint64_t(bmapBlockIdx) * unitsPerBmapBlock_;
+    last = first + unitsPerBmapBlock_;
+  } else {
+    first = bmapBlockIdx / bmapBlocksPerUnit_;
+    last = first + 1;
+  }
+  last = std::min(last, numUnits_);
+}
+
+bool FreeExtentIndex::canMerge(uint64_t leftStart, uint64_t rightStart) const {
+  bool leftFrozen = isUnitFrozen(leftStart);
+  bool rightFrozen = isUnitFrozen(rightStart);
+  if (!leftFrozen && !rightFrozen) return true;
+  return leftFrozen && rightFrozen && groupOf(leftStart) == groupOf(rightStart);
+}
+
+void FreeExtentIndex::addFreeRun(uint64_t start, uint64_t len) {
+  numFreeUnits_ += len;
+  // coalesce with the neighbour runs
+  auto next = runs_.upper_bound(start);
+  if (next != runs_.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == start && canMerge(prev->first, start)) {
+      start = prev->first;
+      len += prev->second;
+      eraseRun(prev);
+    }
+  }
+  if (next != runs_.end() && next->first == start + len &&
+      canMerge(start, next->first)) {
+    len += next->second;
+    eraseRun(next);
+  }
+  insertRun(start, len);
+}
+
+void FreeExtentIndex::insertRun(uint64_t start, uint64_t len) {
+  runs_.emplace(start, len);
+  if (!isUnitFrozen(start)) runsBySize_.emplace(len, start);
+}
+
+void FreeExtentIndex::eraseRun(std::map<uint64_t, uint64_t>::iterator it) {
+  runsBySize_.erase({it->second, it->first});
+  runs_.erase(it);
+}
@@ -2,14 +2,18 @@
 
 #include <string.h>
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
 
 #include "FsProc_Fs.h"
 #include "FsProc_Journal.h"
+#include "FsProc_Readdir.h"
 #include "Param.h"
 #include "Tag.h"
 #include "nlohmann/json.hpp"
@@ -27,7 +31,6 @@ FsImpl::FsImpl(FsProcWorker *worker, const char *memPtr,
 #ifndef NONE_MT_LOCK
       iMapBlockLock(ATOMIC_FLAG_INIT),
       inodeMapLock(ATOMIC_FLAG_INIT),
-      bmapLock(ATOMIC_FLAG_INIT),
 #endif
       memPtr_(memPtr) {
   static_assert(sizeof(cfs_mem_block_t) == BSIZE, "");
@@ -56,7 +59,6 @@ FsImpl::FsImpl(FsProcWorker *worker, const char *bmapMemPtr,
 #ifndef NONE_MT_LOCK
       iMapBlockLock(ATOMIC_FLAG_INIT),
       inodeMapLock(ATOMIC_FLAG_INIT),
-      bmapLock(ATOMIC_FLAG_INIT),
 #endif
       memPtr_(nullptr),
       bmapMemPtr_(bmapMemPtr),
@@ -81,7 +83,6 @@ FsImpl::FsImpl(FsProcWorker *worker, const char *bmapMemPtr,
 #ifndef NONE_MT_LOCK
       iMapBlockLock(ATOMIC_FLAG_INIT),
       inodeMapLock(ATOMIC_FLAG_INIT),
-      bmapLock(ATOMIC_FLAG_INIT),
 #endif
       memPtr_(nullptr),
       bmapMemPtr_(bmapMemPtr),
@@ -131,18 +132,24 @@ cfs_dirent *FsImpl::lookupDirDentry(FsReq *fsReq, InMemInode *dirInode,
   cfs_dinode *dinodePtr = dirInode->inodeData;
   // uint32_t fileIno = 0;
   BlockBufferHandle itemPtr = nullptr;
-  cfs_extent *cur_extent = nullptr;
+  cfs_extent cur_extent;
   struct cfs_dirent *retDirent = nullptr;
   error = false;
   uint64_t totalNumDentry = dinodePtr->size / sizeof(cfs_dirent);
   uint64_t numDentries = 0;
-  for (int i = 0; i < NEXTENT_ARR; i++) {
-    cur_extent = &dinodePtr->ext_array[i];
+  for (uint32_t i = 0; i < dinodePtr->i_block_count;) {
+    int rc = lookupExtent(fsReq, dirInode, i, cur_extent);
+    if (rc == 0) {
+      // reading the index node; do next round lookup after reading dev.
+      return nullptr;
+    }
+    if (rc < 0) break;
     uint64_t blkno;
-    for (uint ii = 0; ii < cur_extent->num_blocks; ii++) {
-      blkno = cur_extent->block_no + ii;
-      SPDLOG_DEBUG("lookupDir- ii:{} cur_extent->numBlocks:{}", ii,
-                   cur_extent->num_blocks);
+    for (uint ii = i - cur_extent.i_block_offset; ii < cur_extent.num_blocks;
+         ii++, i++) {
+      blkno = cur_extent.block_no + ii;
+      SPDLOG_DEBUG("lookupDir- ii:{} cur_extent.numBlocks:{}", ii,
+                   cur_extent.num_blocks);
       // std::cerr << "lookupDir blockNo:" << get_data_start_block() + blkno
       //          << std::endl;
       itemPtr = getBlockForIndex(dataBlockBuf_, get_data_start_block() + blkno,
@@ -191,6 +198,26 @@ cfs_dirent *FsImpl::lookupDirDentry(FsReq *fsReq, InMemInode *dirInode,
   return retDirent;
 }
 
+bool FsImpl::readDirDentries(FsReq *fsReq, InMemInode *dirInode,
+                             uint64_t &cursor, uint32_t maxEntries,
+                             std::vector<cfs_dirent> &dentries) {
+  uint64_t numSlots = dirInode->inodeData->size / sizeof(cfs_dirent);
+  auto visitBlock = [&](uint64_t i, auto &&visit) {
+    cfs_extent cur_extent;
+    int rc = lookupExtent(fsReq, dirInode, i, cur_extent);
+    if (rc <= 0) return rc;
+    uint64_t blkno = cur_extent.block_no + (i - cur_extent.i_block_offset);
+    BlockBufferHandle itemPtr = getBlockForIndex(
+        dataBlockBuf_, get_data_start_block() + blkno, fsReq, dirInode->i_no);
+    if (!itemPtr->isInMem()) return 0;
+    visit(reinterpret_cast<const cfs_dirent *>(itemPtr->getBufPtr()));
+    dataBlockBuf_->releaseBlock(itemPtr);
+    return 1;
+  };
+  return fsp_readdir::collectDentries(numSlots, cursor, maxEntries, visitBlock,
+                                      dentries);
+}
+
 int FsImpl::checkInodeDentryInMem(FsReq *fsReq, InMemInode *dirInode,
                                   InMemInode *targetInode,
                                   const std::string &fileName) {
@@ -535,9 +562,7 @@ int64_t FsImpl::readInodeToUCache(
     std::vector<std::pair<cfs_bno_t, size_t>> &pagesToRead,
     std::vector<std::pair<PageDescriptor *, void *>> &dstVec) {
   assert(pagesToRead.size() == dstVec.size());
-  cfs_dinode *dinodePtr = inode->inodeData;
-  cfs_extent *extentPtr = nullptr;
-  uint32_t cur_inside_extent_idx, cur_extent_max_block_num;
+  cfs_extent extent;
   uint32_t blockIdx;
   int rioNum = 0;
   uint64_t realBytes = 0;
@@ -547,10 +572,18 @@ int64_t FsImpl::readInodeToUCache(
       continue;
     }
     blockIdx = pagesToRead[i].first;
-    int cur_extent_arr_idx = getCurrentExtentArrIdx(
-        blockIdx, cur_inside_extent_idx, cur_extent_max_block_num);
-    extentPtr = &dinodePtr->ext_array[cur_extent_arr_idx];
-    uint32_t dataBlockNo = extentPtr->block_no + cur_inside_extent_idx;
+    int rc = lookupExtent(req, inode, blockIdx, extent);
+    if (rc == 0) {
+      // need to read the index node first
+      rioNum++;
+      break;
+    }
+    if (rc < 0) {
+      SPDLOG_ERROR("ERROR cannot find the extent for blockIdx:{} ino:{}",
+                   blockIdx, inode->i_no);
+      throw std::runtime_error("readInodeToUCache cannot find extent");
+    }
+    uint32_t dataBlockNo = extent.block_no + (blockIdx - extent.i_block_offset);
     BlockBufferHandle itemPtr = getBlockForIndex(
         dataBlockBuf_, get_data_start_block() + dataBlockNo, req, inode->i_no);
     if (itemPtr->isInMem()) {
@@ -578,11 +611,12 @@ int64_t FsImpl::readInodeToUCache(
 // Latency-ST@bumble: 4K read, if in-memory, readInode() takes ~=0.8us
 // if remove *memcpy*, then, 4K read, readInode() takes ~=0.29us
 int64_t FsImpl::readInode(FsReq *req, InMemInode *inode, char *dst,
-                          uint64_t offStart, uint64_t nBytes, bool nocpy) {
+                          uint64_t offStart, uint64_t nBytes, bool nocpy,
+                          bool direct) {
   cfs_dinode *dinodePtr = inode->inodeData;
   uint64_t off = offStart, tot;
   uint32_t m;
-  cfs_extent *extentPtr = nullptr;
+  cfs_extent extent;
   uint64_t realBytes = nBytes;
   char *dstPtr = dst;
   int rioNum = 0;
@@ -592,8 +626,6 @@ int64_t FsImpl::readInode(FsReq *req, InMemInode *inode, char *dst,
     realBytes = dinodePtr->size - off;
   }
 
-  uint32_t cur_inside_extent_idx, cur_extent_max_block_num;
-
   for (tot = 0; tot < realBytes; tot += m, off += m, dstPtr += m) {
     // block index of this inode
     uint32_t blockIdx = off / BSIZE;
@@ -602,19 +634,26 @@ int64_t FsImpl::readInode(FsReq *req, InMemInode *inode, char *dst,
       continue;
     }
 
-    int cur_extent_arr_idx = getCurrentExtentArrIdx(
-        blockIdx, cur_inside_extent_idx, cur_extent_max_block_num);
-
-    if (cur_extent_arr_idx < 0) {
+    int rc = lookupExtent(req, inode, blockIdx, extent);
+    if (rc == 0) {
+      // need to read the index node first
+      rioNum++;
+      break;
+    }
+    if (rc < 0) {
       SPDLOG_ERROR(
           "ERROR cannot find the extent for this offset blockIdx:{} "
-          "curExtArrIdx:{} offStart:{}",
-          blockIdx, cur_extent_arr_idx, offStart);
-      throw std::runtime_error("readInode cannot find extent idx");
+          "offStart:{}",
+          blockIdx, offStart);
+      throw std::runtime_error("readInode cannot find extent");
     }
 
-    extentPtr = &dinodePtr->ext_array[cur_extent_arr_idx];
-    uint32_t dataBlockNo = extentPtr->block_no + cur_inside_extent_idx;
+    uint32_t dataBlockNo = extent.block_no + (blockIdx - extent.i_block_offset);
+    if (direct && dst != nullptr && m == BSIZE &&
+        submitDirectRead(req, get_data_start_block() + dataBlockNo, dstPtr)) {
+      rioNum++;
+      continue;
+    }
     BlockBufferHandle itemPtr = getBlockForIndex(
         dataBlockBuf_, get_data_start_block() + dataBlockNo, req, inode->i_no);
 
@@ -651,7 +690,7 @@ int64_t FsImpl::writeEntireInode(FsReq *req, InMemInode *inode,
   uint64_t off = 0;
   uint32_t tot, m;
   BlockBufferHandle itemPtr = nullptr;
-  cfs_extent *extentPtr = nullptr;
+  cfs_extent extent;
   uint64_t realBytes = wsync_op_ptr->file_size;
 
   struct wsyncAlloc *block_array_ptr =
@@ -661,7 +700,6 @@ int64_t FsImpl::writeEntireInode(FsReq *req, InMemInode *inode,
   auto cur_app = req->getApp();
   assert(cur_app != nullptr);
   // write data
-  uint32_t curInsideExtentIdx, curExtentMaxBlockNum;
   for (tot = 0; tot < realBytes; tot += m, off += m, srcPtr += m) {
     uint32_t curBlockIdx = off / BSIZE;
     assert(curBlockIdx < wsync_op_ptr->array_size);
@@ -673,13 +711,17 @@ int64_t FsImpl::writeEntireInode(FsReq *req, InMemInode *inode,
     // if (req->getBlockIoDone(srcPtr)) {
     //   continue;
     // }
-    int curExtentArrIdx = getCurrentExtentArrIdx(
-        curBlockIdx, curInsideExtentIdx, curExtentMaxBlockNum);
-
-    assert(curExtentArrIdx >= 0);
-    extentPtr = &(dinodePtr->ext_array[curExtentArrIdx]);
+    int rc = lookupExtent(req, inode, curBlockIdx, extent);
+    // index nodes of the blocks just allocated are in memory
+    assert(rc != 0);
+    if (rc < 0) {
+      SPDLOG_ERROR("cannot find the extent for blockIdx:{} ino:{}",
+                   curBlockIdx, inode->i_no);
+      return -1;
+    }
 
-    uint32_t dataBlockNo = extentPtr->block_no + curInsideExtentIdx;
+    uint32_t dataBlockNo =
+        extent.block_no + (curBlockIdx - extent.i_block_offset);
     // for the master thread, the bitmap block's first 2 bits is used to
     // represent [[reserved], "/"]
     assert(dataBlockNo != 0);
@@ -812,24 +854,29 @@ int64_t FsImpl::writeInodeAndSaveDataBlockInfo(FsReq *req, InMemInode *inode,
   uint64_t off = offStart;
   uint32_t tot, m;
   BlockBufferHandle itemPtr = nullptr;
-  cfs_extent *extentPtr = nullptr;
+  cfs_extent extent;
   uint64_t realBytes = nBytes;
   char *srcPtr = src;
   // write data
-  uint32_t curInsideExtentIdx, curExtentMaxBlockNum;
   for (tot = 0; tot < realBytes; tot += m, off += m, srcPtr += m) {
     uint32_t curBlockIdx = off / BSIZE;
     m = std::min(realBytes - tot, BSIZE - off % BSIZE);
     if (req->getBlockIoDone(srcPtr)) {
       continue;
     }
-    int curExtentArrIdx = getCurrentExtentArrIdx(
-        curBlockIdx, curInsideExtentIdx, curExtentMaxBlockNum);
-
-    assert(curExtentArrIdx >= 0);
-    extentPtr = &(dinodePtr->ext_array[curExtentArrIdx]);
+    int rc = lookupExtent(req, inode, curBlockIdx, extent);
+    if (rc == 0) {
+      // wait for the index node
+      return 0;
+    }
+    if (rc < 0) {
+      SPDLOG_ERROR("cannot find the extent for blockIdx:{} ino:{}",
+                   curBlockIdx, inode->i_no);
+      return -1;
+    }
 
-    uint32_t dataBlockNo = extentPtr->block_no + curInsideExtentIdx;
+    uint32_t dataBlockNo =
+        extent.block_no + (curBlockIdx - extent.i_block_offset);
     // for the master thread, the bitmap block's first 2 bits is used to
     // represent [[reserved], "/"]
     assert(dataBlockNo != 0);
@@ -837,10 +884,9 @@ int64_t FsImpl::writeInodeAndSaveDataBlockInfo(FsReq *req, InMemInode *inode,
     // if item not in memory, need to fetch. Thus set default to false
     bool doWrite = false;
     // fprintf(stdout,
-    //        "getBlock4write off:%lu, curExtIdx:%d extPtrBlockNo:%lu "
-    //        "curInsideExtentIdx:%d blockNo:%lu ino:%u\n",
-    //        off, curExtentArrIdx, extentPtr->block_no, curInsideExtentIdx,
-    //        dataBlockNo + get_data_start_block(), inode->i_no);
+    //        "getBlock4write off:%lu, extBlockNo:%lu blockNo:%lu ino:%u\n",
+    //        off, extent.block_no, dataBlockNo + get_data_start_block(),
+    //        inode->i_no);
     // NOTE: this one is a easy case, all-block write will avoid the READ-IN
     if ((off % BSIZE == 0) && ((m == BSIZE) || ((off + m) > dinodePtr->size))) {
       // only need to issue write request
@@ -897,43 +943,106 @@ int64_t FsImpl::writeInodeAndSaveDataBlockInfo(FsReq *req, InMemInode *inode,
   return realBytes;
 }
 
+int FsImpl::lookupExtent(FsReq *req, InMemInode *inode, uint32_t blockIdx,
+                         cfs_extent &extent) {
+  // the node being searched stays pinned until the child pointer (or the
+  // extent) has been read out of it
+  BlockBufferHandle nodeItem = nullptr;
+  auto getNode = [&](uint64_t blockNo) -> const cfs_extent_node * {
+    if (nodeItem) {
+      dataBlockBuf_->releaseBlock(nodeItem);
+      nodeItem = nullptr;
+    }
+    BlockBufferHandle itemPtr = getBlockForIndex(
+        dataBlockBuf_, get_data_start_block() + blockNo, req, inode->i_no);
+    if (!itemPtr->isInMem()) return nullptr;
+    nodeItem = itemPtr;
+    return reinterpret_cast<const cfs_extent_node *>(itemPtr->getBufPtr());
+  };
+  int rc = cfs_extent_tree_lookup(inode->inodeData, blockIdx, getNode, extent);
+  if (nodeItem) dataBlockBuf_->releaseBlock(nodeItem);
+  return rc;
+}
+
+bool FsImpl::collectExtents(FsReq *req, InMemInode *inode,
+                            std::vector<cfs_extent> &extents,
+                            std::vector<uint64_t> &nodeBlocks) {
+  uint32_t blockCount = inode->inodeData->i_block_count;
+  std::vector<uint64_t> toVisit;
+  // Entries beyond i_block_count are stale (see appendDataBlocks()); an index
+  // entry at i_block_count is a new node that has no extent yet.
+  auto visit = [&](const cfs_extent_header &hdr, const cfs_extent *ents) {
+    for (int i = 0; i < hdr.entries; i++) {
+      if (hdr.depth > 0) {
+        if (ents[i].i_block_offset > blockCount) break;
+        toVisit.push_back(ents[i].block_no);
+      } else {
+        if (ents[i].i_block_offset >= blockCount) break;
+        extents.push_back(ents[i]);
+        extents.back().num_blocks = std::min(
+            ents[i].num_blocks, blockCount - ents[i].i_block_offset);
+      }
+    }
+  };
+
+  extents.clear();
+  nodeBlocks.clear();
+  visit(inode->inodeData->ext_header, inode->inodeData->ext_array);
+  bool inMem = true;
+  while (!toVisit.empty()) {
+    uint64_t blockNo = toVisit.back();
+    toVisit.pop_back();
+    nodeBlocks.push_back(blockNo);
+    BlockBufferHandle itemPtr = getBlockForIndex(
+        dataBlockBuf_, get_data_start_block() + blockNo, req, inode->i_no);
+    if (!itemPtr->isInMem()) {
+      // keep going, so that the other nodes are read at the same time
+      inMem = false;
+      continue;
+    }
+    auto node = reinterpret_cast<const cfs_extent_node *>(itemPtr->getBufPtr());
+    visit(node->hdr, node->ents);
+    dataBlockBuf_->releaseBlock(itemPtr);
+  }
+  return inMem;
+}
+
 // REQUIRED: inode lock is held
 int64_t FsImpl::releaseInodeDataBlocks(FsReq *req, InMemInode *inode) {
   SPDLOG_DEBUG("releaseInodeDataBlocks ino:{}", inode->i_no);
 #ifdef TEST_BLOCK_ALLOC_FREE
   fprintf(stdout, "releaseInodeDataBlocks: %u\n", inode->i_no);
 #endif
-  cfs_extent *extentPtr = nullptr;
-  uint32_t curAllocationUnit;
-  for (int i = 0; i < NEXTENT_ARR; i++) {
-    extentPtr = &(inode->inodeData->ext_array[i]);
-    if (extentPtr->block_no > 0) {
-      curAllocationUnit = extentArrIdx2BlockAllocUnit(i);
-      uint64_t bmapBitOff = extentPtr->block_no % (BPB);
-      auto curBmapItemPtr = getBlock(
-          bmapBlockBuf_,
-          extentPtr->block_no / (BPB) + get_bmap_start_block_for_worker(0),
-          req);
-      if (curBmapItemPtr->isInMem()) {
-        if (curAllocationUnit == 1) {
-          assert(block_test_bit(bmapBitOff, curBmapItemPtr->getBufPtr()));
-          block_clear_bit(bmapBitOff, curBmapItemPtr->getBufPtr());
-        } else if (curAllocationUnit < BPB) {
-          for (uint32_t j = 0; j < curAllocationUnit; j++) {
-            block_clear_bit(bmapBitOff + j,
-                            (void *)curBmapItemPtr->getBufPtr());
-          }
-        } else {
-          // block_clear_bit(0, (void *)curBmapItemPtr->getBufPtr());
-          memset(curBmapItemPtr->getBufPtr(), 0, BSIZE);
-        }
-        bmapBlockBuf_->releaseBlock(curBmapItemPtr);
-      } else {
-        return 0;
+  std::vector<cfs_extent> extents;
+  std::vector<uint64_t> nodeBlocks;
+  if (!collectExtents(req, inode, extents, nodeBlocks)) return 0;
+  // <first block, size class> of each allocation unit; index nodes take
+  // single blocks
+  std::vector<std::pair<uint64_t, int>> units;
+  for (const auto &extent : extents) {
+    forEachAllocUnitOfExtent(extent, [&](uint64_t unitStart, int cls) {
+      units.emplace_back(unitStart, cls);
+    });
+  }
+  for (uint64_t blockNo : nodeBlocks) units.emplace_back(blockNo, 0);
+
+  // clearing a bit again is harmless, so it starts over after RIO
+  for (const auto &[unitStart, cls] : units) {
+    uint32_t curAllocationUnit = extentArrIdx2BlockAllocUnit(cls);
+    uint64_t bmapBitOff = unitStart % (BPB);
+    cfs_bno_t bmapBlockNo =
+        unitStart / (BPB) + get_bmap_start_block_for_worker(0);
+    auto curBmapItemPtr = getBlock(bmapBlockBuf_, bmapBlockNo, req);
+    if (!curBmapItemPtr->isInMem()) return 0;
+    if (curAllocationUnit < BPB) {
+      for (uint32_t j = 0; j < curAllocationUnit; j++) {
+        block_clear_bit(bmapBitOff + j, (void *)curBmapItemPtr->getBufPtr());
       }
     } else {
-      break;
+      memset(curBmapItemPtr->getBufPtr(), 0, BSIZE);
     }
+    noteDataBlockFreed(bmapBlockNo, bmapBitOff, curBmapItemPtr->getBufPtr());
+    bmapBlockBuf_->releaseBlock(curBmapItemPtr);
   }
   return 0;
 }
@@ -944,215 +1053,385 @@ int64_t FsImpl::releaseInodeDataBlocks(FsReq *req, InMemInode *inode) {
 //              This Rio will be reading the block bitmap.
 // @return: number of allocated blocks.
 //          -1 if error happens, 0 if need RIO
+// Every step keeps i_block_count and the extent tree in sync, so after RIO, it
+// simply goes on from i_block_count.
 int64_t FsImpl::allocateDataBlocks(FsReq *fsReq, InMemInode *inode,
                                    uint32_t numBlocks) {
-  struct cfs_dinode *dinodePtr = inode->inodeData;
-  struct cfs_extent *extentPtr;
-
-  uint32_t curIblockCount = dinodePtr->i_block_count;
-  uint32_t insideExtentIdx, extentMaxBlockNum;
-  uint32_t n = 0;
-#ifndef NONE_MT_LOCK
-  while (bmapLock.test_and_set(std::memory_order_acquire)) {
-    // spin
-  }
-#endif
-
 #ifdef TEST_BLOCK_ALLOC_FREE
   fprintf(stdout, "allocateDataBlocks: %u\n", inode->i_no);
 #endif
-
+  uint32_t n = 0;
   while (n < numBlocks) {
-    // curIblockCount is equal to the next allocated block's idx.
-    int curExtentArrIdx = getCurrentExtentArrIdx(
-        curIblockCount, insideExtentIdx, extentMaxBlockNum);
-    if (curExtentArrIdx < 0) {
-      SPDLOG_ERROR(
-          "Cannot find slot in current inode's extent_array for blockCount:{}",
-          curIblockCount);
-      return -1;
+    int64_t rc = appendDataBlocks(fsReq, inode, numBlocks - n);
+    if (rc <= 0) return rc;
+    n += rc;
+  }
+  return n;
+}
+
+int64_t FsImpl::appendDataBlocks(FsReq *fsReq, InMemInode *inode,
+                                 uint32_t numBlocks) {
+  struct cfs_dinode *dinodePtr = inode->inodeData;
+  uint32_t blockCount = dinodePtr->i_block_count;
+
+  // the rightmost path of the tree, from the root (no buffer item) down
+  struct PathNode {
+    cfs_extent_header *hdr;
+    cfs_extent *ents;
+    BlockBufferHandle item;
+    bool dirty;
+  };
+  std::vector<PathNode> path;
+  // at most one new index node per step
+  BlockBufferHandle newNodeItem = nullptr;
+  auto finish = [&](uint32_t added) {
+    for (auto &p : path) {
+      if (p.item == nullptr) continue;
+      if (p.dirty) dataBlockBuf_->setBlockDirty(p.item, inode->i_no);
+      dataBlockBuf_->releaseBlock(p.item);
     }
-    extentPtr = &(dinodePtr->ext_array[curExtentArrIdx]);
-    uint32_t curMaxBmapBlocks;
-    uint32_t curBmapBlockDiskBlockNo =
-        get_bmap_start_block_for_worker(idx_) +
-        getDataBMapStartBlockNoForExtentArrIdx(
-            curExtentArrIdx, get_dev_bmap_num_blocks_for_worker(idx_),
-            curMaxBmapBlocks);
-    // curExtentArrIdx, numBmapOnDiskBlocksTotal_, curMaxBmapBlocks);
-    if (extentPtr->num_blocks == 0) {
-      // need to update bitmap block
-      uint32_t curAllocationUnit = extentArrIdx2BlockAllocUnit(curExtentArrIdx);
-      if (curAllocationUnit == 1) {
-        uint32_t start =
-            nextDataBlockAllocWithinUnitBlockIdx[curAllocationUnit];
-        for (uint32_t k = start; k < start + curMaxBmapBlocks; ++k) {
-          uint32_t i = k % curMaxBmapBlocks;
-          nextDataBlockAllocWithinUnitBlockIdx[curAllocationUnit] = i;
-          auto curBmapBlockNo = curBmapBlockDiskBlockNo + i;
-          if (isBlockBitmapImmutable(curBmapBlockNo)) {
-            continue;
-          }
-          auto curBmapItemPtr = getBlock(bmapBlockBuf_, curBmapBlockNo, fsReq);
-
-          if (curBmapItemPtr->isInMem()) {
-            int retryCount = 0;
-
-          FSIMPL_BMAP_ALLOC_RETRY_ONCE_FROM_START:
-            int64_t freeBitNo = find_block_free_bit_no_start_from(
-                (void *)curBmapItemPtr->getBufPtr(),
-                nextDataBlockAllocCurBlkBitNo[curAllocationUnit], (BPB));
-
-            if (freeBitNo >= 0) {
-              block_set_bit(freeBitNo, (void *)curBmapItemPtr->getBufPtr());
-              nextDataBlockAllocCurBlkBitNo[curAllocationUnit] = freeBitNo;
-              extentPtr->block_no = (curBmapBlockDiskBlockNo -
-                                     get_bmap_start_block_for_worker(0) + i) *
-                                        (BPB) +
-                                    freeBitNo;
-
-              SPDLOG_DEBUG("extentPtr->block_no is set to:{}",
-                           extentPtr->block_no);
-              extentPtr->num_blocks++;
-              extentPtr->i_block_offset = curIblockCount;
-              inode->logEntry->update_extent(extentPtr, true,
-                                             /*bmap_modified*/ true);
-              bmapBlockBuf_->releaseBlock(curBmapItemPtr);
-              goto FSIMPL_BMAP_ALLOCATE_SUCCESS;
-            } else {
-              nextDataBlockAllocCurBlkBitNo[curAllocationUnit] = -1;
-              if (curMaxBmapBlocks == 1 && retryCount++ == 0)
-                goto FSIMPL_BMAP_ALLOC_RETRY_ONCE_FROM_START;
-            }
-            bmapBlockBuf_->releaseBlock(curBmapItemPtr);
-          } else {
-#ifndef NONE_MT_LOCK
-            // need to read the bitmap block
-            bmapLock.clear(std::memory_order_release);
-#endif
-            dinodePtr->i_block_count = curIblockCount;
-            inode->logEntry->set_block_count(dinodePtr->i_block_count);
-            return 0;
-          }
+    path.clear();
+    if (newNodeItem != nullptr) {
+      dataBlockBuf_->setBlockDirty(newNodeItem, inode->i_no);
+      dataBlockBuf_->releaseBlock(newNodeItem);
+      newNodeItem = nullptr;
+    }
+    dinodePtr->i_block_count = blockCount + added;
+    inode->logEntry->set_block_count(dinodePtr->i_block_count);
+    inode->logEntry->set_ext_root(dinodePtr);
+    return added;
+  };
+  // allocate an index node (a single block) of the given depth
+  auto newNode = [&](uint16_t depth, uint64_t &nodeNo,
+                     cfs_extent_node *&node) -> int {
+    int rc = allocateDataUnit(fsReq, /*extentArrIdx*/ 0, nodeNo);
+    if (rc <= 0) return rc;
+    cfs_extent unit = {blockCount, 1, nodeNo};
+    inode->logEntry->update_extent(&unit, true, /*bmap_modified*/ true);
+    bool canOverwrite = false;
+    newNodeItem = getBlockForIndex(
+        dataBlockBuf_, get_data_start_block() + nodeNo, fsReq,
+        /*doSubmit*/ false, /*doBlockSubmit*/ false, canOverwrite, inode->i_no);
+    assert(newNodeItem->isInMem() || canOverwrite);
+    node = reinterpret_cast<cfs_extent_node *>(newNodeItem->getBufPtr());
+    cfs_extent_node_init(node, depth);
+    if (!newNodeItem->isInMem()) newNodeItem->set_IO_done();
+    return 1;
+  };
+
+  while (true) {
+    path.push_back(
+        {&dinodePtr->ext_header, dinodePtr->ext_array, nullptr, false});
+    // Load the rightmost path. The entries beyond i_block_count are dropped:
+    // the index nodes are written back before the journal entry, so a crash
+    // in between leaves the entries that the inode does not know about.
+    while (path.back().hdr->depth > 0) {
+      PathNode &cur = path.back();
+      while (cur.hdr->entries > 0 &&
+             cur.ents[cur.hdr->entries - 1].i_block_offset > blockCount) {
+        cur.hdr->entries--;
+        cur.dirty = true;
+      }
+      // an empty index node is only at the right edge
+      if (cur.hdr->entries == 0) break;
+      uint64_t childNo = cur.ents[cur.hdr->entries - 1].block_no;
+      BlockBufferHandle itemPtr = getBlockForIndex(
+          dataBlockBuf_, get_data_start_block() + childNo, fsReq, inode->i_no);
+      if (!itemPtr->isInMem()) return finish(0);
+      auto node = reinterpret_cast<cfs_extent_node *>(itemPtr->getBufPtr());
+      assert(node->hdr.magic == CFS_EXTENT_MAGIC);
+      path.push_back({&node->hdr, node->ents, itemPtr, false});
+    }
+    PathNode &tail = path.back();
+    if (tail.hdr->depth == 0) {
+      while (tail.hdr->entries > 0 &&
+             tail.ents[tail.hdr->entries - 1].i_block_offset >= blockCount) {
+        tail.hdr->entries--;
+        tail.dirty = true;
+      }
+      if (tail.hdr->entries > 0) {
+        cfs_extent &last = tail.ents[tail.hdr->entries - 1];
+        if (last.i_block_offset + last.num_blocks > blockCount) {
+          last.num_blocks = blockCount - last.i_block_offset;
+          tail.dirty = true;
         }
-        // cannot find blocks for this extent's allocation unit
-        SPDLOG_ERROR("Cannot find block for extent_idx:{} for file ino:{}",
-                     curExtentArrIdx, inode->i_no);
-        return -1;
-      } else if (curAllocationUnit < BPB) {
-        uint32_t start =
-            nextDataBlockAllocWithinUnitBlockIdx[curAllocationUnit];
-        for (uint32_t k = start; k < start + curMaxBmapBlocks; ++k) {
-          uint32_t i = k % curMaxBmapBlocks;
-          nextDataBlockAllocWithinUnitBlockIdx[curAllocationUnit] = i;
-          auto curBmapBlockNo = curBmapBlockDiskBlockNo + i;
-          if (isBlockBitmapImmutable(curBmapBlockNo)) {
-            continue;
-          }
+      }
+    }
 
-          auto curBmapItemPtr = getBlock(bmapBlockBuf_, curBmapBlockNo, fsReq);
-          if (curBmapItemPtr->isInMem()) {
-            int64_t freeBitNo = find_block_free_jump_bits_no_start_from(
-                (void *)curBmapItemPtr->getBufPtr(), 0, (BPB),
-                curAllocationUnit);
-            if (freeBitNo >= 0) {
-              block_set_bit(freeBitNo, (void *)curBmapItemPtr->getBufPtr());
-              extentPtr->block_no = (curBmapBlockDiskBlockNo -
-                                     get_bmap_start_block_for_worker(0) + i) *
-                                        (BPB) +
-                                    freeBitNo;
-              // fprintf(stdout, "alloc bit number:%lu\n", extentPtr->block_no);
-              // fprintf(stderr, "allocated at bmap block %u by worker %d\n",
-              // curBmapBlockNo, idx_);
-              extentPtr->num_blocks++;
-              extentPtr->i_block_offset = curIblockCount;
-              inode->logEntry->update_extent(extentPtr, true,
-                                             /*bmap_modified*/ true);
-              SPDLOG_DEBUG(
-                  "Found block at bmap no: {} and bit: {} by worker {}",
-                  curBmapBlockDiskBlockNo + i, freeBitNo,
-                  fsWorker_->getWorkerIdx());
-              bmapBlockBuf_->releaseBlock(curBmapItemPtr);
-              goto FSIMPL_BMAP_ALLOCATE_SUCCESS;
-            }
-            bmapBlockBuf_->releaseBlock(curBmapItemPtr);
-          } else {
-#ifndef NONE_MT_LOCK
-            // need to read the bitmap block
-            bmapLock.clear(std::memory_order_release);
-#endif
-            dinodePtr->i_block_count = curIblockCount;
-            inode->logEntry->set_block_count(dinodePtr->i_block_count);
-            return 0;
-          }
+    int rc = 1;
+    if (tail.hdr->depth > 0) {
+      // an empty index node: hang a node one level down, and so on
+      PathNode &parent = tail;
+      uint64_t nodeNo;
+      cfs_extent_node *node;
+      rc = newNode(parent.hdr->depth - 1, nodeNo, node);
+      if (rc > 0) {
+        parent.ents[parent.hdr->entries++] = {blockCount, 0, nodeNo};
+        parent.dirty = true;
+      }
+    } else if (tail.hdr->entries > 0) {
+      // grow the last extent if its unit has room, or take the adjacent unit
+      // while the file is still in the same size class
+      PathNode &leaf = tail;
+      cfs_extent &last = leaf.ents[leaf.hdr->entries - 1];
+      uint64_t lastEnd = last.block_no + last.num_blocks;
+      uint64_t unitStart;
+      int cls = getAllocClassForDataBlock(lastEnd - 1, unitStart);
+      uint32_t added = 0;
+      if (cls >= 0 && lastEnd < unitStart + extentArrIdx2BlockAllocUnit(cls)) {
+        // no need to modify bitmap blocks
+        added = std::min<uint64_t>(
+            numBlocks, unitStart + extentArrIdx2BlockAllocUnit(cls) - lastEnd);
+      } else if (cls >= 0 && cls == getExtentTreeAllocClass(blockCount)) {
+        rc = allocateDataUnitAt(fsReq, cls, lastEnd);
+        if (rc == 0) return finish(0);
+        if (rc > 0) {
+          cfs_extent unit = {blockCount, extentArrIdx2BlockAllocUnit(cls),
+                             lastEnd};
+          inode->logEntry->update_extent(&unit, true,
+                                         /*bmap_modified*/ true);
+          added = std::min(numBlocks, unit.num_blocks);
+        }
+      }
+      if (added > 0) {
+        last.num_blocks += added;
+        leaf.dirty = true;
+        return finish(added);
+      }
+      rc = 1;
+    }
+    if (tail.hdr->depth == 0 && tail.hdr->entries == tail.hdr->max) {
+      // the leaf is full: hang a new node under the lowest ancestor that has
+      // room, or push the root's entries down one level
+      int level = (int)path.size() - 2;
+      while (level >= 0 &&
+             path[level].hdr->entries == path[level].hdr->max) {
+        level--;
+      }
+      uint64_t nodeNo;
+      cfs_extent_node *node;
+      if (level >= 0) {
+        rc = newNode(path[level].hdr->depth - 1, nodeNo, node);
+        if (rc > 0) {
+          PathNode &parent = path[level];
+          parent.ents[parent.hdr->entries++] = {blockCount, 0, nodeNo};
+          parent.dirty = true;
         }
-        // cannot find blocks for this extent's allocation unit
-        SPDLOG_ERROR("Cannot find block for extent_idx:{}", curExtentArrIdx);
-        return -1;
       } else {
-        int curAllocationBmapBlockNum = curAllocationUnit / (BPB);
-        for (uint32_t i = 0; i < curMaxBmapBlocks;
-             i += curAllocationBmapBlockNum) {
-          auto curBmapBlockNo = curBmapBlockDiskBlockNo + i;
-          if (isBlockBitmapImmutable(curBmapBlockNo)) continue;
-
-          auto curBmapItemPtr = getBlock(bmapBlockBuf_, curBmapBlockNo, fsReq);
-          if (curBmapItemPtr->isInMem()) {
-            int *bufIntPtr = (int *)(curBmapItemPtr->getBufPtr());
-            if (*bufIntPtr == 0) {
-              extentPtr->block_no = (curBmapBlockDiskBlockNo -
-                                     get_bmap_start_block_for_worker(0) + i) *
-                                    (BPB);
-              extentPtr->num_blocks++;
-              extentPtr->i_block_offset = curIblockCount;
-              inode->logEntry->update_extent(extentPtr, true,
-                                             /*bmap_modified*/ true);
-              // We only need to set the first block of each allocation unit as
-              // allocated This is different from testRWFsUtil.cc (not
-              // logically, only per implementation) Mark all the bmap blocks as
-              // allocated makes things hard because it might require first read
-              // in the bitmap blocks, which is unnecessary.
-              memset(curBmapItemPtr->getBufPtr(), 1, BSIZE);
-              bmapBlockBuf_->releaseBlock(curBmapItemPtr);
-              goto FSIMPL_BMAP_ALLOCATE_SUCCESS;
-            }
-            bmapBlockBuf_->releaseBlock(curBmapItemPtr);
-          } else {
-#ifndef NONE_MT_LOCK
-            bmapLock.clear(std::memory_order_release);
-#endif
-            dinodePtr->i_block_count = curIblockCount;
-            inode->logEntry->set_block_count(dinodePtr->i_block_count);
-            return 0;
-          }
+        cfs_extent_header &root = dinodePtr->ext_header;
+        rc = newNode(root.depth, nodeNo, node);
+        if (rc > 0) {
+          memcpy(node->ents, dinodePtr->ext_array,
+                 sizeof(cfs_extent) * root.entries);
+          node->hdr.entries = root.entries;
+          uint32_t firstOffset = dinodePtr->ext_array[0].i_block_offset;
+          memset(dinodePtr->ext_array, 0, sizeof(dinodePtr->ext_array));
+          dinodePtr->ext_array[0] = {firstOffset, 0, nodeNo};
+          root.entries = 1;
+          root.depth++;
         }
-        // cannot find blocks for this extent's allocation unit
-        SPDLOG_ERROR("Cannot find block for extent_idx:{}", curExtentArrIdx);
-        return -1;
       }
-    FSIMPL_BMAP_ALLOCATE_SUCCESS:
-      n++;
-      curIblockCount++;
+    } else if (tail.hdr->depth == 0) {
+      // start a new extent: the preferred size class, then the smaller ones,
+      // then the larger ones
+      int preferred = getExtentTreeAllocClass(blockCount);
+      uint64_t blockNo = 0;
+      for (int i = 0; i < NEXTENT_ARR; i++) {
+        int cls = i <= preferred ? preferred - i : i;
+        rc = allocateDataUnit(fsReq, cls, blockNo);
+        if (rc == 0) return finish(0);
+        if (rc < 0) continue;
+        cfs_extent unit = {blockCount, extentArrIdx2BlockAllocUnit(cls),
+                           blockNo};
+        inode->logEntry->update_extent(&unit, true, /*bmap_modified*/ true);
+        uint32_t added = std::min(numBlocks, unit.num_blocks);
+        tail.ents[tail.hdr->entries++] = {blockCount, added, blockNo};
+        tail.dirty = true;
+        return finish(added);
+      }
+    }
+    if (rc == 0) return finish(0);
+    if (rc < 0) {
+      SPDLOG_ERROR("Cannot find block for blockCount:{} for file ino:{}",
+                   blockCount, inode->i_no);
+      finish(0);
+      return -1;
+    }
+    // the tree has changed; load the path again
+    finish(0);
+  }
+}
+
+FreeExtentIndex *FsImpl::getFreeExtentIndex(int extentArrIdx) {
+  auto &index = freeExtentIdxes_[extentArrIdx];
+  if (index == nullptr) {
+    uint32_t maxBmapBlocks;
+    getDataBMapStartBlockNoForExtentArrIdx(
+        extentArrIdx, get_dev_bmap_num_blocks_for_worker(idx_), maxBmapBlocks);
+    index = std::make_unique<FreeExtentIndex>(
+        maxBmapBlocks, extentArrIdx2BlockAllocUnit(extentArrIdx));
+    uint32_t i;
+    for (cfs_bno_t bmapBlockNo : immutableBlockBitmaps_)
+      if (findFreeExtentIndex(bmapBlockNo, i) == index.get())
+        index->freezeBmapBlock(i);
+  }
+  return index.get();
+}
+
+FreeExtentIndex *FsImpl::findFreeExtentIndex(cfs_bno_t bmapBlockNo,
+                                             uint32_t &bmapBlockIdx) {
+  cfs_bno_t workerStart = get_bmap_start_block_for_worker(idx_);
+  uint32_t workerNumBmapBlocks = get_dev_bmap_num_blocks_for_worker(idx_);
+  // bitmap blocks of other workers are indexed by themselves
+  if (bmapBlockNo < workerStart ||
+      bmapBlockNo >= workerStart + workerNumBmapBlocks)
+    return nullptr;
+  for (int i = 0; i < (NEXTENT_ARR); i++) {
+    uint32_t maxBmapBlocks;
+    cfs_bno_t regionStart =
+        workerStart + getDataBMapStartBlockNoForExtentArrIdx(
+                          i, workerNumBmapBlocks, maxBmapBlocks);
+    if (bmapBlockNo < regionStart || bmapBlockNo >= regionStart + maxBmapBlocks)
+      continue;
+    bmapBlockIdx = bmapBlockNo - regionStart;
+    return freeExtentIdxes_[i].get();
+  }
+  return nullptr;
+}
+
+void FsImpl::lockBlockBitmaps(const std::unordered_set<cfs_bno_t> &bmaps) {
+  for (cfs_bno_t bmapBlockNo : bmaps) {
+    if (!immutableBlockBitmaps_.insert(bmapBlockNo).second) continue;
+    uint32_t i;
+    FreeExtentIndex *index = findFreeExtentIndex(bmapBlockNo, i);
+    if (index != nullptr) index->freezeBmapBlock(i);
+  }
+}
+
+void FsImpl::resetLockedBlockBitmaps(std::unordered_set<cfs_bno_t> &bmaps) {
+  uint32_t i;
+  for (cfs_bno_t bmapBlockNo : immutableBlockBitmaps_) {
+    if (bmaps.count(bmapBlockNo) > 0) continue;
+    FreeExtentIndex *index = findFreeExtentIndex(bmapBlockNo, i);
+    if (index != nullptr) index->thawBmapBlock(i);
+  }
+  for (cfs_bno_t bmapBlockNo : bmaps) {
+    if (immutableBlockBitmaps_.count(bmapBlockNo) > 0) continue;
+    FreeExtentIndex *index = findFreeExtentIndex(bmapBlockNo, i);
+    if (index != nullptr) index->freezeBmapBlock(i);
+  }
+  immutableBlockBitmaps_.swap(bmaps);
+}
+
+int FsImpl::allocateDataUnit(FsReq *fsReq, int extentArrIdx,
+                             uint64_t &blockNo) {
+  uint32_t maxBmapBlocks;
+  cfs_bno_t regionStartBmapBlockNo =
+      get_bmap_start_block_for_worker(idx_) +
+      getDataBMapStartBlockNoForExtentArrIdx(
+          extentArrIdx, get_dev_bmap_num_blocks_for_worker(idx_),
+          maxBmapBlocks);
+  FreeExtentIndex *index = getFreeExtentIndex(extentArrIdx);
+
+  while (true) {
+    uint64_t unit;
+    // the units of immutable bitmap blocks are frozen in the index
+    if (!index->allocUnit(unit)) {
+      // index more bitmap blocks, until some free unit shows up
+      if (index->isFullyIndexed()) return -1;
+      auto curBmapItemPtr =
+          getBlock(bmapBlockBuf_,
+                   regionStartBmapBlockNo + index->getNextBmapBlockToIndex(),
+                   fsReq);
+      if (!curBmapItemPtr->isInMem()) return 0;
+      index->indexNextBmapBlock(curBmapItemPtr->getBufPtr());
+      bmapBlockBuf_->releaseBlock(curBmapItemPtr);
+      continue;
+    }
+
+    uint32_t i = index->unitToBmapBlock(unit);
+    uint32_t bitNo = index->unitToBitNo(unit);
+    auto curBmapItemPtr = getBlock(bmapBlockBuf_, regionStartBmapBlockNo + i,
+                                   fsReq);
+    if (!curBmapItemPtr->isInMem()) {
+      // the bitmap block has been evicted since indexed
+      index->freeUnit(unit);
+      return 0;
+    }
+    char *bmap = curBmapItemPtr->getBufPtr();
+    if (!index->isUnitFree(bmap, unit)) {
+      // stale: the unit is no longer free on the bitmap, so drop it
+      bmapBlockBuf_->releaseBlock(curBmapItemPtr);
+      continue;
+    }
+    if (index->getBmapBlockStride() == 1) {
+      block_set_bit(bitNo, bmap);
     } else {
-      // Do not need to modify bitmap blocks, only need to change the extent's
-      // metadata.
-      uint32_t curExtentAllocationNum =
-          std::min(numBlocks - n, extentMaxBlockNum - extentPtr->num_blocks);
-      extentPtr->num_blocks += curExtentAllocationNum;
-      n += curExtentAllocationNum;
-      curIblockCount += curExtentAllocationNum;
-      // increase num_blocks, no new extent added
-      inode->logEntry->update_extent(extentPtr, true, /*bmap_modified*/ false);
+      // We only need to set the first block of each allocation unit as
+      // allocated This is different from testRWFsUtil.cc (not logically, only
+      // per implementation) Mark all the bmap blocks as allocated makes things
+      // hard because it might require first read in the bitmap blocks, which
+      // is unnecessary.
+      memset(bmap, 1, BSIZE);
     }
+    bmapBlockBuf_->releaseBlock(curBmapItemPtr);
+    blockNo = (regionStartBmapBlockNo - get_bmap_start_block_for_worker(0) + i) *
+                  (BPB) +
+              bitNo;
+    SPDLOG_DEBUG("Found block at bmap no: {} and bit: {} by worker {}",
+                 regionStartBmapBlockNo + i, bitNo, idx_);
+    return 1;
   }
+}
 
-#ifndef NONE_MT_LOCK
-  bmapLock.clear(std::memory_order_release);
-#endif
-  uint32_t allocated = curIblockCount - dinodePtr->i_block_count;
-  dinodePtr->i_block_count = curIblockCount;
-  inode->logEntry->set_block_count(dinodePtr->i_block_count);
-  return allocated;
+int FsImpl::allocateDataUnitAt(FsReq *fsReq, int extentArrIdx,
+                               uint64_t blockNo) {
+  uint32_t maxBmapBlocks;
+  cfs_bno_t regionStartBmapBlockNo =
+      get_bmap_start_block_for_worker(idx_) +
+      getDataBMapStartBlockNoForExtentArrIdx(
+          extentArrIdx, get_dev_bmap_num_blocks_for_worker(idx_),
+          maxBmapBlocks);
+  uint64_t regionStart =
+      (regionStartBmapBlockNo - get_bmap_start_block_for_worker(0)) * (BPB);
+  uint32_t allocUnit = extentArrIdx2BlockAllocUnit(extentArrIdx);
+  if (blockNo < regionStart || (blockNo - regionStart) % allocUnit != 0)
+    return -1;
+  FreeExtentIndex *index = getFreeExtentIndex(extentArrIdx);
+  uint64_t unit = (blockNo - regionStart) / allocUnit;
+  // a unit not indexed yet is left to allocateDataUnit()
+  if (unit >= index->getNumUnits()) return -1;
+  uint32_t i = index->unitToBmapBlock(unit);
+  if (!index->isBmapBlockIndexed(i) || index->isBmapBlockFrozen(i)) return -1;
+
+  auto curBmapItemPtr =
+      getBlock(bmapBlockBuf_, regionStartBmapBlockNo + i, fsReq);
+  if (!curBmapItemPtr->isInMem()) return 0;
+  char *bmap = curBmapItemPtr->getBufPtr();
+  bool isFree = index->isUnitFree(bmap, unit);
+  // a stale unit (no longer free on the bitmap) is dropped as well
+  if (!index->takeUnit(unit) || !isFree) {
+    bmapBlockBuf_->releaseBlock(curBmapItemPtr);
+    return -1;
+  }
+  if (index->getBmapBlockStride() == 1) {
+    block_set_bit(index->unitToBitNo(unit), bmap);
+  } else {
+    // same as allocateDataUnit(): only the first bitmap block of the unit
+    memset(bmap, 1, BSIZE);
+  }
+  bmapBlockBuf_->releaseBlock(curBmapItemPtr);
+  return 1;
+}
+
+void FsImpl::noteDataBlockFreed(cfs_bno_t bmapBlockNo, uint32_t bitNo,
+                                const char *bmap) {
+  uint32_t i;
+  FreeExtentIndex *index = findFreeExtentIndex(bmapBlockNo, i);
+  if (index == nullptr) return;
+  uint64_t unit;
+  if (index->bmapBitToUnit(i, bitNo, unit) && index->isUnitFree(bmap, unit))
+    index->freeUnit(unit);
 }
 
 int64_t FsImpl::checkAndFlushDirty(FsProcWorker *worker) {
@@ -1192,12 +1471,39 @@ int64_t FsImpl::checkAndFlushDirty(FsProcWorker *worker) {
   return numFlushed;
 }
 
+#ifdef DO_SCHED
+int64_t FsImpl::writeBackTenantDirty(FsProcWorker *worker,
+                                     sched::Tenant &tenant) {
+  // with a global LRU, the blocks are not tagged by tenant
+  if (!sched::params::policy::cache_partition) return -1;
+  auto &flusher = dataBlockBuf_->flusher;
+  sched::Tag tag = {.tenant = &tenant};
+  tenant.set_wb_urgent(flusher.checkIfTenantWriteBackUrgent(tag));
+  uint32_t numToFlush = flusher.checkIfTenantNeedWriteBack(tag);
+  if (numToFlush == 0) return -1;
+#ifndef USE_SPDK
+  SPDLOG_ERROR(
+      "Posix Block Device does not allow flushing (i.e., disk io) currently");
+  throw std::runtime_error("Posix Block Device does not allow flushing");
+#endif
+  auto bufFlushReq = new BufferFlushReq(dataBlockBuf_, worker);
+  int64_t numFlushed = 0;
+  if (bufFlushReq->initWriteBackReqs(&tenant, numToFlush) > 0)
+    numFlushed = bufFlushReq->submitFlushReqs();
+  // all the dirty blocks belong to inodes being fsync'ed
+  if (numFlushed == 0) delete bufFlushReq;
+  return numFlushed;
+}
+#endif
+
 int64_t FsImpl::flushInodeData(FsProcWorker *worker, FsReq *req,
                                bool &needFlush) {
   needFlush = true;
   int64_t numFlushed = 0;
   if (!dataBlockBuf_->flusher.checkIfFgFlushReachLimit()) {
-    if (dataBlockBuf_->flusher.checkIfIdxFgFlushInflight(req->getFileInum())) {
+    if (dataBlockBuf_->flusher.checkIfIdxFgFlushInflight(req->getFileInum()) ||
+        dataBlockBuf_->flusher.checkIfIdxWriteBackInflight(
+            req->getFileInum())) {
       numFlushed = -1;
       return numFlushed;
     }
@@ -1267,6 +1573,87 @@ int FsImpl::BlockingInitRootInode(FsProcWorker *worker_handler) {
   return 0;
 }
 
+void FsImpl::snapshotDataBlockBuf(
+    std::vector<sched::snapshot::TenantSnapshot> &tenants) {
+  // the buffer does not expose the LRU order; blocks in main have been reused
+  // (or it is not split), so they are hotter than those in probation
+  std::vector<std::vector<std::pair<uint32_t, uint32_t>>> probation(
+      tenants.size());
+  dataBlockBuf_->forEachBlock([&](block_no_t bno, BlockBufferHandle item) {
+    sched::Tag tag = item.get_tag();
+    sched::Tenant *tenant = tag.get_tenant();
+    if (tenant == nullptr || !item->isInMem()) return;
+    size_t aid = tenant->get_app()->getAid();
+    if (aid >= tenants.size()) return;
+    auto &list = tag.is_probation() ? probation[aid] : tenants[aid].blocks;
+    list.emplace_back(bno, item->getIndex());
+  });
+  for (size_t aid = 0; aid < tenants.size(); ++aid)
+    tenants[aid].blocks.insert(tenants[aid].blocks.end(),
+                               probation[aid].begin(), probation[aid].end());
+}
+
+int FsImpl::BlockingWarmUpDataBlockBuf(
+    sched::Tenant &tenant,
+    const std::vector<std::pair<uint32_t, uint32_t>> &blocks,
+    FsProcWorker *worker_handler) {
+  namespace warm = sched::params::warm;
+  // only the hottest blocks that fit; a split partition admits every miss to
+  // probation, so more than probation would only evict each other
+  size_t num = std::min<size_t>(blocks.size(),
+                                tenant.is_cache_split()
+                                    ? tenant.get_probation_target()
+                                    : tenant.get_max_cache_size());
+  const auto batchInterval = std::chrono::microseconds(
+      warm::prefetch_batch * 1'000'000L / warm::prefetch_bandwidth);
+  auto nextBatchTs = std::chrono::steady_clock::now();
+  std::vector<BlockBufferHandle> batch;
+  int numDone = 0;
+  bool ioFailed = false;
+
+  auto readBatch = [&]() {
+    std::this_thread::sleep_until(nextBatchTs);
+    nextBatchTs = std::chrono::steady_clock::now() + batchInterval;
+    // the device serves a batch faster in the order of block numbers
+    auto readOrder = batch;
+    std::sort(readOrder.begin(), readOrder.end(),
+              [](const BlockBufferHandle &a, const BlockBufferHandle &b) {
+                return a.get_key() < b.get_key();
+              });
+    for (auto &h : readOrder) {
+      BlockReq req(h.get_key(), nullptr, h->getBufPtr(),
+                   FsBlockReqType::READ_BLOCKING);
+      if (worker_handler->submitDirectReadDevReq(&req) < 0) {
+        ioFailed = true;
+        break;
+      }
+      h->set_IO_done();
+    }
+    // a block left not in memory is read again on its first access
+    for (auto &h : batch) {
+      if (h->isInMem()) {
+        tenant.access_ghost_page(h.get_key(), /*is_write*/ false);
+        ++numDone;
+      }
+      dataBlockBuf_->releaseBlock(h);
+    }
+    batch.clear();
+  };
+
+  // insert the coldest first, so that the buffer and the ghost cache end up in
+  // the same LRU order as before
+  for (size_t i = num; i-- > 0 && !ioFailed;) {
+    auto [blockNo, index] = blocks[i];
+    if (dataBlockBuf_->containsBlock(blockNo)) continue;
+    auto item = dataBlockBuf_->getBlock(blockNo, index, &tenant);
+    if (item == nullptr) break;
+    batch.emplace_back(item);
+    if (batch.size() == warm::prefetch_batch) readBatch();
+  }
+  if (!batch.empty()) readBatch();
+  return ioFailed ? -1 : numDone;
+}
+
 InMemInode *FsImpl::BlockingGetInode(cfs_ino_t ino, bool &io_done,
                                      FsProcWorker *worker_handler) {
   [[maybe_unused]] auto it = inodeMap_.find(ino);
@@ -1295,6 +1682,7 @@ InMemInode *FsImpl::BlockingGetInode(cfs_ino_t ino, bool &io_done,
   inode->setValid(true);
   inodeMap_.insert({ino, inode});
   auto dinode_data = reinterpret_cast<cfs_dinode *>(item->getBufPtr());
+  cfs_extent_tree_upgrade(dinode_data);
   inode->inodeData = dinode_data;
 #if CFS_JOURNAL(ON)
   inode->jinodeData = new cfs_dinode(*(inode->inodeData));
@@ -1372,6 +1760,8 @@ InMemInode *FsImpl::getInode(uint32_t ino, FsReq *fsReq, bool doSubmit) {
       // block buffer grabbed, fill the inode
       inodePtr->setValid(true);
       cfs_dinode *inodeDataPtr = (cfs_dinode *)bufferItemPtr->getBufPtr();
+      // an inode in the legacy format is converted when it is loaded
+      cfs_extent_tree_upgrade(inodeDataPtr);
       inodePtr->inodeData = inodeDataPtr;
 #if CFS_JOURNAL(ON)
       // jinode data is only required for journal mode to checkpoint
@@ -1501,6 +1891,18 @@ BlockBufferHandle FsImpl::getBlock(BlockBuffer *blockBuf, uint32_t blockNo,
     return item;
   }
 
+#ifdef DO_SCHED
+  // the block is newly inserted; metadata buffers are shared, so the tenant
+  // bringing the block in is charged for it
+  if (tenant != nullptr && blockBuf != dataBlockBuf_) {
+    if (blockBuf == inodeSectorBuf_) inodeSectorTenants_[blockNo] = tenant;
+    if (tenant->access_meta_block(blockNo, blockBuf->blockSize / SSD_SEC_SIZE,
+                                  /*is_miss*/ doSubmit) &&
+        sched::params::policy::cache_partition)
+      adjustCacheSize(sched::Tag{.tenant = tenant});
+  }
+#endif
+
   if (doSubmit) {
     // need to do block IO
     canOverwritten = false;
@@ -1538,6 +1940,23 @@ BlockBufferHandle FsImpl::getBlock(BlockBuffer *blockBuf, uint32_t blockNo,
   return item;
 }
 
+bool FsImpl::submitDirectRead(FsReq *fsReq, uint32_t blockNo, char *dst) {
+  // the buffered copy may be newer than the one on disk
+  if (dataBlockBuf_->containsBlock(blockNo)) return false;
+  if (!fsReq->getApp()->isShmDmaCapable(fsReq->getShmId(), dst, BSIZE))
+    return false;
+#ifdef DO_SCHED
+  fsReq->get_tenant()->access_bypass_page(blockNo);
+#endif
+  BlockReq *blk_req = fsWorker_->block_req_pool.alloc();
+  blk_req->init(blockNo, /*bufItem*/ nullptr, dst,
+                FsBlockReqType::READ_NOBLOCKING);
+  blk_req->add_fs_req(fsReq);
+  fsReq->inc_pending();
+  fsWorker_->submitAsyncReadDevReq(fsReq, blk_req);
+  return true;
+}
+
 // Initialize the blockBuffer's for data bitmap, inode blocks, data blocks
 // For the stats of bmap and inode
 // bmap will only function in writing path.
@@ -1617,6 +2036,9 @@ void FsImpl::initMemAddrDataBlockBuf() {
   block_no_t pttDataNumBlocks = 0;
   char *dataBlkMemPtr = getDataBlockMemPtrPartition(
       dataBlockMemPtr_, numPartitions_, idx_, pttDataNumBlocks);
+  // a servant's partition is on its own NUMA node if allocated separately
+  if (fsWorker_->getLocalDataBlockMem() != nullptr)
+    dataBlkMemPtr = fsWorker_->getLocalDataBlockMem();
   std::string curBufferName = "DBlock-" + std::to_string(idx_);
 #ifdef DO_SCHED
   block_no_t totalNumBlocks = 0;
@@ -1624,8 +2046,14 @@ void FsImpl::initMemAddrDataBlockBuf() {
   fsWorker_->forEachApp([&](AppProc *app) {
     auto &tenant = app->getTenant();
     uint32_t numBlocks = tenant.get_max_cache_size();
-    if (sched::params::policy::cache_partition)
-      config.emplace_back(sched::Tag{.tenant = &tenant}, numBlocks);
+    if (sched::params::policy::cache_partition) {
+      uint32_t numProbationBlocks = tenant.split_cache(numBlocks);
+      config.emplace_back(sched::Tag{.tenant = &tenant},
+                          numBlocks - numProbationBlocks);
+      if (tenant.is_cache_split())
+        config.emplace_back(sched::Tag::probation_of(&tenant),
+                            numProbationBlocks);
+    }
     totalNumBlocks += numBlocks;
   });
 
@@ -1654,15 +2082,6 @@ void FsImpl::initMemAddrDataBlockBuf() {
   SPDLOG_DEBUG("Data Block Flusher: {}", dataBlockBuf_->flusher);
 }
 
-void FsImpl::initDataBlockAllocNextFreeBlockIdx() {
-  uint32_t curAllocUnit;
-  for (int i = 0; i < (NEXTENT_ARR); i++) {
-    curAllocUnit = extentArrIdx2BlockAllocUnit(i);
-    nextDataBlockAllocWithinUnitBlockIdx[curAllocUnit] = 0;
-    nextDataBlockAllocCurBlkBitNo[curAllocUnit] = -1;
-  }
-}
-
 void FsImpl::fillInodeDentryPositionAfterLookup(FsReq *req, InMemInode *inode,
                                                 int dentryNo) {
   assert(dentryNo == 0 || dentryNo == 1);
@@ -1797,11 +2216,24 @@ void FsImpl::uninstallInode(InMemInode *inode) {
   inodeMap_.erase(inode->i_no);  // TODO: should free the inode and release
                                  // the buffer
   dirtyInodeSet_.erase(inode->i_no);
+  releaseInodeSectorCharge(inode->i_no);
 #if CFS_JOURNAL(ON)
   unlinkedInodeSet_.erase(inode->i_no);
 #endif
 }
 
+void FsImpl::releaseInodeSectorCharge([[maybe_unused]] cfs_ino_t ino) {
+#ifdef DO_SCHED
+  auto it = inodeSectorTenants_.find(ino2SectorNo(ino));
+  if (it == inodeSectorTenants_.end()) return;
+  sched::Tenant *tenant = it->second;
+  inodeSectorTenants_.erase(it);
+  if (tenant->release_meta_block(inodeSectorBuf_->blockSize / SSD_SEC_SIZE) &&
+      sched::params::policy::cache_partition)
+    adjustCacheSize(sched::Tag{.tenant = tenant});
+#endif
+}
+
 void FsImpl::splitInodeDataBlockBufferSlot(
     InMemInode *inode, std::vector<ExportedBlockBufferItem> &items) {
   assert(inode->i_no == inode->inodeData->i_no);
@@ -1846,6 +2278,11 @@ int FsImpl::dumpAllInodesToFile(const char *dirname) {
       DUMP_PACK_DINODE_ATTR_TO_JSON(jsub, dinode, i_block_count);
       DUMP_PACK_DINODE_ATTR_TO_JSON(jsub, dinode, size);
       DUMP_PACK_DINODE_ATTR_TO_JSON(jsub, dinode, syncID);
+      jsub["ext_header"] = {
+          {"magic", dinode->ext_header.magic},
+          {"entries", dinode->ext_header.entries},
+          {"depth", dinode->ext_header.depth},
+      };
       for (int i = 0; i < NEXTENT_ARR; i++) {
         std::string attrName = "extent-" + std::to_string(i);
         jsub[attrName] = {
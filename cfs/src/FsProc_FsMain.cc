@@ -6,8 +6,11 @@
 #include <iostream>
 #include <memory>
 
+#include "BlkDevSim.h"
+#include "CachePolicy.h"
 #include "FsLibShared.h"
 #include "FsProc_Fs.h"
+#include "FsProc_Numa.h"
 #include "Log.h"
 #include "Param.h"
 #include "config4cpp/Configuration.h"
@@ -23,6 +26,7 @@ void handle_sigint(int sig);
 int fsMain(int numWorkers, int numAppProc, std::vector<int>& workerCores,
            const char* readySignalFileName, const char* exitSignalFileName,
            const char* uFSConfigFileName, const char* SPDKConfigFileName,
+           const char* simConfigFileName, const char* snapshotFileName,
            std::vector<std::vector<std::tuple<int, int, double, double>>>&
                workerAppConfigs,
            bool isSpdk = true) {
@@ -30,7 +34,12 @@ int fsMain(int numWorkers, int numAppProc, std::vector<int>& workerCores,
   std::vector<CurBlkDev*> devVec;
   // NOTE: devPtr is used as a global variable previously
   CurBlkDev* devPtr = nullptr;
-  if (isSpdk)
+  if (simConfigFileName != nullptr) {
+#ifdef USE_SPDK
+    // BlkDevSim keeps the asynchronous interface of BlkDevSpdk
+    devPtr = new BlkDevSim(DEV_SIZE / BSIZE, BSIZE, simConfigFileName);
+#endif
+  } else if (isSpdk)
     devPtr = new CurBlkDev("", DEV_SIZE / BSIZE, BSIZE, SPDKConfigFileName);
   else
     devPtr = new CurBlkDev(BLK_DEV_POSIX_FILE_NAME, DEV_SIZE / BSIZE, BSIZE,
@@ -42,6 +51,9 @@ int fsMain(int numWorkers, int numAppProc, std::vector<int>& workerCores,
   gFsProcPtr = new FsProc(numWorkers, numAppProc, readySignalFileName,
                           exitSignalFileName);
   gFsProcPtr->setConfigFname(uFSConfigFileName);
+#ifdef DO_SCHED
+  gFsProcPtr->initSnapshot(snapshotFileName, workerAppConfigs);
+#endif
 
 #ifdef FSP_ENABLE_ALLOC_READ_RA
   std::cout << "READAHEAD raNumBlocks:" << gFsProcPtr->getRaNumBlock()
@@ -72,12 +84,17 @@ void usage(char** argv) {
             << argv[0]
             << " -w NUM_WORKERS -a NUM_APPS -c CORE_LIST -l CONFIG_LIST\n"
             << "  [-r READY_FILENAME] [-e EXIT_FILENAME] "
-               "[-f UFS_CONFIG] [-d SPDK_CONFIG] [-p POLICY]\n\n";
+               "[-f UFS_CONFIG] [-d SPDK_CONFIG] [-p POLICY]\n"
+            << "  [-m CACHE_POLICY_LIST] [-M META_QUOTA_LIST] "
+               "[-s SIM_CONFIG] [-S SNAPSHOT]\n\n";
   std::cerr
       << "  -w NUM_WORKERS      number of workers to create\n"
       << "  -a NUM_APPS         number of apps that will attach\n"
       << "  -c CORE_LIST        a comma-separated list of cores to pin\n"
-      << "                      workers; length must match NUM_WORKERS\n"
+      << "                      workers; length must match NUM_WORKERS;\n"
+      << "                      or \"auto[:N]\" to pick one hyperthread per\n"
+      << "                      physical core, filling NUMA node N (0 by\n"
+      << "                      default) before the other nodes\n"
       << "  -l CONFIG_LIST      a comma-separated list, where each element\n"
       << "                      must be formatted as \"wX-aY:cZ:bW:pV\" where\n"
       << "                      X is worker id, Y is an app id, Z is the\n"
@@ -91,7 +108,26 @@ void usage(char** argv) {
       << "                      shutdown\n"
       << "  -f UFS_CONFIG       path to uFS config file (`f' for filesystem)\n"
       << "  -d SPDK_CONFIG      path to SPDK config file (`d' for device)\n"
-      << "  -p POLICY           policy flags as a comma-separated string\n";
+      << "  -p POLICY           policy flags as a comma-separated string\n"
+      << "  -m CACHE_POLICY_LIST\n"
+      << "                      a comma-separated list, where each element\n"
+      << "                      must be formatted as \"aY:P\" where Y is an\n"
+      << "                      app id and P is the replacement policy of its\n"
+      << "                      cache partitions: lru (default), 2q or arc;\n"
+      << "                      P can also be bypass, which makes the app's\n"
+      << "                      whole-block reads skip the cache\n"
+      << "  -M META_QUOTA_LIST  a comma-separated list, where each element\n"
+      << "                      must be formatted as \"aY:Q\" where Y is an\n"
+      << "                      app id and Q is the metadata (inodes and\n"
+      << "                      bitmaps, in MB) it may bring in before the\n"
+      << "                      excess is taken out of its cache share;\n"
+      << "                      unlimited by default\n"
+      << "  -s SIM_CONFIG       run on an emulated NVMe device instead of the\n"
+      << "                      SPDK one; SIM_CONFIG is its latency/bandwidth\n"
+      << "                      model (see BlkDevSim.h); needs NO_JOURNAL\n"
+      << "  -S SNAPSHOT         warm-restart snapshot file; if it exists, the\n"
+      << "                      allocations and cached blocks it records are\n"
+      << "                      restored at start; it is rewritten on exit\n";
 }
 
 void check_root() {
@@ -211,10 +247,13 @@ int main(int argc, char** argv) {
   int num_workers = 0;
   int num_apps = 0;
   std::vector<int> worker_cores;
+  int auto_cores_node = -1;  // NUMA node of `-c auto`; -1 if not used
   const char* ready_filename = DEFAULT_READY_FILENAME;
   const char* exit_filename = DEFAULT_EXIT_FILENAME;
   const char* ufs_config = DEFAULT_UFS_CONFIG;
   const char* spdk_config = DEFAULT_SPDK_CONFIG;
+  const char* sim_config = nullptr;
+  const char* snapshot_file = nullptr;
   // each element corresponds to a worker's list, which contains all apps that
   // would reach out and their associated initial cache size and bandwidth
   // each config is tuple <aid, cache_mb, bw_mb>
@@ -239,7 +278,7 @@ int main(int argc, char** argv) {
     }                                                      \
   } while (0);
 
-  while ((c = getopt(argc, argv, "w:a:c:l:r:e:f:d:p:")) != -1) {
+  while ((c = getopt(argc, argv, "w:a:c:l:r:e:f:d:p:m:M:s:S:")) != -1) {
     switch (c) {
       case 'w':
         num_workers = atoi(optarg);
@@ -251,6 +290,12 @@ int main(int argc, char** argv) {
         break;
       case 'c':
         worker_cores.clear();
+        auto_cores_node = -1;
+        if (std::string(optarg).compare(0, 4, "auto") == 0) {
+          // resolved once NUM_WORKERS is known
+          auto_cores_node = optarg[4] == ':' ? std::stoi(optarg + 5) : 0;
+          break;
+        }
         for (auto s : splitStr(std::string(optarg), ','))
           worker_cores.emplace_back(std::stoi(s));
         // this may raise an exception for invalid arguments
@@ -271,6 +316,20 @@ int main(int argc, char** argv) {
         spdk_config = optarg;
         check_file_exists(spdk_config);
         break;
+      case 's':
+        sim_config = optarg;
+        check_file_exists(sim_config);
+#if CFS_JOURNAL(ON)
+        // the journal submits its writes to the NVMe qpair directly
+        std::cerr << "The emulated device requires CFS_JOURNAL_TYPE="
+                     "NO_JOURNAL\n";
+        goto err;
+#endif
+        break;
+      case 'S':
+        // may not exist yet: the first run only saves it on exit
+        snapshot_file = optarg;
+        break;
       case 'l':
         for (auto s : splitStr(std::string(optarg), ',')) {
           int w, a, cache_mb;
@@ -299,22 +358,57 @@ int main(int argc, char** argv) {
         break;
       case 'p':
         for (auto s : splitStr(std::string(optarg), ',')) {
-          if (s == "NO_ALLOC") {
-            sched::params::policy::alloc_enabled = false;
-          } else if (s == "NO_HARVEST") {
-            sched::params::policy::harvest_enabled = false;
-          } else if (s == "NO_SYMM_PARTITION") {
-            sched::params::policy::symm_partition = false;
-          } else if (s == "NO_AVOID_TINY_WEIGHT") {
-            sched::params::policy::avoid_tiny_weight = false;
-          } else if (s == "NO_CACHE_PARTITION") {
-            sched::params::policy::cache_partition = false;
-          } else {
+          if (!sched::params::parse_policy_flag(s)) {
             std::cerr << "Unknown policy flag: " << optarg << std::endl;
             goto err;
           }
         }
         break;
+      case 'm':
+        for (auto s : splitStr(std::string(optarg), ',')) {
+          int a;
+          char name[8];
+          sched::CachePolicy cache_policy;
+          if (sscanf(s.data(), "a%d:%7s", &a, name) != 2) {
+            std::cerr << "Invalid cache policy: " << s << '\n';
+            goto err;
+          }
+          bool bypass = std::string_view(name) == "bypass";
+          if (!bypass && !sched::parse_cache_policy(name, cache_policy)) {
+            std::cerr << "Invalid cache policy: " << s << '\n';
+            goto err;
+          }
+          if (a >= num_apps) {
+            std::cerr << "App " << a << " does not exist!\n";
+            goto err;
+          }
+          if (bypass) {
+            sched::set_cache_bypass(a, true);
+            SPDLOG_INFO("App {} bypasses the cache for whole-block reads", a);
+            continue;
+          }
+          sched::set_cache_policy(a, cache_policy);
+          SPDLOG_INFO("App {} uses cache policy {}", a,
+                      sched::to_string(cache_policy));
+        }
+        break;
+      case 'M':
+        for (auto s : splitStr(std::string(optarg), ',')) {
+          int a;
+          double quota_mb;
+          if (sscanf(s.data(), "a%d:%lf", &a, &quota_mb) != 2 ||
+              quota_mb < 0) {
+            std::cerr << "Invalid metadata quota: " << s << '\n';
+            goto err;
+          }
+          if (a >= num_apps) {
+            std::cerr << "App " << a << " does not exist!\n";
+            goto err;
+          }
+          sched::set_meta_cache_quota(a, sched::params::mb_to_blocks(quota_mb));
+          SPDLOG_INFO("App {} has a metadata quota of {} MB", a, quota_mb);
+        }
+        break;
       case '?':
         std::cerr << "Unknown option `-" << char(optopt) << "'.\n";
       default:
@@ -323,12 +417,21 @@ int main(int argc, char** argv) {
   }
 #undef check_file_exists
 #undef check_file_not_exists
+  if (auto_cores_node >= 0) {
+    worker_cores = fsp_numa::assignWorkerCores(num_workers, auto_cores_node);
+    if (worker_cores.empty()) {
+      std::cerr << "Not enough physical cores for <num_workers>!\n";
+      goto err;
+    }
+  }
   SPDLOG_INFO(
       "fsMain with num_workers={}, num_apps={}, "
       "worker_cores={}, ready_filename={}, exit_filename={}, "
-      "ufs_config={}, spdk_config={}",
+      "ufs_config={}, spdk_config={}, sim_config={}, snapshot_file={}",
       num_workers, num_apps, fmt::join(worker_cores, ","), ready_filename,
-      exit_filename, ufs_config, spdk_config);
+      exit_filename, ufs_config, spdk_config,
+      sim_config ? sim_config : "<none>",
+      snapshot_file ? snapshot_file : "<none>");
   if (num_workers <= 0) {
     std::cerr << "No valid <num_workers> specified!\n";
     goto err;
@@ -356,7 +459,8 @@ int main(int argc, char** argv) {
   SCHED_LOG_NOTICE("NANOLOG IS RUNNING... ");
 
   fsMain(num_workers, num_apps, worker_cores, ready_filename, exit_filename,
-         ufs_config, spdk_config, worker_app_configs);
+         ufs_config, spdk_config, sim_config, snapshot_file,
+         worker_app_configs);
 
   sched::log::destroy();
 
@@ -235,6 +235,27 @@ void JournalManager::blockingReadJournalSuper(uint64_t jsuper_blockno) {
   // TODO verify by checking magic and the block no
 }
 
+uint64_t JournalManager::GetLastCheckpoint() const {
+  return jsuper->GetLastCheckpoint();
+}
+
+uint64_t JournalManager::BlockingReadLastCheckpoint(CurBlkDev *dev,
+                                                    uint64_t jsuper_blockno) {
+  char *buf = static_cast<char *>(dev->zmallocBuf(BSIZE, BSIZE));
+  if (buf == nullptr)
+    throw std::runtime_error("Failed to allocate journal super memory");
+  uint64_t ts = 0;
+  if (dev->blockingRead(jsuper_blockno, buf) < 0) {
+    SPDLOG_ERROR("JournalManager: failed to read jsuper at {}",
+                 jsuper_blockno);
+  } else {
+    auto dj = reinterpret_cast<const struct JSuperOnDisk *>(buf);
+    if (dj->jmagic == JSUPER_MAGIC) ts = dj->last_chkpt_ts;
+  }
+  dev->freeBuf(buf);
+  return ts;
+}
+
 void JournalManager::submitJournalEntry(JournalEntry *je, JournalCallbackFn cb,
                                         void *cb_arg) {
   SetJournalPerfTS(cur_metric.ts_queued_start);
@@ -395,8 +416,11 @@ void JournalManager::processJournalEntry(JournalEntry *je) {
         // FIXME: keep track of how many journal entries completed before this
         // flush was issued so that we don't have to issue flush for every
         // single journal entry, and can batch for some that are in flight.
-        rc = spdk_nvme_ns_cmd_flush(dev_ns, dev_qpair, writeComplete, je);
-        if (rc != 0) {
+        // The data blocks of the entry may be on any device of the stripe,
+        // so every device this worker has written to is flushed, not only
+        // the one of the journal.
+        rc = dev->flushWrittenDevs(ioComplete, je);
+        if (rc < 0) {
           SPDLOG_ERROR(
               "JournalManager: failed to submit flush request, errno={}", rc);
           throw std::runtime_error("Failed to submit flush request");
@@ -472,10 +496,15 @@ end:
 // called whenever a journal write completes
 void JournalManager::writeComplete(void *arg,
                                    const struct spdk_nvme_cpl *completion) {
+  ioComplete(arg, !spdk_nvme_cpl_is_error(completion));
+}
+
+// called whenever a journal write or flush completes
+void JournalManager::ioComplete(void *arg, bool ok) {
   JournalEntry *je = (JournalEntry *)arg;
   JournalManager *mgr = je->getManager();
 
-  if (spdk_nvme_cpl_is_error(completion)) {
+  if (!ok) {
     // TODO add more information about which state this failure occurred...
     je->state = JournalEntryState::FAILURE;
     goto end;
@@ -613,8 +642,7 @@ void JournalManager::onCheckpointSuccess(CheckpointInput *src, FileMng *mgr) {
   checkpointInProgress = false;
 
 #if CFS_JOURNAL(LOCAL_JOURNAL)
-  mgr->fsImpl_->immutableBlockBitmaps_.swap(
-      bmapsToLockAfterCheckpointCompletes);
+  mgr->fsImpl_->resetLockedBlockBitmaps(bmapsToLockAfterCheckpointCompletes);
   bmapsToLockAfterCheckpointCompletes.clear();
 #endif
 }
@@ -63,6 +63,13 @@ InodeLogEntry::InodeLogEntry(uint8_t *buf, size_t buf_size) {
   size = *((uint64_t *)ptr);
   ptr += 8;
 
+  if (optfield_bitarr & ext_root_IDX) {
+    memcpy(&ext_header, ptr, sizeof(ext_header));
+    ptr += sizeof(ext_header);
+    memcpy(ext_root, ptr, sizeof(ext_root));
+    ptr += sizeof(ext_root);
+  }
+
   // populate the extent maps
   uint8_t *ext_iter = ptr;
   size_t n_ext_add = *((uint64_t *)ext_iter);
@@ -141,6 +148,13 @@ size_t InodeLogEntry::serialize(uint8_t *buf) {
   *((uint64_t *)ptr) = size;
   ptr += 8;
 
+  if (optfield_bitarr & ext_root_IDX) {
+    memcpy(ptr, &ext_header, sizeof(ext_header));
+    ptr += sizeof(ext_header);
+    memcpy(ptr, ext_root, sizeof(ext_root));
+    ptr += sizeof(ext_root);
+  }
+
   size_t n_ext_add = ext_add.size();
   uint8_t *ext_iter = ptr;
 
@@ -219,6 +233,18 @@ std::string InodeLogEntry::as_json_str() {
     s << cjkey(nlink) << (uint32_t)nlink;
   }
 
+  if (optfield_bitarr & ext_root_IDX) {
+    s << cjkey(ext_root) << "{" << jkey(entries) << ext_header.entries
+      << cjkey(depth) << ext_header.depth << cjkey(extents) << "[";
+    for (int i = 0; i < ext_header.entries; i++) {
+      s << (i > 0 ? "," : "") << "{" << jkey(i_block_offset)
+        << ext_root[i].i_block_offset << cjkey(num_blocks)
+        << ext_root[i].num_blocks << cjkey(block_no) << ext_root[i].block_no
+        << "}";
+    }
+    s << "]}";
+  }
+
   using ExtMap = std::unordered_map<uint64_t, struct ExtMapVal>;
   auto serialize_map = [&s](const ExtMap &m) {
     s << "[";
@@ -310,16 +336,24 @@ void InodeLogEntry::applyChangesTo(
   if (flags & block_count_IDX) dst->i_block_count = block_count;
   if (flags & dentry_count_IDX) dst->i_dentry_count = dentry_count;
   if (flags & nlink_IDX) dst->nlink = nlink;
+  if (flags & ext_root_IDX) {
+    dst->ext_header = ext_header;
+    memcpy(dst->ext_array, ext_root, sizeof(ext_root));
+  }
+  // the root logged above has all the changes of a tree's extents
+  bool ext_tree = cfs_extent_tree_enabled(dst);
 
   std::unordered_map<uint64_t, uint32_t> block_to_ts;
   uint32_t inside_extent_idx, extent_max_block_num;
   for (const auto &[block_no, val] : ext_add) {
     block_to_ts[block_no] = val.seq_no;
-    int extents_idx = getCurrentExtentArrIdx(
-        val.i_block_offset, inside_extent_idx, extent_max_block_num);
-    dst->ext_array[extents_idx].num_blocks = val.num_blocks;
-    dst->ext_array[extents_idx].block_no = block_no - get_data_start_block();
-    dst->ext_array[extents_idx].i_block_offset = val.i_block_offset;
+    if (!ext_tree) {
+      int extents_idx = getCurrentExtentArrIdx(
+          val.i_block_offset, inside_extent_idx, extent_max_block_num);
+      dst->ext_array[extents_idx].num_blocks = val.num_blocks;
+      dst->ext_array[extents_idx].block_no = block_no - get_data_start_block();
+      dst->ext_array[extents_idx].i_block_offset = val.i_block_offset;
+    }
     // we need to count this towards to blocks added/deleted only if bmap is
     // modified so that the caller can update stable maps.
     if (val.bmap_modified) blocks_add_or_del[block_no] = true;
@@ -330,6 +364,10 @@ void InodeLogEntry::applyChangesTo(
     // There may be cases where we add and then delete or vice versa. If this
     // entry timestamp is greater than what we saw previously, apply it.
     if ((search == block_to_ts.end()) || (val.seq_no > search->second)) {
+      // we need to insert into blocks added/deleted only if bmap is modified so
+      // that the caller can update stable maps.
+      if (val.bmap_modified) blocks_add_or_del[block_no] = false;
+      if (ext_tree) continue;
       int extents_idx = getCurrentExtentArrIdx(
           val.i_block_offset, inside_extent_idx, extent_max_block_num);
 
@@ -340,9 +378,6 @@ void InodeLogEntry::applyChangesTo(
       dst->ext_array[extents_idx].num_blocks = 0;
       dst->ext_array[extents_idx].block_no = block_no - get_data_start_block();
       dst->ext_array[extents_idx].i_block_offset = 0;
-      // we need to insert into blocks added/deleted only if bmap is modified so
-      // that the caller can update stable maps.
-      if (val.bmap_modified) blocks_add_or_del[block_no] = false;
     }
   }
 }
@@ -102,13 +102,15 @@ int FsProcWorkerLeaseMng::tryInvalidateLease(
     FsProcWorkerInodeLeaseCtx* ctxPtr) {
   switch (ctxPtr->type) {
     case FsProcLeaseType::READ_SHARE: {
-      auto it = &(readLeaseRecordsMap_.find(ctxPtr->ino)->second);
-      it->erase(ctxPtr->pid);
+      auto it = readLeaseRecordsMap_.find(ctxPtr->ino);
+      it->second.erase(ctxPtr->pid);
+      // otherwise, the ino is still considered leased
+      if (it->second.empty()) readLeaseRecordsMap_.erase(it);
       delete ctxPtr;
       break;
     }
     case FsProcLeaseType::WRITE_EXCLUSIVE: {
-      writeLeaseRecordMap_.erase(ctxPtr->pid);
+      writeLeaseRecordMap_.erase(ctxPtr->ino);
       delete ctxPtr;
       break;
     }
@@ -116,4 +118,13 @@ int FsProcWorkerLeaseMng::tryInvalidateLease(
       SPDLOG_ERROR("Lease Type Not Supported");
   }
   return 0;
-}
\ No newline at end of file
+}
+int FsProcWorkerLeaseMng::revokeReadLeases(cfs_ino_t ino) {
+  auto it = readLeaseRecordsMap_.find(ino);
+  if (it == readLeaseRecordsMap_.end()) return 0;
+  int num = it->second.size();
+  for (auto &kv : it->second) delete kv.second;
+  readLeaseRecordsMap_.erase(it);
+  SPDLOG_DEBUG("revoke {} read leases on ino:{}", num, ino);
+  return num;
+}
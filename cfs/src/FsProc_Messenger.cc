@@ -1,71 +1,111 @@
-#include <string.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
+#include <string>
 
 #include "FsProc_Messenger.h"
 
-FsProcMsgRing::FsProcMsgRing(size_t capacity) : capacity(capacity) {
-  assert((capacity > 4) && ((capacity & (capacity - 1)) == 0));
+thread_local FsProcMessenger::SendBatch *FsProcMessenger::tBatch = nullptr;
 
-  producer = (struct shmipc_mgr *)malloc(sizeof(struct shmipc_mgr));
-  consumer = (struct shmipc_mgr *)malloc(sizeof(struct shmipc_mgr));
-
-  if (consumer == NULL || producer == NULL)
-    throw std::runtime_error("failed to malloc shmipc_mgr instances");
-
-  initShmipcMgr(consumer);
-  initShmipcMgr(producer);
-
-  struct shmipc_msg *ring = NULL;
-  ring = (struct shmipc_msg *)malloc(sizeof(*ring) * capacity);
-  if (ring == NULL) throw std::runtime_error("failed to malloc ring");
-
-  memset(ring, 0, sizeof(*ring) * capacity);
-  consumer->ring = ring;
-  producer->ring = ring;
+FsProcMsgRing::FsProcMsgRing(const char *name, size_t capacity,
+                             bool single_producer)
+    : ring(name, 2 * capacity, single_producer) {
+  assert(capacity >= kMaxBulk);
 }
 
-FsProcMsgRing::~FsProcMsgRing() {
-  struct shmipc_msg *ring = NULL;
-  if (consumer != NULL) {
-    if (consumer->ring != NULL) ring = consumer->ring;
-    free(consumer);
-  }
-  if (producer != NULL) {
-    // both producer and consumer point to same ring, okay to overwrite
-    if (producer->ring != NULL) ring = producer->ring;
-    free(producer);
+bool FsProcMsgRing::put_messages(const FsProcMessage *msgs, size_t n) {
+  assert(n <= kMaxBulk);
+  void *entries[2 * kMaxBulk];
+  for (size_t i = 0; i < n; i++) {
+    entries[2 * i] = reinterpret_cast<void *>(uintptr_t(msgs[i].type));
+    entries[2 * i + 1] = msgs[i].ctx;
   }
-  if (ring != NULL) free(ring);
+  return ring.put_bulk(entries, 2 * n);
 }
 
-void FsProcMsgRing::initShmipcMgr(struct shmipc_mgr *mgr) {
-  mgr->qp = NULL;
-  mgr->ring = NULL;
-  mgr->xreq = NULL;
-  mgr->data = NULL;
-  mgr->capacity = capacity;
-  mgr->mask = capacity - 1;
-  mgr->next = 0;
+size_t FsProcMsgRing::get_messages(FsProcMessage *msgs, size_t max) {
+  void *entries[2 * kMaxBulk];
+  size_t n = 0;
+  while (n < max) {
+    size_t cur = std::min(max - n, kMaxBulk);
+    // the entries are put in pairs, so a burst always gets whole messages
+    unsigned num_entries = ring.get_burst(entries, 2 * cur);
+    assert(num_entries % 2 == 0);
+    for (unsigned i = 0; i < num_entries; i += 2) {
+      msgs[n].type = uint8_t(reinterpret_cast<uintptr_t>(entries[i]));
+      msgs[n].ctx = entries[i + 1];
+      n++;
+    }
+    if (num_entries < 2 * cur) break;
+  }
+  return n;
 }
 
 FsProcMessenger::FsProcMessenger(size_t n_workers, size_t ring_size)
     : n_workers(n_workers), ring_size(ring_size) {
-  for (size_t i = 0; i < n_workers; i++) {
-    rings[i] = new FsProcMsgRing(ring_size);
-  }
-  for (size_t i = 0; i < kNumNonWorkerThreads; i++) {
-    rings[kLmWid + i] = new FsProcMsgRing(ring_size);
+  assert(n_workers <= NMAX_FSP_WORKER);
+  for (int dst = 0; dst < kActualRingLen; dst++) {
+    if (size_t(dst) >= n_workers && dst < kLmWid) {
+      inboxes[dst] = nullptr;
+      continue;
+    }
+    auto inbox = new Inbox();
+    for (size_t src = 0; src <= n_workers; src++) {
+      bool is_worker = src < n_workers;
+      std::string name = "msg_" + std::to_string(dst) + "_" +
+                         (is_worker ? std::to_string(src) : "x");
+      inbox->rings.push_back(
+          new FsProcMsgRing(name.c_str(), ring_size, is_worker));
+    }
+    inboxes[dst] = inbox;
   }
-  for (size_t i = n_workers; i < NMAX_FSP_WORKER; i++) rings[i] = nullptr;
 }
 
 FsProcMessenger::~FsProcMessenger() {
-  for (size_t i = 0; i < n_workers; i++) {
-    if (rings[i] != nullptr) {
-      delete rings[i];
-      rings[i] = nullptr;
-    }
+  for (int dst = 0; dst < kActualRingLen; dst++) {
+    if (inboxes[dst] == nullptr) continue;
+    for (auto ring : inboxes[dst]->rings) delete ring;
+    delete inboxes[dst];
+    inboxes[dst] = nullptr;
+  }
+}
+
+bool FsProcMessenger::send_messages_from(int src, int wid,
+                                         const FsProcMessage *msgs, size_t n) {
+  Inbox *inbox = inboxes[wid];
+  FsProcMsgRing *ring = inbox->rings[senderIdx(src)];
+  while (n > 0) {
+    size_t cur = std::min(n, FsProcMsgRing::kMaxBulk);
+    // NOTE: spins if the receiver is that far behind; messages between workers
+    // are checked on every iteration of the receiver, so it should be short.
+    while (!ring->put_messages(msgs, cur)) util_pause();
+    // seq_cst (a locked add on x86 either way), so that it is ordered before
+    // the load of `sleeping` below
+    inbox->doorbell.fetch_add(1);
+    msgs += cur;
+    n -= cur;
+  }
+  if (inbox->sleeping.load() && wakeup_) wakeup_(wid);
+  return true;
+}
+
+FsProcMessenger::SendBatch::SendBatch(FsProcMessenger *messenger)
+    : messenger_(messenger), outer_(tBatch) {
+  tBatch = this;
+}
+
+FsProcMessenger::SendBatch::~SendBatch() {
+  Flush();
+  tBatch = outer_;
+}
+
+void FsProcMessenger::SendBatch::Flush() {
+  int src = FsProcTLS::GetWid();
+  for (int wid = 0; wid < kActualRingLen; wid++) {
+    auto &msgs = staged_[wid];
+    if (msgs.empty()) continue;
+    messenger_->send_messages_from(src, wid, msgs.data(), msgs.size());
+    msgs.clear();
   }
 }
@@ -0,0 +1,178 @@
+#include "FsProc_Numa.h"
+
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "spdlog/spdlog.h"
+
+namespace fsp_numa {
+
+namespace {
+
+constexpr const char *kNodeDir = "/sys/devices/system/node";
+constexpr const char *kCpuDir = "/sys/devices/system/cpu";
+// number of bits in the node masks passed to the kernel
+constexpr int kMaxNodes = 1024;
+constexpr int kMaskBits = 8 * sizeof(unsigned long);
+
+bool readLine(const std::string &path, std::string &line) {
+  std::ifstream in(path);
+  return bool(std::getline(in, line));
+}
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+std::vector<int> parseCpuList(const std::string &s) {
+  std::vector<int> cpus;
+  std::stringstream ss(s);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    int lo, hi;
+    int n = sscanf(range.c_str(), "%d-%d", &lo, &hi);
+    if (n < 1) continue;
+    if (n == 1) hi = lo;
+    for (int cpu = lo; cpu <= hi; cpu++) cpus.emplace_back(cpu);
+  }
+  return cpus;
+}
+
+// a cpu is the representative of its physical core if it is the first of its
+// hyperthread siblings
+bool isFirstSibling(int cpu) {
+  std::string line;
+  if (!readLine(std::string(kCpuDir) + "/cpu" + std::to_string(cpu) +
+                    "/topology/thread_siblings_list",
+                line))
+    return true;
+  auto siblings = parseCpuList(line);
+  return siblings.empty() ||
+         *std::min_element(siblings.begin(), siblings.end()) == cpu;
+}
+
+struct Topology {
+  std::vector<int> cpuNode;                 // cpu -> node; -1 if none
+  std::vector<std::vector<int>> nodeCores;  // node -> physical cores
+
+  Topology() {
+    std::vector<std::vector<int>> nodeCpus;
+    std::string line;
+    while (readLine(std::string(kNodeDir) + "/node" +
+                        std::to_string(nodeCpus.size()) + "/cpulist",
+                    line))
+      nodeCpus.emplace_back(parseCpuList(line));
+    if (nodeCpus.empty()) {
+      // no NUMA support in the kernel: one node with all the online cpus
+      nodeCpus.emplace_back();
+      long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+      for (int cpu = 0; cpu < numCpus; cpu++) nodeCpus[0].emplace_back(cpu);
+    }
+    for (size_t node = 0; node < nodeCpus.size(); node++) {
+      auto &cores = nodeCores.emplace_back();
+      for (int cpu : nodeCpus[node]) {
+        if (cpu >= int(cpuNode.size())) cpuNode.resize(cpu + 1, -1);
+        cpuNode[cpu] = node;
+        if (isFirstSibling(cpu)) cores.emplace_back(cpu);
+      }
+    }
+  }
+};
+
+const Topology &topology() {
+  static Topology topo;
+  return topo;
+}
+
+uintptr_t pageSize() {
+  static uintptr_t size = sysconf(_SC_PAGESIZE);
+  return size;
+}
+
+}  // namespace
+
+int numNodes() { return topology().nodeCores.size(); }
+
+int nodeOfCpu(int cpu) {
+  const auto &topo = topology();
+  if (topo.nodeCores.size() <= 1 || cpu < 0 ||
+      cpu >= int(topo.cpuNode.size()))
+    return -1;
+  return topo.cpuNode[cpu];
+}
+
+std::vector<int> coresOfNode(int node) {
+  const auto &topo = topology();
+  if (node < 0 || node >= int(topo.nodeCores.size())) return {};
+  return topo.nodeCores[node];
+}
+
+int nodeOfAddr(const void *addr) {
+  if (numNodes() <= 1) return -1;
+  auto page = reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(addr) &
+                                       ~(pageSize() - 1));
+  // get_mempolicy() would fault an untouched page in on this node
+  unsigned char resident = 0;
+  if (mincore(page, pageSize(), &resident) != 0 || !(resident & 1)) return -1;
+  int node = -1;
+  if (syscall(SYS_get_mempolicy, &node, nullptr, 0, page,
+              MPOL_F_NODE | MPOL_F_ADDR) != 0)
+    return -1;
+  return node;
+}
+
+bool bindToNode(void *addr, size_t len, int node) {
+  if (node < 0) return true;
+  if (node >= kMaxNodes) return false;
+  uintptr_t start =
+      (reinterpret_cast<uintptr_t>(addr) + pageSize() - 1) & ~(pageSize() - 1);
+  uintptr_t end =
+      (reinterpret_cast<uintptr_t>(addr) + len) & ~(pageSize() - 1);
+  if (start >= end) return true;
+  unsigned long mask[kMaxNodes / kMaskBits] = {};
+  mask[node / kMaskBits] |= 1UL << (node % kMaskBits);
+  // preferred instead of bound: when the node runs out of memory, the pages
+  // come from another node rather than failing the allocation
+  if (syscall(SYS_mbind, start, end - start, MPOL_PREFERRED, mask, kMaxNodes,
+              MPOL_MF_MOVE) != 0) {
+    SPDLOG_WARN("mbind({:#x}, {}) to node {} failed: {}", start, end - start,
+                node, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+std::vector<int> assignWorkerCores(int num, int node) {
+  int nodes = numNodes();
+  if (node < 0 || node >= nodes) node = 0;
+  std::vector<int> cores = coresOfNode(node);
+  for (int other = 0; other < nodes; other++) {
+    if (other == node) continue;
+    auto otherCores = coresOfNode(other);
+    cores.insert(cores.end(), otherCores.begin(), otherCores.end());
+  }
+  if (num < 0 || int(cores.size()) < num) return {};
+  cores.resize(num);
+  return cores;
+}
+
+bool readNodeStat(int node, NodeStat &stat) {
+  std::ifstream in(std::string(kNodeDir) + "/node" + std::to_string(node) +
+                   "/numastat");
+  if (!in) return false;
+  stat = {};
+  std::string name;
+  uint64_t value;
+  while (in >> name >> value) {
+    if (name == "local_node") stat.localNode = value;
+    if (name == "other_node") stat.otherNode = value;
+  }
+  return true;
+}
+
+}  // namespace fsp_numa
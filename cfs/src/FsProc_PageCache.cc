@@ -4,8 +4,13 @@
 #include <spdlog/spdlog.h>
 
 #include <cstdio>
+#include <unordered_set>
 
-PageCacheManager::PageCacheManager() {
+#ifdef DO_SCHED
+#include "Tenant.h"
+#endif
+
+PageCacheManager::PageCacheManager() : pageOwners(N_PAGE_CACHE_PAGE, nullptr) {
   initCacheShm();
   layout = reinterpret_cast<struct PageCacheLayout *>(shmPtr);
   struct PageDescriptor *pd;
@@ -14,6 +19,7 @@ PageCacheManager::PageCacheManager() {
     pd->gPageIdx = i;
     pd->ino = 0;
     pd->pageStatus = (PAGE_CACHE_PAGE_STATUS_IDLE);
+    pd->version.store(0, std::memory_order_relaxed);
     freePages.push(i);
   }
 }
@@ -22,23 +28,32 @@ PageCacheManager::~PageCacheManager() { destroyCacheShm(); }
 
 int PageCacheManager::allocPageToIno(
     int numPg, std::vector<std::pair<PageDescriptor *, void *>> &pages,
-    cfs_ino_t ino) {
+    cfs_ino_t ino, sched::Tenant *owner) {
+  assert(numPg > 0);
+  assert(pages.size() == 0);
   if (freePages.unsafe_size() < kNoPageForCache + numPg) {
-    SPDLOG_ERROR("Cannot allocate page");
+    SPDLOG_DEBUG("Cannot allocate page: cache is full");
     return -1;
   }
-  assert(numPg > 0);
-  assert(pages.size() == 0);
+#ifdef DO_SCHED
+  if (owner != nullptr && !owner->charge_client_cache(numPg)) {
+    SPDLOG_DEBUG("Cannot allocate page: tenant out of its cache share");
+    return -1;
+  }
+#endif
   int numAllocated = 0;
   page_idx_t curPageIdx = 0;
   while (true) {
     bool success = freePages.try_pop(curPageIdx);
     if (success) {
       numAllocated++;
-      pages.push_back({fromPageIdxToPd(layout, curPageIdx),
-                       fromPageIdxToPagePtr(layout, curPageIdx)});
-      pages.back().first->ino = ino;
-      pages.back().first->pageStatus = PAGE_CACHE_PAGE_STATUS_USED;
+      auto pd = fromPageIdxToPd(layout, curPageIdx);
+      pages.push_back({pd, fromPageIdxToPagePtr(layout, curPageIdx)});
+      bumpPdVersion(pd);
+      pd->ino = ino;
+      pd->validSize = 0;
+      pd->pageStatus = PAGE_CACHE_PAGE_STATUS_USED;
+      pageOwners[curPageIdx] = owner;
     }
     if (numAllocated == numPg) break;
   }
@@ -47,10 +62,27 @@ int PageCacheManager::allocPageToIno(
 
 void PageCacheManager::freePage(std::vector<page_idx_t> &pages) {
   for (auto pgid : pages) {
-    freePages.push(pgid);
     auto pd = fromPageIdxToPd(layout, pgid);
+    // invalidate before the page can be reused
+    bumpPdVersion(pd);
     pd->ino = 0;
+    pd->validSize = 0;
     pd->pageStatus = PAGE_CACHE_PAGE_STATUS_IDLE;
+#ifdef DO_SCHED
+    if (pageOwners[pgid] != nullptr) pageOwners[pgid]->uncharge_client_cache(1);
+#endif
+    pageOwners[pgid] = nullptr;
+    freePages.push(pgid);
+  }
+}
+
+void PageCacheManager::getInodesChargedTo(const sched::Tenant *owner,
+                                          std::vector<cfs_ino_t> &inos) const {
+  std::unordered_set<cfs_ino_t> seen;
+  for (uint32_t i = 0; i < N_PAGE_CACHE_PAGE; i++) {
+    if (pageOwners[i] != owner) continue;
+    cfs_ino_t ino = layout->pds[i].ino;
+    if (seen.insert(ino).second) inos.push_back(ino);
   }
 }
 
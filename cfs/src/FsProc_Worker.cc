@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <cassert>
 #include <functional>
 #include <iostream>
+#include <iterator>
 #include <list>
 #include <numeric>
 #include <random>
@@ -311,11 +313,9 @@ void FsProcWorker::schedMigrateInode(
           app->getAid());
       continue;
     }
-    if (NumInProgressRequests(ino) > 0) {
-      SCHED_LOG_NOTICE(
-          "Cannot export inode %d for App-%d, because it has pending "
-          "requests",
-          ino, app->getAid());
+    if (quiescing_inodes_.contains(ino)) {
+      SCHED_LOG_NOTICE("Inode %d is already moving, continue to the next one",
+                       ino);
       continue;
     }
     if (inode->isDeleted) {
@@ -333,11 +333,17 @@ void FsProcWorker::schedMigrateInode(
   }
   std::shuffle(migratable_inodes.begin(), migratable_inodes.end(),
                std::default_random_engine(std::random_device()()));
+  // prefer the idle inodes, which can be exported right away; the others are
+  // quiesced: the requests in progress on them finish, new ones are held
+  std::stable_partition(
+      migratable_inodes.begin(), migratable_inodes.end(),
+      [this](cfs_ino_t ino) { return NumInProgressRequests(ino) == 0; });
 
-  auto pid = app->getPid();
   auto aid = app->getAid();
   auto inode_it = migratable_inodes.begin();
 
+  // the reassignment messages of all the inodes go out in one put per worker
+  FsProcMessenger::SendBatch send_batch(messenger);
   for (const auto &[dst_wid, num_inodes] : inode_move) {
     if (num_inodes == 0) continue;
     SCHED_LOG_NOTICE("App-%d: Moving %d inodes from Worker-%d to Worker-%d",
@@ -345,39 +351,19 @@ void FsProcWorker::schedMigrateInode(
     int cnt = 0;
     while (inode_it != migratable_inodes.end()) {
       cfs_ino_t ino = *inode_it;
-      SCHED_LOG_DEBUG(
-          "App-%d: Moving inode %u from Worker-%d to "
-          "Worker-%d",
-          aid, ino, wid, dst_wid);
-
-      auto old_owner_callback =
-          [](FileMng *mng, const FileMng::ReassignmentOp::Ctx *reassign_ctx,
-             void *myctx) { SPDLOG_DEBUG("ProcessPendingNewed old_owner"); };
-      struct NewOwnerCtx {
-        pid_t pid;
-        std::vector<int> tids;
-        cfs_ino_t ino;
-      };
-      auto new_ctx = new NewOwnerCtx{
-          .pid = pid,
-          .tids = app->GetTidsForIno(ino),
-          .ino = ino,
-      };
-      auto new_owner_callback =
-          [](FileMng *mng, const FileMng::ReassignmentOp::Ctx *reassign_ctx,
-             void *myctx) {
-            auto newctx = reinterpret_cast<NewOwnerCtx *>(myctx);
-            auto app = mng->fsWorker_->GetApp(newctx->pid);
-            for (auto tid : newctx->tids) {
-              app->AccessIno(tid, newctx->ino);
-            }
-            delete newctx;
-          };
-      FileMng::ReassignmentOp::OwnerExportThroughPrimary(
-          fileManager, ino, dst_wid, old_owner_callback, nullptr,
-          new_owner_callback, new_ctx);
+      if (NumInProgressRequests(ino) == 0) {
+        SCHED_LOG_DEBUG(
+            "App-%d: Moving inode %u from Worker-%d to "
+            "Worker-%d",
+            aid, ino, wid, dst_wid);
+        schedExportInode(app, ino, dst_wid, {});
+      } else {
+        SCHED_LOG_DEBUG(
+            "App-%d: Quiescing inode %u to move from Worker-%d to Worker-%d",
+            aid, ino, wid, dst_wid);
+        quiescing_inodes_.quiesce(ino, app, dst_wid);
+      }
 
-      app->EraseIno(ino);
       ++cnt;
       inode_it++;
       if (cnt >= num_inodes) break;
@@ -397,6 +383,104 @@ void FsProcWorker::schedMigrateInode(
   }
 }
 
+int FsProcWorker::schedExportQuiescedInodes() {
+  if (quiescing_inodes_.empty()) return 0;
+  using InodeState = decltype(quiescing_inodes_)::InodeState;
+  FsProcMessenger::SendBatch send_batch(messenger);
+  auto state_of = [this](cfs_ino_t ino) {
+    InMemInode *inode = fileManager->GetInMemInode(ino);
+    if (inode == nullptr || inode->isDeleted) return InodeState::kGone;
+    // its dirty blocks cannot be exported while being written back
+    if (inode->num_fs_req_in_prog > 0 || inode->isLocked ||
+        fileManager->fsImpl_->checkIfInodeWriteBackInflight(ino))
+      return InodeState::kBusy;
+    return InodeState::kIdle;
+  };
+  auto export_inode = [this](cfs_ino_t ino, AppProc *app, int dst_wid,
+                             std::vector<FsReq *> &&held_reqs) {
+    SCHED_LOG_DEBUG(
+        "App-%d: Moving quiesced inode %u from Worker-%d to Worker-%d "
+        "(%zu requests held)",
+        app->getAid(), ino, wid, dst_wid, held_reqs.size());
+    schedExportInode(app, ino, dst_wid, std::move(held_reqs));
+  };
+  // gone while quiescing (e.g., unlinked); nothing to move, serve the held
+  // requests here
+  auto release = [this](FsReq *req) {
+#ifdef DO_SCHED
+    req->getApp()->getTenant().record_req_released();
+#endif
+    processReqOnRecv(req);
+  };
+  return quiescing_inodes_.exportIdle(state_of, export_inode, release);
+}
+
+bool FsProcWorker::holdReqIfInodeQuiescing(FsReq *req, InMemInode *inode) {
+  if (!quiescing_inodes_.hold(inode->i_no, req)) return false;
+  // not on cpu until it is redirected
+  req->stopOnCpuTimer();
+#ifdef DO_SCHED
+  req->getApp()->getTenant().record_req_held();
+#endif
+  return true;
+}
+
+void FsProcWorker::schedExportInode(AppProc *app, cfs_ino_t ino, int dst_wid,
+                                    std::vector<FsReq *> &&held_reqs) {
+  struct OldOwnerCtx {
+    int dst_wid;
+    std::vector<FsReq *> held_reqs;
+  };
+  auto old_ctx = held_reqs.empty()
+                     ? nullptr
+                     : new OldOwnerCtx{.dst_wid = dst_wid,
+                                       .held_reqs = std::move(held_reqs)};
+  auto old_owner_callback =
+      [](FileMng *mng, const FileMng::ReassignmentOp::Ctx *reassign_ctx,
+         void *myctx) {
+        SPDLOG_DEBUG("schedExportInode old_owner");
+        if (myctx == nullptr) return;
+        // the new owner has the inode now; send the held requests there
+        auto oldctx = reinterpret_cast<OldOwnerCtx *>(myctx);
+        for (auto req : oldctx->held_reqs) {
+#ifdef DO_SCHED
+          req->getApp()->getTenant().record_req_released();
+#endif
+          req->startOnCpuTimer();
+          req->setState(FsReqState::OP_OWNERSHIP_REDIRECT);
+          req->setWid(oldctx->dst_wid);
+          req->setError(FS_REQ_ERROR_INODE_REDIRECT);
+          mng->fsWorker_->submitFsReqCompletion(req);
+        }
+        delete oldctx;
+      };
+  struct NewOwnerCtx {
+    pid_t pid;
+    std::vector<int> tids;
+    cfs_ino_t ino;
+  };
+  auto new_ctx = new NewOwnerCtx{
+      .pid = app->getPid(),
+      .tids = app->GetTidsForIno(ino),
+      .ino = ino,
+  };
+  auto new_owner_callback =
+      [](FileMng *mng, const FileMng::ReassignmentOp::Ctx *reassign_ctx,
+         void *myctx) {
+        auto newctx = reinterpret_cast<NewOwnerCtx *>(myctx);
+        auto app = mng->fsWorker_->GetApp(newctx->pid);
+        for (auto tid : newctx->tids) {
+          app->AccessIno(tid, newctx->ino);
+        }
+        delete newctx;
+      };
+  FileMng::ReassignmentOp::OwnerExportThroughPrimary(
+      fileManager, ino, dst_wid, old_owner_callback, old_ctx,
+      new_owner_callback, new_ctx);
+
+  app->EraseIno(ino);
+}
+
 void FsProcWorker::ProcessSchedNewResrcAlloc(sched::AllocDecision *decision) {
 #ifdef DO_SCHED
   int aid = decision->aid;
@@ -405,7 +489,9 @@ void FsProcWorker::ProcessSchedNewResrcAlloc(sched::AllocDecision *decision) {
   auto &t = app->getTenant();
   SCHED_LOG_NOTICE("Worker-%d: Update resources for App-%d", getWid(),
                    decision->aid);
-  t.set_resrc(decision->resrc);
+  t.set_resrc(decision->resrc, decision->dev_shares);
+  // before the server buffer is resized, so that it gets the reclaimed pages
+  fileManager->reclaimClientCache(t);
   if (sched::params::policy::cache_partition)
     fileManager->fsImpl_->adjustCacheSize(sched::Tag{.tenant = &t});
   int num_inodes_to_migrate = 0;
@@ -416,12 +502,7 @@ void FsProcWorker::ProcessSchedNewResrcAlloc(sched::AllocDecision *decision) {
     SPDLOG_WARN(
         "FsProcWorker::ProcessSchedNewResrcAlloc: inode migration is "
         "deprecated");
-    t.set_drain_for_migration(std::move(decision->inode_move));
-    // if we can do it now, do it.
-    if (t.should_migrate()) {
-      schedMigrateInode(app, t.get_pending_inode_move());
-      t.unset_drain_for_migration();
-    }
+    schedMigrateInode(app, decision->inode_move);
   }
 #endif
 }
@@ -496,6 +577,14 @@ void FsProcWorker::InitApps() {
     appMap.emplace(app->getPid(), app);
     appList.emplace_back(app);
   }
+#ifdef DO_SCHED
+  // restore the allocations before the buffer is partitioned by them
+  if (auto snapshot = gFsProcPtr->getWarmSnapshot()) {
+    for (auto app : appList)
+      app->getTenant().set_resrc(
+          snapshot->tenants[getWid()][app->getAid()].resrc);
+  }
+#endif
 }
 
 void FsProcWorker::recvLoadRebalanceShare(
@@ -601,6 +690,11 @@ int FsProcWorker::submitDevAsyncReadReqCompletion(struct BdevIoContext *ctx) {
   primary_fs_req->get_tenant()->add_latency(block_io_latency);
 #endif
 
+  // a direct read (see FsImpl::submitDirectRead) has no buffer item; its data
+  // is already in the app's buffer
+  auto item = block_req->getBufferItem();
+  if (item == nullptr) primary_fs_req->setBlockIoDone(block_req->getBufPtr());
+
   primary_fs_req->dec_pending();
   if (primary_fs_req->numTotalPendingIoReq() == 0)
     submitReadyReq(primary_fs_req);
@@ -612,10 +706,11 @@ int FsProcWorker::submitDevAsyncReadReqCompletion(struct BdevIoContext *ctx) {
   }
 
   // set buffer item as in-memory (no need to use multiple maps for this...)
-  auto item = block_req->getBufferItem();
-  item->set_IO_done();
-  auto pool = item->getPool();
-  if (pool) pool->releaseBlock(item);
+  if (item != nullptr) {
+    item->set_IO_done();
+    auto pool = item->getPool();
+    if (pool) pool->releaseBlock(item);
+  }
   block_req_pool.free(block_req);
 
   dev->releaseBdevIoContext(ctx);
@@ -632,9 +727,11 @@ int FsProcWorker::submitBlkWriteReqCompletion(struct BdevIoContext *ctx) {
     // flushReq. It is possible that a blockNo exists both in
     // *blockInflightWriteReqs* and *blockFlushReq*.
     if (flushReq->checkValidFlushReq(ctx->blockNo, ctx->blockNoSeqNo)) {
-      flushReq->fsReq->startOnCpuTimer();
+      // background flush has no FsReq to charge the cpu to
+      FsReq *fsReq = flushReq->fsReq;
+      if (fsReq != nullptr) fsReq->startOnCpuTimer();
       submitBlkFlushWriteReqCompletion(ctx->blockNo, flushReq);
-      flushReq->fsReq->stopOnCpuTimer();
+      if (fsReq != nullptr) fsReq->stopOnCpuTimer();
     }
   } else {
     uint64_t blockNo = ctx->blockNo;
@@ -927,7 +1024,7 @@ int FsProcWorker::submitFsReqCompletion(FsReq *fsReq) {
     return FS_REQ_ERROR_INODE_REDIRECT - fsReq->getWid();
   };
 
-  char *packedMsg = (char *)IDX_TO_XREQ(app->shmipc_mgr, fsReq->getSlotId());
+  char *packedMsg = app->slotToXreq(fsReq->getSlotId());
 #define pack_msg(st, op_name) \
   pack_##st(&(cop->op.op_name), (struct st##Packed *)packedMsg)
 #define copy_msg(op_name) \
@@ -1242,6 +1339,17 @@ int FsProcWorker::submitFsReqCompletion(FsReq *fsReq) {
       cop->opStatus = OP_DONE;
       copy_msg(opendir);
     }
+  } else if (curType == FsReqType::READDIR) {
+    SPDLOG_DEBUG("submitFsReqCompletion for readdir");
+    auto it = appMap.find(fsReq->getPid());
+    if (it != appMap.end()) {
+      cop = fsReq->getClientOp();
+      if (fsReq->hasError()) {
+        cop->op.readdir.ret = getReturnValueForFailedReq(fsReq);
+      }
+      cop->opStatus = OP_DONE;
+      copy_msg(readdir);
+    }
   } else if (curType == FsReqType::FDATA_SYNC || curType == FsReqType::FSYNC) {
     SPDLOG_DEBUG("submitFsReqCompletion for fsync ret:{}",
                  fsReq->getClientOp()->op.fsync.ret);
@@ -1397,6 +1505,13 @@ int FsProcWorker::submitFsReqCompletion(FsReq *fsReq) {
       cop->opStatus = OP_DONE;
       copy_msg(threadReassign);
     }
+  } else if (curType == FsReqType::THREAD_RING) {
+    auto it = appMap.find(fsReq->getPid());
+    if (it != appMap.end()) {
+      cop = fsReq->getClientOp();
+      cop->opStatus = OP_DONE;
+      copy_msg(threadRing);
+    }
   } else {
     SPDLOG_INFO("ERROR reqType not supported");
     return -1;
@@ -1625,7 +1740,7 @@ struct clientOp *FsProcWorker::getClientOpForMsg(AppProc *app,
 
   SPDLOG_DEBUG("Received request opcode:{}", copPtr->opCode);
 
-  packedMsg = (char *)IDX_TO_XREQ(app->shmipc_mgr, ring_idx);
+  packedMsg = app->slotToXreq(ring_idx);
 
 #define unpack_msg(st, op_name) \
   unpack_##st((struct st##Packed *)packedMsg, &(copPtr->op.op_name))
@@ -1690,6 +1805,9 @@ struct clientOp *FsProcWorker::getClientOpForMsg(AppProc *app,
     case CFS_OP_OPENDIR:
       copy_msg(opendir);
       break;
+    case CFS_OP_READDIR:
+      copy_msg(readdir);
+      break;
     case CFS_OP_RMDIR:
       copy_msg(rmdir);
       break;
@@ -1729,6 +1847,9 @@ struct clientOp *FsProcWorker::getClientOpForMsg(AppProc *app,
     case CFS_OP_THREAD_REASSIGNMENT:
       copy_msg(threadReassign);
       break;
+    case CFS_OP_THREAD_RING:
+      copy_msg(threadRing);
+      break;
 #ifdef _CFS_TEST_
     case CFS_OP_TEST:
       copy_msg(test);
@@ -1813,17 +1934,19 @@ int FsProcWorker::pollReqFromApps() {
   // pull request from Apps
   // TODO: how many requests we should poll here?
   // considering the multi-threading apps?
+  // NOTE: the shared ring and the per-thread rings of one app are polled
+  // round-robin by AppProc::pollMsg()
   for (auto app : appList) {
     do {
 #ifdef DO_SCHED
       uint64_t begin_ts = PlatformLab::PerfUtils::Cycles::rdtsc();
 #endif
-      msgPtr = shmipc_mgr_get_msg_nowait(app->shmipc_mgr, &ringIdx);
+      msgPtr = app->pollMsg(ringIdx);
       if (msgPtr == nullptr) break;
       msgPtr->status = shmipc_STATUS_IN_PROGRESS;
       numAppReqPolled++;
       copPtr = getClientOpForMsg(app, msgPtr, ringIdx);
-      dataBufPtr = (char *)IDX_TO_DATA(app->shmipc_mgr, ringIdx);
+      dataBufPtr = app->slotToData(ringIdx);
       reqPtr = fsReqPool_->genNewReq(app, ringIdx, copPtr, dataBufPtr, this);
       if (reqPtr == nullptr) {
         fflush(stdout);
@@ -1933,11 +2056,27 @@ bool FsProcWorker::processInternalReadyQueue(sched::Tenant &t) {
 uint64_t FsProcWorker::processBlockReadyQueue(sched::Tenant &t) {
   uint64_t num_blks_submitted = 0;
   int rc;
-  while (true) {
+  // one request from each device in turn, so that a device that is slow or
+  // out of budget does not hold the requests to the others back
+  int num_devs = t.get_num_devs();
+  int dev_idx = 0;
+  int num_idle_devs = 0;  // in a row
+  while (num_idle_devs < num_devs) {
+    // leave the rest in the tenant's queue until the device catches up
+    if (dev->getInflightReqNum() >= dev->getInflightReqLimit())
+      return num_blks_submitted;
+    int d = dev_idx;
+    dev_idx = (dev_idx + 1) % num_devs;
     FsReq *fs_req;
-    BlockReq *blk_req = t.pop_blk_queue(fs_req);
-
-    if (!blk_req) return num_blks_submitted;
+    BlockReq *blk_req = nullptr;
+    if (num_devs == 1 ||
+        dev->getDevInflightReqNum(d) < dev->getDevInflightReqLimit(d))
+      blk_req = t.pop_blk_queue(d, fs_req);
+    if (!blk_req) {
+      num_idle_devs++;
+      continue;
+    }
+    num_idle_devs = 0;
     switch (blk_req->getReqType()) {
       case FsBlockReqType::READ_NOBLOCKING:
       case FsBlockReqType::READ_NOBLOCKING_SECTOR:
@@ -1951,10 +2090,11 @@ uint64_t FsProcWorker::processBlockReadyQueue(sched::Tenant &t) {
         break;
       case FsBlockReqType::WRITE_NOBLOCKING:
       case FsBlockReqType::WRITE_NOBLOCKING_SECTOR:
-        fs_req->startOnCpuTimer();
+        // fs_req is nullptr for the tenant's background write-back
+        if (fs_req) fs_req->startOnCpuTimer();
         rc = submitAsyncBufFlushWriteDevReq(blk_req->get_buf_flush_req(),
                                             blk_req);
-        fs_req->stopOnCpuTimer();
+        if (fs_req) fs_req->stopOnCpuTimer();
         if (rc >= 0) {
           num_blks_submitted += 1;
         } else {
@@ -1966,6 +2106,7 @@ uint64_t FsProcWorker::processBlockReadyQueue(sched::Tenant &t) {
         throw std::runtime_error("unknown block req type");
     }
   }
+  return num_blks_submitted;
 }
 #endif
 
@@ -2028,6 +2169,8 @@ void FsProcWorker::ownerProcessFdReq(FsReq *req) {
   }
 
   SPDLOG_DEBUG("WID:{} successfully resolved fd", getWid());
+  if (!quiescing_inodes_.empty() && holdReqIfInodeQuiescing(req, fobj->ip))
+    return;
   req->setFileObj(fobj);
   req->setTargetInode(fobj->ip);
   recordInProgressFsReq(req, fobj->ip);
@@ -2134,6 +2277,8 @@ void FsProcWorker::ownerProcessPathReq(FsReq *req) {
     ownerHandleUnknownPathReq(req, perm);
     return;
   }
+  if (!quiescing_inodes_.empty() && holdReqIfInodeQuiescing(req, inodePtr))
+    return;
 
   recordInProgressFsReq(req, inodePtr);
   fileManager->processReq(req);
@@ -2250,6 +2395,16 @@ void FsProcWorker::processClientControlPlaneReq(FsReq *req) {
     case FsReqType::THREAD_REASSIGN:
       ProcessManualThreadReassign(req);
       goto end;
+
+    case FsReqType::THREAD_RING: {
+      auto &trop = req->getClientOp()->op.threadRing;
+      if (trop.isRegister) {
+        trop.ret = req->getApp()->addThreadRing(trop.ringId);
+      } else {
+        trop.ret = req->getApp()->removeThreadRing(trop.ringId);
+      }
+      goto submit_completion;
+    }
     default:
       throw std::runtime_error("Unknown client control plane request");
   }
@@ -2328,9 +2483,35 @@ int FsProcWorker::pinToCpu() {
   }
   logger->info("Pin to CPU core-{}", pinnedCPUCore);
   logger->flush();
+  if (getNumaNode() >= 0) relocateReqPools();
   return 0;
 }
 
+void FsProcWorker::relocateReqPools() {
+  // nothing may hold a request yet
+  if (int(fsReqPool_->freeNum()) != FsReqPool::kPerWorkerReqPoolCapacity ||
+      !block_req_pool.allFree()) {
+    SPDLOG_WARN("Worker-{}: request pools in use; not relocated", wid);
+    return;
+  }
+  delete fsReqPool_;
+  fsReqPool_ = new FsReqPool(wid);
+  block_req_pool.relocate();
+  logger->info("Request pools relocated to NUMA node-{}", getNumaNode());
+}
+
+void FsProcWorker::allocLocalDataBlockMem(uint64_t sizeBytes) {
+  assert(localDataBlockMemPtr == nullptr);
+  // outside the bound of setPinMemBound, which only checks the master's
+  // buffer when BlkDevSpdk::kCheckRWMem is on
+  localDataBlockMemPtr =
+      (char *)dev->zmallocBufOnNode(sizeBytes, BSIZE, getNumaNode());
+  if (localDataBlockMemPtr == nullptr)
+    throw std::runtime_error("cannot allocate data block partition");
+  SPDLOG_INFO("Worker-{}: data block partition at {:p} on NUMA node-{}", wid,
+              (void *)localDataBlockMemPtr, getNumaNode());
+}
+
 void FsProcWorker::redirectZombieAppReqs(bool raiseError) {
   if (getWid() != FsProcWorker::kMasterWidConst) {
     shmipc_msg *new_msg;
@@ -2338,12 +2519,12 @@ void FsProcWorker::redirectZombieAppReqs(bool raiseError) {
     char *dataBufPtr = nullptr;
     struct clientOp *copPtr = nullptr;
     for (auto app : appList) {
-      new_msg = shmipc_mgr_get_msg_nowait(app->shmipc_mgr, &ring_idx);
+      new_msg = app->pollMsg(ring_idx);
       if (new_msg == nullptr) continue;
       SHMIPC_SET_MSG_STATUS(new_msg, shmipc_STATUS_IN_PROGRESS);
 
       copPtr = getClientOpForMsg(app, new_msg, ring_idx);
-      dataBufPtr = (char *)IDX_TO_DATA(app->shmipc_mgr, ring_idx);
+      dataBufPtr = app->slotToData(ring_idx);
 
       auto req = fsReqPool_->genNewReq(app, ring_idx, copPtr, dataBufPtr, this);
       if (req == nullptr) {
@@ -2492,28 +2673,108 @@ bool FsProcWorker::workerRunLoopInner() {
     if (!has_work_done) break;  // all queues are empty, no point to proceed
   }
 
-  // submit block requests that are ready (if any)
-  // also check if migration is necessary
+  /* For DO_SCHED, the global background flush is disabled; instead, each
+   * tenant writes back its own dirty blocks once its dirty ratio is above the
+   * threshold. These block requests are accounted for the tenant's bandwidth
+   * consumption like the ones of explict fsync/fdatasync */
   for (auto app : appList) {
-    auto &t = app->getTenant();
-    if (t.should_migrate()) {
-      schedMigrateInode(app, t.get_pending_inode_move());
-      t.unset_drain_for_migration();
-    }
-    loopEffective |= processBlockReadyQueue(t) > 0;
+    loopEffective |=
+        fileManager->fsImpl_->writeBackTenantDirty(this, app->getTenant()) > 0;
   }
 
-  /* For DO_SCHED, we disable background flush; all flush must be triggered by
-   * explict fsync/fdatasync and accounted for bandwidth consumption */
-  /*****************************************************************************
-  auto numFlushBlock = fileManager->checkAndFlushBufferDirtyItems();
-  loopEffective |= (numFlushBlock > 0);
-  *****************************************************************************/
+  // submit block requests that are ready (if any)
+  for (auto app : appList) {
+    loopEffective |= processBlockReadyQueue(app->getTenant()) > 0;
+  }
+  // move the inodes whose in-progress requests are done
+  loopEffective |= schedExportQuiescedInodes() > 0;
 
   return loopEffective;
 }
 #endif
 
+#ifdef DO_SCHED
+void FsProcWorker::publishMetrics(sched::stat::IdleStat &idle_stat) {
+  uint64_t now_ts = PlatformLab::PerfUtils::Cycles::rdtsc();
+  if (now_ts - metrics_publish_ts < sched::metrics::publish_interval_cycles)
+    return;
+  metrics_publish_ts = now_ts;
+  idle_stat.poll();
+
+  auto page = sched::metrics::get_page();
+  if (page == nullptr) return;  // allocator not started or page unavailable
+  if (getWid() >= sched::metrics::max_workers) return;
+
+  sched::metrics::WorkerStat ws{};
+  ws.update_ts = now_ts;
+  ws.idle_ratio = idle_stat.get_idle_ratio();
+  ws.num_tenants = appList.size();
+  ws.dev_inflight = dev->getInflightReqNum();
+  ws.dev_inflight_limit = dev->getInflightReqLimit();
+  ws.parked = !gFsProcPtr->checkWorkerActive(getWid());
+  ws.numa_node = getNumaNode();
+  page->workers[getWid()].store(ws);
+
+  sched::metrics::TenantStat ts{};
+  for (auto app : appList) {
+    int aid = app->getAid();
+    if (aid >= sched::metrics::max_apps) continue;
+    app->getTenant().export_metrics(ts);
+    ts.update_ts = now_ts;
+    ts.wid = getWid();
+    ts.aid = aid;
+    page->tenants[getWid()][aid].store(ts);
+  }
+}
+
+bool FsProcWorker::tryPark(sched::stat::IdleStat &idle_stat) {
+  if (dev->getInflightReqNum() > 0) return false;
+  for (auto app : appList) {
+    if (!app->getTenant().is_drained()) return false;
+  }
+  if (!gFsProcPtr->parkWorker(getWid())) return false;
+  SPDLOG_INFO("wid:{} parked", getWid());
+  // nothing is published while parked, so publish the state now
+  metrics_publish_ts = 0;
+  publishMetrics(idle_stat);
+  return true;
+}
+
+void FsProcWorker::snapshotTenants(sched::snapshot::Snapshot &snapshot) {
+  auto &tenants = snapshot.tenants[getWid()];
+  for (auto app : appList) {
+    if (size_t(app->getAid()) >= tenants.size()) continue;
+    tenants[app->getAid()].resrc = app->getTenant().get_resrc();
+  }
+  fileManager->fsImpl_->snapshotDataBlockBuf(tenants);
+}
+
+void FsProcWorker::warmUpTenants(const sched::snapshot::Snapshot &snapshot) {
+  auto startTs = tap_ustime();
+  for (auto app : appList) {
+    // blocks cached by the app on any worker, this worker's first; they move
+    // along with their inodes when the inodes are migrated later
+    std::vector<std::pair<uint32_t, uint32_t>> blocks;
+    for (int i = 0; i < snapshot.num_workers; ++i) {
+      int wid = (getWid() + i) % snapshot.num_workers;
+      auto &saved = snapshot.tenants[wid][app->getAid()].blocks;
+      blocks.insert(blocks.end(), saved.begin(), saved.end());
+    }
+    if (blocks.empty()) continue;
+    int numDone = fileManager->fsImpl_->BlockingWarmUpDataBlockBuf(
+        app->getTenant(), blocks, this);
+    if (numDone < 0) {
+      SPDLOG_WARN("wid:{} warm up of app {} stopped by an I/O error", getWid(),
+                  app->getAid());
+      continue;
+    }
+    SPDLOG_INFO("wid:{} warmed up app {} with {}/{} blocks", getWid(),
+                app->getAid(), numDone, blocks.size());
+  }
+  SPDLOG_INFO("wid:{} warm up time(us):{}", getWid(), tap_ustime() - startTs);
+}
+#endif
+
 void FsProcWorker::processFsProcMessage(const FsProcMessage &msg) {
   // TODO when a bitmap clear is seen, track the last alloc inode for that.
   // If we ever alloc that block for another inode, fill depends_on field.
@@ -2633,15 +2894,14 @@ void FsProcWorker::processFsProcMessage(const FsProcMessage &msg) {
 
 int FsProcWorker::processInterWorkerMessages() {
   int wid = getWorkerIdx();
-  bool valid_message = false;
-  FsProcMessage msg;
+  FsProcMessage msgs[FsProcMessenger::kMaxRecvBatch];
   int numMsg = 0;
   do {
-    valid_message = messenger->recv_message(wid, msg);
-    if (!valid_message) break;
+    size_t n = messenger->recv_messages(wid, msgs, std::size(msgs));
+    if (n == 0) break;
 
-    processFsProcMessage(msg);
-    numMsg++;
+    for (size_t i = 0; i < n; i++) processFsProcMessage(msgs[i]);
+    numMsg += n;
   } while (1);
   return numMsg;
 }
@@ -2948,6 +3208,10 @@ void FsProcWorkerMaster::workerRunLoop() {
   // device access (spdk) man set cpu affinity, so put pinToCpu() here
   pinToCpu();
 
+#ifdef DO_SCHED
+  gFsProcPtr->checkWarmSnapshotJournals(dev);
+#endif
+
   // install App credentials. This needs to be done before
   // initInMemDataAfterDevReady, which initializes the BlockBuffer
   InitApps();
@@ -2989,6 +3253,10 @@ void FsProcWorkerMaster::workerRunLoop() {
   // ugly... Please fix it in the future...
 
 #ifdef DO_SCHED
+  // restore the cache before admitting any request; all inodes are owned by
+  // the master at this point
+  if (auto snapshot = gFsProcPtr->getWarmSnapshot()) warmUpTenants(*snapshot);
+
   // start allocator
   gFsProcPtr->startAllocator();
 #endif
@@ -3016,6 +3284,9 @@ void FsProcWorkerMaster::workerRunLoop() {
     loopEffective |= (ProcessPendingCreationRedirect() > 0);
     loopEffective |= (checkSplitJoinComm() > 0);
     if (!loopEffective) idle_stat.stop();
+#ifdef DO_SCHED
+    publishMetrics(idle_stat);
+#endif
     /* We disable stats_recorder here because we are not using it now */
     /***************************************************************************
     stats_recorder_.RecordLoopEffective(loopEffective, ts, splitPolicy_);
@@ -3042,6 +3313,7 @@ void FsProcWorkerMaster::workerRunLoop() {
 
 #ifdef DO_SCHED
   for (auto app : appList) SPDLOG_INFO("{}", app->getTenant().to_string());
+  if (auto snapshot = gFsProcPtr->getExitSnapshot()) snapshotTenants(*snapshot);
 #endif
   adgMod::Stats *instance = adgMod::Stats::GetInstance();
   instance->ReportTime();
@@ -3376,12 +3648,21 @@ bool FsProcWorkerMaster::submitShmMsg(int dstWid, uint8_t shmid, FsReq *req) {
 }
 
 int FsProcWorkerMaster::initInMemDataAfterDevReady() {
+  int numPartition =
+      gFsProcPtr->getNumThreads() > 1 ? gFsProcPtr->getNumThreads() : 1;
   // init the memory
   uint64_t devBlockBufferSize = getTotalBlockBufferMemByte();
+  // on a multi-socket server, every servant allocates its data partition on
+  // its own node (initMemDataForServants), so only the master's partition is
+  // kept at the end of this buffer
+  if (numPartition > 1 && getNumaNode() >= 0)
+    devBlockBufferSize -= uint64_t(numPartition - 1) *
+                          (NMEM_DATA_BLOCK / numPartition) * BSIZE;
   SPDLOG_INFO("Init Memory: total buffer (huge-page as backend) sizeBytes:{}",
               devBlockBufferSize);
   // device allocated memory for DMA io
-  devBufMemPtr = (char *)dev->zmallocBuf(devBlockBufferSize, BSIZE);
+  devBufMemPtr =
+      (char *)dev->zmallocBufOnNode(devBlockBufferSize, BSIZE, getNumaNode());
   fprintf(stdout, "PINNED memory start:%p end:%p\n", devBufMemPtr,
           devBufMemPtr + devBlockBufferSize);
   dev->setPinMemBound((devBufMemPtr), (devBufMemPtr + devBlockBufferSize));
@@ -3421,8 +3702,6 @@ int FsProcWorkerMaster::initInMemDataAfterDevReady() {
   // it might be a good idea to make it one optional flag
 
   // init file manager
-  int numPartition =
-      gFsProcPtr->getNumThreads() > 1 ? gFsProcPtr->getNumThreads() : 1;
   fileManager = new FileMng(this, devBufMemPtr, gFsProcPtr->getDirtyFlushRato(),
                             numPartition);
   for (unsigned i = 0; i < imapNumBlocks; i++) {
@@ -3521,7 +3800,11 @@ int FsProcWorkerMaster::ProcessPendingNewedInodesMigration() {
 
 void FsProcWorkerMaster::initMemDataForServants() {
   FileMng *fm = nullptr;
+  block_no_t pttNumDataBlocks = NMEM_DATA_BLOCK / (servantsVec_.size() + 1);
   for (uint i = 0; i < servantsVec_.size(); i++) {
+    if (getNumaNode() >= 0)
+      servantsVec_[i]->allocLocalDataBlockMem(uint64_t(pttNumDataBlocks) *
+                                              BSIZE);
     servantsVec_[i]->InitApps();
     fm = fileManager->generateSubFileMng(servantsVec_[i]);
     servantsVec_[i]->initFileManager(fm);
@@ -3879,11 +4162,22 @@ void FsProcWorkerServant::workerRunLoop() {
     idle_stat.start();
 
     if (!gFsProcPtr->checkWorkerActive(wid)) {
+#ifdef DO_SCHED
+      // a parked worker still serves its messages and app rings between naps:
+      // others may wait on it (e.g., checkpointAllJournals() waits for every
+      // worker), and a message sent to it cuts the nap short
+      if (gFsProcPtr->waitWorkerActive(
+              wid, std::chrono::microseconds(
+                       sched::params::elastic::parked_nap_us)))
+        SPDLOG_INFO("wid:{} activated localvid:{}", getWid(),
+                    stats_recorder_.GetVersion());
+#else
       while (!gFsProcPtr->checkWorkerActive(wid) && *workerRunning)
         ;
       // TODO: put more wake up preparation here
       SPDLOG_INFO("wid:{} activated localvid:{}", getWid(),
                   stats_recorder_.GetVersion());
+#endif
     }
 
     // REQUIRED: ts must be passed immediately into *workerRunLoopInner*
@@ -3893,6 +4187,12 @@ void FsProcWorkerServant::workerRunLoop() {
     // TODO (jing) : should we process messages inside the inner loop instead?
     loopEffective |= (processInterWorkerMessages() > 0);
     if (!loopEffective) idle_stat.stop();
+#ifdef DO_SCHED
+    publishMetrics(idle_stat);
+    if (!loopEffective && gFsProcPtr->checkWorkerParkRequested(wid) &&
+        gFsProcPtr->checkWorkerActive(wid))
+      tryPark(idle_stat);
+#endif
 
     /* We disable stats_recorder here because we are not using it now */
     /***************************************************************************
@@ -3905,6 +4205,7 @@ void FsProcWorkerServant::workerRunLoop() {
 
 #ifdef DO_SCHED
   for (auto app : appList) SPDLOG_INFO("{}", app->getTenant().to_string());
+  if (auto snapshot = gFsProcPtr->getExitSnapshot()) snapshotTenants(*snapshot);
 #endif
   logger->info("Servant Done. out of the loop... ===> stats ===>");
   if (FsWorkerOpStats::kCollectWorkerOpStats)
@@ -92,6 +92,7 @@ struct shmipc_mgr *shmipc_mgr_init(const char *name, size_t rsize, int create) {
   mgr->capacity = rsize;
   mgr->mask = rsize - 1;
   mgr->next = 0;
+  mgr->single_producer = 0;
 
   // TODO ensure that the shared memory vaddr is cache aligned?
   mem_required = (rsize * 64) + (rsize * shmipc_XREQ_MAX_ELEM_SIZE) +
@@ -129,6 +130,7 @@ struct shmipc_mgr *shmipc_mgr_init_client(const char *name, size_t rsize,
   mgr->capacity = rsize;
   mgr->mask = rsize - 1;
   mgr->next = 0;
+  mgr->single_producer = 0;
 
   // TODO ensure that the shared memory vaddr is cache aligned?
   mem_required = (rsize * 64) + (rsize * shmipc_XREQ_MAX_ELEM_SIZE) +
@@ -208,7 +210,10 @@ off_t shmipc_mgr_alloc_slot(struct shmipc_mgr *mgr) {
   struct shmipc_msg *rmsg;
   off_t ring_idx;
 
-  ring_idx = __sync_fetch_and_add(&(mgr->next), 1);
+  if (mgr->single_producer)
+    ring_idx = mgr->next++;
+  else
+    ring_idx = __sync_fetch_and_add(&(mgr->next), 1);
   ring_idx = ring_idx & mgr->mask;
   rmsg = IDX_TO_MSG(mgr, ring_idx);
 
@@ -35,6 +35,11 @@ void iappend(uint32_t inum, void *p, uint64_t n);
 // Note: the result status could be size=0, but num_block > 0, caller need to
 // fix this.
 void iadd_datablock(uint32_t inum, uint32_t block_num);
+// Find the extent of a block of an inode in either format, reading the index
+// nodes from the device
+// @return 1 if found, -1 if the block is not mapped
+int ilookup_extent(const struct cfs_dinode *ip, uint32_t block_idx,
+                   struct cfs_extent &extent);
 void readsb();
 void writesb();
 void fillBlock(char *buf, off_t off, size_t fillSize);
@@ -203,14 +208,14 @@ int32_t fromFnameToInum(std::string &fname) {
   // read root inode
   rinode(ROOTINO, &din);
   int32_t fileIno = -1;
-  struct cfs_extent *cur_extent_ptr;
-  for (int i = 0; i < NEXTENT_ARR; i++) {
-    cur_extent_ptr = &din.ext_array[i];
-    if (cur_extent_ptr->block_no == 0) {
+  struct cfs_extent cur_extent;
+  for (uint32_t i = 0; i < din.i_block_count;) {
+    if (ilookup_extent(&din, i, cur_extent) < 0) {
       break;
     }
-    for (uint j = 0; j < cur_extent_ptr->num_blocks; j++) {
-      uint32_t data_block_no = cur_extent_ptr->block_no + j;
+    for (uint j = i - cur_extent.i_block_offset; j < cur_extent.num_blocks;
+         j++, i++) {
+      uint32_t data_block_no = cur_extent.block_no + j;
       rsect(data_block_no + get_data_start_block(), (uint8_t *)buf);
       struct cfs_dirent *dirEntryPtr = (struct cfs_dirent *)buf;
       for (uint ii = 0; ii < BSIZE / (sizeof(cfs_dirent)); ii++) {
@@ -264,19 +269,16 @@ void read_file(int fno) {
     memset(buf, 0, din.size + 1);
     uint64_t off = 0, tot;
     uint32_t m;
-    struct cfs_extent *extent_ptr;
+    struct cfs_extent extent;
     char *dstPtr = buf;
-    uint32_t cur_inside_extent_idx, cur_extent_max_block_num;
     for (tot = 0; tot < din.size; tot += m, off += m, dstPtr += m) {
       uint32_t blockIdx = off / BSIZE;
       m = std::min(din.size - tot, BSIZE - off % BSIZE);
-      int cur_extent_arr_idx = getCurrentExtentArrIdx(
-          blockIdx, cur_inside_extent_idx, cur_extent_max_block_num);
-      assert(cur_extent_arr_idx >= 0);
-      extent_ptr = &din.ext_array[cur_extent_arr_idx];
-      rsect(
-          extent_ptr->block_no + cur_inside_extent_idx + get_data_start_block(),
-          (uint8_t *)dstPtr);
+      int rc = ilookup_extent(&din, blockIdx, extent);
+      assert(rc > 0);
+      rsect(extent.block_no + (blockIdx - extent.i_block_offset) +
+                get_data_start_block(),
+            (uint8_t *)dstPtr);
       // fprintf(stdout, "din.size:%lu off:%lu %c\n", din.size, off,
       // (char)(*dstPtr));
     }
@@ -722,7 +724,7 @@ void iappend(uint32_t inum, void *xp, uint64_t n) {
   uint32_t tot, m;
   uint64_t off;
   struct cfs_dinode din;
-  struct cfs_extent *extent_ptr;
+  struct cfs_extent extent;
   uint8_t buf[BSIZE];
   char *src_ptr = p;
 
@@ -744,20 +746,18 @@ void iappend(uint32_t inum, void *xp, uint64_t n) {
   // If add data block, inode will be updated.
   rinode(inum, &din);
 
-  uint32_t cur_inside_extent_idx, cur_extent_max_block_num;
   for (tot = 0; tot < n; tot += m, off += m, src_ptr += m) {
     uint32_t cur_block_idx = off / BSIZE;
     m = std::min(real_nbytes - tot, BSIZE - off % BSIZE);
-    int cur_extent_arr_idx = getCurrentExtentArrIdx(
-        cur_block_idx, cur_inside_extent_idx, cur_extent_max_block_num);
-    assert(cur_extent_arr_idx >= 0);
-    extent_ptr = &din.ext_array[cur_extent_arr_idx];
-    rsect(extent_ptr->block_no + cur_inside_extent_idx + get_data_start_block(),
-          buf);
+    int rc = ilookup_extent(&din, cur_block_idx, extent);
+    assert(rc > 0);
+    uint64_t data_block_no = extent.block_no +
+                             (cur_block_idx - extent.i_block_offset) +
+                             get_data_start_block();
+    rsect(data_block_no, buf);
     // cast cur_block_idx to 64 bit, otherwise *BSIZE will overflow
     bcopy(src_ptr, buf + (off - ((uint64_t)cur_block_idx) * BSIZE), m);
-    wsect(extent_ptr->block_no + cur_inside_extent_idx + get_data_start_block(),
-          buf);
+    wsect(data_block_no, buf);
   }
 
   // update inode.
@@ -774,6 +774,11 @@ void iadd_datablock(uint32_t inum, uint32_t block_num) {
   uint32_t num_bmap_blocks = sb.inode_start - sb.bmap_start;
   // fprintf(stdout, "number of bitmap blocks is:%u\n", num_bmap_blocks);
   rinode(inum, &din);
+  if (cfs_extent_tree_enabled(&din)) {
+    // only the file system itself grows an extent tree
+    fprintf(stderr, "ERROR inode:%u is in the extent tree format\n", inum);
+    throw;
+  }
   uint32_t cur_iblock_count = din.i_block_count;
   fprintf(
       stdout,
@@ -877,6 +882,19 @@ void iadd_datablock(uint32_t inum, uint32_t block_num) {
   winode(inum, &din);
 }
 
+int ilookup_extent(const struct cfs_dinode *ip, uint32_t block_idx,
+                   struct cfs_extent &extent) {
+  // convert a copy, so that the legacy writer keeps its own format
+  struct cfs_dinode din = *ip;
+  cfs_extent_tree_upgrade(&din);
+  uint8_t buf[BSIZE];
+  auto get_node = [&](uint64_t block_no) {
+    rsect(block_no + get_data_start_block(), buf);
+    return reinterpret_cast<const struct cfs_extent_node *>(buf);
+  };
+  return cfs_extent_tree_lookup(&din, block_idx, get_node, extent);
+}
+
 void dumpsb() {
   // std::cout << "sb.next_freeinode_no: " << sb.next_freeinode_no << std::endl;
 }
@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AllocSim.h"
+#include "Param.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using namespace sched;
+
+constexpr uint64_t kCyclesPerSecond = params::cycles_per_second;
+constexpr int kNumWorkers = 2;
+constexpr int kNumApps = 2;
+
+// app 0 has a `working_set` (512 MB) on each worker; app 1 scans. every tenant
+// starts with `cache` (256 MB), 100 MB/s and half a worker, and does 1000
+// blocks every 100 ms in the trace, at 20000 cycles per block except for the
+// first `num_light_samples`, which cost a tenth of it. with `dev_shares`, each
+// app's misses go to the devices by its shares
+std::string make_trace(
+    int num_samples, int num_light_samples = 0,
+    const std::vector<std::vector<double>>& dev_shares = {},
+    uint32_t cache = params::mb_to_blocks(256),
+    uint32_t working_set = params::mb_to_blocks(512)) {
+  std::ostringstream ss;
+  ss << "H " << kNumWorkers << ' ' << kNumApps << ' ' << params::ghost::min_size
+     << ' ' << params::ghost::max_size << ' ' << params::ghost::tick << ' '
+     << kCyclesPerSecond << '\n';
+  const int64_t bandwidth = params::mb_to_blocks(100);
+  const int64_t cpu =
+      params::weight_to_cycles(params::worker_avail_weight / 2);
+  auto hit_rate = [working_set](int aid, uint32_t size) {
+    if (aid == 1) return 0.0;
+    return std::min(1.0, double(size) / working_set);
+  };
+  int64_t cpu_consump = 0;
+  for (int i = 1; i <= num_samples; ++i) {
+    cpu_consump += 1000L * (i <= num_light_samples ? 2000 : 20000);
+    for (int wid = 0; wid < kNumWorkers; ++wid) {
+      for (int aid = 0; aid < kNumApps; ++aid) {
+        int64_t done = 1000L * i;
+        ss << "T " << kCyclesPerSecond / 10 * i << ' ' << wid << ' ' << aid
+           << " 10 " << cache << ' ' << bandwidth << ' ' << cpu << ' ' << done
+           << ' ' << int64_t(done * (1 - hit_rate(aid, cache))) << ' '
+           << cpu_consump << ' ' << params::ghost::num_ticks;
+        for (uint32_t size = params::ghost::min_size;
+             size <= params::ghost::max_size; size += params::ghost::tick) {
+          auto hit = int64_t(done * hit_rate(aid, size));
+          ss << ' ' << hit << ' ' << done - hit;
+        }
+        ss << '\n';
+        if (dev_shares.empty()) continue;
+        ss << "D " << wid << ' ' << aid << ' ' << dev_shares[aid].size();
+        for (double share : dev_shares[aid])
+          ss << ' ' << int64_t(done * (1 - hit_rate(aid, cache)) * share);
+        ss << '\n';
+      }
+    }
+  }
+  return ss.str();
+}
+
+sim::AllocSimOptions test_opts() {
+  return {.preheat_us = 1'000'000, .freq_us = 10'000'000,
+          .window_us = 5'000'000};
+}
+
+TEST(AllocSimTest, LoadTrace) {
+  sim::Trace trace;
+  std::istringstream in(make_trace(10));
+  ASSERT_EQ(trace.load(in), "");
+  EXPECT_EQ(trace.num_workers, kNumWorkers);
+  EXPECT_EQ(trace.num_apps, kNumApps);
+  EXPECT_EQ(trace.samples[1][1].size(), 10U);
+  EXPECT_EQ(trace.begin_ts(), kCyclesPerSecond / 10);
+  EXPECT_EQ(trace.end_ts(), kCyclesPerSecond);
+
+  sim::Trace bad;
+  std::istringstream no_header("T 1 0 0\n");
+  EXPECT_NE(bad.load(no_header), "");
+}
+
+TEST(AllocSimTest, HarvestCache) {
+  sim::Trace trace;
+  std::istringstream in(make_trace(300));
+  ASSERT_EQ(trace.load(in), "");
+  sim::AllocSim alloc_sim(trace, test_opts());
+  sim::AllocSim::Round round;
+
+  // the first window runs with the resources in the trace
+  ASSERT_TRUE(alloc_sim.step(round));
+  for (auto& a : round.apps) {
+    EXPECT_TRUE(a.is_active);
+    EXPECT_EQ(a.resrc.cache_size, params::mb_to_blocks(512));
+    EXPECT_DOUBLE_EQ(a.tp, a.base_tp);
+  }
+
+  // the scan gives its cache away for bandwidth, and both apps gain
+  ASSERT_TRUE(alloc_sim.step(round));
+  EXPECT_GT(round.apps[0].resrc.cache_size, params::mb_to_blocks(512));
+  EXPECT_EQ(round.apps[1].resrc.cache_size, params::min_cache_total);
+  EXPECT_GT(round.apps[1].resrc.bandwidth, params::mb_to_blocks(200));
+  for (auto& a : round.apps) EXPECT_GT(a.tp, a.base_tp * 1.1);
+}
+
+TEST(AllocSimTest, NoHarvest) {
+  sim::Trace trace;
+  std::istringstream in(make_trace(300));
+  ASSERT_EQ(trace.load(in), "");
+  params::policy::harvest_enabled = false;
+  sim::AllocSim alloc_sim(trace, test_opts());
+  sim::AllocSim::Round round;
+  ASSERT_TRUE(alloc_sim.step(round));
+  ASSERT_TRUE(alloc_sim.step(round));
+  params::policy::harvest_enabled = true;
+  for (auto& a : round.apps)
+    EXPECT_EQ(a.resrc.cache_size, params::mb_to_blocks(512));
+}
+
+TEST(AllocSimTest, BatchedTrades) {
+  sim::Trace trace;
+  std::istringstream in(make_trace(300));
+  ASSERT_EQ(trace.load(in), "");
+  auto second_round = [&](uint32_t max_trade_batch) {
+    params::max_trade_batch = max_trade_batch;
+    sim::AllocSim alloc_sim(trace, test_opts());
+    sim::AllocSim::Round round;
+    EXPECT_TRUE(alloc_sim.step(round));
+    EXPECT_TRUE(alloc_sim.step(round));
+    return round;
+  };
+  const uint32_t default_batch = params::max_trade_batch;
+  auto single = second_round(1);
+  auto batched = second_round(64);
+  params::max_trade_batch = default_batch;
+
+  // the hit rate curves are linear, so batching trades the same cache
+  for (int aid = 0; aid < kNumApps; ++aid) {
+    EXPECT_EQ(batched.apps[aid].resrc.cache_size,
+              single.apps[aid].resrc.cache_size);
+    EXPECT_NEAR(batched.apps[aid].resrc.bandwidth,
+                single.apps[aid].resrc.bandwidth, params::mb_to_blocks(1));
+  }
+}
+
+TEST(AllocSimTest, BatchedTradesNearGhostMaxSize) {
+  // each tenant of app 0 is two deltas short of its ghost cache's max size,
+  // far below its working set; the scan would give it much more
+  const uint32_t cache = params::ghost::max_size - 2 * params::cache_delta;
+  sim::Trace trace;
+  std::istringstream in(make_trace(300, 0, {}, cache, 4 * cache));
+  ASSERT_EQ(trace.load(in), "");
+  const uint32_t default_batch = params::max_trade_batch;
+  params::max_trade_batch = 64;
+  sim::AllocSim alloc_sim(trace, test_opts());
+  sim::AllocSim::Round round;
+  ASSERT_TRUE(alloc_sim.step(round));
+  ASSERT_TRUE(alloc_sim.step(round));
+  params::max_trade_batch = default_batch;
+
+  // app 0 grows up to what its ghost caches can tell, and no further
+  EXPECT_GT(round.apps[0].resrc.cache_size, kNumWorkers * cache);
+  EXPECT_LE(round.apps[0].resrc.cache_size,
+            kNumWorkers * params::ghost::max_size);
+  EXPECT_GT(round.apps[1].resrc.bandwidth, params::mb_to_blocks(200));
+}
+
+TEST(AllocSimTest, ElasticWorkers) {
+  sim::Trace trace;
+  // light for the first 60 seconds (allocations 0-5), then heavy
+  std::istringstream in(make_trace(1200, 600));
+  ASSERT_EQ(trace.load(in), "");
+  params::policy::symm_partition = false;
+  params::policy::elastic_workers = true;
+  sim::AllocSim alloc_sim(trace, test_opts());
+  std::vector<sim::AllocSim::Round> rounds;
+  sim::AllocSim::Round round;
+  while (alloc_sim.step(round)) rounds.emplace_back(round);
+  params::policy::elastic_workers = false;
+  params::policy::symm_partition = true;
+  ASSERT_GE(rounds.size(), 8U);
+
+  // the demand fits in one worker, but it takes park_patience allocations
+  for (uint32_t i = 0; i + 1 < params::elastic::park_patience; ++i)
+    EXPECT_FALSE(rounds[i].workers_parked[1]);
+  // worker 1 hands its files off and is parked; the apps run on worker 0
+  for (size_t i = params::elastic::park_patience - 1; i < 6; ++i) {
+    EXPECT_FALSE(rounds[i].workers_parked[0]);
+    EXPECT_TRUE(rounds[i].workers_parked[1]);
+    EXPECT_EQ(rounds[i].workers_num_files[0], kNumWorkers * kNumApps * 10);
+    EXPECT_EQ(rounds[i].workers_num_files[1], 0);
+  }
+  int64_t cpu_sum = 0;
+  for (auto& a : rounds[5].apps) {
+    EXPECT_TRUE(a.is_active);
+    EXPECT_GT(a.tp, 0);
+    cpu_sum += a.resrc.cpu_cycles;
+  }
+  EXPECT_LE(cpu_sum, int64_t(params::worker_avail_cycles_per_second));
+
+  // the demand saturates worker 0, so worker 1 is unparked at once
+  EXPECT_FALSE(rounds[6].workers_parked[1]);
+  EXPECT_GT(rounds[6].workers_num_files[1], 0);
+}
+
+TEST(AllocSimTest, NumaAffinity) {
+  // worker 0 and app 0 on node 0; worker 1 and app 1 on node 1
+  std::string numa = "W 0 0\nW 1 1\nA 0 0\nA 1 1\n";
+  sim::Trace trace;
+  std::istringstream in(make_trace(300) + numa);
+  ASSERT_EQ(trace.load(in), "");
+  ASSERT_EQ(trace.worker_nodes, std::vector<int>({0, 1}));
+  ASSERT_EQ(trace.app_nodes, std::vector<int>({0, 1}));
+  params::policy::symm_partition = false;
+  params::policy::avoid_tiny_weight = false;
+
+  auto last_round = [&trace]() {
+    sim::AllocSim alloc_sim(trace, test_opts());
+    sim::AllocSim::Round round;
+    while (alloc_sim.step(round)) continue;
+    return round;
+  };
+  auto near = last_round();
+  params::policy::numa_affinity = false;
+  auto far = last_round();
+  params::policy::numa_affinity = true;
+  params::policy::avoid_tiny_weight = true;
+  params::policy::symm_partition = true;
+
+  // each app fills the worker on its own node before the other one; without
+  // the affinity, app 0 is placed on worker 1 first
+  EXPECT_GT(near.apps[0].num_files[0], near.apps[0].num_files[1]);
+  EXPECT_GT(near.apps[1].num_files[1], near.apps[1].num_files[0]);
+  EXPECT_GT(far.apps[0].num_files[1], far.apps[0].num_files[0]);
+}
+
+TEST(AllocSimTest, DeviceSkew) {
+  // app 0 only touches the data on device 0; the scan spreads evenly
+  sim::Trace trace;
+  std::istringstream in(make_trace(300, 0, {{1, 0}, {0.5, 0.5}}));
+  ASSERT_EQ(trace.load(in), "");
+  ASSERT_EQ(trace.num_devs, 2);
+  EXPECT_EQ(trace.samples[0][1].back().dev_io_cnt.size(), 2U);
+  sim::AllocSim alloc_sim(trace, test_opts());
+  sim::AllocSim::Round round;
+  ASSERT_TRUE(alloc_sim.step(round));
+  ASSERT_TRUE(alloc_sim.step(round));
+
+  // no device is given more than its half of the bandwidth, and the scan gets
+  // the part of device 1 app 0 does not use
+  const int64_t dev_bandwidth = params::mb_to_blocks(100) * kNumWorkers;
+  const auto& bw0 = round.apps[0].resrc.bandwidth;
+  const auto& bw1 = round.apps[1].resrc.bandwidth;
+  EXPECT_LE(bw0 + bw1 * 0.5, dev_bandwidth + 2);
+  EXPECT_LE(bw1 * 0.5, dev_bandwidth + 2);
+  EXPECT_GT(bw1, bw0);
+  for (auto& a : round.apps) EXPECT_GT(a.tp, a.base_tp);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,83 @@
+#include <cstdint>
+
+#include "BlkDevQdController.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// time is in us
+QueueDepthController::Params test_params() {
+  return {.target_latency = 500,
+          .interval = 10000,
+          .min_limit = 8,
+          .max_limit = 600,
+          .ticks_per_second = 1000000,
+          .num_filter_intervals = 4};
+}
+
+// the first completion starts the interval at its submission time: 0
+void start_at_zero(QueueDepthController &ctrl) {
+  ctrl.on_complete(1000, 1000, 0);
+}
+
+// one interval of `num` 4K requests with the same latency
+uint64_t run_interval(QueueDepthController &ctrl, uint64_t now, int num,
+                      uint64_t latency, bool reach_limit) {
+  if (reach_limit) ctrl.on_submit(ctrl.get_limit());
+  for (int i = 1; i <= num; i++)
+    ctrl.on_complete(now + i * 10000 / num, latency, 4096);
+  return now + 10000;
+}
+
+TEST(QueueDepthControllerTest, CutOnStandingQueue) {
+  QueueDepthController ctrl(test_params());
+  start_at_zero(ctrl);
+  EXPECT_EQ(ctrl.get_limit(), 600);
+  EXPECT_EQ(ctrl.get_capacity(), 0U);
+  uint64_t now = run_interval(ctrl, 0, 100, 1000, false);
+  EXPECT_EQ(ctrl.get_limit(), 450);
+  // the device was the bottleneck: 100 x 4K in 10 ms
+  EXPECT_EQ(ctrl.get_capacity(), 100U * 4096 * 100);
+  for (int i = 0; i < 20; i++) now = run_interval(ctrl, now, 100, 1000, false);
+  EXPECT_EQ(ctrl.get_limit(), 8);
+}
+
+TEST(QueueDepthControllerTest, GrowOnlyIfLimited) {
+  QueueDepthController ctrl(test_params());
+  start_at_zero(ctrl);
+  uint64_t now = run_interval(ctrl, 0, 100, 1000, false);
+  ASSERT_EQ(ctrl.get_limit(), 450);
+  // under the target but the limit is never reached: keep it
+  now = run_interval(ctrl, now, 100, 100, false);
+  EXPECT_EQ(ctrl.get_limit(), 450);
+  // one fast request in the interval means there is no standing queue
+  ctrl.on_complete(now + 1, 100, 4096);
+  now = run_interval(ctrl, now, 100, 1000, true);
+  EXPECT_EQ(ctrl.get_limit(), 450 + 450 / 8);
+  for (int i = 0; i < 20; i++) now = run_interval(ctrl, now, 100, 100, true);
+  EXPECT_EQ(ctrl.get_limit(), 600);
+}
+
+TEST(QueueDepthControllerTest, CapacityMaxFilter) {
+  QueueDepthController ctrl(test_params());
+  start_at_zero(ctrl);
+  uint64_t now = run_interval(ctrl, 0, 200, 1000, false);
+  uint64_t high = ctrl.get_capacity();
+  // slower intervals do not lower it until the high one leaves the window
+  for (int i = 0; i < 3; i++) {
+    now = run_interval(ctrl, now, 100, 1000, false);
+    EXPECT_EQ(ctrl.get_capacity(), high);
+  }
+  // an unsaturated interval is not a sample
+  now = run_interval(ctrl, now, 10, 100, false);
+  EXPECT_EQ(ctrl.get_capacity(), high);
+  now = run_interval(ctrl, now, 100, 1000, false);
+  EXPECT_EQ(ctrl.get_capacity(), high / 2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,109 @@
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "BlkDevSim.h"
+#include "FsProc_Fs.h"
+#include "gtest/gtest.h"
+
+FsProc *gFsProcPtr = nullptr;
+
+namespace {
+
+constexpr int kNumDevs = 3;
+// data blocks of 16 units of 1 MB after the metadata
+const uint32_t kNumBlocks = get_data_start_block() + 16 * (1 << 20) / BSIZE;
+
+struct FlushDone {
+  int numCalls{0};
+  bool ok{false};
+};
+
+void onFlushed(void *arg, bool ok) {
+  auto done = static_cast<FlushDone *>(arg);
+  done->numCalls++;
+  done->ok = ok;
+}
+
+class BlkDevSimTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char path[] = "/tmp/fsTest_BlkDevSim_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    configName = path;
+    std::string cfg = "num_devs = \"" + std::to_string(kNumDevs) +
+                      "\";\nstripe_mb = \"1\";\nlat_dist = \"fixed\";\n";
+    ASSERT_EQ(write(fd, cfg.data(), cfg.size()), ssize_t(cfg.size()));
+    close(fd);
+    dev = new BlkDevSim(kNumBlocks, BSIZE, configName);
+    ASSERT_EQ(dev->devInit(), 0);
+    ASSERT_EQ(dev->getNumDevs(), kNumDevs);
+    dev->initWorker(0);
+    buf = static_cast<char *>(dev->zmallocBuf(BSIZE, BSIZE));
+  }
+  void TearDown() override {
+    dev->freeBuf(buf);
+    delete dev;
+    unlink(configName.c_str());
+  }
+
+  // the first data block on device `d`
+  uint64_t blockOnDev(int d) {
+    for (uint64_t b = get_data_start_block(); b < kNumBlocks; b++)
+      if (dev->getDevOfBlock(b) == d) return b;
+    return 0;
+  }
+
+  std::vector<uint64_t> numFlushes() {
+    std::vector<uint64_t> nums;
+    for (int d = 0; d < kNumDevs; d++) nums.push_back(dev->getDevNumFlushes(d));
+    return nums;
+  }
+
+  void waitFlushed(FlushDone &done) {
+    while (done.numCalls == 0) dev->checkCompletion(0);
+    EXPECT_EQ(done.numCalls, 1);
+    EXPECT_TRUE(done.ok);
+  }
+
+  std::string configName;
+  BlkDevSim *dev = nullptr;
+  char *buf = nullptr;
+};
+
+TEST_F(BlkDevSimTest, FlushWrittenDevs) {
+  ASSERT_EQ(dev->blockingWrite(blockOnDev(2), buf), 0);
+  ASSERT_EQ(dev->blockingWrite(blockOnDev(2), buf), 0);
+  FlushDone done;
+  // the journal's device, and the one holding the data
+  EXPECT_EQ(dev->flushWrittenDevs(onFlushed, &done), 2);
+  EXPECT_EQ(done.numCalls, 0);
+  EXPECT_EQ(numFlushes(), (std::vector<uint64_t>{1, 0, 1}));
+  waitFlushed(done);
+
+  // nothing written since: only the journal's device
+  FlushDone again;
+  EXPECT_EQ(dev->flushWrittenDevs(onFlushed, &again), 1);
+  EXPECT_EQ(numFlushes(), (std::vector<uint64_t>{2, 0, 1}));
+  waitFlushed(again);
+  EXPECT_EQ(done.numCalls, 1);
+}
+
+TEST_F(BlkDevSimTest, FlushAfterAsyncWrites) {
+  for (int d = 0; d < kNumDevs; d++)
+    ASSERT_EQ(dev->write(blockOnDev(d), /*blockNoSeqNo*/ 0, buf), 0);
+  FlushDone done;
+  EXPECT_EQ(dev->flushWrittenDevs(onFlushed, &done), kNumDevs);
+  EXPECT_EQ(numFlushes(), (std::vector<uint64_t>{1, 1, 1}));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,83 @@
+#include <cstdint>
+
+#include "BlkDevSimModel.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+BlkDevSimParams fixed_params() {
+  BlkDevSimParams params;
+  params.lat_dist = BlkDevSimParams::LatDist::FIXED;
+  params.read_lat_us = 10;
+  params.write_lat_us = 20;
+  params.parallelism = 2;
+  return params;
+}
+
+TEST(BlkDevSimModelTest, ParseLatDist) {
+  BlkDevSimParams::LatDist dist;
+  EXPECT_TRUE(BlkDevSimParams::parse_lat_dist("exp", dist));
+  EXPECT_EQ(dist, BlkDevSimParams::LatDist::EXP);
+  EXPECT_TRUE(BlkDevSimParams::parse_lat_dist("fixed", dist));
+  EXPECT_EQ(dist, BlkDevSimParams::LatDist::FIXED);
+  EXPECT_FALSE(BlkDevSimParams::parse_lat_dist("normal", dist));
+}
+
+TEST(BlkDevSimModelTest, Parallelism) {
+  BlkDevSimModel model(fixed_params());
+  // two channels: the third read waits for the first one to finish
+  EXPECT_EQ(model.submit(0, false, 4096), 10000U);
+  EXPECT_EQ(model.submit(0, false, 4096), 10000U);
+  EXPECT_EQ(model.submit(0, false, 4096), 20000U);
+  EXPECT_EQ(model.submit(5000, true, 4096), 30000U);
+  // an idle device serves it right away
+  EXPECT_EQ(model.submit(100000, true, 4096), 120000U);
+}
+
+TEST(BlkDevSimModelTest, Bandwidth) {
+  BlkDevSimParams params = fixed_params();
+  params.parallelism = 128;
+  params.read_bw_mbps = 1000;
+  BlkDevSimModel model(params);
+  // 64 x 1 MiB reads take 64 ms at 1000 MiB/s regardless of the latency
+  uint64_t done = 0;
+  for (int i = 0; i < 64; i++) done = model.submit(0, false, 1 << 20);
+  EXPECT_NEAR(done, 64e9 / 1000, 1000);
+  // writes are not limited and there are idle channels left
+  EXPECT_EQ(model.submit(0, true, 1 << 20), 20000U);
+}
+
+TEST(BlkDevSimModelTest, ReadWriteInterference) {
+  BlkDevSimParams params = fixed_params();
+  params.parallelism = 4;
+  params.rw_interference = 2;
+  BlkDevSimModel model(params);
+  EXPECT_EQ(model.submit(0, true, 4096), 20000U);
+  EXPECT_EQ(model.submit(0, true, 4096), 20000U);
+  // half of the channels are writing: 10us * (1 + 2 * 2 / 4)
+  EXPECT_EQ(model.submit(0, false, 4096), 20000U);
+  // the writes are done by then
+  EXPECT_EQ(model.submit(30000, false, 4096), 40000U);
+}
+
+TEST(BlkDevSimModelTest, LatencyMean) {
+  for (auto dist : {BlkDevSimParams::LatDist::EXP,
+                    BlkDevSimParams::LatDist::LOGNORMAL}) {
+    BlkDevSimParams params = fixed_params();
+    params.lat_dist = dist;
+    params.parallelism = 1;
+    BlkDevSimModel model(params);
+    // back to back on one channel: the total is the sum of the latencies
+    uint64_t done = 0;
+    constexpr int kNum = 100000;
+    for (int i = 0; i < kNum; i++) done = model.submit(0, false, 4096);
+    EXPECT_NEAR(double(done) / kNum, 10000, 200);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
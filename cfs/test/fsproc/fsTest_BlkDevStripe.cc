@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "BlkDevStripe.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+BlkDevStripe make_stripe(int num_devs) {
+  BlkDevStripe stripe;
+  stripe.numDevs = num_devs;
+  stripe.unitBlocks = 4;
+  stripe.firstBlock = 10;
+  return stripe;
+}
+
+TEST(BlkDevStripeTest, SingleDeviceIsIdentity) {
+  BlkDevStripe stripe = make_stripe(1);
+  for (uint64_t b = 0; b < 100; b++) {
+    EXPECT_EQ(stripe.devOf(b), 0);
+    EXPECT_EQ(stripe.devBlockNo(b), b);
+  }
+  EXPECT_EQ(stripe.devNumBlocks(0, 100), 100U);
+}
+
+TEST(BlkDevStripeTest, MetadataStaysOnFirstDevice) {
+  BlkDevStripe stripe = make_stripe(3);
+  for (uint64_t b = 0; b < 10; b++) {
+    EXPECT_EQ(stripe.devOf(b), 0);
+    EXPECT_EQ(stripe.devBlockNo(b), b);
+  }
+  EXPECT_EQ(stripe.blocksLeftInUnit(7), 3U);
+}
+
+TEST(BlkDevStripeTest, RoundRobinUnits) {
+  BlkDevStripe stripe = make_stripe(3);
+  // units: [10, 14) -> dev 0, [14, 18) -> dev 1, [18, 22) -> dev 2, ...
+  EXPECT_EQ(stripe.devOf(13), 0);
+  EXPECT_EQ(stripe.devBlockNo(13), 13U);
+  EXPECT_EQ(stripe.devOf(14), 1);
+  EXPECT_EQ(stripe.devBlockNo(14), 0U);
+  EXPECT_EQ(stripe.devOf(21), 2);
+  EXPECT_EQ(stripe.devBlockNo(21), 3U);
+  EXPECT_EQ(stripe.devOf(22), 0);
+  EXPECT_EQ(stripe.devBlockNo(22), 14U);
+  EXPECT_EQ(stripe.devOf(26), 1);
+  EXPECT_EQ(stripe.devBlockNo(26), 4U);
+  EXPECT_EQ(stripe.blocksLeftInUnit(10), 4U);
+  EXPECT_EQ(stripe.blocksLeftInUnit(16), 2U);
+}
+
+TEST(BlkDevStripeTest, Bijection) {
+  for (int num_devs = 1; num_devs <= 4; num_devs++) {
+    BlkDevStripe stripe = make_stripe(num_devs);
+    const uint64_t num_blocks = 107;
+    std::set<std::pair<int, uint64_t>> seen;
+    std::vector<uint64_t> max_block(num_devs, 0);
+    for (uint64_t b = 0; b < num_blocks; b++) {
+      int dev = stripe.devOf(b);
+      uint64_t dev_block = stripe.devBlockNo(b);
+      ASSERT_TRUE(seen.emplace(dev, dev_block).second) << b;
+      max_block[dev] = std::max(max_block[dev], dev_block + 1);
+      // contiguous within a unit
+      if (stripe.blocksLeftInUnit(b) > 1) {
+        EXPECT_EQ(stripe.devOf(b + 1), dev);
+        EXPECT_EQ(stripe.devBlockNo(b + 1), dev_block + 1);
+      }
+    }
+    // every device is packed from block 0 up to its size
+    uint64_t total = 0;
+    for (int dev = 0; dev < num_devs; dev++) {
+      EXPECT_EQ(stripe.devNumBlocks(dev, num_blocks), max_block[dev]);
+      total += stripe.devNumBlocks(dev, num_blocks);
+    }
+    EXPECT_EQ(total, num_blocks);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
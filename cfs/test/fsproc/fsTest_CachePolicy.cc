@@ -0,0 +1,168 @@
+#include <cstdint>
+#include <random>
+
+#include "CachePolicy.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using sched::CacheAdmission;
+using sched::CachePolicy;
+using sched::PolicySim;
+
+TEST(CachePolicyTest, Parse) {
+  CachePolicy p;
+  EXPECT_TRUE(sched::parse_cache_policy("2q", p));
+  EXPECT_EQ(p, CachePolicy::TWO_Q);
+  EXPECT_TRUE(sched::parse_cache_policy("arc", p));
+  EXPECT_EQ(p, CachePolicy::ARC);
+  EXPECT_FALSE(sched::parse_cache_policy("fifo", p));
+  EXPECT_EQ(sched::get_cache_policy(7), CachePolicy::LRU);
+  sched::set_cache_policy(7, CachePolicy::ARC);
+  EXPECT_EQ(sched::get_cache_policy(7), CachePolicy::ARC);
+  EXPECT_FALSE(sched::get_cache_bypass(7));
+  sched::set_cache_bypass(7, true);
+  EXPECT_TRUE(sched::get_cache_bypass(7));
+  EXPECT_EQ(sched::get_cache_policy(7), CachePolicy::ARC);
+  sched::set_cache_bypass(7, false);
+  EXPECT_FALSE(sched::get_cache_bypass(7));
+  EXPECT_EQ(sched::get_meta_cache_quota(7), UINT32_MAX);
+  sched::set_meta_cache_quota(7, 256);
+  EXPECT_EQ(sched::get_meta_cache_quota(7), 256U);
+  EXPECT_EQ(sched::get_meta_cache_quota(8), UINT32_MAX);
+}
+
+TEST(CachePolicyTest, TwoQAdmission) {
+  CacheAdmission adm(CachePolicy::TWO_Q);
+  adm.set_capacity(1024);
+  EXPECT_EQ(adm.get_probation_target(), 256U);
+  // first miss goes to probation; a miss again while remembered goes to main
+  EXPECT_TRUE(adm.admit_to_probation(1));
+  EXPECT_FALSE(adm.admit_to_probation(1));
+  // once admitted to main, it is forgotten
+  EXPECT_TRUE(adm.admit_to_probation(1));
+  // probation history holds A1in + A1out = 768 keys
+  for (uint32_t k = 100; k < 100 + 768; ++k) adm.admit_to_probation(k);
+  EXPECT_FALSE(adm.admit_to_probation(100 + 767));
+  EXPECT_TRUE(adm.admit_to_probation(1));
+
+  CacheAdmission lru(CachePolicy::LRU);
+  lru.set_capacity(1024);
+  EXPECT_EQ(lru.get_probation_target(), 0U);
+  EXPECT_FALSE(lru.admit_to_probation(1));
+}
+
+TEST(CachePolicyTest, ArcAdapts) {
+  CacheAdmission adm(CachePolicy::ARC);
+  adm.set_capacity(1024);
+  uint32_t init = adm.get_probation_target();
+  EXPECT_EQ(init, 64U);
+  // ghost hits of probation grow it
+  for (uint32_t k = 0; k < 100; ++k) adm.admit_to_probation(k);
+  for (uint32_t k = 0; k < 100; ++k) adm.admit_to_probation(k);
+  EXPECT_GT(adm.get_probation_target(), init);
+  // ghost hits of main shrink it, but never below 1/16
+  for (int r = 0; r < 20; ++r)
+    for (uint32_t k = 0; k < 100; ++k) adm.admit_to_probation(k);
+  EXPECT_EQ(adm.get_probation_target(), init);
+  // resize keeps the ratio
+  adm.set_capacity(2048);
+  EXPECT_EQ(adm.get_probation_target(), 2 * init);
+}
+
+TEST(CachePolicyTest, LruSim) {
+  PolicySim sim(CachePolicy::LRU, 4);
+  for (uint32_t k = 0; k < 4; ++k) EXPECT_FALSE(sim.access(k));
+  for (uint32_t k = 0; k < 4; ++k) EXPECT_TRUE(sim.access(k));
+  EXPECT_FALSE(sim.access(4));  // evicts 0
+  EXPECT_FALSE(sim.access(0));
+  EXPECT_TRUE(sim.access(4));
+}
+
+TEST(CachePolicyTest, ArcPromotesProbationHit) {
+  // a block hit once in probation, then a scan through probation: ARC has
+  // moved it to main (T1 -> T2) on the hit, while 2Q leaves it in probation
+  // (A1in) for the scan to evict
+  for (auto policy : {CachePolicy::TWO_Q, CachePolicy::ARC}) {
+    PolicySim sim(policy, 64);
+    EXPECT_FALSE(sim.access(1));
+    EXPECT_TRUE(sim.access(1));
+    for (uint32_t k = 100; k < 200; ++k) EXPECT_FALSE(sim.access(k));
+    EXPECT_EQ(sim.access(1), policy == CachePolicy::ARC)
+        << sched::to_string(policy);
+  }
+
+  CacheAdmission adm(CachePolicy::ARC);
+  adm.set_capacity(64);
+  EXPECT_TRUE(adm.promotes_on_hit());
+  EXPECT_TRUE(adm.admit_to_probation(1));
+  adm.on_promoted(1);
+  // remembered in main now: a miss again is a ghost hit of main
+  uint32_t target = adm.get_probation_target();
+  EXPECT_FALSE(adm.admit_to_probation(1));
+  EXPECT_LE(adm.get_probation_target(), target);
+  EXPECT_FALSE(CacheAdmission(CachePolicy::TWO_Q).promotes_on_hit());
+}
+
+// a hot set that fits in the cache, interleaved with a long sequential scan
+double mixed_hit_rate(CachePolicy policy) {
+  constexpr uint32_t kCapacity = 1024;
+  constexpr uint32_t kHotSet = 512;
+  PolicySim sim(policy, kCapacity);
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<uint32_t> hot(0, kHotSet - 1);
+  uint32_t scan = 1 << 20;
+  uint64_t hit = 0, total = 0;
+  for (int i = 0; i < 200000; ++i) {
+    bool h = (i % 3 == 0) ? sim.access(hot(gen)) : sim.access(scan++);
+    if (i < 20000) continue;  // warm up
+    hit += h;
+    ++total;
+  }
+  return double(hit) / total;
+}
+
+TEST(CachePolicyTest, ScanResistance) {
+  double lru = mixed_hit_rate(CachePolicy::LRU);
+  double two_q = mixed_hit_rate(CachePolicy::TWO_Q);
+  double arc = mixed_hit_rate(CachePolicy::ARC);
+  // the hot set is 1/3 of the accesses; LRU loses about half of it to the
+  // scan while 2Q and ARC keep it
+  EXPECT_LT(lru, 0.25);
+  EXPECT_GT(two_q, 0.32);
+  EXPECT_GT(arc, 0.32);
+}
+
+TEST(CachePolicyTest, SimGhostCache) {
+  sched::SimGhostCache ghost(CachePolicy::TWO_Q, 1024, 1024, 4096);
+  for (int r = 0; r < 4; ++r)
+    for (uint32_t k = 0; k < 65536; ++k) ghost.access(k % 2048, false);
+  // sampled: only ~1/32 of the accesses are counted
+  auto &small = ghost.get_stat(1024);
+  auto &large = ghost.get_stat(4096);
+  uint64_t total = large.hit_cnt + large.miss_cnt;
+  EXPECT_GT(total, 4 * 65536 / 64);
+  EXPECT_LT(total, 4 * 65536 / 16);
+  EXPECT_GT(large.hit_cnt, small.hit_cnt);
+}
+
+TEST(CachePolicyTest, SampledKeys) {
+  // what is added to the ghost counters is sampled at their rate
+  uint32_t num_sampled = 0;
+  for (uint32_t k = 0; k < 65536; ++k)
+    num_sampled += sched::SimGhostCache::is_sampled(k);
+  EXPECT_GT(num_sampled, 65536U / 64);
+  EXPECT_LT(num_sampled, 65536U / 16);
+
+  // and the counters count exactly the sampled keys' accesses
+  sched::SimGhostCache ghost(CachePolicy::LRU, 1024, 1024, 1024);
+  for (uint32_t k = 0; k < 65536; ++k) ghost.access(k, /*as_miss*/ true);
+  EXPECT_EQ(ghost.get_stat(1024).miss_cnt, num_sampled);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,229 @@
+#include <cstring>
+#include <set>
+
+#include "FsProc_FreeExtentIndex.h"
+#include "FsProc_FsInternal.h"
+#include "gtest/gtest.h"
+#include "util.h"
+
+namespace {
+
+TEST(FreeExtentIndexTest, Layout) {
+  FreeExtentIndex idx1(4, 1);
+  EXPECT_EQ(idx1.getNumUnits(), 4UL * BPB);
+  EXPECT_EQ(idx1.unitToBmapBlock(BPB + 3), 1U);
+  EXPECT_EQ(idx1.unitToBitNo(BPB + 3), 3U);
+
+  FreeExtentIndex idx2048(4, 2048);
+  EXPECT_EQ(idx2048.getNumUnits(), 4UL * BPB / 2048);
+  EXPECT_EQ(idx2048.unitToBmapBlock(17), 1U);
+  EXPECT_EQ(idx2048.unitToBitNo(17), 2048U);
+  uint64_t unit;
+  EXPECT_TRUE(idx2048.bmapBitToUnit(1, 2048, unit));
+  EXPECT_EQ(unit, 17UL);
+  EXPECT_FALSE(idx2048.bmapBitToUnit(1, 2049, unit));
+
+  // one unit spans 2 bitmap blocks; the trailing block is not a whole unit
+  FreeExtentIndex idxLarge(5, 2 * BPB);
+  EXPECT_EQ(idxLarge.getNumUnits(), 2UL);
+  EXPECT_EQ(idxLarge.getBmapBlockStride(), 2U);
+  EXPECT_EQ(idxLarge.unitToBmapBlock(1), 2U);
+  EXPECT_TRUE(idxLarge.bmapBitToUnit(2, 0, unit));
+  EXPECT_EQ(unit, 1UL);
+  EXPECT_FALSE(idxLarge.bmapBitToUnit(1, 0, unit));
+}
+
+TEST(FreeExtentIndexTest, IndexAndBestFit) {
+  char bmap[BSIZE];
+  memset(bmap, 0, BSIZE);
+  FreeExtentIndex idx(1, 1);
+  // used: [0, 10), [12, 100), [105, BPB) --> free runs: [10, 12), [100, 105)
+  for (uint32_t i = 0; i < BPB; i++) {
+    if (!((i >= 10 && i < 12) || (i >= 100 && i < 105))) block_set_bit(i, bmap);
+  }
+  idx.indexNextBmapBlock(bmap);
+  EXPECT_TRUE(idx.isFullyIndexed());
+  EXPECT_EQ(idx.getNumFreeUnits(), 7UL);
+  EXPECT_EQ(idx.getNumRuns(), 2UL);
+
+  // best fit takes the shorter run first
+  uint64_t unit;
+  ASSERT_TRUE(idx.allocUnit(unit));
+  EXPECT_EQ(unit, 10UL);
+  ASSERT_TRUE(idx.allocUnit(unit));
+  EXPECT_EQ(unit, 11UL);
+  ASSERT_TRUE(idx.allocUnit(unit));
+  EXPECT_EQ(unit, 100UL);
+  EXPECT_EQ(idx.getNumFreeUnits(), 4UL);
+}
+
+TEST(FreeExtentIndexTest, FreeCoalesce) {
+  char bmap[BSIZE];
+  memset(bmap, 0, BSIZE);
+  FreeExtentIndex idx(1, 2048);
+  idx.indexNextBmapBlock(bmap);
+  uint64_t n = idx.getNumUnits();
+  EXPECT_EQ(idx.getNumFreeUnits(), n);
+  EXPECT_EQ(idx.getNumRuns(), 1UL);
+
+  std::set<uint64_t> allocated;
+  uint64_t unit;
+  while (idx.allocUnit(unit)) {
+    EXPECT_TRUE(allocated.insert(unit).second);
+  }
+  EXPECT_EQ(allocated.size(), n);
+  EXPECT_EQ(idx.getNumRuns(), 0UL);
+
+  // free every other unit, then fill the holes
+  for (uint64_t u = 0; u < n; u += 2) idx.freeUnit(u);
+  EXPECT_EQ(idx.getNumRuns(), n / 2);
+  for (uint64_t u = 1; u < n; u += 2) idx.freeUnit(u);
+  EXPECT_EQ(idx.getNumRuns(), 1UL);
+  EXPECT_EQ(idx.getNumFreeUnits(), n);
+
+  // double free is ignored
+  idx.freeUnit(0);
+  EXPECT_EQ(idx.getNumFreeUnits(), n);
+}
+
+TEST(FreeExtentIndexTest, TakeUnit) {
+  char bmap[BSIZE];
+  memset(bmap, 0, BSIZE);
+  FreeExtentIndex idx(2, 1);
+  idx.indexNextBmapBlock(bmap);
+  // not indexed yet
+  EXPECT_FALSE(idx.takeUnit(BPB + 1));
+  // the unit after a file's last one keeps the file contiguous
+  EXPECT_TRUE(idx.takeUnit(7));
+  EXPECT_FALSE(idx.takeUnit(7));
+  EXPECT_TRUE(idx.takeUnit(8));
+  EXPECT_TRUE(idx.takeUnit(0));
+  EXPECT_EQ(idx.getNumFreeUnits(), uint64_t(BPB) - 3);
+  // [1, 7) and [9, BPB)
+  EXPECT_EQ(idx.getNumRuns(), 2UL);
+  idx.freeUnit(8);
+  idx.freeUnit(7);
+  EXPECT_EQ(idx.getNumRuns(), 1UL);
+}
+
+TEST(FreeExtentIndexTest, IncrementalIndex) {
+  char freeBmap[BSIZE], fullBmap[BSIZE];
+  memset(freeBmap, 0, BSIZE);
+  memset(fullBmap, 0xff, BSIZE);
+  FreeExtentIndex idx(3, 1);
+  uint64_t unit;
+  EXPECT_FALSE(idx.allocUnit(unit));
+  idx.indexNextBmapBlock(fullBmap);
+  EXPECT_FALSE(idx.allocUnit(unit));
+  EXPECT_EQ(idx.getNextBmapBlockToIndex(), 1U);
+
+  // free before indexed is left to indexing
+  idx.freeUnit(BPB);
+  EXPECT_EQ(idx.getNumFreeUnits(), 0UL);
+
+  idx.indexNextBmapBlock(freeBmap);
+  EXPECT_EQ(idx.getNumFreeUnits(), uint64_t(BPB));
+  idx.indexNextBmapBlock(freeBmap);
+  // runs of adjacent bitmap blocks are coalesced
+  EXPECT_EQ(idx.getNumRuns(), 1UL);
+  EXPECT_TRUE(idx.isFullyIndexed());
+}
+
+TEST(FreeExtentIndexTest, SkipFrozenBmapBlock) {
+  char bmap[BSIZE];
+  memset(bmap, 0, BSIZE);
+  FreeExtentIndex idx(2, 2048);
+  idx.indexNextBmapBlock(bmap);
+  idx.indexNextBmapBlock(bmap);
+  idx.freezeBmapBlock(0);
+  EXPECT_TRUE(idx.isBmapBlockFrozen(0));
+  uint64_t unit;
+  ASSERT_TRUE(idx.allocUnit(unit));
+  EXPECT_EQ(idx.unitToBmapBlock(unit), 1U);
+  idx.freezeBmapBlock(1);
+  EXPECT_FALSE(idx.allocUnit(unit));
+  // the frozen blocks' units are still free, just not allocated from
+  EXPECT_EQ(idx.getNumFreeUnits(), idx.getNumUnits() - 1);
+  EXPECT_EQ(idx.getNumUsableRuns(), 0UL);
+  idx.thawBmapBlock(1);
+  ASSERT_TRUE(idx.allocUnit(unit));
+  EXPECT_EQ(idx.unitToBmapBlock(unit), 1U);
+}
+
+TEST(FreeExtentIndexTest, FreezeSplitsAndThawCoalesces) {
+  char bmap[BSIZE];
+  memset(bmap, 0, BSIZE);
+  FreeExtentIndex idx(3, 1);
+  for (int i = 0; i < 3; i++) idx.indexNextBmapBlock(bmap);
+  EXPECT_EQ(idx.getNumRuns(), 1UL);
+
+  // the run is cut at the frozen block's edges, and only the outer pieces
+  // stay allocatable
+  idx.freezeBmapBlock(1);
+  EXPECT_EQ(idx.getNumRuns(), 3UL);
+  EXPECT_EQ(idx.getNumUsableRuns(), 2UL);
+  EXPECT_EQ(idx.getNumFreeUnits(), 3UL * BPB);
+
+  // a freed unit of a frozen block does not join the neighbouring run
+  EXPECT_TRUE(idx.takeUnit(BPB - 1));
+  EXPECT_TRUE(idx.takeUnit(BPB));
+  idx.freeUnit(BPB);
+  EXPECT_EQ(idx.getNumRuns(), 3UL);
+  idx.freeUnit(BPB - 1);
+  EXPECT_EQ(idx.getNumRuns(), 3UL);
+
+  // nested: usable again after as many thaws
+  idx.freezeBmapBlock(1);
+  idx.thawBmapBlock(1);
+  EXPECT_TRUE(idx.isBmapBlockFrozen(1));
+  uint64_t unit;
+  for (uint64_t i = 0; i < 2UL * BPB; i++) {
+    ASSERT_TRUE(idx.allocUnit(unit));
+    EXPECT_NE(idx.unitToBmapBlock(unit), 1U);
+  }
+  EXPECT_FALSE(idx.allocUnit(unit));
+  for (uint64_t u = 0; u < BPB; u++) idx.freeUnit(u);
+  idx.thawBmapBlock(1);
+  EXPECT_FALSE(idx.isBmapBlockFrozen(1));
+  EXPECT_EQ(idx.getNumRuns(), 1UL);
+  EXPECT_EQ(idx.getNumUsableRuns(), 1UL);
+  EXPECT_EQ(idx.getNumFreeUnits(), 2UL * BPB);
+}
+
+TEST(FreeExtentIndexTest, FreezeBeforeIndexed) {
+  char bmap[BSIZE];
+  memset(bmap, 0, BSIZE);
+  FreeExtentIndex idx(2, 2 * BPB);
+  // any block of a unit freezes the whole unit
+  idx.freezeBmapBlock(1);
+  EXPECT_TRUE(idx.isBmapBlockFrozen(0));
+  idx.indexNextBmapBlock(bmap);
+  uint64_t unit;
+  EXPECT_FALSE(idx.allocUnit(unit));
+  EXPECT_EQ(idx.getNumFreeUnits(), 1UL);
+  idx.thawBmapBlock(0);
+  ASSERT_TRUE(idx.allocUnit(unit));
+  EXPECT_EQ(unit, 0UL);
+}
+
+TEST(FreeExtentIndexTest, LargeUnit) {
+  char freeBmap[BSIZE], usedBmap[BSIZE];
+  memset(freeBmap, 0, BSIZE);
+  memset(usedBmap, 1, BSIZE);
+  FreeExtentIndex idx(4, 2 * BPB);
+  EXPECT_FALSE(idx.isUnitFree(usedBmap, 0));
+  idx.indexNextBmapBlock(usedBmap);
+  idx.indexNextBmapBlock(freeBmap);
+  EXPECT_TRUE(idx.isFullyIndexed());
+  uint64_t unit;
+  ASSERT_TRUE(idx.allocUnit(unit));
+  EXPECT_EQ(unit, 1UL);
+  EXPECT_FALSE(idx.allocUnit(unit));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
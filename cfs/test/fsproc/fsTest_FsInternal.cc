@@ -1,4 +1,7 @@
 
+#include <map>
+#include <vector>
+
 #include "FsProc_FsInternal.h"
 #include "gtest/gtest.h"
 
@@ -35,6 +38,125 @@ TEST(FsExtentMapDiskBlock, T1) {
   }
 }
 
+TEST(FsExtentTree, Upgrade) {
+  cfs_dinode dinode;
+  memset(&dinode, 0, sizeof(dinode));
+  dinode.ext_array[0] = {0, 1, 5};
+  dinode.ext_array[1] = {1, 100, 4096};
+  // left behind by a deleted extent
+  dinode.ext_array[2] = {0, 0, 77};
+  EXPECT_FALSE(cfs_extent_tree_enabled(&dinode));
+  cfs_extent_tree_upgrade(&dinode);
+  EXPECT_TRUE(cfs_extent_tree_enabled(&dinode));
+  EXPECT_EQ(dinode.ext_header.entries, 2);
+  EXPECT_EQ(dinode.ext_header.depth, 0);
+  EXPECT_EQ(dinode.ext_array[1].block_no, 4096UL);
+  EXPECT_EQ(dinode.ext_array[2].block_no, 0UL);
+  // no-op once upgraded
+  dinode.ext_array[2] = {101, 1, 9000};
+  dinode.ext_header.entries = 3;
+  cfs_extent_tree_upgrade(&dinode);
+  EXPECT_EQ(dinode.ext_header.entries, 3);
+}
+
+TEST(FsExtentTree, Lookup) {
+  cfs_dinode dinode;
+  cfs_extent_tree_init(&dinode);
+  std::map<uint64_t, cfs_extent_node> nodes;
+  cfs_extent_node_init(&nodes[100], 0);
+  nodes[100].ents[0] = {0, 10, 1000};
+  nodes[100].ents[1] = {10, 5, 2000};
+  nodes[100].hdr.entries = 2;
+  cfs_extent_node_init(&nodes[200], 0);
+  nodes[200].ents[0] = {15, 20, 3000};
+  nodes[200].hdr.entries = 1;
+  dinode.ext_header.depth = 1;
+  dinode.ext_header.entries = 2;
+  dinode.ext_array[0] = {0, 0, 100};
+  dinode.ext_array[1] = {15, 0, 200};
+
+  std::vector<uint64_t> unavailable;
+  auto getNode = [&](uint64_t block_no) -> const cfs_extent_node * {
+    for (auto b : unavailable)
+      if (b == block_no) return nullptr;
+    return &nodes.at(block_no);
+  };
+  cfs_extent ext;
+  ASSERT_EQ(cfs_extent_tree_lookup(&dinode, 0, getNode, ext), 1);
+  EXPECT_EQ(ext.block_no, 1000UL);
+  ASSERT_EQ(cfs_extent_tree_lookup(&dinode, 12, getNode, ext), 1);
+  EXPECT_EQ(ext.block_no, 2000UL);
+  EXPECT_EQ(ext.i_block_offset, 10U);
+  ASSERT_EQ(cfs_extent_tree_lookup(&dinode, 34, getNode, ext), 1);
+  EXPECT_EQ(ext.block_no, 3000UL);
+  EXPECT_EQ(cfs_extent_tree_lookup(&dinode, 35, getNode, ext), -1);
+  unavailable.push_back(200);
+  EXPECT_EQ(cfs_extent_tree_lookup(&dinode, 20, getNode, ext), 0);
+  EXPECT_EQ(cfs_extent_tree_lookup(&dinode, 5, getNode, ext), 1);
+}
+
+TEST(FsExtentTree, AllocUnitOfDataBlock) {
+  uint32_t nBmapblocks = get_dev_bmap_num_blocks_for_worker(0);
+  for (int i = 0; i < NEXTENT_ARR; i++) {
+    uint32_t maxBmapBlocks;
+    uint64_t regionStart =
+        uint64_t(getDataBMapStartBlockNoForExtentArrIdx(i, nBmapblocks,
+                                                        maxBmapBlocks)) *
+        (BPB);
+    uint64_t unit = extentArrIdx2BlockAllocUnit(i);
+    if (uint64_t(maxBmapBlocks) * (BPB) < 2 * unit) continue;
+    uint64_t unitStart;
+    EXPECT_EQ(getAllocClassForDataBlock(regionStart, unitStart), i);
+    EXPECT_EQ(unitStart, regionStart);
+    EXPECT_EQ(getAllocClassForDataBlock(regionStart + unit + unit / 2,
+                                        unitStart),
+              i);
+    EXPECT_EQ(unitStart, regionStart + unit);
+    // same layout in the next worker's region
+    uint64_t nextWorker = uint64_t(nBmapblocks) * (BPB);
+    EXPECT_EQ(getAllocClassForDataBlock(nextWorker + regionStart, unitStart),
+              i);
+    EXPECT_EQ(unitStart, nextWorker + regionStart);
+
+    // an extent grown into the adjacent unit, the last one partially
+    cfs_extent ext{0, uint32_t(unit + 1), regionStart};
+    std::vector<uint64_t> units;
+    forEachAllocUnitOfExtent(ext, [&](uint64_t start, int cls) {
+      EXPECT_EQ(cls, i);
+      units.push_back(start);
+    });
+    ASSERT_EQ(units.size(), 2UL);
+    EXPECT_EQ(units[1], regionStart + unit);
+  }
+}
+
+TEST(FsExtentTree, BmapRegionsOfSmallDevice) {
+  // fewer bitmap blocks than the last extent alone would take, down to tiny
+  for (uint32_t total : {2000U, 640U, 597U, 320U, 240U, 64U, 16U}) {
+    uint32_t end = 0;
+    for (int i = 0; i < NEXTENT_ARR; i++) {
+      uint32_t maxBmapBlocks;
+      uint32_t start =
+          getDataBMapStartBlockNoForExtentArrIdx(i, total, maxBmapBlocks);
+      // in order, without overlapping, within the worker's bitmap blocks
+      EXPECT_GE(start, end) << "total " << total << " class " << i;
+      end = start + maxBmapBlocks;
+      EXPECT_LE(end, total) << "total " << total << " class " << i;
+      if (kFsPerExtShareArr[i] > 0 && total >= 64) {
+        EXPECT_GT(maxBmapBlocks, 0U) << "total " << total << " class " << i;
+      }
+    }
+  }
+}
+
+TEST(FsExtentTree, AllocClass) {
+  EXPECT_EQ(getExtentTreeAllocClass(0), 0);
+  EXPECT_EQ(getExtentTreeAllocClass(EXTENT_TREE_SMALL_FILE_BLOCKS - 1), 0);
+  EXPECT_EQ(getExtentTreeAllocClass(EXTENT_TREE_SMALL_FILE_BLOCKS), 1);
+  // unbounded: the largest class repeats
+  EXPECT_EQ(getExtentTreeAllocClass(UINT32_MAX), NEXTENT_ARR - 1);
+}
+
 }  // namespace
 
 int main(int argc, char **argv) {
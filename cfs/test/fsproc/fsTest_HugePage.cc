@@ -0,0 +1,132 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "FsHugePage.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+constexpr size_t kMB = 1UL << 20;
+
+class HugePageTest : public ::testing::Test {
+ protected:
+  void SetUp() override { saved_ = fs_hugepage::config(); }
+  void TearDown() override { fs_hugepage::config() = saved_; }
+
+ private:
+  fs_hugepage::Config saved_;
+};
+
+TEST_F(HugePageTest, OffOrSmallFallsBack) {
+  fs_hugepage::Backend backend = fs_hugepage::Backend::kThp;
+  EXPECT_EQ(fs_hugepage::mapAnon(kMB, &backend), nullptr);
+  EXPECT_EQ(backend, fs_hugepage::Backend::kNone);
+
+  fs_hugepage::config().hugetlbPageSize = 0;
+  fs_hugepage::config().thp = false;
+  EXPECT_EQ(fs_hugepage::mapAnon(8 * kMB, &backend), nullptr);
+  EXPECT_EQ(backend, fs_hugepage::Backend::kNone);
+}
+
+TEST_F(HugePageTest, ThpIsAlignedAndZeroed) {
+  fs_hugepage::config().hugetlbPageSize = 0;
+  size_t size = 5 * kMB + 4096;
+  fs_hugepage::Backend backend;
+  char *buf = static_cast<char *>(fs_hugepage::mapAnon(size, &backend));
+  ASSERT_NE(buf, nullptr);
+  EXPECT_EQ(backend, fs_hugepage::Backend::kThp);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(buf) % (2 * kMB), 0U);
+  for (size_t off = 0; off < size; off += 4096) ASSERT_EQ(buf[off], 0);
+  memset(buf, 1, size);
+  EXPECT_TRUE(fs_hugepage::unmap(buf));
+  // already unmapped
+  EXPECT_FALSE(fs_hugepage::unmap(buf));
+}
+
+TEST_F(HugePageTest, HugetlbOrThp) {
+  // with no reserved huge pages, it falls back to THP
+  size_t size = 4 * kMB;
+  fs_hugepage::Backend backend;
+  char *buf = static_cast<char *>(fs_hugepage::mapAnon(size, &backend));
+  ASSERT_NE(buf, nullptr);
+  EXPECT_NE(backend, fs_hugepage::Backend::kNone);
+  memset(buf, 1, size);
+  EXPECT_TRUE(fs_hugepage::unmap(buf));
+}
+
+TEST_F(HugePageTest, UnknownAddrIsNotUnmapped) {
+  void *ptr = malloc(64);
+  EXPECT_FALSE(fs_hugepage::unmap(ptr));
+  free(ptr);
+}
+
+TEST_F(HugePageTest, ShmNeedsHugetlbfs) {
+  // opt-in: no mount unless CFS_HUGETLBFS_DIR gives one
+  EXPECT_TRUE(fs_hugepage::Config().hugetlbfsDir.empty());
+  fs_hugepage::config().hugetlbfsDir = "";
+  EXPECT_EQ(fs_hugepage::mapShm("fsTest_HugePage", 4 * kMB, true), nullptr);
+  // /tmp is not a hugetlbfs mount
+  fs_hugepage::config().hugetlbfsDir = "/tmp";
+  EXPECT_EQ(fs_hugepage::mapShm("fsTest_HugePage", 4 * kMB, true), nullptr);
+  EXPECT_EQ(fs_hugepage::mapShm("fsTest_HugePage", 4 * kMB, false), nullptr);
+  EXPECT_NE(access("/tmp/fsTest_HugePage", F_OK), 0);
+}
+
+const char *kShm = "fsTest_HugePage";
+
+// with a hugetlbfs mount of free huge pages in CFS_HUGETLBFS_DIR
+class HugetlbfsShmTest : public HugePageTest {
+ protected:
+  void SetUp() override {
+    HugePageTest::SetUp();
+    if (fs_hugepage::config().hugetlbfsDir.empty())
+      GTEST_SKIP() << "CFS_HUGETLBFS_DIR not set";
+    path = fs_hugepage::config().hugetlbfsDir + "/" + kShm;
+  }
+
+  char *create() {
+    void *ptr = fs_hugepage::mapShm(kShm, 4 * kMB, /*create*/ true);
+    return static_cast<char *>(ptr);
+  }
+  bool fileExists() { return access(path.c_str(), F_OK) == 0; }
+
+  std::string path;
+};
+
+TEST_F(HugetlbfsShmTest, FileRemovedOnAttach) {
+  // left by a run that died before its peer attached
+  close(open(path.c_str(), O_CREAT | O_RDWR, 0666));
+  char *created = create();
+  if (created == nullptr) GTEST_SKIP() << "no free huge pages";
+  EXPECT_TRUE(fileExists());
+  char *attached = static_cast<char *>(
+      fs_hugepage::mapShm(kShm, 4 * kMB, /*create*/ false));
+  ASSERT_NE(attached, nullptr);
+  EXPECT_FALSE(fileExists());
+  // still shared
+  created[4096] = 'x';
+  EXPECT_EQ(attached[4096], 'x');
+  EXPECT_TRUE(fs_hugepage::unmap(attached));
+  EXPECT_TRUE(fs_hugepage::unmap(created));
+}
+
+TEST_F(HugetlbfsShmTest, FileRemovedOnUnmap) {
+  char *created = create();
+  if (created == nullptr) GTEST_SKIP() << "no free huge pages";
+  EXPECT_TRUE(fileExists());
+  // the peer never attached
+  EXPECT_TRUE(fs_hugepage::unmap(created));
+  EXPECT_FALSE(fileExists());
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "IndexedHeap.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using sched::IndexedHeap;
+
+// the id a linear scan picks: the best key, ties to the smaller id
+template <typename Better>
+int scan_best(const std::vector<int64_t>& keys, int except, Better better) {
+  int best = -1;
+  for (int i = 0; i < int(keys.size()); ++i) {
+    if (i == except) continue;
+    if (best < 0 || better(keys[i], keys[best])) best = i;
+  }
+  return best;
+}
+
+TEST(IndexedHeapTest, TopAndSecond) {
+  IndexedHeap<int64_t> heap({3, 7, 7, 1});
+  EXPECT_EQ(heap.size(), 4U);
+  EXPECT_EQ(heap.top(), 1);  // ties go to the smaller id
+  EXPECT_EQ(heap.second(), 2);
+  EXPECT_EQ(heap.get_key(3), 1);
+
+  heap.update(3, 10);
+  EXPECT_EQ(heap.top(), 3);
+  EXPECT_EQ(heap.second(), 1);
+  heap.update(3, 0);
+  heap.update(1, 2);
+  EXPECT_EQ(heap.top(), 2);
+  EXPECT_EQ(heap.second(), 0);
+}
+
+TEST(IndexedHeapTest, MinHeapOfTwo) {
+  IndexedHeap<int64_t, std::less<int64_t>> heap({5, 4});
+  EXPECT_EQ(heap.top(), 1);
+  EXPECT_EQ(heap.second(), 0);
+  heap.update(1, 6);
+  EXPECT_EQ(heap.top(), 0);
+  EXPECT_EQ(heap.second(), 1);
+}
+
+TEST(IndexedHeapTest, RandomUpdates) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int64_t> key_distr(0, 50);  // many ties
+  for (int n : {2, 3, 17, 100}) {
+    std::vector<int64_t> keys(n);
+    for (auto& k : keys) k = key_distr(rng);
+    IndexedHeap<int64_t, std::less<int64_t>> heap(keys);
+    std::uniform_int_distribution<int> id_distr(0, n - 1);
+    for (int i = 0; i < 1000; ++i) {
+      int id = id_distr(rng);
+      keys[id] = key_distr(rng);
+      heap.update(id, keys[id]);
+      int top = scan_best(keys, -1, std::less<int64_t>());
+      ASSERT_EQ(heap.top(), top);
+      ASSERT_EQ(heap.second(), scan_best(keys, top, std::less<int64_t>()));
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,139 @@
+#include <map>
+#include <vector>
+
+#include "FsProc_InodeQuiescer.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+struct FakeApp {
+  int aid;
+};
+
+struct FakeReq {
+  cfs_ino_t ino;
+  int wid;  // where it is served; -1 while held
+  int numRedirects{0};
+  int numReleases{0};
+};
+
+using Quiescer = InodeQuiescer<FakeApp, FakeReq>;
+using InodeState = Quiescer::InodeState;
+
+// a worker serving requests on its inodes, the way FsProcWorker does it
+struct FakeWorker {
+  int wid;
+  Quiescer quiescing;
+  std::map<cfs_ino_t, int> numInProgress;
+  std::map<cfs_ino_t, int> owner;
+  std::vector<cfs_ino_t> gone;
+
+  // @return true if the request is held
+  bool recv(FakeReq *req) {
+    if (quiescing.hold(req->ino, req)) {
+      req->wid = -1;
+      return true;
+    }
+    req->wid = wid;
+    return false;
+  }
+
+  int exportQuiesced() {
+    auto stateOf = [this](cfs_ino_t ino) {
+      for (cfs_ino_t g : gone)
+        if (g == ino) return InodeState::kGone;
+      return numInProgress[ino] > 0 ? InodeState::kBusy : InodeState::kIdle;
+    };
+    auto exportInode = [this](cfs_ino_t ino, FakeApp *, int dstWid,
+                              std::vector<FakeReq *> &&held) {
+      owner[ino] = dstWid;
+      for (auto req : held) {
+        req->wid = dstWid;
+        req->numRedirects++;
+      }
+    };
+    auto release = [this](FakeReq *req) {
+      req->numReleases++;
+      recv(req);
+    };
+    return quiescing.exportIdle(stateOf, exportInode, release);
+  }
+};
+
+TEST(InodeQuiescerTest, HoldThenRedirectOnce) {
+  FakeApp app{1};
+  FakeWorker w{.wid = 0};
+  w.owner[10] = 0;
+  w.owner[11] = 0;
+  // two requests on inode 10 in flight when the migration starts
+  w.numInProgress[10] = 2;
+  ASSERT_TRUE(w.quiescing.quiesce(10, &app, 3));
+  EXPECT_FALSE(w.quiescing.quiesce(10, &app, 4));
+
+  // new requests on it are held, the ones on other inodes are not
+  FakeReq held1{.ino = 10, .wid = 0}, held2{.ino = 10, .wid = 0};
+  FakeReq other{.ino = 11, .wid = 0};
+  EXPECT_TRUE(w.recv(&held1));
+  EXPECT_TRUE(w.recv(&held2));
+  EXPECT_FALSE(w.recv(&other));
+  EXPECT_EQ(other.wid, 0);
+  EXPECT_EQ(w.quiescing.numHeld(10), 2U);
+
+  // not exported while any request is in progress
+  EXPECT_EQ(w.exportQuiesced(), 0);
+  w.numInProgress[10] = 1;
+  EXPECT_EQ(w.exportQuiesced(), 0);
+  EXPECT_EQ(held1.wid, -1);
+  EXPECT_EQ(w.owner[10], 0);
+
+  w.numInProgress[10] = 0;
+  EXPECT_EQ(w.exportQuiesced(), 1);
+  EXPECT_EQ(w.owner[10], 3);
+  for (auto req : {&held1, &held2}) {
+    EXPECT_EQ(req->wid, 3);
+    EXPECT_EQ(req->numRedirects, 1);
+    EXPECT_EQ(req->numReleases, 0);
+  }
+
+  // nothing is handed over twice, and later requests are not held
+  EXPECT_TRUE(w.quiescing.empty());
+  EXPECT_EQ(w.exportQuiesced(), 0);
+  EXPECT_EQ(held1.numRedirects, 1);
+  FakeReq late{.ino = 10, .wid = 0};
+  EXPECT_FALSE(w.recv(&late));
+  EXPECT_EQ(other.numRedirects, 0);
+}
+
+TEST(InodeQuiescerTest, GoneInodeReleasesHeld) {
+  FakeApp app{1};
+  FakeWorker w{.wid = 0};
+  w.numInProgress[20] = 1;
+  w.numInProgress[21] = 1;
+  ASSERT_TRUE(w.quiescing.quiesce(20, &app, 2));
+  ASSERT_TRUE(w.quiescing.quiesce(21, &app, 2));
+  FakeReq r20{.ino = 20, .wid = 0}, r21{.ino = 21, .wid = 0};
+  EXPECT_TRUE(w.recv(&r20));
+  EXPECT_TRUE(w.recv(&r21));
+
+  // inode 20 is unlinked while quiescing: its request is served here
+  w.gone.push_back(20);
+  EXPECT_EQ(w.exportQuiesced(), 0);
+  EXPECT_EQ(r20.numReleases, 1);
+  EXPECT_EQ(r20.numRedirects, 0);
+  EXPECT_EQ(r20.wid, 0);
+  EXPECT_TRUE(w.quiescing.contains(21));
+  EXPECT_EQ(r21.wid, -1);
+
+  w.numInProgress[21] = 0;
+  EXPECT_EQ(w.exportQuiesced(), 1);
+  EXPECT_EQ(r21.numRedirects, 1);
+  EXPECT_EQ(r21.numReleases, 0);
+  EXPECT_EQ(r21.wid, 2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,130 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FsProc_Messenger.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+
+// what a worker does on a PREPARE_FOR_CHECKPOINTING message
+struct PrepareCtx {
+  std::atomic_bool completed{false};
+};
+
+// the workers' side of FsProc: the parked ones nap on a condition variable,
+// which the messenger's wakeup notifies, as in FsProc::waitWorkerActive()
+class FakeWorkers {
+ public:
+  explicit FakeWorkers(size_t n) : messenger(n, 64), active(n) {
+    messenger.set_wakeup([this](int) {
+      { std::lock_guard<std::mutex> lock(mtx); }
+      cv.notify_all();
+    });
+    for (auto &a : active) a = true;
+  }
+  ~FakeWorkers() {
+    running = false;
+    { std::lock_guard<std::mutex> lock(mtx); }
+    cv.notify_all();
+    for (auto &t : threads) t.join();
+  }
+
+  void park(int wid) { active[wid] = false; }
+  void start(std::chrono::microseconds nap) {
+    for (size_t wid = 0; wid < active.size(); ++wid)
+      threads.emplace_back([this, wid, nap] { run(wid, nap); });
+  }
+
+  FsProcMessenger messenger;
+  std::atomic_int num_naps{0};
+
+ private:
+  void run(int wid, std::chrono::microseconds nap) {
+    while (running) {
+      if (!active[wid]) {
+        messenger.set_sleeping(wid, true);
+        {
+          std::unique_lock<std::mutex> lock(mtx);
+          cv.wait_for(lock, nap, [&] {
+            return active[wid] || !running || messenger.has_pending(wid);
+          });
+        }
+        messenger.set_sleeping(wid, false);
+        ++num_naps;
+      }
+      FsProcMessage msg;
+      while (messenger.recv_message(wid, msg)) {
+        if (msg.type == PREPARE_FOR_CHECKPOINTING)
+          static_cast<PrepareCtx *>(msg.ctx)->completed = true;
+      }
+    }
+  }
+
+  std::vector<std::atomic_bool> active;
+  std::atomic_bool running{true};
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::vector<std::thread> threads;
+};
+
+TEST(MessengerTest, HasPending) {
+  FsProcMessenger messenger(2, 64);
+  EXPECT_FALSE(messenger.has_pending(1));
+  FsProcMessage msg{.type = PREPARE_FOR_CHECKPOINTING, .ctx = nullptr};
+  FsProcMessage msgs[2] = {msg, msg};
+  messenger.send_messages(1, msgs, 2);
+  EXPECT_TRUE(messenger.has_pending(1));
+  EXPECT_FALSE(messenger.has_pending(0));
+  // one of them is buffered by recv_message(), and still pending
+  ASSERT_TRUE(messenger.recv_message(1, msg));
+  EXPECT_TRUE(messenger.has_pending(1));
+  ASSERT_TRUE(messenger.recv_message(1, msg));
+  EXPECT_FALSE(messenger.has_pending(1));
+}
+
+// checkpointAllJournals() sends PREPARE_FOR_CHECKPOINTING to every worker and
+// spins until all of them complete it, parked ones included
+TEST(MessengerTest, CheckpointWakesParkedWorker) {
+  constexpr size_t kNumWorkers = 3;
+  FakeWorkers workers(kNumWorkers);
+  workers.park(2);
+  // so long that only the message can wake the parked worker up in time
+  workers.start(std::chrono::seconds(60));
+  std::this_thread::sleep_for(10ms);  // let it fall asleep
+
+  auto begin = std::chrono::steady_clock::now();
+  PrepareCtx ctx[kNumWorkers];
+  for (size_t wid = 1; wid < kNumWorkers; ++wid) {
+    FsProcMessage msg{.type = PREPARE_FOR_CHECKPOINTING, .ctx = &ctx[wid]};
+    workers.messenger.send_message(wid, msg);
+  }
+  for (size_t wid = 1; wid < kNumWorkers; ++wid) {
+    while (!ctx[wid].completed) {
+      ASSERT_LT(std::chrono::steady_clock::now() - begin, 10s);
+      std::this_thread::yield();
+    }
+  }
+}
+
+TEST(MessengerTest, ParkedWorkerNaps) {
+  FakeWorkers workers(2);
+  workers.park(1);
+  workers.start(1ms);
+  std::this_thread::sleep_for(100ms);
+  // it wakes up to poll, but does not spin
+  EXPECT_GT(workers.num_naps, 10);
+  EXPECT_LT(workers.num_naps, 1000);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
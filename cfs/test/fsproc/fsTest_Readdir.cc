@@ -0,0 +1,251 @@
+#include <cstdio>
+#include <set>
+#include <vector>
+
+#include "FsProc_Readdir.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using fsp_readdir::kDentriesPerBlock;
+
+// the dentry blocks of a directory; a block may be a hole or not in memory
+struct FakeDir {
+  std::vector<std::vector<cfs_dirent>> blocks;
+  std::set<uint64_t> holes;
+  std::set<uint64_t> notInMem;
+  int numVisits = 0;
+
+  uint64_t numSlots() const { return blocks.size() * kDentriesPerBlock; }
+  cfs_dirent &slot(uint64_t s) {
+    return blocks[s / kDentriesPerBlock][s % kDentriesPerBlock];
+  }
+  // create a dentry for `ino` in slot `s`
+  void link(uint64_t s, uint32_t ino) {
+    while (blocks.size() <= s / kDentriesPerBlock)
+      blocks.emplace_back(kDentriesPerBlock, cfs_dirent{});
+    slot(s).inum = ino;
+    snprintf(slot(s).name, DIRSIZE, "f%u", ino);
+  }
+  void unlink(uint64_t s) { slot(s).inum = 0; }
+
+  bool collect(uint64_t &cursor, uint32_t maxEntries,
+               std::vector<cfs_dirent> &dentries) {
+    auto visitBlock = [this](uint64_t i, auto &&visit) {
+      numVisits++;
+      if (holes.count(i)) return -1;
+      if (notInMem.erase(i)) return 0;
+      visit(blocks[i].data());
+      return 1;
+    };
+    return fsp_readdir::collectDentries(numSlots(), cursor, maxEntries,
+                                        visitBlock, dentries);
+  }
+
+  // list the dir in chunks of `chunk`, as fs_readdir does
+  std::vector<uint32_t> list(uint32_t chunk, int *numChunks = nullptr) {
+    std::vector<uint32_t> inos;
+    std::vector<cfs_dirent> dentries;
+    uint64_t cursor = 0;
+    int n = 0;
+    do {
+      EXPECT_TRUE(collect(cursor, chunk, dentries));
+      for (auto &d : dentries) inos.push_back(d.inum);
+      n++;
+    } while (dentries.size() == chunk);
+    if (numChunks != nullptr) *numChunks = n;
+    return inos;
+  }
+};
+
+TEST(ReaddirTest, StreamsAllEntries) {
+  FakeDir dir;
+  std::vector<uint32_t> expected;
+  // three blocks, the middle one a hole, with unlinked slots here and there
+  for (uint64_t s = 0; s < 3 * kDentriesPerBlock; s++) {
+    if (s / kDentriesPerBlock == 1) continue;
+    dir.link(s, 100 + s);
+    if (s % 7 == 3) {
+      dir.unlink(s);
+    } else {
+      expected.push_back(100 + s);
+    }
+  }
+  dir.link(kDentriesPerBlock, 1);  // lays the hole out
+  dir.unlink(kDentriesPerBlock);
+  dir.holes.insert(1);
+  int numChunks;
+  EXPECT_EQ(dir.list(10, &numChunks), expected);
+  EXPECT_EQ(numChunks, int(expected.size() / 10 + 1));
+  // one chunk for all of them
+  EXPECT_EQ(dir.list(1000), expected);
+}
+
+TEST(ReaddirTest, PendingIoKeepsCursor) {
+  FakeDir dir;
+  for (uint64_t s = 0; s < 2 * kDentriesPerBlock; s++) dir.link(s, 1 + s);
+  dir.notInMem.insert(1);
+  // the chunk spans both blocks: nothing is returned until block 1 is read
+  uint64_t cursor = kDentriesPerBlock - 2;
+  std::vector<cfs_dirent> dentries;
+  EXPECT_FALSE(dir.collect(cursor, 4, dentries));
+  EXPECT_EQ(cursor, kDentriesPerBlock - 2);
+  EXPECT_TRUE(dir.collect(cursor, 4, dentries));
+  ASSERT_EQ(dentries.size(), 4U);
+  EXPECT_EQ(dentries[0].inum, kDentriesPerBlock - 1);
+  EXPECT_EQ(dentries[3].inum, kDentriesPerBlock + 2);
+  EXPECT_EQ(cursor, kDentriesPerBlock + 2);
+}
+
+TEST(ReaddirTest, CursorNeverExpires) {
+  FakeDir dir;
+  for (uint64_t s = 0; s < 20; s++) dir.link(s, 1 + s);
+  std::vector<cfs_dirent> dentries;
+  uint64_t cursor = 0;
+  ASSERT_TRUE(dir.collect(cursor, 5, dentries));
+  EXPECT_EQ(cursor, 5U);
+
+  // the dir changes before the next chunk: the entries keep their slots, so
+  // the cursor still points after the ones already returned
+  dir.unlink(2);        // returned already: nothing moves
+  dir.unlink(6);        // not reached yet: skipped
+  dir.link(3, 1000);    // reused slot before the cursor: missed
+  dir.link(12, 12000);  // after the cursor: returned
+  dir.link(kDentriesPerBlock + 1, 2000);  // the dir grows: returned
+  std::vector<uint32_t> rest;
+  while (dir.collect(cursor, 5, dentries) && !dentries.empty())
+    for (auto &d : dentries) rest.push_back(d.inum);
+  std::vector<uint32_t> expected = {6, 8, 9, 10, 11, 12, 12000};
+  for (uint32_t ino = 14; ino <= 20; ino++) expected.push_back(ino);
+  expected.push_back(2000);
+  EXPECT_EQ(rest, expected);
+
+  // a cursor at or past the end is still valid, and returns no entry
+  uint64_t end = cursor;
+  EXPECT_EQ(end, dir.numSlots());
+  uint64_t past = end + 1000;
+  ASSERT_TRUE(dir.collect(past, 5, dentries));
+  EXPECT_TRUE(dentries.empty());
+  EXPECT_EQ(past, end + 1000);
+  // and an old cursor can be replayed any time
+  uint64_t old = 5;
+  ASSERT_TRUE(dir.collect(old, 2, dentries));
+  ASSERT_EQ(dentries.size(), 2U);
+  EXPECT_EQ(dentries[0].inum, 6U);
+  EXPECT_EQ(dentries[1].inum, 8U);
+  // no block after the cursor's is read
+  dir.numVisits = 0;
+  uint64_t last = kDentriesPerBlock;
+  ASSERT_TRUE(dir.collect(last, 1, dentries));
+  EXPECT_EQ(dir.numVisits, 1);
+}
+
+TEST(ReaddirTest, PackEntries) {
+  std::vector<cfs_dirent> dentries(2);
+  dentries[0].inum = 7;
+  memset(dentries[0].name, 'a', DIRSIZE);  // not terminated on disk
+  dentries[1].inum = 9;
+  strcpy(dentries[1].name, "b");
+
+  readdirEnt ents[2];
+  fsp_readdir::packEntries(reinterpret_cast<char *>(ents), dentries, false);
+  EXPECT_EQ(ents[0].ino, 7U);
+  EXPECT_EQ(ents[0].type, DT_UNKNOWN);
+  EXPECT_EQ(strlen(ents[0].name), size_t(DIRSIZE - 1));
+  EXPECT_STREQ(ents[1].name, "b");
+
+  readdirPlusEnt plusEnts[2];
+  plusEnts[1].hasAttrs = 1;
+  fsp_readdir::packEntries(reinterpret_cast<char *>(plusEnts), dentries, true);
+  EXPECT_EQ(plusEnts[1].ent.ino, 9U);
+  EXPECT_STREQ(plusEnts[1].ent.name, "b");
+  EXPECT_EQ(plusEnts[1].hasAttrs, 0);
+}
+
+struct FakeInode {
+  uint32_t ino;
+  bool isDir;
+};
+
+// the primary's side of readdirplus: the inodes it owns, and which of them
+// are in memory
+struct FakePrimary {
+  std::set<uint32_t> owned;
+  std::set<uint32_t> notInMem;
+  std::set<uint32_t> missing;
+  std::vector<uint32_t> gets;
+  std::vector<FakeInode> inodes = std::vector<FakeInode>(100);
+  bool pending = false;
+
+  int fill(readdirPlusEnt *ents, int num) {
+    pending = false;
+    return fsp_readdir::fillAttrs<FakeInode>(
+        ents, num, [this](uint32_t ino) { return owned.count(ino) > 0; },
+        [this](uint32_t ino) -> FakeInode * {
+          gets.push_back(ino);
+          if (missing.count(ino)) return nullptr;
+          if (notInMem.erase(ino)) {
+            pending = true;
+            return nullptr;
+          }
+          inodes[ino] = {ino, ino % 2 == 0};
+          return &inodes[ino];
+        },
+        [this]() { return pending; },
+        [](FakeInode *inode, readdirPlusEnt *ent) {
+          ent->statbuf.st_ino = inode->ino;
+          ent->ent.type = inode->isDir ? DT_DIR : DT_REG;
+        });
+  }
+};
+
+std::vector<readdirPlusEnt> makePlusEnts(std::vector<uint32_t> inos) {
+  std::vector<cfs_dirent> dentries(inos.size());
+  for (size_t k = 0; k < inos.size(); k++) dentries[k].inum = inos[k];
+  std::vector<readdirPlusEnt> ents(inos.size());
+  fsp_readdir::packEntries(reinterpret_cast<char *>(ents.data()), dentries,
+                           true);
+  return ents;
+}
+
+TEST(ReaddirTest, PlusFillsOwnedInodesOnly) {
+  FakePrimary primary;
+  primary.owned = {2, 3, 5};
+  auto ents = makePlusEnts({2, 3, 4, 5, 6});
+  EXPECT_EQ(primary.fill(ents.data(), ents.size()), 1);
+  // the inodes of the other workers are not touched
+  EXPECT_EQ(primary.gets, (std::vector<uint32_t>{2, 3, 5}));
+  for (auto &ent : ents) {
+    bool owned = primary.owned.count(ent.ent.ino) > 0;
+    EXPECT_EQ(ent.hasAttrs, owned ? 1 : 0);
+    if (!owned) {
+      EXPECT_EQ(ent.ent.type, DT_UNKNOWN);
+      continue;
+    }
+    EXPECT_EQ(ent.statbuf.st_ino, ent.ent.ino);
+    EXPECT_EQ(ent.ent.type, ent.ent.ino % 2 == 0 ? DT_DIR : DT_REG);
+  }
+}
+
+TEST(ReaddirTest, PlusReadsMissingInodesTogether) {
+  FakePrimary primary;
+  primary.owned = {1, 2, 3};
+  primary.notInMem = {1, 3};
+  auto ents = makePlusEnts({1, 2, 3});
+  // both reads are started before waiting
+  EXPECT_EQ(primary.fill(ents.data(), ents.size()), 0);
+  EXPECT_EQ(primary.gets, (std::vector<uint32_t>{1, 2, 3}));
+  for (auto &ent : ents) EXPECT_EQ(ent.hasAttrs, 0);
+  EXPECT_EQ(primary.fill(ents.data(), ents.size()), 1);
+  for (auto &ent : ents) EXPECT_EQ(ent.hasAttrs, 1);
+
+  primary.missing = {2};
+  EXPECT_EQ(primary.fill(ents.data(), ents.size()), -1);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,105 @@
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <utility>
+
+#include "RingQueue.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using sched::QlenHist;
+using sched::RingQueue;
+
+TEST(RingQueueTest, Fifo) {
+  RingQueue<int> q(4);
+  EXPECT_TRUE(q.empty());
+  EXPECT_EQ(q.capacity(), 4U);
+  // wrap around a few times without growing
+  for (int i = 0; i < 10; ++i) {
+    q.push(2 * i);
+    q.push(2 * i + 1);
+    EXPECT_EQ(q.front(), i);
+    q.pop();
+  }
+  EXPECT_EQ(q.size(), 10U);
+  for (int i = 10; i < 20; ++i) {
+    EXPECT_EQ(q.front(), i);
+    q.pop();
+  }
+  EXPECT_TRUE(q.empty());
+}
+
+TEST(RingQueueTest, CapacityRoundsUp) {
+  RingQueue<int> q(5);
+  EXPECT_EQ(q.capacity(), 8U);
+  RingQueue<int> one(0);
+  EXPECT_EQ(one.capacity(), 1U);
+}
+
+TEST(RingQueueTest, GrowKeepsOrder) {
+  RingQueue<std::pair<int, int>> q(4);
+  // move the head off 0 first, so the entries wrap when it grows
+  for (int i = 0; i < 3; ++i) q.push({-1, -1});
+  for (int i = 0; i < 3; ++i) q.pop();
+  for (int i = 0; i < 100; ++i) q.push({i, -i});
+  EXPECT_EQ(q.size(), 100U);
+  EXPECT_EQ(q.capacity(), 128U);
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(q.front().first, i);
+    EXPECT_EQ(q.front().second, -i);
+    q.pop();
+  }
+  EXPECT_TRUE(q.empty());
+}
+
+TEST(RingQueueTest, MatchesDeque) {
+  RingQueue<uint64_t> q(2);
+  std::deque<uint64_t> ref;
+  std::mt19937 rng(7);
+  uint64_t next = 0;
+  for (int i = 0; i < 100000; ++i) {
+    if (ref.empty() || rng() % 3 != 0) {
+      q.push(next);
+      ref.push_back(next++);
+    } else {
+      ASSERT_EQ(q.front(), ref.front());
+      q.pop();
+      ref.pop_front();
+    }
+    ASSERT_EQ(q.size(), ref.size());
+  }
+}
+
+TEST(QlenHistTest, Buckets) {
+  EXPECT_EQ(QlenHist::bucket_of(0), 0U);
+  EXPECT_EQ(QlenHist::bucket_of(1), 1U);
+  EXPECT_EQ(QlenHist::bucket_of(2), 2U);
+  EXPECT_EQ(QlenHist::bucket_of(3), 2U);
+  EXPECT_EQ(QlenHist::bucket_of(4), 3U);
+  EXPECT_EQ(QlenHist::bucket_of(1UL << 40),
+            sched::params::qlen_hist_buckets - 1);
+  for (uint32_t b = 0; b < sched::params::qlen_hist_buckets; ++b)
+    EXPECT_EQ(QlenHist::bucket_of(QlenHist::bucket_min(b)), b);
+}
+
+TEST(QlenHistTest, Quantile) {
+  QlenHist hist;
+  EXPECT_EQ(hist.total(), 0U);
+  for (int i = 0; i < 90; ++i) hist.record(0);
+  for (int i = 0; i < 9; ++i) hist.record(5);
+  hist.record(100);
+  EXPECT_EQ(hist.total(), 100U);
+  EXPECT_EQ(hist.get(0), 90U);
+  EXPECT_EQ(hist.get(QlenHist::bucket_of(5)), 9U);
+  EXPECT_EQ(hist.quantile_bucket(0.5), 0U);
+  EXPECT_EQ(hist.quantile_bucket(0.95), QlenHist::bucket_of(5));
+  EXPECT_EQ(hist.quantile_bucket(0.995), QlenHist::bucket_of(100));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
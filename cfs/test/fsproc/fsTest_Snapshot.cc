@@ -0,0 +1,120 @@
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Snapshot.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using sched::ResrcAlloc;
+using sched::snapshot::Snapshot;
+
+Snapshot make_snapshot() {
+  Snapshot s(2, 3);
+  s.journal_chkpts = {1700000000000000UL, 1700000000123456UL};
+  for (int wid = 0; wid < 2; ++wid) {
+    for (int aid = 0; aid < 3; ++aid) {
+      auto& t = s.tenants[wid][aid];
+      t.resrc = {.cache_size = uint32_t(1000 * (aid + 1)),
+                 .bandwidth = 500 * (wid + 1),
+                 .cpu_cycles = 1'000'000L * (aid + wid)};
+      for (uint32_t i = 0; i < uint32_t(aid * 10); ++i)
+        t.blocks.emplace_back(1000 * wid + i, aid + 2);
+    }
+  }
+  return s;
+}
+
+TEST(SnapshotTest, RoundTrip) {
+  Snapshot s = make_snapshot();
+  std::stringstream ss;
+  ASSERT_EQ(s.save(ss), "");
+
+  Snapshot loaded;
+  ASSERT_EQ(loaded.load(ss), "");
+  ASSERT_EQ(loaded.num_workers, 2);
+  ASSERT_EQ(loaded.num_apps, 3);
+  EXPECT_EQ(loaded.journal_chkpts, s.journal_chkpts);
+  for (int wid = 0; wid < 2; ++wid) {
+    for (int aid = 0; aid < 3; ++aid) {
+      const auto& a = s.tenants[wid][aid];
+      const auto& b = loaded.tenants[wid][aid];
+      EXPECT_EQ(a.resrc.cache_size, b.resrc.cache_size);
+      EXPECT_EQ(a.resrc.bandwidth, b.resrc.bandwidth);
+      EXPECT_EQ(a.resrc.cpu_cycles, b.resrc.cpu_cycles);
+      EXPECT_EQ(a.blocks, b.blocks);
+    }
+  }
+}
+
+TEST(SnapshotTest, RejectCorrupted) {
+  Snapshot loaded;
+  std::stringstream garbage("not a snapshot at all");
+  EXPECT_NE(loaded.load(garbage), "");
+
+  std::stringstream ss;
+  ASSERT_EQ(make_snapshot().save(ss), "");
+  std::string bytes = ss.str();
+  std::stringstream truncated(bytes.substr(0, bytes.size() - 4));
+  EXPECT_NE(loaded.load(truncated), "");
+}
+
+// a start takes the snapshot away, so that a crash cannot restore it again
+TEST(SnapshotTest, TakeFileOnce) {
+  char dir[] = "/tmp/fsTest_Snapshot_XXXXXX";
+  ASSERT_NE(mkdtemp(dir), nullptr);
+  std::string path = std::string(dir) + "/snapshot";
+  ASSERT_EQ(make_snapshot().save_file(path), "");
+
+  Snapshot loaded;
+  ASSERT_EQ(loaded.take_file(path), "");
+  EXPECT_EQ(loaded.num_workers, 2);
+  EXPECT_EQ(loaded.journal_chkpts, make_snapshot().journal_chkpts);
+  EXPECT_NE(access(path.c_str(), F_OK), 0);
+  EXPECT_EQ(access((path + ".used").c_str(), F_OK), 0);
+
+  Snapshot again;
+  EXPECT_NE(again.take_file(path), "");
+  // the next clean exit writes one again
+  ASSERT_EQ(make_snapshot().save_file(path), "");
+  EXPECT_EQ(again.take_file(path), "");
+
+  unlink((path + ".used").c_str());
+  rmdir(dir);
+}
+
+TEST(SnapshotTest, MatchTotals) {
+  Snapshot s = make_snapshot();
+  // same totals per worker, distributed differently
+  std::vector<std::vector<ResrcAlloc>> init(2, std::vector<ResrcAlloc>(3));
+  for (int wid = 0; wid < 2; ++wid) {
+    init[wid][0] = {.cache_size = 6000,
+                    .bandwidth = 1500 * (wid + 1),
+                    .cpu_cycles = 3'000'000L * (wid + 1)};
+  }
+  EXPECT_TRUE(s.match(init));
+
+  // bandwidth differs by rounding only
+  init[1][1].bandwidth = 3;
+  EXPECT_TRUE(s.match(init));
+
+  // cache must match exactly: the buffer is sized for it
+  init[1][1].cache_size = 1;
+  EXPECT_FALSE(s.match(init));
+  init[1][1].cache_size = 0;
+
+  init.pop_back();
+  EXPECT_FALSE(s.match(init));  // fewer workers
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -196,6 +196,60 @@ TEST(BlockBufferFlusherTest, FlusherTest) {
   EXPECT_EQ(flusher->getDirtyItemNum(), 0);
   flusher->addFgFlushInflightNum(-1);
 }
+
+TEST(BlockBufferFlusherTest, WriteBackTest) {
+  constexpr uint32_t blockNum = 100;
+  constexpr int blockSize = 32;
+  char memPtr[blockNum * blockSize]{};
+  BlockBuffer buffer(blockNum, blockSize, memPtr);
+  Flusher* flusher = &buffer.flusher;
+  const sched::Tag tag = sched::tag::unalloc;
+
+  flusher->setDirtyRatio(0.2);
+  flusher->setDirtyFlushOneTimeSubmitNum(1);
+
+  // dirty 10 blocks of each of index 3, 2 and 1, in descending block number
+  for (uint32_t idx = 3; idx > 0; idx--) {
+    for (block_no_t bno = idx * 1000 + 9; bno >= idx * 1000; bno--) {
+      auto item = buffer.getBlock(bno, idx);
+      buffer.setBlockDirty(item, idx);
+      buffer.releaseBlock(item);
+    }
+  }
+  // 30 > 20: write back to the low watermark (15)
+  EXPECT_EQ(flusher->checkIfTenantNeedWriteBack(tag), 15);
+
+  // index 1 is waiting for fsync; its blocks are left to it
+  flusher->addFgFlushWaitIndex(1);
+  std::list<BlockBufferHandle> flushBlocks;
+  flusher->doWriteBack(tag, 15, flushBlocks);
+  ASSERT_EQ(flushBlocks.size(), 15);
+  std::vector<block_no_t> bnos;
+  for (auto ele : flushBlocks) bnos.push_back(ele.get_key());
+  for (int i = 0; i < 15; i++)
+    EXPECT_EQ(bnos[i], 2000 + (i / 10) * 1000 + i % 10);
+  EXPECT_EQ(flusher->checkIfTenantNeedWriteBack(tag), 0);
+  EXPECT_FALSE(flusher->checkIfIdxWriteBackInflight(1));
+  EXPECT_TRUE(flusher->checkIfIdxWriteBackInflight(2));
+  EXPECT_TRUE(flusher->checkIfIdxWriteBackInflight(3));
+
+  for (auto ele : flushBlocks) buffer.unsetBlockDirty(ele);
+  EXPECT_EQ(flusher->doWriteBackDone(tag), 0);
+  EXPECT_EQ(flusher->doWriteBackDone(tag), -1);
+  EXPECT_FALSE(flusher->checkIfIdxWriteBackInflight(2));
+  EXPECT_EQ(flusher->getDirtyItemNum(), 15);
+
+  // the next one resumes after 3004 and wraps around to index 1
+  flusher->removeFgFlushWaitIndex(1);
+  flushBlocks.clear();
+  flusher->doWriteBack(tag, 8, flushBlocks);
+  ASSERT_EQ(flushBlocks.size(), 8);
+  EXPECT_EQ(flushBlocks.front().get_key(), 3005);
+  EXPECT_EQ(flushBlocks.back().get_key(), 1002);
+  for (auto ele : flushBlocks) buffer.unsetBlockDirty(ele);
+  EXPECT_EQ(flusher->doWriteBackDone(tag), 0);
+  EXPECT_EQ(flusher->getDirtyItemNum(), 7);
+}
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -0,0 +1,194 @@
+// Benchmark of the huge page backend of the block buffers (FsHugePage.h).
+//
+// It serves cache hits the way a worker does: it copies random 4 KB blocks out
+// of a large buffer (the BlockBuffer slots) into the small buffer of an app.
+// The random blocks are what makes the TLB miss: with 4 KB pages, every block
+// is its own page. It compares the backends of the large buffer:
+//   - 4k: regular pages (MADV_NOHUGEPAGE), what malloc gave before
+//   - thp: transparent huge pages
+//   - hugetlb: reserved huge pages (skipped if vm.nr_hugepages is too low)
+//
+// It reports the time and the TSC cycles per block, and the dTLB load misses
+// per block if perf_event_open is allowed (else n/a).
+//
+// Usage: bench_hugepage_copy [-m buffer_mb] [-n num_blocks] [-g]
+//   -g: use 1 GB hugetlb pages instead of 2 MB
+
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "FsHugePage.h"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kBlockSize = 4096;
+// an app reads into a small buffer it reuses, e.g., its read(2) buffer
+constexpr size_t kAppBufSize = 256 * 1024;
+
+struct BenchConfig {
+  size_t bufferMB = 1024;
+  uint64_t numBlocks = 2000000;
+  size_t hugetlbPageSize = 2UL << 20;
+};
+
+struct BenchResult {
+  double nsPerBlock;
+  double cyclesPerBlock;
+  double tlbMissPerBlock;  // < 0 if unknown
+};
+
+enum class Mode { k4k, kThp, kHugetlb };
+
+static const char *modeName(Mode mode) {
+  switch (mode) {
+    case Mode::k4k:
+      return "4k";
+    case Mode::kThp:
+      return "thp";
+    default:
+      return "hugetlb";
+  }
+}
+
+// @return -1 if not allowed (e.g., perf_event_paranoid, or in a VM)
+static int openTlbCounter() {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// @return nullptr if the backend is not available
+static char *mapBuf(Mode mode, size_t size, const BenchConfig &cfg) {
+  fs_hugepage::Config &hpCfg = fs_hugepage::config();
+  if (mode == Mode::k4k) {
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return nullptr;
+    madvise(p, size, MADV_NOHUGEPAGE);
+    return static_cast<char *>(p);
+  }
+  hpCfg.hugetlbPageSize = mode == Mode::kHugetlb ? cfg.hugetlbPageSize : 0;
+  hpCfg.thp = mode == Mode::kThp;
+  fs_hugepage::Backend backend;
+  void *p = fs_hugepage::mapAnon(size, &backend);
+  if (p == nullptr) return nullptr;
+  if ((mode == Mode::kThp) != (backend == fs_hugepage::Backend::kThp)) {
+    fs_hugepage::unmap(p);
+    return nullptr;
+  }
+  return static_cast<char *>(p);
+}
+
+static void unmapBuf(Mode mode, char *buf, size_t size) {
+  if (mode == Mode::k4k) {
+    munmap(buf, size);
+  } else {
+    fs_hugepage::unmap(buf);
+  }
+}
+
+static bool run_one(Mode mode, const BenchConfig &cfg, BenchResult &res) {
+  size_t size = cfg.bufferMB << 20;
+  char *buf = mapBuf(mode, size, cfg);
+  if (buf == nullptr) return false;
+  memset(buf, 1, size);
+  std::vector<char> appBuf(kAppBufSize);
+
+  // the offsets are drawn before, so the loop only copies
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<uint64_t> dist(0, size / kBlockSize - 1);
+  std::vector<uint32_t> blocks(cfg.numBlocks);
+  for (auto &b : blocks) b = dist(rng);
+
+  int fd = openTlbCounter();
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  auto start = Clock::now();
+  uint64_t startTsc = __rdtsc();
+  size_t dst = 0;
+  for (uint32_t b : blocks) {
+    memcpy(appBuf.data() + dst, buf + uint64_t(b) * kBlockSize, kBlockSize);
+    dst = (dst + kBlockSize) % kAppBufSize;
+  }
+  uint64_t cycles = __rdtsc() - startTsc;
+  double ns = std::chrono::duration<double, std::nano>(Clock::now() - start)
+                  .count();
+  uint64_t misses = 0;
+  bool known = false;
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    known = read(fd, &misses, sizeof(misses)) == sizeof(misses);
+    close(fd);
+  }
+
+  res.nsPerBlock = ns / cfg.numBlocks;
+  res.cyclesPerBlock = double(cycles) / cfg.numBlocks;
+  res.tlbMissPerBlock = known ? double(misses) / cfg.numBlocks : -1;
+  unmapBuf(mode, buf, size);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  BenchConfig cfg;
+  int opt;
+  while ((opt = getopt(argc, argv, "m:n:g")) != -1) {
+    switch (opt) {
+      case 'm':
+        cfg.bufferMB = atoi(optarg);
+        break;
+      case 'n':
+        cfg.numBlocks = atoll(optarg);
+        break;
+      case 'g':
+        cfg.hugetlbPageSize = 1UL << 30;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-m buffer_mb] [-n num_blocks] [-g]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+
+  printf("buffer=%zuMB blocks=%lu hugetlb_page=%zuMB\n", cfg.bufferMB,
+         cfg.numBlocks, cfg.hugetlbPageSize >> 20);
+  printf("%-8s %10s %14s %14s\n", "backend", "ns/blk", "cycles/blk",
+         "dTLB_miss/blk");
+  for (auto mode : {Mode::k4k, Mode::kThp, Mode::kHugetlb}) {
+    BenchResult res;
+    if (!run_one(mode, cfg, res)) {
+      printf("%-8s %10s %14s %14s\n", modeName(mode), "n/a", "n/a", "n/a");
+      continue;
+    }
+    if (res.tlbMissPerBlock < 0) {
+      printf("%-8s %10.1lf %14.1lf %14s\n", modeName(mode), res.nsPerBlock,
+             res.cyclesPerBlock, "n/a");
+    } else {
+      printf("%-8s %10.1lf %14.1lf %14.3lf\n", modeName(mode), res.nsPerBlock,
+             res.cyclesPerBlock, res.tlbMissPerBlock);
+    }
+  }
+  return 0;
+}
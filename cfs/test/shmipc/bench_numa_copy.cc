@@ -0,0 +1,236 @@
+// Benchmark of the NUMA placement of worker memory (FsProc_Numa.h).
+//
+// Each thread is a worker pinned to a core, spread over the nodes round-robin.
+// It serves cache hits: it copies 4 KB blocks out of its data partition (the
+// BlockBuffer slots) into the shared memory of its app. It compares:
+//   - naive: every buffer is touched first by the main thread, the way the
+//     master allocated all the partitions and the rings before; they all land
+//     on the node of the main thread
+//   - local: the partition and the app memory are bound to the node of the
+//     worker, the way the workers and the apps are placed now
+//
+// Cross-socket traffic is computed from the placement of the pages: a copy
+// crosses the interconnect for its source if the source page is on another
+// node than the worker, and the same for its destination. The kernel counters
+// of /sys/devices/system/node/nodeN/numastat are reported as well: other_node
+// counts the pages allocated on a node for a task running on another one.
+//
+// On a single-node machine, both placements are the same and the traffic is
+// reported as n/a.
+//
+// Usage: bench_numa_copy [-t num_workers] [-m partition_mb] [-r rounds]
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "FsProc_Numa.h"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kBlockSize = 4096;
+// an app reads into a small buffer it reuses, e.g., its read(2) buffer
+constexpr size_t kAppBufSize = 256 * 1024;
+
+struct BenchConfig {
+  int numWorkers = 0;  // default: two per node
+  size_t partitionMB = 256;
+  int rounds = 10;
+};
+
+struct BenchResult {
+  double gbps;
+  double crossGB;  // < 0 if unknown
+  double crossRatio;
+  uint64_t otherNodePages;
+};
+
+enum class Placement { kNaive, kLocal };
+
+static const char *placementName(Placement p) {
+  return p == Placement::kNaive ? "naive" : "local";
+}
+
+struct Worker {
+  int cpu;
+  int node;
+  char *partition;
+  char *appBuf;
+  size_t partitionSize;
+};
+
+static void pinSelf(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static char *mapBuf(size_t size) {
+  void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  return static_cast<char *>(p);
+}
+
+// fraction of the pages of [buf, buf + size) that are not on `node`
+// @return < 0 if the placement is unknown
+static double remoteRatio(const char *buf, size_t size, int node) {
+  if (node < 0) return -1;
+  size_t pages = 0, remote = 0;
+  for (size_t off = 0; off < size; off += kBlockSize) {
+    int n = fsp_numa::nodeOfAddr(buf + off);
+    if (n < 0) return -1;
+    pages++;
+    remote += n != node;
+  }
+  return double(remote) / pages;
+}
+
+static uint64_t sumOtherNode() {
+  uint64_t sum = 0;
+  fsp_numa::NodeStat stat;
+  for (int node = 0; node < fsp_numa::numNodes(); node++)
+    if (fsp_numa::readNodeStat(node, stat)) sum += stat.otherNode;
+  return sum;
+}
+
+static BenchResult run_one(std::vector<Worker> &workers, Placement placement,
+                           const BenchConfig &cfg) {
+  uint64_t otherNodeBefore = sumOtherNode();
+  for (auto &w : workers) {
+    w.partitionSize = cfg.partitionMB << 20;
+    w.partition = mapBuf(w.partitionSize);
+    w.appBuf = mapBuf(kAppBufSize);
+    if (placement == Placement::kLocal) {
+      fsp_numa::bindToNode(w.partition, w.partitionSize, w.node);
+      fsp_numa::bindToNode(w.appBuf, kAppBufSize, w.node);
+    }
+    // the main thread touches everything first, as the master does
+    memset(w.partition, 1, w.partitionSize);
+    memset(w.appBuf, 0, kAppBufSize);
+  }
+  uint64_t otherNodePages = sumOtherNode() - otherNodeBefore;
+
+  std::atomic_int ready{0};
+  std::atomic_bool go{false};
+  std::vector<std::thread> threads;
+  for (auto &w : workers) {
+    threads.emplace_back([&, wp = &w] {
+      pinSelf(wp->cpu);
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire))
+        ;
+      size_t dst = 0;
+      for (int r = 0; r < cfg.rounds; r++) {
+        for (size_t src = 0; src < wp->partitionSize; src += kBlockSize) {
+          memcpy(wp->appBuf + dst, wp->partition + src, kBlockSize);
+          dst = (dst + kBlockSize) % kAppBufSize;
+        }
+      }
+    });
+  }
+  while (ready.load() < int(workers.size()))
+    ;
+  auto start = Clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto &t : threads) t.join();
+  double sec = std::chrono::duration<double>(Clock::now() - start).count();
+
+  BenchResult res;
+  double bytes = 0, crossBytes = 0;
+  bool known = true;
+  for (auto &w : workers) {
+    double perWorker = double(w.partitionSize) * cfg.rounds;
+    bytes += perWorker;
+    double src = remoteRatio(w.partition, w.partitionSize, w.node);
+    double dst = remoteRatio(w.appBuf, kAppBufSize, w.node);
+    if (src < 0 || dst < 0) known = false;
+    crossBytes += perWorker * (src + dst);
+    munmap(w.partition, w.partitionSize);
+    munmap(w.appBuf, kAppBufSize);
+  }
+  res.gbps = bytes / sec / 1e9;
+  res.crossGB = known ? crossBytes / 1e9 : -1;
+  // both the source and the destination may cross
+  res.crossRatio = known ? crossBytes / (2 * bytes) : -1;
+  res.otherNodePages = otherNodePages;
+  return res;
+}
+
+int main(int argc, char **argv) {
+  BenchConfig cfg;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:m:r:")) != -1) {
+    switch (opt) {
+      case 't':
+        cfg.numWorkers = atoi(optarg);
+        break;
+      case 'm':
+        cfg.partitionMB = atoi(optarg);
+        break;
+      case 'r':
+        cfg.rounds = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr,
+                "Usage: %s [-t num_workers] [-m partition_mb] [-r rounds]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+
+  int numNodes = fsp_numa::numNodes();
+  if (cfg.numWorkers <= 0) cfg.numWorkers = 2 * numNodes;
+  // spread the workers over the nodes round-robin
+  std::vector<Worker> workers;
+  std::vector<std::vector<int>> nodeCores(numNodes);
+  size_t numCores = 0;
+  for (int node = 0; node < numNodes; node++) {
+    nodeCores[node] = fsp_numa::coresOfNode(node);
+    numCores += nodeCores[node].size();
+  }
+  if (size_t(cfg.numWorkers) > numCores) {
+    fprintf(stderr, "Not enough physical cores for %d workers\n",
+            cfg.numWorkers);
+    return 1;
+  }
+  for (int i = 0; int(workers.size()) < cfg.numWorkers; i++) {
+    int node = i % numNodes;
+    size_t idx = i / numNodes;
+    if (idx >= nodeCores[node].size()) continue;
+    int cpu = nodeCores[node][idx];
+    workers.push_back({cpu, fsp_numa::nodeOfCpu(cpu), nullptr, nullptr, 0});
+  }
+  // the main thread plays the master, on the first core of node 0
+  pinSelf(workers[0].cpu);
+
+  printf("nodes=%d workers=%d partition=%zuMB rounds=%d\n", numNodes,
+         cfg.numWorkers, cfg.partitionMB, cfg.rounds);
+  printf("%-6s %8s %10s %8s %15s\n", "place", "GB/s", "cross_GB", "cross%",
+         "other_node_pgs");
+  for (auto placement : {Placement::kNaive, Placement::kLocal}) {
+    auto res = run_one(workers, placement, cfg);
+    if (res.crossGB < 0) {
+      printf("%-6s %8.2lf %10s %8s %15lu\n", placementName(placement),
+             res.gbps, "n/a", "n/a", res.otherNodePages);
+    } else {
+      printf("%-6s %8.2lf %10.2lf %7.1lf%% %15lu\n", placementName(placement),
+             res.gbps, res.crossGB, res.crossRatio * 100, res.otherNodePages);
+    }
+  }
+  return 0;
+}
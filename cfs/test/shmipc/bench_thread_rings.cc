@@ -0,0 +1,214 @@
+// Scaling benchmark of the app -> worker request rings.
+//
+// One server thread (the worker) serves N client threads (the app threads)
+// with either:
+//   - shared: one multi-producer ring for all the threads (the default before
+//     CFS_OP_THREAD_RING), slots are allocated with an atomic bump on next
+//   - thread: one single-producer ring per thread, polled round-robin
+//
+// Each client thread issues synchronous requests (alloc, put, wait, dealloc)
+// and records the round-trip latency. To model requests that take longer in
+// the worker (e.g., waiting for the device), every <slow_every>-th request is
+// completed <slow_us> later while the server keeps serving the others; on a
+// shared ring, such a slot blocks every thread that wraps around onto it.
+//
+// Usage: bench_thread_rings [-t max_threads] [-n ops_per_thread]
+//                           [-s shared_ring_size] [-e slow_every] [-u slow_us]
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include "shmipc/shmipc.h"
+
+using Clock = std::chrono::steady_clock;
+
+// same as RING_SIZE and THREAD_RING_SIZE in param.h
+constexpr size_t kSharedRingSize = 512;
+constexpr size_t kThreadRingSize = 64;
+
+struct BenchConfig {
+  int maxThreads = 64;
+  int opsPerThread = 20000;
+  size_t sharedRingSize = kSharedRingSize;
+  size_t threadRingSize = kThreadRingSize;
+  int slowEvery = 0;  // 0: no slow requests
+  int slowUs = 50;
+};
+
+struct BenchResult {
+  double kops;
+  double avgUs;
+  double p50Us;
+  double p99Us;
+};
+
+static void server_loop(std::vector<struct shmipc_mgr *> &rings,
+                        std::atomic_bool &stop, const BenchConfig &cfg) {
+  struct Deferred {
+    Clock::time_point due;
+    struct shmipc_msg *msg;
+  };
+  std::deque<Deferred> deferred;
+  uint64_t numServed = 0;
+  size_t cursor = 0;
+  off_t idx;
+  while (!stop.load(std::memory_order_relaxed) || !deferred.empty()) {
+    auto now = Clock::now();
+    while (!deferred.empty() && deferred.front().due <= now) {
+      SHMIPC_SET_MSG_STATUS(deferred.front().msg,
+                            shmipc_STATUS_READY_FOR_CLIENT);
+      deferred.pop_front();
+    }
+    bool found = false;
+    for (size_t i = 0; i < rings.size(); i++) {
+      auto ring = rings[cursor];
+      cursor = (cursor + 1) % rings.size();
+      auto msg = shmipc_mgr_get_msg_nowait(ring, &idx);
+      if (msg == nullptr) continue;
+      found = true;
+      msg->status = shmipc_STATUS_IN_PROGRESS;
+      msg->retval = *(int *)msg->inline_data;
+      if (cfg.slowEvery > 0 && ++numServed % cfg.slowEvery == 0) {
+        deferred.push_back(
+            {now + std::chrono::microseconds(cfg.slowUs), msg});
+      } else {
+        SHMIPC_SET_MSG_STATUS(msg, shmipc_STATUS_READY_FOR_CLIENT);
+      }
+      break;
+    }
+    // let the clients run if there are fewer cores than threads
+    if (!found) std::this_thread::yield();
+  }
+}
+
+static void client_loop(struct shmipc_mgr *ring, int tid,
+                        const BenchConfig &cfg, std::vector<uint32_t> &lats) {
+  struct shmipc_msg msg;
+  lats.reserve(cfg.opsPerThread);
+  for (int i = 0; i < cfg.opsPerThread; i++) {
+    memset(&msg, 0, sizeof(msg));
+    msg.type = 1;
+    *(int *)msg.inline_data = tid;
+    auto start = Clock::now();
+    off_t ring_idx = shmipc_mgr_alloc_slot(ring);
+    shmipc_mgr_put_msg(ring, ring_idx, &msg);
+    shmipc_mgr_dealloc_slot(ring, ring_idx);
+    auto end = Clock::now();
+    if (msg.retval != tid) {
+      fprintf(stderr, "tid:%d got response of %ld\n", tid, msg.retval);
+      exit(1);
+    }
+    lats.push_back(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count());
+  }
+}
+
+static BenchResult run_one(int numThreads, bool perThreadRing,
+                           const BenchConfig &cfg) {
+  char name[64];
+  std::vector<struct shmipc_mgr *> serverRings, clientRings;
+  int numRings = perThreadRing ? numThreads : 1;
+  size_t ringSize = perThreadRing ? cfg.threadRingSize : cfg.sharedRingSize;
+  for (int i = 0; i < numRings; i++) {
+    snprintf(name, sizeof(name), "/bench_thread_rings_%d_%d", getpid(), i);
+    auto server = shmipc_mgr_init(name, ringSize, 1);
+    auto client = shmipc_mgr_init(name, ringSize, 0);
+    if (server == nullptr || client == nullptr) {
+      fprintf(stderr, "cannot create ring %s\n", name);
+      exit(1);
+    }
+    client->single_producer = perThreadRing;
+    serverRings.push_back(server);
+    clientRings.push_back(client);
+  }
+
+  std::atomic_bool stop{false};
+  std::thread server(server_loop, std::ref(serverRings), std::ref(stop),
+                     std::cref(cfg));
+  std::vector<std::vector<uint32_t>> lats(numThreads);
+  std::vector<std::thread> clients;
+  auto start = Clock::now();
+  for (int i = 0; i < numThreads; i++) {
+    clients.emplace_back(client_loop, clientRings[perThreadRing ? i : 0],
+                         i + 1, std::cref(cfg), std::ref(lats[i]));
+  }
+  for (auto &t : clients) t.join();
+  double sec = std::chrono::duration<double>(Clock::now() - start).count();
+  stop = true;
+  server.join();
+
+  for (auto ring : clientRings) shmipc_mgr_destroy(ring);
+  for (auto ring : serverRings) shmipc_mgr_destroy(ring);
+
+  std::vector<uint32_t> all;
+  for (auto &v : lats) all.insert(all.end(), v.begin(), v.end());
+  std::sort(all.begin(), all.end());
+  double sum = 0;
+  for (auto l : all) sum += l;
+  BenchResult res;
+  res.kops = all.size() / sec / 1000;
+  res.avgUs = sum / all.size() / 1000;
+  res.p50Us = all[all.size() / 2] / 1000.0;
+  res.p99Us = all[all.size() * 99 / 100] / 1000.0;
+  return res;
+}
+
+int main(int argc, char **argv) {
+  BenchConfig cfg;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:n:s:e:u:")) != -1) {
+    switch (opt) {
+      case 't':
+        cfg.maxThreads = atoi(optarg);
+        break;
+      case 'n':
+        cfg.opsPerThread = atoi(optarg);
+        break;
+      case 's':
+        cfg.sharedRingSize = atoi(optarg);
+        break;
+      case 'e':
+        cfg.slowEvery = atoi(optarg);
+        break;
+      case 'u':
+        cfg.slowUs = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr,
+                "Usage: %s [-t max_threads] [-n ops_per_thread] "
+                "[-s shared_ring_size] [-e slow_every] [-u slow_us]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if (cfg.maxThreads < 1 || cfg.opsPerThread < 1) return 1;
+
+  printf("ops/thread:%d shared_ring:%zu thread_ring:%zu slow_every:%d "
+         "slow_us:%d\n",
+         cfg.opsPerThread, cfg.sharedRingSize, cfg.threadRingSize,
+         cfg.slowEvery, cfg.slowUs);
+  printf("%8s %8s %10s %10s %10s %10s\n", "threads", "rings", "kops",
+         "avg_us", "p50_us", "p99_us");
+  for (int n = 1; n <= cfg.maxThreads; n *= 2) {
+    for (bool perThreadRing : {false, true}) {
+      auto res = run_one(n, perThreadRing, cfg);
+      printf("%8d %8s %10.1f %10.3f %10.3f %10.3f\n", n,
+             perThreadRing ? "thread" : "shared", res.kops, res.avgUs,
+             res.p50Us, res.p99Us);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,221 @@
+// Benchmark of the inter-worker messenger (FsProcMessenger).
+//
+// N sender threads (the workers) send messages to one receiver (a worker or
+// the load monitor), which polls the way a worker does in its run loop. It
+// compares:
+//   - shmipc: the former FsProcMsgRing, one multi-producer shmipc ring per
+//     receiver; every message allocates a slot with an atomic bump on next
+//   - spsc: FsProcMessenger, one single-producer ring per (sender, receiver)
+//     and a doorbell, sending one message at a time
+//   - spsc-batch: same, sending <batch> messages with one put
+//
+// Every message carries its send timestamp, so the receiver records the
+// one-way latency.
+//
+// Usage: bench_worker_messenger [-t max_senders] [-n msgs_per_sender]
+//                               [-b batch]
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "FsProc_Messenger.h"
+#include "shmipc/shmipc.h"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kRingSize = DEFAULT_MESSENGER_BUFSIZE;
+
+struct BenchConfig {
+  int maxSenders = 8;
+  int msgsPerSender = 200000;
+  int batch = 16;
+};
+
+struct BenchResult {
+  double kops;
+  double avgUs;
+  double p50Us;
+  double p99Us;
+};
+
+// The FsProcMsgRing before FsProcMessenger moved to per-sender rings.
+class ShmipcMsgRing {
+ public:
+  explicit ShmipcMsgRing(size_t capacity) {
+    ring_ = (struct shmipc_msg *)calloc(capacity, sizeof(struct shmipc_msg));
+    initShmipcMgr(&producer_, capacity);
+    initShmipcMgr(&consumer_, capacity);
+  }
+  ~ShmipcMsgRing() { free(ring_); }
+
+  void put_message(const FsProcMessage &fsp_msg) {
+    struct shmipc_msg msg;
+    msg.status = shmipc_STATUS_RESERVED;
+    msg.type = fsp_msg.type;
+    *(void **)(msg.inline_data) = fsp_msg.ctx;
+    off_t ring_idx = shmipc_mgr_alloc_slot(&producer_);
+    shmipc_mgr_put_msg_nowait(&producer_, ring_idx, &msg);
+  }
+
+  bool get_message(FsProcMessage &fsp_msg) {
+    off_t idx;
+    struct shmipc_msg *msg = shmipc_mgr_get_msg_nowait(&consumer_, &idx);
+    if (msg == nullptr) return false;
+    fsp_msg.type = msg->type;
+    fsp_msg.ctx = *(void **)(msg->inline_data);
+    shmipc_mgr_dealloc_slot(&consumer_, idx);
+    return true;
+  }
+
+ private:
+  struct shmipc_msg *ring_;
+  struct shmipc_mgr producer_;
+  struct shmipc_mgr consumer_;
+
+  void initShmipcMgr(struct shmipc_mgr *mgr, size_t capacity) {
+    memset(mgr, 0, sizeof(*mgr));
+    mgr->ring = ring_;
+    mgr->capacity = capacity;
+    mgr->mask = capacity - 1;
+  }
+};
+
+enum class Mode { kShmipc, kSpsc, kSpscBatch };
+
+static const char *modeName(Mode mode) {
+  switch (mode) {
+    case Mode::kShmipc:
+      return "shmipc";
+    case Mode::kSpsc:
+      return "spsc";
+    default:
+      return "spsc-batch";
+  }
+}
+
+static uint64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::now().time_since_epoch())
+      .count();
+}
+
+static BenchResult run_one(int numSenders, Mode mode, const BenchConfig &cfg) {
+  ShmipcMsgRing shmipcRing(kRingSize);
+  FsProcMessenger messenger(numSenders + 1, kRingSize);
+  // the receiver is the last worker; the others send
+  const int dst = numSenders;
+  const uint64_t total = uint64_t(numSenders) * cfg.msgsPerSender;
+
+  std::vector<uint32_t> lats;
+  lats.reserve(total);
+  std::atomic_bool go{false};
+  auto receiver = std::thread([&] {
+    FsProcMessage msgs[FsProcMessenger::kMaxRecvBatch];
+    while (!go.load(std::memory_order_acquire))
+      ;
+    while (lats.size() < total) {
+      size_t n = 0;
+      if (mode == Mode::kShmipc) {
+        while (n < std::size(msgs) && shmipcRing.get_message(msgs[n])) n++;
+      } else {
+        n = messenger.recv_messages(dst, msgs, std::size(msgs));
+      }
+      if (n == 0) {
+        // let the senders run if there are fewer cores than threads
+        std::this_thread::yield();
+        continue;
+      }
+      uint64_t now = nowNs();
+      for (size_t i = 0; i < n; i++)
+        lats.push_back(now - reinterpret_cast<uintptr_t>(msgs[i].ctx));
+    }
+  });
+
+  std::vector<std::thread> senders;
+  for (int src = 0; src < numSenders; src++) {
+    senders.emplace_back([&, src] {
+      int batch = mode == Mode::kSpscBatch ? cfg.batch : 1;
+      std::vector<FsProcMessage> msgs(batch);
+      while (!go.load(std::memory_order_acquire))
+        ;
+      for (int i = 0; i < cfg.msgsPerSender; i += batch) {
+        int n = std::min(batch, cfg.msgsPerSender - i);
+        uint64_t ts = nowNs();
+        for (int j = 0; j < n; j++) {
+          msgs[j].type = FsProcMessageType::NOOP;
+          msgs[j].ctx = reinterpret_cast<void *>(uintptr_t(ts));
+        }
+        if (mode == Mode::kShmipc) {
+          for (int j = 0; j < n; j++) shmipcRing.put_message(msgs[j]);
+        } else {
+          messenger.send_messages_from(src, dst, msgs.data(), n);
+        }
+      }
+    });
+  }
+
+  auto start = Clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto &t : senders) t.join();
+  receiver.join();
+  double sec = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::sort(lats.begin(), lats.end());
+  double sum = 0;
+  for (auto l : lats) sum += l;
+  BenchResult res;
+  res.kops = lats.size() / sec / 1000;
+  res.avgUs = sum / lats.size() / 1000;
+  res.p50Us = lats[lats.size() / 2] / 1000.0;
+  res.p99Us = lats[lats.size() * 99 / 100] / 1000.0;
+  return res;
+}
+
+int main(int argc, char **argv) {
+  BenchConfig cfg;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:n:b:")) != -1) {
+    switch (opt) {
+      case 't':
+        cfg.maxSenders = atoi(optarg);
+        break;
+      case 'n':
+        cfg.msgsPerSender = atoi(optarg);
+        break;
+      case 'b':
+        cfg.batch = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr,
+                "Usage: %s [-t max_senders] [-n msgs_per_sender] [-b batch]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  // one of the workers is the receiver
+  cfg.maxSenders = std::min(cfg.maxSenders, NMAX_FSP_WORKER - 1);
+  if (cfg.maxSenders < 1 || cfg.msgsPerSender < 1 || cfg.batch < 1) return 1;
+
+  printf("msgs/sender:%d ring:%zu batch:%d\n", cfg.msgsPerSender, kRingSize,
+         cfg.batch);
+  printf("%8s %11s %10s %10s %10s %10s\n", "senders", "ring", "kops",
+         "avg_us", "p50_us", "p99_us");
+  for (int n = 1; n <= cfg.maxSenders; n *= 2) {
+    for (Mode mode : {Mode::kShmipc, Mode::kSpsc, Mode::kSpscBatch}) {
+      auto res = run_one(n, mode, cfg);
+      printf("%8d %11s %10.1f %10.3f %10.3f %10.3f\n", n, modeName(mode),
+             res.kops, res.avgUs, res.p50Us, res.p99Us);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
@@ -788,6 +788,7 @@ class Benchmark {
     benchmark_fn_map_["opendir"] = &Benchmark::BenchOpendir;
     benchmark_fn_map_["listdirinfo1"] = &Benchmark::BenchListdirInfo1;
     benchmark_fn_map_["listdirinfo2"] = &Benchmark::BenchListdirInfo2;
+    benchmark_fn_map_["listdirplus"] = &Benchmark::BenchListdirPlus;
     benchmark_fn_map_["rmdir"] = &Benchmark::BenchRmdir;
     benchmark_fn_map_["rename"] = &Benchmark::BenchRename;
     benchmark_fn_map_["namegen"] = &Benchmark::BenchNameGeneration;
@@ -2652,6 +2653,79 @@ class Benchmark {
         }
       } while (1);
 
+#ifndef CFS_USE_POSIX
+      fs_closedir(dentryPtr);
+#else
+      closedir(dentryPtr);
+#endif
+      // finish one op
+      thread->stats.FinishedSingleOp();
+
+      if (cc.check_server_said_stop()) break;
+    }
+#ifndef CFS_USE_POSIX
+    fs_free(initShmPtr);
+#endif
+
+    // benchmark done
+    cc.notify_server_that_client_stopped();
+    thread->stats.Stop();
+  }
+
+  // opendirplus()+readdirplus(), the attributes come with the entries
+  // same work as listdirinfo1 (POSIX has no readdirplus, so it does stat())
+  void BenchListdirPlus(ThreadState *thread) {
+    PinToCore(thread);
+    if (numop_ != FLAGS_numop) {
+      char msg[100];
+      snprintf(msg, sizeof(msg), "(%d ops)", numop_);
+      thread->stats.AddMessage(msg);
+    }
+
+    std::string basepath = dir_.ToString();
+    basepath += "/";
+
+#ifndef CFS_USE_POSIX
+    struct CFS_DIR *dentryPtr = nullptr;
+    void *initShmPtr = fs_malloc(4096);
+#else
+    DIR *dentryPtr = nullptr;
+#endif
+
+    CoordinatorClient cc(FLAGS_coordinator_shm_fname, 0);
+    cc.notify_server_that_client_is_ready();
+    cc.wait_till_server_says_start();
+
+    thread->stats.Start();
+    for (int i = 0; i < numop_; i++) {
+#ifndef CFS_USE_POSIX
+      dentryPtr = fs_opendirplus(basepath.c_str());
+#else
+      dentryPtr = opendir(basepath.c_str());
+#endif
+      if (dentryPtr == nullptr) {
+        fprintf(stderr, "Failed to opendir\n");
+        cc.notify_server_that_client_stopped();
+        return;
+      }
+
+      // iterate the whole directory
+      struct dirent *dp;
+      struct stat statbuf;
+      do {
+#ifndef CFS_USE_POSIX
+        dp = fs_readdirplus(dentryPtr, &statbuf);
+#else
+        dp = readdir(dentryPtr);
+        if (dp != NULL) {
+          std::string stat_path = basepath + dp->d_name;
+          if (::stat(stat_path.c_str(), &statbuf) != 0) {
+            fprintf(stderr, "Failed to stat %s\n", stat_path.c_str());
+          }
+        }
+#endif
+      } while (dp != NULL);
+
 #ifndef CFS_USE_POSIX
       fs_closedir(dentryPtr);
 #else
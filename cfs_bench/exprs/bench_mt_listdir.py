@@ -53,6 +53,10 @@ if len(sys.argv) >= 4:
         if 'statonly' in v:
             # if set, invoke "listdirinfo2" benchmark (timing only stat)
             listdir_option = "listdirinfo2"
+        if 'plus' in v:
+            # if set, invoke "listdirplus" benchmark (readdirplus, timing the
+            # whole)
+            listdir_option = "listdirplus"
         if 'rand' in v:
             # will randomlize the file path to access (to avoid the contention)
             cur_is_random = True